@@ -19,6 +19,8 @@
 #define LOG_TAG "Camera2-Metadata"
 #include <utils/Log.h>
 #include <utils/Errors.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <binder/Parcel.h>
 #include <camera/CameraMetadata.h>
@@ -302,6 +304,19 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
         ALOGE("%s: Tag %d not found", __FUNCTION__, tag);
         return BAD_VALUE;
     }
+
+    // An entry that keeps its size is rewritten in place; this is the common
+    // case for per-frame settings and needs neither a resize nor a search.
+    // memmove copes with data pointing into the entry itself.
+    camera_metadata_entry_t entry;
+    res = findEntry(tag, &entry);
+    if (res == OK && entry.type == type && entry.count == data_count) {
+        if (data_count > 0) {
+            memmove(entry.data.u8, data, camera_metadata_type_size[type] * data_count);
+        }
+        return OK;
+    }
+
     // Safety check - ensure that data isn't pointing to this metadata, since
     // that would get invalidated if a resize is needed
     size_t bufferSize = get_camera_metadata_size(mBuffer);
@@ -319,8 +334,7 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     res = resizeIfNeeded(1, data_size);
 
     if (res == OK) {
-        camera_metadata_entry_t entry;
-        res = find_camera_metadata_entry(mBuffer, tag, &entry);
+        res = findEntry(tag, &entry);
         if (res == NAME_NOT_FOUND) {
             res = add_camera_metadata_entry(mBuffer,
                     tag, data, data_count);
@@ -360,6 +374,8 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
         entry.count = 0;
         return entry;
     }
+    // Not through findEntry(): find() may be called on metadata that other
+    // threads are reading too, and filling in mTagIndex writes to it.
     res = find_camera_metadata_entry(mBuffer, tag, &entry);
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
@@ -386,7 +402,7 @@ status_t CameraMetadata::erase(uint32_t tag) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    res = findEntry(tag, &entry);
     if (res == NAME_NOT_FOUND) {
         return OK;
     } else if (res != OK) {
@@ -406,6 +422,157 @@ status_t CameraMetadata::erase(uint32_t tag) {
     return res;
 }
 
+status_t CameraMetadata::findEntry(uint32_t tag, camera_metadata_entry_t *entry) {
+    if (mBuffer == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    if (mTagIndex.isEmpty()) {
+        TagIndexSlot empty = { 0, UINT32_MAX };
+        mTagIndex.insertAt(empty, 0, 1 << kTagIndexBits);
+    }
+
+    // Multiplicative hashing mixes the section bits of the tag into the slot
+    TagIndexSlot &slot = mTagIndex.editItemAt((tag * 2654435761u) >> (32 - kTagIndexBits));
+    if (slot.tag == tag && slot.index < get_camera_metadata_entry_count(mBuffer) &&
+            get_camera_metadata_entry(mBuffer, slot.index, entry) == OK &&
+            entry->tag == tag) {
+        return OK;
+    }
+
+    status_t res = find_camera_metadata_entry(mBuffer, tag, entry);
+    if (res == OK) {
+        slot.tag = tag;
+        slot.index = entry->index;
+    }
+    return res;
+}
+
+static bool entryDataEquals(const camera_metadata_ro_entry_t &a,
+        const camera_metadata_ro_entry_t &b) {
+    if (a.type != b.type || a.count != b.count) {
+        return false;
+    }
+    return a.count == 0 ||
+            memcmp(a.data.u8, b.data.u8, camera_metadata_type_size[a.type] * a.count) == 0;
+}
+
+status_t CameraMetadata::diff(const CameraMetadata &other, Vector<uint32_t> *tags) const {
+    if (tags == NULL) {
+        return BAD_VALUE;
+    }
+    tags->clear();
+
+    camera_metadata_ro_entry_t entry, otherEntry;
+    size_t count = entryCount();
+    for (size_t i = 0; i < count; i++) {
+        get_camera_metadata_ro_entry(mBuffer, i, &entry);
+        if (find_camera_metadata_ro_entry(other.mBuffer, entry.tag, &otherEntry) != OK ||
+                !entryDataEquals(entry, otherEntry)) {
+            tags->add(entry.tag);
+        }
+    }
+    size_t otherCount = other.entryCount();
+    for (size_t i = 0; i < otherCount; i++) {
+        get_camera_metadata_ro_entry(other.mBuffer, i, &otherEntry);
+        if (!exists(otherEntry.tag)) {
+            tags->add(otherEntry.tag);
+        }
+    }
+    return OK;
+}
+
+status_t CameraMetadata::patch(const CameraMetadata &other, size_t *changedCount) {
+    return patch(other.mBuffer, changedCount);
+}
+
+status_t CameraMetadata::patch(const camera_metadata_t *other, size_t *changedCount) {
+    status_t res;
+    size_t changed = 0;
+    if (changedCount != NULL) {
+        *changedCount = 0;
+    }
+    if (mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+    if (other == mBuffer) {
+        return OK;
+    }
+    if (other == NULL) {
+        changed = entryCount();
+        clear();
+        if (changedCount != NULL) {
+            *changedCount = changed;
+        }
+        return OK;
+    }
+
+    camera_metadata_entry_t entry;
+    camera_metadata_ro_entry_t otherEntry;
+
+    // Erase tags that other doesn't have first, to free up room. Walk
+    // backwards so that deleting doesn't move the entries still to be visited.
+    for (size_t i = entryCount(); i > 0; i--) {
+        get_camera_metadata_entry(mBuffer, i - 1, &entry);
+        if (find_camera_metadata_ro_entry(other, entry.tag, &otherEntry) == OK) {
+            continue;
+        }
+        res = delete_camera_metadata_entry(mBuffer, i - 1);
+        if (res != OK) {
+            ALOGE("%s: Error deleting entry %x: %s (%d)", __FUNCTION__, entry.tag,
+                    strerror(-res), res);
+            return res;
+        }
+        changed++;
+    }
+
+    size_t otherCount = get_camera_metadata_entry_count(other);
+    for (size_t i = 0; i < otherCount; i++) {
+        get_camera_metadata_ro_entry(other, i, &otherEntry);
+        res = findEntry(otherEntry.tag, &entry);
+        bool found = (res == OK);
+        if (found) {
+            camera_metadata_ro_entry_t current;
+            get_camera_metadata_ro_entry(mBuffer, entry.index, &current);
+            if (entryDataEquals(current, otherEntry)) {
+                continue;
+            }
+            if (entry.type == otherEntry.type && entry.count == otherEntry.count) {
+                memcpy(entry.data.u8, otherEntry.data.u8,
+                        camera_metadata_type_size[entry.type] * entry.count);
+                changed++;
+                continue;
+            }
+        } else if (res != NAME_NOT_FOUND) {
+            return res;
+        }
+
+        // Resizing keeps the entry order, so entry.index stays valid
+        res = resizeIfNeeded(1, calculate_camera_metadata_entry_data_size(otherEntry.type,
+                otherEntry.count));
+        if (res == OK && found) {
+            res = update_camera_metadata_entry(mBuffer, entry.index, otherEntry.data.u8,
+                    otherEntry.count, NULL);
+        } else if (res == OK) {
+            res = add_camera_metadata_entry(mBuffer, otherEntry.tag, otherEntry.data.u8,
+                    otherEntry.count);
+        }
+        if (res != OK) {
+            ALOGE("%s: Unable to update metadata entry %s.%s (%x): %s (%d)",
+                    __FUNCTION__, get_camera_metadata_section_name(otherEntry.tag),
+                    get_camera_metadata_tag_name(otherEntry.tag), otherEntry.tag,
+                    strerror(-res), res);
+            return res;
+        }
+        changed++;
+    }
+
+    if (changedCount != NULL) {
+        *changedCount = changed;
+    }
+    return OK;
+}
+
 void CameraMetadata::dump(int fd, int verbosity, int indentation) const {
     dump_indented_camera_metadata(mBuffer, fd, verbosity, indentation);
 }
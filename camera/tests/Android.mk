@@ -18,7 +18,8 @@ LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 
 LOCAL_SRC_FILES:= \
 	VendorTagDescriptorTests.cpp \
-	CameraBinderTests.cpp
+	CameraBinderTests.cpp \
+	CameraMetadataTests.cpp
 
 LOCAL_SHARED_LIBRARIES := \
 	libutils \
@@ -42,3 +43,20 @@ LOCAL_MODULE:= camera_client_test
 LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	CameraMetadataBench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libcamera_metadata \
+	libcamera_client
+
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+
+LOCAL_MODULE:= camera_metadata_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times the CameraMetadata operations a repeating request goes through every
+// frame: updating per-frame tags, finding them again, copying the whole
+// request, and bringing a copy up to date with patch() instead.
+
+#include <camera/CameraMetadata.h>
+#include <system/camera_metadata.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace android;
+
+// Tags a typical preview request carries; the first few change every frame.
+static const uint32_t kPerFrameTags[] = {
+    ANDROID_REQUEST_ID,
+    ANDROID_SENSOR_EXPOSURE_TIME,
+    ANDROID_SENSOR_SENSITIVITY,
+    ANDROID_LENS_FOCUS_DISTANCE,
+};
+
+static const uint32_t kStaticTags[] = {
+    ANDROID_CONTROL_MODE,
+    ANDROID_CONTROL_AE_MODE,
+    ANDROID_CONTROL_AE_LOCK,
+    ANDROID_CONTROL_AE_ANTIBANDING_MODE,
+    ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
+    ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER,
+    ANDROID_CONTROL_AF_MODE,
+    ANDROID_CONTROL_AF_TRIGGER,
+    ANDROID_CONTROL_AWB_MODE,
+    ANDROID_CONTROL_AWB_LOCK,
+    ANDROID_CONTROL_CAPTURE_INTENT,
+    ANDROID_CONTROL_EFFECT_MODE,
+    ANDROID_CONTROL_SCENE_MODE,
+    ANDROID_CONTROL_VIDEO_STABILIZATION_MODE,
+    ANDROID_COLOR_CORRECTION_MODE,
+    ANDROID_COLOR_CORRECTION_ABERRATION_MODE,
+    ANDROID_EDGE_MODE,
+    ANDROID_FLASH_MODE,
+    ANDROID_HOT_PIXEL_MODE,
+    ANDROID_LENS_OPTICAL_STABILIZATION_MODE,
+    ANDROID_NOISE_REDUCTION_MODE,
+    ANDROID_SHADING_MODE,
+    ANDROID_STATISTICS_FACE_DETECT_MODE,
+    ANDROID_STATISTICS_LENS_SHADING_MAP_MODE,
+    ANDROID_TONEMAP_MODE,
+    ANDROID_JPEG_QUALITY,
+    ANDROID_JPEG_THUMBNAIL_QUALITY,
+};
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void updatePerFrameTags(CameraMetadata *request, int frame) {
+    int32_t requestId = frame;
+    int64_t exposureTime = 10000000 + frame;
+    int32_t sensitivity = 100 + frame % 100;
+    float focusDistance = (frame % 10) / 10.0f;
+    request->update(ANDROID_REQUEST_ID, &requestId, 1);
+    request->update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1);
+    request->update(ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1);
+    request->update(ANDROID_LENS_FOCUS_DISTANCE, &focusDistance, 1);
+}
+
+static void buildRequest(CameraMetadata *request) {
+    uint8_t zero = 0;
+    int32_t zero32 = 0;
+    for (size_t i = 0; i < sizeof(kStaticTags) / sizeof(kStaticTags[0]); ++i) {
+        if (get_camera_metadata_tag_type(kStaticTags[i]) == TYPE_INT32) {
+            request->update(kStaticTags[i], &zero32, 1);
+        } else {
+            request->update(kStaticTags[i], &zero, 1);
+        }
+    }
+    int32_t regions[] = { 0, 0, 4000, 3000, 1 };
+    int32_t fpsRange[] = { 15, 30 };
+    int32_t cropRegion[] = { 0, 0, 4000, 3000 };
+    request->update(ANDROID_CONTROL_AE_REGIONS, regions, 5);
+    request->update(ANDROID_CONTROL_AF_REGIONS, regions, 5);
+    request->update(ANDROID_CONTROL_AWB_REGIONS, regions, 5);
+    request->update(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, fpsRange, 2);
+    request->update(ANDROID_SCALER_CROP_REGION, cropRegion, 4);
+    updatePerFrameTags(request, 0);
+    request->sort();
+}
+
+static void usage(const char* me) {
+    fprintf(stderr, "usage: %s [-n iterations]\n", me);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    int iterations = 100000;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:")) >= 0) {
+        switch (res) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (iterations <= 0) {
+        usage(argv[0]);
+    }
+
+    CameraMetadata request;
+    buildRequest(&request);
+    const size_t perFrameTagCount = sizeof(kPerFrameTags) / sizeof(kPerFrameTags[0]);
+
+    printf("%zu-entry request, %d iterations\n", request.entryCount(), iterations);
+    printf("%-32s %12s\n", "operation", "ns/op");
+
+    // Rewriting the per-frame tags with same-size values
+    double start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        updatePerFrameTags(&request, i);
+    }
+    double elapsed = nowSeconds() - start;
+    printf("%-32s %12.1f\n", "update (per tag)", elapsed * 1e9 / (iterations * perFrameTagCount));
+
+    // Looking up the per-frame tags
+    size_t found = 0;
+    start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        for (size_t t = 0; t < perFrameTagCount; ++t) {
+            found += request.find(kPerFrameTags[t]).count;
+        }
+    }
+    elapsed = nowSeconds() - start;
+    printf("%-32s %12.1f\n", "find (per tag)", elapsed * 1e9 / (iterations * perFrameTagCount));
+
+    // Keeping a copy of the latest request, by copying and by patching
+    CameraMetadata latest;
+    start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        updatePerFrameTags(&request, i);
+        latest = request;
+    }
+    elapsed = nowSeconds() - start;
+    printf("%-32s %12.1f\n", "update + copy (per request)", elapsed * 1e9 / iterations);
+
+    start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        updatePerFrameTags(&request, i);
+        latest.patch(request);
+    }
+    elapsed = nowSeconds() - start;
+    printf("%-32s %12.1f\n", "update + patch (per request)", elapsed * 1e9 / iterations);
+
+    if (found != iterations * perFrameTagCount) {
+        fprintf(stderr, "Lost track of %zu entries\n",
+                iterations * perFrameTagCount - found);
+        return 1;
+    }
+    return 0;
+}
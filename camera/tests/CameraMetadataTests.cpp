@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "CameraMetadataTests"
+
+#include <camera/CameraMetadata.h>
+#include <system/camera_metadata.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+using namespace android;
+
+// A request-like set of settings with inline, fixed-size and variable-size
+// entries.
+static void FillSettings(CameraMetadata *settings) {
+    int32_t requestId = 1;
+    int64_t exposureTime = 10000000;
+    int32_t sensitivity = 100;
+    uint8_t aeMode = ANDROID_CONTROL_AE_MODE_ON;
+    float focusDistance = 0.5f;
+    int32_t aeRegions[] = { 0, 0, 640, 480, 1 };
+    float curve[] = { 0.0f, 0.0f, 0.5f, 0.6f, 1.0f, 1.0f };
+
+    ASSERT_EQ(OK, settings->update(ANDROID_REQUEST_ID, &requestId, 1));
+    ASSERT_EQ(OK, settings->update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1));
+    ASSERT_EQ(OK, settings->update(ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1));
+    ASSERT_EQ(OK, settings->update(ANDROID_CONTROL_AE_MODE, &aeMode, 1));
+    ASSERT_EQ(OK, settings->update(ANDROID_LENS_FOCUS_DISTANCE, &focusDistance, 1));
+    ASSERT_EQ(OK, settings->update(ANDROID_CONTROL_AE_REGIONS, aeRegions, 5));
+    ASSERT_EQ(OK, settings->update(ANDROID_TONEMAP_CURVE_RED, curve, 6));
+}
+
+static bool ContainsTag(const Vector<uint32_t> &tags, uint32_t tag) {
+    for (size_t i = 0; i < tags.size(); ++i) {
+        if (tags[i] == tag) return true;
+    }
+    return false;
+}
+
+static void ExpectSameContents(const CameraMetadata &a, const CameraMetadata &b) {
+    Vector<uint32_t> tags;
+    ASSERT_EQ(OK, a.diff(b, &tags));
+    EXPECT_EQ(0u, tags.size());
+    EXPECT_EQ(a.entryCount(), b.entryCount());
+}
+
+TEST(CameraMetadataTest, UpdateInPlace) {
+    CameraMetadata settings;
+    FillSettings(&settings);
+    ASSERT_FALSE(HasFatalFailure());
+
+    // Same-size updates must not move or grow the buffer
+    const camera_metadata_t *buffer = settings.getAndLock();
+    size_t bufferSize = get_camera_metadata_size(buffer);
+    settings.unlock(buffer);
+
+    for (int i = 0; i < 100; ++i) {
+        int64_t exposureTime = 1000 * i;
+        int32_t aeRegions[] = { i, i, 640 + i, 480 + i, 1 };
+        float curve[] = { 0.0f, 0.0f, i / 100.0f, 0.6f, 1.0f, 1.0f };
+        ASSERT_EQ(OK, settings.update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1));
+        ASSERT_EQ(OK, settings.update(ANDROID_CONTROL_AE_REGIONS, aeRegions, 5));
+        ASSERT_EQ(OK, settings.update(ANDROID_TONEMAP_CURVE_RED, curve, 6));
+
+        camera_metadata_entry_t entry = settings.find(ANDROID_SENSOR_EXPOSURE_TIME);
+        ASSERT_EQ(1u, entry.count);
+        EXPECT_EQ(exposureTime, entry.data.i64[0]);
+        entry = settings.find(ANDROID_CONTROL_AE_REGIONS);
+        ASSERT_EQ(5u, entry.count);
+        EXPECT_EQ(640 + i, entry.data.i32[2]);
+        entry = settings.find(ANDROID_TONEMAP_CURVE_RED);
+        ASSERT_EQ(6u, entry.count);
+        EXPECT_EQ(i / 100.0f, entry.data.f[2]);
+    }
+
+    buffer = settings.getAndLock();
+    EXPECT_EQ(bufferSize, get_camera_metadata_size(buffer));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(buffer, NULL));
+    settings.unlock(buffer);
+
+    // Updating from an entry's own data is fine when the size doesn't change
+    camera_metadata_entry_t entry = settings.find(ANDROID_CONTROL_AE_REGIONS);
+    EXPECT_EQ(OK, settings.update(ANDROID_CONTROL_AE_REGIONS, entry.data.i32, entry.count));
+
+    // Changing the size still works
+    float curve[] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    ASSERT_EQ(OK, settings.update(ANDROID_TONEMAP_CURVE_RED, curve, 4));
+    entry = settings.find(ANDROID_TONEMAP_CURVE_RED);
+    ASSERT_EQ(4u, entry.count);
+    EXPECT_EQ(1.0f, entry.data.f[3]);
+}
+
+TEST(CameraMetadataTest, FindAfterReorder) {
+    CameraMetadata settings;
+    FillSettings(&settings);
+    ASSERT_FALSE(HasFatalFailure());
+
+    // Look everything up once so that the tag index is warm
+    EXPECT_EQ(1u, settings.find(ANDROID_SENSOR_SENSITIVITY).count);
+    EXPECT_EQ(1u, settings.find(ANDROID_CONTROL_AE_MODE).count);
+    EXPECT_EQ(1u, settings.find(ANDROID_LENS_FOCUS_DISTANCE).count);
+
+    // Sorting and erasing move entries around underneath the index
+    ASSERT_EQ(OK, settings.sort());
+    ASSERT_EQ(OK, settings.erase(ANDROID_REQUEST_ID));
+    EXPECT_FALSE(settings.exists(ANDROID_REQUEST_ID));
+    EXPECT_EQ(0u, settings.find(ANDROID_REQUEST_ID).count);
+
+    camera_metadata_entry_t entry = settings.find(ANDROID_SENSOR_SENSITIVITY);
+    ASSERT_EQ(1u, entry.count);
+    EXPECT_EQ(static_cast<uint32_t>(ANDROID_SENSOR_SENSITIVITY), entry.tag);
+    EXPECT_EQ(100, entry.data.i32[0]);
+
+    entry = settings.find(ANDROID_CONTROL_AE_MODE);
+    ASSERT_EQ(1u, entry.count);
+    EXPECT_EQ(static_cast<uint8_t>(ANDROID_CONTROL_AE_MODE_ON), entry.data.u8[0]);
+
+    // Erasing through the index removes the right entry
+    ASSERT_EQ(OK, settings.erase(ANDROID_LENS_FOCUS_DISTANCE));
+    EXPECT_FALSE(settings.exists(ANDROID_LENS_FOCUS_DISTANCE));
+    EXPECT_TRUE(settings.exists(ANDROID_CONTROL_AE_MODE));
+    EXPECT_EQ(5u, settings.entryCount());
+
+    // Copies and swaps keep finding the right entries
+    CameraMetadata copy(settings);
+    EXPECT_EQ(100, copy.find(ANDROID_SENSOR_SENSITIVITY).data.i32[0]);
+    CameraMetadata other;
+    int32_t sensitivity = 400;
+    ASSERT_EQ(OK, other.update(ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1));
+    settings.swap(other);
+    EXPECT_EQ(400, settings.find(ANDROID_SENSOR_SENSITIVITY).data.i32[0]);
+    EXPECT_EQ(100, other.find(ANDROID_SENSOR_SENSITIVITY).data.i32[0]);
+    EXPECT_EQ(0u, settings.find(ANDROID_CONTROL_AE_MODE).count);
+}
+
+TEST(CameraMetadataTest, DiffAndPatch) {
+    CameraMetadata base;
+    FillSettings(&base);
+    ASSERT_FALSE(HasFatalFailure());
+
+    CameraMetadata next(base);
+    Vector<uint32_t> tags;
+    ASSERT_EQ(OK, base.diff(next, &tags));
+    EXPECT_EQ(0u, tags.size());
+
+    // One changed value, one resized entry, one removed and one added tag
+    int64_t exposureTime = 20000000;
+    float curve[] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    uint8_t afTrigger = ANDROID_CONTROL_AF_TRIGGER_START;
+    ASSERT_EQ(OK, next.update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1));
+    ASSERT_EQ(OK, next.update(ANDROID_TONEMAP_CURVE_RED, curve, 4));
+    ASSERT_EQ(OK, next.erase(ANDROID_LENS_FOCUS_DISTANCE));
+    ASSERT_EQ(OK, next.update(ANDROID_CONTROL_AF_TRIGGER, &afTrigger, 1));
+
+    ASSERT_EQ(OK, base.diff(next, &tags));
+    EXPECT_EQ(4u, tags.size());
+    EXPECT_TRUE(ContainsTag(tags, ANDROID_SENSOR_EXPOSURE_TIME));
+    EXPECT_TRUE(ContainsTag(tags, ANDROID_TONEMAP_CURVE_RED));
+    EXPECT_TRUE(ContainsTag(tags, ANDROID_LENS_FOCUS_DISTANCE));
+    EXPECT_TRUE(ContainsTag(tags, ANDROID_CONTROL_AF_TRIGGER));
+
+    size_t changed = 0;
+    CameraMetadata patched(base);
+    ASSERT_EQ(OK, patched.patch(next, &changed));
+    EXPECT_EQ(4u, changed);
+    ExpectSameContents(patched, next);
+
+    const camera_metadata_t *buffer = patched.getAndLock();
+    EXPECT_EQ(OK, validate_camera_metadata_structure(buffer, NULL));
+    patched.unlock(buffer);
+
+    // Patching again is a no-op
+    ASSERT_EQ(OK, patched.patch(next, &changed));
+    EXPECT_EQ(0u, changed);
+
+    // Patching back restores the original
+    ASSERT_EQ(OK, patched.patch(base, &changed));
+    EXPECT_EQ(4u, changed);
+    ExpectSameContents(patched, base);
+
+    // Patching into an empty metadata copies everything
+    CameraMetadata empty;
+    ASSERT_EQ(OK, empty.patch(base, &changed));
+    EXPECT_EQ(base.entryCount(), changed);
+    ExpectSameContents(empty, base);
+
+    // Patching from nothing clears
+    ASSERT_EQ(OK, empty.patch(static_cast<const camera_metadata_t*>(NULL), &changed));
+    EXPECT_EQ(base.entryCount(), changed);
+    EXPECT_TRUE(empty.isEmpty());
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "mediascan"
+#include <utils/Log.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <binder/ProcessState.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/StagefrightMediaScanner.h>
+
+using namespace android;
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-j threads] [-i index] [-s] [-g copies] dir [seed files...]\n"
+                    "       -j number of worker threads (default: picked by the scanner)\n"
+                    "       -i incremental index file, read and updated by the scan\n"
+                    "       -s also time a serial processFile() scan for comparison\n"
+                    "       -g first fill dir with this many links to the seed files\n",
+                    me);
+    exit(1);
+}
+
+// Collects the media files found by the directory walk and counts what the
+// scanner reports for them. If |scanner| is set, files are passed to its
+// processFile() as they are found, as the framework's client does.
+struct Client : public MediaScannerClient {
+    Vector<String8> mFiles;
+    size_t mNumTags;
+
+    explicit Client(StagefrightMediaScanner *scanner = NULL)
+        : mNumTags(0),
+          mScanner(scanner) {
+    }
+
+    virtual status_t scanFile(const char *path, long long /* lastModified */,
+            long long /* fileSize */, bool isDirectory, bool noMedia) {
+        if (!isDirectory && !noMedia) {
+            mFiles.push(String8(path));
+            if (mScanner != NULL && mScanner->processFile(
+                        path, NULL /* mimeType */, *this) == MEDIA_SCAN_RESULT_ERROR) {
+                return UNKNOWN_ERROR;
+            }
+        }
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char * /* name */, const char * /* value */) {
+        ++mNumTags;
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char * /* mimeType */) {
+        return OK;
+    }
+
+private:
+    StagefrightMediaScanner *mScanner;
+};
+
+// Creates |copies| symlinks to the seed files under |dir|, 100 per directory.
+static void populate(const char *dir, int copies, int numSeeds, char **seeds) {
+    for (int i = 0; i < copies; ++i) {
+        const char *seed = seeds[i % numSeeds];
+        const char *extension = strrchr(seed, '.');
+
+        String8 subdir = String8::format("%s/%03d", dir, i / 100);
+        if (i % 100 == 0 && mkdir(subdir.string(), 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "unable to create '%s'\n", subdir.string());
+            exit(1);
+        }
+
+        char target[PATH_MAX];
+        if (realpath(seed, target) == NULL) {
+            fprintf(stderr, "unable to resolve '%s'\n", seed);
+            exit(1);
+        }
+
+        String8 link = String8::format(
+                "%s/file%06d%s", subdir.string(), i, extension != NULL ? extension : "");
+        unlink(link.string());
+        if (symlink(target, link.string()) != 0) {
+            fprintf(stderr, "unable to create '%s'\n", link.string());
+            exit(1);
+        }
+    }
+}
+
+static void report(const char *name, size_t numFiles, size_t numTags, int64_t elapsedUs) {
+    printf("%-10s %zu files, %zu tags in %.2f s, %.1f files/s\n",
+            name, numFiles, numTags, elapsedUs / 1E6,
+            elapsedUs > 0 ? numFiles * 1E6 / elapsedUs : 0.0);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    size_t numThreads = 0;
+    const char *indexPath = NULL;
+    bool compareSerial = false;
+    int copies = 0;
+
+    int res;
+    while ((res = getopt(argc, argv, "j:i:sg:")) >= 0) {
+        switch (res) {
+            case 'j':
+                numThreads = atoi(optarg);
+                break;
+            case 'i':
+                indexPath = optarg;
+                break;
+            case 's':
+                compareSerial = true;
+                break;
+            case 'g':
+                copies = atoi(optarg);
+                break;
+            default:
+                usage(me);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1 || (copies > 0 && argc < 2)) {
+        usage(me);
+    }
+
+    const char *dir = argv[0];
+    if (copies > 0) {
+        populate(dir, copies, argc - 1, argv + 1);
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    StagefrightMediaScanner scanner;
+    if (indexPath != NULL) {
+        CHECK_EQ(scanner.loadIndex(indexPath), (status_t)OK);
+    }
+
+    Client walker;
+    int64_t startUs = ALooper::GetNowUs();
+    CHECK_NE(scanner.processDirectory(dir, walker), MEDIA_SCAN_RESULT_ERROR);
+    report("walk", walker.mFiles.size(), 0, ALooper::GetNowUs() - startUs);
+
+    Client batchClient;
+    startUs = ALooper::GetNowUs();
+    CHECK_NE(scanner.processFiles(walker.mFiles, batchClient, numThreads),
+            MEDIA_SCAN_RESULT_ERROR);
+    report("parallel", walker.mFiles.size(), batchClient.mNumTags,
+            ALooper::GetNowUs() - startUs);
+
+    if (indexPath != NULL) {
+        CHECK_EQ(scanner.saveIndex(), (status_t)OK);
+    }
+
+    // What the framework does: processFile() from the walk's callback, which
+    // the scanner overlaps with scanning the files after it.
+    Client directoryClient(&scanner);
+    startUs = ALooper::GetNowUs();
+    CHECK_NE(scanner.processDirectory(dir, directoryClient), MEDIA_SCAN_RESULT_ERROR);
+    report("directory", directoryClient.mFiles.size(), directoryClient.mNumTags,
+            ALooper::GetNowUs() - startUs);
+
+    if (compareSerial) {
+        Client serialClient;
+        startUs = ALooper::GetNowUs();
+        for (size_t i = 0; i < walker.mFiles.size(); ++i) {
+            scanner.processFile(walker.mFiles[i].string(), NULL /* mimeType */, serialClient);
+        }
+        report("serial", walker.mFiles.size(), serialClient.mNumTags,
+                ALooper::GetNowUs() - startUs);
+    }
+
+    return 0;
+}
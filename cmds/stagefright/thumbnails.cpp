@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "thumbnails"
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+#include <media/IMediaMetadataRetriever.h>
+#include <media/IMediaPlayerService.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/MediaSource.h>
+#include <private/media/VideoFrame.h>
+
+using namespace android;
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-w maxWidth] [-h maxHeight] [-n passes] [-f] file ...\n"
+                    "       -w/-h bound the thumbnail size (default 320x240)\n"
+                    "       -n number of passes over the files (default 1)\n"
+                    "       -f also time full size getFrameAtTime for comparison\n",
+                    me);
+    exit(1);
+}
+
+// Extracts one frame per file with either getThumbnailAtTime or getFrameAtTime
+// and returns the number of files that produced a frame.
+static size_t runPass(
+        const sp<IMediaPlayerService> &service, int argc, char **argv,
+        bool thumbnail, int32_t maxWidth, int32_t maxHeight) {
+    size_t numFrames = 0;
+    for (int k = 0; k < argc; ++k) {
+        const char *filename = argv[k];
+
+        int fd = open(filename, O_RDONLY | O_LARGEFILE);
+        if (fd < 0) {
+            fprintf(stderr, "unable to open '%s'\n", filename);
+            continue;
+        }
+
+        off64_t fileSize = lseek64(fd, 0, SEEK_END);
+
+        // a new retriever per file, as a media scanner would use
+        sp<IMediaMetadataRetriever> retriever = service->createMetadataRetriever();
+        CHECK(retriever != NULL);
+
+        status_t err = retriever->setDataSource(fd, 0, fileSize);
+        close(fd);
+        fd = -1;
+
+        if (err != OK) {
+            ALOGW("setDataSource(%s) failed: %d", filename, err);
+            continue;
+        }
+
+        sp<IMemory> mem;
+        if (thumbnail) {
+            mem = retriever->getThumbnailAtTime(-1, maxWidth, maxHeight);
+        } else {
+            mem = retriever->getFrameAtTime(
+                    -1, MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC);
+        }
+
+        if (mem == NULL) {
+            ALOGW("no frame from '%s'", filename);
+            continue;
+        }
+
+        VideoFrame *frame = (VideoFrame *)mem->pointer();
+        ALOGV("%s: %ux%u", filename, frame->mWidth, frame->mHeight);
+        ++numFrames;
+    }
+    return numFrames;
+}
+
+static void report(
+        const char *name, size_t numFrames, size_t numFiles, int64_t elapsedUs) {
+    printf("%-14s %zu/%zu frames in %.2f s, %.2f frames/s\n",
+            name, numFrames, numFiles, elapsedUs / 1E6,
+            elapsedUs > 0 ? numFrames * 1E6 / elapsedUs : 0.0);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    int32_t maxWidth = 320;
+    int32_t maxHeight = 240;
+    int passes = 1;
+    bool compareFullFrame = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "w:h:n:f")) >= 0) {
+        switch (res) {
+            case 'w':
+                maxWidth = atoi(optarg);
+                break;
+            case 'h':
+                maxHeight = atoi(optarg);
+                break;
+            case 'n':
+                passes = atoi(optarg);
+                break;
+            case 'f':
+                compareFullFrame = true;
+                break;
+            default:
+                usage(me);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1 || maxWidth <= 0 || maxHeight <= 0 || passes <= 0) {
+        usage(me);
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    sp<IServiceManager> sm = defaultServiceManager();
+    sp<IBinder> binder = sm->getService(String16("media.player"));
+    sp<IMediaPlayerService> service = interface_cast<IMediaPlayerService>(binder);
+    CHECK(service.get() != NULL);
+
+    size_t numFiles = (size_t)argc * passes;
+
+    // The service serializes frame extraction, so files are processed one at a time.
+    size_t numFrames = 0;
+    int64_t startUs = ALooper::GetNowUs();
+    for (int i = 0; i < passes; ++i) {
+        numFrames += runPass(service, argc, argv, true /* thumbnail */, maxWidth, maxHeight);
+    }
+    report("thumbnail", numFrames, numFiles, ALooper::GetNowUs() - startUs);
+
+    if (compareFullFrame) {
+        numFrames = 0;
+        startUs = ALooper::GetNowUs();
+        for (int i = 0; i < passes; ++i) {
+            numFrames += runPass(service, argc, argv, false /* thumbnail */, 0, 0);
+        }
+        report("getFrameAtTime", numFrames, numFiles, ALooper::GetNowUs() - startUs);
+    }
+
+    return 0;
+}
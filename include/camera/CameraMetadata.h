@@ -169,6 +169,21 @@ class CameraMetadata: public Parcelable {
      */
     status_t erase(uint32_t tag);
 
+    /**
+     * List the tags whose entries differ between this metadata and other,
+     * including tags found in only one of the two.
+     */
+    status_t diff(const CameraMetadata &other, Vector<uint32_t> *tags) const;
+
+    /**
+     * Make this metadata match other by rewriting only the entries that
+     * differ and erasing the ones other doesn't have. Entries that keep their
+     * size are rewritten in place. If changedCount is not NULL, it is set to
+     * the number of entries added, rewritten or erased.
+     */
+    status_t patch(const CameraMetadata &other, size_t *changedCount = NULL);
+    status_t patch(const camera_metadata_t *other, size_t *changedCount = NULL);
+
     /**
      * Swap the underlying camera metadata between this and the other
      * metadata object.
@@ -224,6 +239,24 @@ class CameraMetadata: public Parcelable {
     camera_metadata_t *mBuffer;
     mutable bool       mLocked;
 
+    /**
+     * Entry indices of recently found tags, so that repeated updates and
+     * erases of a tag skip the search. A slot is checked against the buffer
+     * whenever it is used, so it never needs invalidating. Only used by
+     * methods that modify the buffer, since lookups may run concurrently.
+     */
+    struct TagIndexSlot {
+        uint32_t tag;
+        uint32_t index;
+    };
+    static const size_t kTagIndexBits = 6;
+    Vector<TagIndexSlot> mTagIndex;
+
+    /**
+     * Find an entry by tag, through mTagIndex
+     */
+    status_t findEntry(uint32_t tag, camera_metadata_entry_t *entry);
+
     /**
      * Check if tag has a given type
      */
@@ -43,6 +43,10 @@ public:
     virtual status_t        setDataSource(int fd, int64_t offset, int64_t length) = 0;
     virtual status_t        setDataSource(const sp<IDataSource>& dataSource) = 0;
     virtual sp<IMemory>     getFrameAtTime(int64_t timeUs, int option) = 0;
+    // Decodes only the sync frame closest to |timeUs| (or the thumbnail time if |timeUs|
+    // is negative) and scales it down to fit within |maxWidth| x |maxHeight|.
+    virtual sp<IMemory>     getThumbnailAtTime(
+            int64_t timeUs, int32_t maxWidth, int32_t maxHeight) = 0;
     virtual sp<IMemory>     extractAlbumArt() = 0;
     virtual const char*     extractMetadata(int keyCode) = 0;
 };
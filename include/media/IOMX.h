@@ -161,6 +161,13 @@ public:
     virtual status_t freeBuffer(
             node_id node, OMX_U32 port_index, buffer_id buffer) = 0;
 
+    // Returns in *bytesCopied the amount of data copied so far between the backup
+    // buffers and the component's buffers on |port_index|. Buffers allocated
+    // with allocateBufferWithBackup() for in-process software components share
+    // the backup memory with the component and are not copied.
+    virtual status_t getBufferCopyStats(
+            node_id node, OMX_U32 port_index, uint64_t *bytesCopied) = 0;
+
     enum {
         kFenceTimeoutMs = 1000
     };
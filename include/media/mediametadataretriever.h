@@ -78,6 +78,7 @@ public:
     status_t setDataSource(int fd, int64_t offset, int64_t length);
     status_t setDataSource(const sp<IDataSource>& dataSource);
     sp<IMemory> getFrameAtTime(int64_t timeUs, int option);
+    sp<IMemory> getThumbnailAtTime(int64_t timeUs, int32_t maxWidth, int32_t maxHeight);
     sp<IMemory> extractAlbumArt();
     const char* extractMetadata(int keyCode);
 
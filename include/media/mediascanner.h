@@ -22,10 +22,9 @@
 #include <utils/List.h>
 #include <utils/Errors.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 #include <pthread.h>
 
-struct dirent;
-
 namespace android {
 
 class MediaScannerClient;
@@ -85,6 +84,12 @@ struct MediaScanner {
 protected:
     const char *locale() const;
 
+    // Called by processDirectory() with the regular files of the directory
+    // it is walking, in the order they are reported to the client, which may
+    // pass any of them to processFile(). Called again with the same files
+    // after each subdirectory, and with none when the walk is done.
+    virtual void onDirectoryFiles(const Vector<String8> &paths);
+
 private:
     // current locale (like "ja_JP"), created/destroyed with strdup()/free()
     char *mLocale;
@@ -95,7 +100,7 @@ private:
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia);
     MediaScanResult doProcessDirectoryEntry(
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
-            struct dirent* entry, char* fileSpot);
+            const char *name, unsigned char type, char* fileSpot);
     void loadSkipList();
     bool shouldSkipDirectory(char *path);
 
@@ -27,12 +27,19 @@
 
 namespace android {
 
+// 4:2:0 with 16-bit little-endian samples that carry 10 bits in their most significant bits,
+// followed by interleaved CbCr (P010). OMX does not define a color format for it.
+static const OMX_COLOR_FORMATTYPE kColorFormatYUVP010 = (OMX_COLOR_FORMATTYPE)0x7F420A10;
+
 struct ColorConverter {
     ColorConverter(OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to);
     ~ColorConverter();
 
     bool isValid() const;
 
+    // Converts the source crop rectangle into the destination crop rectangle. The
+    // destination rectangle may be smaller than the source, in which case the frame is
+    // scaled down in the same pass (not supported by the reference converters).
     status_t convert(
             const void *srcBits,
             size_t srcWidth, size_t srcHeight,
@@ -43,6 +50,10 @@ struct ColorConverter {
             size_t dstCropLeft, size_t dstCropTop,
             size_t dstCropRight, size_t dstCropBottom);
 
+    // Use the original per-pixel converters instead of the row converters. These only
+    // support RGB565 output and no P010 input. For benchmarking and verification.
+    void setUseReferenceConverters(bool enable);
+
 private:
     struct BitmapParams {
         BitmapParams(
@@ -59,11 +70,38 @@ private:
         size_t mCropLeft, mCropTop, mCropRight, mCropBottom;
     };
 
+    struct Band;
+
     OMX_COLOR_FORMATTYPE mSrcFormat, mDstFormat;
     uint8_t *mClip;
+    bool mUseReference;
 
     uint8_t *initClip();
 
+    status_t convertReference(
+            const BitmapParams &src, const BitmapParams &dst);
+
+    // Converts the crop rectangle row by row, splitting large frames into bands of rows
+    // that are converted in parallel.
+    status_t convertRows(
+            const BitmapParams &src, const BitmapParams &dst);
+
+    // Points |src_y|, |src_u| and |src_v| at crop row |row| of |src|, deinterleaving into
+    // |tmp_y|, |tmp_u| and |tmp_v| if the source format needs it.
+    void getSourceRow(
+            const BitmapParams &src, size_t row,
+            uint8_t *tmp_y, uint8_t *tmp_u, uint8_t *tmp_v,
+            const uint8_t **src_y, const uint8_t **src_u, const uint8_t **src_v,
+            bool *swapRB) const;
+
+    // Converts rows [rowBegin, rowEnd) of the destination crop rectangle. |rowBegin| must
+    // be even.
+    void convertRowRange(
+            const BitmapParams &src, const BitmapParams &dst,
+            size_t rowBegin, size_t rowEnd) const;
+
+    static void *BandThreadWrapper(void *me);
+
     status_t convertCbYCrY(
             const BitmapParams &src, const BitmapParams &dst);
 
@@ -19,6 +19,8 @@
 #define STAGEFRIGHT_MEDIA_SCANNER_H_
 
 #include <media/mediascanner.h>
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -30,15 +32,61 @@ struct StagefrightMediaScanner : public MediaScanner {
             const char *path, const char *mimeType,
             MediaScannerClient &client);
 
+    // Extracts the metadata of |paths| on up to |maxThreads| worker threads (0 picks
+    // a default) and reports it to |client| on the calling thread, in order, exactly as
+    // processFile() would. If |results| is not NULL it receives the result for each
+    // path. Returns MEDIA_SCAN_RESULT_ERROR and stops if the client returns an error.
+    MediaScanResult processFiles(
+            const Vector<String8> &paths, MediaScannerClient &client,
+            size_t maxThreads = 0, Vector<MediaScanResult> *results = NULL);
+
+    // Enables incremental scanning in processFiles(): files whose modification time
+    // and size are unchanged since they were recorded in the index at |indexPath| are
+    // reported from the index without being opened. The index is updated by
+    // saveIndex().
+    status_t loadIndex(const char *indexPath);
+    status_t saveIndex();
+
     virtual MediaAlbumArt *extractAlbumArt(int fd);
 
+protected:
+    // Scans the files following one passed to processFile() on worker
+    // threads, so that they are ready when the client asks for them. Only
+    // done while the client asks about consecutive files, so that files it
+    // skips as unchanged aren't opened.
+    virtual void onDirectoryFiles(const Vector<String8> &paths);
+
 private:
+    struct ScannedFile;
+    struct RecordingClient;
+    struct BatchScan;
+    struct ScanAhead;
+
+    // files of the directory being walked by processDirectory()
+    ScanAhead *mScanAhead;
+
+    // files recorded by the last scan, by path; only used in incremental mode.
+    // Guarded by mIndexLock, since workers check the index.
+    String8 mIndexPath;
+    KeyedVector<String8, ScannedFile *> mIndex;
+    Mutex mIndexLock;
+
     StagefrightMediaScanner(const StagefrightMediaScanner &);
     StagefrightMediaScanner &operator=(const StagefrightMediaScanner &);
 
     MediaScanResult processFileInternal(
             const char *path, const char *mimeType,
             MediaScannerClient &client);
+
+    void scanFileForBatch(const String8 &path, ScannedFile *file);
+    void clearIndex();
+
+    void scanAheadOf(const char *path);
+    ScannedFile *takeScannedAhead(const char *path);
+    void stopScanAhead();
+
+    static void *BatchThreadWrapper(void *me);
+    static void *ScanAheadThreadWrapper(void *me);
 };
 
 }  // namespace android
@@ -20,7 +20,9 @@
 
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/KeyedVector.h>
+#include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/SortedVector.h>
 #include <utils/Thread.h>
 
 #include <netinet/in.h>
@@ -31,6 +33,9 @@ struct AMessage;
 
 // Helper class to manage a number of live sockets (datagram and stream-based)
 // on a single thread. Clients are notified about activity through AMessages.
+// Sockets are watched with epoll, edge-triggered except for listening
+// sockets, or with select() if epoll isn't available or the
+// media.stagefright.net-epoll property is false.
 struct ANetworkSession : public RefBase {
     ANetworkSession();
 
@@ -104,8 +109,20 @@ private:
 
     int mPipeFd[2];
 
+    // -1 if sockets are watched with select().
+    int mEpollFd;
+
     KeyedVector<int32_t, sp<Session> > mSessions;
 
+    // Sessions that had data queued since the network thread last ran.
+    // Edge-triggered epoll only reports a socket as writable again after
+    // its send buffer has filled up.
+    SortedVector<int32_t> mSessionsToWrite;
+
+    // Sessions that stopped reading before their socket was drained, so
+    // other sessions aren't starved. They are read again on the next pass.
+    SortedVector<int32_t> mSessionsToRead;
+
     enum Mode {
         kModeCreateUDPSession,
         kModeCreateTCPDatagramSessionPassive,
@@ -123,7 +140,20 @@ private:
             int32_t *sessionID);
 
     void threadLoop();
+    void threadLoopSelect();
+    void threadLoopEpoll();
     void interrupt();
+    void drainPipe();
+
+    void addSession_l(const sp<Session> &session);
+    void watchSession_l(const sp<Session> &session);
+
+    void onSessionReady_l(
+            const sp<Session> &session, bool readable, bool writable,
+            List<sp<Session> > *sessionsToAdd);
+
+    void acceptClients_l(
+            const sp<Session> &session, List<sp<Session> > *sessionsToAdd);
 
     static status_t MakeSocketNonBlocking(int s);
 
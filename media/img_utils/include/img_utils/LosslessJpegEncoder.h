@@ -0,0 +1,55 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMG_UTILS_LOSSLESS_JPEG_ENCODER_H
+#define IMG_UTILS_LOSSLESS_JPEG_ENCODER_H
+
+#include <cutils/compiler.h>
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+
+#include <stdint.h>
+
+namespace android {
+namespace img_utils {
+
+/**
+ * Encodes images with the lossless process of ITU-T T.81 (JPEG-92), as used by
+ * DNG files with Compression = 7.
+ *
+ * Each image is coded with predictor 1 (the sample to the left) and a Huffman
+ * table optimized for that image.
+ */
+class ANDROID_API LosslessJpegEncoder {
+    public:
+        /**
+         * Encode a width x height image with the given number of interleaved
+         * components (1-4), each bitsPerSample (2-16) bits deep.  Samples are
+         * read from the given buffer, which holds rowStride samples per row.
+         *
+         * The encoded image is appended to the output vector.
+         *
+         * Returns OK on success, or a negative error code.
+         */
+        static status_t encode(const uint16_t* samples, uint32_t width, uint32_t height,
+                uint32_t components, uint32_t bitsPerSample, size_t rowStride,
+                /*out*/Vector<uint8_t>* output);
+};
+
+} /*namespace img_utils*/
+} /*namespace android*/
+
+#endif /*IMG_UTILS_LOSSLESS_JPEG_ENCODER_H*/
@@ -115,13 +115,42 @@ class ANDROID_API TiffIfd : public TiffWritable {
          */
         virtual status_t validateAndSetStripTags();
 
+        /**
+         * Convenience method to validate and set tile-related image tags.
+         *
+         * This works like validateAndSetStripTags, but lays the image out in
+         * tiles of the given size instead, replacing any strip tags.  Tiles
+         * on the right and bottom edges are padded to the full tile size.
+         * The tile width and length must be multiples of 16.
+         *
+         * Returns OK on success, or a negative error code.
+         */
+        virtual status_t validateAndSetTileTags(uint32_t tileWidth, uint32_t tileLength);
+
+        /**
+         * Returns true if the image data in this IFD is stored in tiles rather
+         * than strips.
+         */
+        virtual bool isTiled() const;
+
+        /**
+         * Get the image dimensions and pixel layout from the ImageWidth,
+         * ImageLength, SamplesPerPixel and BitsPerSample tags.
+         *
+         * Returns OK on success, or a negative error code if any of these tags
+         * are missing or the samples are not byte-aligned.
+         */
+        virtual status_t getImageLayout(/*out*/uint32_t* width, /*out*/uint32_t* height,
+                /*out*/uint32_t* samplesPerPixel, /*out*/uint32_t* bytesPerSample) const;
+
         /**
          * Returns true if validateAndSetStripTags has been called, but not setStripOffsets.
          */
         virtual bool uninitializedOffsets() const;
 
         /**
-         * Convenience method to set beginning offset for strips.
+         * Convenience method to set beginning offset for strips, or tiles if
+         * this IFD is tiled.  The strips are placed contiguously.
          *
          * Call this to update the strip offsets before calling writeData.
          *
@@ -130,7 +159,17 @@ class ANDROID_API TiffIfd : public TiffWritable {
         virtual status_t setStripOffset(uint32_t offset);
 
         /**
-         * Get the total size of the strips in bytes.
+         * Replace the byte count of each strip, or each tile if this IFD is
+         * tiled.  This is used when strips are compressed, and must be called
+         * before setStripOffset.  The count must match the existing number of
+         * strips.
+         *
+         * Returns OK on success, or a negative error code.
+         */
+        virtual status_t setStripByteCounts(const uint32_t* byteCounts, uint32_t count);
+
+        /**
+         * Get the total size of the strips (or tiles) in bytes.
          *
          * This sums the byte count at each strip offset, and returns
          * the total count of bytes stored in strips for this IFD.
@@ -22,6 +22,7 @@
 #include <img_utils/TiffEntryImpl.h>
 #include <img_utils/TagDefinitions.h>
 #include <img_utils/TiffIfd.h>
+#include <img_utils/TileSource.h>
 
 #include <utils/Log.h>
 #include <utils/Errors.h>
@@ -93,6 +94,25 @@ class ANDROID_API TiffWriter : public LightRefBase<TiffWriter> {
         virtual status_t write(Output* out, StripSource** sources, size_t sourcesCount,
                 Endianness end = LITTLE);
 
+        /**
+         * Write a TIFF header containing each IFD set, followed by the image
+         * data for each IFD with strip or tile tags set by addStrip or addTiles.
+         *
+         * Image data is read from the TileSource for each of these IFDs, and
+         * strips or tiles are prepared in parallel on numThreads worker threads
+         * (or one per CPU core if 0) before being written in order.
+         *
+         * If the Compression tag of an IFD is 7, each strip or tile is encoded
+         * as a lossless JPEG and the byte count tags are updated to match.
+         * The compressed data for the whole image is kept in memory until the
+         * header can be written.  Otherwise Compression must be 1 (or unset),
+         * and uncompressed strips or tiles are streamed to the output.
+         *
+         * Returns OK on success, or a negative error code on failure.
+         */
+        virtual status_t write(Output* out, TileSource** sources, size_t sourcesCount,
+                Endianness end = LITTLE, uint32_t numThreads = 0);
+
         /**
          * Write a TIFF header containing each IFD set.  This will recursively
          * write all SubIFDs and tags.
@@ -175,6 +195,18 @@ class ANDROID_API TiffWriter : public LightRefBase<TiffWriter> {
          */
         virtual status_t addStrip(uint32_t ifd);
 
+        /**
+         * Convenience function to set the tile related tags for a given IFD,
+         * using tiles of the given size.  Tile dimensions must be multiples
+         * of 16.
+         *
+         * Call this instead of addStrip before using a TileSource as an input
+         * to write.  The same tags must be set as for addStrip.
+         *
+         * Returns OK on success, or a negative error code.
+         */
+        virtual status_t addTiles(uint32_t ifd, uint32_t tileWidth, uint32_t tileLength);
+
         /**
          * Return the TIFF entry with the given tag ID in the IFD with the given ID,
          * or an empty pointer if none exists.
@@ -257,6 +289,7 @@ class ANDROID_API TiffWriter : public LightRefBase<TiffWriter> {
 
         sp<TiffIfd> findLastIfd();
         status_t writeFileHeader(EndianOutput& out);
+        status_t writeIfds(EndianOutput& out);
         const TagDefinition_t* lookupDefinition(uint16_t tag) const;
         status_t calculateOffsets();
 
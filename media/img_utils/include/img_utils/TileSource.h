@@ -0,0 +1,64 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef IMG_UTILS_TILE_SOURCE_H
+#define IMG_UTILS_TILE_SOURCE_H
+
+#include <cutils/compiler.h>
+#include <utils/Errors.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace img_utils {
+
+/**
+ * Source of image data for strips or tiles that are prepared in parallel by
+ * TiffWriter.
+ *
+ * Unlike StripSource, pixels are requested by region and in no particular
+ * order, and requests may be made concurrently from several threads.
+ */
+class ANDROID_API TileSource {
+    public:
+        virtual ~TileSource();
+
+        /**
+         * Copy the region of rowCount x columnCount pixels with the given top
+         * left corner into dst, using dstRowStride bytes per row.  Pixels are
+         * copied as they will be stored in the file, SamplesPerPixel samples
+         * of BitsPerSample / 8 bytes each.  The region always lies within the
+         * image.
+         *
+         * This method must be safe to call from several threads at once.
+         *
+         * Returns OK on success, or a negative error code.
+         */
+        virtual status_t readPixels(uint32_t row, uint32_t column, uint32_t rowCount,
+                uint32_t columnCount, /*out*/uint8_t* dst, size_t dstRowStride) const = 0;
+
+        /**
+         * Return the source IFD.
+         */
+        virtual uint32_t getIfd() const = 0;
+};
+
+} /*namespace img_utils*/
+} /*namespace android*/
+
+#endif /*IMG_UTILS_TILE_SOURCE_H*/
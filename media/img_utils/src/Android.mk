@@ -32,6 +32,8 @@ LOCAL_SRC_FILES := \
   ByteArrayOutput.cpp \
   DngUtils.cpp \
   StripSource.cpp \
+  TileSource.cpp \
+  LosslessJpegEncoder.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
   libexpat \
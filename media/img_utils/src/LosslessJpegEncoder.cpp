@@ -0,0 +1,335 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LosslessJpegEncoder"
+
+#include <img_utils/LosslessJpegEncoder.h>
+
+#include <utils/Log.h>
+
+#include <string.h>
+
+namespace android {
+namespace img_utils {
+
+namespace {
+
+enum {
+    NUM_CATEGORIES = 17, // difference categories (SSSS) 0-16
+    MAX_CODE_LENGTH = 16,
+    MAX_COMPONENTS = 4,
+};
+
+// Returns the category (SSSS) of a difference in [-32767, 32768].
+inline uint32_t category(int32_t diff) {
+    uint32_t magnitude = diff < 0 ? -diff : diff;
+    uint32_t bits = 0;
+    while (magnitude != 0) {
+        ++bits;
+        magnitude >>= 1;
+    }
+    return bits;
+}
+
+// Difference between a sample and its prediction, modulo 2^16 (T.81 H.1.2.2).
+inline int32_t difference(uint32_t sample, uint32_t prediction) {
+    int32_t diff = (sample - prediction) & 0xFFFF;
+    return diff > 32768 ? diff - 65536 : diff;
+}
+
+/**
+ * Calls fn(diff) for every difference of the image in coding order.
+ */
+template<typename Fn>
+void forEachDifference(const uint16_t* samples, uint32_t width, uint32_t height,
+        uint32_t components, uint32_t bitsPerSample, size_t rowStride, Fn& fn) {
+    const uint32_t initialPrediction = 1u << (bitsPerSample - 1);
+    const uint16_t* prevRow = NULL;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint16_t* row = samples + y * rowStride;
+        for (uint32_t c = 0; c < components; ++c) {
+            // The first sample of a row is predicted from above, or from the
+            // initial prediction on the first row.
+            uint32_t prediction = (prevRow == NULL) ? initialPrediction : prevRow[c];
+            fn(difference(row[c], prediction), c);
+        }
+        for (uint32_t x = 1; x < width; ++x) {
+            const uint16_t* pixel = row + x * components;
+            const uint16_t* left = pixel - components;
+            for (uint32_t c = 0; c < components; ++c) {
+                fn(difference(pixel[c], left[c]), c);
+            }
+        }
+        prevRow = row;
+    }
+}
+
+struct CategoryCounter {
+    uint32_t counts[NUM_CATEGORIES];
+
+    void operator()(int32_t diff, uint32_t /*component*/) {
+        ++counts[category(diff)];
+    }
+};
+
+/**
+ * Builds a Huffman table limited to 16 bit codes from category counts, using
+ * the procedure from T.81 Annex K.2.  Fills in the DHT BITS and HUFFVAL lists
+ * and the code and length of each category.
+ */
+void buildHuffmanTable(const uint32_t* counts, uint8_t* bits, uint8_t* huffVal,
+        uint32_t* numValues, uint16_t* codes, uint8_t* lengths) {
+    // One extra symbol with a count of 1 reserves the all-ones code.
+    const int reserved = NUM_CATEGORIES;
+    uint32_t freq[NUM_CATEGORIES + 1];
+    int codeSize[NUM_CATEGORIES + 1];
+    int others[NUM_CATEGORIES + 1];
+    for (int i = 0; i < NUM_CATEGORIES; ++i) {
+        freq[i] = counts[i];
+    }
+    freq[reserved] = 1;
+    for (int i = 0; i <= reserved; ++i) {
+        codeSize[i] = 0;
+        others[i] = -1;
+    }
+
+    for (;;) {
+        // Find the two least frequent symbols, preferring larger values on ties.
+        int v1 = -1;
+        int v2 = -1;
+        for (int i = 0; i <= reserved; ++i) {
+            if (freq[i] == 0) {
+                continue;
+            }
+            if (v1 < 0 || freq[i] <= freq[v1]) {
+                v2 = v1;
+                v1 = i;
+            } else if (v2 < 0 || freq[i] <= freq[v2]) {
+                v2 = i;
+            }
+        }
+        if (v2 < 0) {
+            break;
+        }
+
+        freq[v1] += freq[v2];
+        freq[v2] = 0;
+
+        ++codeSize[v1];
+        while (others[v1] >= 0) {
+            v1 = others[v1];
+            ++codeSize[v1];
+        }
+        others[v1] = v2;
+
+        ++codeSize[v2];
+        while (others[v2] >= 0) {
+            v2 = others[v2];
+            ++codeSize[v2];
+        }
+    }
+
+    // Count codes of each length, then limit lengths to 16 bits (Annex K.3).
+    uint32_t lengthCounts[2 * (NUM_CATEGORIES + 1) + 1];
+    memset(lengthCounts, 0, sizeof(lengthCounts));
+    for (int i = 0; i <= reserved; ++i) {
+        if (codeSize[i] > 0) {
+            ++lengthCounts[codeSize[i]];
+        }
+    }
+
+    for (int i = 2 * (NUM_CATEGORIES + 1); i > MAX_CODE_LENGTH;) {
+        if (lengthCounts[i] > 0) {
+            int j = i - 2;
+            while (lengthCounts[j] == 0) {
+                --j;
+            }
+            lengthCounts[i] -= 2;
+            lengthCounts[i - 1] += 1;
+            lengthCounts[j + 1] += 2;
+            lengthCounts[j] -= 1;
+        } else {
+            --i;
+        }
+    }
+
+    // Drop the reserved code, which is the longest.
+    int longest = MAX_CODE_LENGTH;
+    while (lengthCounts[longest] == 0) {
+        --longest;
+    }
+    --lengthCounts[longest];
+
+    // Order symbols by code length, then value.
+    uint32_t n = 0;
+    for (int size = 1; size <= 2 * (NUM_CATEGORIES + 1); ++size) {
+        for (int i = 0; i < NUM_CATEGORIES; ++i) {
+            if (codeSize[i] == size) {
+                huffVal[n++] = i;
+            }
+        }
+    }
+    *numValues = n;
+
+    // Assign canonical codes (Annex C).
+    memset(lengths, 0, NUM_CATEGORIES);
+    uint32_t code = 0;
+    uint32_t k = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+        bits[length - 1] = lengthCounts[length];
+        for (uint32_t i = 0; i < lengthCounts[length]; ++i) {
+            codes[huffVal[k]] = code++;
+            lengths[huffVal[k]] = length;
+            ++k;
+        }
+        code <<= 1;
+    }
+}
+
+/**
+ * Writes entropy coded data with 0xFF byte stuffing.
+ */
+class BitWriter {
+    public:
+        explicit BitWriter(Vector<uint8_t>* output) : mOutput(output), mBits(0), mCount(0) {}
+
+        void put(uint32_t value, uint32_t length) {
+            mBits = (mBits << length) | (value & ((1u << length) - 1));
+            mCount += length;
+            while (mCount >= 8) {
+                mCount -= 8;
+                uint8_t byte = static_cast<uint8_t>(mBits >> mCount);
+                mOutput->push_back(byte);
+                if (byte == 0xFF) {
+                    mOutput->push_back(0);
+                }
+            }
+        }
+
+        // Pad the last byte with 1 bits.
+        void flush() {
+            if (mCount > 0) {
+                put(0x7F, 8 - mCount);
+            }
+        }
+
+    private:
+        Vector<uint8_t>* mOutput;
+        uint64_t mBits;
+        uint32_t mCount;
+};
+
+struct DifferenceWriter {
+    BitWriter* writer;
+    const uint16_t* codes;
+    const uint8_t* lengths;
+
+    void operator()(int32_t diff, uint32_t /*component*/) {
+        uint32_t ssss = category(diff);
+        writer->put(codes[ssss], lengths[ssss]);
+        if (ssss > 0 && ssss < 16) {
+            // Negative differences are coded as diff - 1 in ssss bits.
+            writer->put(diff < 0 ? diff - 1 : diff, ssss);
+        }
+    }
+};
+
+void putMarker(Vector<uint8_t>* output, uint8_t marker) {
+    output->push_back(0xFF);
+    output->push_back(marker);
+}
+
+void putShort(Vector<uint8_t>* output, uint32_t value) {
+    output->push_back(static_cast<uint8_t>(value >> 8));
+    output->push_back(static_cast<uint8_t>(value));
+}
+
+} // namespace
+
+status_t LosslessJpegEncoder::encode(const uint16_t* samples, uint32_t width, uint32_t height,
+        uint32_t components, uint32_t bitsPerSample, size_t rowStride,
+        /*out*/Vector<uint8_t>* output) {
+    if (width == 0 || width > UINT16_MAX || height == 0 || height > UINT16_MAX) {
+        ALOGE("%s: Invalid image size %ux%u.", __FUNCTION__, width, height);
+        return BAD_VALUE;
+    }
+    if (components == 0 || components > MAX_COMPONENTS) {
+        ALOGE("%s: Invalid number of components %u.", __FUNCTION__, components);
+        return BAD_VALUE;
+    }
+    if (bitsPerSample < 2 || bitsPerSample > 16) {
+        ALOGE("%s: Invalid sample precision %u.", __FUNCTION__, bitsPerSample);
+        return BAD_VALUE;
+    }
+    if (rowStride < width * components) {
+        ALOGE("%s: Row stride %zu too small.", __FUNCTION__, rowStride);
+        return BAD_VALUE;
+    }
+
+    CategoryCounter counter;
+    memset(counter.counts, 0, sizeof(counter.counts));
+    forEachDifference(samples, width, height, components, bitsPerSample, rowStride, counter);
+
+    uint8_t bits[MAX_CODE_LENGTH];
+    uint8_t huffVal[NUM_CATEGORIES];
+    uint32_t numValues;
+    uint16_t codes[NUM_CATEGORIES];
+    uint8_t lengths[NUM_CATEGORIES];
+    buildHuffmanTable(counter.counts, bits, huffVal, &numValues, codes, lengths);
+
+    putMarker(output, 0xD8); // SOI
+
+    putMarker(output, 0xC3); // SOF3, lossless Huffman
+    putShort(output, 8 + 3 * components);
+    output->push_back(bitsPerSample);
+    putShort(output, height);
+    putShort(output, width);
+    output->push_back(components);
+    for (uint32_t c = 0; c < components; ++c) {
+        output->push_back(c); // component identifier
+        output->push_back(0x11); // 1x1 sampling
+        output->push_back(0); // no quantization table
+    }
+
+    putMarker(output, 0xC4); // DHT
+    putShort(output, 2 + 1 + MAX_CODE_LENGTH + numValues);
+    output->push_back(0); // DC table 0
+    output->appendArray(bits, MAX_CODE_LENGTH);
+    output->appendArray(huffVal, numValues);
+
+    putMarker(output, 0xDA); // SOS
+    putShort(output, 6 + 2 * components);
+    output->push_back(components);
+    for (uint32_t c = 0; c < components; ++c) {
+        output->push_back(c);
+        output->push_back(0); // Huffman table 0
+    }
+    output->push_back(1); // predictor 1
+    output->push_back(0);
+    output->push_back(0); // no point transform
+
+    BitWriter writer(output);
+    DifferenceWriter differenceWriter = { &writer, codes, lengths };
+    forEachDifference(samples, width, height, components, bitsPerSample, rowStride,
+            differenceWriter);
+    writer.flush();
+
+    putMarker(output, 0xD9); // EOI
+    return OK;
+}
+
+} /*namespace img_utils*/
+} /*namespace android*/
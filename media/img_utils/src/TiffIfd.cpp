@@ -168,7 +168,8 @@ uint32_t TiffIfd::getComparableValue() const {
     return mIfdId;
 }
 
-status_t TiffIfd::validateAndSetStripTags() {
+status_t TiffIfd::getImageLayout(/*out*/uint32_t* width, /*out*/uint32_t* height,
+        /*out*/uint32_t* samplesPerPixel, /*out*/uint32_t* bytesPerSample) const {
     sp<TiffEntry> widthEntry = getEntry(TAG_IMAGEWIDTH);
     if (widthEntry == NULL) {
         ALOGE("%s: IFD %u doesn't have a ImageWidth tag set", __FUNCTION__, mIfdId);
@@ -193,10 +194,7 @@ status_t TiffIfd::validateAndSetStripTags() {
         return BAD_VALUE;
     }
 
-    uint32_t width = *(widthEntry->getData<uint32_t>());
-    uint32_t height = *(heightEntry->getData<uint32_t>());
     uint16_t bitsPerSample = *(bitsEntry->getData<uint16_t>());
-    uint16_t samplesPerPixel = *(samplesEntry->getData<uint16_t>());
 
     if ((bitsPerSample % 8) != 0) {
         ALOGE("%s: BitsPerSample %d in IFD %u is not byte-aligned.", __FUNCTION__,
@@ -204,7 +202,19 @@ status_t TiffIfd::validateAndSetStripTags() {
         return BAD_VALUE;
     }
 
-    uint32_t bytesPerSample = bitsPerSample / 8;
+    *width = *(widthEntry->getData<uint32_t>());
+    *height = *(heightEntry->getData<uint32_t>());
+    *samplesPerPixel = *(samplesEntry->getData<uint16_t>());
+    *bytesPerSample = bitsPerSample / 8;
+    return OK;
+}
+
+status_t TiffIfd::validateAndSetStripTags() {
+    uint32_t width, height, samplesPerPixel, bytesPerSample;
+    status_t ret = getImageLayout(&width, &height, &samplesPerPixel, &bytesPerSample);
+    if (ret != OK) {
+        return ret;
+    }
 
     // Choose strip size as close to 8kb as possible without splitting rows.
     // If the row length is >8kb, each strip will only contain a single row.
@@ -285,24 +295,96 @@ status_t TiffIfd::validateAndSetStripTags() {
         return BAD_VALUE;
     }
 
+    removeEntry(TAG_TILEWIDTH);
+    removeEntry(TAG_TILELENGTH);
+    removeEntry(TAG_TILEBYTECOUNTS);
+    removeEntry(TAG_TILEOFFSETS);
+
     mStripOffsetsInitialized = true;
     return OK;
 }
 
+status_t TiffIfd::validateAndSetTileTags(uint32_t tileWidth, uint32_t tileLength) {
+    uint32_t width, height, samplesPerPixel, bytesPerSample;
+    status_t ret = getImageLayout(&width, &height, &samplesPerPixel, &bytesPerSample);
+    if (ret != OK) {
+        return ret;
+    }
+
+    if (tileWidth == 0 || tileLength == 0 || (tileWidth % 16) != 0 || (tileLength % 16) != 0) {
+        ALOGE("%s: Tile size %ux%u in IFD %u is not a multiple of 16.", __FUNCTION__,
+                tileWidth, tileLength, mIfdId);
+        return BAD_VALUE;
+    }
+
+    uint64_t tileSize = static_cast<uint64_t>(tileWidth) * tileLength * samplesPerPixel *
+            bytesPerSample;
+    if (tileSize > UINT32_MAX) {
+        ALOGE("%s: Tile size %ux%u too large.", __FUNCTION__, tileWidth, tileLength);
+        return BAD_VALUE;
+    }
+
+    const uint32_t tilesAcross = (width + tileWidth - 1) / tileWidth;
+    const uint32_t tilesDown = (height + tileLength - 1) / tileLength;
+    const uint32_t numTiles = tilesAcross * tilesDown;
+
+    sp<TiffEntry> tileWidthEntry = TiffWriter::uncheckedBuildEntry(TAG_TILEWIDTH, LONG, 1,
+            UNDEFINED_ENDIAN, &tileWidth);
+    sp<TiffEntry> tileLengthEntry = TiffWriter::uncheckedBuildEntry(TAG_TILELENGTH, LONG, 1,
+            UNDEFINED_ENDIAN, &tileLength);
+
+    // Every tile is padded to the full tile size, including those on the edges.
+    Vector<uint32_t> byteCounts;
+    byteCounts.insertAt(static_cast<uint32_t>(tileSize), 0, numTiles);
+    sp<TiffEntry> tileByteCounts = TiffWriter::uncheckedBuildEntry(TAG_TILEBYTECOUNTS, LONG,
+            numTiles, UNDEFINED_ENDIAN, byteCounts.array());
+
+    // Set uninitialized offsets
+    Vector<uint32_t> tileOffsetsVector;
+    tileOffsetsVector.insertAt(0, 0, numTiles);
+    sp<TiffEntry> tileOffsets = TiffWriter::uncheckedBuildEntry(TAG_TILEOFFSETS, LONG,
+            numTiles, UNDEFINED_ENDIAN, tileOffsetsVector.array());
+
+    if (tileWidthEntry == NULL || tileLengthEntry == NULL || tileByteCounts == NULL ||
+            tileOffsets == NULL) {
+        ALOGE("%s: Could not build tile entries for IFD %u.", __FUNCTION__, mIfdId);
+        return BAD_VALUE;
+    }
+
+    if (addEntry(tileWidthEntry) != OK || addEntry(tileLengthEntry) != OK ||
+            addEntry(tileByteCounts) != OK || addEntry(tileOffsets) != OK) {
+        ALOGE("%s: Could not add tile entries to IFD %u", __FUNCTION__, mIfdId);
+        return BAD_VALUE;
+    }
+
+    removeEntry(TAG_ROWSPERSTRIP);
+    removeEntry(TAG_STRIPBYTECOUNTS);
+    removeEntry(TAG_STRIPOFFSETS);
+
+    mStripOffsetsInitialized = true;
+    return OK;
+}
+
+bool TiffIfd::isTiled() const {
+    return mEntries.indexOfTag(TAG_TILEOFFSETS) >= 0;
+}
+
 bool TiffIfd::uninitializedOffsets() const {
     return mStripOffsetsInitialized;
 }
 
 status_t TiffIfd::setStripOffset(uint32_t offset) {
+    const uint16_t offsetsTag = isTiled() ? TAG_TILEOFFSETS : TAG_STRIPOFFSETS;
+    const uint16_t byteCountsTag = isTiled() ? TAG_TILEBYTECOUNTS : TAG_STRIPBYTECOUNTS;
 
     // Get old offsets and bytecounts
-    sp<TiffEntry> oldOffsets = getEntry(TAG_STRIPOFFSETS);
+    sp<TiffEntry> oldOffsets = getEntry(offsetsTag);
     if (oldOffsets == NULL) {
         ALOGE("%s: IFD %u does not contain StripOffsets entry.", __FUNCTION__, mIfdId);
         return BAD_VALUE;
     }
 
-    sp<TiffEntry> stripByteCounts = getEntry(TAG_STRIPBYTECOUNTS);
+    sp<TiffEntry> stripByteCounts = getEntry(byteCountsTag);
     if (stripByteCounts == NULL) {
         ALOGE("%s: IFD %u does not contain StripByteCounts entry.", __FUNCTION__, mIfdId);
         return BAD_VALUE;
@@ -328,7 +410,7 @@ status_t TiffIfd::setStripOffset(uint32_t offset) {
         offset += stripByteCountsArray[i];
     }
 
-    sp<TiffEntry> newOffsets = TiffWriter::uncheckedBuildEntry(TAG_STRIPOFFSETS, LONG,
+    sp<TiffEntry> newOffsets = TiffWriter::uncheckedBuildEntry(offsetsTag, LONG,
             static_cast<uint32_t>(numStrips), UNDEFINED_ENDIAN, stripOffsets.array());
 
     if (newOffsets == NULL) {
@@ -343,8 +425,34 @@ status_t TiffIfd::setStripOffset(uint32_t offset) {
     return OK;
 }
 
+status_t TiffIfd::setStripByteCounts(const uint32_t* byteCounts, uint32_t count) {
+    const uint16_t byteCountsTag = isTiled() ? TAG_TILEBYTECOUNTS : TAG_STRIPBYTECOUNTS;
+
+    sp<TiffEntry> oldByteCounts = getEntry(byteCountsTag);
+    if (oldByteCounts == NULL) {
+        ALOGE("%s: IFD %u does not contain StripByteCounts entry.", __FUNCTION__, mIfdId);
+        return BAD_VALUE;
+    }
+
+    if (oldByteCounts->getCount() != count) {
+        ALOGE("%s: Byte count list size (%u) doesn't match strip count (%u) in IFD %u",
+                __FUNCTION__, count, oldByteCounts->getCount(), mIfdId);
+        return BAD_VALUE;
+    }
+
+    sp<TiffEntry> newByteCounts = TiffWriter::uncheckedBuildEntry(byteCountsTag, LONG,
+            count, UNDEFINED_ENDIAN, byteCounts);
+
+    if (newByteCounts == NULL || addEntry(newByteCounts) != OK) {
+        ALOGE("%s: Failed to update byte counts entry in IFD %u", __FUNCTION__, mIfdId);
+        return BAD_VALUE;
+    }
+    return OK;
+}
+
 uint32_t TiffIfd::getStripSize() const {
-    sp<TiffEntry> stripByteCounts = getEntry(TAG_STRIPBYTECOUNTS);
+    sp<TiffEntry> stripByteCounts =
+            getEntry(isTiled() ? TAG_TILEBYTECOUNTS : TAG_STRIPBYTECOUNTS);
     if (stripByteCounts == NULL) {
         ALOGE("%s: IFD %u does not contain StripByteCounts entry.", __FUNCTION__, mIfdId);
         return BAD_VALUE;
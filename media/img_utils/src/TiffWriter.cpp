@@ -16,15 +16,298 @@
 
 #define LOG_TAG "TiffWriter"
 
+#include <img_utils/LosslessJpegEncoder.h>
 #include <img_utils/TiffHelpers.h>
 #include <img_utils/TiffWriter.h>
 #include <img_utils/TagDefinitions.h>
 
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+#include <algorithm>
+
 #include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
 
 namespace android {
 namespace img_utils {
 
+namespace {
+
+enum {
+    MAX_WRITER_THREADS = 8,
+    // Number of uncompressed strips or tiles that may be prepared ahead of
+    // the output, per worker thread.
+    CHUNKS_AHEAD_PER_THREAD = 4,
+};
+
+/**
+ * Image data to write for one IFD.
+ */
+struct IfdLayout {
+    sp<TiffIfd> ifd;
+    const TileSource* source;
+    uint32_t width;
+    uint32_t height;
+    uint32_t samplesPerPixel;
+    uint32_t bytesPerSample;
+    bool compressed;
+    size_t firstChunk;
+    size_t chunkCount;
+};
+
+/**
+ * A single strip or tile.  Tiles on the image edges are padded to the full
+ * tile size.
+ */
+struct Chunk {
+    size_t layout;
+    uint32_t row;
+    uint32_t column;
+    uint32_t rowCount;
+    uint32_t columnCount;
+    uint32_t paddedRows;
+    uint32_t paddedColumns;
+};
+
+/**
+ * Prepares strips or tiles on a pool of worker threads.  Workers stay at most
+ * window chunks ahead of the last chunk taken by waitForChunk.
+ */
+class ChunkPreparer {
+    public:
+        ChunkPreparer(const Vector<IfdLayout>& layouts, const Vector<Chunk>& chunks,
+                size_t window);
+        ~ChunkPreparer();
+
+        status_t start(uint32_t numThreads);
+
+        /**
+         * Wait for the chunk with the given index, and move its data to the
+         * given vector.  Chunks must be taken in order.
+         */
+        status_t waitForChunk(size_t index, /*out*/Vector<uint8_t>* data);
+
+    private:
+        static void* threadWrapper(void* me);
+        void threadLoop();
+        status_t prepare(const Chunk& chunk, /*out*/Vector<uint8_t>* data) const;
+
+        const Vector<IfdLayout>& mLayouts;
+        const Vector<Chunk>& mChunks;
+        const size_t mWindow;
+
+        Mutex mLock;
+        Condition mCondition;
+        Vector<pthread_t> mThreads;
+        Vector<Vector<uint8_t> > mResults;
+        Vector<bool> mReady;
+        size_t mNextChunk;
+        size_t mTaken;
+        status_t mError;
+        bool mAborted;
+};
+
+ChunkPreparer::ChunkPreparer(const Vector<IfdLayout>& layouts, const Vector<Chunk>& chunks,
+        size_t window)
+        : mLayouts(layouts), mChunks(chunks), mWindow(window), mNextChunk(0), mTaken(0),
+          mError(OK), mAborted(false) {
+    mResults.resize(chunks.size());
+    mReady.insertAt(false, 0, chunks.size());
+}
+
+ChunkPreparer::~ChunkPreparer() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mAborted = true;
+        mCondition.broadcast();
+    }
+    for (size_t i = 0; i < mThreads.size(); ++i) {
+        pthread_join(mThreads[i], NULL);
+    }
+}
+
+status_t ChunkPreparer::start(uint32_t numThreads) {
+    for (uint32_t i = 0; i < numThreads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, threadWrapper, this) != 0) {
+            break;
+        }
+        mThreads.push_back(thread);
+    }
+    if (mThreads.isEmpty()) {
+        ALOGE("%s: Could not start any worker threads.", __FUNCTION__);
+        return UNKNOWN_ERROR;
+    }
+    return OK;
+}
+
+// static
+void* ChunkPreparer::threadWrapper(void* me) {
+    static_cast<ChunkPreparer*>(me)->threadLoop();
+    return NULL;
+}
+
+void ChunkPreparer::threadLoop() {
+    Mutex::Autolock autoLock(mLock);
+    for (;;) {
+        while (!mAborted && mNextChunk < mChunks.size() && mNextChunk >= mTaken + mWindow) {
+            mCondition.wait(mLock);
+        }
+        if (mAborted || mNextChunk >= mChunks.size()) {
+            return;
+        }
+        size_t index = mNextChunk++;
+
+        Vector<uint8_t> data;
+        mLock.unlock();
+        status_t err = prepare(mChunks[index], &data);
+        mLock.lock();
+
+        if (err != OK) {
+            mError = err;
+            mAborted = true;
+        } else {
+            mResults.editItemAt(index) = data;
+            mReady.editItemAt(index) = true;
+        }
+        mCondition.broadcast();
+    }
+}
+
+status_t ChunkPreparer::waitForChunk(size_t index, /*out*/Vector<uint8_t>* data) {
+    Mutex::Autolock autoLock(mLock);
+    while (!mAborted && !mReady[index]) {
+        mCondition.wait(mLock);
+    }
+    if (!mReady[index]) {
+        return mError != OK ? mError : UNKNOWN_ERROR;
+    }
+    *data = mResults[index];
+    mResults.editItemAt(index).clear();
+    mTaken = index + 1;
+    mCondition.broadcast();
+    return OK;
+}
+
+status_t ChunkPreparer::prepare(const Chunk& chunk, /*out*/Vector<uint8_t>* data) const {
+    const IfdLayout& layout = mLayouts[chunk.layout];
+    const size_t pixelSize = layout.samplesPerPixel * layout.bytesPerSample;
+    const size_t rowStride = chunk.paddedColumns * pixelSize;
+
+    Vector<uint8_t> pixels;
+    if (pixels.resize(rowStride * chunk.paddedRows) < 0) {
+        ALOGE("%s: Could not allocate %zu bytes for strip.", __FUNCTION__,
+                rowStride * chunk.paddedRows);
+        return NO_MEMORY;
+    }
+    uint8_t* pixelData = pixels.editArray();
+    if (chunk.rowCount != chunk.paddedRows || chunk.columnCount != chunk.paddedColumns) {
+        memset(pixelData, 0, pixels.size());
+    }
+
+    status_t ret = layout.source->readPixels(chunk.row, chunk.column, chunk.rowCount,
+            chunk.columnCount, pixelData, rowStride);
+    if (ret != OK) {
+        ALOGE("%s: Could not read pixels for IFD %u, received %d.", __FUNCTION__,
+                layout.ifd->getId(), ret);
+        return ret;
+    }
+
+    if (!layout.compressed) {
+        *data = pixels;
+        return OK;
+    }
+
+    const uint16_t* samples = reinterpret_cast<const uint16_t*>(pixelData);
+    Vector<uint16_t> widened;
+    if (layout.bytesPerSample == 1) {
+        widened.resize(pixels.size());
+        uint16_t* dst = widened.editArray();
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            dst[i] = pixelData[i];
+        }
+        samples = widened.array();
+    }
+
+    // Code single sample (CFA) images as two interleaved components of half
+    // the width, so each sample is predicted from the nearest one of the same
+    // color.  This is the layout DNG readers expect.
+    uint32_t components = layout.samplesPerPixel;
+    uint32_t width = chunk.paddedColumns;
+    if (components == 1 && (width % 2) == 0) {
+        components = 2;
+        width /= 2;
+    }
+
+    data->clear();
+    return LosslessJpegEncoder::encode(samples, width, chunk.paddedRows, components,
+            layout.bytesPerSample * 8, width * components, data);
+}
+
+/**
+ * Split the image in the given IFD into strips or tiles, as described by its
+ * strip or tile tags.
+ */
+status_t addChunks(size_t layoutIndex, const IfdLayout& layout, /*out*/Vector<Chunk>* chunks) {
+    const sp<TiffIfd>& ifd = layout.ifd;
+    const bool tiled = ifd->isTiled();
+
+    uint32_t chunkWidth = layout.width;
+    uint32_t chunkLength;
+    sp<TiffEntry> byteCounts;
+    if (tiled) {
+        sp<TiffEntry> tileWidth = ifd->getEntry(TAG_TILEWIDTH);
+        sp<TiffEntry> tileLength = ifd->getEntry(TAG_TILELENGTH);
+        if (tileWidth == NULL || tileLength == NULL) {
+            ALOGE("%s: IFD %u is missing tile size tags.", __FUNCTION__, ifd->getId());
+            return BAD_VALUE;
+        }
+        chunkWidth = *(tileWidth->getData<uint32_t>());
+        chunkLength = *(tileLength->getData<uint32_t>());
+        byteCounts = ifd->getEntry(TAG_TILEBYTECOUNTS);
+    } else {
+        sp<TiffEntry> rowsPerStrip = ifd->getEntry(TAG_ROWSPERSTRIP);
+        if (rowsPerStrip == NULL) {
+            ALOGE("%s: IFD %u is missing RowsPerStrip tag.", __FUNCTION__, ifd->getId());
+            return BAD_VALUE;
+        }
+        chunkLength = *(rowsPerStrip->getData<uint32_t>());
+        byteCounts = ifd->getEntry(TAG_STRIPBYTECOUNTS);
+    }
+
+    if (byteCounts == NULL || chunkWidth == 0 || chunkLength == 0) {
+        ALOGE("%s: Invalid strip tags in IFD %u.", __FUNCTION__, ifd->getId());
+        return BAD_VALUE;
+    }
+
+    for (uint32_t row = 0; row < layout.height; row += chunkLength) {
+        for (uint32_t column = 0; column < layout.width; column += chunkWidth) {
+            Chunk chunk;
+            chunk.layout = layoutIndex;
+            chunk.row = row;
+            chunk.column = column;
+            chunk.rowCount = std::min(chunkLength, layout.height - row);
+            chunk.columnCount = std::min(chunkWidth, layout.width - column);
+            chunk.paddedRows = tiled ? chunkLength : chunk.rowCount;
+            chunk.paddedColumns = tiled ? chunkWidth : chunk.columnCount;
+            chunks->push_back(chunk);
+        }
+    }
+
+    if (chunks->size() - layout.firstChunk != byteCounts->getCount()) {
+        ALOGE("%s: Number of strips (%zu) in IFD %u doesn't match byte counts (%u).",
+                __FUNCTION__, chunks->size() - layout.firstChunk, ifd->getId(),
+                byteCounts->getCount());
+        return BAD_VALUE;
+    }
+    return OK;
+}
+
+} // namespace
+
 KeyedVector<uint16_t, const TagDefinition_t*> TiffWriter::buildTagMap(
             const TagDefinition_t* definitions, size_t length) {
     KeyedVector<uint16_t, const TagDefinition_t*> map;
@@ -91,14 +374,7 @@ status_t TiffWriter::write(Output* out, StripSource** sources, size_t sourcesCou
     }
 
     BAIL_ON_FAIL(writeFileHeader(endOut), ret);
-
-    uint32_t offset = FILE_HEADER_SIZE;
-    sp<TiffIfd> ifd = mIfd;
-    while(ifd != NULL) {
-        BAIL_ON_FAIL(ifd->writeData(offset, &endOut), ret);
-        offset += ifd->getSize();
-        ifd = ifd->getNextIfd();
-    }
+    BAIL_ON_FAIL(writeIfds(endOut), ret);
 
     if (LOG_NDEBUG == 0) {
         log();
@@ -110,7 +386,7 @@ status_t TiffWriter::write(Output* out, StripSource** sources, size_t sourcesCou
         bool found = false;
         for (size_t j = 0; j < sourcesCount; ++j) {
             if (sources[j]->getIfd() == ifdKey) {
-                if ((ret = sources[i]->writeToStream(endOut, sizeToWrite)) != OK) {
+                if ((ret = sources[j]->writeToStream(endOut, sizeToWrite)) != OK) {
                     ALOGE("%s: Could not write to stream, received %d.", __FUNCTION__, ret);
                     return ret;
                 }
@@ -129,7 +405,8 @@ status_t TiffWriter::write(Output* out, StripSource** sources, size_t sourcesCou
     return ret;
 }
 
-status_t TiffWriter::write(Output* out, Endianness end) {
+status_t TiffWriter::write(Output* out, TileSource** sources, size_t sourcesCount,
+        Endianness end, uint32_t numThreads) {
     status_t ret = OK;
     EndianOutput endOut(out, end);
 
@@ -137,15 +414,148 @@ status_t TiffWriter::write(Output* out, Endianness end) {
         ALOGE("%s: Tiff header is empty.", __FUNCTION__);
         return BAD_VALUE;
     }
+
+    // Split the image data of each IFD with strip or tile tags into chunks.
+    Vector<IfdLayout> layouts;
+    Vector<Chunk> chunks;
+    bool compressed = false;
+    for (size_t i = 0; i < mNamedIfds.size(); ++i) {
+        if (!mNamedIfds[i]->uninitializedOffsets()) {
+            continue;
+        }
+
+        IfdLayout layout;
+        layout.ifd = mNamedIfds[i];
+        layout.source = NULL;
+        for (size_t j = 0; j < sourcesCount; ++j) {
+            if (sources[j]->getIfd() == mNamedIfds.keyAt(i)) {
+                layout.source = sources[j];
+                break;
+            }
+        }
+        if (layout.source == NULL) {
+            ALOGE("%s: No source for image data for IFD %u", __FUNCTION__, mNamedIfds.keyAt(i));
+            return BAD_VALUE;
+        }
+
+        BAIL_ON_FAIL(layout.ifd->getImageLayout(&layout.width, &layout.height,
+                &layout.samplesPerPixel, &layout.bytesPerSample), ret);
+
+        uint16_t compression = TAG_COMPRESSION_NONE;
+        sp<TiffEntry> compressionEntry = layout.ifd->getEntry(TAG_COMPRESSION);
+        if (compressionEntry != NULL) {
+            compression = *(compressionEntry->getData<uint16_t>());
+        }
+        if (compression == TAG_COMPRESSION_JPEG && layout.bytesPerSample <= 2) {
+            layout.compressed = true;
+            compressed = true;
+        } else if (compression == TAG_COMPRESSION_NONE) {
+            layout.compressed = false;
+        } else {
+            ALOGE("%s: Unsupported compression %u for IFD %u.", __FUNCTION__, compression,
+                    mNamedIfds.keyAt(i));
+            return BAD_VALUE;
+        }
+
+        layout.firstChunk = chunks.size();
+        BAIL_ON_FAIL(addChunks(layouts.size(), layout, &chunks), ret);
+        layout.chunkCount = chunks.size() - layout.firstChunk;
+        layouts.push_back(layout);
+    }
+
+    if (layouts.size() != sourcesCount) {
+        ALOGE("%s: Mismatch between number of IFDs with uninitialized strips (%zu) and"
+                " sources (%zu).", __FUNCTION__, layouts.size(), sourcesCount);
+        return BAD_VALUE;
+    }
+
+    if (numThreads == 0) {
+        long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = (numCpus > 0) ? static_cast<uint32_t>(numCpus) : 1;
+        numThreads = std::min(numThreads, static_cast<uint32_t>(MAX_WRITER_THREADS));
+    }
+    if (numThreads > chunks.size()) {
+        numThreads = std::max(static_cast<uint32_t>(chunks.size()), 1u);
+    }
+
+    // Compressed sizes, and so the header, are only known once every chunk
+    // has been prepared.  Uncompressed chunks are streamed after the header.
+    size_t window = compressed ? chunks.size() : numThreads * CHUNKS_AHEAD_PER_THREAD;
+    ChunkPreparer preparer(layouts, chunks, window);
+    BAIL_ON_FAIL(preparer.start(numThreads), ret);
+
+    Vector<Vector<uint8_t> > prepared;
+    if (compressed) {
+        prepared.resize(chunks.size());
+        for (size_t i = 0; i < layouts.size(); ++i) {
+            const IfdLayout& layout = layouts[i];
+            Vector<uint32_t> byteCounts;
+            for (size_t j = layout.firstChunk; j < layout.firstChunk + layout.chunkCount; ++j) {
+                BAIL_ON_FAIL(preparer.waitForChunk(j, &prepared.editItemAt(j)), ret);
+                byteCounts.add(prepared[j].size());
+            }
+            BAIL_ON_FAIL(layout.ifd->setStripByteCounts(byteCounts.array(),
+                    static_cast<uint32_t>(byteCounts.size())), ret);
+        }
+    }
+
+    uint32_t totalSize = getTotalSize();
+    for (size_t i = 0; i < layouts.size(); ++i) {
+        uint32_t stripSize = layouts[i].ifd->getStripSize();
+        if (layouts[i].ifd->setStripOffset(totalSize) != OK) {
+            ALOGE("%s: Could not set strip offsets.", __FUNCTION__);
+            return BAD_VALUE;
+        }
+        totalSize += stripSize;
+        WORD_ALIGN(totalSize);
+    }
+
     BAIL_ON_FAIL(writeFileHeader(endOut), ret);
+    BAIL_ON_FAIL(writeIfds(endOut), ret);
 
-    uint32_t offset = FILE_HEADER_SIZE;
-    sp<TiffIfd> ifd = mIfd;
-    while(ifd != NULL) {
-        BAIL_ON_FAIL(ifd->writeData(offset, &endOut), ret);
-        offset += ifd->getSize();
-        ifd = ifd->getNextIfd();
+    if (LOG_NDEBUG == 0) {
+        log();
+    }
+
+    for (size_t i = 0; i < layouts.size(); ++i) {
+        const IfdLayout& layout = layouts[i];
+        const uint32_t* byteCounts = layout.ifd->getEntry(layout.ifd->isTiled() ?
+                TAG_TILEBYTECOUNTS : TAG_STRIPBYTECOUNTS)->getData<uint32_t>();
+        for (size_t j = 0; j < layout.chunkCount; ++j) {
+            size_t index = layout.firstChunk + j;
+            Vector<uint8_t> data;
+            if (compressed) {
+                data = prepared[index];
+                prepared.editItemAt(index).clear();
+            } else {
+                BAIL_ON_FAIL(preparer.waitForChunk(index, &data), ret);
+            }
+            if (data.size() != byteCounts[j]) {
+                ALOGE("%s: Strip %zu in IFD %u has %zu bytes, expected %u.", __FUNCTION__, j,
+                        layout.ifd->getId(), data.size(), byteCounts[j]);
+                return BAD_VALUE;
+            }
+            if ((ret = endOut.write(data.array(), 0, data.size())) != OK) {
+                ALOGE("%s: Could not write to stream, received %d.", __FUNCTION__, ret);
+                return ret;
+            }
+        }
+        ZERO_TILL_WORD(&endOut, layout.ifd->getStripSize(), ret);
+    }
+
+    return ret;
+}
+
+status_t TiffWriter::write(Output* out, Endianness end) {
+    status_t ret = OK;
+    EndianOutput endOut(out, end);
+
+    if (mIfd == NULL) {
+        ALOGE("%s: Tiff header is empty.", __FUNCTION__);
+        return BAD_VALUE;
     }
+    BAIL_ON_FAIL(writeFileHeader(endOut), ret);
+    BAIL_ON_FAIL(writeIfds(endOut), ret);
     return ret;
 }
 
@@ -214,6 +624,16 @@ status_t TiffWriter::addStrip(uint32_t ifd) {
     return selected->validateAndSetStripTags();
 }
 
+status_t TiffWriter::addTiles(uint32_t ifd, uint32_t tileWidth, uint32_t tileLength) {
+    ssize_t index = mNamedIfds.indexOfKey(ifd);
+    if (index < 0) {
+        ALOGE("%s: Ifd %u doesn't exist, cannot add tile entries.", __FUNCTION__, ifd);
+        return BAD_VALUE;
+    }
+    sp<TiffIfd> selected = mNamedIfds[index];
+    return selected->validateAndSetTileTags(tileWidth, tileLength);
+}
+
 status_t TiffWriter::addIfd(uint32_t ifd) {
     ssize_t index = mNamedIfds.indexOfKey(ifd);
     if (index >= 0) {
@@ -368,6 +788,18 @@ status_t TiffWriter::writeFileHeader(EndianOutput& out) {
     return ret;
 }
 
+status_t TiffWriter::writeIfds(EndianOutput& out) {
+    status_t ret = OK;
+    uint32_t offset = FILE_HEADER_SIZE;
+    sp<TiffIfd> ifd = mIfd;
+    while(ifd != NULL) {
+        BAIL_ON_FAIL(ifd->writeData(offset, &out), ret);
+        offset += ifd->getSize();
+        ifd = ifd->getNextIfd();
+    }
+    return ret;
+}
+
 uint32_t TiffWriter::getTotalSize() const {
     uint32_t totalSize = FILE_HEADER_SIZE;
     sp<TiffIfd> ifd = mIfd;
@@ -0,0 +1,55 @@
+# Copyright 2016 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+  TiffWriterBench.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+  libimg_utils \
+  libutils \
+  liblog
+
+LOCAL_CFLAGS += \
+  -Wall \
+  -Wextra \
+  -Werror
+
+LOCAL_MODULE := tiffwriter_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+  LosslessJpegEncoder_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+  libimg_utils \
+  libutils \
+  liblog
+
+LOCAL_CFLAGS += \
+  -Wall \
+  -Wextra \
+  -Werror
+
+LOCAL_MODULE := LosslessJpegEncoder_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,467 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LosslessJpegEncoder_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <img_utils/ByteArrayOutput.h>
+#include <img_utils/LosslessJpegEncoder.h>
+#include <img_utils/TagDefinitions.h>
+#include <img_utils/TiffWriter.h>
+#include <img_utils/TileSource.h>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace android {
+namespace img_utils {
+
+/**
+ * Reads entropy coded data, dropping the stuffed zero after each 0xFF byte.
+ */
+class BitReader {
+    public:
+        BitReader(const uint8_t* data, size_t size) :
+                mData(data), mSize(size), mPos(0), mByte(0), mCount(0) {}
+
+        // Returns the next bit, or -1 at the end of the data.
+        int getBit() {
+            if (mCount == 0) {
+                if (mPos >= mSize) {
+                    return -1;
+                }
+                mByte = mData[mPos++];
+                if (mByte == 0xFF) {
+                    if (mPos >= mSize || mData[mPos] != 0) {
+                        return -1;
+                    }
+                    ++mPos;
+                }
+                mCount = 8;
+            }
+            --mCount;
+            return (mByte >> mCount) & 1;
+        }
+
+        bool getBits(uint32_t count, uint32_t* value) {
+            *value = 0;
+            for (uint32_t i = 0; i < count; ++i) {
+                int bit = getBit();
+                if (bit < 0) {
+                    return false;
+                }
+                *value = (*value << 1) | bit;
+            }
+            return true;
+        }
+
+        // Whether the rest of the current byte is the 1 bit padding.
+        bool atPadding() const {
+            return (mByte & ((1u << mCount) - 1)) == (1u << mCount) - 1;
+        }
+
+        size_t position() const {
+            return mPos;
+        }
+
+    private:
+        const uint8_t* mData;
+        size_t mSize;
+        size_t mPos;
+        uint8_t mByte;
+        uint32_t mCount;
+};
+
+struct DecodedImage {
+    uint32_t width;
+    uint32_t height;
+    uint32_t components;
+    uint32_t bitsPerSample;
+    Vector<uint16_t> samples; // width * components samples per row
+};
+
+/**
+ * Decodes what LosslessJpegEncoder writes: a T.81 lossless image with a single
+ * Huffman table, predictor 1 and no point transform.  Returns false if the
+ * data isn't such an image.
+ */
+static bool decodeLosslessJpeg(const uint8_t* data, size_t size, DecodedImage* image) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+
+    uint8_t bits[16];
+    uint8_t huffVal[256];
+    bool haveFrame = false;
+    bool haveTable = false;
+    size_t pos = 2;
+    for (;;) {
+        if (pos + 4 > size || data[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = data[pos + 1];
+        size_t length = (data[pos + 2] << 8) | data[pos + 3];
+        const uint8_t* segment = data + pos + 4;
+        if (length < 2 || pos + 2 + length > size) {
+            return false;
+        }
+        pos += 2 + length;
+
+        if (marker == 0xC3) { // SOF3
+            image->bitsPerSample = segment[0];
+            image->height = (segment[1] << 8) | segment[2];
+            image->width = (segment[3] << 8) | segment[4];
+            image->components = segment[5];
+            haveFrame = true;
+        } else if (marker == 0xC4) { // DHT
+            memcpy(bits, segment + 1, sizeof(bits));
+            size_t count = 0;
+            for (size_t i = 0; i < sizeof(bits); ++i) {
+                count += bits[i];
+            }
+            if (count > sizeof(huffVal) || 1 + 16 + count != length - 2) {
+                return false;
+            }
+            memcpy(huffVal, segment + 1 + 16, count);
+            haveTable = true;
+        } else if (marker == 0xDA) { // SOS
+            if (segment[1 + 2 * segment[0]] != 1) {
+                return false; // predictor
+            }
+            break;
+        }
+    }
+    if (!haveFrame || !haveTable) {
+        return false;
+    }
+
+    // Canonical codes (T.81 Annex C)
+    uint32_t firstCode[17];
+    uint32_t firstIndex[17];
+    uint32_t code = 0;
+    uint32_t index = 0;
+    for (int length = 1; length <= 16; ++length) {
+        firstCode[length] = code;
+        firstIndex[length] = index;
+        code = (code + bits[length - 1]) << 1;
+        index += bits[length - 1];
+    }
+
+    const uint32_t components = image->components;
+    const size_t rowSamples = image->width * components;
+    image->samples.resize(rowSamples * image->height);
+    uint16_t* out = image->samples.editArray();
+
+    BitReader reader(data + pos, size - pos);
+    for (uint32_t y = 0; y < image->height; ++y) {
+        for (uint32_t x = 0; x < image->width; ++x) {
+            for (uint32_t c = 0; c < components; ++c) {
+                uint32_t ssss = 0;
+                uint32_t value = 0;
+                bool found = false;
+                for (int length = 1; length <= 16 && !found; ++length) {
+                    int bit = reader.getBit();
+                    if (bit < 0) {
+                        return false;
+                    }
+                    value = (value << 1) | bit;
+                    if (value - firstCode[length] < bits[length - 1]) {
+                        ssss = huffVal[firstIndex[length] + value - firstCode[length]];
+                        found = true;
+                    }
+                }
+                if (!found || ssss > 16) {
+                    return false;
+                }
+
+                int32_t diff = 0;
+                if (ssss == 16) {
+                    diff = 32768;
+                } else if (ssss > 0) {
+                    uint32_t extra;
+                    if (!reader.getBits(ssss, &extra)) {
+                        return false;
+                    }
+                    diff = extra;
+                    if (extra < (1u << (ssss - 1))) {
+                        diff = static_cast<int32_t>(extra) - (1 << ssss) + 1;
+                    }
+                }
+
+                uint32_t prediction;
+                if (x == 0 && y == 0) {
+                    prediction = 1u << (image->bitsPerSample - 1);
+                } else if (x == 0) {
+                    prediction = out[(y - 1) * rowSamples + c];
+                } else {
+                    prediction = out[y * rowSamples + (x - 1) * components + c];
+                }
+                out[y * rowSamples + x * components + c] =
+                        static_cast<uint16_t>(prediction + diff);
+            }
+        }
+    }
+
+    // Only padding and EOI may follow.
+    return reader.atPadding() && pos + reader.position() + 2 == size &&
+            data[size - 2] == 0xFF && data[size - 1] == 0xD9;
+}
+
+enum Pattern {
+    PATTERN_GRADIENT, // smooth with a little noise, like a real image
+    PATTERN_FLAT,
+    PATTERN_NOISE,
+    PATTERN_EXTREMES, // the largest differences, including 32768 at 16 bits
+};
+
+static uint16_t patternSample(Pattern pattern, uint32_t bitsPerSample, uint32_t x, uint32_t y,
+        uint32_t c) {
+    const uint32_t mask = (1u << bitsPerSample) - 1;
+    switch (pattern) {
+        case PATTERN_GRADIENT:
+            return (x * 7 + y * 3 + c * 40 + ((x * 31 + y * 17) % 5)) & mask;
+        case PATTERN_FLAT:
+            return 5 & mask;
+        case PATTERN_NOISE:
+            return ((x * 2654435761u) ^ (y * 40503u) ^ (c * 977u)) & mask;
+        case PATTERN_EXTREMES:
+        default:
+            if ((x + y + c) % 3 == 0) {
+                return 0;
+            }
+            return ((x + y) % 2 == 0) ? mask : (1u << (bitsPerSample - 1));
+    }
+}
+
+TEST(LosslessJpegEncoderTest, RoundTrip) {
+    const uint32_t kWidth = 17;
+    const uint32_t kHeight = 9;
+    const uint32_t kBitsPerSample[] = { 2, 8, 10, 12, 16 };
+    const Pattern kPatterns[] = {
+        PATTERN_GRADIENT, PATTERN_FLAT, PATTERN_NOISE, PATTERN_EXTREMES,
+    };
+
+    for (uint32_t components = 1; components <= 4; ++components) {
+        for (size_t b = 0; b < sizeof(kBitsPerSample) / sizeof(kBitsPerSample[0]); ++b) {
+            for (size_t p = 0; p < sizeof(kPatterns) / sizeof(kPatterns[0]); ++p) {
+                const uint32_t bitsPerSample = kBitsPerSample[b];
+                SCOPED_TRACE(testing::Message() << components << " components, "
+                        << bitsPerSample << " bits, pattern " << kPatterns[p]);
+
+                // Samples past the end of each row must be ignored.
+                const size_t rowStride = kWidth * components + 3;
+                Vector<uint16_t> samples;
+                samples.insertAt(0xABCD, 0, rowStride * kHeight);
+                uint16_t* s = samples.editArray();
+                for (uint32_t y = 0; y < kHeight; ++y) {
+                    for (uint32_t x = 0; x < kWidth; ++x) {
+                        for (uint32_t c = 0; c < components; ++c) {
+                            s[y * rowStride + x * components + c] =
+                                    patternSample(kPatterns[p], bitsPerSample, x, y, c);
+                        }
+                    }
+                }
+
+                Vector<uint8_t> encoded;
+                ASSERT_EQ(OK, LosslessJpegEncoder::encode(samples.array(), kWidth, kHeight,
+                        components, bitsPerSample, rowStride, &encoded));
+
+                DecodedImage image;
+                ASSERT_TRUE(decodeLosslessJpeg(encoded.array(), encoded.size(), &image));
+                ASSERT_EQ(kWidth, image.width);
+                ASSERT_EQ(kHeight, image.height);
+                ASSERT_EQ(components, image.components);
+                ASSERT_EQ(bitsPerSample, image.bitsPerSample);
+                for (uint32_t y = 0; y < kHeight; ++y) {
+                    ASSERT_EQ(0, memcmp(&s[y * rowStride],
+                            &image.samples[y * kWidth * components],
+                            kWidth * components * sizeof(uint16_t))) << "row " << y;
+                }
+            }
+        }
+    }
+}
+
+TEST(LosslessJpegEncoderTest, AppendsToOutput) {
+    const uint16_t samples[] = { 1, 2, 3, 4 };
+    Vector<uint8_t> encoded;
+    encoded.push_back(0x42);
+    ASSERT_EQ(OK, LosslessJpegEncoder::encode(samples, 2, 2, 1, 8, 2, &encoded));
+
+    ASSERT_GT(encoded.size(), 1u);
+    EXPECT_EQ(0x42, encoded[0]);
+    DecodedImage image;
+    ASSERT_TRUE(decodeLosslessJpeg(encoded.array() + 1, encoded.size() - 1, &image));
+    EXPECT_EQ(0, memcmp(samples, image.samples.array(), sizeof(samples)));
+}
+
+TEST(LosslessJpegEncoderTest, RejectsInvalidArguments) {
+    const uint16_t samples[16] = { 0 };
+    Vector<uint8_t> encoded;
+    EXPECT_EQ(BAD_VALUE, LosslessJpegEncoder::encode(samples, 0, 4, 1, 8, 4, &encoded));
+    EXPECT_EQ(BAD_VALUE, LosslessJpegEncoder::encode(samples, 4, 0, 1, 8, 4, &encoded));
+    EXPECT_EQ(BAD_VALUE, LosslessJpegEncoder::encode(samples, 2, 2, 5, 8, 10, &encoded));
+    EXPECT_EQ(BAD_VALUE, LosslessJpegEncoder::encode(samples, 4, 4, 1, 1, 4, &encoded));
+    EXPECT_EQ(BAD_VALUE, LosslessJpegEncoder::encode(samples, 4, 4, 1, 17, 4, &encoded));
+    EXPECT_EQ(BAD_VALUE, LosslessJpegEncoder::encode(samples, 4, 4, 1, 8, 3, &encoded));
+    EXPECT_EQ(0u, encoded.size());
+}
+
+static const uint32_t kRawIfd = 0;
+
+/**
+ * 16-bit single sample image with the gradient pattern.
+ */
+class PatternTileSource : public TileSource {
+    public:
+        PatternTileSource(uint32_t width, uint32_t height) : mWidth(width), mHeight(height) {
+            mPixels.resize(width * height);
+            uint16_t* pixels = mPixels.editArray();
+            for (uint32_t y = 0; y < height; ++y) {
+                for (uint32_t x = 0; x < width; ++x) {
+                    pixels[y * width + x] = patternSample(PATTERN_GRADIENT, 16, x, y, 0);
+                }
+            }
+        }
+
+        virtual ~PatternTileSource() {}
+
+        virtual status_t readPixels(uint32_t row, uint32_t column, uint32_t rowCount,
+                uint32_t columnCount, uint8_t* dst, size_t dstRowStride) const {
+            if (row + rowCount > mHeight || column + columnCount > mWidth) {
+                return BAD_VALUE;
+            }
+            const uint16_t* src = mPixels.array() + row * mWidth + column;
+            for (uint32_t y = 0; y < rowCount; ++y) {
+                memcpy(dst, src, columnCount * sizeof(uint16_t));
+                src += mWidth;
+                dst += dstRowStride;
+            }
+            return OK;
+        }
+
+        virtual uint32_t getIfd() const {
+            return kRawIfd;
+        }
+
+        uint16_t pixel(uint32_t x, uint32_t y) const {
+            return mPixels[y * mWidth + x];
+        }
+
+    private:
+        uint32_t mWidth;
+        uint32_t mHeight;
+        Vector<uint16_t> mPixels;
+};
+
+/**
+ * Writes the source as a tiled raw IFD, then decodes every tile found through
+ * the tile offset and byte count tags and compares it with the source.  Edge
+ * tiles are padded with zeros.
+ */
+static void checkTiledRoundTrip(uint16_t compression, uint32_t numThreads) {
+    const uint32_t kWidth = 100;
+    const uint32_t kHeight = 70;
+    const uint32_t kTileSize = 32;
+
+    PatternTileSource source(kWidth, kHeight);
+    sp<TiffWriter> writer = new TiffWriter();
+    ASSERT_EQ(OK, writer->addIfd(kRawIfd));
+
+    uint32_t width = kWidth;
+    uint32_t height = kHeight;
+    uint16_t bitsPerSample = 16;
+    uint16_t samplesPerPixel = 1;
+    uint16_t photometric = 32803; // CFA
+    ASSERT_EQ(OK, writer->addEntry(TAG_IMAGEWIDTH, 1, &width, kRawIfd));
+    ASSERT_EQ(OK, writer->addEntry(TAG_IMAGELENGTH, 1, &height, kRawIfd));
+    ASSERT_EQ(OK, writer->addEntry(TAG_BITSPERSAMPLE, 1, &bitsPerSample, kRawIfd));
+    ASSERT_EQ(OK, writer->addEntry(TAG_SAMPLESPERPIXEL, 1, &samplesPerPixel, kRawIfd));
+    ASSERT_EQ(OK, writer->addEntry(TAG_COMPRESSION, 1, &compression, kRawIfd));
+    ASSERT_EQ(OK, writer->addEntry(TAG_PHOTOMETRICINTERPRETATION, 1, &photometric,
+            kRawIfd));
+    ASSERT_EQ(OK, writer->addTiles(kRawIfd, kTileSize, kTileSize));
+
+    ByteArrayOutput out;
+    ASSERT_EQ(OK, out.open());
+    TileSource* sources[] = { &source };
+    ASSERT_EQ(OK, writer->write(&out, sources, 1, LITTLE, numThreads));
+    // Closing drops what was written.
+    Vector<uint8_t> written;
+    written.appendArray(out.getArray(), out.getSize());
+    ASSERT_EQ(OK, out.close());
+
+    const uint32_t tilesAcross = (kWidth + kTileSize - 1) / kTileSize;
+    const uint32_t tilesDown = (kHeight + kTileSize - 1) / kTileSize;
+    sp<TiffEntry> offsets = writer->getEntry(TAG_TILEOFFSETS, kRawIfd);
+    sp<TiffEntry> byteCounts = writer->getEntry(TAG_TILEBYTECOUNTS, kRawIfd);
+    ASSERT_TRUE(offsets != NULL);
+    ASSERT_TRUE(byteCounts != NULL);
+    ASSERT_EQ(tilesAcross * tilesDown, offsets->getCount());
+    ASSERT_EQ(tilesAcross * tilesDown, byteCounts->getCount());
+
+    const uint8_t* file = written.array();
+    const size_t fileSize = written.size();
+    for (uint32_t t = 0; t < tilesAcross * tilesDown; ++t) {
+        SCOPED_TRACE(testing::Message() << "tile " << t);
+        const uint32_t offset = offsets->getData<uint32_t>()[t];
+        const uint32_t byteCount = byteCounts->getData<uint32_t>()[t];
+        ASSERT_LE(static_cast<size_t>(offset) + byteCount, fileSize);
+
+        Vector<uint16_t> tile;
+        if (compression == TAG_COMPRESSION_NONE) {
+            ASSERT_EQ(kTileSize * kTileSize * sizeof(uint16_t), byteCount);
+            tile.resize(kTileSize * kTileSize);
+            for (size_t i = 0; i < tile.size(); ++i) {
+                tile.editItemAt(i) = file[offset + 2 * i] | (file[offset + 2 * i + 1] << 8);
+            }
+        } else {
+            // CFA tiles are coded as two components of half the width.
+            DecodedImage image;
+            ASSERT_TRUE(decodeLosslessJpeg(file + offset, byteCount, &image));
+            ASSERT_EQ(kTileSize, image.width * image.components);
+            ASSERT_EQ(kTileSize, image.height);
+            tile = image.samples;
+        }
+
+        const uint32_t tileX = (t % tilesAcross) * kTileSize;
+        const uint32_t tileY = (t / tilesAcross) * kTileSize;
+        for (uint32_t y = 0; y < kTileSize; ++y) {
+            for (uint32_t x = 0; x < kTileSize; ++x) {
+                uint16_t expected = 0;
+                if (tileX + x < kWidth && tileY + y < kHeight) {
+                    expected = source.pixel(tileX + x, tileY + y);
+                }
+                ASSERT_EQ(expected, tile[y * kTileSize + x]) << "at " << x << ", " << y;
+            }
+        }
+    }
+}
+
+TEST(TiffWriterTest, TilesRoundTrip) {
+    ASSERT_NO_FATAL_FAILURE(checkTiledRoundTrip(TAG_COMPRESSION_NONE, 1));
+    ASSERT_NO_FATAL_FAILURE(checkTiledRoundTrip(TAG_COMPRESSION_NONE, 3));
+}
+
+TEST(TiffWriterTest, LosslessJpegTilesRoundTrip) {
+    ASSERT_NO_FATAL_FAILURE(checkTiledRoundTrip(TAG_COMPRESSION_JPEG, 1));
+    ASSERT_NO_FATAL_FAILURE(checkTiledRoundTrip(TAG_COMPRESSION_JPEG, 3));
+}
+
+} /*namespace img_utils*/
+} /*namespace android*/
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times TiffWriter writing a synthetic 16-bit CFA image (20 Mpixel by
+// default) as a DNG-style raw IFD: with the original StripSource path, with
+// strips and tiles prepared in parallel from a TileSource, and with tiles
+// compressed as lossless JPEG.  Each mode writes both to a file and to memory.
+
+#include <img_utils/ByteArrayOutput.h>
+#include <img_utils/FileOutput.h>
+#include <img_utils/StripSource.h>
+#include <img_utils/TagDefinitions.h>
+#include <img_utils/TileSource.h>
+#include <img_utils/TiffWriter.h>
+
+#include <utils/String8.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace android;
+using namespace android::img_utils;
+
+static const uint32_t kRawIfd = 0;
+
+/**
+ * 10-bit Bayer-like image data in 16-bit samples: a smooth gradient that
+ * differs per CFA color, plus a little noise.
+ */
+class SyntheticRawSource : public StripSource, public TileSource {
+    public:
+        SyntheticRawSource(uint32_t width, uint32_t height)
+                : mWidth(width), mHeight(height) {
+            mPixels.resize(width * height);
+            uint16_t* pixels = mPixels.editArray();
+            srand(width + height);
+            for (uint32_t y = 0; y < height; ++y) {
+                for (uint32_t x = 0; x < width; ++x) {
+                    uint32_t color = (y % 2) * 2 + (x % 2);
+                    uint32_t value = 64 + (x * 600 / width) + (y * 300 / height) + color * 40
+                            + (rand() % 16);
+                    pixels[y * width + x] = static_cast<uint16_t>(value & 0x3FF);
+                }
+            }
+        }
+
+        virtual ~SyntheticRawSource() {}
+
+        virtual status_t writeToStream(Output& stream, uint32_t count) {
+            size_t rowBytes = mWidth * sizeof(uint16_t);
+            if (count != rowBytes * mHeight) {
+                return BAD_VALUE;
+            }
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(mPixels.array());
+            for (uint32_t y = 0; y < mHeight; ++y) {
+                status_t err = stream.write(data, y * rowBytes, rowBytes);
+                if (err != OK) {
+                    return err;
+                }
+            }
+            return OK;
+        }
+
+        virtual status_t readPixels(uint32_t row, uint32_t column, uint32_t rowCount,
+                uint32_t columnCount, uint8_t* dst, size_t dstRowStride) const {
+            const uint16_t* src = mPixels.array() + row * mWidth + column;
+            for (uint32_t y = 0; y < rowCount; ++y) {
+                memcpy(dst, src, columnCount * sizeof(uint16_t));
+                src += mWidth;
+                dst += dstRowStride;
+            }
+            return OK;
+        }
+
+        virtual uint32_t getIfd() const {
+            return kRawIfd;
+        }
+
+        size_t getImageSize() const {
+            return mPixels.size() * sizeof(uint16_t);
+        }
+
+    private:
+        uint32_t mWidth;
+        uint32_t mHeight;
+        Vector<uint16_t> mPixels;
+};
+
+enum Mode {
+    MODE_STRIP_SOURCE,
+    MODE_PARALLEL_STRIPS,
+    MODE_TILES,
+    MODE_COMPRESSED_TILES,
+};
+
+static const struct {
+    Mode mMode;
+    const char* mName;
+} kModes[] = {
+    { MODE_STRIP_SOURCE, "strips (StripSource)" },
+    { MODE_PARALLEL_STRIPS, "strips (parallel)" },
+    { MODE_TILES, "tiles" },
+    { MODE_COMPRESSED_TILES, "tiles + lossless JPEG" },
+};
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static status_t writeImage(Mode mode, uint32_t width, uint32_t height, uint32_t tileSize,
+        uint32_t threads, SyntheticRawSource* source, Output* out) {
+    sp<TiffWriter> writer = new TiffWriter();
+    status_t err = writer->addIfd(kRawIfd);
+    if (err != OK) {
+        return err;
+    }
+
+    uint32_t newSubfileType = 0;
+    uint16_t bitsPerSample = 16;
+    uint16_t samplesPerPixel = 1;
+    uint16_t compression = (mode == MODE_COMPRESSED_TILES) ?
+            TAG_COMPRESSION_JPEG : TAG_COMPRESSION_NONE;
+    uint16_t photometric = 32803; // CFA
+    uint16_t cfaRepeatDim[] = { 2, 2 };
+    uint8_t cfaPattern[] = { 0, 1, 1, 2 }; // RGGB
+
+    if ((err = writer->addEntry(TAG_NEWSUBFILETYPE, 1, &newSubfileType, kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_IMAGEWIDTH, 1, &width, kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_IMAGELENGTH, 1, &height, kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_BITSPERSAMPLE, 1, &bitsPerSample, kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_SAMPLESPERPIXEL, 1, &samplesPerPixel, kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_COMPRESSION, 1, &compression, kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_PHOTOMETRICINTERPRETATION, 1, &photometric,
+                    kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_CFAREPEATPATTERNDIM, 2, cfaRepeatDim, kRawIfd)) != OK ||
+            (err = writer->addEntry(TAG_CFAPATTERN, 4, cfaPattern, kRawIfd)) != OK) {
+        return err;
+    }
+
+    if (mode == MODE_STRIP_SOURCE || mode == MODE_PARALLEL_STRIPS) {
+        err = writer->addStrip(kRawIfd);
+    } else {
+        err = writer->addTiles(kRawIfd, tileSize, tileSize);
+    }
+    if (err != OK) {
+        return err;
+    }
+
+    if (mode == MODE_STRIP_SOURCE) {
+        StripSource* sources[] = { source };
+        return writer->write(out, sources, 1);
+    }
+    TileSource* sources[] = { source };
+    return writer->write(out, sources, 1, LITTLE, threads);
+}
+
+static void usage(const char* me) {
+    fprintf(stderr, "usage: %s [-w width] [-h height] [-t tile size] [-j threads]"
+            " [-n iterations] [-o output dir]\n", me);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    uint32_t width = 5472;
+    uint32_t height = 3648;
+    uint32_t tileSize = 256;
+    uint32_t threads = 0;
+    int iterations = 3;
+    const char* outputDir = "/data/local/tmp";
+
+    int res;
+    while ((res = getopt(argc, argv, "w:h:t:j:n:o:")) >= 0) {
+        switch (res) {
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'h':
+                height = atoi(optarg);
+                break;
+            case 't':
+                tileSize = atoi(optarg);
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'o':
+                outputDir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (width == 0 || height == 0 || tileSize == 0 || iterations <= 0) {
+        usage(argv[0]);
+    }
+
+    SyntheticRawSource source(width, height);
+    const double imageMb = source.getImageSize() / (1024.0 * 1024.0);
+
+    printf("%ux%u 16-bit CFA (%.1f MB), %d iterations\n", width, height, imageMb, iterations);
+    printf("%-24s %-7s %10s %10s %12s\n", "mode", "output", "ms", "MB/s", "bytes");
+
+    int failures = 0;
+    for (size_t m = 0; m < sizeof(kModes) / sizeof(kModes[0]); ++m) {
+        for (int toFile = 1; toFile >= 0; --toFile) {
+            String8 path = String8::format("%s/tiffwriter_bench_%zu.dng", outputDir, m);
+            size_t bytes = 0;
+            status_t err = OK;
+
+            double start = nowSeconds();
+            for (int i = 0; i < iterations && err == OK; ++i) {
+                FileOutput fileOut(path);
+                ByteArrayOutput memoryOut;
+                Output* out = toFile ? static_cast<Output*>(&fileOut) : &memoryOut;
+                if ((err = out->open()) != OK) {
+                    break;
+                }
+                err = writeImage(kModes[m].mMode, width, height, tileSize, threads, &source,
+                        out);
+                bytes = memoryOut.getSize();
+                status_t closeErr = out->close();
+                err = (err != OK) ? err : closeErr;
+            }
+            double ms = (nowSeconds() - start) * 1000 / iterations;
+
+            if (err != OK) {
+                printf("%-24s %-7s failed (%d)\n", kModes[m].mName, toFile ? "file" : "memory",
+                        err);
+                ++failures;
+                continue;
+            }
+            if (toFile) {
+                struct stat st;
+                if (stat(path.string(), &st) == 0) {
+                    bytes = st.st_size;
+                }
+            }
+            printf("%-24s %-7s %10.1f %10.1f %12zu\n", kModes[m].mName,
+                    toFile ? "file" : "memory", ms, imageMb * 1000 / ms, bytes);
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -62,6 +62,7 @@ enum {
     UPDATE_GRAPHIC_BUFFER_IN_META,
     CONFIGURE_VIDEO_TUNNEL_MODE,
     UPDATE_NATIVE_HANDLE_IN_META,
+    GET_BUFFER_COPY_STATS,
 };
 
 class BpOMX : public BpInterface<IOMX> {
@@ -537,6 +538,19 @@ public:
         return err;
     }
 
+    virtual status_t getBufferCopyStats(
+            node_id node, OMX_U32 port_index, uint64_t *bytesCopied) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IOMX::getInterfaceDescriptor());
+        data.writeInt32((int32_t)node);
+        data.writeInt32(port_index);
+        remote()->transact(GET_BUFFER_COPY_STATS, data, &reply);
+
+        status_t err = reply.readInt32();
+        *bytesCopied = reply.readUint64();
+        return err;
+    }
+
     virtual status_t freeBuffer(
             node_id node, OMX_U32 port_index, buffer_id buffer) {
         Parcel data, reply;
@@ -870,6 +884,21 @@ status_t BnOMX::onTransact(
             return NO_ERROR;
         }
 
+        case GET_BUFFER_COPY_STATS:
+        {
+            CHECK_OMX_INTERFACE(IOMX, data, reply);
+
+            node_id node = (node_id)data.readInt32();
+            OMX_U32 port_index = data.readInt32();
+
+            uint64_t bytesCopied = 0;
+            status_t err = getBufferCopyStats(node, port_index, &bytesCopied);
+            reply->writeInt32(err);
+            reply->writeUint64(bytesCopied);
+
+            return NO_ERROR;
+        }
+
         case USE_BUFFER:
         {
             CHECK_OMX_INTERFACE(IOMX, data, reply);
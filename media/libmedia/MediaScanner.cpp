@@ -101,6 +101,8 @@ MediaScanResult MediaScanner::processDirectory(
 
     MediaScanResult result = doProcessDirectory(pathBuffer, pathRemaining, client, false);
 
+    onDirectoryFiles(Vector<String8>());
+
     free(pathBuffer);
 
     return result;
@@ -157,23 +159,43 @@ MediaScanResult MediaScanner::doProcessDirectory(
         return MEDIA_SCAN_RESULT_SKIPPED;
     }
 
-    MediaScanResult result = MEDIA_SCAN_RESULT_OK;
+    // Read the whole directory first, so that the files in it are known
+    // before the client is asked about the first one.
+    Vector<String8> names;
+    Vector<unsigned char> types;
+    Vector<String8> files;
     while ((entry = readdir(dir))) {
-        if (doProcessDirectoryEntry(path, pathRemaining, client, noMedia, entry, fileSpot)
-                == MEDIA_SCAN_RESULT_ERROR) {
+        names.push(String8(entry->d_name));
+        types.push(entry->d_type);
+        if (entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) {
+            String8 file(path);
+            file.append(entry->d_name);
+            files.push(file);
+        }
+    }
+    closedir(dir);
+
+    onDirectoryFiles(files);
+
+    MediaScanResult result = MEDIA_SCAN_RESULT_OK;
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (doProcessDirectoryEntry(path, pathRemaining, client, noMedia,
+                    names[i].string(), types[i], fileSpot) == MEDIA_SCAN_RESULT_ERROR) {
             result = MEDIA_SCAN_RESULT_ERROR;
             break;
         }
+        if (types[i] != DT_REG) {
+            // a subdirectory may have replaced them
+            onDirectoryFiles(files);
+        }
     }
-    closedir(dir);
     return result;
 }
 
 MediaScanResult MediaScanner::doProcessDirectoryEntry(
         char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
-        struct dirent* entry, char* fileSpot) {
+        const char *name, unsigned char type, char* fileSpot) {
     struct stat statbuf;
-    const char* name = entry->d_name;
 
     // ignore "." and ".."
     if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
@@ -187,7 +209,6 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
     }
     strcpy(fileSpot, name);
 
-    int type = entry->d_type;
     if (type == DT_UNKNOWN) {
         // If the type is unknown, stat() the file instead.
         // This is sometimes necessary when accessing NFS mounted filesystems, but
@@ -237,6 +258,9 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
     return MEDIA_SCAN_RESULT_OK;
 }
 
+void MediaScanner::onDirectoryFiles(const Vector<String8> & /* paths */) {
+}
+
 MediaAlbumArt *MediaAlbumArt::clone() {
     size_t byte_size = this->size() + sizeof(MediaAlbumArt);
     MediaAlbumArt *result = reinterpret_cast<MediaAlbumArt *>(malloc(byte_size));
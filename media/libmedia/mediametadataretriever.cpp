@@ -152,6 +152,19 @@ sp<IMemory> MediaMetadataRetriever::getFrameAtTime(int64_t timeUs, int option)
     return mRetriever->getFrameAtTime(timeUs, option);
 }
 
+sp<IMemory> MediaMetadataRetriever::getThumbnailAtTime(
+        int64_t timeUs, int32_t maxWidth, int32_t maxHeight)
+{
+    ALOGV("getThumbnailAtTime: time(%" PRId64 " us) max size(%dx%d)",
+            timeUs, maxWidth, maxHeight);
+    Mutex::Autolock _l(mLock);
+    if (mRetriever == 0) {
+        ALOGE("retriever is not initialized");
+        return NULL;
+    }
+    return mRetriever->getThumbnailAtTime(timeUs, maxWidth, maxHeight);
+}
+
 const char* MediaMetadataRetriever::extractMetadata(int keyCode)
 {
     ALOGV("extractMetadata(%d)", keyCode);
@@ -208,6 +208,35 @@ sp<IMemory> MetadataRetrieverClient::getFrameAtTime(int64_t timeUs, int option)
         ALOGE("failed to capture a video frame");
         return NULL;
     }
+    return storeThumbnail_l(frame);
+}
+
+sp<IMemory> MetadataRetrieverClient::getThumbnailAtTime(
+        int64_t timeUs, int32_t maxWidth, int32_t maxHeight)
+{
+    ALOGV("getThumbnailAtTime: time(%lld us) max size(%dx%d)",
+            (long long)timeUs, maxWidth, maxHeight);
+    Mutex::Autolock lock(mLock);
+    Mutex::Autolock glock(sLock);
+    mThumbnail.clear();
+    if (mRetriever == NULL) {
+        ALOGE("retriever is not initialized");
+        return NULL;
+    }
+    if (maxWidth <= 0 || maxHeight <= 0) {
+        ALOGE("invalid thumbnail size %dx%d", maxWidth, maxHeight);
+        return NULL;
+    }
+    VideoFrame *frame = mRetriever->getThumbnailAtTime(timeUs, maxWidth, maxHeight);
+    if (frame == NULL) {
+        ALOGE("failed to capture a thumbnail");
+        return NULL;
+    }
+    return storeThumbnail_l(frame);
+}
+
+sp<IMemory> MetadataRetrieverClient::storeThumbnail_l(VideoFrame *frame)
+{
     size_t size = sizeof(VideoFrame) + frame->mSize;
     sp<MemoryHeapBase> heap = new MemoryHeapBase(size, 0, "MetadataRetrieverClient");
     if (heap == NULL) {
@@ -51,6 +51,8 @@ public:
     virtual status_t                setDataSource(int fd, int64_t offset, int64_t length);
     virtual status_t                setDataSource(const sp<IDataSource>& source);
     virtual sp<IMemory>             getFrameAtTime(int64_t timeUs, int option);
+    virtual sp<IMemory>             getThumbnailAtTime(
+            int64_t timeUs, int32_t maxWidth, int32_t maxHeight);
     virtual sp<IMemory>             extractAlbumArt();
     virtual const char*             extractMetadata(int keyCode);
 
@@ -62,6 +64,9 @@ private:
     explicit MetadataRetrieverClient(pid_t pid);
     virtual ~MetadataRetrieverClient();
 
+    // Copies |frame| into shared memory held in mThumbnail and deletes it.
+    sp<IMemory> storeThumbnail_l(VideoFrame *frame);
+
     mutable Mutex                          mLock;
     static  Mutex                          sLock;
     sp<MediaMetadataRetrieverBase>         mRetriever;
@@ -56,6 +56,7 @@ LOCAL_SRC_FILES:=                         \
         SurfaceMediaSource.cpp            \
         SurfaceUtils.cpp                  \
         ThrottledSource.cpp               \
+        ThumbnailDecoderPool.cpp          \
         Utils.cpp                         \
         VBRISeeker.cpp                    \
         VideoFrameScheduler.cpp           \
@@ -462,7 +462,8 @@ sp<MetaData> MPEG4Extractor::getTrackMetaData(
     }
 
     if ((flags & kIncludeExtensiveMetaData)
-            && !track->includes_expensive_metadata) {
+            && !track->includes_expensive_metadata
+            && loadDeferredTables(track) == OK) {
         track->includes_expensive_metadata = true;
 
         const char *mime;
@@ -981,6 +982,7 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
                 track->meta = new MetaData;
                 track->includes_expensive_metadata = false;
                 track->skipTrack = false;
+                track->deferredTablesStatus = OK;
                 track->timescale = 0;
                 track->meta->setCString(kKeyMIMEType, "application/octet-stream");
             }
@@ -1688,6 +1690,8 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
 
             *offset += chunk_size;
 
+            // Not deferred like ctts and stss: it's usually a handful of
+            // entries, and verifyTrack() needs it for the track to be valid.
             status_t err =
                 mLastTrack->sampleTable->setTimeToSampleParams(
                         data_offset, chunk_data_size);
@@ -1706,14 +1710,12 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
 
             *offset += chunk_size;
 
-            status_t err =
-                mLastTrack->sampleTable->setCompositionTimeToSampleParams(
-                        data_offset, chunk_data_size);
-
-            if (err != OK) {
-                return err;
-            }
-
+            // read when samples are first needed, which metadata extraction never does
+            DeferredTable table;
+            table.type = chunk_type;
+            table.offset = data_offset;
+            table.size = chunk_data_size;
+            mLastTrack->deferredTables.push(table);
             break;
         }
 
@@ -1724,14 +1726,12 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
 
             *offset += chunk_size;
 
-            status_t err =
-                mLastTrack->sampleTable->setSyncSampleParams(
-                        data_offset, chunk_data_size);
-
-            if (err != OK) {
-                return err;
-            }
-
+            // read when samples are first needed, which metadata extraction never does
+            DeferredTable table;
+            table.type = chunk_type;
+            table.offset = data_offset;
+            table.size = chunk_data_size;
+            mLastTrack->deferredTables.push(table);
             break;
         }
 
@@ -3120,6 +3120,9 @@ sp<IMediaSource> MPEG4Extractor::getTrack(size_t index) {
         return NULL;
     }
 
+    if (loadDeferredTables(track) != OK) {
+        return NULL;
+    }
 
     Trex *trex = NULL;
     int32_t trackId;
@@ -3176,6 +3179,32 @@ sp<IMediaSource> MPEG4Extractor::getTrack(size_t index) {
             mSidxEntries, trex, mMoofOffset);
 }
 
+status_t MPEG4Extractor::loadDeferredTables(Track *track) {
+    for (size_t i = 0; i < track->deferredTables.size()
+            && track->deferredTablesStatus == OK; ++i) {
+        const DeferredTable &table = track->deferredTables[i];
+        switch (table.type) {
+            case FOURCC('c', 't', 't', 's'):
+                track->deferredTablesStatus =
+                    track->sampleTable->setCompositionTimeToSampleParams(
+                            table.offset, table.size);
+                break;
+            case FOURCC('s', 't', 's', 's'):
+                track->deferredTablesStatus = track->sampleTable->setSyncSampleParams(
+                        table.offset, table.size);
+                break;
+            default:
+                TRESPASS();
+        }
+    }
+    track->deferredTables.clear();
+
+    if (track->deferredTablesStatus != OK) {
+        ALOGE("malformed sample table: %d", track->deferredTablesStatus);
+    }
+    return track->deferredTablesStatus;
+}
+
 // static
 status_t MPEG4Extractor::verifyTrack(Track *track) {
     const char *mime;
@@ -30,16 +30,20 @@
 
 namespace android {
 
+// Pages are allocated at the size of the read that fills them. Released pages
+// are kept for reuse by reads of the same size, up to maxPooledBytes; older
+// ones are freed first.
 struct PageCache {
-    PageCache(size_t pageSize);
+    PageCache(size_t maxPooledBytes);
     ~PageCache();
 
     struct Page {
         void *mData;
         size_t mSize;
+        size_t mCapacity;
     };
 
-    Page *acquirePage();
+    Page *acquirePage(size_t capacity);
     void releasePage(Page *page);
 
     void appendPage(Page *page);
@@ -52,7 +56,8 @@ struct PageCache {
     void copy(size_t from, void *data, size_t size);
 
 private:
-    size_t mPageSize;
+    size_t mMaxPooledBytes;
+    size_t mPooledBytes;
     size_t mTotalSize;
 
     List<Page *> mActivePages;
@@ -63,8 +68,9 @@ private:
     DISALLOW_EVIL_CONSTRUCTORS(PageCache);
 };
 
-PageCache::PageCache(size_t pageSize)
-    : mPageSize(pageSize),
+PageCache::PageCache(size_t maxPooledBytes)
+    : mMaxPooledBytes(maxPooledBytes),
+      mPooledBytes(0),
       mTotalSize(0) {
 }
 
@@ -86,24 +92,47 @@ void PageCache::freePages(List<Page *> *list) {
     }
 }
 
-PageCache::Page *PageCache::acquirePage() {
-    if (!mFreePages.empty()) {
-        List<Page *>::iterator it = mFreePages.begin();
+PageCache::Page *PageCache::acquirePage(size_t capacity) {
+    for (List<Page *>::iterator it = mFreePages.begin();
+            it != mFreePages.end(); ++it) {
         Page *page = *it;
-        mFreePages.erase(it);
+        if (page->mCapacity == capacity) {
+            mFreePages.erase(it);
+            mPooledBytes -= capacity;
 
-        return page;
+            return page;
+        }
     }
 
     Page *page = new Page;
-    page->mData = malloc(mPageSize);
+    page->mData = malloc(capacity);
     page->mSize = 0;
+    page->mCapacity = capacity;
 
     return page;
 }
 
 void PageCache::releasePage(Page *page) {
     page->mSize = 0;
+
+    while (!mFreePages.empty()
+            && mPooledBytes + page->mCapacity > mMaxPooledBytes) {
+        List<Page *>::iterator it = mFreePages.begin();
+        Page *oldest = *it;
+        mFreePages.erase(it);
+        mPooledBytes -= oldest->mCapacity;
+
+        free(oldest->mData);
+        delete oldest;
+    }
+
+    if (page->mCapacity > mMaxPooledBytes) {
+        free(page->mData);
+        delete page;
+        return;
+    }
+
+    mPooledBytes += page->mCapacity;
     mFreePages.push_back(page);
 }
 
@@ -186,7 +215,7 @@ NuCachedSource2::NuCachedSource2(
     : mSource(source),
       mReflector(new AHandlerReflector<NuCachedSource2>(this)),
       mLooper(new ALooper),
-      mCache(new PageCache(kPageSize)),
+      mCache(NULL),
       mCacheOffset(0),
       mFinalStatus(OK),
       mLastAccessPos(0),
@@ -197,7 +226,15 @@ NuCachedSource2::NuCachedSource2(
       mHighwaterThresholdBytes(kDefaultHighWaterThreshold),
       mLowwaterThresholdBytes(kDefaultLowWaterThreshold),
       mKeepAliveIntervalUs(kDefaultKeepAliveIntervalUs),
-      mDisconnectAtHighwatermark(disconnectAtHighwatermark) {
+      mDisconnectAtHighwatermark(disconnectAtHighwatermark),
+      mReadSize(kPageSize),
+      mRandomAccess(false),
+      mNumShortRuns(0),
+      mBytesReadSinceSeek(0),
+      mLastReadEnd(0),
+      mDeferredReadEnd(0) {
+    memset(&mStats, 0, sizeof(mStats));
+
     // We are NOT going to support disconnect-at-highwatermark indefinitely
     // and we are not guaranteeing support for client-specified cache
     // parameters. Both of these are temporary measures to solve a specific
@@ -214,6 +251,10 @@ NuCachedSource2::NuCachedSource2(
         mKeepAliveIntervalUs = 0;
     }
 
+    // Once the cache is full, the prefetcher restarts after about this much
+    // has been read, and reads it again.
+    mCache = new PageCache(mHighwaterThresholdBytes - mLowwaterThresholdBytes);
+
     mLooper->setName("NuCachedSource2");
     mLooper->registerHandler(mReflector);
 
@@ -232,6 +273,11 @@ NuCachedSource2::~NuCachedSource2() {
     mLooper->stop();
     mLooper->unregisterHandler(mReflector->id());
 
+    ALOGI("fetched %" PRIu64 " bytes, consumed %" PRIu64 ", discarded %" PRIu64
+          " unread, %u seeks",
+          mStats.mBytesFetched, mStats.mBytesConsumed, mStats.mBytesDiscarded,
+          mStats.mNumSeeks);
+
     delete mCache;
     mCache = NULL;
 }
@@ -357,10 +403,22 @@ void NuCachedSource2::fetchInternal() {
         }
     }
 
-    PageCache::Page *page = mCache->acquirePage();
+    size_t readSize;
+    PageCache::Page *page;
+    off64_t offset;
+    {
+        Mutex::Autolock autoLock(mLock);
+        // Keep-alives only need to keep the connection busy.
+        readSize = mFetching ? mReadSize : (size_t)kPageSize;
+
+        // Readers release pages into the same pool, under mLock.
+        page = mCache->acquirePage(readSize);
+        offset = mCacheOffset + mCache->totalSize();
+    }
 
-    ssize_t n = mSource->readAt(
-            mCacheOffset + mCache->totalSize(), page->mData, kPageSize);
+    int64_t startUs = ALooper::GetNowUs();
+    ssize_t n = mSource->readAt(offset, page->mData, readSize);
+    int64_t readDurationUs = ALooper::GetNowUs() - startUs;
 
     Mutex::Autolock autoLock(mLock);
 
@@ -390,9 +448,51 @@ void NuCachedSource2::fetchInternal() {
 
         page->mSize = n;
         mCache->appendPage(page);
+
+        mStats.mBytesFetched += n;
+        if ((size_t)n == readSize) {
+            updateReadSize_l(n, readDurationUs);
+        }
+    }
+}
+
+void NuCachedSource2::updateReadSize_l(size_t numBytes, int64_t durationUs) {
+    if (mRandomAccess) {
+        mReadSize = kPageSize;
+        return;
+    }
+
+    // Reads are at most a quarter of what the cache holds.
+    size_t maxReadSize = mHighwaterThresholdBytes / 4;
+
+    size_t readSize = ComputeReadSize(mReadSize, maxReadSize, numBytes, durationUs);
+    if (readSize != mReadSize) {
+        ALOGV("read size %zu -> %zu", mReadSize, readSize);
+        mReadSize = readSize;
     }
 }
 
+// static
+size_t NuCachedSource2::ComputeReadSize(
+        size_t readSize, size_t maxReadSize, size_t numBytes, int64_t durationUs) {
+    if (maxReadSize > kMaxReadSize) {
+        maxReadSize = kMaxReadSize;
+    }
+
+    int64_t targetBytes = (int64_t)numBytes * kTargetReadDurationUs
+        / (durationUs > 0 ? durationUs : 1);
+
+    // At most double the previous read, so that a single fast read doesn't
+    // commit the looper to a long one.
+    size_t nextReadSize = kPageSize;
+    while (nextReadSize * 2 <= (uint64_t)targetBytes
+            && nextReadSize * 2 <= maxReadSize
+            && nextReadSize < readSize * 2) {
+        nextReadSize *= 2;
+    }
+    return nextReadSize;
+}
+
 void NuCachedSource2::onFetch() {
     ALOGV("onFetch");
 
@@ -426,6 +526,15 @@ void NuCachedSource2::onFetch() {
                 static_cast<HTTPBase *>(mSource.get())->disconnect();
                 mFinalStatus = -EAGAIN;
             }
+        } else if (mFetching) {
+            Mutex::Autolock autoLock(mLock);
+            off64_t cachedEnd = mCacheOffset + mCache->totalSize();
+            if (mRandomAccess
+                    && cachedEnd >= mLastAccessPos + kRandomAccessReadahead
+                    && cachedEnd >= mDeferredReadEnd) {
+                ALOGV("random access, done prefetching for now");
+                mFetching = false;
+            }
         }
     } else {
         Mutex::Autolock autoLock(mLock);
@@ -488,9 +597,14 @@ void NuCachedSource2::restartPrefetcherIfNecessary_l(
         return;
     }
 
+    size_t lowwaterThresholdBytes = mLowwaterThresholdBytes;
+    if (mRandomAccess) {
+        lowwaterThresholdBytes = kRandomAccessReadahead / 2;
+    }
+
     if (!ignoreLowWaterThreshold && !force
             && mCacheOffset + mCache->totalSize() - mLastAccessPos
-                >= mLowwaterThresholdBytes) {
+                >= lowwaterThresholdBytes) {
         return;
     }
 
@@ -505,6 +619,7 @@ void NuCachedSource2::restartPrefetcherIfNecessary_l(
     }
 
     size_t actualBytes = mCache->releaseFromStart(maxBytes);
+    mStats.mBytesDiscarded += unreadBytes_l(actualBytes);
     mCacheOffset += actualBytes;
 
     ALOGI("restarting prefetcher, totalSize = %zu", mCache->totalSize());
@@ -529,6 +644,7 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
         mCache->copy(delta, data, size);
 
         mLastAccessPos = offset + size;
+        onDataRead_l(offset, size);
 
         return size;
     }
@@ -557,11 +673,41 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
 
     if (result > 0) {
         mLastAccessPos = offset + result;
+        onDataRead_l(offset, result);
     }
 
     return (ssize_t)result;
 }
 
+void NuCachedSource2::onDataRead_l(off64_t offset, size_t size) {
+    mStats.mBytesConsumed += size;
+    mLastReadEnd = offset + size;
+
+    if (mBytesReadSinceSeek < kSequentialRunBytes) {
+        mBytesReadSinceSeek += size;
+        if (mBytesReadSinceSeek >= kSequentialRunBytes) {
+            mNumShortRuns = 0;
+            if (mRandomAccess) {
+                ALOGI("sequential access");
+                mRandomAccess = false;
+            }
+        }
+    }
+}
+
+size_t NuCachedSource2::unreadBytes_l(size_t numBytes) const {
+    off64_t end = mCacheOffset + numBytes;
+    off64_t readEnd = mLastReadEnd > mCacheOffset ? mLastReadEnd : mCacheOffset;
+    return end > readEnd ? end - readEnd : 0;
+}
+
+void NuCachedSource2::getStats(Stats *stats) const {
+    Mutex::Autolock autoLock(mLock);
+    *stats = mStats;
+    stats->mReadSize = mReadSize;
+    stats->mRandomAccess = mRandomAccess;
+}
+
 size_t NuCachedSource2::cachedSize() {
     Mutex::Autolock autoLock(mLock);
     return mCacheOffset + mCache->totalSize();
@@ -608,15 +754,17 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
                 true); // force
     }
 
+    mDeferredReadEnd = 0;
+
     if (offset < mCacheOffset
             || offset >= (off64_t)(mCacheOffset + mCache->totalSize())) {
-        static const off64_t kPadding = 256 * 1024;
-
         // In the presence of multiple decoded streams, once of them will
         // trigger this seek request, the other one will request data "nearby"
         // soon, adjust the seek position so that that subsequent request
-        // does not trigger another seek.
-        off64_t seekOffset = (offset > kPadding) ? offset - kPadding : 0;
+        // does not trigger another seek. Random access rarely comes back.
+        off64_t padding = mRandomAccess ? kPageSize : 256 * 1024;
+
+        off64_t seekOffset = (offset > padding) ? offset - padding : 0;
 
         seekInternal_l(seekOffset);
     }
@@ -646,6 +794,7 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
     }
 
     ALOGV("deferring read");
+    mDeferredReadEnd = offset + size;
 
     return -EAGAIN;
 }
@@ -660,6 +809,21 @@ status_t NuCachedSource2::seekInternal_l(off64_t offset) {
 
     ALOGI("new range: offset= %lld", (long long)offset);
 
+    mStats.mBytesDiscarded += unreadBytes_l(mCache->totalSize());
+    ++mStats.mNumSeeks;
+
+    if (mBytesReadSinceSeek < kSequentialRunBytes) {
+        ++mNumShortRuns;
+    }
+    mBytesReadSinceSeek = 0;
+    if (!mRandomAccess && mNumShortRuns >= kMinShortRunsForRandomAccess) {
+        ALOGI("random access");
+        mRandomAccess = true;
+    }
+
+    // Start small, to get the data asked for soon.
+    mReadSize = kPageSize;
+
     mCacheOffset = offset;
 
     size_t totalSize = mCache->totalSize();
@@ -137,6 +137,9 @@ struct MuxOMX : public IOMX {
             node_id node, OMX_U32 port_index, const sp<IMemory> &params,
             buffer_id *buffer, OMX_U32 allottedSize);
 
+    virtual status_t getBufferCopyStats(
+            node_id node, OMX_U32 port_index, uint64_t *bytesCopied);
+
     virtual status_t freeBuffer(
             node_id node, OMX_U32 port_index, buffer_id buffer);
 
@@ -458,6 +461,11 @@ status_t MuxOMX::allocateBufferWithBackup(
             node, port_index, params, buffer, allottedSize);
 }
 
+status_t MuxOMX::getBufferCopyStats(
+        node_id node, OMX_U32 port_index, uint64_t *bytesCopied) {
+    return getOMX(node)->getBufferCopyStats(node, port_index, bytesCopied);
+}
+
 status_t MuxOMX::freeBuffer(
         node_id node, OMX_U32 port_index, buffer_id buffer) {
     return getOMX(node)->freeBuffer(node, port_index, buffer);
@@ -20,19 +20,163 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include <media/stagefright/StagefrightMediaScanner.h>
 
 #include <media/IMediaHTTPService.h>
 #include <media/mediametadataretriever.h>
 #include <private/media/VideoFrame.h>
+#include <utils/Condition.h>
 
 namespace android {
 
-StagefrightMediaScanner::StagefrightMediaScanner() {}
+// default and maximum number of processFiles() worker threads
+static const size_t kDefaultMaxBatchThreads = 4;
+static const size_t kMaxBatchThreads = 16;
 
-StagefrightMediaScanner::~StagefrightMediaScanner() {}
+// how far workers may get ahead of the files reported to the client
+static const size_t kMaxPendingFiles = 32;
+
+static const uint32_t kIndexMagic = 'SFMI';
+static const uint32_t kIndexVersion = 1;
+
+// What scanning one file reported, so that it can be replayed to a client later.
+struct StagefrightMediaScanner::ScannedFile {
+    int64_t mLastModified;
+    int64_t mSize;
+    MediaScanResult mResult;
+    bool mHasMimeType;
+    String8 mMimeType;
+    Vector<String8> mTags;  // name, value pairs
+
+    ScannedFile()
+        : mLastModified(-1),
+          mSize(-1),
+          mResult(MEDIA_SCAN_RESULT_SKIPPED),
+          mHasMimeType(false) {
+    }
+
+    // Reports the file to |client| as processFile() would have.
+    MediaScanResult replay(MediaScannerClient &client, const char *locale) const {
+        client.setLocale(locale);
+        client.beginFile();
+        MediaScanResult result = mResult;
+        if (mHasMimeType && client.setMimeType(mMimeType.string()) != OK) {
+            result = MEDIA_SCAN_RESULT_ERROR;
+        }
+        for (size_t i = 0; i + 1 < mTags.size() && result != MEDIA_SCAN_RESULT_ERROR; i += 2) {
+            if (client.addStringTag(mTags[i].string(), mTags[i + 1].string()) != OK) {
+                result = MEDIA_SCAN_RESULT_ERROR;
+            }
+        }
+        client.endFile();
+        return result;
+    }
+};
+
+// Records what processFileInternal() reports instead of passing it on, so that
+// files can be scanned on worker threads.
+struct StagefrightMediaScanner::RecordingClient : public MediaScannerClient {
+    explicit RecordingClient(ScannedFile *file)
+        : mFile(file) {
+    }
+
+    virtual status_t scanFile(const char * /* path */, long long /* lastModified */,
+            long long /* fileSize */, bool /* isDirectory */, bool /* noMedia */) {
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char *name, const char *value) {
+        mFile->mTags.push(String8(name));
+        mFile->mTags.push(String8(value));
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char *mimeType) {
+        mFile->mHasMimeType = true;
+        mFile->mMimeType = mimeType;
+        return OK;
+    }
+
+private:
+    ScannedFile *mFile;
+};
+
+struct StagefrightMediaScanner::BatchScan {
+    StagefrightMediaScanner *mScanner;
+    const Vector<String8> *mPaths;
+    Vector<ScannedFile *> mFiles;
+    Vector<bool> mDone;
+
+    Mutex mLock;
+    Condition mCondition;
+    size_t mNextToScan;
+    size_t mNextToReport;
+    bool mAborted;
+};
+
+// The regular files of the directory processDirectory() is in. Workers scan
+// the ones past the last file passed to processFile(), while the client asks
+// about one file after the other. A client that skips files, as on a rescan
+// where most of them are unchanged, gets no scanning ahead until it asks about
+// consecutive files again; the window then doubles with each one, up to
+// kMaxPendingFiles, so that no more is scanned in vain than was asked for.
+struct StagefrightMediaScanner::ScanAhead {
+    explicit ScanAhead(StagefrightMediaScanner *scanner)
+        : mScanner(scanner),
+          mLastAsked(-1),
+          mWindow(0),
+          mNextToScan(0),
+          mScanLimit(0),
+          mStopping(false) {
+    }
+
+    StagefrightMediaScanner *mScanner;
+
+    Mutex mLock;
+    Condition mCondition;
+    Vector<String8> mPaths;
+    KeyedVector<String8, size_t> mPositions;
+    // files scanned ahead by path, NULL while a worker is scanning one
+    KeyedVector<String8, ScannedFile *> mScanned;
+    // position of the file last passed to processFile(), -1 if none
+    ssize_t mLastAsked;
+    size_t mWindow;
+    size_t mNextToScan;
+    size_t mScanLimit;
+    Vector<pthread_t> mThreads;
+    bool mStopping;
+};
+
+StagefrightMediaScanner::StagefrightMediaScanner()
+    : mScanAhead(new ScanAhead(this)) {
+}
+
+StagefrightMediaScanner::~StagefrightMediaScanner() {
+    stopScanAhead();
+    delete mScanAhead;
+    mScanAhead = NULL;
+
+    clearIndex();
+}
+
+static size_t NumBatchThreads(size_t maxThreads) {
+    size_t numThreads = maxThreads > 0 ? maxThreads : kDefaultMaxBatchThreads;
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxThreads == 0 && numCpus > 0 && numThreads > (size_t)numCpus) {
+        numThreads = numCpus;
+    }
+    if (numThreads > kMaxBatchThreads) {
+        numThreads = kMaxBatchThreads;
+    }
+    return numThreads;
+}
 
 static bool FileHasAcceptableExtension(const char *extension) {
     static const char *kValidExtensions[] = {
@@ -59,6 +203,15 @@ MediaScanResult StagefrightMediaScanner::processFile(
         MediaScannerClient &client) {
     ALOGV("processFile '%s'.", path);
 
+    scanAheadOf(path);
+
+    ScannedFile *file = takeScannedAhead(path);
+    if (file != NULL) {
+        MediaScanResult result = file->replay(client, locale());
+        delete file;
+        return result;
+    }
+
     client.setLocale(locale());
     client.beginFile();
     MediaScanResult result = processFileInternal(path, mimeType, client);
@@ -141,6 +294,473 @@ MediaScanResult StagefrightMediaScanner::processFileInternal(
     return MEDIA_SCAN_RESULT_OK;
 }
 
+MediaScanResult StagefrightMediaScanner::processFiles(
+        const Vector<String8> &paths, MediaScannerClient &client,
+        size_t maxThreads, Vector<MediaScanResult> *results) {
+    ALOGV("processFiles: %zu files", paths.size());
+
+    if (results != NULL) {
+        results->clear();
+    }
+
+    size_t numThreads = NumBatchThreads(maxThreads);
+    if (numThreads > paths.size()) {
+        numThreads = paths.size();
+    }
+
+    BatchScan batch;
+    batch.mScanner = this;
+    batch.mPaths = &paths;
+    batch.mNextToScan = 0;
+    batch.mNextToReport = 0;
+    batch.mAborted = false;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        batch.mFiles.push(new ScannedFile);
+        batch.mDone.push(false);
+    }
+
+    Vector<pthread_t> threads;
+    for (size_t i = 0; i < numThreads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, BatchThreadWrapper, &batch) == 0) {
+            threads.push(thread);
+        }
+    }
+
+    MediaScanResult result = MEDIA_SCAN_RESULT_OK;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (threads.isEmpty()) {
+            // no workers could be started, scan on this thread
+            scanFileForBatch(paths[i], batch.mFiles[i]);
+        } else {
+            Mutex::Autolock autoLock(batch.mLock);
+            while (!batch.mDone[i]) {
+                batch.mCondition.wait(batch.mLock);
+            }
+        }
+
+        ScannedFile *file = batch.mFiles[i];
+        batch.mFiles.editItemAt(i) = NULL;
+
+        MediaScanResult fileResult = file->replay(client, locale());
+        if (results != NULL) {
+            results->push(fileResult);
+        }
+        bool clientFailed = fileResult == MEDIA_SCAN_RESULT_ERROR
+                && file->mResult != MEDIA_SCAN_RESULT_ERROR;
+
+        if (file->mResult != MEDIA_SCAN_RESULT_ERROR && file->mLastModified >= 0) {
+            Mutex::Autolock autoLock(mIndexLock);
+            if (mIndexPath.isEmpty()) {
+                delete file;
+            } else {
+                ssize_t index = mIndex.indexOfKey(paths[i]);
+                if (index >= 0) {
+                    delete mIndex.valueAt(index);
+                    mIndex.replaceValueAt(index, file);
+                } else {
+                    mIndex.add(paths[i], file);
+                }
+            }
+        } else {
+            delete file;
+        }
+
+        if (clientFailed) {
+            result = MEDIA_SCAN_RESULT_ERROR;
+            break;
+        }
+
+        Mutex::Autolock autoLock(batch.mLock);
+        batch.mNextToReport = i + 1;
+        batch.mCondition.broadcast();
+    }
+
+    {
+        Mutex::Autolock autoLock(batch.mLock);
+        batch.mAborted = true;
+        batch.mCondition.broadcast();
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // files scanned ahead of a client error
+    for (size_t i = 0; i < batch.mFiles.size(); ++i) {
+        delete batch.mFiles[i];
+    }
+
+    return result;
+}
+
+// static
+void *StagefrightMediaScanner::BatchThreadWrapper(void *me) {
+    BatchScan *batch = static_cast<BatchScan *>(me);
+
+    Mutex::Autolock autoLock(batch->mLock);
+    for (;;) {
+        while (!batch->mAborted && batch->mNextToScan < batch->mPaths->size()
+                && batch->mNextToScan >= batch->mNextToReport + kMaxPendingFiles) {
+            batch->mCondition.wait(batch->mLock);
+        }
+        if (batch->mAborted || batch->mNextToScan >= batch->mPaths->size()) {
+            break;
+        }
+
+        size_t i = batch->mNextToScan++;
+        ScannedFile *file = batch->mFiles[i];
+
+        batch->mLock.unlock();
+        batch->mScanner->scanFileForBatch(batch->mPaths->itemAt(i), file);
+        batch->mLock.lock();
+
+        batch->mDone.editItemAt(i) = true;
+        batch->mCondition.broadcast();
+    }
+
+    return NULL;
+}
+
+void StagefrightMediaScanner::scanFileForBatch(const String8 &path, ScannedFile *file) {
+    struct stat statbuf;
+    if (stat(path.string(), &statbuf) == 0) {
+        file->mLastModified = statbuf.st_mtime;
+        file->mSize = statbuf.st_size;
+    }
+
+    if (file->mLastModified >= 0) {
+        // loadIndex() may run while scanning ahead of processFile()
+        Mutex::Autolock autoLock(mIndexLock);
+        ssize_t index = mIndexPath.isEmpty() ? -1 : mIndex.indexOfKey(path);
+        if (index >= 0) {
+            const ScannedFile *previous = mIndex.valueAt(index);
+            if (previous->mLastModified == file->mLastModified
+                    && previous->mSize == file->mSize) {
+                ALOGV("'%s' is unchanged", path.string());
+                *file = *previous;
+                return;
+            }
+        }
+    }
+
+    RecordingClient recorder(file);
+    file->mResult = processFileInternal(path.string(), NULL /* mimeType */, recorder);
+}
+
+void StagefrightMediaScanner::onDirectoryFiles(const Vector<String8> &paths) {
+    if (paths.isEmpty()) {
+        stopScanAhead();
+    }
+
+    Mutex::Autolock autoLock(mScanAhead->mLock);
+
+    bool unchanged = paths.size() == mScanAhead->mPaths.size();
+    for (size_t i = 0; unchanged && i < paths.size(); ++i) {
+        unchanged = paths[i] == mScanAhead->mPaths[i];
+    }
+    if (unchanged) {
+        return;
+    }
+
+    mScanAhead->mPaths = paths;
+    mScanAhead->mPositions.clear();
+    for (size_t i = 0; i < paths.size(); ++i) {
+        mScanAhead->mPositions.add(paths[i], i);
+    }
+    mScanAhead->mLastAsked = -1;
+    mScanAhead->mWindow = 0;
+    mScanAhead->mNextToScan = 0;
+    mScanAhead->mScanLimit = 0;
+
+    // Files of the parent directory are kept for when the walk gets back to
+    // it, unless too many have piled up. Files still being scanned are
+    // dropped by their worker.
+    KeyedVector<String8, ScannedFile *> &scanned = mScanAhead->mScanned;
+    size_t numElsewhere = 0;
+    for (size_t i = 0; i < scanned.size(); ++i) {
+        if (mScanAhead->mPositions.indexOfKey(scanned.keyAt(i)) < 0) {
+            ++numElsewhere;
+        }
+    }
+    if (numElsewhere <= 2 * kMaxPendingFiles) {
+        return;
+    }
+    for (size_t i = scanned.size(); i-- > 0;) {
+        if (mScanAhead->mPositions.indexOfKey(scanned.keyAt(i)) < 0) {
+            delete scanned.valueAt(i);
+            scanned.removeItemsAt(i);
+        }
+    }
+}
+
+void StagefrightMediaScanner::scanAheadOf(const char *path) {
+    Mutex::Autolock autoLock(mScanAhead->mLock);
+
+    ssize_t index = mScanAhead->mPositions.indexOfKey(String8(path));
+    if (index < 0) {
+        return;
+    }
+    size_t position = mScanAhead->mPositions.valueAt(index);
+
+    // The client went past these without asking for them.
+    KeyedVector<String8, ScannedFile *> &scanned = mScanAhead->mScanned;
+    for (size_t i = scanned.size(); i-- > 0;) {
+        ssize_t scannedIndex = mScanAhead->mPositions.indexOfKey(scanned.keyAt(i));
+        if (scanned.valueAt(i) != NULL && scannedIndex >= 0
+                && mScanAhead->mPositions.valueAt(scannedIndex) < position) {
+            delete scanned.valueAt(i);
+            scanned.removeItemsAt(i);
+        }
+    }
+
+    if (mScanAhead->mLastAsked >= 0 && position == (size_t)mScanAhead->mLastAsked + 1) {
+        size_t window = mScanAhead->mWindow > 0 ? 2 * mScanAhead->mWindow : 1;
+        mScanAhead->mWindow = window < kMaxPendingFiles ? window : kMaxPendingFiles;
+    } else {
+        mScanAhead->mWindow = 0;
+    }
+    mScanAhead->mLastAsked = position;
+
+    if (mScanAhead->mNextToScan < position + 1) {
+        mScanAhead->mNextToScan = position + 1;
+    }
+    mScanAhead->mScanLimit = position + 1 + mScanAhead->mWindow;
+    if (mScanAhead->mNextToScan >= mScanAhead->mScanLimit
+            || mScanAhead->mNextToScan >= mScanAhead->mPaths.size()) {
+        return;
+    }
+
+    if (mScanAhead->mThreads.isEmpty()) {
+        size_t numThreads = NumBatchThreads(0);
+        for (size_t i = 0; i < numThreads; ++i) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, ScanAheadThreadWrapper, mScanAhead) == 0) {
+                mScanAhead->mThreads.push(thread);
+            }
+        }
+    }
+    mScanAhead->mCondition.broadcast();
+}
+
+StagefrightMediaScanner::ScannedFile *StagefrightMediaScanner::takeScannedAhead(
+        const char *path) {
+    Mutex::Autolock autoLock(mScanAhead->mLock);
+
+    String8 key(path);
+    for (;;) {
+        ssize_t index = mScanAhead->mScanned.indexOfKey(key);
+        if (index < 0) {
+            return NULL;
+        }
+        ScannedFile *file = mScanAhead->mScanned.valueAt(index);
+        if (file != NULL) {
+            mScanAhead->mScanned.removeItemsAt(index);
+            return file;
+        }
+        mScanAhead->mCondition.wait(mScanAhead->mLock);
+    }
+}
+
+void StagefrightMediaScanner::stopScanAhead() {
+    Vector<pthread_t> threads;
+    {
+        Mutex::Autolock autoLock(mScanAhead->mLock);
+        mScanAhead->mStopping = true;
+        mScanAhead->mCondition.broadcast();
+        threads = mScanAhead->mThreads;
+        mScanAhead->mThreads.clear();
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    Mutex::Autolock autoLock(mScanAhead->mLock);
+    mScanAhead->mStopping = false;
+    for (size_t i = 0; i < mScanAhead->mScanned.size(); ++i) {
+        delete mScanAhead->mScanned.valueAt(i);
+    }
+    mScanAhead->mScanned.clear();
+}
+
+// static
+void *StagefrightMediaScanner::ScanAheadThreadWrapper(void *me) {
+    ScanAhead *scanAhead = static_cast<ScanAhead *>(me);
+
+    Mutex::Autolock autoLock(scanAhead->mLock);
+    for (;;) {
+        while (!scanAhead->mStopping
+                && (scanAhead->mNextToScan >= scanAhead->mScanLimit
+                    || scanAhead->mNextToScan >= scanAhead->mPaths.size())) {
+            scanAhead->mCondition.wait(scanAhead->mLock);
+        }
+        if (scanAhead->mStopping) {
+            break;
+        }
+
+        String8 path = scanAhead->mPaths[scanAhead->mNextToScan++];
+        if (scanAhead->mScanned.indexOfKey(path) >= 0) {
+            continue;
+        }
+        scanAhead->mScanned.add(path, NULL);
+
+        ScannedFile *file = new ScannedFile;
+        scanAhead->mLock.unlock();
+        scanAhead->mScanner->scanFileForBatch(path, file);
+        scanAhead->mLock.lock();
+
+        ssize_t index = scanAhead->mScanned.indexOfKey(path);
+        if (index >= 0 && scanAhead->mScanned.valueAt(index) == NULL) {
+            scanAhead->mScanned.replaceValueAt(index, file);
+        } else {
+            delete file;
+        }
+        scanAhead->mCondition.broadcast();
+    }
+
+    return NULL;
+}
+
+static bool WriteUInt32(FILE *out, uint32_t x) {
+    return fwrite(&x, sizeof(x), 1, out) == 1;
+}
+
+static bool WriteInt64(FILE *out, int64_t x) {
+    return fwrite(&x, sizeof(x), 1, out) == 1;
+}
+
+static bool WriteString(FILE *out, const String8 &s) {
+    return WriteUInt32(out, s.length())
+        && (s.length() == 0 || fwrite(s.string(), s.length(), 1, out) == 1);
+}
+
+static bool ReadUInt32(FILE *in, uint32_t *x) {
+    return fread(x, sizeof(*x), 1, in) == 1;
+}
+
+static bool ReadInt64(FILE *in, int64_t *x) {
+    return fread(x, sizeof(*x), 1, in) == 1;
+}
+
+static bool ReadString(FILE *in, String8 *s) {
+    uint32_t length;
+    if (!ReadUInt32(in, &length) || length > PATH_MAX * 16) {
+        return false;
+    }
+    s->clear();
+    if (length == 0) {
+        return true;
+    }
+    char *buffer = s->lockBuffer(length);
+    if (buffer == NULL || fread(buffer, length, 1, in) != 1) {
+        s->unlockBuffer(0);
+        return false;
+    }
+    s->unlockBuffer(length);
+    return true;
+}
+
+status_t StagefrightMediaScanner::loadIndex(const char *indexPath) {
+    Mutex::Autolock autoLock(mIndexLock);
+
+    clearIndex();
+    mIndexPath = indexPath;
+
+    FILE *in = fopen(indexPath, "rb");
+    if (in == NULL) {
+        // first scan, everything will be read
+        return OK;
+    }
+
+    uint32_t magic, version, count;
+    bool ok = ReadUInt32(in, &magic) && magic == kIndexMagic
+        && ReadUInt32(in, &version) && version == kIndexVersion
+        && ReadUInt32(in, &count);
+
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        String8 path;
+        ScannedFile *file = new ScannedFile;
+        uint32_t result, hasMimeType, numTags;
+        ok = ReadString(in, &path)
+            && ReadInt64(in, &file->mLastModified)
+            && ReadInt64(in, &file->mSize)
+            && ReadUInt32(in, &result) && result <= MEDIA_SCAN_RESULT_ERROR
+            && ReadUInt32(in, &hasMimeType)
+            && ReadString(in, &file->mMimeType)
+            && ReadUInt32(in, &numTags);
+        for (uint32_t j = 0; ok && j < numTags; ++j) {
+            String8 tag;
+            ok = ReadString(in, &tag);
+            file->mTags.push(tag);
+        }
+
+        if (!ok) {
+            delete file;
+            break;
+        }
+        file->mResult = (MediaScanResult)result;
+        file->mHasMimeType = hasMimeType != 0;
+        mIndex.add(path, file);
+    }
+    fclose(in);
+
+    if (!ok) {
+        ALOGW("ignoring malformed scan index '%s'", indexPath);
+        clearIndex();
+    }
+    return OK;
+}
+
+status_t StagefrightMediaScanner::saveIndex() {
+    Mutex::Autolock autoLock(mIndexLock);
+
+    if (mIndexPath.isEmpty()) {
+        return INVALID_OPERATION;
+    }
+
+    // write a new file and rename it, so that an interrupted save keeps the old index
+    String8 tmpPath = mIndexPath;
+    tmpPath.append(".tmp");
+    FILE *out = fopen(tmpPath.string(), "wb");
+    if (out == NULL) {
+        ALOGE("unable to write scan index '%s': %s", tmpPath.string(), strerror(errno));
+        return -errno;
+    }
+
+    bool ok = WriteUInt32(out, kIndexMagic)
+        && WriteUInt32(out, kIndexVersion)
+        && WriteUInt32(out, mIndex.size());
+    for (size_t i = 0; ok && i < mIndex.size(); ++i) {
+        const ScannedFile *file = mIndex.valueAt(i);
+        ok = WriteString(out, mIndex.keyAt(i))
+            && WriteInt64(out, file->mLastModified)
+            && WriteInt64(out, file->mSize)
+            && WriteUInt32(out, file->mResult)
+            && WriteUInt32(out, file->mHasMimeType)
+            && WriteString(out, file->mMimeType)
+            && WriteUInt32(out, file->mTags.size());
+        for (size_t j = 0; ok && j < file->mTags.size(); ++j) {
+            ok = WriteString(out, file->mTags[j]);
+        }
+    }
+
+    if (fclose(out) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmpPath.string(), mIndexPath.string()) != 0) {
+        ALOGE("unable to write scan index '%s'", mIndexPath.string());
+        unlink(tmpPath.string());
+        return UNKNOWN_ERROR;
+    }
+    return OK;
+}
+
+void StagefrightMediaScanner::clearIndex() {
+    for (size_t i = 0; i < mIndex.size(); ++i) {
+        delete mIndex.valueAt(i);
+    }
+    mIndex.clear();
+}
+
 MediaAlbumArt *StagefrightMediaScanner::extractAlbumArt(int fd) {
     ALOGV("extractAlbumArt %d", fd);
 
@@ -24,6 +24,7 @@
 
 #include "include/avc_utils.h"
 #include "include/StagefrightMetadataRetriever.h"
+#include "include/ThumbnailDecoderPool.h"
 
 #include <media/ICrypto.h>
 #include <media/IMediaHTTPService.h>
@@ -139,12 +140,17 @@ status_t StagefrightMetadataRetriever::setDataSource(
     return OK;
 }
 
+// If |maxWidth| and |maxHeight| are positive, only the sync sample found by |seekMode| is
+// decoded, using a decoder from the ThumbnailDecoderPool, and the frame is scaled down
+// to fit within |maxWidth| x |maxHeight| while it is converted to RGB.
 static VideoFrame *extractVideoFrame(
         const AString &componentName,
         const sp<MetaData> &trackMeta,
         const sp<IMediaSource> &source,
         int64_t frameTimeUs,
-        int seekMode) {
+        int seekMode,
+        int32_t maxWidth = 0,
+        int32_t maxHeight = 0) {
 
     sp<MetaData> format = source->getFormat();
 
@@ -167,11 +173,17 @@ static VideoFrame *extractVideoFrame(
         videoFormat->setInt32("android._num-output-buffers", 1);
     }
 
+    bool isThumbnail = maxWidth > 0 && maxHeight > 0;
+
     status_t err;
-    sp<ALooper> looper = new ALooper;
-    looper->start();
-    sp<MediaCodec> decoder = MediaCodec::CreateByComponentName(
-            looper, componentName, &err);
+    sp<MediaCodec> decoder;
+    if (isThumbnail) {
+        decoder = ThumbnailDecoderPool::getInstance()->acquire(componentName, &err);
+    } else {
+        sp<ALooper> looper = new ALooper;
+        looper->start();
+        decoder = MediaCodec::CreateByComponentName(looper, componentName, &err);
+    }
 
     if (decoder.get() == NULL || err != OK) {
         ALOGW("Failed to instantiate decoder [%s]", componentName.c_str());
@@ -303,7 +315,11 @@ static VideoFrame *extractVideoFrame(
                 memcpy(codecBuffer->data(),
                         (const uint8_t*)mediaBuffer->data() + mediaBuffer->range_offset(),
                         mediaBuffer->range_length());
-                if (isAvcOrHevc && IsIDR(codecBuffer) && !isSeekingClosest) {
+                if (isThumbnail) {
+                    // The seek landed on a sync sample, which is all we decode.
+                    haveMoreInputs = false;
+                    flags |= MediaCodec::BUFFER_FLAG_EOS;
+                } else if (isAvcOrHevc && IsIDR(codecBuffer) && !isSeekingClosest) {
                     // Only need to decode one IDR frame, unless we're seeking with CLOSEST
                     // option, in which case we need to actually decode to targetTimeUs.
                     haveMoreInputs = false;
@@ -404,28 +420,59 @@ static VideoFrame *extractVideoFrame(
         rotationAngle = 0;  // By default, no rotation
     }
 
+    int32_t sarWidth, sarHeight;
+    if (!trackMeta->findInt32(kKeySARWidth, &sarWidth)
+            || !trackMeta->findInt32(kKeySARHeight, &sarHeight)
+            || sarWidth <= 0 || sarHeight <= 0) {
+        sarWidth = sarHeight = 1;
+    }
+
     VideoFrame *frame = new VideoFrame;
     frame->mWidth = crop_right - crop_left + 1;
     frame->mHeight = crop_bottom - crop_top + 1;
-    frame->mDisplayWidth = frame->mWidth;
+
+    if (isThumbnail) {
+        // The bounds apply to the frame as displayed.
+        if (rotationAngle == 90 || rotationAngle == 270) {
+            int32_t tmp = maxWidth;
+            maxWidth = maxHeight;
+            maxHeight = tmp;
+        }
+
+        double displayWidth = (double)frame->mWidth * sarWidth / sarHeight;
+        double scale = 1.0;
+        if (displayWidth > maxWidth) {
+            scale = maxWidth / displayWidth;
+        }
+        if (frame->mHeight * scale > maxHeight) {
+            scale = (double)maxHeight / frame->mHeight;
+        }
+
+        if (scale < 1.0) {
+            frame->mWidth = (uint32_t)(frame->mWidth * scale + 0.5);
+            frame->mHeight = (uint32_t)(frame->mHeight * scale + 0.5);
+            if (frame->mWidth == 0) {
+                frame->mWidth = 1;
+            }
+            if (frame->mHeight == 0) {
+                frame->mHeight = 1;
+            }
+        }
+    }
+
+    frame->mDisplayWidth = (frame->mWidth * sarWidth) / sarHeight;
     frame->mDisplayHeight = frame->mHeight;
     frame->mSize = frame->mWidth * frame->mHeight * 2;
     frame->mData = new uint8_t[frame->mSize];
     frame->mRotationAngle = rotationAngle;
 
-    int32_t sarWidth, sarHeight;
-    if (trackMeta->findInt32(kKeySARWidth, &sarWidth)
-            && trackMeta->findInt32(kKeySARHeight, &sarHeight)
-            && sarHeight != 0) {
-        frame->mDisplayWidth = (frame->mDisplayWidth * sarWidth) / sarHeight;
-    }
-
     int32_t srcFormat;
     CHECK(outputFormat->findInt32("color-format", &srcFormat));
 
     ColorConverter converter((OMX_COLOR_FORMATTYPE)srcFormat, OMX_COLOR_Format16bitRGB565);
 
     if (converter.isValid()) {
+        // scales down in the same pass if the frame is smaller than the crop
         err = converter.convert(
                 (const uint8_t *)videoFrameBuffer->data(),
                 width, height,
@@ -443,7 +490,11 @@ static VideoFrame *extractVideoFrame(
     videoFrameBuffer.clear();
     source->stop();
     decoder->releaseOutputBuffer(index);
-    decoder->release();
+    if (isThumbnail) {
+        ThumbnailDecoderPool::getInstance()->recycle(componentName, decoder);
+    } else {
+        decoder->release();
+    }
 
     if (err != OK) {
         ALOGE("Colorconverter failed to convert frame.");
@@ -460,6 +511,25 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
 
     ALOGV("getFrameAtTime: %" PRId64 " us option: %d", timeUs, option);
 
+    return getFrameInternal(timeUs, option, 0 /* maxWidth */, 0 /* maxHeight */);
+}
+
+VideoFrame *StagefrightMetadataRetriever::getThumbnailAtTime(
+        int64_t timeUs, int32_t maxWidth, int32_t maxHeight) {
+
+    ALOGV("getThumbnailAtTime: %" PRId64 " us max size: %dx%d", timeUs, maxWidth, maxHeight);
+
+    if (maxWidth <= 0 || maxHeight <= 0) {
+        return NULL;
+    }
+
+    return getFrameInternal(
+            timeUs, MediaSource::ReadOptions::SEEK_CLOSEST_SYNC, maxWidth, maxHeight);
+}
+
+VideoFrame *StagefrightMetadataRetriever::getFrameInternal(
+        int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight) {
+
     if (mExtractor.get() == NULL) {
         ALOGV("no extractor.");
         return NULL;
@@ -527,7 +597,8 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
     for (size_t i = 0; i < matchingCodecs.size(); ++i) {
         const AString &componentName = matchingCodecs[i];
         VideoFrame *frame =
-            extractVideoFrame(componentName, trackMeta, source, timeUs, option);
+            extractVideoFrame(
+                    componentName, trackMeta, source, timeUs, option, maxWidth, maxHeight);
 
         if (frame != NULL) {
             return frame;
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ThumbnailDecoderPool"
+#include <utils/Log.h>
+
+#include "include/ThumbnailDecoderPool.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaCodec.h>
+
+namespace android {
+
+// idle decoders kept per component
+static const size_t kMaxIdleDecoders = 2;
+
+// idle decoders are released after this long
+static const int64_t kIdleTimeoutUs = 5000000ll;
+
+static Mutex sInstanceLock;
+static sp<ThumbnailDecoderPool> sInstance;
+
+// static
+sp<ThumbnailDecoderPool> ThumbnailDecoderPool::getInstance() {
+    Mutex::Autolock autoLock(sInstanceLock);
+    if (sInstance == NULL) {
+        sInstance = new ThumbnailDecoderPool;
+        sInstance->mLooper->registerHandler(sInstance);
+    }
+    return sInstance;
+}
+
+ThumbnailDecoderPool::ThumbnailDecoderPool()
+    : mLooper(new ALooper),
+      mEvictPending(false) {
+    mLooper->setName("ThumbnailDecoderPool");
+    mLooper->start();
+}
+
+ThumbnailDecoderPool::~ThumbnailDecoderPool() {
+    mLooper->unregisterHandler(id());
+    mLooper->stop();
+
+    for (size_t i = 0; i < mIdleDecoders.size(); ++i) {
+        const Vector<IdleDecoder> &decoders = mIdleDecoders.valueAt(i);
+        for (size_t j = 0; j < decoders.size(); ++j) {
+            decoders[j].mDecoder->release();
+        }
+    }
+}
+
+sp<MediaCodec> ThumbnailDecoderPool::acquire(
+        const AString &componentName, status_t *err) {
+    {
+        Mutex::Autolock autoLock(mLock);
+        ssize_t index = mIdleDecoders.indexOfKey(componentName);
+        if (index >= 0 && !mIdleDecoders.valueAt(index).isEmpty()) {
+            Vector<IdleDecoder> &decoders = mIdleDecoders.editValueAt(index);
+
+            // most recently used first
+            sp<MediaCodec> decoder = decoders.top().mDecoder;
+            decoders.pop();
+            ALOGV("reusing decoder [%s]", componentName.c_str());
+
+            *err = OK;
+            return decoder;
+        }
+    }
+
+    sp<ALooper> looper = new ALooper;
+    looper->start();
+    return MediaCodec::CreateByComponentName(looper, componentName, err);
+}
+
+void ThumbnailDecoderPool::recycle(
+        const AString &componentName, const sp<MediaCodec> &decoder) {
+    status_t err = decoder->stop();
+    if (err != OK) {
+        ALOGW("failed to stop decoder [%s]: %d", componentName.c_str(), err);
+        decoder->release();
+        return;
+    }
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        ssize_t index = mIdleDecoders.indexOfKey(componentName);
+        if (index < 0) {
+            index = mIdleDecoders.add(componentName, Vector<IdleDecoder>());
+        }
+
+        Vector<IdleDecoder> &decoders = mIdleDecoders.editValueAt(index);
+        if (decoders.size() < kMaxIdleDecoders) {
+            IdleDecoder idle;
+            idle.mDecoder = decoder;
+            idle.mIdleSinceUs = ALooper::GetNowUs();
+            decoders.push(idle);
+            scheduleEvict_l();
+            return;
+        }
+    }
+
+    decoder->release();
+}
+
+void ThumbnailDecoderPool::scheduleEvict_l() {
+    if (!mEvictPending) {
+        mEvictPending = true;
+        (new AMessage(kWhatEvict, this))->post(kIdleTimeoutUs);
+    }
+}
+
+void ThumbnailDecoderPool::onMessageReceived(const sp<AMessage> &msg) {
+    switch (msg->what()) {
+        case kWhatEvict:
+        {
+            Vector<sp<MediaCodec> > expired;
+            {
+                Mutex::Autolock autoLock(mLock);
+                mEvictPending = false;
+
+                int64_t nowUs = ALooper::GetNowUs();
+                for (size_t i = 0; i < mIdleDecoders.size(); ++i) {
+                    Vector<IdleDecoder> &decoders = mIdleDecoders.editValueAt(i);
+
+                    // decoders are pushed in the order they became idle
+                    while (!decoders.isEmpty()
+                            && nowUs - decoders[0].mIdleSinceUs >= kIdleTimeoutUs) {
+                        expired.push(decoders[0].mDecoder);
+                        decoders.removeAt(0);
+                    }
+                    if (!decoders.isEmpty()) {
+                        scheduleEvict_l();
+                    }
+                }
+            }
+
+            // release outside of the lock, this waits for the component to be freed
+            for (size_t i = 0; i < expired.size(); ++i) {
+                expired.editItemAt(i)->release();
+            }
+            ALOGV("released %zu idle decoders", expired.size());
+            break;
+        }
+
+        default:
+            TRESPASS();
+    }
+}
+
+}  // namespace android
@@ -22,6 +22,9 @@
 
 #include "basic_op.h"
 #include "band_nrg.h"
+#ifdef X86_SIMD
+#include "aacenc_x86.h"
+#endif
 
 #ifndef ARMV5E
 /********************************************************************************
@@ -39,6 +42,11 @@ void CalcBandEnergy(const Word32 *mdctSpectrum,
   Word32 i, j;
   Word32 accuSum = 0;
 
+#ifdef X86_SIMD
+  if (CalcBandEnergy_x86(mdctSpectrum, bandOffset, numBands, bandEnergy, bandEnergySum))
+    return;
+#endif
+
   for (i=0; i<numBands; i++) {
     Word32 accu = 0;
     for (j=bandOffset[i]; j<bandOffset[i+1]; j++)
@@ -71,6 +79,11 @@ void CalcBandEnergyMS(const Word32 *mdctSpectrumLeft,
   Word32 accuMidSum = 0;
   Word32 accuSideSum = 0;
 
+#ifdef X86_SIMD
+  if (CalcBandEnergyMS_x86(mdctSpectrumLeft, mdctSpectrumRight, bandOffset, numBands,
+                           bandEnergyMid, bandEnergyMidSum, bandEnergySide, bandEnergySideSum))
+    return;
+#endif
 
   for(i=0; i<numBands; i++) {
     Word32 accuMid = 0;
@@ -25,6 +25,10 @@
 #include "oper_32b.h"
 #include "quantize.h"
 #include "aac_rom.h"
+#include "psy_const.h"
+#ifdef X86_SIMD
+#include "aacenc_x86.h"
+#endif
 
 #define MANT_DIGITS 9
 #define MANT_SIZE   (1<<MANT_DIGITS)
@@ -111,6 +115,21 @@ static void quantizeLines(const Word16 gain,
   Word32 g = (gain >> 2) + 4;
   Word32 mdctSpeL;
   const Word16 *pquat;
+#ifdef X86_SIMD
+  Word16 bigLines[FRAME_LEN_LONG];
+  Word32 numBigLines, i;
+
+  if (quantizeSmallLines_x86(gain, noOfLines, mdctSpectrum, quaSpectrum,
+                             bigLines, &numBigLines)) {
+    for (i = 0; i < numBigLines; i++) {
+      Word16 qua;
+      mdctSpeL = mdctSpectrum[bigLines[i]];
+      qua = quantizeSingleLine(gain, L_abs(mdctSpeL));
+      quaSpectrum[bigLines[i]] = mdctSpeL < 0 ? -qua : qua;
+    }
+    return;
+  }
+#endif
     /* gain&3 */
 
   pquat = quantBorders[m];
@@ -24,6 +24,9 @@
 #include "psy_const.h"
 #include "transform.h"
 #include "aac_rom.h"
+#ifdef X86_SIMD
+#include "aacenc_x86.h"
+#endif
 
 
 #define LS_TRANS ((FRAME_LEN_LONG-FRAME_LEN_SHORT)/2) /* 448 */
@@ -194,6 +197,11 @@ static void Radix4FFT(int *buf, int num, int bgn, int *twidTab)
 	int i, j, step;
 	int *xptr, *csptr;
 
+#ifdef X86_SIMD
+	if (Radix4FFT_x86(buf, num, bgn, twidTab))
+		return;
+#endif
+
 	for (num >>= 2; num != 0; num >>= 2)
 	{
 		step = 2*bgn;
@@ -0,0 +1,73 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		aacenc_x86.h
+
+	Content:	SSE2/SSE4.1/AVX2 kernels for the x86 build. Each kernel
+				takes the arguments of its C counterpart and returns 1 if
+				it produced the (bit-exact) result, 0 if the caller must
+				run the C reference instead.
+
+*******************************************************************************/
+
+#ifndef __AACENC_X86_H__
+#define __AACENC_X86_H__
+
+#include <stdint.h>
+#include "typedef.h"
+#include "aacenc_simd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+Word32 CalcBandEnergy_x86(const Word32 *mdctSpectrum,
+                          const Word16 *bandOffset,
+                          const Word16  numBands,
+                          Word32       *bandEnergy,
+                          Word32       *bandEnergySum);
+
+Word32 CalcBandEnergyMS_x86(const Word32 *mdctSpectrumLeft,
+                            const Word32 *mdctSpectrumRight,
+                            const Word16 *bandOffset,
+                            const Word16  numBands,
+                            Word32       *bandEnergyMid,
+                            Word32       *bandEnergyMidSum,
+                            Word32       *bandEnergySide,
+                            Word32       *bandEnergySideSum);
+
+/* Quantizes the lines whose magnitude is below 4. The indices of the lines
+   that need the full quantizeSingleLine() path are stored in bigLines[]. */
+Word32 quantizeSmallLines_x86(const Word16 gain,
+                              const Word16 noOfLines,
+                              const Word32 *mdctSpectrum,
+                              Word16 *quaSpectrum,
+                              Word16 *bigLines,
+                              Word32 *numBigLines);
+
+Word32 Radix4FFT_x86(int *buf, int num, int bgn, int *twidTab);
+
+/* Per-level variants, selected by the functions above. */
+uint64_t BandEnergy_avx2(const Word32 *spec, Word32 n);
+void BandEnergyMS_avx2(const Word32 *left, const Word32 *right, Word32 n,
+                       uint64_t *mid, uint64_t *side);
+void Radix4FFT_sse41(int *buf, int num, int bgn, int *twidTab);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AACENC_X86_H__ */
@@ -0,0 +1,80 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		dsp_avx2.c
+
+	Content:	AVX2 band energy kernels, returning the unsaturated 64-bit
+				sum of MULHIGH(x, x) over a band.
+
+*******************************************************************************/
+
+#include <immintrin.h>
+#include "basic_op.h"
+#include "aacenc_x86.h"
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+static inline AVX2_FN __m256i add_sq_high_avx2(__m256i acc, __m256i x)
+{
+	__m256i a = _mm256_abs_epi32(x);		/* MIN_32 stays 2^31 as unsigned */
+	acc = _mm256_add_epi64(acc, _mm256_srli_epi64(_mm256_mul_epu32(a, a), 32));
+	a = _mm256_srli_epi64(a, 32);
+	return _mm256_add_epi64(acc, _mm256_srli_epi64(_mm256_mul_epu32(a, a), 32));
+}
+
+static inline AVX2_FN uint64_t hsum_epi64_avx2(__m256i acc)
+{
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+AVX2_FN uint64_t BandEnergy_avx2(const Word32 *spec, Word32 n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	uint64_t sum;
+	Word32 j;
+
+	for (j = 0; j + 8 <= n; j += 8)
+		acc = add_sq_high_avx2(acc, _mm256_loadu_si256((const __m256i *)(spec + j)));
+	sum = hsum_epi64_avx2(acc);
+	for (; j < n; j++)
+		sum += MULHIGH(spec[j], spec[j]);
+	return sum;
+}
+
+AVX2_FN void BandEnergyMS_avx2(const Word32 *left, const Word32 *right, Word32 n,
+                               uint64_t *mid, uint64_t *side)
+{
+	__m256i accMid = _mm256_setzero_si256();
+	__m256i accSide = _mm256_setzero_si256();
+	Word32 j;
+
+	for (j = 0; j + 8 <= n; j += 8) {
+		__m256i l = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(left + j)), 1);
+		__m256i r = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(right + j)), 1);
+		accMid = add_sq_high_avx2(accMid, _mm256_add_epi32(l, r));
+		accSide = add_sq_high_avx2(accSide, _mm256_sub_epi32(l, r));
+	}
+	*mid = hsum_epi64_avx2(accMid);
+	*side = hsum_epi64_avx2(accSide);
+	for (; j < n; j++) {
+		Word32 l = left[j] >> 1;
+		Word32 r = right[j] >> 1;
+		*mid += MULHIGH(l + r, l + r);
+		*side += MULHIGH(l - r, l - r);
+	}
+}
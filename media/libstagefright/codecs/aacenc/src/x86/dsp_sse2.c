@@ -0,0 +1,236 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		dsp_sse2.c
+
+	Content:	SSE2 band energy and quantization kernels, and the
+				dispatch to the SSE4.1/AVX2 variants.
+
+				The band energies are sums of non-negative MULHIGH(x, x)
+				terms, so the saturating L_add() chain equals the exact
+				64-bit sum clamped to MAX_32, in any summation order.
+
+*******************************************************************************/
+
+#include <emmintrin.h>
+#include "basic_op.h"
+#include "aac_rom.h"
+#include "aacenc_x86.h"
+
+/* Adds MULHIGH(x, x) of four lines to the two 64-bit lanes of acc. */
+static inline __m128i add_sq_high(__m128i acc, __m128i x)
+{
+	/* |x| as unsigned, so MIN_32 squares to 2^62 like the scalar code */
+	__m128i s = _mm_srai_epi32(x, 31);
+	__m128i a = _mm_sub_epi32(_mm_xor_si128(x, s), s);
+	acc = _mm_add_epi64(acc, _mm_srli_epi64(_mm_mul_epu32(a, a), 32));
+	a = _mm_srli_epi64(a, 32);
+	return _mm_add_epi64(acc, _mm_srli_epi64(_mm_mul_epu32(a, a), 32));
+}
+
+static inline uint64_t hsum_epi64(__m128i acc)
+{
+	uint64_t lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, acc);
+	return lanes[0] + lanes[1];
+}
+
+static inline Word32 sat_energy(uint64_t sum)
+{
+	return sum > (uint64_t)MAX_32 ? MAX_32 : (Word32)sum;
+}
+
+static uint64_t band_energy_sse2(const Word32 *spec, Word32 n)
+{
+	__m128i acc = _mm_setzero_si128();
+	uint64_t sum;
+	Word32 j;
+
+	for (j = 0; j + 4 <= n; j += 4)
+		acc = add_sq_high(acc, _mm_loadu_si128((const __m128i *)(spec + j)));
+	sum = hsum_epi64(acc);
+	for (; j < n; j++)
+		sum += MULHIGH(spec[j], spec[j]);
+	return sum;
+}
+
+static void band_energy_ms_sse2(const Word32 *left, const Word32 *right, Word32 n,
+                                uint64_t *mid, uint64_t *side)
+{
+	__m128i accMid = _mm_setzero_si128();
+	__m128i accSide = _mm_setzero_si128();
+	Word32 j;
+
+	for (j = 0; j + 4 <= n; j += 4) {
+		__m128i l = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(left + j)), 1);
+		__m128i r = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(right + j)), 1);
+		accMid = add_sq_high(accMid, _mm_add_epi32(l, r));
+		accSide = add_sq_high(accSide, _mm_sub_epi32(l, r));
+	}
+	*mid = hsum_epi64(accMid);
+	*side = hsum_epi64(accSide);
+	for (; j < n; j++) {
+		Word32 l = left[j] >> 1;
+		Word32 r = right[j] >> 1;
+		*mid += MULHIGH(l + r, l + r);
+		*side += MULHIGH(l - r, l - r);
+	}
+}
+
+Word32 CalcBandEnergy_x86(const Word32 *mdctSpectrum,
+                          const Word16 *bandOffset,
+                          const Word16  numBands,
+                          Word32       *bandEnergy,
+                          Word32       *bandEnergySum)
+{
+	Word32 i, n, level;
+	Word32 accuSum = 0;
+
+	level = voAACEnc_GetSimdLevel();
+	if (level == VOAACENC_SIMD_NONE)
+		return 0;
+
+	for (i=0; i<numBands; i++) {
+		Word32 accu;
+		n = bandOffset[i+1] - bandOffset[i];
+		if (level >= VOAACENC_SIMD_AVX2)
+			accu = sat_energy(BandEnergy_avx2(mdctSpectrum + bandOffset[i], n));
+		else
+			accu = sat_energy(band_energy_sse2(mdctSpectrum + bandOffset[i], n));
+
+		accu = L_add(accu, accu);
+		accuSum = L_add(accuSum, accu);
+		bandEnergy[i] = accu;
+	}
+	*bandEnergySum = accuSum;
+	return 1;
+}
+
+Word32 CalcBandEnergyMS_x86(const Word32 *mdctSpectrumLeft,
+                            const Word32 *mdctSpectrumRight,
+                            const Word16 *bandOffset,
+                            const Word16  numBands,
+                            Word32       *bandEnergyMid,
+                            Word32       *bandEnergyMidSum,
+                            Word32       *bandEnergySide,
+                            Word32       *bandEnergySideSum)
+{
+	Word32 i, n, level;
+	Word32 accuMidSum = 0;
+	Word32 accuSideSum = 0;
+
+	level = voAACEnc_GetSimdLevel();
+	if (level == VOAACENC_SIMD_NONE)
+		return 0;
+
+	for (i=0; i<numBands; i++) {
+		uint64_t mid, side;
+		Word32 accuMid, accuSide;
+		n = bandOffset[i+1] - bandOffset[i];
+		if (level >= VOAACENC_SIMD_AVX2)
+			BandEnergyMS_avx2(mdctSpectrumLeft + bandOffset[i],
+			                  mdctSpectrumRight + bandOffset[i], n, &mid, &side);
+		else
+			band_energy_ms_sse2(mdctSpectrumLeft + bandOffset[i],
+			                    mdctSpectrumRight + bandOffset[i], n, &mid, &side);
+
+		accuMid = sat_energy(mid);
+		accuSide = sat_energy(side);
+		accuMid = L_add(accuMid, accuMid);
+		accuSide = L_add(accuSide, accuSide);
+		bandEnergyMid[i] = accuMid;
+		accuMidSum = L_add(accuMidSum, accuMid);
+		bandEnergySide[i] = accuSide;
+		accuSideSum = L_add(accuSideSum, accuSide);
+	}
+	*bandEnergyMidSum = accuMidSum;
+	*bandEnergySideSum = accuSideSum;
+	return 1;
+}
+
+Word32 quantizeSmallLines_x86(const Word16 gain,
+                              const Word16 noOfLines,
+                              const Word32 *mdctSpectrum,
+                              Word16 *quaSpectrum,
+                              Word16 *bigLines,
+                              Word32 *numBigLines)
+{
+	const Word16 *pquat = quantBorders[gain & 3];
+	Word32 g = (gain >> 2) + 4 + 16;
+	Word32 line, nBig = 0;
+	__m128i b0, b1, b2, b3, shift;
+
+	/* The C code shifts by g (or -g) directly; only mirror the defined range. */
+	if (g < 0 || g > 31 || voAACEnc_GetSimdLevel() == VOAACENC_SIMD_NONE)
+		return 0;
+
+	/* saShft > b  <=>  saShft >= b + 1 */
+	b0 = _mm_set1_epi32(pquat[0]);
+	b1 = _mm_set1_epi32(pquat[1] - 1);
+	b2 = _mm_set1_epi32(pquat[2] - 1);
+	b3 = _mm_set1_epi32(pquat[3] - 1);
+	shift = _mm_cvtsi32_si128(g);
+
+	for (line = 0; line + 4 <= noOfLines; line += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(mdctSpectrum + line));
+		__m128i s = _mm_srai_epi32(x, 31);
+		__m128i sa = _mm_sub_epi32(_mm_xor_si128(x, s), s);
+		__m128i q;
+		Word32 big;
+
+		sa = _mm_xor_si128(sa, _mm_srai_epi32(sa, 31));		/* L_abs(MIN_32) == MAX_32 */
+		sa = _mm_sra_epi32(sa, shift);
+
+		/* the borders are increasing, so the magnitude is the number of borders passed */
+		q = _mm_sub_epi32(_mm_setzero_si128(), _mm_cmpgt_epi32(sa, b0));
+		q = _mm_sub_epi32(q, _mm_cmpgt_epi32(sa, b1));
+		q = _mm_sub_epi32(q, _mm_cmpgt_epi32(sa, b2));
+		q = _mm_sub_epi32(_mm_xor_si128(q, s), s);
+		_mm_storel_epi64((__m128i *)(quaSpectrum + line), _mm_packs_epi32(q, q));
+
+		big = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(sa, b3)));
+		while (big) {
+			Word32 k = __builtin_ctz(big);
+			bigLines[nBig++] = (Word16)(line + k);
+			big &= big - 1;
+		}
+	}
+
+	for (; line < noOfLines; line++) {
+		Word32 mdctSpeL = mdctSpectrum[line];
+		Word32 saShft = L_abs(mdctSpeL) >> g;
+		Word32 qua = 0;
+
+		if (saShft >= pquat[3])
+			bigLines[nBig++] = (Word16)line;
+		else if (saShft > pquat[0])
+			qua = (saShft < pquat[1]) ? 1 : (saShft < pquat[2]) ? 2 : 3;
+		quaSpectrum[line] = (Word16)(mdctSpeL < 0 ? -qua : qua);
+	}
+
+	*numBigLines = nBig;
+	return 1;
+}
+
+Word32 Radix4FFT_x86(int *buf, int num, int bgn, int *twidTab)
+{
+	/* two butterflies per iteration */
+	if (voAACEnc_GetSimdLevel() < VOAACENC_SIMD_SSE41 || (bgn & 1))
+		return 0;
+
+	Radix4FFT_sse41(buf, num, bgn, twidTab);
+	return 1;
+}
@@ -0,0 +1,107 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		dsp_sse41.c
+
+	Content:	SSE4.1 radix-4 FFT stages of the MDCT. Two butterflies are
+				computed per iteration, keeping (re, im) pairs interleaved
+				as in the buffer. All arithmetic wraps exactly like the
+				C version, so the result is bit-exact.
+
+*******************************************************************************/
+
+#include <smmintrin.h>
+#include "basic_op.h"
+#include "aacenc_x86.h"
+
+#define SSE41_FN __attribute__((target("sse4.1")))
+
+/* MULHIGH() on four lanes */
+static inline SSE41_FN __m128i mulhigh4(__m128i a, __m128i b)
+{
+	__m128i even = _mm_srli_epi64(_mm_mul_epi32(a, b), 32);
+	__m128i odd = _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_blend_epi16(even, odd, 0xCC);
+}
+
+/* x = (re, im) pairs, cs = (cos, sin) pairs:
+   returns (cos*re + sin*im, cos*im - sin*re) pairs */
+static inline SSE41_FN __m128i cmul2(__m128i x, __m128i cs)
+{
+	__m128i a = mulhigh4(x, cs);
+	__m128i b = mulhigh4(_mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)), cs);
+	__m128i h = _mm_hadd_epi32(a, _mm_sign_epi32(b, _mm_set_epi32(-1, 1, -1, 1)));
+	return _mm_shuffle_epi32(h, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+SSE41_FN void Radix4FFT_sse41(int *buf, int num, int bgn, int *twidTab)
+{
+	int i, j, step;
+	int *xptr, *csptr;
+	const __m128i negRe = _mm_set_epi32(1, -1, 1, -1);
+
+	for (num >>= 2; num != 0; num >>= 2)
+	{
+		step = 2*bgn;
+		xptr = buf;
+
+		for (i = num; i != 0; i--)
+		{
+			csptr = twidTab;
+
+			for (j = bgn; j != 0; j -= 2)
+			{
+				__m128i x0, x1, x2, x3, cs1, cs2, cs3;
+				__m128i t, r23, p, q, r45, r67, s, d, u;
+				__m128 l0, l1, l2;
+
+				x0 = _mm_loadu_si128((const __m128i *)xptr);
+				x1 = _mm_loadu_si128((const __m128i *)(xptr + step));
+				x2 = _mm_loadu_si128((const __m128i *)(xptr + 2*step));
+				x3 = _mm_loadu_si128((const __m128i *)(xptr + 3*step));
+
+				/* twiddles of two butterflies: c1 s1 c2 s2 c3 s3 | c1 s1 c2 s2 c3 s3 */
+				l0 = _mm_loadu_ps((const float *)csptr);
+				l1 = _mm_loadu_ps((const float *)(csptr + 4));
+				l2 = _mm_loadu_ps((const float *)(csptr + 8));
+				cs1 = _mm_castps_si128(_mm_shuffle_ps(l0, l1, _MM_SHUFFLE(3, 2, 1, 0)));
+				cs2 = _mm_castps_si128(_mm_shuffle_ps(l0, l2, _MM_SHUFFLE(1, 0, 3, 2)));
+				cs3 = _mm_castps_si128(_mm_shuffle_ps(l1, l2, _MM_SHUFFLE(3, 2, 1, 0)));
+				csptr += 12;
+
+				r23 = cmul2(x1, cs1);
+				t = _mm_srai_epi32(x0, 2);
+				p = _mm_sub_epi32(t, r23);					/* r0, r1 */
+				q = _mm_add_epi32(t, r23);					/* r2, r3 */
+
+				r45 = cmul2(x2, cs2);
+				r67 = cmul2(x3, cs3);
+				s = _mm_add_epi32(r45, r67);				/* r4, r7 after the C swap */
+				d = _mm_sub_epi32(r45, r67);
+				u = _mm_sign_epi32(_mm_shuffle_epi32(d, _MM_SHUFFLE(2, 3, 0, 1)), negRe);	/* r5, r6 */
+
+				_mm_storeu_si128((__m128i *)xptr, _mm_add_epi32(q, s));
+				_mm_storeu_si128((__m128i *)(xptr + step), _mm_sub_epi32(p, u));
+				_mm_storeu_si128((__m128i *)(xptr + 2*step), _mm_sub_epi32(q, s));
+				_mm_storeu_si128((__m128i *)(xptr + 3*step), _mm_add_epi32(p, u));
+				xptr += 4;
+			}
+			xptr += 3*step;
+		}
+		twidTab += 3*step;
+		bgn <<= 2;
+	}
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Encodes N independent streams on a pool of worker threads, each stream
+// with its own encoder instance, and reports encoded audio-seconds per
+// wall-second.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "voAAC.h"
+#include "cmnMemory.h"
+#ifdef X86_SIMD
+#include "aacenc_simd.h"
+#endif
+
+enum {
+    kSampleRate = 44100,
+    kFrameLength = 1024,
+    kOutputBufferSize = 8192,
+};
+
+struct Pool {
+    const std::vector<int16_t> *pcm;
+    int channels;
+    int bitRate;
+    int framesPerStream;
+    int numStreams;
+
+    pthread_mutex_t lock;
+    int nextStream;
+    int failedStreams;
+};
+
+static double nowSeconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool encodeStream(const Pool &pool) {
+    VO_AUDIO_CODECAPI api;
+    if (voGetAACEncAPI(&api) != VO_ERR_NONE) {
+        return false;
+    }
+
+    VO_MEM_OPERATOR memOperator;
+    memOperator.Alloc = cmnMemAlloc;
+    memOperator.Copy = cmnMemCopy;
+    memOperator.Free = cmnMemFree;
+    memOperator.Set = cmnMemSet;
+    memOperator.Check = cmnMemCheck;
+
+    VO_CODEC_INIT_USERDATA userData;
+    memset(&userData, 0, sizeof(userData));
+    userData.memflag = VO_IMF_USERMEMOPERATOR;
+    userData.memData = (VO_PTR)&memOperator;
+
+    VO_HANDLE handle;
+    if (api.Init(&handle, VO_AUDIO_CodingAAC, &userData) != VO_ERR_NONE) {
+        return false;
+    }
+
+    AACENC_PARAM params;
+    memset(&params, 0, sizeof(params));
+    params.sampleRate = kSampleRate;
+    params.bitRate = pool.bitRate;
+    params.nChannels = pool.channels;
+    params.adtsUsed = 0;
+    if (api.SetParam(handle, VO_PID_AAC_ENCPARAM, &params) != VO_ERR_NONE) {
+        api.Uninit(handle);
+        return false;
+    }
+
+    const size_t frameSamples = kFrameLength * pool.channels;
+    const size_t inputFrames = pool.pcm->size() / frameSamples;
+    uint8_t outBuf[kOutputBufferSize];
+    for (int i = 0; i < pool.framesPerStream; ++i) {
+        VO_CODECBUFFER inputData;
+        memset(&inputData, 0, sizeof(inputData));
+        inputData.Buffer = (unsigned char *)&(*pool.pcm)[(i % inputFrames) * frameSamples];
+        inputData.Length = frameSamples * sizeof(int16_t);
+        api.SetInputData(handle, &inputData);
+
+        for (;;) {
+            VO_CODECBUFFER outputData;
+            memset(&outputData, 0, sizeof(outputData));
+            outputData.Buffer = outBuf;
+            outputData.Length = sizeof(outBuf);
+            VO_AUDIO_OUTPUTINFO outputInfo;
+            memset(&outputInfo, 0, sizeof(outputInfo));
+            VO_U32 ret = api.GetOutputData(handle, &outputData, &outputInfo);
+            if (ret == VO_ERR_INPUT_BUFFER_SMALL) {
+                break;
+            } else if (ret != VO_ERR_NONE) {
+                api.Uninit(handle);
+                return false;
+            }
+        }
+    }
+
+    api.Uninit(handle);
+    return true;
+}
+
+static void *worker(void *arg) {
+    Pool *pool = (Pool *)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int stream = pool->nextStream++;
+        pthread_mutex_unlock(&pool->lock);
+        if (stream >= pool->numStreams) {
+            break;
+        }
+        if (!encodeStream(*pool)) {
+            pthread_mutex_lock(&pool->lock);
+            ++pool->failedStreams;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n streams] [-t threads] [-s seconds] [-c channels] "
+                    "[-b bitrate] [-C]\n"
+                    "\t-n number of independent streams (default: 4 x threads)\n"
+                    "\t-t worker threads (default: number of cores)\n"
+                    "\t-s seconds of audio per stream (default: 30)\n"
+                    "\t-c channels, 1 or 2 (default: 2)\n"
+                    "\t-b bitrate in bits/s (default: 128000)\n"
+                    "\t-C force the C reference kernels\n", me);
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int streams = 0;
+    int seconds = 30;
+    int channels = 2;
+    int bitRate = 128000;
+    bool forceC = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:t:s:c:b:Ch")) >= 0) {
+        switch (res) {
+            case 'n': streams = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 's': seconds = atoi(optarg); break;
+            case 'c': channels = atoi(optarg); break;
+            case 'b': bitRate = atoi(optarg); break;
+            case 'C': forceC = true; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (streams == 0) {
+        streams = 4 * threads;
+    }
+    if (streams <= 0 || threads <= 0 || seconds <= 0 || channels < 1 || channels > 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#ifdef X86_SIMD
+    if (forceC) {
+        voAACEnc_SetSimdLevel(VOAACENC_SIMD_NONE);
+    }
+    printf("SIMD level %d\n", voAACEnc_GetSimdLevel());
+#else
+    (void)forceC;
+#endif
+
+    // Five seconds of a chord over low-level noise, looped by each stream.
+    std::vector<int16_t> pcm(5 * kSampleRate * channels);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < pcm.size() / channels; ++i) {
+        double t = (double)i / kSampleRate;
+        seed = seed * 1103515245 + 12345;
+        double v = 6000.0 * (sin(2 * M_PI * 261.6 * t) + sin(2 * M_PI * 329.6 * t)
+                + sin(2 * M_PI * 392.0 * t)) + (int32_t)((seed >> 16) & 0x1ff) - 256;
+        for (int c = 0; c < channels; ++c) {
+            pcm[i * channels + c] = (int16_t)(c == 0 ? v : 0.8 * v);
+        }
+    }
+
+    Pool pool;
+    pool.pcm = &pcm;
+    pool.channels = channels;
+    pool.bitRate = bitRate;
+    pool.framesPerStream = (int)((int64_t)seconds * kSampleRate / kFrameLength);
+    pool.numStreams = streams;
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.nextStream = 0;
+    pool.failedStreams = 0;
+
+    std::vector<pthread_t> workers(threads);
+    double wallStart = nowSeconds(CLOCK_MONOTONIC);
+    double cpuStart = nowSeconds(CLOCK_PROCESS_CPUTIME_ID);
+    for (int i = 0; i < threads; ++i) {
+        pthread_create(&workers[i], NULL, worker, &pool);
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    double wallSeconds = nowSeconds(CLOCK_MONOTONIC) - wallStart;
+    double cpuSeconds = nowSeconds(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+    pthread_mutex_destroy(&pool.lock);
+
+    if (pool.failedStreams != 0) {
+        fprintf(stderr, "%d streams failed\n", pool.failedStreams);
+        return EXIT_FAILURE;
+    }
+
+    double audioSeconds = (double)streams * pool.framesPerStream * kFrameLength / kSampleRate;
+    printf("%d streams x %d s on %d threads, %d ch, %d bps\n",
+            streams, seconds, threads, channels, bitRate);
+    printf("wall %.2f s, cpu %.2f s\n", wallSeconds, cpuSeconds);
+    printf("throughput:  %.1f audio-seconds per wall-second\n", audioSeconds / wallSeconds);
+    printf("per core:    %.1f audio-seconds per cpu-second\n", audioSeconds / cpuSeconds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Encodes the same input with the C reference and with each level of x86
+// SIMD kernels, for mono and stereo at several bitrates, and checks that the
+// bitstreams match.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "voAAC.h"
+#include "cmnMemory.h"
+#include "aacenc_simd.h"
+
+enum {
+    kSampleRate = 44100,
+    kFrameLength = 1024,
+    kOutputBufferSize = 8192,
+    kSyntheticSeconds = 20,
+};
+
+// Tones, noise, transients (to trigger short blocks) and near-full-scale
+// bursts, with the two channels partly correlated so M/S coding kicks in.
+static void makeSyntheticInput(int channels, std::vector<int16_t> *pcm) {
+    const size_t frames = kSyntheticSeconds * kSampleRate;
+    pcm->resize(frames * channels);
+    uint32_t seed = 0x2468ace;
+    for (size_t i = 0; i < frames; ++i) {
+        seed = seed * 1103515245 + 12345;
+        double noise = ((int32_t)(seed >> 8) & 0xffff) / 65536.0 - 0.5;
+        double t = (double)i / kSampleRate;
+        double v;
+        switch ((int)t % 4) {
+            case 0:
+                v = 8000.0 * sin(2 * M_PI * 440.0 * t) + 3000.0 * sin(2 * M_PI * 3520.0 * t);
+                break;
+            case 1:
+                v = 12000.0 * noise;
+                break;
+            case 2:
+                v = ((i % 11025) < 64) ? 30000.0 * noise : 200.0 * noise;
+                break;
+            default:
+                v = 40000.0 * sin(2 * M_PI * 97.0 * t) + 8000.0 * noise;
+                break;
+        }
+        for (int c = 0; c < channels; ++c) {
+            double w = (c == 0) ? v : 0.7 * v + 2000.0 * sin(2 * M_PI * 1000.0 * t);
+            if (w > 32767.0) w = 32767.0;
+            if (w < -32768.0) w = -32768.0;
+            (*pcm)[i * channels + c] = (int16_t)w;
+        }
+    }
+}
+
+static bool encode(const std::vector<int16_t> &pcm, int channels, int bitRate,
+                   std::vector<uint8_t> *out) {
+    VO_AUDIO_CODECAPI api;
+    if (voGetAACEncAPI(&api) != VO_ERR_NONE) {
+        return false;
+    }
+
+    VO_MEM_OPERATOR memOperator;
+    memOperator.Alloc = cmnMemAlloc;
+    memOperator.Copy = cmnMemCopy;
+    memOperator.Free = cmnMemFree;
+    memOperator.Set = cmnMemSet;
+    memOperator.Check = cmnMemCheck;
+
+    VO_CODEC_INIT_USERDATA userData;
+    memset(&userData, 0, sizeof(userData));
+    userData.memflag = VO_IMF_USERMEMOPERATOR;
+    userData.memData = (VO_PTR)&memOperator;
+
+    VO_HANDLE handle;
+    if (api.Init(&handle, VO_AUDIO_CodingAAC, &userData) != VO_ERR_NONE) {
+        return false;
+    }
+
+    AACENC_PARAM params;
+    memset(&params, 0, sizeof(params));
+    params.sampleRate = kSampleRate;
+    params.bitRate = bitRate;
+    params.nChannels = channels;
+    params.adtsUsed = 0;
+    if (api.SetParam(handle, VO_PID_AAC_ENCPARAM, &params) != VO_ERR_NONE) {
+        api.Uninit(handle);
+        return false;
+    }
+
+    out->clear();
+    uint8_t outBuf[kOutputBufferSize];
+    const size_t frameSamples = kFrameLength * channels;
+    for (size_t offset = 0; offset + frameSamples <= pcm.size(); offset += frameSamples) {
+        VO_CODECBUFFER inputData;
+        memset(&inputData, 0, sizeof(inputData));
+        inputData.Buffer = (unsigned char *)&pcm[offset];
+        inputData.Length = frameSamples * sizeof(int16_t);
+        api.SetInputData(handle, &inputData);
+
+        for (;;) {
+            VO_CODECBUFFER outputData;
+            memset(&outputData, 0, sizeof(outputData));
+            outputData.Buffer = outBuf;
+            outputData.Length = sizeof(outBuf);
+            VO_AUDIO_OUTPUTINFO outputInfo;
+            memset(&outputInfo, 0, sizeof(outputInfo));
+            VO_U32 ret = api.GetOutputData(handle, &outputData, &outputInfo);
+            if (ret == VO_ERR_INPUT_BUFFER_SMALL) {
+                break;
+            } else if (ret != VO_ERR_NONE) {
+                api.Uninit(handle);
+                return false;
+            }
+            out->insert(out->end(), outBuf, outBuf + outputData.Length);
+        }
+    }
+
+    api.Uninit(handle);
+    return true;
+}
+
+int main(int argc, char * /* argv */[]) {
+    if (argc != 1) {
+        fprintf(stderr, "This test takes no arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    int simdLevel = voAACEnc_GetSimdLevel();
+    printf("SIMD level %d\n", simdLevel);
+    if (simdLevel == VOAACENC_SIMD_NONE) {
+        printf("No SIMD support on this CPU, nothing to compare\n");
+        return EXIT_SUCCESS;
+    }
+
+    static const int kBitRates[] = { 32000, 64000, 128000, 192000 };
+    int failures = 0;
+    for (int channels = 1; channels <= 2; ++channels) {
+        std::vector<int16_t> pcm;
+        makeSyntheticInput(channels, &pcm);
+        for (size_t b = 0; b < sizeof(kBitRates) / sizeof(kBitRates[0]); ++b) {
+            int bitRate = kBitRates[b] * channels;
+            std::vector<uint8_t> reference;
+            voAACEnc_SetSimdLevel(VOAACENC_SIMD_NONE);
+            if (!encode(pcm, channels, bitRate, &reference)) {
+                fprintf(stderr, "%d ch %d bps: encoder error\n", channels, bitRate);
+                ++failures;
+                continue;
+            }
+            for (int level = VOAACENC_SIMD_SSE2; level <= simdLevel; ++level) {
+                std::vector<uint8_t> simd;
+                voAACEnc_SetSimdLevel(level);
+                if (!encode(pcm, channels, bitRate, &simd)) {
+                    fprintf(stderr, "level %d %d ch %d bps: encoder error\n",
+                            level, channels, bitRate);
+                    ++failures;
+                } else if (reference != simd) {
+                    size_t i = 0;
+                    while (i < reference.size() && i < simd.size()
+                            && reference[i] == simd[i]) {
+                        ++i;
+                    }
+                    fprintf(stderr, "level %d %d ch %d bps: bitstreams differ at byte %zu\n",
+                            level, channels, bitRate, i);
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -86,6 +86,20 @@ else
     LOCAL_C_INCLUDES_arm += $(LOCAL_PATH)/src/asm/ARMV7
 endif
 
+LOCAL_SRC_FILES_x86 := \
+        ../common/cmnCpuX86.c \
+        src/x86/cpu_x86.c \
+        src/x86/dsp_sse2.c \
+        src/x86/dsp_avx2.c
+
+LOCAL_SRC_FILES_x86_64 := $(LOCAL_SRC_FILES_x86)
+
+# SSE2/AVX2 kernels are picked at run time, see src/x86/amrwb_simd.h
+LOCAL_CFLAGS_x86 := -DX86_SIMD
+LOCAL_CFLAGS_x86_64 := -DX86_SIMD
+LOCAL_C_INCLUDES_x86 := $(LOCAL_PATH)/src/x86
+LOCAL_C_INCLUDES_x86_64 := $(LOCAL_PATH)/src/x86
+
 LOCAL_MODULE := libstagefright_amrwbenc
 
 LOCAL_ARM_MODE := arm
@@ -135,5 +149,56 @@ LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
 
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        test/amrwbenc_simd_test.cpp \
+        ../common/cmnMemory.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/src/x86 \
+	frameworks/av/media/libstagefright/codecs/common/include
+
+LOCAL_STATIC_LIBRARIES := \
+        libstagefright_amrwbenc
+
+LOCAL_CFLAGS += -Werror
+LOCAL_CLANG := true
+
+LOCAL_MODULE := libstagefright_amrwbenc_simd_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_MODULE_TARGET_ARCH := x86 x86_64
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        test/amrwbenc_bench.cpp \
+        ../common/cmnMemory.c
+
+LOCAL_C_INCLUDES := \
+	frameworks/av/media/libstagefright/codecs/common/include
+
+LOCAL_C_INCLUDES_x86 := $(LOCAL_PATH)/src/x86
+LOCAL_C_INCLUDES_x86_64 := $(LOCAL_PATH)/src/x86
+LOCAL_CFLAGS_x86 := -DX86_SIMD
+LOCAL_CFLAGS_x86_64 := -DX86_SIMD
+
+LOCAL_STATIC_LIBRARIES := \
+        libstagefright_amrwbenc
+
+LOCAL_CFLAGS += -Werror
+LOCAL_CLANG := true
+
+LOCAL_MODULE := libstagefright_amrwbenc_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
 ################################################################################
 include $(call all-makefiles-under,$(LOCAL_PATH))
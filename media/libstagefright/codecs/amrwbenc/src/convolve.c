@@ -24,6 +24,9 @@
 
 #include "typedef.h"
 #include "basic_op.h"
+#ifdef X86_SIMD
+#include "amrwb_x86.h"
+#endif
 
 #define UNUSED(x) (void)(x)
 
@@ -39,6 +42,11 @@ void Convolve (
     Word32 s;
         UNUSED(L);
 
+#ifdef X86_SIMD
+    if (Convolve_x86(x, h, y))
+        return;
+#endif
+
     for (n = 0; n < 64;)
     {
         tmpH = h+n;
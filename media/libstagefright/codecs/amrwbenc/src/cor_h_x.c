@@ -27,6 +27,9 @@
 #include "typedef.h"
 #include "basic_op.h"
 #include "math_op.h"
+#ifdef X86_SIMD
+#include "amrwb_x86.h"
+#endif
 
 #define L_SUBFR   64
 #define NB_TRACK  4
@@ -49,6 +52,28 @@ void cor_h_x(
     L_max1 = 0;
     L_max2 = 0;
     L_max3 = 0;
+#ifdef X86_SIMD
+    if (cor_h_x_x86(h, x, y32))
+    {
+        /* y32[] is already computed, only the per-track maxima are left */
+        for (i = 0; i < L_SUBFR; i += STEP)
+        {
+            L_tmp = (y32[i] > 0)? y32[i]: (y32[i] == INT_MIN ? INT_MAX : -y32[i]);
+            if(L_tmp > L_max)
+                L_max = L_tmp;
+            L_tmp = (y32[i+1] > 0)? y32[i+1]: (y32[i+1] == INT_MIN ? INT_MAX : -y32[i+1]);
+            if(L_tmp > L_max1)
+                L_max1 = L_tmp;
+            L_tmp = (y32[i+2] > 0)? y32[i+2]: (y32[i+2] == INT_MIN ? INT_MAX : -y32[i+2]);
+            if(L_tmp > L_max2)
+                L_max2 = L_tmp;
+            L_tmp = (y32[i+3] > 0)? y32[i+3]: (y32[i+3] == INT_MIN ? INT_MAX : -y32[i+3]);
+            if(L_tmp > L_max3)
+                L_max3 = L_tmp;
+        }
+    }
+    else
+#endif
     for (i = 0; i < L_SUBFR; i += STEP)
     {
         L_tmp = 1;                                    /* 1 -> to avoid null dn[] */
@@ -26,6 +26,9 @@
 
 #include "typedef.h"
 #include "basic_op.h"
+#ifdef X86_SIMD
+#include "amrwb_x86.h"
+#endif
 
 #define UP_SAMP      4
 #define L_INTERPOL2  16
@@ -71,6 +74,10 @@ void Pred_lt4(
     k = 3 - frac;                                /* k = UP_SAMP - 1 - frac */
 
     ptr2 = &(inter4_2[k][0]);
+#ifdef X86_SIMD
+    if (Pred_lt4_x86(x, ptr2, exc, T0, L_subfr))
+        return;
+#endif
     for (j = 0; j < L_subfr; j++)
     {
         ptr = ptr2;
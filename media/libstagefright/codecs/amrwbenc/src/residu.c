@@ -24,6 +24,9 @@
 
 #include "typedef.h"
 #include "basic_op.h"
+#ifdef X86_SIMD
+#include "amrwb_x86.h"
+#endif
 
 void Residu(
         Word16 a[],                           /* (i) Q12 : prediction coefficients                     */
@@ -34,6 +37,10 @@ void Residu(
 {
     Word16 i,*p1, *p2;
     Word32 s;
+#ifdef X86_SIMD
+    if (Residu_x86(a, x, y, lg))
+        return;
+#endif
     for (i = 0; i < lg; i++)
     {
         p1 = a;
@@ -25,6 +25,9 @@
 #include "basic_op.h"
 #include "math_op.h"
 #include "cnst.h"
+#ifdef X86_SIMD
+#include "amrwb_x86.h"
+#endif
 
 #define UNUSED(x) (void)(x)
 
@@ -41,6 +44,10 @@ void Syn_filt(
     Word16 y_buf[L_SUBFR16k + M16k];
     Word32 L_tmp;
     Word16 *yy, *p1, *p2;
+#ifdef X86_SIMD
+    if (Syn_filt_x86(a, x, y, lg, mem, update))
+        return;
+#endif
     yy = &y_buf[0];
     /* copy initial filter states into synthesis buffer */
     for (i = 0; i < 16; i++)
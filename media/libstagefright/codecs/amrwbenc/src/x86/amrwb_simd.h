@@ -0,0 +1,48 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/***********************************************************************
+*       File: amrwb_simd.h                                             *
+*                                                                      *
+*       Description: Selection of the x86 kernels. Kept free of the    *
+*                    codec typedefs so tools can include it directly.  *
+*                                                                      *
+************************************************************************/
+
+#ifndef __AMRWB_SIMD_H__
+#define __AMRWB_SIMD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VOAMRWB_SIMD_NONE    0
+#define VOAMRWB_SIMD_SSE2    1
+#define VOAMRWB_SIMD_AVX2    2
+
+/* Highest instruction set usable on this CPU, capped by voAMRWB_SetSimdLevel(). */
+int voAMRWB_GetSimdLevel(void);
+
+/* Caps the instruction set used by every encoder instance in the process.
+ * Pass VOAMRWB_SIMD_NONE to force the C path (used by the bit-exact test). */
+void voAMRWB_SetSimdLevel(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  //__AMRWB_SIMD_H__
+
@@ -0,0 +1,52 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/***********************************************************************
+*       File: amrwb_x86.h                                              *
+*                                                                      *
+*       Description: SSE2/AVX2 kernels for the x86 build. Each kernel  *
+*                    takes the arguments of its C counterpart and      *
+*                    returns 1 if it produced the (bit-exact) result,  *
+*                    0 if the caller must run the C reference instead. *
+*                                                                      *
+************************************************************************/
+
+#ifndef __AMRWB_X86_H__
+#define __AMRWB_X86_H__
+
+#include "typedef.h"
+#include "amrwb_simd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+Word32 Convolve_x86(Word16 x[], Word16 h[], Word16 y[]);
+Word32 cor_h_x_x86(Word16 h[], Word16 x[], Word32 y32[]);
+Word32 Residu_x86(Word16 a[], Word16 x[], Word16 y[], Word16 lg);
+Word32 Pred_lt4_x86(Word16 x[], Word16 coef[], Word16 exc[], Word16 T0, Word16 L_subfr);
+Word32 Syn_filt_x86(Word16 a[], Word16 x[], Word16 y[], Word16 lg, Word16 mem[], Word16 update);
+
+/* AVX2 variants, only called when voAMRWB_GetSimdLevel() >= VOAMRWB_SIMD_AVX2. */
+void Convolve_avx2(Word16 x[], Word16 hr[], Word16 y[]);
+void cor_h_x_avx2(Word16 h[], Word16 xe[], Word32 y32[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  //__AMRWB_X86_H__
+
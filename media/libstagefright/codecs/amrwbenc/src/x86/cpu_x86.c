@@ -0,0 +1,45 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/***********************************************************************
+*       File: cpu_x86.c                                                *
+*                                                                      *
+*       Description: Run-time selection of the x86 kernel level        *
+*                                                                      *
+************************************************************************/
+
+#include "cmnCpuX86.h"
+#include "amrwb_simd.h"
+
+static volatile int gLevelCap = VOAMRWB_SIMD_AVX2;
+
+int voAMRWB_GetSimdLevel(void)
+{
+    int cap = gLevelCap;
+    int features = cmnCpuX86Features();
+    int level = VOAMRWB_SIMD_NONE;
+
+    if (features & CMN_X86_AVX2)
+        level = VOAMRWB_SIMD_AVX2;
+    else if (features & CMN_X86_SSE2)
+        level = VOAMRWB_SIMD_SSE2;
+    return (level < cap) ? level : cap;
+}
+
+void voAMRWB_SetSimdLevel(int level)
+{
+    gLevelCap = level;
+}
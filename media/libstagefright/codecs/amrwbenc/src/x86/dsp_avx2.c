@@ -0,0 +1,87 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/***********************************************************************
+*       File: dsp_avx2.c                                               *
+*                                                                      *
+*       Description: AVX2 inner loops for Convolve() and cor_h_x().    *
+*                    The callers in dsp_sse2.c have already checked    *
+*                    that no partial sum can saturate and prepared     *
+*                    the zero-padded 128-sample operand.               *
+*                                                                      *
+************************************************************************/
+
+#include <immintrin.h>
+#include "typedef.h"
+#include "basic_op.h"
+#include "cnst.h"
+#include "amrwb_x86.h"
+#include "simd_x86_inl.h"
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+/* Eight 32-bit partial sums of a[i] * b[i] over n (multiple of 16) samples, folded to four. */
+static __inline AVX2_FN __m128i madd_n_avx2(const Word16 *a, const Word16 *b, Word32 n)
+{
+    __m256i acc = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)a),
+                                    _mm256_loadu_si256((const __m256i *)b));
+    Word32 i;
+    for (i = 16; i < n; i += 16)
+    {
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                    _mm256_loadu_si256((const __m256i *)(a + i)),
+                    _mm256_loadu_si256((const __m256i *)(b + i))));
+    }
+    return _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+}
+
+AVX2_FN void Convolve_avx2(Word16 x[], Word16 hr[], Word16 y[])
+{
+    Word32 i, n, nb;
+    Word32 s[4];
+
+    for (n = 0; n < L_SUBFR; n += 4)
+    {
+        nb = (n + 4 + 15) & ~15;
+        _mm_storeu_si128((__m128i *)s, hsum4(
+                    madd_n_avx2(x, &hr[L_SUBFR - 1 - n], nb),
+                    madd_n_avx2(x, &hr[L_SUBFR - 2 - n], nb),
+                    madd_n_avx2(x, &hr[L_SUBFR - 3 - n], nb),
+                    madd_n_avx2(x, &hr[L_SUBFR - 4 - n], nb)));
+        for (i = 0; i < 4; i++)
+        {
+            y[n + i] = voround(L_shl(s[i], 1));
+        }
+    }
+}
+
+AVX2_FN void cor_h_x_avx2(Word16 h[], Word16 xe[], Word32 y32[])
+{
+    Word32 i, nb;
+
+    for (i = 0; i < L_SUBFR; i += 4)
+    {
+        nb = (L_SUBFR - i + 15) & ~15;
+        __m128i s = hsum4(
+                madd_n_avx2(&xe[i], h, nb),
+                madd_n_avx2(&xe[i + 1], h, nb),
+                madd_n_avx2(&xe[i + 2], h, nb),
+                madd_n_avx2(&xe[i + 3], h, nb));
+        s = _mm_add_epi32(_mm_slli_epi32(s, 1), _mm_set1_epi32(1));
+        _mm_storeu_si128((__m128i *)&y32[i], s);
+    }
+}
+
@@ -0,0 +1,258 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/***********************************************************************
+*       File: dsp_sse2.c                                               *
+*                                                                      *
+*       Description: SSE2 versions of Convolve(), cor_h_x(), Residu(), *
+*                    Pred_lt4() and Syn_filt().                        *
+*                                                                      *
+*       Residu(), Pred_lt4() and Syn_filt() accumulate with plain      *
+*       32-bit adds, so the wrapping _mm_madd_epi16() sums are         *
+*       bit-exact in any order. Convolve() and cor_h_x() use the       *
+*       saturating L_add(); they only take the vector path when the    *
+*       Cauchy-Schwarz bound ||x||*||h|| proves that no partial sum    *
+*       can saturate, and fall back to C otherwise.                    *
+*                                                                      *
+************************************************************************/
+
+#include <stdint.h>
+#include "typedef.h"
+#include "basic_op.h"
+#include "cnst.h"
+#include "amrwb_x86.h"
+#include "simd_x86_inl.h"
+
+/* (2^31 - 1)^2, rounded down to leave room for the double rounding error */
+#define SAT_BOUND_SQ    4.6e18
+
+static uint64_t energy(Word16 x[], Word32 n)
+{
+    /* The pair sums of x[i]^2 fit in 32 unsigned bits, widen before adding. */
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    uint64_t lanes[2];
+    Word32 i;
+    for (i = 0; i < n; i += 8)
+    {
+        __m128i v = LOADU(x + i);
+        __m128i p = _mm_madd_epi16(v, v);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p, zero));
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    return lanes[0] + lanes[1];
+}
+
+/* True if scale * |sum of any subset of x[i] * h[j]| stays below 2^31. */
+static Word32 cannot_saturate(Word16 x[], Word16 h[], Word32 n, Word32 scale)
+{
+    double bound = (double)energy(x, n) * (double)energy(h, n);
+    return bound * (double)(scale * scale) < SAT_BOUND_SQ;
+}
+
+Word32 Convolve_x86(Word16 x[], Word16 h[], Word16 y[])
+{
+    Word16 hr[2 * L_SUBFR];
+    Word32 i, n, nb, level;
+    Word32 s[4];
+
+    level = voAMRWB_GetSimdLevel();
+    if (level == VOAMRWB_SIMD_NONE || !cannot_saturate(x, h, L_SUBFR, 1))
+        return 0;
+
+    /* Reverse h[] and pad it with zeros: y[n] = sum(x[i] * hr[L_SUBFR - 1 - n + i]) */
+    for (i = 0; i < L_SUBFR; i++)
+    {
+        hr[i] = h[L_SUBFR - 1 - i];
+        hr[L_SUBFR + i] = 0;
+    }
+
+    if (level >= VOAMRWB_SIMD_AVX2)
+    {
+        Convolve_avx2(x, hr, y);
+        return 1;
+    }
+
+    for (n = 0; n < L_SUBFR; n += 4)
+    {
+        nb = (n + 4 + 7) & ~7;          /* y[n + 3] only needs x[0 .. n + 3] */
+        _mm_storeu_si128((__m128i *)s, hsum4(
+                    madd_n(x, &hr[L_SUBFR - 1 - n], nb),
+                    madd_n(x, &hr[L_SUBFR - 2 - n], nb),
+                    madd_n(x, &hr[L_SUBFR - 3 - n], nb),
+                    madd_n(x, &hr[L_SUBFR - 4 - n], nb)));
+        for (i = 0; i < 4; i++)
+        {
+            y[n + i] = voround(L_shl(s[i], 1));
+        }
+    }
+    return 1;
+}
+
+Word32 cor_h_x_x86(Word16 h[], Word16 x[], Word32 y32[])
+{
+    Word16 xe[2 * L_SUBFR];
+    Word32 i, nb, level;
+
+    level = voAMRWB_GetSimdLevel();
+    if (level == VOAMRWB_SIMD_NONE || !cannot_saturate(x, h, L_SUBFR, 2))
+        return 0;
+
+    /* Pad x[] with zeros: y32[i] = 1 + 2 * sum(xe[i + j] * h[j]) */
+    for (i = 0; i < L_SUBFR; i++)
+    {
+        xe[i] = x[i];
+        xe[L_SUBFR + i] = 0;
+    }
+
+    if (level >= VOAMRWB_SIMD_AVX2)
+    {
+        cor_h_x_avx2(h, xe, y32);
+        return 1;
+    }
+
+    for (i = 0; i < L_SUBFR; i += 4)
+    {
+        nb = (L_SUBFR - i + 7) & ~7;
+        __m128i s = hsum4(
+                madd_n(&xe[i], h, nb),
+                madd_n(&xe[i + 1], h, nb),
+                madd_n(&xe[i + 2], h, nb),
+                madd_n(&xe[i + 3], h, nb));
+        s = _mm_add_epi32(_mm_slli_epi32(s, 1), _mm_set1_epi32(1));
+        _mm_storeu_si128((__m128i *)&y32[i], s);
+    }
+    return 1;
+}
+
+Word32 Residu_x86(Word16 a[], Word16 x[], Word16 y[], Word16 lg)
+{
+    Word16 ar[M];
+    Word32 i, k;
+    Word32 s[4];
+    __m128i ar_lo, ar_hi;
+
+    if (voAMRWB_GetSimdLevel() == VOAMRWB_SIMD_NONE)
+        return 0;
+
+    /* ar[] holds a[M..1], so a[1..M] * x[i - 1 .. i - M] is a dot product over x[i - M .. i - 1] */
+    for (k = 0; k < M; k++)
+    {
+        ar[k] = a[M - k];
+    }
+    ar_lo = LOADU(ar);
+    ar_hi = LOADU(ar + 8);
+
+#define RESIDU_TAPS(p) \
+    _mm_add_epi32(_mm_madd_epi16(LOADU((p) - M), ar_lo), _mm_madd_epi16(LOADU((p) - 8), ar_hi))
+
+    for (i = 0; i + 4 <= lg; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)s, hsum4(
+                    RESIDU_TAPS(&x[i]), RESIDU_TAPS(&x[i + 1]),
+                    RESIDU_TAPS(&x[i + 2]), RESIDU_TAPS(&x[i + 3])));
+        for (k = 0; k < 4; k++)
+        {
+            s[k] += vo_mult32(a[0], x[i + k]);
+            y[i + k] = extract_h(L_add(L_shl2(s[k], 5), 0x8000));
+        }
+    }
+    for (; i < lg; i++)
+    {
+        s[0] = hsum1(RESIDU_TAPS(&x[i])) + vo_mult32(a[0], x[i]);
+        y[i] = extract_h(L_add(L_shl2(s[0], 5), 0x8000));
+    }
+#undef RESIDU_TAPS
+    return 1;
+}
+
+Word32 Pred_lt4_x86(Word16 x[], Word16 coef[], Word16 exc[], Word16 T0, Word16 L_subfr)
+{
+    Word32 j, k;
+    Word32 s[4];
+    __m128i c0, c1, c2, c3;
+
+    /* Four outputs are computed before any is stored, so none of them may
+     * read an exc[] sample written in the same group. */
+    if (T0 < 4 + 16 || voAMRWB_GetSimdLevel() == VOAMRWB_SIMD_NONE)
+        return 0;
+
+    c0 = LOADU(coef);
+    c1 = LOADU(coef + 8);
+    c2 = LOADU(coef + 16);
+    c3 = LOADU(coef + 24);
+
+#define PRED_TAPS(p) \
+    _mm_add_epi32( \
+        _mm_add_epi32(_mm_madd_epi16(LOADU(p), c0), _mm_madd_epi16(LOADU((p) + 8), c1)), \
+        _mm_add_epi32(_mm_madd_epi16(LOADU((p) + 16), c2), _mm_madd_epi16(LOADU((p) + 24), c3)))
+
+    for (j = 0; j + 4 <= L_subfr; j += 4)
+    {
+        _mm_storeu_si128((__m128i *)s, hsum4(
+                    PRED_TAPS(&x[j]), PRED_TAPS(&x[j + 1]),
+                    PRED_TAPS(&x[j + 2]), PRED_TAPS(&x[j + 3])));
+        for (k = 0; k < 4; k++)
+        {
+            exc[j + k] = extract_h(L_add(L_shl2(s[k], 2), 0x8000));
+        }
+    }
+    for (; j < L_subfr; j++)
+    {
+        s[0] = hsum1(PRED_TAPS(&x[j]));
+        exc[j] = extract_h(L_add(L_shl2(s[0], 2), 0x8000));
+    }
+#undef PRED_TAPS
+    return 1;
+}
+
+Word32 Syn_filt_x86(Word16 a[], Word16 x[], Word16 y[], Word16 lg, Word16 mem[], Word16 update)
+{
+    Word16 y_buf[L_SUBFR16k + M16k];
+    Word16 ar[M];
+    Word32 i, a0, L_tmp;
+    __m128i ar_lo, ar_hi;
+
+    if (voAMRWB_GetSimdLevel() == VOAMRWB_SIMD_NONE)
+        return 0;
+
+    for (i = 0; i < M; i++)
+    {
+        y_buf[i] = mem[i];
+        ar[i] = a[M - i];
+    }
+    ar_lo = LOADU(ar);
+    ar_hi = LOADU(ar + 8);
+    a0 = (a[0] >> 1);                     /* input / 2 */
+
+    /* The recursion needs y[i - 1] before y[i], so only the taps are vectorized. */
+    for (i = 0; i < lg; i++)
+    {
+        L_tmp = vo_mult32(a0, x[i]);
+        L_tmp -= hsum1(_mm_add_epi32(_mm_madd_epi16(LOADU(&y_buf[i]), ar_lo),
+                                     _mm_madd_epi16(LOADU(&y_buf[i + 8]), ar_hi)));
+        L_tmp = L_shl2(L_tmp, 4);
+        y[i] = y_buf[M + i] = extract_h(L_add(L_tmp, 0x8000));
+    }
+    if (update)
+        for (i = 0; i < M; i++)
+        {
+            mem[i] = y_buf[lg + i];
+        }
+    return 1;
+}
+
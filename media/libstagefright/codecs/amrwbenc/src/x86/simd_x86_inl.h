@@ -0,0 +1,60 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/***********************************************************************
+*       File: simd_x86_inl.h                                           *
+*                                                                      *
+*       Description: Inline SSE2 helpers shared by the x86 kernels     *
+*                                                                      *
+************************************************************************/
+
+#ifndef __SIMD_X86_INL_H__
+#define __SIMD_X86_INL_H__
+
+#include <emmintrin.h>
+#include "typedef.h"
+
+#define LOADU(p)        _mm_loadu_si128((const __m128i *)(p))
+
+/* Four 32-bit partial sums of a[i] * b[i] over n (multiple of 8) samples. */
+static __inline __m128i madd_n(const Word16 *a, const Word16 *b, Word32 n)
+{
+    __m128i acc = _mm_madd_epi16(LOADU(a), LOADU(b));
+    Word32 i;
+    for (i = 8; i < n; i += 8)
+    {
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(LOADU(a + i), LOADU(b + i)));
+    }
+    return acc;
+}
+
+/* Returns { sum(a), sum(b), sum(c), sum(d) } of four 4-lane vectors. */
+static __inline __m128i hsum4(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    __m128i ab = _mm_add_epi32(_mm_unpacklo_epi32(a, b), _mm_unpackhi_epi32(a, b));
+    __m128i cd = _mm_add_epi32(_mm_unpacklo_epi32(c, d), _mm_unpackhi_epi32(c, d));
+    return _mm_add_epi32(_mm_unpacklo_epi64(ab, cd), _mm_unpackhi_epi64(ab, cd));
+}
+
+static __inline Word32 hsum1(__m128i a)
+{
+    a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+    a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(a);
+}
+
+#endif  //__SIMD_X86_INL_H__
+
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs many independent AMR-WB encoders concurrently and reports how many
+// real-time channels one core sustains (encoded audio seconds per CPU second).
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "voAMRWB.h"
+#include "cmnMemory.h"
+#ifdef X86_SIMD
+#include "amrwb_simd.h"
+#endif
+
+enum {
+    kSampleRate = 16000,
+    kSamplesPerFrame = 320,
+    kInputFrameSize = kSamplesPerFrame * sizeof(int16_t),
+    kOutputBufferSize = 1024,
+};
+
+struct StreamContext {
+    const std::vector<int16_t> *pcm;
+    int mode;
+    int dtx;
+    int frames;
+    double cpuSeconds;
+    size_t outputBytes;
+    bool ok;
+};
+
+static double nowSeconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *encodeStream(void *arg) {
+    StreamContext *ctx = (StreamContext *)arg;
+    ctx->ok = false;
+
+    VO_AUDIO_CODECAPI api;
+    if (voGetAMRWBEncAPI(&api) != VO_ERR_NONE) {
+        return NULL;
+    }
+
+    VO_MEM_OPERATOR memOperator;
+    memOperator.Alloc = cmnMemAlloc;
+    memOperator.Copy = cmnMemCopy;
+    memOperator.Free = cmnMemFree;
+    memOperator.Set = cmnMemSet;
+    memOperator.Check = cmnMemCheck;
+
+    VO_CODEC_INIT_USERDATA userData;
+    memset(&userData, 0, sizeof(userData));
+    userData.memflag = VO_IMF_USERMEMOPERATOR;
+    userData.memData = (VO_PTR)&memOperator;
+
+    VO_HANDLE handle;
+    if (api.Init(&handle, VO_AUDIO_CodingAMRWB, &userData) != VO_ERR_NONE) {
+        return NULL;
+    }
+    int frameType = VOAMRWB_RFC3267;
+    api.SetParam(handle, VO_PID_AMRWB_FRAMETYPE, &frameType);
+    api.SetParam(handle, VO_PID_AMRWB_MODE, &ctx->mode);
+    api.SetParam(handle, VO_PID_AMRWB_DTX, &ctx->dtx);
+
+    const size_t inputFrames = ctx->pcm->size() / kSamplesPerFrame;
+    uint8_t outBuf[kOutputBufferSize];
+    double start = nowSeconds(CLOCK_THREAD_CPUTIME_ID);
+    ctx->outputBytes = 0;
+    for (int i = 0; i < ctx->frames; ++i) {
+        VO_CODECBUFFER inputData;
+        memset(&inputData, 0, sizeof(inputData));
+        inputData.Buffer = (unsigned char *)&(*ctx->pcm)[(i % inputFrames) * kSamplesPerFrame];
+        inputData.Length = kInputFrameSize;
+        api.SetInputData(handle, &inputData);
+
+        VO_CODECBUFFER outputData;
+        memset(&outputData, 0, sizeof(outputData));
+        outputData.Buffer = outBuf;
+        outputData.Length = sizeof(outBuf);
+        VO_AUDIO_OUTPUTINFO outputInfo;
+        memset(&outputInfo, 0, sizeof(outputInfo));
+        VO_U32 ret = api.GetOutputData(handle, &outputData, &outputInfo);
+        if (ret != VO_ERR_NONE && ret != VO_ERR_INPUT_BUFFER_SMALL) {
+            api.Uninit(handle);
+            return NULL;
+        }
+        ctx->outputBytes += outputData.Length;
+    }
+    ctx->cpuSeconds = nowSeconds(CLOCK_THREAD_CPUTIME_ID) - start;
+
+    api.Uninit(handle);
+    ctx->ok = true;
+    return NULL;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n streams] [-s seconds] [-m mode] [-d] [-c]\n"
+                    "\t-n number of concurrent encoders (default: number of cores)\n"
+                    "\t-s seconds of audio per encoder (default: 60)\n"
+                    "\t-m AMR-WB mode 0..8 (default: 8)\n"
+                    "\t-d enable DTX\n"
+                    "\t-c force the C reference kernels\n", me);
+}
+
+int main(int argc, char *argv[]) {
+    int streams = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int seconds = 60;
+    int mode = VOAMRWB_MD2385;
+    int dtx = 0;
+    bool forceC = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:s:m:dch")) >= 0) {
+        switch (res) {
+            case 'n': streams = atoi(optarg); break;
+            case 's': seconds = atoi(optarg); break;
+            case 'm': mode = atoi(optarg); break;
+            case 'd': dtx = 1; break;
+            case 'c': forceC = true; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (streams <= 0 || seconds <= 0 || mode < VOAMRWB_MD66 || mode > VOAMRWB_MD2385) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#ifdef X86_SIMD
+    if (forceC) {
+        voAMRWB_SetSimdLevel(VOAMRWB_SIMD_NONE);
+    }
+    printf("SIMD level %d\n", voAMRWB_GetSimdLevel());
+#else
+    (void)forceC;
+#endif
+
+    // Ten seconds of harmonic signal with a gliding pitch, looped by each stream.
+    std::vector<int16_t> pcm(10 * kSampleRate);
+    double phase = 0.0;
+    for (size_t i = 0; i < pcm.size(); ++i) {
+        phase += 2.0 * M_PI * (120.0 + 60.0 * sin(i / 8000.0)) / kSampleRate;
+        pcm[i] = (int16_t)(8000.0 * (sin(phase) + 0.4 * sin(2 * phase) + 0.2 * sin(5 * phase)));
+    }
+
+    std::vector<StreamContext> contexts(streams);
+    std::vector<pthread_t> threads(streams);
+    double wallStart = nowSeconds(CLOCK_MONOTONIC);
+    for (int i = 0; i < streams; ++i) {
+        contexts[i].pcm = &pcm;
+        contexts[i].mode = mode;
+        contexts[i].dtx = dtx;
+        contexts[i].frames = seconds * kSampleRate / kSamplesPerFrame;
+        pthread_create(&threads[i], NULL, encodeStream, &contexts[i]);
+    }
+    double cpuSeconds = 0.0;
+    bool ok = true;
+    for (int i = 0; i < streams; ++i) {
+        pthread_join(threads[i], NULL);
+        cpuSeconds += contexts[i].cpuSeconds;
+        ok = ok && contexts[i].ok;
+    }
+    double wallSeconds = nowSeconds(CLOCK_MONOTONIC) - wallStart;
+    if (!ok) {
+        fprintf(stderr, "encoder error\n");
+        return EXIT_FAILURE;
+    }
+
+    double audioSeconds = (double)streams * seconds;
+    printf("%d streams x %d s, mode %d%s\n", streams, seconds, mode, dtx ? ", DTX" : "");
+    printf("wall %.2f s, cpu %.2f s\n", wallSeconds, cpuSeconds);
+    printf("throughput:  %.1f audio-seconds per wall-second\n", audioSeconds / wallSeconds);
+    printf("density:     %.1f real-time channels per core\n", audioSeconds / cpuSeconds);
+    printf("per frame:   %.2f us cpu\n", cpuSeconds * 1e6 / (audioSeconds * kSampleRate / kSamplesPerFrame));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Encodes the same input with the C reference and with the x86 SIMD kernels
+// for every mode, with and without DTX, and checks that the bitstreams match.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "voAMRWB.h"
+#include "cmnMemory.h"
+#include "amrwb_simd.h"
+
+enum {
+    kSamplesPerFrame = 320,
+    kInputFrameSize = kSamplesPerFrame * sizeof(int16_t),
+    kOutputBufferSize = 1024,
+    kNumModes = 9,
+    kSyntheticFrames = 1500,  // 30 seconds
+};
+
+// Voiced segments with a gliding pitch, unvoiced noise, silence (for DTX) and
+// clipped bursts that push the saturating kernels onto their C fallback.
+static void makeSyntheticInput(std::vector<int16_t> *pcm) {
+    pcm->resize(kSyntheticFrames * kSamplesPerFrame);
+    uint32_t seed = 0x1234567;
+    double phase = 0.0;
+    for (size_t i = 0; i < pcm->size(); ++i) {
+        size_t frame = i / kSamplesPerFrame;
+        seed = seed * 1103515245 + 12345;
+        double noise = ((int32_t)(seed >> 8) & 0xffff) / 65536.0 - 0.5;
+        double f0 = 100.0 + 80.0 * sin(i / 16000.0);
+        phase += 2.0 * M_PI * f0 / 16000.0;
+        double v;
+        switch ((frame / 50) % 4) {
+            case 0:
+                v = 9000.0 * (sin(phase) + 0.5 * sin(2 * phase) + 0.25 * sin(3 * phase));
+                break;
+            case 1:
+                v = 6000.0 * noise;
+                break;
+            case 2:
+                v = 4.0 * noise;
+                break;
+            default:
+                v = 60000.0 * sin(phase) + 20000.0 * noise;
+                break;
+        }
+        if (v > 32767.0) v = 32767.0;
+        if (v < -32768.0) v = -32768.0;
+        (*pcm)[i] = (int16_t)v;
+    }
+}
+
+static bool encode(const std::vector<int16_t> &pcm, int mode, int dtx,
+                   std::vector<uint8_t> *out) {
+    VO_AUDIO_CODECAPI api;
+    if (voGetAMRWBEncAPI(&api) != VO_ERR_NONE) {
+        return false;
+    }
+
+    VO_MEM_OPERATOR memOperator;
+    memOperator.Alloc = cmnMemAlloc;
+    memOperator.Copy = cmnMemCopy;
+    memOperator.Free = cmnMemFree;
+    memOperator.Set = cmnMemSet;
+    memOperator.Check = cmnMemCheck;
+
+    VO_CODEC_INIT_USERDATA userData;
+    memset(&userData, 0, sizeof(userData));
+    userData.memflag = VO_IMF_USERMEMOPERATOR;
+    userData.memData = (VO_PTR)&memOperator;
+
+    VO_HANDLE handle;
+    if (api.Init(&handle, VO_AUDIO_CodingAMRWB, &userData) != VO_ERR_NONE) {
+        return false;
+    }
+
+    int frameType = VOAMRWB_RFC3267;
+    api.SetParam(handle, VO_PID_AMRWB_FRAMETYPE, &frameType);
+    api.SetParam(handle, VO_PID_AMRWB_MODE, &mode);
+    api.SetParam(handle, VO_PID_AMRWB_DTX, &dtx);
+
+    out->clear();
+    uint8_t outBuf[kOutputBufferSize];
+    for (size_t offset = 0; offset + kSamplesPerFrame <= pcm.size();
+            offset += kSamplesPerFrame) {
+        VO_CODECBUFFER inputData;
+        memset(&inputData, 0, sizeof(inputData));
+        inputData.Buffer = (unsigned char *)&pcm[offset];
+        inputData.Length = kInputFrameSize;
+        api.SetInputData(handle, &inputData);
+
+        VO_CODECBUFFER outputData;
+        memset(&outputData, 0, sizeof(outputData));
+        outputData.Buffer = outBuf;
+        outputData.Length = sizeof(outBuf);
+        VO_AUDIO_OUTPUTINFO outputInfo;
+        memset(&outputInfo, 0, sizeof(outputInfo));
+        VO_U32 ret = api.GetOutputData(handle, &outputData, &outputInfo);
+        if (ret != VO_ERR_NONE && ret != VO_ERR_INPUT_BUFFER_SMALL) {
+            api.Uninit(handle);
+            return false;
+        }
+        out->insert(out->end(), outBuf, outBuf + outputData.Length);
+    }
+
+    api.Uninit(handle);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<int16_t> pcm;
+    if (argc == 2) {
+        // 16 kHz mono 16-bit raw PCM.
+        FILE *fp = fopen(argv[1], "rb");
+        if (fp == NULL) {
+            fprintf(stderr, "Could not open %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        int16_t frame[kSamplesPerFrame];
+        while (fread(frame, kInputFrameSize, 1, fp) == 1) {
+            pcm.insert(pcm.end(), frame, frame + kSamplesPerFrame);
+        }
+        fclose(fp);
+    } else if (argc == 1) {
+        makeSyntheticInput(&pcm);
+    } else {
+        fprintf(stderr, "Usage %s [<16 kHz raw pcm file>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    voAMRWB_SetSimdLevel(VOAMRWB_SIMD_AVX2);
+    int simdLevel = voAMRWB_GetSimdLevel();
+    printf("SIMD level %d, %zu frames\n", simdLevel, pcm.size() / kSamplesPerFrame);
+    if (simdLevel == VOAMRWB_SIMD_NONE) {
+        printf("No SIMD support on this CPU, nothing to compare\n");
+        return EXIT_SUCCESS;
+    }
+
+    int failures = 0;
+    for (int level = VOAMRWB_SIMD_SSE2; level <= simdLevel; ++level) {
+        for (int mode = 0; mode < kNumModes; ++mode) {
+            for (int dtx = 0; dtx <= 1; ++dtx) {
+                std::vector<uint8_t> reference, simd;
+                voAMRWB_SetSimdLevel(VOAMRWB_SIMD_NONE);
+                bool ok = encode(pcm, mode, dtx, &reference);
+                voAMRWB_SetSimdLevel(level);
+                ok = ok && encode(pcm, mode, dtx, &simd);
+                if (!ok) {
+                    fprintf(stderr, "level %d mode %d dtx %d: encoder error\n",
+                            level, mode, dtx);
+                    ++failures;
+                } else if (reference != simd) {
+                    size_t i = 0;
+                    while (i < reference.size() && i < simd.size()
+                            && reference[i] == simd[i]) {
+                        ++i;
+                    }
+                    fprintf(stderr, "level %d mode %d dtx %d: bitstreams differ at byte %zu\n",
+                            level, mode, dtx, i);
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
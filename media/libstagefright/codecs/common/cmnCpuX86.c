@@ -0,0 +1,57 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		cmnCpuX86.c
+
+	Content:	x86 instruction set detection shared by the encoders
+
+*******************************************************************************/
+#include "cmnCpuX86.h"
+
+#include <cpuid.h>
+#include <pthread.h>
+
+static pthread_once_t gDetectOnce = PTHREAD_ONCE_INIT;
+static int gFeatures = 0;
+
+static void detect_features(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int xcr0_lo, xcr0_hi;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & bit_SSE2))
+		return;
+	gFeatures |= CMN_X86_SSE2;
+
+	if (ecx & bit_SSE4_1)
+		gFeatures |= CMN_X86_SSE41;
+
+	/* AVX2 also needs the OS to save the YMM state (XCR0 bits 1 and 2). */
+	if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) || __get_cpuid_max(0, 0) < 7)
+		return;
+	__asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	if ((xcr0_lo & 0x6) != 0x6)
+		return;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (ebx & bit_AVX2)
+		gFeatures |= CMN_X86_AVX2;
+}
+
+int cmnCpuX86Features (void)
+{
+	pthread_once(&gDetectOnce, detect_features);
+	return gFeatures;
+}
@@ -0,0 +1,44 @@
+/*
+ ** Copyright (C) 2016 The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		cmnCpuX86.h
+
+	Content:	x86 instruction set detection shared by the encoders
+
+*******************************************************************************/
+
+#ifndef __cmnCpuX86_H__
+#define __cmnCpuX86_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define CMN_X86_SSE2		0x01
+#define CMN_X86_SSE41		0x02
+#define CMN_X86_AVX2		0x04
+
+/**
+ * Instruction sets usable on this CPU
+ * \return CMN_X86_* flags. AVX2 is only reported if the OS saves the YMM state.
+ */
+int	cmnCpuX86Features (void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __cmnCpuX86_H__ */
@@ -3,6 +3,7 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:=                     \
         ColorConverter.cpp            \
+        RowConverters.cpp             \
         SoftwareRenderer.cpp
 
 LOCAL_C_INCLUDES := \
@@ -20,3 +21,30 @@ LOCAL_SANITIZE := signed-integer-overflow
 LOCAL_MODULE:= libstagefright_color_conversion
 
 include $(BUILD_STATIC_LIBRARY)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tests/ColorConverterBench.cpp
+
+LOCAL_C_INCLUDES := \
+        $(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_STATIC_LIBRARIES := \
+        libstagefright_color_conversion \
+        libyuv_static
+
+LOCAL_SHARED_LIBRARIES := \
+        libstagefright_foundation \
+        libutils \
+        liblog
+
+LOCAL_CFLAGS += -Werror
+LOCAL_CLANG := true
+
+LOCAL_MODULE := color_conversion_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
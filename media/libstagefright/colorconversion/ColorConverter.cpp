@@ -22,17 +22,35 @@
 #include <media/stagefright/ColorConverter.h>
 #include <media/stagefright/MediaErrors.h>
 
+#include <pthread.h>
+#include <unistd.h>
+
 #include "libyuv/convert_from.h"
 
+#include "RowConverters.h"
+
 #define USE_LIBYUV
 
 namespace android {
 
+// frames are split into bands of at least this many pixels that are converted in parallel
+static const size_t kMinPixelsPerBand = 1920 * 1080;
+static const size_t kMaxBands = 4;
+
+struct ColorConverter::Band {
+    const ColorConverter *mConverter;
+    const BitmapParams *mSrc;
+    const BitmapParams *mDst;
+    size_t mRowBegin;
+    size_t mRowEnd;
+};
+
 ColorConverter::ColorConverter(
         OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to)
     : mSrcFormat(from),
       mDstFormat(to),
-      mClip(NULL) {
+      mClip(NULL),
+      mUseReference(false) {
 }
 
 ColorConverter::~ColorConverter() {
@@ -41,11 +59,12 @@ ColorConverter::~ColorConverter() {
 }
 
 bool ColorConverter::isValid() const {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
+    if (mDstFormat != OMX_COLOR_Format16bitRGB565
+            && (mUseReference || mDstFormat != OMX_COLOR_Format32BitRGBA8888)) {
         return false;
     }
 
-    switch (mSrcFormat) {
+    switch ((int)mSrcFormat) {
         case OMX_COLOR_FormatYUV420Planar:
         case OMX_COLOR_FormatCbYCrY:
         case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
@@ -53,11 +72,18 @@ bool ColorConverter::isValid() const {
         case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
             return true;
 
+        case kColorFormatYUVP010:
+            return !mUseReference;
+
         default:
             return false;
     }
 }
 
+void ColorConverter::setUseReferenceConverters(bool enable) {
+    mUseReference = enable;
+}
+
 ColorConverter::BitmapParams::BitmapParams(
         void *bits,
         size_t width, size_t height,
@@ -89,10 +115,6 @@ status_t ColorConverter::convert(
         size_t dstWidth, size_t dstHeight,
         size_t dstCropLeft, size_t dstCropTop,
         size_t dstCropRight, size_t dstCropBottom) {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
-        return ERROR_UNSUPPORTED;
-    }
-
     BitmapParams src(
             const_cast<void *>(srcBits),
             srcWidth, srcHeight,
@@ -103,6 +125,243 @@ status_t ColorConverter::convert(
             dstWidth, dstHeight,
             dstCropLeft, dstCropTop, dstCropRight, dstCropBottom);
 
+    if (mUseReference) {
+        return convertReference(src, dst);
+    }
+    return convertRows(src, dst);
+}
+
+status_t ColorConverter::convertRows(
+        const BitmapParams &src, const BitmapParams &dst) {
+    if (!isValid()) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    // the destination may be smaller than the source, in which case the frame is scaled down
+    if (!((src.mCropLeft & 1) == 0
+            && dst.cropWidth() <= src.cropWidth()
+            && dst.cropHeight() <= src.cropHeight())) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    size_t height = dst.cropHeight();
+    size_t numBands = dst.cropWidth() * height / kMinPixelsPerBand;
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCpus > 0 && numBands > (size_t)numCpus) {
+        numBands = numCpus;
+    }
+    if (numBands > kMaxBands) {
+        numBands = kMaxBands;
+    }
+
+    if (numBands <= 1) {
+        convertRowRange(src, dst, 0, height);
+        return OK;
+    }
+
+    // bands start on even rows so that they begin on a new chroma row
+    size_t rowsPerBand = ((height + numBands - 1) / numBands + 1) & ~1;
+
+    Band bands[kMaxBands];
+    pthread_t threads[kMaxBands];
+    bool started[kMaxBands];
+    for (size_t i = 0; i < numBands; ++i) {
+        Band &band = bands[i];
+        band.mConverter = this;
+        band.mSrc = &src;
+        band.mDst = &dst;
+        band.mRowBegin = i * rowsPerBand < height ? i * rowsPerBand : height;
+        band.mRowEnd = band.mRowBegin + rowsPerBand < height ? band.mRowBegin + rowsPerBand : height;
+
+        // the calling thread converts the first band itself
+        started[i] = i > 0 && band.mRowBegin < band.mRowEnd
+                && pthread_create(&threads[i], NULL, BandThreadWrapper, &band) == 0;
+    }
+
+    for (size_t i = 0; i < numBands; ++i) {
+        if (!started[i]) {
+            convertRowRange(src, dst, bands[i].mRowBegin, bands[i].mRowEnd);
+        }
+    }
+
+    for (size_t i = 0; i < numBands; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    return OK;
+}
+
+// static
+void *ColorConverter::BandThreadWrapper(void *me) {
+    Band *band = static_cast<Band *>(me);
+    band->mConverter->convertRowRange(
+            *band->mSrc, *band->mDst, band->mRowBegin, band->mRowEnd);
+    return NULL;
+}
+
+void ColorConverter::getSourceRow(
+        const BitmapParams &src, size_t row,
+        uint8_t *tmp_y, uint8_t *tmp_u, uint8_t *tmp_v,
+        const uint8_t **src_y, const uint8_t **src_u, const uint8_t **src_v,
+        bool *swapRB) const {
+    const uint8_t *srcBits = (const uint8_t *)src.mBits;
+    size_t width = src.cropWidth();
+    size_t chromaWidth = (width + 1) / 2;
+    size_t y = src.mCropTop + row;
+
+    *src_y = tmp_y;
+    *src_u = tmp_u;
+    *src_v = tmp_v;
+    *swapRB = false;
+
+    switch ((int)mSrcFormat) {
+        case OMX_COLOR_FormatYUV420Planar:
+        {
+            *src_y = srcBits + y * src.mWidth + src.mCropLeft;
+            *src_u = srcBits + src.mWidth * src.mHeight
+                + (y / 2) * (src.mWidth / 2) + src.mCropLeft / 2;
+            *src_v = *src_u + (src.mWidth / 2) * (src.mHeight / 2);
+            break;
+        }
+
+        case OMX_COLOR_FormatYUV420SemiPlanar:
+        case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
+        {
+            *src_y = srcBits + y * src.mWidth + src.mCropLeft;
+            const uint8_t *src_uv = srcBits + src.mWidth * src.mHeight
+                + (y / 2) * src.mWidth + src.mCropLeft;
+
+            // these are converted with V first / blue in the high bits, respectively,
+            // as they always have been
+            if (mSrcFormat == OMX_COLOR_FormatYUV420SemiPlanar) {
+                SplitPairsRow(src_uv, tmp_v, tmp_u, chromaWidth);
+            } else {
+                SplitPairsRow(src_uv, tmp_u, tmp_v, chromaWidth);
+            }
+            *swapRB = true;
+            break;
+        }
+
+        case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
+        {
+            // luma starts at the crop origin, chroma after the padded luma plane
+            *src_y = srcBits + row * src.mWidth;
+            const uint8_t *src_uv = srcBits
+                + src.mWidth * (src.mHeight - src.mCropTop / 2) + (row / 2) * src.mWidth;
+            SplitPairsRow(src_uv, tmp_u, tmp_v, chromaWidth);
+            break;
+        }
+
+        case OMX_COLOR_FormatCbYCrY:
+        {
+            SplitCbYCrYRow(srcBits + (y * src.mWidth + src.mCropLeft) * 2,
+                    tmp_y, tmp_u, tmp_v, width);
+            break;
+        }
+
+        case kColorFormatYUVP010:
+        {
+            const uint16_t *srcWords = (const uint16_t *)src.mBits;
+            Narrow16Row(srcWords + y * src.mWidth + src.mCropLeft, tmp_y, width);
+            SplitPairs16Row(srcWords + src.mWidth * src.mHeight
+                    + (y / 2) * src.mWidth + src.mCropLeft, tmp_u, tmp_v, chromaWidth);
+            break;
+        }
+
+        default:
+            TRESPASS();
+    }
+}
+
+void ColorConverter::convertRowRange(
+        const BitmapParams &src, const BitmapParams &dst,
+        size_t rowBegin, size_t rowEnd) const {
+    size_t srcWidth = src.cropWidth();
+    size_t srcHeight = src.cropHeight();
+    size_t srcChromaWidth = (srcWidth + 1) / 2;
+    size_t width = dst.cropWidth();
+    size_t height = dst.cropHeight();
+    size_t chromaWidth = (width + 1) / 2;
+    bool scaled = width != srcWidth || height != srcHeight;
+    size_t bpp = mDstFormat == OMX_COLOR_Format32BitRGBA8888 ? 4 : 2;
+
+    uint8_t *dstBits = (uint8_t *)dst.mBits
+        + ((dst.mCropTop + rowBegin) * dst.mWidth + dst.mCropLeft) * bpp;
+
+#ifdef USE_LIBYUV
+    if (mSrcFormat == OMX_COLOR_FormatYUV420Planar
+            && mDstFormat == OMX_COLOR_Format16bitRGB565 && !scaled) {
+        const uint8_t *src_y, *src_u, *src_v;
+        bool swapRB;
+        getSourceRow(src, rowBegin, NULL, NULL, NULL, &src_y, &src_u, &src_v, &swapRB);
+
+        libyuv::I420ToRGB565(src_y, src.mWidth, src_u, src.mWidth / 2, src_v, src.mWidth / 2,
+                dstBits, dst.mWidth * 2, width, rowEnd - rowBegin);
+        return;
+    }
+#endif
+
+    // deinterleaved source rows, followed by the sampled rows when scaling
+    size_t scratchSize = srcWidth + 2 * srcChromaWidth;
+    if (scaled) {
+        scratchSize += width + 2 * chromaWidth;
+    }
+    uint8_t *scratch = new uint8_t[scratchSize];
+    uint8_t *tmp_y = scratch;
+    uint8_t *tmp_u = tmp_y + srcWidth;
+    uint8_t *tmp_v = tmp_u + srcChromaWidth;
+    uint8_t *scaled_y = tmp_v + srcChromaWidth;
+    uint8_t *scaled_u = scaled_y + width;
+    uint8_t *scaled_v = scaled_u + chromaWidth;
+
+    for (size_t row = rowBegin; row < rowEnd; ++row) {
+        const uint8_t *src_y, *src_u, *src_v;
+        bool swapRB;
+
+        if (!scaled) {
+            getSourceRow(src, row, tmp_y, tmp_u, tmp_v, &src_y, &src_u, &src_v, &swapRB);
+        } else {
+            // point-sample at the center of each destination pixel (pixel pair for chroma)
+            getSourceRow(src, (2 * row + 1) * srcHeight / (2 * height),
+                    tmp_y, tmp_u, tmp_v, &src_y, &src_u, &src_v, &swapRB);
+
+            for (size_t x = 0; x < width; ++x) {
+                scaled_y[x] = src_y[(2 * x + 1) * srcWidth / (2 * width)];
+            }
+            for (size_t x = 0; x < chromaWidth; ++x) {
+                size_t srcX = (2 * x + 1) * srcWidth / width;
+                if (srcX >= srcWidth) {
+                    srcX = srcWidth - 1;
+                }
+                scaled_u[x] = src_u[srcX / 2];
+                scaled_v[x] = src_v[srcX / 2];
+            }
+
+            src_y = scaled_y;
+            src_u = scaled_u;
+            src_v = scaled_v;
+        }
+
+        if (mDstFormat == OMX_COLOR_Format32BitRGBA8888) {
+            YUVToRGBA8888Row(src_y, src_u, src_v, dstBits, width, swapRB);
+        } else {
+            YUVToRGB565Row(src_y, src_u, src_v, (uint16_t *)dstBits, width, swapRB);
+        }
+
+        dstBits += dst.mWidth * bpp;
+    }
+
+    delete[] scratch;
+}
+
+status_t ColorConverter::convertReference(
+        const BitmapParams &src, const BitmapParams &dst) {
+    if (!isValid()) {
+        return ERROR_UNSUPPORTED;
+    }
+
     status_t err;
 
     switch (mSrcFormat) {
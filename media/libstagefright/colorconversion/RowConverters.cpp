@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RowConverters.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define USE_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace android {
+
+// B = 298/256 * (Y - 16) + 517/256 * (U - 128)
+// G = 298/256 * (Y - 16) - 208/256 * (V - 128) - 100/256 * (U - 128)
+// R = 298/256 * (Y - 16) + 409/256 * (V - 128)
+//
+// The vector versions shift right by 8 instead of dividing by 256. The two
+// only differ for negative values, which are clamped to 0 either way.
+
+static inline uint8_t clamp8(signed x) {
+    return x < 0 ? 0 : x > 255 ? 255 : (uint8_t)x;
+}
+
+static inline void yuvToRGB(
+        signed y, signed u, signed v, uint8_t *r, uint8_t *g, uint8_t *b) {
+    signed tmp = (y - 16) * 298;
+    u -= 128;
+    v -= 128;
+
+    *b = clamp8((tmp + u * 517) / 256);
+    *g = clamp8((tmp - v * 208 - u * 100) / 256);
+    *r = clamp8((tmp + v * 409) / 256);
+}
+
+static void yuvToRGB565RowC(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint16_t *dst, size_t x, size_t width, bool swapRB) {
+    for (; x < width; ++x) {
+        uint8_t r, g, b;
+        yuvToRGB(y[x], u[x / 2], v[x / 2], &r, &g, &b);
+        if (swapRB) {
+            uint8_t tmp = r;
+            r = b;
+            b = tmp;
+        }
+        dst[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+static void yuvToRGBA8888RowC(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint8_t *dst, size_t x, size_t width, bool swapRB) {
+    for (; x < width; ++x) {
+        uint8_t r, g, b;
+        yuvToRGB(y[x], u[x / 2], v[x / 2], &r, &g, &b);
+        dst[4 * x] = swapRB ? b : r;
+        dst[4 * x + 1] = g;
+        dst[4 * x + 2] = swapRB ? r : b;
+        dst[4 * x + 3] = 0xff;
+    }
+}
+
+#if defined(USE_NEON)
+
+static inline uint8x8_t narrowAndClamp(int32x4_t lo, int32x4_t hi) {
+    return vqmovun_s16(vcombine_s16(vshrn_n_s32(lo, 8), vshrn_n_s32(hi, 8)));
+}
+
+// Converts 16 pixels; even and odd pixels are returned separately.
+static inline void yuvToRGB16(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint8x8_t r[2], uint8x8_t g[2], uint8x8_t b[2]) {
+    uint8x8x2_t yy = vld2_u8(y);
+    int16x8_t uu = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u))), vdupq_n_s16(128));
+    int16x8_t vv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v))), vdupq_n_s16(128));
+
+    int32x4_t ubLo = vmull_n_s16(vget_low_s16(uu), 517);
+    int32x4_t ubHi = vmull_n_s16(vget_high_s16(uu), 517);
+    int32x4_t uvgLo = vmlal_n_s16(vmull_n_s16(vget_low_s16(uu), -100), vget_low_s16(vv), -208);
+    int32x4_t uvgHi = vmlal_n_s16(vmull_n_s16(vget_high_s16(uu), -100), vget_high_s16(vv), -208);
+    int32x4_t vrLo = vmull_n_s16(vget_low_s16(vv), 409);
+    int32x4_t vrHi = vmull_n_s16(vget_high_s16(vv), 409);
+
+    for (int k = 0; k < 2; ++k) {
+        int16x8_t ys = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yy.val[k])), vdupq_n_s16(16));
+        int32x4_t yLo = vmull_n_s16(vget_low_s16(ys), 298);
+        int32x4_t yHi = vmull_n_s16(vget_high_s16(ys), 298);
+
+        b[k] = narrowAndClamp(vaddq_s32(yLo, ubLo), vaddq_s32(yHi, ubHi));
+        g[k] = narrowAndClamp(vaddq_s32(yLo, uvgLo), vaddq_s32(yHi, uvgHi));
+        r[k] = narrowAndClamp(vaddq_s32(yLo, vrLo), vaddq_s32(yHi, vrHi));
+    }
+}
+
+static inline uint16x8_t packRGB565(uint8x8_t hi, uint8x8_t g, uint8x8_t lo) {
+    uint16x8_t out = vandq_u16(vshll_n_u8(hi, 8), vdupq_n_u16(0xf800));
+    out = vorrq_u16(out, vandq_u16(vshrq_n_u16(vshll_n_u8(g, 8), 5), vdupq_n_u16(0x07e0)));
+    return vorrq_u16(out, vshrq_n_u16(vmovl_u8(lo), 3));
+}
+
+void YUVToRGB565Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint16_t *dst, size_t width, bool swapRB) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t r[2], g[2], b[2];
+        yuvToRGB16(y + x, u + x / 2, v + x / 2, r, g, b);
+
+        uint16x8x2_t out;
+        for (int k = 0; k < 2; ++k) {
+            out.val[k] = swapRB ? packRGB565(b[k], g[k], r[k]) : packRGB565(r[k], g[k], b[k]);
+        }
+        vst2q_u16(dst + x, out);
+    }
+    yuvToRGB565RowC(y, u, v, dst, x, width, swapRB);
+}
+
+void YUVToRGBA8888Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint8_t *dst, size_t width, bool swapRB) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t r[2], g[2], b[2];
+        yuvToRGB16(y + x, u + x / 2, v + x / 2, r, g, b);
+
+        uint8x8x2_t rr = vzip_u8(r[0], r[1]);
+        uint8x8x2_t gg = vzip_u8(g[0], g[1]);
+        uint8x8x2_t bb = vzip_u8(b[0], b[1]);
+        for (int k = 0; k < 2; ++k) {
+            uint8x8x4_t out;
+            out.val[0] = swapRB ? bb.val[k] : rr.val[k];
+            out.val[1] = gg.val[k];
+            out.val[2] = swapRB ? rr.val[k] : bb.val[k];
+            out.val[3] = vdup_n_u8(0xff);
+            vst4_u8(dst + 4 * x + 32 * k, out);
+        }
+    }
+    yuvToRGBA8888RowC(y, u, v, dst, x, width, swapRB);
+}
+
+#elif defined(USE_SSE2)
+
+// Converts 8 pixels to 16-bit R, G and B values in [0, 255].
+static inline void yuvToRGB8(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        __m128i *r, __m128i *g, __m128i *b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i kYUToB = _mm_setr_epi16(298, 517, 298, 517, 298, 517, 298, 517);
+    const __m128i kYUToG = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+    const __m128i kVToG = _mm_setr_epi16(-208, 0, -208, 0, -208, 0, -208, 0);
+    const __m128i kYVToR = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+
+    int32_t u4, v4;
+    memcpy(&u4, u, sizeof(u4));
+    memcpy(&v4, v, sizeof(v4));
+
+    __m128i yy = _mm_sub_epi16(
+            _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)y), zero), _mm_set1_epi16(16));
+    __m128i uu = _mm_sub_epi16(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero), _mm_set1_epi16(128));
+    __m128i vv = _mm_sub_epi16(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero), _mm_set1_epi16(128));
+    // each chroma sample covers two pixels
+    uu = _mm_unpacklo_epi16(uu, uu);
+    vv = _mm_unpacklo_epi16(vv, vv);
+
+    __m128i yuLo = _mm_unpacklo_epi16(yy, uu);
+    __m128i yuHi = _mm_unpackhi_epi16(yy, uu);
+    __m128i yvLo = _mm_unpacklo_epi16(yy, vv);
+    __m128i yvHi = _mm_unpackhi_epi16(yy, vv);
+    __m128i vLo = _mm_unpacklo_epi16(vv, zero);
+    __m128i vHi = _mm_unpackhi_epi16(vv, zero);
+
+    __m128i bLo = _mm_srai_epi32(_mm_madd_epi16(yuLo, kYUToB), 8);
+    __m128i bHi = _mm_srai_epi32(_mm_madd_epi16(yuHi, kYUToB), 8);
+    __m128i gLo = _mm_srai_epi32(
+            _mm_add_epi32(_mm_madd_epi16(yuLo, kYUToG), _mm_madd_epi16(vLo, kVToG)), 8);
+    __m128i gHi = _mm_srai_epi32(
+            _mm_add_epi32(_mm_madd_epi16(yuHi, kYUToG), _mm_madd_epi16(vHi, kVToG)), 8);
+    __m128i rLo = _mm_srai_epi32(_mm_madd_epi16(yvLo, kYVToR), 8);
+    __m128i rHi = _mm_srai_epi32(_mm_madd_epi16(yvHi, kYVToR), 8);
+
+    const __m128i kMax = _mm_set1_epi16(255);
+    *b = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(bLo, bHi), zero), kMax);
+    *g = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(gLo, gHi), zero), kMax);
+    *r = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(rLo, rHi), zero), kMax);
+}
+
+void YUVToRGB565Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint16_t *dst, size_t width, bool swapRB) {
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i r, g, b;
+        yuvToRGB8(y + x, u + x / 2, v + x / 2, &r, &g, &b);
+
+        __m128i hi = swapRB ? b : r;
+        __m128i lo = swapRB ? r : b;
+        __m128i out = _mm_slli_epi16(_mm_and_si128(hi, _mm_set1_epi16(0xf8)), 8);
+        out = _mm_or_si128(out, _mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xfc)), 3));
+        out = _mm_or_si128(out, _mm_srli_epi16(lo, 3));
+        _mm_storeu_si128((__m128i *)(dst + x), out);
+    }
+    yuvToRGB565RowC(y, u, v, dst, x, width, swapRB);
+}
+
+void YUVToRGBA8888Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint8_t *dst, size_t width, bool swapRB) {
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i r, g, b;
+        yuvToRGB8(y + x, u + x / 2, v + x / 2, &r, &g, &b);
+
+        __m128i first = _mm_packus_epi16(swapRB ? b : r, swapRB ? b : r);
+        __m128i third = _mm_packus_epi16(swapRB ? r : b, swapRB ? r : b);
+        __m128i rg = _mm_unpacklo_epi8(first, _mm_packus_epi16(g, g));
+        __m128i ba = _mm_unpacklo_epi8(third, _mm_set1_epi8((char)0xff));
+        _mm_storeu_si128((__m128i *)(dst + 4 * x), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *)(dst + 4 * x + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+    yuvToRGBA8888RowC(y, u, v, dst, x, width, swapRB);
+}
+
+#else
+
+void YUVToRGB565Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint16_t *dst, size_t width, bool swapRB) {
+    yuvToRGB565RowC(y, u, v, dst, 0, width, swapRB);
+}
+
+void YUVToRGBA8888Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint8_t *dst, size_t width, bool swapRB) {
+    yuvToRGBA8888RowC(y, u, v, dst, 0, width, swapRB);
+}
+
+#endif
+
+void SplitPairsRow(
+        const uint8_t *src, uint8_t *first, uint8_t *second, size_t count) {
+    size_t i = 0;
+#if defined(USE_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pairs = vld2q_u8(src + 2 * i);
+        vst1q_u8(first + i, pairs.val[0]);
+        vst1q_u8(second + i, pairs.val[1]);
+    }
+#elif defined(USE_SSE2)
+    const __m128i kLowBytes = _mm_set1_epi16(0xff);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(first + i), _mm_packus_epi16(
+                _mm_and_si128(a, kLowBytes), _mm_and_si128(b, kLowBytes)));
+        _mm_storeu_si128((__m128i *)(second + i), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; i < count; ++i) {
+        first[i] = src[2 * i];
+        second[i] = src[2 * i + 1];
+    }
+}
+
+void SplitCbYCrYRow(
+        const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, size_t width) {
+    size_t x = 0;
+#if defined(USE_NEON)
+    for (; x + 16 <= width; x += 16) {
+        uint8x8x4_t uyvy = vld4_u8(src + 2 * x);
+        uint8x8x2_t yy;
+        yy.val[0] = uyvy.val[1];
+        yy.val[1] = uyvy.val[3];
+        vst2_u8(y + x, yy);
+        vst1_u8(u + x / 2, uyvy.val[0]);
+        vst1_u8(v + x / 2, uyvy.val[2]);
+    }
+#elif defined(USE_SSE2)
+    const __m128i kLowBytes = _mm_set1_epi16(0xff);
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+        _mm_storeu_si128((__m128i *)(y + x), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+        __m128i uv = _mm_packus_epi16(_mm_and_si128(a, kLowBytes), _mm_and_si128(b, kLowBytes));
+        _mm_storel_epi64((__m128i *)(u + x / 2),
+                _mm_packus_epi16(_mm_and_si128(uv, kLowBytes), zero));
+        _mm_storel_epi64((__m128i *)(v + x / 2),
+                _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+#endif
+    for (; x < width; x += 2) {
+        u[x / 2] = src[2 * x];
+        y[x] = src[2 * x + 1];
+        v[x / 2] = src[2 * x + 2];
+        if (x + 1 < width) {
+            y[x + 1] = src[2 * x + 3];
+        }
+    }
+}
+
+void Narrow16Row(const uint16_t *src, uint8_t *dst, size_t count) {
+    size_t i = 0;
+#if defined(USE_NEON)
+    for (; i + 8 <= count; i += 8) {
+        vst1_u8(dst + i, vshrn_n_u16(vld1q_u16(src + i), 8));
+    }
+#elif defined(USE_SSE2)
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = src[i] >> 8;
+    }
+}
+
+void SplitPairs16Row(
+        const uint16_t *src, uint8_t *first, uint8_t *second, size_t count) {
+    size_t i = 0;
+#if defined(USE_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint16x8x2_t pairs = vld2q_u16(src + 2 * i);
+        vst1_u8(first + i, vshrn_n_u16(pairs.val[0], 8));
+        vst1_u8(second + i, vshrn_n_u16(pairs.val[1], 8));
+    }
+#elif defined(USE_SSE2)
+    const __m128i kLowBytes = _mm_set1_epi16(0xff);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 8));
+        __m128i pairs = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storel_epi64((__m128i *)(first + i),
+                _mm_packus_epi16(_mm_and_si128(pairs, kLowBytes), zero));
+        _mm_storel_epi64((__m128i *)(second + i),
+                _mm_packus_epi16(_mm_srli_epi16(pairs, 8), zero));
+    }
+#endif
+    for (; i < count; ++i) {
+        first[i] = src[2 * i] >> 8;
+        second[i] = src[2 * i + 1] >> 8;
+    }
+}
+
+}  // namespace android
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROW_CONVERTERS_H_
+
+#define ROW_CONVERTERS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// Single-row kernels used by ColorConverter and SoftwareRenderer. They use
+// NEON or SSE2 when the target supports it and plain C otherwise.
+//
+// The YUV to RGB kernels compute the same BT.601 limited range integer
+// approximation as the original per-pixel ColorConverter code and produce
+// identical output.
+
+// Converts |width| pixels of 4:2:0 8-bit YUV to RGB565. |u| and |v| hold
+// (width + 1) / 2 samples. If |swapRB| is set, blue is stored in the high bits.
+void YUVToRGB565Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint16_t *dst, size_t width, bool swapRB);
+
+// Same as above but writes R, G, B, 0xff bytes per pixel.
+void YUVToRGBA8888Row(
+        const uint8_t *y, const uint8_t *u, const uint8_t *v,
+        uint8_t *dst, size_t width, bool swapRB);
+
+// Splits |count| interleaved byte pairs into |first| and |second|.
+void SplitPairsRow(
+        const uint8_t *src, uint8_t *first, uint8_t *second, size_t count);
+
+// Splits |width| pixels of CbYCrY (UYVY) into Y and (width + 1) / 2 U and V samples.
+void SplitCbYCrYRow(
+        const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, size_t width);
+
+// Keeps the 8 most significant bits of |count| 16-bit samples.
+void Narrow16Row(const uint16_t *src, uint8_t *dst, size_t count);
+
+// Splits |count| interleaved 16-bit sample pairs, keeping the 8 most significant bits.
+void SplitPairs16Row(
+        const uint16_t *src, uint8_t *first, uint8_t *second, size_t count);
+
+}  // namespace android
+
+#endif  // ROW_CONVERTERS_H_
@@ -26,6 +26,8 @@
 #include <ui/GraphicBufferMapper.h>
 #include <gui/IGraphicBufferProducer.h>
 
+#include "RowConverters.h"
+
 namespace android {
 
 static bool runningInEmulator() {
@@ -298,11 +300,7 @@ std::list<FrameRenderTracker::Info> SoftwareRenderer::render(
         }
 
         for (int y = 0; y < (mCropHeight + 1) / 2; ++y) {
-            size_t tmp = (mCropWidth + 1) / 2;
-            for (size_t x = 0; x < tmp; ++x) {
-                dst_u[x] = src_uv[2 * x];
-                dst_v[x] = src_uv[2 * x + 1];
-            }
+            SplitPairsRow(src_uv, dst_u, dst_v, (mCropWidth + 1) / 2);
 
             src_uv += mWidth;
             dst_u += dst_c_stride;
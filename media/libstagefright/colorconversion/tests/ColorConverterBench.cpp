@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times ColorConverter's row converters against the original per-pixel
+// converters for every supported source format at 480p, 1080p and 2160p,
+// and checks that both produce the same RGB565 output.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <media/stagefright/ColorConverter.h>
+
+using namespace android;
+
+struct Format {
+    OMX_COLOR_FORMATTYPE mFormat;
+    const char *mName;
+    size_t mBitsPerPixel;
+};
+
+static const Format kFormats[] = {
+    { OMX_COLOR_FormatYUV420Planar, "YUV420Planar", 12 },
+    { OMX_COLOR_FormatYUV420SemiPlanar, "YUV420SemiPlanar", 12 },
+    { OMX_QCOM_COLOR_FormatYVU420SemiPlanar, "QCOMYVU420SemiPlanar", 12 },
+    { OMX_TI_COLOR_FormatYUV420PackedSemiPlanar, "TIYUV420PackedSemiPlanar", 12 },
+    { OMX_COLOR_FormatCbYCrY, "CbYCrY", 16 },
+    { kColorFormatYUVP010, "P010", 24 },
+};
+
+static const struct {
+    size_t mWidth;
+    size_t mHeight;
+    const char *mName;
+} kSizes[] = {
+    { 720, 480, "480p" },
+    { 1920, 1080, "1080p" },
+    { 3840, 2160, "2160p" },
+};
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the average milliseconds per frame, or a negative value on failure.
+static double timeConversion(
+        ColorConverter *converter, const std::vector<uint8_t> &src,
+        size_t width, size_t height, std::vector<uint8_t> *dst, int iterations) {
+    double start = nowSeconds();
+    for (int i = 0; i < iterations; ++i) {
+        if (converter->convert(
+                src.data(), width, height, 0, 0, width - 1, height - 1,
+                dst->data(), width, height, 0, 0, width - 1, height - 1) != OK) {
+            return -1;
+        }
+    }
+    return (nowSeconds() - start) * 1000 / iterations;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n iterations]\n", me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int iterations = 20;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:h")) >= 0) {
+        switch (res) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (iterations <= 0) {
+        usage(argv[0]);
+    }
+
+    printf("%-26s %-6s %-9s %12s %12s %8s %s\n",
+            "format", "size", "output", "ref ms", "rows ms", "speedup", "match");
+
+    int mismatches = 0;
+    for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); ++s) {
+        size_t width = kSizes[s].mWidth;
+        size_t height = kSizes[s].mHeight;
+
+        for (size_t f = 0; f < sizeof(kFormats) / sizeof(kFormats[0]); ++f) {
+            const Format &format = kFormats[f];
+
+            std::vector<uint8_t> src(width * height * format.mBitsPerPixel / 8);
+            srand(f);
+            for (size_t i = 0; i < src.size(); ++i) {
+                src[i] = rand();
+            }
+
+            for (int rgba = 0; rgba < 2; ++rgba) {
+                OMX_COLOR_FORMATTYPE dstFormat =
+                    rgba ? OMX_COLOR_Format32BitRGBA8888 : OMX_COLOR_Format16bitRGB565;
+                std::vector<uint8_t> rowsOut(width * height * (rgba ? 4 : 2));
+                std::vector<uint8_t> refOut(rowsOut.size());
+
+                ColorConverter rows(format.mFormat, dstFormat);
+                double rowsMs = timeConversion(
+                        &rows, src, width, height, &rowsOut, iterations);
+
+                ColorConverter ref(format.mFormat, dstFormat);
+                ref.setUseReferenceConverters(true);
+                double refMs = -1;
+                if (ref.isValid()) {
+                    refMs = timeConversion(&ref, src, width, height, &refOut, iterations);
+                }
+
+                const char *match = "-";
+                if (refMs >= 0 && rowsMs >= 0) {
+                    match = rowsOut == refOut ? "yes" : "NO";
+                    if (rowsOut != refOut) {
+                        ++mismatches;
+                    }
+                }
+
+                char refStr[16] = "n/a", speedupStr[16] = "-";
+                if (refMs >= 0) {
+                    snprintf(refStr, sizeof(refStr), "%.2f", refMs);
+                    if (rowsMs > 0) {
+                        snprintf(speedupStr, sizeof(speedupStr), "%.1fx", refMs / rowsMs);
+                    }
+                }
+
+                printf("%-26s %-6s %-9s %12s %12.2f %8s %s\n",
+                        format.mName, kSizes[s].mName, rgba ? "RGBA8888" : "RGB565",
+                        refStr, rowsMs, speedupStr, match);
+            }
+        }
+    }
+
+    return mismatches == 0 ? 0 : 1;
+}
@@ -27,8 +27,12 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cutils/properties.h>
 
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
@@ -52,6 +56,26 @@ static uint64_t U64_AT(const uint8_t *ptr) {
 static const size_t kMaxUDPSize = 1500;
 static const int32_t kMaxUDPRetries = 200;
 
+// Stream sockets are read into at least this much free space at a time.
+static const size_t kMinInBufferSpace = 4096;
+
+// One event reads at most this much stream data, or this many datagrams,
+// before other sessions get their turn. Unparsed stream data may not grow
+// past kMaxInBufferSize.
+static const size_t kMaxReadPerEvent = 4 * kMinInBufferSpace;
+static const size_t kMaxDatagramsPerEvent = 32;
+static const size_t kMaxInBufferSize = 1024 * 1024;
+
+// Up to this many queued datagrams go out in one sendmmsg(), and up to this
+// many stream fragments in one writev().
+static const size_t kMaxBatchedDatagrams = 32;
+static const size_t kMaxBatchedFragments = 64;
+
+static const int kMaxEpollEvents = 64;
+
+// The epoll data of the interrupt pipe, session IDs start at 1.
+static const uint32_t kPipeID = 0;
+
 struct ANetworkSession::NetworkThread : public Thread {
     NetworkThread(ANetworkSession *session);
 
@@ -99,6 +123,9 @@ struct ANetworkSession::Session : public RefBase {
     status_t readMore();
     status_t writeMore();
 
+    // Whether the last readMore() stopped before the socket would block.
+    bool hasPendingRead() const;
+
     status_t sendRequest(
             const void *data, ssize_t size, bool timeValid, int64_t timeUs);
 
@@ -126,10 +153,15 @@ private:
     sp<AMessage> mNotify;
     bool mSawReceiveFailure, mSawSendFailure;
     int32_t mUDPRetries;
+    bool mReadPending;
 
     List<Fragment> mOutFragments;
 
-    AString mInBuffer;
+    // Stream data received but not parsed yet is the range of mInBuffer.
+    // Parsed messages are dropped by moving the start of the range, and
+    // what's left is only moved back to the front when there isn't enough
+    // room after it for the next recv().
+    sp<ABuffer> mInBuffer;
 
     int64_t mLastStallReportUs;
 
@@ -138,6 +170,16 @@ private:
 
     void dumpFragmentStats(const Fragment &frag);
 
+    // Returns where the next received bytes go, with at least
+    // kMinInBufferSpace bytes of room unless mInBuffer is at
+    // kMaxInBufferSize, and sets *space to how much. Returns NULL if
+    // mInBuffer is full.
+    uint8_t *reserveInBuffer(size_t *space);
+    void consumeInBuffer(size_t size);
+
+    status_t readDatagrams();
+    status_t writeDatagrams();
+
     DISALLOW_EVIL_CONSTRUCTORS(Session);
 };
 ////////////////////////////////////////////////////////////////////////////////
@@ -170,6 +212,7 @@ ANetworkSession::Session::Session(
       mSawReceiveFailure(false),
       mSawSendFailure(false),
       mUDPRetries(kMaxUDPRetries),
+      mReadPending(false),
       mLastStallReportUs(-1ll) {
     if (mState == CONNECTED) {
         struct sockaddr_in localAddr;
@@ -258,6 +301,10 @@ bool ANetworkSession::Session::wantsToRead() {
     return !mSawReceiveFailure && mState != CONNECTING;
 }
 
+bool ANetworkSession::Session::hasPendingRead() const {
+    return mReadPending;
+}
+
 bool ANetworkSession::Session::wantsToWrite() {
     return !mSawSendFailure
         && (mState == CONNECTING
@@ -265,110 +312,194 @@ bool ANetworkSession::Session::wantsToWrite() {
             || (mState == DATAGRAM && !mOutFragments.empty()));
 }
 
-status_t ANetworkSession::Session::readMore() {
-    if (mState == DATAGRAM) {
-        CHECK_EQ(mMode, MODE_DATAGRAM);
-
-        status_t err;
-        do {
-            sp<ABuffer> buf = new ABuffer(kMaxUDPSize);
-
-            struct sockaddr_in remoteAddr;
-            socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-            ssize_t n;
-            do {
-                n = recvfrom(
-                        mSocket, buf->data(), buf->capacity(), 0,
-                        (struct sockaddr *)&remoteAddr, &remoteAddrLen);
-            } while (n < 0 && errno == EINTR);
-
-            err = OK;
-            if (n < 0) {
-                err = -errno;
-            } else if (n == 0) {
-                err = -ECONNRESET;
-            } else {
-                buf->setRange(0, n);
-
-                int64_t nowUs = ALooper::GetNowUs();
-                buf->meta()->setInt64("arrivalTimeUs", nowUs);
+status_t ANetworkSession::Session::readDatagrams() {
+    CHECK_EQ(mMode, MODE_DATAGRAM);
+
+    // Reads until the socket is drained, a failure that's retried doesn't
+    // stop it since edge-triggered polling won't report what's still
+    // queued again. Past kMaxDatagramsPerEvent the session is read again
+    // on the next pass of the network thread instead.
+    mReadPending = false;
+    for (size_t count = 0;; ++count) {
+        if (count == kMaxDatagramsPerEvent) {
+            mReadPending = true;
+            return OK;
+        }
 
-                sp<AMessage> notify = mNotify->dup();
-                notify->setInt32("sessionID", mSessionID);
-                notify->setInt32("reason", kWhatDatagram);
+        sp<ABuffer> buf = new ABuffer(kMaxUDPSize);
 
-                uint32_t ip = ntohl(remoteAddr.sin_addr.s_addr);
-                notify->setString(
-                        "fromAddr",
-                        AStringPrintf(
-                            "%u.%u.%u.%u",
-                            ip >> 24,
-                            (ip >> 16) & 0xff,
-                            (ip >> 8) & 0xff,
-                            ip & 0xff).c_str());
+        struct sockaddr_in remoteAddr;
+        socklen_t remoteAddrLen = sizeof(remoteAddr);
 
-                notify->setInt32("fromPort", ntohs(remoteAddr.sin_port));
+        ssize_t n;
+        do {
+            n = recvfrom(
+                    mSocket, buf->data(), buf->capacity(), 0,
+                    (struct sockaddr *)&remoteAddr, &remoteAddrLen);
+        } while (n < 0 && errno == EINTR);
 
-                notify->setBuffer("data", buf);
-                notify->post();
-            }
-        } while (err == OK);
+        status_t err = OK;
+        if (n < 0) {
+            err = -errno;
+        } else if (n == 0) {
+            err = -ECONNRESET;
+        }
 
         if (err == -EAGAIN) {
-            err = OK;
+            return OK;
         }
 
         if (err != OK) {
             if (!mUDPRetries) {
                 notifyError(false /* send */, err, "Recvfrom failed.");
                 mSawReceiveFailure = true;
-            } else {
-                mUDPRetries--;
-                ALOGE("Recvfrom failed, %d/%d retries left",
-                        mUDPRetries, kMaxUDPRetries);
-                err = OK;
+                return err;
             }
+
+            mUDPRetries--;
+            ALOGE("Recvfrom failed, %d/%d retries left",
+                    mUDPRetries, kMaxUDPRetries);
+            continue;
+        }
+
+        mUDPRetries = kMaxUDPRetries;
+
+        buf->setRange(0, n);
+
+        int64_t nowUs = ALooper::GetNowUs();
+        buf->meta()->setInt64("arrivalTimeUs", nowUs);
+
+        sp<AMessage> notify = mNotify->dup();
+        notify->setInt32("sessionID", mSessionID);
+        notify->setInt32("reason", kWhatDatagram);
+
+        uint32_t ip = ntohl(remoteAddr.sin_addr.s_addr);
+        notify->setString(
+                "fromAddr",
+                AStringPrintf(
+                    "%u.%u.%u.%u",
+                    ip >> 24,
+                    (ip >> 16) & 0xff,
+                    (ip >> 8) & 0xff,
+                    ip & 0xff).c_str());
+
+        notify->setInt32("fromPort", ntohs(remoteAddr.sin_port));
+
+        notify->setBuffer("data", buf);
+        notify->post();
+    }
+}
+
+uint8_t *ANetworkSession::Session::reserveInBuffer(size_t *space) {
+    if (mInBuffer == NULL) {
+        mInBuffer = new ABuffer(kMinInBufferSpace);
+        mInBuffer->setRange(0, 0);
+    }
+
+    size_t size = mInBuffer->size();
+    size_t end = mInBuffer->offset() + size;
+
+    if (mInBuffer->capacity() - end < kMinInBufferSpace) {
+        if (mInBuffer->capacity() - size < kMinInBufferSpace
+                && mInBuffer->capacity() < kMaxInBufferSize) {
+            size_t capacity = 2 * mInBuffer->capacity();
+            if (capacity > kMaxInBufferSize) {
+                capacity = kMaxInBufferSize;
+            }
+
+            sp<ABuffer> buffer = new ABuffer(capacity);
+            memcpy(buffer->data(), mInBuffer->data(), size);
+            mInBuffer = buffer;
         } else {
-            mUDPRetries = kMaxUDPRetries;
+            memmove(mInBuffer->base(), mInBuffer->data(), size);
         }
+        mInBuffer->setRange(0, size);
+        end = size;
+    }
 
-        return err;
+    *space = mInBuffer->capacity() - end;
+    return *space > 0 ? mInBuffer->base() + end : NULL;
+}
+
+void ANetworkSession::Session::consumeInBuffer(size_t size) {
+    CHECK_LE(size, mInBuffer->size());
+
+    if (size == mInBuffer->size()) {
+        mInBuffer->setRange(0, 0);
+    } else {
+        mInBuffer->setRange(
+                mInBuffer->offset() + size, mInBuffer->size() - size);
     }
+}
 
-    char tmp[512];
-    ssize_t n;
-    do {
-        n = recv(mSocket, tmp, sizeof(tmp), 0);
-    } while (n < 0 && errno == EINTR);
+status_t ANetworkSession::Session::readMore() {
+    if (mState == DATAGRAM) {
+        return readDatagrams();
+    }
 
+    // Reads up to kMaxReadPerEvent bytes before parsing any of them. If
+    // the socket isn't drained by then the session is read again on the
+    // next pass of the network thread, since edge-triggered polling won't
+    // report it again.
     status_t err = OK;
+    bool full = false;
+    size_t total = 0;
+    mReadPending = false;
+    for (;;) {
+        if (total >= kMaxReadPerEvent) {
+            mReadPending = true;
+            break;
+        }
+
+        size_t space;
+        uint8_t *dst = reserveInBuffer(&space);
+
+        if (dst == NULL) {
+            full = true;
+            break;
+        }
 
-    if (n > 0) {
-        mInBuffer.append(tmp, n);
+        if (space > kMaxReadPerEvent - total) {
+            space = kMaxReadPerEvent - total;
+        }
 
+        ssize_t n;
+        do {
+            n = recv(mSocket, dst, space, 0);
+        } while (n < 0 && errno == EINTR);
+
+        if (n > 0) {
 #if 0
-        ALOGI("in:");
-        hexdump(tmp, n);
+            ALOGI("in:");
+            hexdump(dst, n);
 #endif
-    } else if (n < 0) {
-        err = -errno;
-    } else {
-        err = -ECONNRESET;
+
+            mInBuffer->setRange(mInBuffer->offset(), mInBuffer->size() + n);
+            total += n;
+            continue;
+        }
+
+        if (n < 0 && errno != EAGAIN) {
+            err = -errno;
+        } else if (n == 0) {
+            err = -ECONNRESET;
+        }
+        break;
     }
 
     if (mMode == MODE_DATAGRAM) {
         // TCP stream carrying 16-bit length-prefixed datagrams.
 
-        while (mInBuffer.size() >= 2) {
-            size_t packetSize = U16_AT((const uint8_t *)mInBuffer.c_str());
+        while (mInBuffer->size() >= 2) {
+            const uint8_t *data = mInBuffer->data();
+            size_t packetSize = U16_AT(data);
 
-            if (mInBuffer.size() < packetSize + 2) {
+            if (mInBuffer->size() < packetSize + 2) {
                 break;
             }
 
             sp<ABuffer> packet = new ABuffer(packetSize);
-            memcpy(packet->data(), mInBuffer.c_str() + 2, packetSize);
+            memcpy(packet->data(), data + 2, packetSize);
 
             int64_t nowUs = ALooper::GetNowUs();
             packet->meta()->setInt64("arrivalTimeUs", nowUs);
@@ -379,44 +510,45 @@ status_t ANetworkSession::Session::readMore() {
             notify->setBuffer("data", packet);
             notify->post();
 
-            mInBuffer.erase(0, packetSize + 2);
+            consumeInBuffer(packetSize + 2);
         }
     } else if (mMode == MODE_RTSP) {
         for (;;) {
+            const char *data = (const char *)mInBuffer->data();
+            size_t size = mInBuffer->size();
             size_t length;
 
-            if (mInBuffer.size() > 0 && mInBuffer.c_str()[0] == '$') {
-                if (mInBuffer.size() < 4) {
+            if (size > 0 && data[0] == '$') {
+                if (size < 4) {
                     break;
                 }
 
-                length = U16_AT((const uint8_t *)mInBuffer.c_str() + 2);
+                length = U16_AT((const uint8_t *)data + 2);
 
-                if (mInBuffer.size() < 4 + length) {
+                if (size < 4 + length) {
                     break;
                 }
 
                 sp<AMessage> notify = mNotify->dup();
                 notify->setInt32("sessionID", mSessionID);
                 notify->setInt32("reason", kWhatBinaryData);
-                notify->setInt32("channel", mInBuffer.c_str()[1]);
+                notify->setInt32("channel", data[1]);
 
-                sp<ABuffer> data = new ABuffer(length);
-                memcpy(data->data(), mInBuffer.c_str() + 4, length);
+                sp<ABuffer> buffer = new ABuffer(length);
+                memcpy(buffer->data(), data + 4, length);
 
                 int64_t nowUs = ALooper::GetNowUs();
-                data->meta()->setInt64("arrivalTimeUs", nowUs);
+                buffer->meta()->setInt64("arrivalTimeUs", nowUs);
 
-                notify->setBuffer("data", data);
+                notify->setBuffer("data", buffer);
                 notify->post();
 
-                mInBuffer.erase(0, 4 + length);
+                consumeInBuffer(4 + length);
                 continue;
             }
 
             sp<ParsedMessage> msg =
-                ParsedMessage::Parse(
-                        mInBuffer.c_str(), mInBuffer.size(), err != OK, &length);
+                ParsedMessage::Parse(data, size, err != OK, &length);
 
             if (msg == NULL) {
                 break;
@@ -436,13 +568,14 @@ status_t ANetworkSession::Session::readMore() {
             if (content
                     && !memcmp(content, "wfd_idr_request\r\n", 17)
                     && length >= 19
-                    && mInBuffer.c_str()[length] == '\r'
-                    && mInBuffer.c_str()[length + 1] == '\n') {
+                    && size >= length + 2
+                    && data[length] == '\r'
+                    && data[length + 1] == '\n') {
                 length += 2;
             }
 #endif
 
-            mInBuffer.erase(0, length);
+            consumeInBuffer(length);
 
             if (err != OK) {
                 break;
@@ -451,22 +584,23 @@ status_t ANetworkSession::Session::readMore() {
     } else {
         CHECK_EQ(mMode, MODE_WEBSOCKET);
 
-        const uint8_t *data = (const uint8_t *)mInBuffer.c_str();
-        // hexdump(data, mInBuffer.size());
+        while (mInBuffer->size() >= 2) {
+            const uint8_t *data = mInBuffer->data();
+            size_t size = mInBuffer->size();
+            // hexdump(data, size);
 
-        while (mInBuffer.size() >= 2) {
             size_t offset = 2;
 
             uint64_t payloadLen = data[1] & 0x7f;
             if (payloadLen == 126) {
-                if (offset + 2 > mInBuffer.size()) {
+                if (offset + 2 > size) {
                     break;
                 }
 
                 payloadLen = U16_AT(&data[offset]);
                 offset += 2;
             } else if (payloadLen == 127) {
-                if (offset + 8 > mInBuffer.size()) {
+                if (offset + 8 > size) {
                     break;
                 }
 
@@ -477,7 +611,7 @@ status_t ANetworkSession::Session::readMore() {
             uint32_t mask = 0;
             if (data[1] & 0x80) {
                 // MASK==1
-                if (offset + 4 > mInBuffer.size()) {
+                if (offset + 4 > size) {
                     break;
                 }
 
@@ -485,7 +619,7 @@ status_t ANetworkSession::Session::readMore() {
                 offset += 4;
             }
 
-            if (payloadLen > mInBuffer.size() || offset > mInBuffer.size() - payloadLen) {
+            if (payloadLen > size || offset > size - payloadLen) {
                 break;
             }
 
@@ -509,7 +643,19 @@ status_t ANetworkSession::Session::readMore() {
             notify->setInt32("headerByte", data[0]);
             notify->post();
 
-            mInBuffer.erase(0, offset + payloadLen);
+            consumeInBuffer(offset + payloadLen);
+        }
+    }
+
+    if (full) {
+        if (mInBuffer->size() < kMaxInBufferSize) {
+            // Parsing made room, keep reading.
+            mReadPending = true;
+        } else {
+            // The message at the front doesn't fit.
+            ALOGE("Session %d received more than %zu bytes without a "
+                  "complete message", mSessionID, kMaxInBufferSize);
+            err = -EMSGSIZE;
         }
     }
 
@@ -548,57 +694,84 @@ void ANetworkSession::Session::dumpFragmentStats(const Fragment & /* frag */) {
 #endif
 }
 
-status_t ANetworkSession::Session::writeMore() {
-    if (mState == DATAGRAM) {
-        CHECK(!mOutFragments.empty());
+status_t ANetworkSession::Session::writeDatagrams() {
+    CHECK(!mOutFragments.empty());
 
-        status_t err;
+    // Like readDatagrams(), this doesn't stop at a failure that's retried,
+    // the socket won't be reported as writable again.
+    while (!mOutFragments.empty()) {
+        struct iovec iov[kMaxBatchedDatagrams];
+        struct mmsghdr msgs[kMaxBatchedDatagrams];
+        memset(msgs, 0, sizeof(msgs));
+
+        size_t count = 0;
+        for (List<Fragment>::iterator it = mOutFragments.begin();
+                it != mOutFragments.end() && count < kMaxBatchedDatagrams;
+                ++it, ++count) {
+            iov[count].iov_base = it->mBuffer->data();
+            iov[count].iov_len = it->mBuffer->size();
+            msgs[count].msg_hdr.msg_iov = &iov[count];
+            msgs[count].msg_hdr.msg_iovlen = 1;
+        }
+
+        int n;
         do {
-            const Fragment &frag = *mOutFragments.begin();
-            const sp<ABuffer> &datagram = frag.mBuffer;
+            n = sendmmsg(mSocket, msgs, count, 0);
+        } while (n < 0 && errno == EINTR);
 
-            int n;
+        if (n < 0 && errno == ENOSYS) {
             do {
-                n = send(mSocket, datagram->data(), datagram->size(), 0);
+                n = send(mSocket, iov[0].iov_base, iov[0].iov_len, 0);
             } while (n < 0 && errno == EINTR);
 
-            err = OK;
-
             if (n > 0) {
-                if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
-                    dumpFragmentStats(frag);
-                }
-
-                mOutFragments.erase(mOutFragments.begin());
-            } else if (n < 0) {
-                err = -errno;
-            } else if (n == 0) {
-                err = -ECONNRESET;
+                n = 1;
             }
-        } while (err == OK && !mOutFragments.empty());
+        }
+
+        status_t err = OK;
+        if (n < 0) {
+            err = -errno;
+        } else if (n == 0) {
+            err = -ECONNRESET;
+        }
 
         if (err == -EAGAIN) {
-            if (!mOutFragments.empty()) {
-                ALOGI("%zu datagrams remain queued.", mOutFragments.size());
-            }
-            err = OK;
+            ALOGI("%zu datagrams remain queued.", mOutFragments.size());
+            break;
         }
 
         if (err != OK) {
             if (!mUDPRetries) {
                 notifyError(true /* send */, err, "Send datagram failed.");
                 mSawSendFailure = true;
-            } else {
-                mUDPRetries--;
-                ALOGE("Send datagram failed, %d/%d retries left",
-                        mUDPRetries, kMaxUDPRetries);
-                err = OK;
+                return err;
             }
-        } else {
-            mUDPRetries = kMaxUDPRetries;
+
+            mUDPRetries--;
+            ALOGE("Send datagram failed, %d/%d retries left",
+                    mUDPRetries, kMaxUDPRetries);
+            continue;
         }
 
-        return err;
+        mUDPRetries = kMaxUDPRetries;
+
+        for (int i = 0; i < n; ++i) {
+            const Fragment &frag = *mOutFragments.begin();
+            if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
+                dumpFragmentStats(frag);
+            }
+
+            mOutFragments.erase(mOutFragments.begin());
+        }
+    }
+
+    return OK;
+}
+
+status_t ANetworkSession::Session::writeMore() {
+    if (mState == DATAGRAM) {
+        return writeDatagrams();
     }
 
     if (mState == CONNECTING) {
@@ -625,33 +798,56 @@ status_t ANetworkSession::Session::writeMore() {
 
     ssize_t n = -1;
     while (!mOutFragments.empty()) {
-        const Fragment &frag = *mOutFragments.begin();
+        struct iovec iov[kMaxBatchedFragments];
+        size_t count = 0;
+        size_t totalSize = 0;
+        for (List<Fragment>::iterator it = mOutFragments.begin();
+                it != mOutFragments.end() && count < kMaxBatchedFragments;
+                ++it, ++count) {
+            iov[count].iov_base = it->mBuffer->data();
+            iov[count].iov_len = it->mBuffer->size();
+            totalSize += it->mBuffer->size();
+        }
 
         do {
-            n = send(mSocket, frag.mBuffer->data(), frag.mBuffer->size(), 0);
+            n = writev(mSocket, iov, count);
         } while (n < 0 && errno == EINTR);
 
         if (n <= 0) {
             break;
         }
 
-        frag.mBuffer->setRange(
-                frag.mBuffer->offset() + n, frag.mBuffer->size() - n);
+        // Drops the fragments that went out, and what went out of the first
+        // one that didn't.
+        size_t remaining = n;
+        while (remaining > 0) {
+            const Fragment &frag = *mOutFragments.begin();
+            size_t size = frag.mBuffer->size();
 
-        if (frag.mBuffer->size() > 0) {
-            break;
-        }
+            if (remaining < size) {
+                frag.mBuffer->setRange(
+                        frag.mBuffer->offset() + remaining, size - remaining);
+                break;
+            }
+
+            remaining -= size;
 
-        if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
-            dumpFragmentStats(frag);
+            if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
+                dumpFragmentStats(frag);
+            }
+
+            mOutFragments.erase(mOutFragments.begin());
         }
 
-        mOutFragments.erase(mOutFragments.begin());
+        if ((size_t)n < totalSize) {
+            // The socket's send buffer is full.
+            break;
+        }
     }
 
     status_t err = OK;
 
-    if (n < 0) {
+    if (n < 0 && errno != EAGAIN) {
         err = -errno;
     } else if (n == 0) {
         err = -ECONNRESET;
@@ -798,7 +994,8 @@ void ANetworkSession::Session::notify(NotificationReason reason) {
 ////////////////////////////////////////////////////////////////////////////////
 
 ANetworkSession::ANetworkSession()
-    : mNextSessionID(1) {
+    : mNextSessionID(1),
+      mEpollFd(-1) {
     mPipeFd[0] = mPipeFd[1] = -1;
 }
 
@@ -817,6 +1014,35 @@ status_t ANetworkSession::start() {
         return -errno;
     }
 
+    // interrupt() is called with mLock held, and mustn't wait for the
+    // network thread to make room in the pipe.
+    MakeSocketNonBlocking(mPipeFd[1]);
+
+    if (property_get_bool("media.stagefright.net-epoll", true)) {
+        Mutex::Autolock autoLock(mLock);
+
+        mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = kPipeID;
+
+        if (mEpollFd < 0
+                || epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mPipeFd[0], &event) < 0) {
+            ALOGW("epoll unavailable (%s), using select", strerror(errno));
+
+            if (mEpollFd >= 0) {
+                close(mEpollFd);
+                mEpollFd = -1;
+            }
+        } else {
+            for (size_t i = 0; i < mSessions.size(); ++i) {
+                watchSession_l(mSessions.valueAt(i));
+            }
+        }
+    }
+
     mThread = new NetworkThread(this);
 
     status_t err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
@@ -828,6 +1054,11 @@ status_t ANetworkSession::start() {
         close(mPipeFd[1]);
         mPipeFd[0] = mPipeFd[1] = -1;
 
+        if (mEpollFd >= 0) {
+            close(mEpollFd);
+            mEpollFd = -1;
+        }
+
         return err;
     }
 
@@ -849,6 +1080,16 @@ status_t ANetworkSession::stop() {
     close(mPipeFd[1]);
     mPipeFd[0] = mPipeFd[1] = -1;
 
+    Mutex::Autolock autoLock(mLock);
+
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+
+    mSessionsToWrite.clear();
+    mSessionsToRead.clear();
+
     return OK;
 }
 
@@ -937,6 +1178,13 @@ status_t ANetworkSession::destroySession(int32_t sessionID) {
         return -ENOENT;
     }
 
+    if (mEpollFd >= 0) {
+        // The socket may outlive the session if a reference to it is held
+        // on the network thread.
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL,
+                  mSessions.valueAt(index)->socket(), NULL);
+    }
+
     mSessions.removeItemsAt(index);
 
     interrupt();
@@ -1080,7 +1328,7 @@ status_t ANetworkSession::createClientOrServer(
         if (res == 0) {
             if (mode == kModeCreateRTSPServer
                     || mode == kModeCreateTCPDatagramSessionPassive) {
-                res = listen(s, 4);
+                res = listen(s, SOMAXCONN);
             } else {
                 CHECK_EQ(mode, kModeCreateUDPSession);
 
@@ -1148,7 +1396,7 @@ status_t ANetworkSession::createClientOrServer(
         session->setMode(Session::MODE_RTSP);
     }
 
-    mSessions.add(session->sessionID(), session);
+    addSession_l(session);
 
     interrupt();
 
@@ -1217,6 +1465,10 @@ status_t ANetworkSession::sendRequest(
 
     status_t err = session->sendRequest(data, size, timeValid, timeUs);
 
+    if (mEpollFd >= 0) {
+        mSessionsToWrite.add(sessionID);
+    }
+
     interrupt();
 
     return err;
@@ -1243,12 +1495,62 @@ void ANetworkSession::interrupt() {
         n = write(mPipeFd[1], &dummy, 1);
     } while (n < 0 && errno == EINTR);
 
-    if (n < 0) {
+    // A full pipe already wakes up the network thread.
+    if (n < 0 && errno != EAGAIN) {
         ALOGW("Error writing to pipe (%s)", strerror(errno));
     }
 }
 
+void ANetworkSession::drainPipe() {
+    char buffer[256];
+    ssize_t n;
+    do {
+        n = read(mPipeFd[0], buffer, sizeof(buffer));
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        ALOGW("Error reading from pipe (%s)", strerror(errno));
+    }
+}
+
+void ANetworkSession::addSession_l(const sp<Session> &session) {
+    mSessions.add(session->sessionID(), session);
+
+    if (mEpollFd >= 0) {
+        watchSession_l(session);
+    }
+}
+
+void ANetworkSession::watchSession_l(const sp<Session> &session) {
+    // Sessions ask for both and make sure they don't miss an edge, by
+    // reading and writing until the socket would block. Listening sockets
+    // stay level-triggered: if accept() fails for lack of descriptors the
+    // pending connections are reported again instead of going unnoticed
+    // until the next one arrives.
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+        event.events = EPOLLIN;
+    } else {
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    }
+    event.data.u32 = session->sessionID();
+
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, session->socket(), &event) < 0) {
+        ALOGE("Unable to watch socket %d (%s)",
+              session->socket(), strerror(errno));
+    }
+}
+
 void ANetworkSession::threadLoop() {
+    if (mEpollFd >= 0) {
+        threadLoopEpoll();
+    } else {
+        threadLoopSelect();
+    }
+}
+
+void ANetworkSession::threadLoopSelect() {
     fd_set rs, ws;
     FD_ZERO(&rs);
     FD_ZERO(&ws);
@@ -1300,15 +1602,7 @@ void ANetworkSession::threadLoop() {
     }
 
     if (FD_ISSET(mPipeFd[0], &rs)) {
-        char c;
-        ssize_t n;
-        do {
-            n = read(mPipeFd[0], &c, 1);
-        } while (n < 0 && errno == EINTR);
-
-        if (n < 0) {
-            ALOGW("Error reading from pipe (%s)", strerror(errno));
-        }
+        drainPipe();
 
         --res;
     }
@@ -1330,71 +1624,10 @@ void ANetworkSession::threadLoop() {
 
             if (FD_ISSET(s, &rs) || FD_ISSET(s, &ws)) {
                 --res;
-            }
 
-            if (FD_ISSET(s, &rs)) {
-                if (session->isRTSPServer() || session->isTCPDatagramServer()) {
-                    struct sockaddr_in remoteAddr;
-                    socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-                    int clientSocket = accept(
-                            s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
-
-                    if (clientSocket >= 0) {
-                        status_t err = MakeSocketNonBlocking(clientSocket);
-
-                        if (err != OK) {
-                            ALOGE("Unable to make client socket non blocking, "
-                                  "failed w/ error %d (%s)",
-                                  err, strerror(-err));
-
-                            close(clientSocket);
-                            clientSocket = -1;
-                        } else {
-                            in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
-
-                            ALOGI("incoming connection from %d.%d.%d.%d:%d "
-                                  "(socket %d)",
-                                  (addr >> 24),
-                                  (addr >> 16) & 0xff,
-                                  (addr >> 8) & 0xff,
-                                  addr & 0xff,
-                                  ntohs(remoteAddr.sin_port),
-                                  clientSocket);
-
-                            sp<Session> clientSession =
-                                new Session(
-                                        mNextSessionID++,
-                                        Session::CONNECTED,
-                                        clientSocket,
-                                        session->getNotificationMessage());
-
-                            clientSession->setMode(
-                                    session->isRTSPServer()
-                                        ? Session::MODE_RTSP
-                                        : Session::MODE_DATAGRAM);
-
-                            sessionsToAdd.push_back(clientSession);
-                        }
-                    } else {
-                        ALOGE("accept returned error %d (%s)",
-                              errno, strerror(errno));
-                    }
-                } else {
-                    status_t err = session->readMore();
-                    if (err != OK) {
-                        ALOGE("readMore on socket %d failed w/ error %d (%s)",
-                              s, err, strerror(-err));
-                    }
-                }
-            }
-
-            if (FD_ISSET(s, &ws)) {
-                status_t err = session->writeMore();
-                if (err != OK) {
-                    ALOGE("writeMore on socket %d failed w/ error %d (%s)",
-                          s, err, strerror(-err));
-                }
+                onSessionReady_l(
+                        session, FD_ISSET(s, &rs), FD_ISSET(s, &ws),
+                        &sessionsToAdd);
             }
         }
 
@@ -1402,11 +1635,193 @@ void ANetworkSession::threadLoop() {
             sp<Session> session = *sessionsToAdd.begin();
             sessionsToAdd.erase(sessionsToAdd.begin());
 
-            mSessions.add(session->sessionID(), session);
+            addSession_l(session);
 
             ALOGI("added clientSession %d", session->sessionID());
         }
     }
 }
 
+void ANetworkSession::threadLoopEpoll() {
+    struct epoll_event events[kMaxEpollEvents];
+
+    int timeoutMs;
+    {
+        Mutex::Autolock autoLock(mLock);
+        // Don't block if sessions still have data to be read.
+        timeoutMs = mSessionsToRead.isEmpty() ? -1 : 0;
+    }
+
+    int res = epoll_wait(mEpollFd, events, kMaxEpollEvents, timeoutMs);
+
+    if (res < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+
+        ALOGE("epoll_wait failed w/ error %d (%s)", errno, strerror(errno));
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    List<sp<Session> > sessionsToAdd;
+
+    // Reading these may queue them again.
+    SortedVector<int32_t> sessionsToRead = mSessionsToRead;
+    mSessionsToRead.clear();
+
+    for (int i = 0; i < res; ++i) {
+        if (events[i].data.u32 == kPipeID) {
+            drainPipe();
+            continue;
+        }
+
+        ssize_t index = mSessions.indexOfKey(events[i].data.u32);
+
+        if (index < 0) {
+            // Destroyed since.
+            continue;
+        }
+
+        sp<Session> session = mSessions.valueAt(index);
+
+        // Errors are picked up by reading or writing.
+        bool failed = events[i].events & (EPOLLERR | EPOLLHUP);
+
+        onSessionReady_l(
+                session,
+                failed || (events[i].events & EPOLLIN),
+                failed || (events[i].events & EPOLLOUT),
+                &sessionsToAdd);
+    }
+
+    for (size_t i = 0; i < mSessionsToWrite.size(); ++i) {
+        ssize_t index = mSessions.indexOfKey(mSessionsToWrite.itemAt(i));
+
+        if (index >= 0) {
+            sp<Session> session = mSessions.valueAt(index);
+            onSessionReady_l(
+                    session, false /* readable */, true /* writable */,
+                    &sessionsToAdd);
+        }
+    }
+    mSessionsToWrite.clear();
+
+    for (size_t i = 0; i < sessionsToRead.size(); ++i) {
+        ssize_t index = mSessions.indexOfKey(sessionsToRead.itemAt(i));
+
+        if (index >= 0) {
+            sp<Session> session = mSessions.valueAt(index);
+            onSessionReady_l(
+                    session, true /* readable */, false /* writable */,
+                    &sessionsToAdd);
+        }
+    }
+
+    while (!sessionsToAdd.empty()) {
+        sp<Session> session = *sessionsToAdd.begin();
+        sessionsToAdd.erase(sessionsToAdd.begin());
+
+        addSession_l(session);
+
+        ALOGI("added clientSession %d", session->sessionID());
+    }
+}
+
+void ANetworkSession::onSessionReady_l(
+        const sp<Session> &session, bool readable, bool writable,
+        List<sp<Session> > *sessionsToAdd) {
+    int s = session->socket();
+
+    // A connecting session only starts reading once writeMore() has seen it
+    // connect.
+    if (writable && session->wantsToWrite()) {
+        status_t err = session->writeMore();
+        if (err != OK) {
+            ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                  s, err, strerror(-err));
+        }
+    }
+
+    if (!readable || !session->wantsToRead()) {
+        return;
+    }
+
+    if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+        acceptClients_l(session, sessionsToAdd);
+        return;
+    }
+
+    status_t err = session->readMore();
+    if (err != OK) {
+        ALOGE("readMore on socket %d failed w/ error %d (%s)",
+              s, err, strerror(-err));
+    }
+
+    if (mEpollFd >= 0 && session->hasPendingRead()) {
+        mSessionsToRead.add(session->sessionID());
+    }
+}
+
+void ANetworkSession::acceptClients_l(
+        const sp<Session> &session, List<sp<Session> > *sessionsToAdd) {
+    for (;;) {
+        struct sockaddr_in remoteAddr;
+        socklen_t remoteAddrLen = sizeof(remoteAddr);
+
+        int clientSocket = accept(
+                session->socket(),
+                (struct sockaddr *)&remoteAddr, &remoteAddrLen);
+
+        if (clientSocket < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EAGAIN) {
+                ALOGE("accept returned error %d (%s)", errno, strerror(errno));
+            }
+            break;
+        }
+
+        status_t err = MakeSocketNonBlocking(clientSocket);
+
+        if (err != OK) {
+            ALOGE("Unable to make client socket non blocking, "
+                  "failed w/ error %d (%s)",
+                  err, strerror(-err));
+
+            close(clientSocket);
+            clientSocket = -1;
+            continue;
+        }
+
+        in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
+
+        ALOGI("incoming connection from %d.%d.%d.%d:%d "
+              "(socket %d)",
+              (addr >> 24),
+              (addr >> 16) & 0xff,
+              (addr >> 8) & 0xff,
+              addr & 0xff,
+              ntohs(remoteAddr.sin_port),
+              clientSocket);
+
+        sp<Session> clientSession =
+            new Session(
+                    mNextSessionID++,
+                    Session::CONNECTED,
+                    clientSocket,
+                    session->getNotificationMessage());
+
+        clientSession->setMode(
+                session->isRTSPServer()
+                    ? Session::MODE_RTSP
+                    : Session::MODE_DATAGRAM);
+
+        sessionsToAdd->push_back(clientSession);
+    }
+}
+
 }  // namespace android
@@ -42,3 +42,25 @@ LOCAL_MODULE:= libstagefright_foundation
 
 
 include $(BUILD_SHARED_LIBRARY)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tests/ANetworkSessionBench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+        libstagefright_foundation \
+        libutils \
+        libcutils \
+        liblog
+
+LOCAL_CFLAGS += -Wno-multichar -Werror -Wall
+LOCAL_CLANG := true
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_MODULE := anetworksession_bench
+
+include $(BUILD_EXECUTABLE)
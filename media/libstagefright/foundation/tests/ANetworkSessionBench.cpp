@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how ANetworkSession copes with many sessions. Pairs of sessions
+// are connected over loopback and a few of them bounce a datagram back and
+// forth while the rest sit idle, which is what a wifi display or RTSP server
+// with many clients mostly looks like. The round trip rate and latency are
+// reported.
+//
+// Compare the backends by running with
+//     setprop media.stagefright.net-epoll false
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/resource.h>
+
+#include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/ANetworkSession.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/SortedVector.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+static const unsigned kBasePort = 47000;
+static const size_t kDatagramSize = 188;
+
+struct Bench : public AHandler {
+    enum {
+        kWhatNetworkNotify = 'netN',
+    };
+
+    Bench(const sp<ANetworkSession> &netSession, size_t numRoundTrips)
+        : mNetSession(netSession),
+          mNumRoundTrips(numRoundTrips),
+          mNumConnected(0),
+          mNumSent(0),
+          mStartUs(0),
+          mEndUs(0) {
+    }
+
+    void addClient(int32_t sessionID) {
+        Mutex::Autolock autoLock(mLock);
+        mClients.add(sessionID);
+    }
+
+    // Waits for numSessions sessions to connect, or returns false.
+    bool waitForConnections(size_t numSessions) {
+        Mutex::Autolock autoLock(mLock);
+        while (mNumConnected < numSessions) {
+            if (mCondition.waitRelative(mLock, 10000000000ll) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Starts a round trip on each of clients, and waits for all of them to
+    // be done.
+    bool run(const Vector<int32_t> &clients) {
+        {
+            Mutex::Autolock autoLock(mLock);
+            mStartUs = ALooper::GetNowUs();
+            mNumSent = clients.size();
+        }
+
+        for (size_t i = 0; i < clients.size(); ++i) {
+            send(clients[i]);
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        while (mEndUs == 0) {
+            if (mCondition.waitRelative(mLock, 10000000000ll) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void report() {
+        Mutex::Autolock autoLock(mLock);
+
+        double seconds = (mEndUs - mStartUs) / 1E6;
+        printf("%zu round trips in %.2f s, %.0f/s\n",
+                mLatenciesUs.size(), seconds, mLatenciesUs.size() / seconds);
+
+        mLatenciesUs.sort(compareLatencies);
+        printf("round trip us: median %lld, 99%% %lld, max %lld\n",
+                (long long)mLatenciesUs[mLatenciesUs.size() / 2],
+                (long long)mLatenciesUs[mLatenciesUs.size() * 99 / 100],
+                (long long)mLatenciesUs[mLatenciesUs.size() - 1]);
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        CHECK_EQ(msg->what(), (uint32_t)kWhatNetworkNotify);
+
+        int32_t reason, sessionID;
+        CHECK(msg->findInt32("reason", &reason));
+        CHECK(msg->findInt32("sessionID", &sessionID));
+
+        switch (reason) {
+            case ANetworkSession::kWhatConnected:
+            case ANetworkSession::kWhatClientConnected:
+            {
+                Mutex::Autolock autoLock(mLock);
+                ++mNumConnected;
+                mCondition.signal();
+                break;
+            }
+
+            case ANetworkSession::kWhatDatagram:
+            {
+                sp<ABuffer> data;
+                CHECK(msg->findBuffer("data", &data));
+                onDatagram(msg, sessionID, data);
+                break;
+            }
+
+            case ANetworkSession::kWhatError:
+            {
+                int32_t err;
+                CHECK(msg->findInt32("err", &err));
+                fprintf(stderr, "session %d: error %d\n", sessionID, err);
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+private:
+    sp<ANetworkSession> mNetSession;
+    size_t mNumRoundTrips;
+
+    Mutex mLock;
+    Condition mCondition;
+    SortedVector<int32_t> mClients;
+    // The echoing ends of UDP pairs that have been connected to the client.
+    SortedVector<int32_t> mConnectedServers;
+    size_t mNumConnected;
+    size_t mNumSent;
+    int64_t mStartUs;
+    int64_t mEndUs;
+    Vector<int64_t> mLatenciesUs;
+
+    void send(int32_t sessionID) {
+        uint8_t data[kDatagramSize];
+        memset(data, 0, sizeof(data));
+        int64_t nowUs = ALooper::GetNowUs();
+        memcpy(data, &nowUs, sizeof(nowUs));
+
+        status_t err = mNetSession->sendRequest(sessionID, data, sizeof(data));
+        CHECK_EQ(err, (status_t)OK);
+    }
+
+    void onDatagram(
+            const sp<AMessage> &msg, int32_t sessionID,
+            const sp<ABuffer> &data) {
+        CHECK_EQ(data->size(), kDatagramSize);
+
+        Mutex::Autolock autoLock(mLock);
+
+        if (mClients.indexOf(sessionID) < 0) {
+            // The echoing end of a UDP pair doesn't know where to send to
+            // until it's heard from the client.
+            AString fromAddr;
+            int32_t fromPort;
+            if (msg->findString("fromAddr", &fromAddr)
+                    && msg->findInt32("fromPort", &fromPort)
+                    && mConnectedServers.indexOf(sessionID) < 0) {
+                CHECK_EQ(mNetSession->connectUDPSession(
+                            sessionID, fromAddr.c_str(), fromPort),
+                         (status_t)OK);
+                mConnectedServers.add(sessionID);
+            }
+
+            CHECK_EQ(mNetSession->sendRequest(
+                        sessionID, data->data(), data->size()),
+                     (status_t)OK);
+            return;
+        }
+
+        int64_t sentUs;
+        memcpy(&sentUs, data->data(), sizeof(sentUs));
+        mLatenciesUs.push(ALooper::GetNowUs() - sentUs);
+
+        if (mLatenciesUs.size() == mNumRoundTrips) {
+            mEndUs = ALooper::GetNowUs();
+            mCondition.signal();
+        } else if (mNumSent < mNumRoundTrips) {
+            ++mNumSent;
+            send(sessionID);
+        }
+    }
+
+    static int compareLatencies(const int64_t *a, const int64_t *b) {
+        return *a < *b ? -1 : *a > *b ? 1 : 0;
+    }
+
+    DISALLOW_EVIL_CONSTRUCTORS(Bench);
+};
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-n session pairs] [-a active pairs] [-r round trips]"
+            " [-u]\n"
+            "  -u  UDP sessions, instead of TCP carrying datagrams\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    size_t numPairs = 400;
+    size_t numActive = 4;
+    size_t numRoundTrips = 50000;
+    bool udp = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:a:r:u")) >= 0) {
+        switch (res) {
+            case 'n':
+                numPairs = atoi(optarg);
+                break;
+            case 'a':
+                numActive = atoi(optarg);
+                break;
+            case 'r':
+                numRoundTrips = atoi(optarg);
+                break;
+            case 'u':
+                udp = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (numPairs == 0 || numActive == 0 || numActive > numPairs
+            || numRoundTrips < numActive) {
+        usage(argv[0]);
+    }
+
+    // Each pair is two sockets, and there's the listening one.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0
+            && limit.rlim_cur < 2 * numPairs + 64) {
+        limit.rlim_cur = 2 * numPairs + 64;
+        if (limit.rlim_cur > limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+        }
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    sp<ANetworkSession> netSession = new ANetworkSession;
+    CHECK_EQ(netSession->start(), (status_t)OK);
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("network bench");
+    sp<Bench> bench = new Bench(netSession, numRoundTrips);
+    looper->registerHandler(bench);
+    looper->start();
+
+    sp<AMessage> notify = new AMessage(Bench::kWhatNetworkNotify, bench);
+
+    Vector<int32_t> clients;
+    size_t numConnections = 0;
+    if (udp) {
+        for (size_t i = 0; i < numPairs; ++i) {
+            int32_t serverID, clientID;
+            CHECK_EQ(netSession->createUDPSession(
+                        kBasePort + i, notify, &serverID),
+                     (status_t)OK);
+            CHECK_EQ(netSession->createUDPSession(
+                        0 /* localPort */, "127.0.0.1", kBasePort + i,
+                        notify, &clientID),
+                     (status_t)OK);
+            bench->addClient(clientID);
+            clients.push(clientID);
+        }
+    } else {
+        struct in_addr addr;
+        addr.s_addr = htonl(INADDR_LOOPBACK);
+        int32_t serverID;
+        CHECK_EQ(netSession->createTCPDatagramSession(
+                    addr, kBasePort, notify, &serverID),
+                 (status_t)OK);
+
+        for (size_t i = 0; i < numPairs; ++i) {
+            int32_t clientID;
+            CHECK_EQ(netSession->createTCPDatagramSession(
+                        0 /* localPort */, "127.0.0.1", kBasePort,
+                        notify, &clientID),
+                     (status_t)OK);
+            bench->addClient(clientID);
+            clients.push(clientID);
+        }
+
+        // Both ends of each connection report it.
+        numConnections = 2 * numPairs;
+    }
+
+    if (!bench->waitForConnections(numConnections)) {
+        fprintf(stderr, "sessions didn't connect\n");
+        return 1;
+    }
+
+    // The active ones are spread out over the others.
+    Vector<int32_t> active;
+    for (size_t i = 0; i < numActive; ++i) {
+        active.push(clients[i * numPairs / numActive]);
+    }
+
+    printf("%zu %s session pairs, %zu active, %s\n",
+            numPairs, udp ? "UDP" : "TCP", numActive,
+            property_get_bool("media.stagefright.net-epoll", true)
+                ? "epoll" : "select");
+
+    if (!bench->run(active)) {
+        fprintf(stderr, "round trips didn't finish\n");
+        return 1;
+    }
+    bench->report();
+
+    looper->stop();
+    netSession->stop();
+
+    return 0;
+}
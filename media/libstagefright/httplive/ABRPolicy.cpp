@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ABRPolicy"
+#include <utils/Log.h>
+
+#include "ABRPolicy.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+
+#include <math.h>
+#include <string.h>
+
+namespace android {
+
+// Throughput estimated as the lowest of a fast and a slow moving average,
+// weighted by transfer time, and the harmonic mean of the last few samples.
+// The averages react to drops quickly and to recoveries slowly; the harmonic
+// mean keeps a single fast sample from pulling the estimate up.
+struct ThroughputEstimate {
+    ThroughputEstimate()
+        : mFast(kFastHalfLifeUs),
+          mSlow(kSlowHalfLifeUs),
+          mNumSamples(0),
+          mNextRecent(0) {
+    }
+
+    void add(size_t numBytes, int64_t delayUs) {
+        if (delayUs <= 0 || numBytes == 0) {
+            return;
+        }
+
+        double bps = numBytes * 8E6 / delayUs;
+        mFast.add(bps, delayUs);
+        mSlow.add(bps, delayUs);
+
+        mRecentBps[mNextRecent] = bps;
+        mNextRecent = (mNextRecent + 1) % kNumRecentSamples;
+        ++mNumSamples;
+    }
+
+    // Returns -1 until there are enough samples.
+    int64_t get() const {
+        if (mNumSamples < kMinSamples) {
+            return -1;
+        }
+
+        size_t n = mNumSamples;
+        if (n > kNumRecentSamples) {
+            n = kNumRecentSamples;
+        }
+        double inverseSum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            inverseSum += 1.0 / mRecentBps[i];
+        }
+        double estimate = n / inverseSum;
+
+        if (mFast.get() < estimate) {
+            estimate = mFast.get();
+        }
+        if (mSlow.get() < estimate) {
+            estimate = mSlow.get();
+        }
+        return (int64_t)estimate;
+    }
+
+private:
+    static const int64_t kFastHalfLifeUs = 2000000ll;
+    static const int64_t kSlowHalfLifeUs = 8000000ll;
+    static const size_t kNumRecentSamples = 5;
+    static const size_t kMinSamples = 2;
+
+    struct Average {
+        Average(int64_t halfLifeUs)
+            : mHalfLifeUs(halfLifeUs),
+              mEstimate(0),
+              mTotalWeight(0) {
+        }
+
+        void add(double value, int64_t weightUs) {
+            double alpha = pow(0.5, (double)weightUs / mHalfLifeUs);
+            mEstimate = alpha * mEstimate + (1 - alpha) * value;
+            mTotalWeight = alpha * mTotalWeight + (1 - alpha);
+        }
+
+        // Corrected for the average starting at 0.
+        double get() const {
+            return mTotalWeight > 0 ? mEstimate / mTotalWeight : 0;
+        }
+
+    private:
+        int64_t mHalfLifeUs;
+        double mEstimate;
+        double mTotalWeight;
+    };
+
+    Average mFast;
+    Average mSlow;
+    double mRecentBps[kNumRecentSamples];
+    size_t mNumSamples;
+    size_t mNextRecent;
+};
+
+// The policy LiveSession has always had: switch up when the buffer is above
+// the up switch mark and the long term estimate is 20% above the current
+// variant, down when the buffer is below the down switch mark and the
+// estimate is below the current variant, to the highest variant that fits
+// in 70% of the estimate.
+struct ThresholdABRPolicy : public ABRPolicy {
+    ThresholdABRPolicy() {}
+
+    virtual const char *name() const {
+        return "threshold";
+    }
+
+    virtual ssize_t selectVariant(
+            const Vector<Variant> &variants, const Status &status) {
+        if (status.mBandwidthBps < 0) {
+            return -1;
+        }
+
+        int64_t bandwidthBps = status.mBandwidthBps;
+        int64_t curBandwidthBps = variants[status.mCurIndex].mBandwidthBps;
+        bool canSwitchDown = status.mBufferLow && bandwidthBps < curBandwidthBps;
+        bool canSwitchUp = status.mBufferHigh
+                && bandwidthBps > curBandwidthBps * 12 / 10;
+
+        if (!canSwitchDown && !canSwitchUp) {
+            return -1;
+        }
+
+        // The long term estimate lags behind a drop.
+        if (canSwitchDown && !status.mBandwidthStable
+                && status.mShortTermBandwidthBps < bandwidthBps) {
+            bandwidthBps = status.mShortTermBandwidthBps;
+        }
+
+        size_t index = HighestVariantBelow(variants, bandwidthBps * 7 / 10);
+        if ((canSwitchUp && index > status.mCurIndex)
+                || (canSwitchDown && index < status.mCurIndex)) {
+            return index;
+        }
+        return -1;
+    }
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(ThresholdABRPolicy);
+};
+
+// Picks the highest variant that fits in 85% of the throughput estimate,
+// holding off up switches while the buffer is below the down switch mark.
+struct ThroughputABRPolicy : public ABRPolicy {
+    ThroughputABRPolicy() {}
+
+    virtual const char *name() const {
+        return "throughput";
+    }
+
+    virtual void addThroughputSample(size_t numBytes, int64_t delayUs) {
+        mEstimate.add(numBytes, delayUs);
+    }
+
+    virtual ssize_t selectVariant(
+            const Vector<Variant> &variants, const Status &status) {
+        int64_t bandwidthBps = mEstimate.get();
+        if (bandwidthBps < 0) {
+            return -1;
+        }
+
+        size_t index = HighestVariantBelow(variants, bandwidthBps * 85 / 100);
+        if (index < status.mCurIndex
+                || (index > status.mCurIndex && !status.mBufferLow)) {
+            return index;
+        }
+        return -1;
+    }
+
+private:
+    ThroughputEstimate mEstimate;
+
+    DISALLOW_EVIL_CONSTRUCTORS(ThroughputABRPolicy);
+};
+
+// BOLA (Spiteri et al., "BOLA: Near-Optimal Bitrate Adaptation for Online
+// Videos"): picks the variant m maximizing
+//
+//     (V * (v_m + gp) - Q) / S_m
+//
+// where Q is the buffer level in segments, S_m the segment size, and
+// v_m = ln(S_m / S_0) the utility of variant m. V and gp are set so that the
+// lowest variant is chosen with an empty buffer and the highest one with
+// kBufferTargetUs of buffer.
+//
+// Decisions are buffer based, except that an up switch is never made past
+// what the throughput estimate supports (BOLA-O), and that the throughput
+// rule is used until there is a segment's worth of buffer.
+struct BolaABRPolicy : public ABRPolicy {
+    BolaABRPolicy() {}
+
+    virtual const char *name() const {
+        return "bola";
+    }
+
+    virtual void addThroughputSample(size_t numBytes, int64_t delayUs) {
+        mEstimate.add(numBytes, delayUs);
+    }
+
+    virtual ssize_t selectVariant(
+            const Vector<Variant> &variants, const Status &status) {
+        int64_t bandwidthBps = mEstimate.get();
+        size_t throughputIndex = bandwidthBps < 0
+                ? status.mCurIndex
+                : HighestVariantBelow(variants, bandwidthBps * 85 / 100);
+
+        int64_t segmentDurationUs = status.mSegmentDurationUs;
+        if (segmentDurationUs <= 0) {
+            segmentDurationUs = kDefaultSegmentDurationUs;
+        }
+
+        if (status.mBufferedDurationUs < segmentDurationUs) {
+            if (bandwidthBps < 0 || throughputIndex == status.mCurIndex) {
+                return -1;
+            }
+            return throughputIndex;
+        }
+
+        ssize_t lowest = -1;
+        for (size_t i = 0; i < variants.size(); ++i) {
+            if (variants[i].mUsable && variants[i].mBandwidthBps > 0) {
+                lowest = i;
+                break;
+            }
+        }
+        if (lowest < 0) {
+            return -1;
+        }
+
+        double bufferTarget = (double)kBufferTargetUs / segmentDurationUs;
+        if (bufferTarget < kMinBufferTargetSegments) {
+            bufferTarget = kMinBufferTargetSegments;
+        }
+        double minBps = variants[lowest].mBandwidthBps;
+        double maxUtility =
+            log(variants[variants.size() - 1].mBandwidthBps / minBps);
+        double gp = kGammaP;
+        double v = (bufferTarget - 1) / (maxUtility + gp);
+        double q = (double)status.mBufferedDurationUs / segmentDurationUs;
+
+        size_t index = lowest;
+        double bestScore = 0;
+        for (size_t i = lowest; i < variants.size(); ++i) {
+            if (!variants[i].mUsable) {
+                continue;
+            }
+            double bps = variants[i].mBandwidthBps;
+            double score = (v * (log(bps / minBps) + gp) - q) / bps;
+            if (i == (size_t)lowest || score > bestScore) {
+                index = i;
+                bestScore = score;
+            }
+        }
+
+        if (index > status.mCurIndex && bandwidthBps >= 0) {
+            size_t maxIndex = throughputIndex > status.mCurIndex
+                    ? throughputIndex : status.mCurIndex;
+            if (index > maxIndex) {
+                index = maxIndex;
+            }
+        }
+
+        return index != status.mCurIndex ? (ssize_t)index : -1;
+    }
+
+private:
+    static const int64_t kBufferTargetUs = 30000000ll;
+    static const int64_t kDefaultSegmentDurationUs = 6000000ll;
+    static const int32_t kMinBufferTargetSegments = 3;
+    static const int32_t kGammaP = 5;
+
+    ThroughputEstimate mEstimate;
+
+    DISALLOW_EVIL_CONSTRUCTORS(BolaABRPolicy);
+};
+
+// static
+sp<ABRPolicy> ABRPolicy::Create(const char *name) {
+    if (name == NULL || !strcmp(name, "threshold")) {
+        return new ThresholdABRPolicy;
+    } else if (!strcmp(name, "throughput")) {
+        return new ThroughputABRPolicy;
+    } else if (!strcmp(name, "bola")) {
+        return new BolaABRPolicy;
+    }
+
+    ALOGW("unknown ABR policy '%s', using threshold", name);
+    return new ThresholdABRPolicy;
+}
+
+void ABRPolicy::addThroughputSample(
+        size_t /* numBytes */, int64_t /* delayUs */) {
+}
+
+// static
+size_t ABRPolicy::HighestVariantBelow(
+        const Vector<Variant> &variants, int64_t bandwidthBps) {
+    CHECK(!variants.isEmpty());
+
+    // If every variant is blacklisted, take the lowest and hope it's alive.
+    size_t lowest = 0;
+    for (size_t i = 0; i < variants.size(); ++i) {
+        if (variants[i].mUsable) {
+            lowest = i;
+            break;
+        }
+    }
+
+    size_t index = variants.size() - 1;
+    while (index > lowest) {
+        if (variants[index].mUsable
+                && variants[index].mBandwidthBps <= bandwidthBps) {
+            break;
+        }
+        --index;
+    }
+    return index;
+}
+
+}  // namespace android
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ABR_POLICY_H_
+
+#define ABR_POLICY_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Decides which variant of a master playlist LiveSession should fetch.
+//
+// LiveSession feeds the policy the same throughput samples its bandwidth
+// estimator gets, and asks it for a variant every time it polls the buffers.
+// Policies are pure decision logic with no clock of their own, so that the
+// offline simulator can replay traces through them.
+struct ABRPolicy : public RefBase {
+    struct Variant {
+        int32_t mBandwidthBps;  // BANDWIDTH attribute
+        bool mUsable;           // not blacklisted or capped
+    };
+
+    struct Status {
+        size_t mCurIndex;
+        // Lowest buffered duration across the audio and video streams.
+        int64_t mBufferedDurationUs;
+        int64_t mSegmentDurationUs;
+        // Buffer above LiveSession's up switch mark / below its down
+        // switch mark.
+        bool mBufferHigh;
+        bool mBufferLow;
+        // LiveSession's long term and short term estimates, -1 if none yet.
+        int32_t mBandwidthBps;
+        int32_t mShortTermBandwidthBps;
+        bool mBandwidthStable;
+    };
+
+    // name is one of "threshold" (the default), "throughput" or "bola".
+    static sp<ABRPolicy> Create(const char *name);
+
+    virtual const char *name() const = 0;
+
+    virtual void addThroughputSample(size_t numBytes, int64_t delayUs);
+
+    // Returns the index of the variant to switch to, or a negative value to
+    // stay on status.mCurIndex. variants are sorted by ascending bandwidth.
+    virtual ssize_t selectVariant(
+            const Vector<Variant> &variants, const Status &status) = 0;
+
+    // The highest usable variant whose bandwidth is at most bandwidthBps,
+    // or the lowest usable one if there is none.
+    static size_t HighestVariantBelow(
+            const Vector<Variant> &variants, int64_t bandwidthBps);
+
+protected:
+    ABRPolicy() {}
+    virtual ~ABRPolicy() {}
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(ABRPolicy);
+};
+
+}  // namespace android
+
+#endif  // ABR_POLICY_H_
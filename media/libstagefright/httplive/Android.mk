@@ -3,11 +3,13 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:=               \
+        ABRPolicy.cpp           \
         HTTPDownloader.cpp      \
         LiveDataSource.cpp      \
         LiveSession.cpp         \
         M3UParser.cpp           \
         PlaylistFetcher.cpp     \
+        SegmentPrefetcher.cpp   \
 
 LOCAL_C_INCLUDES:= \
 	$(TOP)/frameworks/av/media/libstagefright \
@@ -33,3 +35,86 @@ ifeq ($(TARGET_ARCH),arm)
 endif
 
 include $(BUILD_SHARED_LIBRARY)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tests/HLSPrefetchBench.cpp
+
+LOCAL_C_INCLUDES := \
+	$(TOP)/frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/av/media/libstagefright/httplive \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+        libbinder \
+        libmedia \
+        libstagefright \
+        libstagefright_foundation \
+        libstagefright_httplive \
+        libutils \
+        liblog
+
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_CLANG := true
+
+LOCAL_MODULE := stagefright_hls_prefetch_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tests/ABRSimulator.cpp
+
+LOCAL_C_INCLUDES := \
+	$(TOP)/frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/av/media/libstagefright/httplive \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+        libmedia \
+        libstagefright_foundation \
+        libstagefright_httplive \
+        libutils \
+        liblog
+
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_CLANG := true
+
+LOCAL_MODULE := stagefright_hls_abr_sim
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tests/M3UParserBench.cpp
+
+LOCAL_C_INCLUDES := \
+	$(TOP)/frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/av/media/libstagefright/httplive \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+        libmedia \
+        libstagefright_foundation \
+        libstagefright_httplive \
+        libutils \
+        liblog
+
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_CLANG := true
+
+LOCAL_MODULE := stagefright_m3u_parser_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -19,6 +19,7 @@
 #include <utils/Log.h>
 
 #include "LiveSession.h"
+#include "ABRPolicy.h"
 #include "HTTPDownloader.h"
 #include "M3UParser.h"
 #include "PlaylistFetcher.h"
@@ -302,10 +303,17 @@ LiveSession::LiveSession(
       mUpSwitchMark(kUpSwitchMarkUs),
       mDownSwitchMark(kDownSwitchMarkUs),
       mUpSwitchMargin(kUpSwitchMarginUs),
+      mLastBufferedDurationUs(-1ll),
+      mTargetDurationUs(-1ll),
       mFirstTimeUsValid(false),
       mFirstTimeUs(0),
       mLastSeekTimeUs(0),
       mHasMetadata(false) {
+    char value[PROPERTY_VALUE_MAX];
+    mABRPolicy = ABRPolicy::Create(
+            property_get("media.httplive.abr", value, NULL) ? value : NULL);
+    ALOGV("using %s ABR policy", mABRPolicy->name());
+
     mStreams[kAudioIndex] = StreamItem("audio");
     mStreams[kVideoIndex] = StreamItem("video");
     mStreams[kSubtitleIndex] = StreamItem("subtitles");
@@ -722,6 +730,7 @@ void LiveSession::onMessageReceived(const sp<AMessage> &msg) {
                     mUpSwitchMark = min(kUpSwitchMarkUs, targetDurationUs * 7 / 4);
                     mDownSwitchMark = min(kDownSwitchMarkUs, targetDurationUs * 9 / 4);
                     mUpSwitchMargin = min(kUpSwitchMarginUs, targetDurationUs);
+                    mTargetDurationUs = targetDurationUs;
                     break;
                 }
 
@@ -884,6 +893,34 @@ void LiveSession::onMessageReceived(const sp<AMessage> &msg) {
                     break;
                 }
 
+                case PlaylistFetcher::kWhatVariantSwitched:
+                {
+                    AString uri, newUri;
+                    CHECK(msg->findString("uri", &uri));
+                    CHECK(msg->findString("newUri", &newUri));
+
+                    // The fetcher notifies with newUri from now on.
+                    ssize_t index = mFetcherInfos.indexOfKey(uri);
+                    if (index >= 0) {
+                        FetcherInfo info = mFetcherInfos.valueAt(index);
+                        mFetcherInfos.removeItemsAt(index);
+                        mFetcherInfos.add(newUri, info);
+                    }
+                    for (size_t i = 0; i < kMaxStreams; ++i) {
+                        if (mStreams[i].mUri == uri) {
+                            mStreams[i].mUri = newUri;
+                        }
+                    }
+
+                    if (mContinuation != NULL) {
+                        CHECK_GT(mContinuationCounter, 0);
+                        if (--mContinuationCounter == 0) {
+                            mContinuation->post();
+                        }
+                    }
+                    break;
+                }
+
                 case PlaylistFetcher::kWhatMetadataDetected:
                 {
                     if (!mHasMetadata) {
@@ -920,6 +957,12 @@ void LiveSession::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatFinishVariantSwitch:
+        {
+            onFinishVariantSwitch();
+            break;
+        }
+
         case kWhatPollBuffering:
         {
             int32_t generation;
@@ -1313,6 +1356,9 @@ float LiveSession::getAbortThreshold(
 
 void LiveSession::addBandwidthMeasurement(size_t numBytes, int64_t delayUs) {
     mBandwidthEstimator->addBandwidthMeasurement(numBytes, delayUs);
+
+    Mutex::Autolock autoLock(mABRLock);
+    mABRPolicy->addThroughputSample(numBytes, delayUs);
 }
 
 ssize_t LiveSession::getLowestValidBandwidthIndex() const {
@@ -2152,6 +2198,7 @@ bool LiveSession::checkBuffering(
     if (getDuration(&durationUs) != OK) {
         durationUs = -1;
     }
+    mLastBufferedDurationUs = -1ll;
     for (size_t i = 0; i < mPacketSources.size(); ++i) {
         // we don't check subtitles for buffering level
         if (!(mStreamMask & mPacketSources.keyAt(i)
@@ -2191,6 +2238,10 @@ bool LiveSession::checkBuffering(
             ++readyCount;
         }
         if (!mPacketSources[i]->isFinished(0)) {
+            if (mLastBufferedDurationUs < 0
+                    || bufferedDurationUs < mLastBufferedDurationUs) {
+                mLastBufferedDurationUs = bufferedDurationUs;
+            }
             if (bufferedDurationUs < kUnderflowMarkUs) {
                 ++underflowCount;
             }
@@ -2302,6 +2353,12 @@ bool LiveSession::switchBandwidthIfNeeded(bool bufferHigh, bool bufferLow) {
         return false;
     }
 
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.httplive.bw-index", value, NULL)) {
+        // pinned to a variant
+        return false;
+    }
+
     int32_t bandwidthBps, shortTermBps;
     bool isStable;
     if (mBandwidthEstimator->estimateBandwidth(
@@ -2313,45 +2370,163 @@ bool LiveSession::switchBandwidthIfNeeded(bool bufferHigh, bool bufferLow) {
         mLastBandwidthStable = isStable;
     } else {
         ALOGV("no bandwidth estimate.");
+        // the policy may have an estimate of its own
+        bandwidthBps = shortTermBps = -1;
+        isStable = false;
+    }
+
+    long maxBw = 0;
+    if (property_get("media.httplive.max-bw", value, NULL)) {
+        char *end;
+        maxBw = strtoul(value, &end, 10);
+        if (end == value || *end != '\0') {
+            maxBw = 0;
+        }
+    }
+
+    Vector<ABRPolicy::Variant> variants;
+    for (size_t i = 0; i < mBandwidthItems.size(); ++i) {
+        const BandwidthItem &item = mBandwidthItems[i];
+        ABRPolicy::Variant variant;
+        variant.mBandwidthBps = item.mBandwidth;
+        variant.mUsable = isBandwidthValid(item)
+                && (maxBw <= 0 || (long)item.mBandwidth <= maxBw);
+        variants.push(variant);
+    }
+
+    ABRPolicy::Status status;
+    status.mCurIndex = mCurBandwidthIndex;
+    status.mBufferedDurationUs = mLastBufferedDurationUs;
+    status.mSegmentDurationUs = mTargetDurationUs;
+    status.mBufferHigh = bufferHigh;
+    status.mBufferLow = bufferLow;
+    status.mBandwidthBps = bandwidthBps;
+    status.mShortTermBandwidthBps = shortTermBps;
+    status.mBandwidthStable = isStable;
+
+    ssize_t bandwidthIndex;
+    {
+        Mutex::Autolock autoLock(mABRLock);
+        bandwidthIndex = mABRPolicy->selectVariant(variants, status);
+    }
+
+    if (bandwidthIndex < 0 || bandwidthIndex == mCurBandwidthIndex) {
         return false;
     }
 
-    int32_t curBandwidth = mBandwidthItems.itemAt(mCurBandwidthIndex).mBandwidth;
-    // canSwithDown and canSwitchUp can't both be true.
-    // we only want to switch up when measured bw is 120% higher than current variant,
-    // and we only want to switch down when measured bw is below current variant.
-    bool canSwitchDown = bufferLow
-            && (bandwidthBps < (int32_t)curBandwidth);
-    bool canSwitchUp = bufferHigh
-            && (bandwidthBps > (int32_t)curBandwidth * 12 / 10);
-
-    if (canSwitchDown || canSwitchUp) {
-        // bandwidth estimating has some delay, if we have to downswitch when
-        // it hasn't stabilized, use the short term to guess real bandwidth,
-        // since it may be dropping too fast.
-        // (note this doesn't apply to upswitch, always use longer average there)
-        if (!isStable && canSwitchDown) {
-            if (shortTermBps < bandwidthBps) {
-                bandwidthBps = shortTermBps;
+    if (mInPreparationPhase) {
+        // only switch down while preparing, restarting with the new index
+        // is faster and playback experience is cleaner.
+        if (bandwidthIndex > mCurBandwidthIndex) {
+            return false;
+        }
+        changeConfiguration(0, bandwidthIndex);
+        return true;
+    }
+
+    if (!switchVariantInPlace(bandwidthIndex)) {
+        changeConfiguration(-1ll, bandwidthIndex);
+    }
+    return true;
+}
+
+/*
+ * Has the fetchers move to the variant at bandwidthIndex at their next segment
+ * boundary, without restarting them. Only possible if the new variant has the
+ * same streams, laid out over the same number of playlists, as the current
+ * one; returns false otherwise.
+ */
+bool LiveSession::switchVariantInPlace(size_t bandwidthIndex) {
+    if (!property_get_bool("media.httplive.seamless-switch", true)) {
+        return false;
+    }
+
+    const BandwidthItem &item = mBandwidthItems.itemAt(bandwidthIndex);
+    uint32_t streamMask = 0;
+    AString newUris[kMaxStreams];
+    for (size_t i = 0; i < kMaxStreams; ++i) {
+        if (!(mStreamMask & indexToType(i))) {
+            continue;
+        }
+        if (!mPlaylist->getTypeURI(
+                item.mPlaylistIndex, mStreams[i].mType, &newUris[i])) {
+            return false;
+        }
+        streamMask |= indexToType(i);
+    }
+    if (streamMask != mStreamMask) {
+        return false;
+    }
+
+    // Every fetcher has to map to exactly one new playlist.
+    KeyedVector<AString, AString> uriMap;
+    for (size_t i = 0; i < kMaxStreams; ++i) {
+        if (!(mStreamMask & indexToType(i))) {
+            continue;
+        }
+        const AString &uri = mStreams[i].mUri;
+        if (mFetcherInfos.indexOfKey(uri) < 0) {
+            return false;
+        }
+        ssize_t index = uriMap.indexOfKey(uri);
+        if (index >= 0) {
+            if (uriMap.valueAt(index) != newUris[i]) {
+                return false;
+            }
+            continue;
+        }
+        for (size_t j = 0; j < uriMap.size(); ++j) {
+            if (uriMap.valueAt(j) == newUris[i]) {
+                return false;
             }
         }
+        uriMap.add(uri, newUris[i]);
+    }
+    for (size_t i = 0; i < uriMap.size(); ++i) {
+        if (uriMap.keyAt(i) != uriMap.valueAt(i)
+                && mFetcherInfos.indexOfKey(uriMap.valueAt(i)) >= 0) {
+            return false;
+        }
+    }
 
-        ssize_t bandwidthIndex = getBandwidthIndex(bandwidthBps);
+    ALOGI("#### Starting Seamless Bandwidth Switch: %zd => %zu",
+            mCurBandwidthIndex, bandwidthIndex);
 
-        // it's possible that we're checking for canSwitchUp case, but the returned
-        // bandwidthIndex is < mCurBandwidthIndex, as getBandwidthIndex() only uses 70%
-        // of measured bw. In that case we don't want to do anything, since we have
-        // both enough buffer and enough bw.
-        if ((canSwitchUp && bandwidthIndex > mCurBandwidthIndex)
-         || (canSwitchDown && bandwidthIndex < mCurBandwidthIndex)) {
-            // if not yet prepared, just restart again with new bw index.
-            // this is faster and playback experience is cleaner.
-            changeConfiguration(
-                    mInPreparationPhase ? 0 : -1ll, bandwidthIndex);
-            return true;
+    mOrigBandwidthIndex = mCurBandwidthIndex;
+    mCurBandwidthIndex = bandwidthIndex;
+    mReconfigurationInProgress = true;
+
+    // Acks come back as kWhatVariantSwitched, the fetchers are keyed by their
+    // new uri from then on.
+    mContinuation = new AMessage(kWhatFinishVariantSwitch, this);
+    mContinuationCounter = 0;
+    for (size_t i = 0; i < uriMap.size(); ++i) {
+        if (uriMap.keyAt(i) == uriMap.valueAt(i)) {
+            continue;
         }
+        ALOGV("switching fetcher %s to %s",
+                uriMap.keyAt(i).c_str(), uriMap.valueAt(i).c_str());
+        mFetcherInfos.valueFor(uriMap.keyAt(i)).mFetcher->switchVariantAsync(
+                uriMap.valueAt(i).c_str());
+        ++mContinuationCounter;
+    }
+
+    if (mContinuationCounter == 0) {
+        mContinuation->post();
+    }
+    return true;
+}
+
+void LiveSession::onFinishVariantSwitch() {
+    mContinuation.clear();
+    mReconfigurationInProgress = false;
+    mOrigBandwidthIndex = mCurBandwidthIndex;
+
+    ALOGI("#### Finished Seamless Bandwidth Switch: %zd", mCurBandwidthIndex);
+
+    if (mDisconnectReplyID != NULL) {
+        finishDisconnect();
     }
-    return false;
 }
 
 void LiveSession::postError(status_t err) {
@@ -21,12 +21,14 @@
 #include <media/stagefright/foundation/AHandler.h>
 #include <media/mediaplayer.h>
 
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 
 #include "mpeg2ts/ATSParser.h"
 
 namespace android {
 
+struct ABRPolicy;
 struct ABuffer;
 struct AReplyToken;
 struct AnotherPacketSource;
@@ -129,6 +131,7 @@ private:
         kWhatChangeConfiguration2       = 'chC2',
         kWhatChangeConfiguration3       = 'chC3',
         kWhatPollBuffering              = 'poll',
+        kWhatFinishVariantSwitch        = 'fnVS',
     };
 
     // Bandwidth Switch Mark Defaults
@@ -202,6 +205,9 @@ private:
     int32_t mLastBandwidthBps;
     bool mLastBandwidthStable;
     sp<BandwidthEstimator> mBandwidthEstimator;
+    // Fed from the fetcher looper, consulted from ours.
+    Mutex mABRLock;
+    sp<ABRPolicy> mABRPolicy;
 
     sp<M3UParser> mPlaylist;
     int32_t mMaxWidth;
@@ -239,6 +245,8 @@ private:
     int64_t mUpSwitchMark;
     int64_t mDownSwitchMark;
     int64_t mUpSwitchMargin;
+    int64_t mLastBufferedDurationUs;
+    int64_t mTargetDurationUs;
 
     sp<AReplyToken> mDisconnectReplyID;
     sp<AReplyToken> mSeekReplyID;
@@ -291,6 +299,8 @@ private:
             sp<AMessage> &msg, int64_t delayUs, bool *needResumeUntil);
 
     bool switchBandwidthIfNeeded(bool bufferHigh, bool bufferLow);
+    bool switchVariantInPlace(size_t bandwidthIndex);
+    void onFinishVariantSwitch();
     bool tryBandwidthFallback();
 
     void schedulePollBuffering();
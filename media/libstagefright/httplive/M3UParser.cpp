@@ -21,6 +21,7 @@
 #include "M3UParser.h"
 #include <binder/Parcel.h>
 #include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaDefs.h>
@@ -28,6 +29,8 @@
 #include <media/stagefright/Utils.h>
 #include <media/mediaplayer.h>
 
+#include <ctype.h>
+
 namespace android {
 
 struct M3UParser::MediaGroup : public RefBase {
@@ -242,8 +245,11 @@ bool M3UParser::MediaGroup::getActiveURI(AString *uri) const {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+static bool MakeURL(const char *baseURL, const char *url, AString *out);
+
 M3UParser::M3UParser(
-        const char *baseURI, const void *data, size_t size)
+        const char *baseURI, const void *data, size_t size,
+        const sp<M3UParser> &previous)
     : mInitCheck(NO_INIT),
       mBaseURI(baseURI),
       mIsExtM3U(false),
@@ -256,7 +262,7 @@ M3UParser::M3UParser(
       mDiscontinuitySeq(0),
       mDiscontinuityCount(0),
       mSelectedIndex(-1) {
-    mInitCheck = parse(data, size);
+    mInitCheck = parse(data, size, previous);
 }
 
 M3UParser::~M3UParser() {
@@ -304,7 +310,7 @@ sp<AMessage> M3UParser::meta() {
 }
 
 size_t M3UParser::size() {
-    return mItems.size();
+    return mIsVariantPlaylist ? mItems.size() : mSegments.size();
 }
 
 bool M3UParser::itemAt(size_t index, AString *uri, sp<AMessage> *meta) {
@@ -316,21 +322,95 @@ bool M3UParser::itemAt(size_t index, AString *uri, sp<AMessage> *meta) {
         *meta = NULL;
     }
 
-    if (index >= mItems.size()) {
+    if (mIsVariantPlaylist) {
+        if (index >= mItems.size()) {
+            return false;
+        }
+
+        if (uri) {
+            *uri = mItems.itemAt(index).mURI;
+        }
+
+        if (meta) {
+            *meta = mItems.itemAt(index).mMeta;
+        }
+
+        return true;
+    }
+
+    if (index >= mSegments.size()) {
         return false;
     }
 
+    const Segment &segment = mSegments.itemAt(index);
+
     if (uri) {
-        *uri = mItems.itemAt(index).mURI;
+        CHECK(MakeURL(mBaseURI.c_str(),
+                (const char *)mData->data() + segment.mURIOffset, uri));
     }
 
     if (meta) {
-        *meta = mItems.itemAt(index).mMeta;
+        if (segment.mHasCipherInfo) {
+            *meta = mCipherInfos.itemAt(segment.mCipherIndex)->dup();
+        } else {
+            *meta = new AMessage;
+        }
+        (*meta)->setInt64("durationUs", segment.mDurationUs);
+        (*meta)->setInt32("discontinuity-sequence", segment.mDiscontinuitySeq);
+        if (segment.mDiscontinuity) {
+            (*meta)->setInt32("discontinuity", true);
+        }
+        if (segment.mRangeLength >= 0) {
+            (*meta)->setInt64("range-offset", segment.mRangeOffset);
+            (*meta)->setInt64("range-length", segment.mRangeLength);
+        }
     }
 
     return true;
 }
 
+int64_t M3UParser::getSegmentStartTimeUs(size_t index) const {
+    CHECK_LT(index, mSegments.size());
+    return mSegments.itemAt(index).mStartTimeUs;
+}
+
+int64_t M3UParser::getSegmentDurationUs(size_t index) const {
+    CHECK_LT(index, mSegments.size());
+    return mSegments.itemAt(index).mDurationUs;
+}
+
+size_t M3UParser::getSegmentDiscontinuitySeq(size_t index) const {
+    CHECK_LT(index, mSegments.size());
+    return mSegments.itemAt(index).mDiscontinuitySeq;
+}
+
+size_t M3UParser::getSegmentIndexForTime(int64_t timeUs) const {
+    // A live playlist can be fetched before it has any segments.
+    if (mSegments.isEmpty()) {
+        return 0;
+    }
+
+    // the first segment that ends after timeUs
+    size_t lo = 0;
+    size_t hi = mSegments.size() - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const Segment &segment = mSegments.itemAt(mid);
+        if (timeUs < segment.mStartTimeUs + segment.mDurationUs) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+sp<AMessage> M3UParser::getCipherInfo(size_t index) const {
+    CHECK_LT(index, mSegments.size());
+    ssize_t cipherIndex = mSegments.itemAt(index).mCipherIndex;
+    return cipherIndex < 0 ? NULL : mCipherInfos.itemAt(cipherIndex);
+}
+
 void M3UParser::pickRandomMediaItems() {
     for (size_t i = 0; i < mMediaGroups.size(); ++i) {
         mMediaGroups.valueAt(i)->pickRandomMediaItems();
@@ -544,112 +624,138 @@ static bool MakeURL(const char *baseURL, const char *url, AString *out) {
     return true;
 }
 
-status_t M3UParser::parse(const void *_data, size_t size) {
+static bool StartsWith(const char *line, const char *prefix) {
+    return !strncmp(line, prefix, strlen(prefix));
+}
+
+status_t M3UParser::parse(
+        const void *_data, size_t size, const sp<M3UParser> &previous) {
+    // Lines are NUL terminated in place, so that they can be parsed without
+    // copying them out, and compared with the previous playlist's.
+    mData = new ABuffer(size + 1);
+    char *data = (char *)mData->data();
+    memcpy(data, _data, size);
+    data[size] = '\0';
+
+    char *end = data + size;
+    for (char *lf = data; (lf = (char *)memchr(lf, '\n', end - lf)) != NULL;) {
+        *lf = '\0';
+        if (lf > data && lf[-1] == '\r') {
+            lf[-1] = '\0';
+        }
+        ++lf;
+    }
+    if (size > 0 && data[size - 1] == '\r') {
+        data[size - 1] = '\0';
+    }
+
     int32_t lineNo = 0;
 
     sp<AMessage> itemMeta;
 
-    const char *data = (const char *)_data;
+    // The segment the media tags seen since the last uri line apply to.
+    Segment segment;
+    memset(&segment, 0, sizeof(segment));
+    segment.mRangeLength = -1;
+    bool haveDuration = false;
+    sp<AMessage> cipherInfo;
+    ssize_t cipherIndex = -1;
+
     size_t offset = 0;
     uint64_t segmentRangeOffset = 0;
     while (offset < size) {
-        size_t offsetLF = offset;
-        while (offsetLF < size && data[offsetLF] != '\n') {
-            ++offsetLF;
-        }
+        const char *line = &data[offset];
+        size_t offsetLF = offset + strlen(line);
 
-        AString line;
-        if (offsetLF > offset && data[offsetLF - 1] == '\r') {
-            line.setTo(&data[offset], offsetLF - offset - 1);
-        } else {
-            line.setTo(&data[offset], offsetLF - offset);
-        }
+        // ALOGI("#%s#", line);
 
-        // ALOGI("#%s#", line.c_str());
-
-        if (line.empty()) {
+        if (offsetLF == offset) {
             offset = offsetLF + 1;
             continue;
         }
 
-        if (lineNo == 0 && line == "#EXTM3U") {
+        if (lineNo == 0 && !strcmp(line, "#EXTM3U")) {
             mIsExtM3U = true;
         }
 
         if (mIsExtM3U) {
             status_t err = OK;
 
-            if (line.startsWith("#EXT-X-TARGETDURATION")) {
+            if (StartsWith(line, "#EXT-X-TARGETDURATION")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseMetaData(line, &mMeta, "target-duration");
-            } else if (line.startsWith("#EXT-X-MEDIA-SEQUENCE")) {
+                err = parseMetaData(AString(line), &mMeta, "target-duration");
+            } else if (StartsWith(line, "#EXT-X-MEDIA-SEQUENCE")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseMetaData(line, &mMeta, "media-sequence");
-            } else if (line.startsWith("#EXT-X-KEY")) {
+                err = parseMetaData(AString(line), &mMeta, "media-sequence");
+            } else if (StartsWith(line, "#EXT-X-KEY")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseCipherInfo(line, &itemMeta, mBaseURI);
-            } else if (line.startsWith("#EXT-X-ENDLIST")) {
+                err = parseCipherInfo(AString(line), &cipherInfo, mBaseURI);
+            } else if (StartsWith(line, "#EXT-X-ENDLIST")) {
                 mIsComplete = true;
-            } else if (line.startsWith("#EXT-X-PLAYLIST-TYPE:EVENT")) {
+            } else if (StartsWith(line, "#EXT-X-PLAYLIST-TYPE:EVENT")) {
                 mIsEvent = true;
-            } else if (line.startsWith("#EXTINF")) {
+            } else if (StartsWith(line, "#EXTINF")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseMetaDataDuration(line, &itemMeta, "durationUs");
-            } else if (line.startsWith("#EXT-X-DISCONTINUITY-SEQUENCE")) {
+                const char *colon = strchr(line, ':');
+                double durationSecs;
+                if (colon == NULL) {
+                    err = ERROR_MALFORMED;
+                } else {
+                    err = ParseDouble(colon + 1, &durationSecs);
+                }
+                if (err == OK) {
+                    segment.mDurationUs = (int64_t)(durationSecs * 1E6);
+                    haveDuration = true;
+                }
+            } else if (StartsWith(line, "#EXT-X-DISCONTINUITY-SEQUENCE")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
                 size_t seq;
-                err = parseDiscontinuitySequence(line, &seq);
+                err = parseDiscontinuitySequence(AString(line), &seq);
                 if (err == OK) {
                     mDiscontinuitySeq = seq;
                     ALOGI("mDiscontinuitySeq %zu", mDiscontinuitySeq);
                 } else {
                     ALOGI("Failed to parseDiscontinuitySequence %d", err);
                 }
-            } else if (line.startsWith("#EXT-X-DISCONTINUITY")) {
+            } else if (StartsWith(line, "#EXT-X-DISCONTINUITY")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                if (itemMeta == NULL) {
-                    itemMeta = new AMessage;
-                }
-                itemMeta->setInt32("discontinuity", true);
+                segment.mDiscontinuity = true;
                 ++mDiscontinuityCount;
-            } else if (line.startsWith("#EXT-X-STREAM-INF")) {
+            } else if (StartsWith(line, "#EXT-X-STREAM-INF")) {
                 if (mMeta != NULL) {
                     return ERROR_MALFORMED;
                 }
                 mIsVariantPlaylist = true;
-                err = parseStreamInf(line, &itemMeta);
-            } else if (line.startsWith("#EXT-X-BYTERANGE")) {
+                err = parseStreamInf(AString(line), &itemMeta);
+            } else if (StartsWith(line, "#EXT-X-BYTERANGE")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
 
-                uint64_t length, offset;
-                err = parseByteRange(line, segmentRangeOffset, &length, &offset);
+                uint64_t rangeLength, rangeOffset;
+                err = parseByteRange(
+                        line, segmentRangeOffset, &rangeLength, &rangeOffset);
 
                 if (err == OK) {
-                    if (itemMeta == NULL) {
-                        itemMeta = new AMessage;
-                    }
-
-                    itemMeta->setInt64("range-offset", offset);
-                    itemMeta->setInt64("range-length", length);
+                    segment.mRangeOffset = rangeOffset;
+                    segment.mRangeLength = rangeLength;
 
-                    segmentRangeOffset = offset + length;
+                    segmentRangeOffset = rangeOffset + rangeLength;
                 }
-            } else if (line.startsWith("#EXT-X-MEDIA")) {
-                err = parseMedia(line);
+            } else if (StartsWith(line, "#EXT-X-MEDIA")) {
+                err = parseMedia(AString(line));
             }
 
             if (err != OK) {
@@ -657,25 +763,50 @@ status_t M3UParser::parse(const void *_data, size_t size) {
             }
         }
 
-        if (!line.startsWith("#")) {
+        if (line[0] != '#') {
             if (!mIsVariantPlaylist) {
-                int64_t durationUs;
-                if (itemMeta == NULL
-                        || !itemMeta->findInt64("durationUs", &durationUs)) {
+                if (!haveDuration) {
                     return ERROR_MALFORMED;
                 }
-                itemMeta->setInt32("discontinuity-sequence",
-                        mDiscontinuitySeq + mDiscontinuityCount);
-            }
 
-            mItems.push();
-            Item *item = &mItems.editItemAt(mItems.size() - 1);
+                if (cipherInfo != NULL) {
+                    mCipherInfos.push(cipherInfo);
+                    cipherIndex = mCipherInfos.size() - 1;
+                    segment.mHasCipherInfo = true;
+                }
+
+                segment.mURIOffset = offset;
+                segment.mEndOffset = offsetLF + 1;
+                segment.mDiscontinuitySeq =
+                    mDiscontinuitySeq + mDiscontinuityCount;
+                segment.mCipherIndex = cipherIndex;
+                mSegments.push(segment);
+
+                memset(&segment, 0, sizeof(segment));
+                segment.mRangeLength = -1;
+                haveDuration = false;
+                cipherInfo.clear();
+
+                if (mSegments.size() == 1 && previous != NULL) {
+                    size_t nextOffset = copySegmentsFrom(
+                            previous, offsetLF + 1,
+                            &segmentRangeOffset, &cipherIndex);
+                    if (nextOffset > 0) {
+                        offset = nextOffset;
+                        lineNo += mSegments.size();
+                        continue;
+                    }
+                }
+            } else {
+                mItems.push();
+                Item *item = &mItems.editItemAt(mItems.size() - 1);
 
-            CHECK(MakeURL(mBaseURI.c_str(), line.c_str(), &item->mURI));
+                CHECK(MakeURL(mBaseURI.c_str(), line, &item->mURI));
 
-            item->mMeta = itemMeta;
+                item->mMeta = itemMeta;
 
-            itemMeta.clear();
+                itemMeta.clear();
+            }
         }
 
         offset = offsetLF + 1;
@@ -698,7 +829,14 @@ status_t M3UParser::parse(const void *_data, size_t size) {
         if (mMeta != NULL) {
             mMeta->findInt32("media-sequence", &mFirstSeqNumber);
         }
-        mLastSeqNumber = mFirstSeqNumber + mItems.size() - 1;
+        mLastSeqNumber = mFirstSeqNumber + mSegments.size() - 1;
+
+        int64_t startTimeUs = 0;
+        for (size_t i = 0; i < mSegments.size(); ++i) {
+            Segment &segment = mSegments.editItemAt(i);
+            segment.mStartTimeUs = startTimeUs;
+            startTimeUs += segment.mDurationUs;
+        }
     }
 
     for (size_t i = 0; i < mItems.size(); ++i) {
@@ -969,50 +1107,157 @@ status_t M3UParser::parseCipherInfo(
     return OK;
 }
 
+// Parses an unsigned number, allowing for surrounding blanks, that ends at
+// terminator or at the end of the string.
+static bool ParseUInt64(const char *s, char terminator, uint64_t *x) {
+    while (isspace(*s)) {
+        ++s;
+    }
+
+    char *end;
+    *x = strtoull(s, &end, 10);
+    if (end == s) {
+        return false;
+    }
+
+    while (isspace(*end)) {
+        ++end;
+    }
+    return *end == '\0' || *end == terminator;
+}
+
 // static
 status_t M3UParser::parseByteRange(
-        const AString &line, uint64_t curOffset,
+        const char *line, uint64_t curOffset,
         uint64_t *length, uint64_t *offset) {
-    ssize_t colonPos = line.find(":");
+    const char *colon = strchr(line, ':');
 
-    if (colonPos < 0) {
+    if (colon == NULL) {
         return ERROR_MALFORMED;
     }
 
-    ssize_t atPos = line.find("@", colonPos + 1);
+    if (!ParseUInt64(colon + 1, '@', length)) {
+        return ERROR_MALFORMED;
+    }
 
-    AString lenStr;
-    if (atPos < 0) {
-        lenStr = AString(line, colonPos + 1, line.size() - colonPos - 1);
+    const char *at = strchr(colon + 1, '@');
+    if (at != NULL) {
+        if (!ParseUInt64(at + 1, '\0', offset)) {
+            return ERROR_MALFORMED;
+        }
     } else {
-        lenStr = AString(line, colonPos + 1, atPos - colonPos - 1);
+        *offset = curOffset;
     }
 
-    lenStr.trim();
+    return OK;
+}
 
-    const char *s = lenStr.c_str();
-    char *end;
-    *length = strtoull(s, &end, 10);
+static bool CipherInfoEquals(const sp<AMessage> &a, const sp<AMessage> &b) {
+    if (a == NULL || b == NULL) {
+        return a == NULL && b == NULL;
+    }
 
-    if (s == end || *end != '\0') {
-        return ERROR_MALFORMED;
+    static const char *keys[] = { "cipher-method", "cipher-uri", "cipher-iv" };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(const char *); ++i) {
+        AString x, y;
+        bool hasX = a->findString(keys[i], &x);
+        bool hasY = b->findString(keys[i], &y);
+        if (hasX != hasY || (hasX && x != y)) {
+            return false;
+        }
     }
 
-    if (atPos >= 0) {
-        AString offStr = AString(line, atPos + 1, line.size() - atPos - 1);
-        offStr.trim();
+    return true;
+}
 
-        const char *s = offStr.c_str();
-        *offset = strtoull(s, &end, 10);
+// Takes over the segments of previous that follow the one just parsed, if
+// they're in this playlist too: previous is what this playlist was before a
+// refresh, and the text that follows its first segment starts with the text
+// of those segments in previous. Returns the offset to carry on parsing
+// from, 0 if nothing could be taken over.
+size_t M3UParser::copySegmentsFrom(
+        const sp<M3UParser> &previous, size_t offset,
+        uint64_t *segmentRangeOffset, ssize_t *cipherIndex) {
+    if (previous->mIsVariantPlaylist || previous->mIsComplete
+            || previous->mSegments.isEmpty() || previous->mBaseURI != mBaseURI) {
+        return 0;
+    }
 
-        if (s == end || *end != '\0') {
-            return ERROR_MALFORMED;
+    int32_t firstSeqNumber = 0;
+    if (mMeta != NULL) {
+        mMeta->findInt32("media-sequence", &firstSeqNumber);
+    }
+    if (firstSeqNumber < previous->mFirstSeqNumber
+            || firstSeqNumber >= previous->mLastSeqNumber) {
+        return 0;
+    }
+
+    size_t first = firstSeqNumber - previous->mFirstSeqNumber;
+    const Segment &prevFirst = previous->mSegments.itemAt(first);
+    const Segment &prevLast =
+        previous->mSegments.itemAt(previous->mSegments.size() - 1);
+    const Segment &cur = mSegments.itemAt(0);
+
+    const char *prevData = (const char *)previous->mData->data();
+    const char *data = (const char *)mData->data();
+
+    if (strcmp(prevData + prevFirst.mURIOffset, data + cur.mURIOffset)
+            || prevFirst.mDurationUs != cur.mDurationUs
+            || prevFirst.mRangeOffset != cur.mRangeOffset
+            || prevFirst.mRangeLength != cur.mRangeLength) {
+        return 0;
+    }
+
+    // Its key may have been declared before the text compared below. A
+    // segment that is now encrypted differently means the stream was
+    // repackaged, so nothing is taken over.
+    if (!CipherInfoEquals(previous->getCipherInfo(first), getCipherInfo(0))) {
+        return 0;
+    }
+
+    size_t length = prevLast.mEndOffset - prevFirst.mEndOffset;
+    if (offset + length > mData->size()
+            || memcmp(prevData + prevFirst.mEndOffset, data + offset, length)) {
+        return 0;
+    }
+
+    int32_t discontinuityDelta =
+        cur.mDiscontinuitySeq - prevFirst.mDiscontinuitySeq;
+
+    // The keys of the copied segments that come after the first one's.
+    ssize_t cipherBase = mCipherInfos.size();
+    for (size_t i = prevFirst.mCipherIndex + 1;
+            i < previous->mCipherInfos.size(); ++i) {
+        mCipherInfos.push(previous->mCipherInfos.itemAt(i));
+    }
+
+    size_t numSegments = previous->mSegments.size() - first - 1;
+    mSegments.appendArray(
+            previous->mSegments.array() + first + 1, numSegments);
+
+    for (size_t i = 1; i < mSegments.size(); ++i) {
+        Segment &segment = mSegments.editItemAt(i);
+        segment.mURIOffset = segment.mURIOffset - prevFirst.mEndOffset + offset;
+        segment.mEndOffset = segment.mEndOffset - prevFirst.mEndOffset + offset;
+        segment.mDiscontinuitySeq += discontinuityDelta;
+        if (segment.mCipherIndex == prevFirst.mCipherIndex) {
+            segment.mCipherIndex = mSegments.itemAt(0).mCipherIndex;
+        } else {
+            segment.mCipherIndex +=
+                cipherBase - prevFirst.mCipherIndex - 1;
+        }
+        if (segment.mRangeLength >= 0) {
+            *segmentRangeOffset = segment.mRangeOffset + segment.mRangeLength;
         }
-    } else {
-        *offset = curOffset;
     }
 
-    return OK;
+    const Segment &last = mSegments.itemAt(mSegments.size() - 1);
+    *cipherIndex = last.mCipherIndex;
+    mDiscontinuityCount = last.mDiscontinuitySeq - (int32_t)mDiscontinuitySeq;
+
+    ALOGV("took over %zu segments from the previous playlist", numSegments);
+
+    return offset + length;
 }
 
 status_t M3UParser::parseMedia(const AString &line) {
@@ -26,8 +26,13 @@
 
 namespace android {
 
+struct ABuffer;
+
 struct M3UParser : public RefBase {
-    M3UParser(const char *baseURI, const void *data, size_t size);
+    // If previous is the playlist data is a refresh of, the segments the two
+    // have in common are taken over from it rather than parsed again.
+    M3UParser(const char *baseURI, const void *data, size_t size,
+            const sp<M3UParser> &previous = NULL);
 
     status_t initCheck() const;
 
@@ -45,6 +50,17 @@ struct M3UParser : public RefBase {
     size_t size();
     bool itemAt(size_t index, AString *uri, sp<AMessage> *meta = NULL);
 
+    // Media playlists only, without going through itemAt().
+    // The start time is from the start of the first segment.
+    int64_t getSegmentStartTimeUs(size_t index) const;
+    int64_t getSegmentDurationUs(size_t index) const;
+    size_t getSegmentDiscontinuitySeq(size_t index) const;
+    // The segment that contains timeUs, the last one if none does, and 0 if
+    // the playlist has no segments.
+    size_t getSegmentIndexForTime(int64_t timeUs) const;
+    // The EXT-X-KEY attributes in effect for the segment, NULL if none.
+    sp<AMessage> getCipherInfo(size_t index) const;
+
     void pickRandomMediaItems();
     status_t selectTrack(size_t index, bool select);
     size_t getTrackCount() const;
@@ -61,11 +77,29 @@ protected:
 private:
     struct MediaGroup;
 
+    // Variant playlist entry.
     struct Item {
         AString mURI;
         sp<AMessage> mMeta;
     };
 
+    // Media playlist entry. Live playlists can hold thousands of these and
+    // are parsed again every target duration, so they're kept flat: the uri
+    // is resolved on demand from mData, and the item meta is only built by
+    // itemAt().
+    struct Segment {
+        size_t mURIOffset;          // in mData
+        size_t mEndOffset;          // past the uri line
+        int64_t mDurationUs;
+        int64_t mStartTimeUs;
+        int64_t mRangeOffset;
+        int64_t mRangeLength;       // -1: no EXT-X-BYTERANGE
+        int32_t mDiscontinuitySeq;
+        ssize_t mCipherIndex;       // in mCipherInfos, -1: none
+        bool mHasCipherInfo;        // EXT-X-KEY right before the segment
+        bool mDiscontinuity;
+    };
+
     status_t mInitCheck;
 
     AString mBaseURI;
@@ -81,12 +115,22 @@ private:
 
     sp<AMessage> mMeta;
     Vector<Item> mItems;
+    Vector<Segment> mSegments;
+    Vector<sp<AMessage> > mCipherInfos;
     ssize_t mSelectedIndex;
 
+    // The playlist, with line breaks replaced by NULs.
+    sp<ABuffer> mData;
+
     // Media groups keyed by group ID.
     KeyedVector<AString, sp<MediaGroup> > mMediaGroups;
 
-    status_t parse(const void *data, size_t size);
+    status_t parse(
+            const void *data, size_t size, const sp<M3UParser> &previous);
+
+    size_t copySegmentsFrom(
+            const sp<M3UParser> &previous, size_t offset,
+            uint64_t *segmentRangeOffset, ssize_t *cipherIndex);
 
     static status_t parseMetaData(
             const AString &line, sp<AMessage> *meta, const char *key);
@@ -101,7 +145,7 @@ private:
             const AString &line, sp<AMessage> *meta, const AString &baseURI);
 
     static status_t parseByteRange(
-            const AString &line, uint64_t curOffset,
+            const char *line, uint64_t curOffset,
             uint64_t *length, uint64_t *offset);
 
     status_t parseMedia(const AString &line);
@@ -23,6 +23,7 @@
 #include "HTTPDownloader.h"
 #include "LiveSession.h"
 #include "M3UParser.h"
+#include "SegmentPrefetcher.h"
 #include "include/avc_utils.h"
 #include "include/ID3.h"
 #include "mpeg2ts/AnotherPacketSource.h"
@@ -34,6 +35,8 @@
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
 
+#include <cutils/properties.h>
+
 #include <ctype.h>
 #include <inttypes.h>
 #include <openssl/aes.h>
@@ -59,6 +62,7 @@ struct PlaylistFetcher::DownloadState : public RefBase {
             sp<AMessage> &itemMeta,
             sp<ABuffer> &buffer,
             sp<ABuffer> &tsBuffer,
+            bool &prefetched,
             int32_t &firstSeqNumberInPlaylist,
             int32_t &lastSeqNumberInPlaylist);
     void saveState(
@@ -66,6 +70,7 @@ struct PlaylistFetcher::DownloadState : public RefBase {
             sp<AMessage> &itemMeta,
             sp<ABuffer> &buffer,
             sp<ABuffer> &tsBuffer,
+            bool &prefetched,
             int32_t &firstSeqNumberInPlaylist,
             int32_t &lastSeqNumberInPlaylist);
 
@@ -75,6 +80,7 @@ private:
     sp<AMessage> mItemMeta;
     sp<ABuffer> mBuffer;
     sp<ABuffer> mTsBuffer;
+    bool mPrefetched;
     int32_t mFirstSeqNumberInPlaylist;
     int32_t mLastSeqNumberInPlaylist;
 };
@@ -94,6 +100,7 @@ void PlaylistFetcher::DownloadState::resetState() {
     mItemMeta = NULL;
     mBuffer = NULL;
     mTsBuffer = NULL;
+    mPrefetched = false;
     mFirstSeqNumberInPlaylist = 0;
     mLastSeqNumberInPlaylist = 0;
 }
@@ -103,6 +110,7 @@ void PlaylistFetcher::DownloadState::restoreState(
         sp<AMessage> &itemMeta,
         sp<ABuffer> &buffer,
         sp<ABuffer> &tsBuffer,
+        bool &prefetched,
         int32_t &firstSeqNumberInPlaylist,
         int32_t &lastSeqNumberInPlaylist) {
     if (!mHasSavedState) {
@@ -113,6 +121,7 @@ void PlaylistFetcher::DownloadState::restoreState(
     itemMeta = mItemMeta;
     buffer = mBuffer;
     tsBuffer = mTsBuffer;
+    prefetched = mPrefetched;
     firstSeqNumberInPlaylist = mFirstSeqNumberInPlaylist;
     lastSeqNumberInPlaylist = mLastSeqNumberInPlaylist;
 
@@ -124,6 +133,7 @@ void PlaylistFetcher::DownloadState::saveState(
         sp<AMessage> &itemMeta,
         sp<ABuffer> &buffer,
         sp<ABuffer> &tsBuffer,
+        bool &prefetched,
         int32_t &firstSeqNumberInPlaylist,
         int32_t &lastSeqNumberInPlaylist) {
     mHasSavedState = true;
@@ -132,6 +142,7 @@ void PlaylistFetcher::DownloadState::saveState(
     mItemMeta = itemMeta;
     mBuffer = buffer;
     mTsBuffer = tsBuffer;
+    mPrefetched = prefetched;
     mFirstSeqNumberInPlaylist = firstSeqNumberInPlaylist;
     mLastSeqNumberInPlaylist = lastSeqNumberInPlaylist;
 }
@@ -151,6 +162,8 @@ PlaylistFetcher::PlaylistFetcher(
       mSegmentStartTimeUs(-1ll),
       mDiscontinuitySeq(-1ll),
       mStartTimeUsRelative(false),
+      mSwitchSegmentStartTimeUs(-1ll),
+      mVariantSwitched(false),
       mLastPlaylistFetchTimeUs(-1ll),
       mPlaylistTimeUs(-1ll),
       mSeqNumber(-1),
@@ -172,9 +185,27 @@ PlaylistFetcher::PlaylistFetcher(
       mHasMetadata(false) {
     memset(mPlaylistHash, 0, sizeof(mPlaylistHash));
     mHTTPDownloader = mSession->getHTTPDownloader();
+
+    // The number of segments downloaded ahead of the current one, each over
+    // a connection of its own; 0 disables prefetching.
+    char value[PROPERTY_VALUE_MAX];
+    mNumPrefetchSegments = 2;
+    if (property_get("media.httplive.prefetch-segments", value, NULL)) {
+        mNumPrefetchSegments = atoi(value);
+    }
+    if (mNumPrefetchSegments > 0) {
+        Vector<sp<HTTPDownloader> > downloaders;
+        for (int32_t i = 0; i < mNumPrefetchSegments; ++i) {
+            downloaders.push(mSession->getHTTPDownloader());
+        }
+        mPrefetcher = new SegmentPrefetcher(downloaders);
+    }
 }
 
 PlaylistFetcher::~PlaylistFetcher() {
+    if (mPrefetcher != NULL) {
+        mPrefetcher->stop();
+    }
 }
 
 int32_t PlaylistFetcher::getFetcherID() const {
@@ -191,20 +222,8 @@ int64_t PlaylistFetcher::getSegmentStartTimeUs(int32_t seqNumber) const {
     CHECK_GE(seqNumber, firstSeqNumberInPlaylist);
     CHECK_LE(seqNumber, lastSeqNumberInPlaylist);
 
-    int64_t segmentStartUs = 0ll;
-    for (int32_t index = 0;
-            index < seqNumber - firstSeqNumberInPlaylist; ++index) {
-        sp<AMessage> itemMeta;
-        CHECK(mPlaylist->itemAt(
-                    index, NULL /* uri */, &itemMeta));
-
-        int64_t itemDurationUs;
-        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-        segmentStartUs += itemDurationUs;
-    }
-
-    return segmentStartUs;
+    return mPlaylist->getSegmentStartTimeUs(
+            seqNumber - firstSeqNumberInPlaylist);
 }
 
 int64_t PlaylistFetcher::getSegmentDurationUs(int32_t seqNumber) const {
@@ -217,15 +236,8 @@ int64_t PlaylistFetcher::getSegmentDurationUs(int32_t seqNumber) const {
     CHECK_GE(seqNumber, firstSeqNumberInPlaylist);
     CHECK_LE(seqNumber, lastSeqNumberInPlaylist);
 
-    int32_t index = seqNumber - firstSeqNumberInPlaylist;
-    sp<AMessage> itemMeta;
-    CHECK(mPlaylist->itemAt(
-                index, NULL /* uri */, &itemMeta));
-
-    int64_t itemDurationUs;
-    CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-    return itemDurationUs;
+    return mPlaylist->getSegmentDurationUs(
+            seqNumber - firstSeqNumberInPlaylist);
 }
 
 int64_t PlaylistFetcher::delayUsToRefreshPlaylist() const {
@@ -249,13 +261,7 @@ int64_t PlaylistFetcher::delayUsToRefreshPlaylist() const {
         {
             size_t n = mPlaylist->size();
             if (n > 0) {
-                sp<AMessage> itemMeta;
-                CHECK(mPlaylist->itemAt(n - 1, NULL /* uri */, &itemMeta));
-
-                int64_t itemDurationUs;
-                CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-                minPlaylistAgeUs = itemDurationUs;
+                minPlaylistAgeUs = mPlaylist->getSegmentDurationUs(n - 1);
                 break;
             }
 
@@ -292,21 +298,10 @@ int64_t PlaylistFetcher::delayUsToRefreshPlaylist() const {
 status_t PlaylistFetcher::decryptBuffer(
         size_t playlistIndex, const sp<ABuffer> &buffer,
         bool first) {
-    sp<AMessage> itemMeta;
-    bool found = false;
+    sp<AMessage> itemMeta = mPlaylist->getCipherInfo(playlistIndex);
     AString method;
 
-    for (ssize_t i = playlistIndex; i >= 0; --i) {
-        AString uri;
-        CHECK(mPlaylist->itemAt(i, &uri, &itemMeta));
-
-        if (itemMeta->findString("cipher-method", &method)) {
-            found = true;
-            break;
-        }
-    }
-
-    if (!found) {
+    if (itemMeta == NULL || !itemMeta->findString("cipher-method", &method)) {
         method = "NONE";
     }
     buffer->meta()->setString("cipher-method", method.c_str());
@@ -457,6 +452,9 @@ void PlaylistFetcher::setStoppingThreshold(float thresholdRatio, bool disconnect
     }
     if (disconnect) {
         mHTTPDownloader->disconnect();
+        if (mPrefetcher != NULL) {
+            mPrefetcher->disconnect();
+        }
     }
 }
 
@@ -467,9 +465,15 @@ void PlaylistFetcher::resetStoppingThreshold(bool disconnect) {
     }
     if (disconnect) {
         mHTTPDownloader->disconnect();
+        if (mPrefetcher != NULL) {
+            mPrefetcher->disconnect();
+        }
     } else {
         // allow reconnect
         mHTTPDownloader->reconnect();
+        if (mPrefetcher != NULL) {
+            mPrefetcher->reconnect();
+        }
     }
 }
 
@@ -553,6 +557,12 @@ void PlaylistFetcher::fetchPlaylistAsync() {
     (new AMessage(kWhatFetchPlaylist, this))->post();
 }
 
+void PlaylistFetcher::switchVariantAsync(const char *uri) {
+    sp<AMessage> msg = new AMessage(kWhatSwitchVariant, this);
+    msg->setString("uri", uri);
+    msg->post();
+}
+
 void PlaylistFetcher::onMessageReceived(const sp<AMessage> &msg) {
     switch (msg->what()) {
         case kWhatStart:
@@ -628,6 +638,12 @@ void PlaylistFetcher::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatSwitchVariant:
+        {
+            onSwitchVariant(msg);
+            break;
+        }
+
         default:
             TRESPASS();
     }
@@ -711,6 +727,13 @@ status_t PlaylistFetcher::onStart(const sp<AMessage> &msg) {
         mSeqNumber = -1;
         mTimeChangeSignaled = false;
         mDownloadState->resetState();
+        if (mPrefetcher != NULL) {
+            mPrefetcher->flush();
+        }
+    }
+
+    if (!mPendingURI.empty() && !mDownloadState->hasSavedState()) {
+        switchToPendingVariant();
     }
 
     postMonitorQueue();
@@ -741,9 +764,69 @@ void PlaylistFetcher::onStop(const sp<AMessage> &msg) {
     mPacketSources.clear();
     mStreamTypeMask = 0;
 
+    if (mPrefetcher != NULL) {
+        mPrefetcher->flush();
+    }
+
     resetStoppingThreshold(true /* disconnect */);
 }
 
+void PlaylistFetcher::onSwitchVariant(const sp<AMessage> &msg) {
+    AString uri;
+    CHECK(msg->findString("uri", &uri));
+
+    sp<AMessage> notify = mNotify->dup();
+    notify->setInt32("what", kWhatVariantSwitched);
+    notify->setString("newUri", uri);
+    notify->post();
+
+    mNotify->setString("uri", uri);
+    if (mStartTimeUsNotify != NULL) {
+        mStartTimeUsNotify->setString("uri", uri);
+    }
+
+    mPendingURI = uri;
+    if (mSeqNumber < 0 && !mDownloadState->hasSavedState()) {
+        // Nothing fetched yet, nothing to line up with.
+        switchToPendingVariant();
+    }
+}
+
+void PlaylistFetcher::switchToPendingVariant() {
+    FLOGV("switching to '%s' before segment %d",
+            uriDebugString(mPendingURI).c_str(), mSeqNumber);
+
+    // Variants of a VOD or event playlist are aligned by time, those of a
+    // live playlist by sequence number.
+    mSwitchSegmentStartTimeUs = -1ll;
+    if (mSeqNumber >= 0 && mPlaylist != NULL
+            && (mPlaylist->isComplete() || mPlaylist->isEvent())) {
+        int32_t firstSeqNumberInPlaylist, lastSeqNumberInPlaylist;
+        mPlaylist->getSeqNumberRange(
+                &firstSeqNumberInPlaylist, &lastSeqNumberInPlaylist);
+        if (mSeqNumber >= firstSeqNumberInPlaylist
+                && mSeqNumber <= lastSeqNumberInPlaylist) {
+            mSwitchSegmentStartTimeUs = getSegmentStartTimeUs(mSeqNumber);
+        }
+    }
+
+    mURI = mPendingURI;
+    mPendingURI.clear();
+
+    mPlaylist.clear();
+    mLastPlaylistFetchTimeUs = -1ll;
+    mRefreshState = INITIAL_MINIMUM_RELOAD_DELAY;
+    memset(mPlaylistHash, 0, sizeof(mPlaylistHash));
+
+    // The new variant may be coded differently; start it like a
+    // discontinuity.
+    mVariantSwitched = (mSeqNumber >= 0);
+
+    if (mPrefetcher != NULL) {
+        mPrefetcher->flush();
+    }
+}
+
 // Resume until we have reached the boundary timestamps listed in `msg`; when
 // the remaining time is too short (within a resume threshold) stop immediately
 // instead.
@@ -784,6 +867,9 @@ void PlaylistFetcher::onMonitorQueue() {
     // in the middle of an unfinished download, delay
     // playlist refresh as it'll change seq numbers
     if (!mDownloadState->hasSavedState()) {
+        if (!mPendingURI.empty()) {
+            switchToPendingVariant();
+        }
         refreshPlaylist();
     }
 
@@ -859,7 +945,7 @@ status_t PlaylistFetcher::refreshPlaylist() {
     if (delayUsToRefreshPlaylist() <= 0) {
         bool unchanged;
         sp<M3UParser> playlist = mHTTPDownloader->fetchPlaylist(
-                mURI.c_str(), mPlaylistHash, &unchanged);
+                mURI.c_str(), mPlaylistHash, &unchanged, mPlaylist);
 
         if (playlist == NULL) {
             if (unchanged) {
@@ -977,6 +1063,15 @@ bool PlaylistFetcher::initDownloadState(
 
     mSegmentFirstPTS = -1ll;
 
+    if (mPlaylist != NULL && mSwitchSegmentStartTimeUs >= 0) {
+        // Same rule as when adapting through a new fetcher: the segment of
+        // the new variant that holds the midpoint of the first target
+        // duration.
+        mSeqNumber = getSeqNumberForTime(
+                mSwitchSegmentStartTimeUs + mPlaylist->getTargetDuration() / 2);
+        mSwitchSegmentStartTimeUs = -1ll;
+    }
+
     if (mPlaylist != NULL && mSeqNumber < 0) {
         CHECK_GE(mStartTimeUs, 0ll);
 
@@ -1151,6 +1246,11 @@ bool PlaylistFetcher::initDownloadState(
     }
     mLastDiscontinuitySeq = -1;
 
+    if (mVariantSwitched) {
+        discontinuity = true;
+        mVariantSwitched = false;
+    }
+
     // decrypt a junk buffer to prefetch key; since a session uses only one http connection,
     // this avoids interleaved connections to the key and segment file.
     {
@@ -1219,24 +1319,66 @@ bool PlaylistFetcher::initDownloadState(
     return true;
 }
 
+void PlaylistFetcher::schedulePrefetch(
+        int32_t firstSeqNumberInPlaylist,
+        int32_t lastSeqNumberInPlaylist) {
+    // Subtitle segments are too small to be worth the extra connections.
+    if (mPrefetcher == NULL || mStartup || mStopParams != NULL
+            || getStoppingThreshold() >= 0.0f
+            || (mStreamTypeMask & (LiveSession::STREAMTYPE_AUDIO
+                    | LiveSession::STREAMTYPE_VIDEO)) == 0) {
+        return;
+    }
+
+    Vector<SegmentPrefetcher::Segment> segments;
+    for (int32_t seqNumber = mSeqNumber + 1;
+            seqNumber <= lastSeqNumberInPlaylist
+                && seqNumber - mSeqNumber <= mNumPrefetchSegments;
+            ++seqNumber) {
+        SegmentPrefetcher::Segment segment;
+        sp<AMessage> itemMeta;
+        if (!mPlaylist->itemAt(
+                seqNumber - firstSeqNumberInPlaylist, &segment.mURI, &itemMeta)) {
+            break;
+        }
+
+        segment.mSeqNumber = seqNumber;
+        if (!itemMeta->findInt64("range-offset", &segment.mRangeOffset)
+                || !itemMeta->findInt64("range-length", &segment.mRangeLength)) {
+            segment.mRangeOffset = 0;
+            segment.mRangeLength = -1;
+        }
+        segments.push(segment);
+    }
+
+    mPrefetcher->prefetch(segments);
+}
+
 void PlaylistFetcher::onDownloadNext() {
     AString uri;
     sp<AMessage> itemMeta;
     sp<ABuffer> buffer;
     sp<ABuffer> tsBuffer;
+    bool prefetched = false;
     int32_t firstSeqNumberInPlaylist = 0;
     int32_t lastSeqNumberInPlaylist = 0;
     bool connectHTTP = true;
 
+    if (!mPendingURI.empty() && !mDownloadState->hasSavedState()) {
+        switchToPendingVariant();
+    }
+
     if (mDownloadState->hasSavedState()) {
         mDownloadState->restoreState(
                 uri,
                 itemMeta,
                 buffer,
                 tsBuffer,
+                prefetched,
                 firstSeqNumberInPlaylist,
                 lastSeqNumberInPlaylist);
-        connectHTTP = false;
+        // Nothing was read yet if we were waiting for the prefetcher.
+        connectHTTP = (buffer == NULL);
         FLOGV("resuming: '%s'", uri.c_str());
     } else {
         if (!initDownloadState(
@@ -1256,40 +1398,100 @@ void PlaylistFetcher::onDownloadNext() {
         range_length = -1;
     }
 
+    if (connectHTTP && mPrefetcher != NULL) {
+        SegmentPrefetcher::Segment segment;
+        segment.mSeqNumber = mSeqNumber;
+        segment.mURI = uri;
+        segment.mRangeOffset = range_offset;
+        segment.mRangeLength = range_length;
+
+        // Rather than wait for a download in progress, come back once it's done.
+        sp<AMessage> notify = new AMessage(kWhatDownloadNext, this);
+        notify->setInt32("generation", mMonitorQueueGeneration);
+
+        status_t err = mPrefetcher->take(segment, notify, &buffer);
+        if (err == WOULD_BLOCK) {
+            FLOGV("waiting for segment %d to be prefetched", mSeqNumber);
+            mDownloadState->saveState(
+                    uri,
+                    itemMeta,
+                    buffer,
+                    tsBuffer,
+                    prefetched,
+                    firstSeqNumberInPlaylist,
+                    lastSeqNumberInPlaylist);
+            return;
+        } else if (err == OK) {
+            FLOGV("segment %d was prefetched (%zu bytes)",
+                    mSeqNumber, buffer->capacity());
+            // Handed to the parser a block at a time below, as if downloaded.
+            buffer->setRange(0, 0);
+            prefetched = true;
+        }
+
+        schedulePrefetch(firstSeqNumberInPlaylist, lastSeqNumberInPlaylist);
+    }
+
     // block-wise download
     bool shouldPause = false;
     ssize_t bytesRead;
     do {
-        int64_t startUs = ALooper::GetNowUs();
-        bytesRead = mHTTPDownloader->fetchBlock(
-                uri.c_str(), &buffer, range_offset, range_length, kDownloadBlockSize,
-                NULL /* actualURL */, connectHTTP);
-        int64_t delayUs = ALooper::GetNowUs() - startUs;
-
-        if (bytesRead == ERROR_NOT_CONNECTED) {
-            return;
-        }
-        if (bytesRead < 0) {
-            status_t err = bytesRead;
-            ALOGE("failed to fetch .ts segment at url '%s'", uri.c_str());
-            notifyError(err);
-            return;
-        }
-
         // add sample for bandwidth estimation, excluding samples from subtitles (as
         // its too small), or during startup/resumeUntil (when we could have more than
         // one connection open which affects bandwidth)
-        if (!mStartup && mStopParams == NULL && bytesRead > 0
+        bool measure = !mStartup && mStopParams == NULL
                 && (mStreamTypeMask
                         & (LiveSession::STREAMTYPE_AUDIO
-                        | LiveSession::STREAMTYPE_VIDEO))) {
-            mSession->addBandwidthMeasurement(bytesRead, delayUs);
-            if (delayUs > 2000000ll) {
+                        | LiveSession::STREAMTYPE_VIDEO));
+
+        if (prefetched) {
+            bytesRead = buffer->capacity() - buffer->size();
+            if (bytesRead > kDownloadBlockSize) {
+                bytesRead = kDownloadBlockSize;
+            }
+            buffer->setRange(0, buffer->size() + bytesRead);
+        } else {
+            if (measure && mPrefetcher != NULL) {
+                mPrefetcher->transferStarted();
+            }
+            int64_t startUs = ALooper::GetNowUs();
+            bytesRead = mHTTPDownloader->fetchBlock(
+                    uri.c_str(), &buffer, range_offset, range_length, kDownloadBlockSize,
+                    NULL /* actualURL */, connectHTTP);
+            int64_t delayUs = ALooper::GetNowUs() - startUs;
+            if (measure && mPrefetcher != NULL) {
+                mPrefetcher->transferProgress(bytesRead > 0 ? bytesRead : 0);
+                mPrefetcher->transferEnded();
+            }
+
+            if (bytesRead == ERROR_NOT_CONNECTED) {
+                return;
+            }
+            if (bytesRead < 0) {
+                status_t err = bytesRead;
+                ALOGE("failed to fetch .ts segment at url '%s'", uri.c_str());
+                notifyError(err);
+                return;
+            }
+
+            // With segments downloading in parallel, a single transfer says
+            // little about the link; the prefetcher's samples cover them all.
+            if (measure && bytesRead > 0 && mPrefetcher == NULL) {
+                mSession->addBandwidthMeasurement(bytesRead, delayUs);
+            }
+            if (measure && delayUs > 2000000ll) {
                 FLOGV("bytesRead %zd took %.2f seconds - abnormal bandwidth dip",
                         bytesRead, (double)delayUs / 1.0e6);
             }
         }
 
+        size_t sampleBytes;
+        int64_t sampleDelayUs;
+        if (measure && mPrefetcher != NULL
+                && mPrefetcher->getBandwidthSample(&sampleBytes, &sampleDelayUs)) {
+            mSession->addBandwidthMeasurement(sampleBytes, sampleDelayUs);
+        }
+
         connectHTTP = false;
 
         CHECK(buffer != NULL);
@@ -1328,6 +1530,9 @@ void PlaylistFetcher::onDownloadNext() {
 
         if (err == -EAGAIN) {
             // starting sequence number too low/high
+            if (mPrefetcher != NULL) {
+                mPrefetcher->flush();
+            }
             mTSParser.clear();
             for (size_t i = 0; i < mPacketSources.size(); i++) {
                 sp<AnotherPacketSource> packetSource = mPacketSources.valueAt(i);
@@ -1360,6 +1565,7 @@ void PlaylistFetcher::onDownloadNext() {
                         itemMeta,
                         buffer,
                         tsBuffer,
+                        prefetched,
                         firstSeqNumberInPlaylist,
                         lastSeqNumberInPlaylist);
                 return;
@@ -1476,27 +1682,13 @@ bool PlaylistFetcher::adjustSeqNumberWithAnchorTime(int64_t anchorTimeUs) {
     if (diffUs > maxDiffUs) {
         while (index > 0 && diffUs > maxDiffUs) {
             --index;
-
-            sp<AMessage> itemMeta;
-            CHECK(mPlaylist->itemAt(index, NULL /* uri */, &itemMeta));
-
-            int64_t itemDurationUs;
-            CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-            diffUs -= itemDurationUs;
+            diffUs -= mPlaylist->getSegmentDurationUs(index);
         }
     } else if (diffUs < minDiffUs) {
         while (index + 1 < (ssize_t) mPlaylist->size()
                 && diffUs < minDiffUs) {
             ++index;
-
-            sp<AMessage> itemMeta;
-            CHECK(mPlaylist->itemAt(index, NULL /* uri */, &itemMeta));
-
-            int64_t itemDurationUs;
-            CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-            diffUs += itemDurationUs;
+            diffUs += mPlaylist->getSegmentDurationUs(index);
         }
     }
 
@@ -1517,10 +1709,8 @@ int32_t PlaylistFetcher::getSeqNumberForDiscontinuity(size_t discontinuitySeq) c
 
     size_t index = 0;
     while (index < mPlaylist->size()) {
-        sp<AMessage> itemMeta;
-        CHECK(mPlaylist->itemAt( index, NULL /* uri */, &itemMeta));
-        size_t curDiscontinuitySeq;
-        CHECK(itemMeta->findInt32("discontinuity-sequence", (int32_t *)&curDiscontinuitySeq));
+        size_t curDiscontinuitySeq =
+            mPlaylist->getSegmentDiscontinuitySeq(index);
         int32_t seqNumber = firstSeqNumberInPlaylist + index;
         if (curDiscontinuitySeq == discontinuitySeq) {
             return seqNumber;
@@ -1535,29 +1725,8 @@ int32_t PlaylistFetcher::getSeqNumberForDiscontinuity(size_t discontinuitySeq) c
 }
 
 int32_t PlaylistFetcher::getSeqNumberForTime(int64_t timeUs) const {
-    size_t index = 0;
-    int64_t segmentStartUs = 0;
-    while (index < mPlaylist->size()) {
-        sp<AMessage> itemMeta;
-        CHECK(mPlaylist->itemAt(
-                    index, NULL /* uri */, &itemMeta));
-
-        int64_t itemDurationUs;
-        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-        if (timeUs < segmentStartUs + itemDurationUs) {
-            break;
-        }
-
-        segmentStartUs += itemDurationUs;
-        ++index;
-    }
-
-    if (index >= mPlaylist->size()) {
-        index = mPlaylist->size() - 1;
-    }
-
-    return mPlaylist->getFirstSeqNumber() + index;
+    return mPlaylist->getFirstSeqNumber()
+            + mPlaylist->getSegmentIndexForTime(timeUs);
 }
 
 const sp<ABuffer> &PlaylistFetcher::setAccessUnitProperties(
@@ -1627,15 +1796,10 @@ status_t PlaylistFetcher::extractAndQueueAccessUnitsFromTs(const sp<ABuffer> &bu
         mNextPTSTimeUs = -1ll;
     }
 
-    size_t offset = 0;
-    while (offset + 188 <= buffer->size()) {
-        status_t err = mTSParser->feedTSPacket(buffer->data() + offset, 188);
-
-        if (err != OK) {
-            return err;
-        }
-
-        offset += 188;
+    size_t offset = buffer->size() - buffer->size() % 188;
+    status_t err = mTSParser->feedTSPackets(buffer->data(), offset);
+    if (err != OK) {
+        return err;
     }
     // setRange to indicate consumed bytes.
     buffer->setRange(buffer->offset() + offset, buffer->size() - offset);
@@ -1697,7 +1861,6 @@ status_t PlaylistFetcher::extractAndQueueAccessUnitsFromTs(const sp<ABuffer> &bu
         }
     }
 
-    status_t err = OK;
     for (size_t i = mPacketSources.size(); i > 0;) {
         i--;
         sp<AnotherPacketSource> packetSource = mPacketSources.valueAt(i);
@@ -2083,15 +2246,10 @@ status_t PlaylistFetcher::extractAndQueueAccessUnits(
 
 void PlaylistFetcher::updateDuration() {
     int64_t durationUs = 0ll;
-    for (size_t index = 0; index < mPlaylist->size(); ++index) {
-        sp<AMessage> itemMeta;
-        CHECK(mPlaylist->itemAt(
-                    index, NULL /* uri */, &itemMeta));
-
-        int64_t itemDurationUs;
-        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-        durationUs += itemDurationUs;
+    size_t n = mPlaylist->size();
+    if (n > 0) {
+        durationUs = mPlaylist->getSegmentStartTimeUs(n - 1)
+                + mPlaylist->getSegmentDurationUs(n - 1);
     }
 
     sp<AMessage> msg = mNotify->dup();
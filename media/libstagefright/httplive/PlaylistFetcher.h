@@ -31,6 +31,7 @@ class DataSource;
 struct HTTPBase;
 struct LiveDataSource;
 struct M3UParser;
+struct SegmentPrefetcher;
 class String8;
 
 struct PlaylistFetcher : public AHandler {
@@ -51,6 +52,7 @@ struct PlaylistFetcher : public AHandler {
         kWhatStopReached,
         kWhatPlaylistFetched,
         kWhatMetadataDetected,
+        kWhatVariantSwitched,
     };
 
     PlaylistFetcher(
@@ -81,6 +83,13 @@ struct PlaylistFetcher : public AHandler {
 
     void fetchPlaylistAsync();
 
+    // Moves on to the media playlist at uri once the segment being
+    // downloaded is complete, with the segment of the new playlist that
+    // starts where the next one of the current playlist would have. The
+    // fetcher acknowledges with kWhatVariantSwitched right away, and posts
+    // its notifications with the new uri from then on.
+    void switchVariantAsync(const char *uri);
+
     uint32_t getStreamTypeMask() const {
         return mStreamTypeMask;
     }
@@ -101,7 +110,8 @@ private:
         kWhatMonitorQueue   = 'moni',
         kWhatResumeUntil    = 'rsme',
         kWhatDownloadNext   = 'dlnx',
-        kWhatFetchPlaylist  = 'flst'
+        kWhatFetchPlaylist  = 'flst',
+        kWhatSwitchVariant  = 'swvr',
     };
 
     struct DownloadState;
@@ -117,6 +127,8 @@ private:
     sp<AMessage> mStartTimeUsNotify;
 
     sp<HTTPDownloader> mHTTPDownloader;
+    sp<SegmentPrefetcher> mPrefetcher;
+    int32_t mNumPrefetchSegments;
     sp<LiveSession> mSession;
     AString mURI;
 
@@ -134,6 +146,13 @@ private:
     bool mStartTimeUsRelative;
     sp<AMessage> mStopParams; // message containing the latest timestamps we should fetch.
 
+    // Variant switch requested by switchVariantAsync() and not done yet.
+    AString mPendingURI;
+    // Start time in the previous variant's playlist of the segment to
+    // continue with once the new playlist is in, -1 to keep mSeqNumber.
+    int64_t mSwitchSegmentStartTimeUs;
+    bool mVariantSwitched;
+
     KeyedVector<LiveSession::StreamType, sp<AnotherPacketSource> >
         mPacketSources;
 
@@ -216,6 +235,8 @@ private:
     status_t onStart(const sp<AMessage> &msg);
     void onPause();
     void onStop(const sp<AMessage> &msg);
+    void onSwitchVariant(const sp<AMessage> &msg);
+    void switchToPendingVariant();
     void onMonitorQueue();
     void onDownloadNext();
     bool initDownloadState(
@@ -224,6 +245,12 @@ private:
             int32_t &firstSeqNumberInPlaylist,
             int32_t &lastSeqNumberInPlaylist);
 
+    // Hands the segments after mSeqNumber to mPrefetcher, unless starting up
+    // or about to stop, when they might not be needed.
+    void schedulePrefetch(
+            int32_t firstSeqNumberInPlaylist,
+            int32_t lastSeqNumberInPlaylist);
+
     // Resume a fetcher to continue until the stopping point stored in msg.
     status_t onResumeUntil(const sp<AMessage> &msg);
 
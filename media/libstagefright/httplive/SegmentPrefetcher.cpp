@@ -0,0 +1,438 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SegmentPrefetcher"
+#include <utils/Log.h>
+
+#include "SegmentPrefetcher.h"
+
+#include "HTTPDownloader.h"
+#include "PlaylistFetcher.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaErrors.h>
+
+#include <errno.h>
+
+namespace android {
+
+// static
+const int64_t SegmentPrefetcher::kMinBandwidthSampleUs = 500000ll;
+
+SegmentPrefetcher::SegmentPrefetcher(
+        const Vector<sp<HTTPDownloader> > &downloaders)
+    : mDownloaders(downloaders),
+      mNextWorkerIndex(0),
+      mGeneration(0),
+      mTakeSeqNumber(-1),
+      mDisconnected(false),
+      mStopping(false),
+      mNumTransfers(0),
+      mBusySinceUs(0),
+      mBusyUs(0),
+      mNumBytes(0) {
+}
+
+SegmentPrefetcher::~SegmentPrefetcher() {
+    stop();
+}
+
+void SegmentPrefetcher::prefetch(const Vector<Segment> &segments) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mDisconnected || mStopping || mDownloaders.isEmpty()
+            || segments.isEmpty() || mEntries.size() * 2 > segments.size()) {
+        return;
+    }
+
+    Vector<Segment> added;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (mEntries.indexOfKey(segments[i].mSeqNumber) >= 0) {
+            continue;
+        }
+
+        Entry entry;
+        entry.mSegment = segments[i];
+        entry.mState = QUEUED;
+        mEntries.add(segments[i].mSeqNumber, entry);
+        added.push(segments[i]);
+    }
+
+    if (added.isEmpty()) {
+        return;
+    }
+
+    // Coalesce byte ranges, but leave a job for every worker.
+    size_t maxSegmentsPerJob =
+        (added.size() + mDownloaders.size() - 1) / mDownloaders.size();
+
+    Job job;
+    job.mFirstSeqNumber = added[0].mSeqNumber;
+    job.mNumSegments = 1;
+    for (size_t i = 1; i < added.size(); ++i) {
+        const Segment &prev = added[i - 1];
+        const Segment &cur = added[i];
+
+        if (job.mNumSegments < maxSegmentsPerJob
+                && cur.mSeqNumber == prev.mSeqNumber + 1
+                && cur.mURI == prev.mURI
+                && prev.mRangeLength >= 0 && cur.mRangeLength >= 0
+                && cur.mRangeOffset == prev.mRangeOffset + prev.mRangeLength) {
+            ++job.mNumSegments;
+            continue;
+        }
+
+        mJobs.push_back(job);
+        job.mFirstSeqNumber = cur.mSeqNumber;
+        job.mNumSegments = 1;
+    }
+    mJobs.push_back(job);
+
+    ALOGV("prefetching %zu segments from %d", added.size(), added[0].mSeqNumber);
+
+    startThreads_l();
+    mCondition.broadcast();
+}
+
+status_t SegmentPrefetcher::take(
+        const Segment &segment, const sp<AMessage> &notify, sp<ABuffer> *data) {
+    Mutex::Autolock autoLock(mLock);
+
+    data->clear();
+    mTakeNotify.clear();
+
+    while (!mEntries.isEmpty() && mEntries.keyAt(0) < segment.mSeqNumber) {
+        mEntries.removeItemsAt(0);
+    }
+
+    ssize_t index = mEntries.indexOfKey(segment.mSeqNumber);
+    if (index < 0 || mDisconnected || mStopping) {
+        return NAME_NOT_FOUND;
+    }
+
+    const Entry &entry = mEntries.valueAt(index);
+    if (entry.mSegment.mURI != segment.mURI
+            || entry.mSegment.mRangeOffset != segment.mRangeOffset
+            || entry.mSegment.mRangeLength != segment.mRangeLength) {
+        // The playlist changed under us.
+        mEntries.removeItemsAt(index);
+        return NAME_NOT_FOUND;
+    }
+
+    switch (entry.mState) {
+        case RUNNING:
+            mTakeNotify = notify;
+            mTakeSeqNumber = segment.mSeqNumber;
+            return WOULD_BLOCK;
+
+        case DONE:
+            *data = entry.mData;
+            mEntries.removeItemsAt(index);
+            return OK;
+
+        default:
+            // Not started yet, or failed: the caller is better off
+            // downloading it right away.
+            mEntries.removeItemsAt(index);
+            return NAME_NOT_FOUND;
+    }
+}
+
+void SegmentPrefetcher::postTakeNotify_l() {
+    if (mTakeNotify != NULL) {
+        mTakeNotify->post();
+        mTakeNotify.clear();
+    }
+}
+
+void SegmentPrefetcher::flush() {
+    Mutex::Autolock autoLock(mLock);
+
+    ++mGeneration;
+    mJobs.clear();
+    mEntries.clear();
+    // The fetcher flushes from its own looper and starts over by itself.
+    mTakeNotify.clear();
+    mCondition.broadcast();
+}
+
+void SegmentPrefetcher::disconnect() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mDisconnected = true;
+        mJobs.clear();
+        postTakeNotify_l();
+        mCondition.broadcast();
+    }
+
+    for (size_t i = 0; i < mDownloaders.size(); ++i) {
+        mDownloaders[i]->disconnect();
+    }
+}
+
+void SegmentPrefetcher::reconnect() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mDisconnected = false;
+    }
+
+    for (size_t i = 0; i < mDownloaders.size(); ++i) {
+        mDownloaders[i]->reconnect();
+    }
+}
+
+void SegmentPrefetcher::transferStarted() {
+    Mutex::Autolock autoLock(mLock);
+    transferStarted_l();
+}
+
+void SegmentPrefetcher::transferProgress(size_t numBytes) {
+    Mutex::Autolock autoLock(mLock);
+    mNumBytes += numBytes;
+}
+
+void SegmentPrefetcher::transferEnded() {
+    Mutex::Autolock autoLock(mLock);
+    transferEnded_l();
+}
+
+void SegmentPrefetcher::transferStarted_l() {
+    if (mNumTransfers++ == 0) {
+        mBusySinceUs = ALooper::GetNowUs();
+    }
+}
+
+void SegmentPrefetcher::transferEnded_l() {
+    if (--mNumTransfers == 0) {
+        mBusyUs += ALooper::GetNowUs() - mBusySinceUs;
+    }
+}
+
+bool SegmentPrefetcher::getBandwidthSample(size_t *numBytes, int64_t *delayUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    int64_t nowUs = ALooper::GetNowUs();
+    int64_t busyUs = mBusyUs;
+    if (mNumTransfers > 0) {
+        busyUs += nowUs - mBusySinceUs;
+    }
+
+    if (mNumBytes == 0 || busyUs < kMinBandwidthSampleUs) {
+        return false;
+    }
+
+    *numBytes = mNumBytes;
+    *delayUs = busyUs;
+
+    mNumBytes = 0;
+    mBusyUs = 0;
+    if (mNumTransfers > 0) {
+        mBusySinceUs = nowUs;
+    }
+    return true;
+}
+
+void SegmentPrefetcher::stop() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (mStopping) {
+            return;
+        }
+        mStopping = true;
+        mJobs.clear();
+        mTakeNotify.clear();
+        mCondition.broadcast();
+    }
+
+    for (size_t i = 0; i < mDownloaders.size(); ++i) {
+        mDownloaders[i]->disconnect();
+    }
+
+    for (size_t i = 0; i < mThreads.size(); ++i) {
+        void *dummy;
+        pthread_join(mThreads[i], &dummy);
+    }
+    mThreads.clear();
+}
+
+void SegmentPrefetcher::startThreads_l() {
+    while (mThreads.size() < mDownloaders.size()) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+        pthread_t thread;
+        int err = pthread_create(&thread, &attr, ThreadWrapper, this);
+        pthread_attr_destroy(&attr);
+
+        if (err != 0) {
+            ALOGW("failed to start prefetch worker: %d", err);
+            return;
+        }
+        mThreads.push(thread);
+    }
+}
+
+// static
+void *SegmentPrefetcher::ThreadWrapper(void *me) {
+    static_cast<SegmentPrefetcher *>(me)->threadEntry();
+    return NULL;
+}
+
+void SegmentPrefetcher::threadEntry() {
+    Mutex::Autolock autoLock(mLock);
+
+    sp<HTTPDownloader> downloader = mDownloaders[mNextWorkerIndex++];
+
+    for (;;) {
+        while (!mStopping && (mJobs.empty() || mDisconnected)) {
+            mCondition.wait(mLock);
+        }
+
+        if (mStopping) {
+            break;
+        }
+
+        Job job = *mJobs.begin();
+        mJobs.erase(mJobs.begin());
+
+        // Segments the fetcher got to first are no longer queued.
+        Vector<Segment> segments;
+        for (size_t i = 0; i < job.mNumSegments; ++i) {
+            ssize_t index = mEntries.indexOfKey(job.mFirstSeqNumber + i);
+            if (index < 0 || mEntries.valueAt(index).mState != QUEUED) {
+                if (segments.isEmpty()) {
+                    continue;
+                }
+                break;
+            }
+            mEntries.editValueAt(index).mState = RUNNING;
+            segments.push(mEntries.valueAt(index).mSegment);
+        }
+
+        if (segments.isEmpty()) {
+            continue;
+        }
+
+        int32_t generation = mGeneration;
+        transferStarted_l();
+
+        mLock.unlock();
+        Vector<sp<ABuffer> > data;
+        status_t err = download(downloader, segments, generation, &data);
+        mLock.lock();
+
+        transferEnded_l();
+
+        if (generation == mGeneration) {
+            if (err != OK) {
+                ALOGW("failed to prefetch segment %d: %d",
+                        segments[data.size()].mSeqNumber, err);
+            }
+
+            for (size_t i = 0; i < segments.size(); ++i) {
+                ssize_t index = mEntries.indexOfKey(segments[i].mSeqNumber);
+                if (index < 0) {
+                    continue;
+                }
+
+                Entry &entry = mEntries.editValueAt(index);
+                if (i < data.size()) {
+                    entry.mState = DONE;
+                    entry.mData = data[i];
+                } else {
+                    entry.mState = FAILED;
+                }
+
+                if (segments[i].mSeqNumber == mTakeSeqNumber) {
+                    postTakeNotify_l();
+                }
+            }
+        }
+    }
+}
+
+status_t SegmentPrefetcher::download(
+        const sp<HTTPDownloader> &downloader,
+        const Vector<Segment> &segments, int32_t generation,
+        Vector<sp<ABuffer> > *data) {
+    const Segment &first = segments[0];
+    int64_t rangeLength = first.mRangeLength;
+    if (segments.size() > 1) {
+        const Segment &last = segments[segments.size() - 1];
+        rangeLength = last.mRangeOffset + last.mRangeLength - first.mRangeOffset;
+    }
+
+    ALOGV("downloading segments %d..%d, range %lld/%lld",
+            first.mSeqNumber, first.mSeqNumber + (int32_t)segments.size() - 1,
+            (long long)first.mRangeOffset, (long long)rangeLength);
+
+    sp<ABuffer> buffer;
+    bool reconnect = true;
+    for (;;) {
+        ssize_t n = downloader->fetchBlock(
+                first.mURI.c_str(), &buffer, first.mRangeOffset, rangeLength,
+                PlaylistFetcher::kDownloadBlockSize, NULL /* actualUrl */,
+                reconnect);
+        reconnect = false;
+
+        if (n < 0) {
+            return n;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        mNumBytes += n;
+
+        if (n == 0) {
+            break;
+        }
+
+        if (mStopping || generation != mGeneration) {
+            return -ECANCELED;
+        }
+    }
+
+    if (segments.size() == 1) {
+        if (buffer->capacity() != buffer->size()) {
+            sp<ABuffer> copy = new ABuffer(buffer->size());
+            memcpy(copy->data(), buffer->data(), buffer->size());
+            buffer = copy;
+        }
+        data->push(buffer);
+        return OK;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        size_t size = segments[i].mRangeLength;
+        if (offset + size > buffer->size()) {
+            return ERROR_END_OF_STREAM;
+        }
+
+        sp<ABuffer> segmentData = new ABuffer(size);
+        memcpy(segmentData->data(), buffer->data() + offset, size);
+        data->push(segmentData);
+        offset += size;
+    }
+
+    return OK;
+}
+
+}  // namespace android
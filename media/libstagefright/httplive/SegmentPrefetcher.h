@@ -0,0 +1,161 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SEGMENT_PREFETCHER_H_
+
+#define SEGMENT_PREFETCHER_H_
+
+#include <pthread.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/KeyedVector.h>
+#include <utils/List.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ABuffer;
+struct AMessage;
+struct HTTPDownloader;
+
+// Downloads the media segments a PlaylistFetcher is going to need next,
+// several at a time, while the fetcher works on the current one. Every worker
+// keeps its HTTPDownloader, and with it its connection, from one segment to
+// the next. Runs of segments that are consecutive byte ranges of the same
+// resource (EXT-X-BYTERANGE) are fetched with a single request.
+//
+// The fetcher asks for segments in order through take(); whatever order the
+// downloads complete in, it parses them in playlist order. take() never
+// blocks, so the fetcher's looper stays responsive while it waits.
+struct SegmentPrefetcher : public RefBase {
+    struct Segment {
+        int32_t mSeqNumber;
+        AString mURI;
+        int64_t mRangeOffset;
+        int64_t mRangeLength;  // -1: the whole resource
+    };
+
+    // One worker per downloader.
+    SegmentPrefetcher(const Vector<sp<HTTPDownloader> > &downloaders);
+
+    // Starts downloading the segments, in sequence number order, that aren't
+    // downloaded or being downloaded already. Does nothing while more than
+    // half as many segments as given are still waiting to be taken, so that
+    // they're queued in runs long enough to coalesce.
+    void prefetch(const Vector<Segment> &segments);
+
+    // Returns OK and the data of segment, whose capacity is the size of the
+    // segment, if it has been downloaded. Returns WOULD_BLOCK if it is being
+    // downloaded; notify is posted once it is done or disconnect() is called,
+    // and the caller asks again then. flush() drops notify. Otherwise
+    // returns NAME_NOT_FOUND: the segment wasn't prefetched, its download
+    // hasn't started yet or failed, and the caller downloads it itself.
+    // Segments before it are dropped.
+    status_t take(
+            const Segment &segment, const sp<AMessage> &notify, sp<ABuffer> *data);
+
+    // Drops every segment and abandons the downloads in progress.
+    void flush();
+
+    // Aborts the downloads in progress; take() returns NAME_NOT_FOUND and
+    // prefetch() does nothing until reconnect().
+    void disconnect();
+    void reconnect();
+
+    // Transfers the caller makes itself, to be counted in the bandwidth
+    // samples along with the workers' transfers.
+    void transferStarted();
+    void transferProgress(size_t numBytes);
+    void transferEnded();
+
+    // Downloads share the link, so bandwidth is measured over all of them:
+    // the bytes transferred since the last sample, and the time during which
+    // at least one transfer was in progress. Returns false until that time
+    // is long enough to make a sample.
+    bool getBandwidthSample(size_t *numBytes, int64_t *delayUs);
+
+    // Stops the workers. Can't be undone.
+    void stop();
+
+protected:
+    virtual ~SegmentPrefetcher();
+
+private:
+    enum State {
+        QUEUED,
+        RUNNING,
+        DONE,
+        FAILED,
+    };
+
+    struct Entry {
+        Segment mSegment;
+        State mState;
+        sp<ABuffer> mData;
+    };
+
+    struct Job {
+        int32_t mFirstSeqNumber;
+        size_t mNumSegments;
+    };
+
+    static const int64_t kMinBandwidthSampleUs;
+
+    Vector<sp<HTTPDownloader> > mDownloaders;
+    Vector<pthread_t> mThreads;
+    size_t mNextWorkerIndex;
+
+    Mutex mLock;
+    Condition mCondition;
+    KeyedVector<int32_t, Entry> mEntries;
+    List<Job> mJobs;
+    int32_t mGeneration;
+
+    // Posted when the segment take() is waiting for leaves RUNNING.
+    sp<AMessage> mTakeNotify;
+    int32_t mTakeSeqNumber;
+    bool mDisconnected;
+    bool mStopping;
+
+    size_t mNumTransfers;
+    int64_t mBusySinceUs;
+    int64_t mBusyUs;
+    size_t mNumBytes;
+
+    static void *ThreadWrapper(void *me);
+    void threadEntry();
+
+    void startThreads_l();
+    void postTakeNotify_l();
+    void transferStarted_l();
+    void transferEnded_l();
+
+    // Downloads segments, which are consecutive byte ranges of one resource
+    // if there are more than one, and returns their data in data.
+    status_t download(
+            const sp<HTTPDownloader> &downloader,
+            const Vector<Segment> &segments, int32_t generation,
+            Vector<sp<ABuffer> > *data);
+
+    DISALLOW_EVIL_CONSTRUCTORS(SegmentPrefetcher);
+};
+
+}  // namespace android
+
+#endif  // SEGMENT_PREFETCHER_H_
@@ -0,0 +1,528 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a bandwidth trace against the variants of a local master playlist,
+// through every ABR policy, and reports how playback would have gone.
+//
+// Time is simulated: segments are downloaded one after the other at the rate
+// the trace gives, a block at a time the way PlaylistFetcher does, while the
+// player drains the buffer in real time. Buffer marks are LiveSession's.
+//
+// The trace is a text file of "<seconds> <kbit/s>" lines, each giving the
+// link rate from that time on; it is looped if playback outlasts it. Segment
+// sizes come from the variant playlists when they are local files with byte
+// ranges, and are BANDWIDTH times the segment duration otherwise.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/List.h>
+#include <utils/Vector.h>
+
+#include "ABRPolicy.h"
+#include "M3UParser.h"
+
+using namespace android;
+
+// LiveSession's and PlaylistFetcher's.
+static const int64_t kUpSwitchMarkUs = 15000000ll;
+static const int64_t kDownSwitchMarkUs = 20000000ll;
+static const int64_t kReadyMarkUs = 5000000ll;
+static const int64_t kPrepareMarkUs = 1500000ll;
+static const int64_t kMaxBufferedDurationUs = 30000000ll;
+static const size_t kDownloadBlockSize = 47 * 1024;
+
+struct TracePoint {
+    int64_t mTimeUs;
+    int64_t mBytesPerSec;
+};
+
+struct Variant {
+    AString mURI;
+    int32_t mBandwidthBps;
+    Vector<int64_t> mSegmentSizes;  // empty: BANDWIDTH * duration
+};
+
+struct Trace {
+    Trace(const Vector<TracePoint> &points, int64_t durationUs)
+        : mPoints(points),
+          mDurationUs(durationUs) {
+    }
+
+    int64_t bytesPerSecAt(int64_t timeUs, int64_t *untilUs) const {
+        int64_t loopUs = timeUs / mDurationUs * mDurationUs;
+        int64_t offsetUs = timeUs - loopUs;
+
+        size_t i = 0;
+        while (i + 1 < mPoints.size() && mPoints[i + 1].mTimeUs <= offsetUs) {
+            ++i;
+        }
+        *untilUs = loopUs + (i + 1 < mPoints.size()
+                ? mPoints[i + 1].mTimeUs : mDurationUs);
+        return mPoints[i].mBytesPerSec;
+    }
+
+    // Returns when numBytes started at timeUs will have arrived.
+    int64_t transfer(int64_t timeUs, int64_t numBytes) const {
+        while (numBytes > 0) {
+            int64_t untilUs;
+            int64_t bytesPerSec = bytesPerSecAt(timeUs, &untilUs);
+            if (bytesPerSec <= 0) {
+                timeUs = untilUs;
+                continue;
+            }
+            int64_t available = (untilUs - timeUs) * bytesPerSec / 1000000ll;
+            if (available >= numBytes) {
+                return timeUs + (numBytes * 1000000ll + bytesPerSec - 1)
+                        / bytesPerSec;
+            }
+            numBytes -= available;
+            timeUs = untilUs;
+        }
+        return timeUs;
+    }
+
+private:
+    Vector<TracePoint> mPoints;
+    int64_t mDurationUs;
+};
+
+// Stands in for LiveSession's BandwidthEstimator, which runs off the system
+// clock: the average over the last kWindowUs of samples, and over the last
+// kShortTermSamples.
+struct SimpleEstimator {
+    SimpleEstimator() : mLastEstimate(-1) {}
+
+    void add(int64_t timeUs, size_t numBytes, int64_t delayUs) {
+        Sample sample;
+        sample.mTimeUs = timeUs;
+        sample.mNumBytes = numBytes;
+        sample.mDelayUs = delayUs;
+        mSamples.push_back(sample);
+        while (mSamples.begin()->mTimeUs < timeUs - kWindowUs) {
+            mSamples.erase(mSamples.begin());
+        }
+    }
+
+    bool estimate(int32_t *bps, bool *isStable, int32_t *shortTermBps) {
+        if (mSamples.size() < kShortTermSamples) {
+            return false;
+        }
+
+        int64_t numBytes = 0, delayUs = 0;
+        int64_t shortTermBytes = 0, shortTermDelayUs = 0;
+        size_t n = 0;
+        for (List<Sample>::iterator it = mSamples.begin();
+                it != mSamples.end(); ++it, ++n) {
+            numBytes += it->mNumBytes;
+            delayUs += it->mDelayUs;
+            if (n + kShortTermSamples >= mSamples.size()) {
+                shortTermBytes += it->mNumBytes;
+                shortTermDelayUs += it->mDelayUs;
+            }
+        }
+
+        *bps = numBytes * 8000000ll / delayUs;
+        *shortTermBps = shortTermBytes * 8000000ll / shortTermDelayUs;
+        *isStable = mLastEstimate >= 0
+                && *bps > mLastEstimate * 9 / 10 && *bps < mLastEstimate * 11 / 10;
+        mLastEstimate = *bps;
+        return true;
+    }
+
+private:
+    static const int64_t kWindowUs = 30000000ll;
+    static const size_t kShortTermSamples = 3;
+
+    struct Sample {
+        int64_t mTimeUs;
+        size_t mNumBytes;
+        int64_t mDelayUs;
+    };
+
+    List<Sample> mSamples;
+    int32_t mLastEstimate;
+};
+
+struct Result {
+    int64_t mStartupUs;
+    int64_t mPlayedUs;
+    int64_t mStalledUs;
+    size_t mNumStalls;
+    size_t mNumSwitches;
+    double mAverageBitrateBps;
+};
+
+static int64_t segmentSize(
+        const Variant &variant, size_t index, int64_t segmentDurationUs) {
+    if (index < variant.mSegmentSizes.size()) {
+        return variant.mSegmentSizes[index];
+    }
+    return variant.mBandwidthBps * segmentDurationUs / 8000000ll;
+}
+
+// Plays the buffer out up to timeUs, stalling if it runs dry.
+static void advance(
+        int64_t timeUs, int64_t *nowUs, int64_t *bufferedUs,
+        bool *playing, bool started, Result *result) {
+    int64_t elapsedUs = timeUs - *nowUs;
+    if (*playing) {
+        if (elapsedUs >= *bufferedUs) {
+            result->mPlayedUs += *bufferedUs;
+            result->mStalledUs += elapsedUs - *bufferedUs;
+            ++result->mNumStalls;
+            *bufferedUs = 0;
+            *playing = false;
+        } else {
+            result->mPlayedUs += elapsedUs;
+            *bufferedUs -= elapsedUs;
+        }
+    } else if (started) {
+        result->mStalledUs += elapsedUs;
+    }
+    *nowUs = timeUs;
+}
+
+static void simulate(
+        const char *policyName, const Vector<Variant> &variants,
+        size_t initialIndex, const Trace &trace, size_t numSegments,
+        int64_t segmentDurationUs, int64_t rttUs, Result *result) {
+    sp<ABRPolicy> policy = ABRPolicy::Create(policyName);
+    SimpleEstimator estimator;
+
+    Vector<ABRPolicy::Variant> abrVariants;
+    for (size_t i = 0; i < variants.size(); ++i) {
+        ABRPolicy::Variant variant;
+        variant.mBandwidthBps = variants[i].mBandwidthBps;
+        variant.mUsable = true;
+        abrVariants.push(variant);
+    }
+
+    int64_t upSwitchMarkUs = segmentDurationUs * 7 / 4;
+    if (upSwitchMarkUs > kUpSwitchMarkUs) {
+        upSwitchMarkUs = kUpSwitchMarkUs;
+    }
+    int64_t downSwitchMarkUs = segmentDurationUs * 9 / 4;
+    if (downSwitchMarkUs > kDownSwitchMarkUs) {
+        downSwitchMarkUs = kDownSwitchMarkUs;
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    size_t curIndex = initialIndex;
+    int64_t nowUs = 0;
+    int64_t bufferedUs = 0;
+    bool playing = false;
+    bool preparing = true;
+    double bitsPlayed = 0;
+
+    for (size_t seg = 0; seg < numSegments; ++seg) {
+        // PlaylistFetcher holds off while it has enough buffered.
+        if (bufferedUs > kMaxBufferedDurationUs) {
+            advance(nowUs + bufferedUs - kMaxBufferedDurationUs,
+                    &nowUs, &bufferedUs, &playing, !preparing, result);
+        }
+
+        int64_t size = segmentSize(variants[curIndex], seg, segmentDurationUs);
+        int64_t startUs = nowUs + rttUs;
+        int64_t blockStartUs = startUs;
+        for (int64_t offset = 0; offset < size; offset += kDownloadBlockSize) {
+            int64_t blockSize = size - offset;
+            if (blockSize > (int64_t)kDownloadBlockSize) {
+                blockSize = kDownloadBlockSize;
+            }
+            int64_t blockEndUs = trace.transfer(blockStartUs, blockSize);
+            int64_t delayUs = blockEndUs - blockStartUs;
+            if (delayUs <= 0) {
+                delayUs = 1;
+            }
+            estimator.add(blockEndUs, blockSize, delayUs);
+            policy->addThroughputSample(blockSize, delayUs);
+            blockStartUs = blockEndUs;
+        }
+        int64_t doneUs = blockStartUs;
+
+        advance(doneUs, &nowUs, &bufferedUs, &playing, !preparing, result);
+        bufferedUs += segmentDurationUs;
+        bitsPlayed += (double)variants[curIndex].mBandwidthBps
+                * segmentDurationUs / 1E6;
+
+        if (!playing) {
+            int64_t markUs = preparing ? kPrepareMarkUs : kReadyMarkUs;
+            if (bufferedUs > markUs || seg + 1 == numSegments) {
+                playing = true;
+                if (preparing) {
+                    result->mStartupUs = nowUs;
+                    preparing = false;
+                }
+            }
+        }
+
+        ABRPolicy::Status status;
+        status.mCurIndex = curIndex;
+        status.mBufferedDurationUs = bufferedUs;
+        status.mSegmentDurationUs = segmentDurationUs;
+        status.mBufferHigh = bufferedUs > upSwitchMarkUs;
+        status.mBufferLow = bufferedUs < downSwitchMarkUs;
+        int32_t bps, shortTermBps;
+        bool isStable;
+        if (!estimator.estimate(&bps, &isStable, &shortTermBps)) {
+            bps = shortTermBps = -1;
+            isStable = false;
+        }
+        status.mBandwidthBps = bps;
+        status.mShortTermBandwidthBps = shortTermBps;
+        status.mBandwidthStable = isStable;
+
+        ssize_t index = policy->selectVariant(abrVariants, status);
+        if (index >= 0 && (size_t)index != curIndex
+                && (!preparing || (size_t)index < curIndex)) {
+            curIndex = index;
+            ++result->mNumSwitches;
+        }
+    }
+
+    // Play out what's left.
+    if (playing) {
+        result->mPlayedUs += bufferedUs;
+    }
+
+    result->mAverageBitrateBps = bitsPlayed * 1E6
+            / (numSegments * segmentDurationUs);
+}
+
+static bool readFile(const char *path, AString *data) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data->append(buffer, n);
+    }
+    fclose(file);
+    return true;
+}
+
+static bool readTrace(const char *path, Vector<TracePoint> *points,
+        int64_t *durationUs) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        double seconds, kbps;
+        if (line[0] == '#' || sscanf(line, "%lf %lf", &seconds, &kbps) != 2) {
+            continue;
+        }
+
+        TracePoint point;
+        point.mTimeUs = seconds * 1E6;
+        point.mBytesPerSec = kbps * 1000 / 8;
+        if (!points->isEmpty()
+                && point.mTimeUs <= points->itemAt(points->size() - 1).mTimeUs) {
+            fprintf(stderr, "%s: times must increase\n", path);
+            fclose(file);
+            return false;
+        }
+        points->push(point);
+    }
+    fclose(file);
+
+    if (points->isEmpty()) {
+        return false;
+    }
+
+    // The last rate lasts as long as the interval before it, or a second.
+    size_t n = points->size();
+    int64_t lastUs = points->itemAt(n - 1).mTimeUs;
+    *durationUs = lastUs + (n > 1 ? lastUs - points->itemAt(n - 2).mTimeUs
+                                  : 1000000ll);
+    // The trace starts at time 0.
+    points->editItemAt(0).mTimeUs = 0;
+    return true;
+}
+
+// Reads the segment sizes of a variant's playlist, if it is a local file
+// with byte ranges.
+static void readSegmentSizes(const AString &dir, Variant *variant) {
+    AString path = variant->mURI;
+    if (path.startsWith("file://")) {
+        path.erase(0, 7);
+    } else if (path.find("://") >= 0) {
+        return;
+    } else if (!path.startsWith("/")) {
+        path = dir;
+        path.append(variant->mURI);
+    }
+
+    AString data;
+    if (!readFile(path.c_str(), &data)) {
+        return;
+    }
+
+    sp<M3UParser> playlist = new M3UParser(
+            variant->mURI.c_str(), data.c_str(), data.size());
+    if (playlist->initCheck() != OK || playlist->isVariantPlaylist()) {
+        return;
+    }
+
+    for (size_t i = 0; i < playlist->size(); ++i) {
+        AString uri;
+        sp<AMessage> meta;
+        int64_t rangeLength;
+        if (!playlist->itemAt(i, &uri, &meta) || meta == NULL
+                || !meta->findInt64("range-length", &rangeLength)) {
+            variant->mSegmentSizes.clear();
+            return;
+        }
+        variant->mSegmentSizes.push(rangeLength);
+    }
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-d segment seconds] [-n segments] [-t rtt ms]\n"
+            "          master.m3u8 trace\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    int64_t segmentDurationUs = 6000000ll;
+    size_t numSegments = 100;
+    int64_t rttUs = 50000ll;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:n:t:")) >= 0) {
+        switch (res) {
+            case 'd':
+                segmentDurationUs = atof(optarg) * 1E6;
+                break;
+            case 'n':
+                numSegments = atoi(optarg);
+                break;
+            case 't':
+                rttUs = atoi(optarg) * 1000ll;
+                break;
+            default:
+                usage(me);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 2 || segmentDurationUs <= 0 || numSegments == 0 || rttUs < 0) {
+        usage(me);
+    }
+
+    AString data;
+    if (!readFile(argv[0], &data)) {
+        fprintf(stderr, "can't read %s\n", argv[0]);
+        return 1;
+    }
+
+    sp<M3UParser> master = new M3UParser(argv[0], data.c_str(), data.size());
+    if (master->initCheck() != OK || !master->isVariantPlaylist()) {
+        fprintf(stderr, "%s is not a master playlist\n", argv[0]);
+        return 1;
+    }
+
+    AString dir = argv[0];
+    ssize_t slash = dir.find("/");
+    while (slash >= 0 && dir.find("/", slash + 1) >= 0) {
+        slash = dir.find("/", slash + 1);
+    }
+    if (slash >= 0) {
+        dir.erase(slash + 1, dir.size() - slash - 1);
+    } else {
+        dir.clear();
+    }
+
+    // Sorted by ascending bandwidth, the way LiveSession keeps them.
+    Vector<Variant> variants;
+    int32_t initialBandwidthBps = -1;
+    for (size_t i = 0; i < master->size(); ++i) {
+        Variant variant;
+        sp<AMessage> meta;
+        if (!master->itemAt(i, &variant.mURI, &meta) || meta == NULL
+                || !meta->findInt32("bandwidth", &variant.mBandwidthBps)
+                || variant.mBandwidthBps <= 0) {
+            continue;
+        }
+        readSegmentSizes(dir, &variant);
+        if (initialBandwidthBps < 0) {
+            initialBandwidthBps = variant.mBandwidthBps;
+        }
+
+        size_t j = 0;
+        while (j < variants.size()
+                && variants[j].mBandwidthBps <= variant.mBandwidthBps) {
+            ++j;
+        }
+        variants.insertAt(variant, j);
+    }
+    if (variants.isEmpty()) {
+        fprintf(stderr, "%s has no variants with a bandwidth\n", argv[0]);
+        return 1;
+    }
+
+    // LiveSession starts with the variant listed first.
+    size_t initialIndex = 0;
+    while (variants[initialIndex].mBandwidthBps != initialBandwidthBps) {
+        ++initialIndex;
+    }
+
+    Vector<TracePoint> points;
+    int64_t traceDurationUs;
+    if (!readTrace(argv[1], &points, &traceDurationUs)) {
+        fprintf(stderr, "can't read trace %s\n", argv[1]);
+        return 1;
+    }
+    Trace trace(points, traceDurationUs);
+
+    printf("%zu variants, %zu segments of %.1f s, trace of %.1f s\n",
+            variants.size(), numSegments, segmentDurationUs / 1E6,
+            traceDurationUs / 1E6);
+    printf("%-12s %10s %10s %8s %10s %14s\n",
+            "policy", "startup s", "rebuffer", "stalls", "switches",
+            "avg kbit/s");
+
+    static const char *kPolicies[] = { "threshold", "throughput", "bola" };
+    for (size_t i = 0; i < NELEM(kPolicies); ++i) {
+        Result result;
+        simulate(kPolicies[i], variants, initialIndex, trace, numSegments,
+                segmentDurationUs, rttUs, &result);
+
+        int64_t totalUs = result.mPlayedUs + result.mStalledUs;
+        printf("%-12s %10.2f %9.2f%% %8zu %10zu %14.0f\n",
+                kPolicies[i], result.mStartupUs / 1E6,
+                totalUs > 0 ? 100.0 * result.mStalledUs / totalUs : 0.0,
+                result.mNumStalls, result.mNumSwitches,
+                result.mAverageBitrateBps / 1000);
+    }
+
+    return 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the sustained download rate of a run of HLS segments, fetched one
+// after the other the way PlaylistFetcher does without prefetching, and
+// through SegmentPrefetcher.
+//
+// Segments are served by an in-process stand-in for the HTTP stack, so that
+// runs are repeatable: every request costs a round trip, opening a connection
+// another one, each connection is limited to one receive window per round
+// trip, and all connections share the link rate.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <binder/IInterface.h>
+#include <media/IMediaHTTPConnection.h>
+#include <media/IMediaHTTPService.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+#include "HTTPDownloader.h"
+#include "PlaylistFetcher.h"
+#include "SegmentPrefetcher.h"
+
+using namespace android;
+
+struct Network {
+    int64_t mRttUs;
+    int64_t mConnectionBytesPerSec;
+    int64_t mLinkBytesPerSec;
+
+    Network() : mLinkFreeUs(0) {}
+
+    // Reserves the link for numBytes and returns when they will have arrived,
+    // given that the connection can't receive them any faster than its window
+    // allows.
+    int64_t transfer(size_t numBytes) {
+        Mutex::Autolock autoLock(mLock);
+        int64_t nowUs = ALooper::GetNowUs();
+        if (mLinkFreeUs < nowUs) {
+            mLinkFreeUs = nowUs;
+        }
+        mLinkFreeUs += numBytes * 1000000ll / mLinkBytesPerSec;
+
+        int64_t doneUs = nowUs + numBytes * 1000000ll / mConnectionBytesPerSec;
+        return doneUs > mLinkFreeUs ? doneUs : mLinkFreeUs;
+    }
+
+private:
+    Mutex mLock;
+    int64_t mLinkFreeUs;
+};
+
+// Every resource is served as kResourceSize bytes of the same pattern.
+static const off64_t kResourceSize = 1ll << 40;
+
+struct FakeHTTPConnection : public IMediaHTTPConnection {
+    FakeHTTPConnection(Network *network)
+        : mNetwork(network),
+          mConnected(false),
+          mKeptAlive(false),
+          mRangeOffset(0),
+          mRangeLength(-1) {
+    }
+
+    virtual bool connect(
+            const char * /* uri */, const KeyedVector<String8, String8> *headers) {
+        mRangeOffset = 0;
+        mRangeLength = -1;
+        ssize_t index = headers->indexOfKey(String8("Range"));
+        if (index >= 0) {
+            long long first, last;
+            int n = sscanf(headers->valueAt(index).string(),
+                    "bytes=%lld-%lld", &first, &last);
+            if (n >= 1) {
+                mRangeOffset = first;
+            }
+            if (n == 2) {
+                mRangeLength = last - first + 1;
+            }
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        mConnected = true;
+        // A new connection first needs its handshake.
+        int64_t delayUs = mNetwork->mRttUs * (mKeptAlive ? 1 : 2);
+        mKeptAlive = true;
+        return sleep_l(ALooper::GetNowUs() + delayUs);
+    }
+
+    virtual void disconnect() {
+        Mutex::Autolock autoLock(mLock);
+        mConnected = false;
+        mKeptAlive = false;
+        mCondition.broadcast();
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        off64_t available = getSize() - offset;
+        if (available <= 0) {
+            return 0;
+        }
+        if ((off64_t)size > available) {
+            size = available;
+        }
+
+        memset(data, (mRangeOffset + offset) & 0xff, size);
+
+        Mutex::Autolock autoLock(mLock);
+        if (!sleep_l(mNetwork->transfer(size))) {
+            return ERROR_IO;
+        }
+        return size;
+    }
+
+    virtual off64_t getSize() {
+        return mRangeLength >= 0 ? mRangeLength : kResourceSize - mRangeOffset;
+    }
+
+    virtual status_t getMIMEType(String8 *mimeType) {
+        *mimeType = String8("video/mp2t");
+        return OK;
+    }
+
+    virtual status_t getUri(String8 * /* uri */) {
+        return INVALID_OPERATION;
+    }
+
+protected:
+    virtual IBinder *onAsBinder() {
+        return NULL;
+    }
+
+private:
+    Network *mNetwork;
+    Mutex mLock;
+    Condition mCondition;
+    bool mConnected;
+    bool mKeptAlive;
+    off64_t mRangeOffset;
+    off64_t mRangeLength;
+
+    // Returns false if disconnected before untilUs.
+    bool sleep_l(int64_t untilUs) {
+        for (;;) {
+            if (!mConnected) {
+                return false;
+            }
+            int64_t nowUs = ALooper::GetNowUs();
+            if (nowUs >= untilUs) {
+                return true;
+            }
+            mCondition.waitRelative(mLock, (untilUs - nowUs) * 1000ll);
+        }
+    }
+};
+
+struct FakeHTTPService : public IMediaHTTPService {
+    FakeHTTPService(Network *network) : mNetwork(network) {}
+
+    virtual sp<IMediaHTTPConnection> makeHTTPConnection() {
+        return new FakeHTTPConnection(mNetwork);
+    }
+
+protected:
+    virtual IBinder *onAsBinder() {
+        return NULL;
+    }
+
+private:
+    Network *mNetwork;
+};
+
+static void makeSegments(
+        size_t numSegments, size_t segmentSize, bool byteRanges,
+        Vector<SegmentPrefetcher::Segment> *segments) {
+    for (size_t i = 0; i < numSegments; ++i) {
+        SegmentPrefetcher::Segment segment;
+        segment.mSeqNumber = i;
+        if (byteRanges) {
+            segment.mURI = "http://localhost/stream.ts";
+            segment.mRangeOffset = i * segmentSize;
+        } else {
+            segment.mURI = AStringPrintf("http://localhost/segment%zu.ts", i);
+            segment.mRangeOffset = 0;
+        }
+        segment.mRangeLength = segmentSize;
+        segments->push(segment);
+    }
+}
+
+// Downloads segment the way PlaylistFetcher does, a block at a time.
+static ssize_t fetchSegment(
+        const sp<HTTPDownloader> &downloader,
+        const SegmentPrefetcher::Segment &segment) {
+    sp<ABuffer> buffer;
+    bool reconnect = true;
+    ssize_t n;
+    do {
+        n = downloader->fetchBlock(
+                segment.mURI.c_str(), &buffer,
+                segment.mRangeOffset, segment.mRangeLength,
+                PlaylistFetcher::kDownloadBlockSize, NULL /* actualUrl */,
+                reconnect);
+        reconnect = false;
+    } while (n > 0);
+
+    return n < 0 ? n : (ssize_t)buffer->size();
+}
+
+// Stands in for the fetcher's looper: wakes the bench up once the segment it
+// is waiting for has been downloaded.
+struct TakeWaiter : public AHandler {
+    TakeWaiter() : mNotified(false) {}
+
+    void wait() {
+        Mutex::Autolock autoLock(mLock);
+        while (!mNotified) {
+            mCondition.wait(mLock);
+        }
+        mNotified = false;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> & /* msg */) {
+        Mutex::Autolock autoLock(mLock);
+        mNotified = true;
+        mCondition.signal();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    bool mNotified;
+};
+
+// Returns the number of seconds it took to get every segment, or a negative
+// value on error.
+static double run(
+        const sp<IMediaHTTPService> &service,
+        const Vector<SegmentPrefetcher::Segment> &segments,
+        size_t numWorkers, size_t *numPrefetched) {
+    KeyedVector<String8, String8> headers;
+    sp<HTTPDownloader> downloader = new HTTPDownloader(service, headers);
+
+    sp<SegmentPrefetcher> prefetcher;
+    sp<ALooper> looper;
+    sp<TakeWaiter> waiter;
+    if (numWorkers > 0) {
+        Vector<sp<HTTPDownloader> > downloaders;
+        for (size_t i = 0; i < numWorkers; ++i) {
+            downloaders.push(new HTTPDownloader(service, headers));
+        }
+        prefetcher = new SegmentPrefetcher(downloaders);
+
+        looper = new ALooper;
+        looper->setName("hls_prefetch_bench");
+        looper->start();
+        waiter = new TakeWaiter;
+        looper->registerHandler(waiter);
+    }
+
+    *numPrefetched = 0;
+    int64_t startUs = ALooper::GetNowUs();
+
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const SegmentPrefetcher::Segment &segment = segments[i];
+
+        sp<ABuffer> data;
+        if (prefetcher != NULL) {
+            while (prefetcher->take(
+                        segment, new AMessage(0, waiter), &data) == WOULD_BLOCK) {
+                waiter->wait();
+            }
+
+            Vector<SegmentPrefetcher::Segment> next;
+            for (size_t j = i + 1; j < segments.size() && j <= i + numWorkers; ++j) {
+                next.push(segments[j]);
+            }
+            prefetcher->prefetch(next);
+        }
+
+        size_t size;
+        if (data != NULL) {
+            ++*numPrefetched;
+            size = data->capacity();
+        } else {
+            ssize_t n = fetchSegment(downloader, segment);
+            if (n < 0) {
+                fprintf(stderr, "segment %zu: error %zd\n", i, n);
+                return -1.0;
+            }
+            size = n;
+        }
+
+        if ((int64_t)size != segment.mRangeLength) {
+            fprintf(stderr, "segment %zu: got %zu bytes, expected %lld\n",
+                    i, size, (long long)segment.mRangeLength);
+            return -1.0;
+        }
+    }
+
+    double seconds = (ALooper::GetNowUs() - startUs) / 1E6;
+
+    if (prefetcher != NULL) {
+        prefetcher->stop();
+        looper->unregisterHandler(waiter->id());
+        looper->stop();
+    }
+    return seconds;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-n segments] [-s segment KB] [-t rtt ms]\n"
+            "          [-c connection kbit/s] [-l link kbit/s] [-p max workers] [-b]\n"
+            "  -b  segments are byte ranges of one resource\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    size_t numSegments = 20;
+    size_t segmentSize = 256 * 1024;
+    int64_t rttMs = 100;
+    int64_t connectionKbps = 4000;
+    int64_t linkKbps = 20000;
+    size_t maxWorkers = 4;
+    bool byteRanges = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:s:t:c:l:p:b")) >= 0) {
+        switch (res) {
+            case 'n':
+                numSegments = atoi(optarg);
+                break;
+            case 's':
+                segmentSize = atoi(optarg) * 1024;
+                break;
+            case 't':
+                rttMs = atoi(optarg);
+                break;
+            case 'c':
+                connectionKbps = atoi(optarg);
+                break;
+            case 'l':
+                linkKbps = atoi(optarg);
+                break;
+            case 'p':
+                maxWorkers = atoi(optarg);
+                break;
+            case 'b':
+                byteRanges = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (numSegments == 0 || segmentSize == 0 || rttMs < 0
+            || connectionKbps <= 0 || linkKbps <= 0) {
+        usage(argv[0]);
+    }
+
+    Network network;
+    network.mRttUs = rttMs * 1000ll;
+    network.mConnectionBytesPerSec = connectionKbps * 1000 / 8;
+    network.mLinkBytesPerSec = linkKbps * 1000 / 8;
+    sp<IMediaHTTPService> service = new FakeHTTPService(&network);
+
+    Vector<SegmentPrefetcher::Segment> segments;
+    makeSegments(numSegments, segmentSize, byteRanges, &segments);
+
+    printf("%zu segments of %zu KB%s, rtt %lld ms, "
+            "%lld kbit/s per connection, %lld kbit/s link\n",
+            numSegments, segmentSize / 1024, byteRanges ? " (byte ranges)" : "",
+            (long long)rttMs, (long long)connectionKbps, (long long)linkKbps);
+    printf("%-10s %10s %12s %12s\n", "workers", "seconds", "Mbit/s", "prefetched");
+
+    for (size_t numWorkers = 0; numWorkers <= maxWorkers; ++numWorkers) {
+        size_t numPrefetched;
+        double seconds = run(service, segments, numWorkers, &numPrefetched);
+        if (seconds < 0) {
+            return 1;
+        }
+        printf("%-10zu %10.2f %12.2f %12zu\n",
+                numWorkers, seconds,
+                numSegments * segmentSize * 8 / seconds / 1E6,
+                numPrefetched);
+    }
+
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures what a live playlist refresh costs PlaylistFetcher against the
+// length of the playlist: parsing the whole playlist again, and parsing it
+// given the previous version, with the window sliding by one segment per
+// refresh. Both ways are checked to give the same segments.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+
+#include "M3UParser.h"
+
+using namespace android;
+
+static const char *kBaseURI = "http://localhost/live/index.m3u8";
+
+struct Options {
+    bool mByteRanges;
+    size_t mKeyInterval;            // 0: not encrypted
+    size_t mDiscontinuityInterval;  // 0: none
+};
+
+// The live window of numSegments segments starting at firstSeqNumber.
+static AString makePlaylist(
+        const Options &options, int32_t firstSeqNumber, size_t numSegments) {
+    AString data("#EXTM3U\n#EXT-X-VERSION:4\n#EXT-X-TARGETDURATION:6\n");
+    data.append(AStringPrintf("#EXT-X-MEDIA-SEQUENCE:%d\n", firstSeqNumber));
+
+    size_t discontinuitySeq = 0;
+    if (options.mDiscontinuityInterval > 0) {
+        discontinuitySeq = firstSeqNumber / options.mDiscontinuityInterval;
+    }
+    data.append(AStringPrintf(
+            "#EXT-X-DISCONTINUITY-SEQUENCE:%zu\n", discontinuitySeq));
+
+    for (size_t i = 0; i < numSegments; ++i) {
+        int32_t seqNumber = firstSeqNumber + i;
+
+        if (options.mKeyInterval > 0
+                && (i == 0 || seqNumber % options.mKeyInterval == 0)) {
+            data.append(AStringPrintf(
+                    "#EXT-X-KEY:METHOD=AES-128,URI=\"key%zu.bin\"\n",
+                    seqNumber / options.mKeyInterval));
+        }
+        if (i > 0 && options.mDiscontinuityInterval > 0
+                && seqNumber % options.mDiscontinuityInterval == 0) {
+            data.append("#EXT-X-DISCONTINUITY\n");
+        }
+
+        data.append(AStringPrintf("#EXTINF:%d.%03d,\n",
+                5 + seqNumber % 2, seqNumber % 1000));
+        if (options.mByteRanges) {
+            data.append(AStringPrintf("#EXT-X-BYTERANGE:%d@%lld\n",
+                    100000 + seqNumber % 7, (long long)seqNumber * 200000));
+            data.append("stream.ts\n");
+        } else {
+            data.append(AStringPrintf("segment%d.ts\n", seqNumber));
+        }
+    }
+
+    return data;
+}
+
+static bool sameSegments(
+        const sp<M3UParser> &a, const sp<M3UParser> &b) {
+    int32_t firstA, lastA, firstB, lastB;
+    a->getSeqNumberRange(&firstA, &lastA);
+    b->getSeqNumberRange(&firstB, &lastB);
+    if (firstA != firstB || lastA != lastB || a->size() != b->size()) {
+        return false;
+    }
+
+    static const char *kIntKeys[] = {
+        "discontinuity-sequence", "discontinuity",
+    };
+    static const char *kInt64Keys[] = {
+        "durationUs", "range-offset", "range-length",
+    };
+    static const char *kStringKeys[] = {
+        "cipher-method", "cipher-uri", "cipher-iv",
+    };
+
+    for (size_t i = 0; i < a->size(); ++i) {
+        AString uriA, uriB;
+        sp<AMessage> metaA, metaB;
+        CHECK(a->itemAt(i, &uriA, &metaA));
+        CHECK(b->itemAt(i, &uriB, &metaB));
+        if (uriA != uriB
+                || a->getSegmentStartTimeUs(i) != b->getSegmentStartTimeUs(i)) {
+            return false;
+        }
+
+        for (size_t j = 0; j < NELEM(kIntKeys); ++j) {
+            int32_t x = -1, y = -1;
+            if (metaA->findInt32(kIntKeys[j], &x)
+                    != metaB->findInt32(kIntKeys[j], &y) || x != y) {
+                return false;
+            }
+        }
+        for (size_t j = 0; j < NELEM(kInt64Keys); ++j) {
+            int64_t x = -1, y = -1;
+            if (metaA->findInt64(kInt64Keys[j], &x)
+                    != metaB->findInt64(kInt64Keys[j], &y) || x != y) {
+                return false;
+            }
+        }
+
+        sp<AMessage> cipherA = a->getCipherInfo(i);
+        sp<AMessage> cipherB = b->getCipherInfo(i);
+        for (size_t j = 0; j < NELEM(kStringKeys); ++j) {
+            AString x, y;
+            if (metaA->findString(kStringKeys[j], &x)
+                    != metaB->findString(kStringKeys[j], &y) || x != y) {
+                return false;
+            }
+            if ((cipherA == NULL) != (cipherB == NULL)) {
+                return false;
+            }
+            if (cipherA != NULL
+                    && (cipherA->findString(kStringKeys[j], &x)
+                            != cipherB->findString(kStringKeys[j], &y)
+                        || x != y)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Returns the average time per refresh in us, or a negative value if the
+// two ways of parsing disagree.
+static double run(
+        const Options &options, size_t numSegments, size_t numRefreshes,
+        bool incremental) {
+    Vector<AString> playlists;
+    for (size_t i = 0; i <= numRefreshes; ++i) {
+        playlists.push(makePlaylist(options, 1000 + i, numSegments));
+    }
+
+    sp<M3UParser> playlist = new M3UParser(
+            kBaseURI, playlists[0].c_str(), playlists[0].size());
+    CHECK_EQ(playlist->initCheck(), (status_t)OK);
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 1; i <= numRefreshes; ++i) {
+        sp<M3UParser> previous;
+        if (incremental) {
+            previous = playlist;
+        }
+        playlist = new M3UParser(
+                kBaseURI, playlists[i].c_str(), playlists[i].size(), previous);
+        CHECK_EQ(playlist->initCheck(), (status_t)OK);
+    }
+    double us = (double)(ALooper::GetNowUs() - startUs) / numRefreshes;
+
+    if (incremental) {
+        const AString &last = playlists[numRefreshes];
+        sp<M3UParser> full = new M3UParser(kBaseURI, last.c_str(), last.size());
+        if (!sameSegments(playlist, full)) {
+            fprintf(stderr, "%zu segments: incremental parse differs\n",
+                    numSegments);
+            return -1.0;
+        }
+    }
+
+    return us;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-r refreshes] [-b] [-k key interval]"
+            " [-d discontinuity interval]\n"
+            "  -b  segments are byte ranges of one resource\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    size_t numRefreshes = 20;
+    Options options;
+    options.mByteRanges = false;
+    options.mKeyInterval = 0;
+    options.mDiscontinuityInterval = 0;
+
+    int res;
+    while ((res = getopt(argc, argv, "r:bk:d:")) >= 0) {
+        switch (res) {
+            case 'r':
+                numRefreshes = atoi(optarg);
+                break;
+            case 'b':
+                options.mByteRanges = true;
+                break;
+            case 'k':
+                options.mKeyInterval = atoi(optarg);
+                break;
+            case 'd':
+                options.mDiscontinuityInterval = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (numRefreshes == 0) {
+        usage(argv[0]);
+    }
+
+    static const size_t kNumSegments[] = { 10, 100, 1000, 5000, 20000 };
+
+    printf("%-10s %14s %14s\n", "segments", "full us", "incremental us");
+    for (size_t i = 0; i < NELEM(kNumSegments); ++i) {
+        double fullUs = run(options, kNumSegments[i], numRefreshes, false);
+        double incrementalUs =
+            run(options, kNumSegments[i], numRefreshes, true);
+        if (incrementalUs < 0) {
+            return 1;
+        }
+        printf("%-10zu %14.1f %14.1f\n",
+                kNumSegments[i], fullUs, incrementalUs);
+    }
+
+    return 0;
+}
@@ -33,6 +33,7 @@ struct AMessage;
 struct AnotherPacketSource;
 struct ATSParser;
 class DataSource;
+struct MPEG2TSSeekIndex;
 struct MPEG2TSSource;
 class String8;
 
@@ -48,6 +49,9 @@ struct MPEG2TSExtractor : public MediaExtractor {
     virtual uint32_t flags() const;
     virtual const char * name() { return "MPEG2TSExtractor"; }
 
+protected:
+    virtual ~MPEG2TSExtractor();
+
 private:
     friend struct MPEG2TSSource;
 
@@ -68,6 +72,12 @@ private:
     // If no video track is present, audio track will be used instead.
     KeyedVector<int64_t, off64_t> *mSeekSyncPoints;
 
+    // Sync points of the seek track for the whole file, from a cache or
+    // built in the background. NULL if the file isn't worth indexing.
+    sp<MPEG2TSSeekIndex> mSeekIndex;
+    // How many of its entries have been added to mSeekSyncPoints
+    size_t mNumSeekIndexEntriesMerged;
+
     off64_t mOffset;
 
     void init();
@@ -89,6 +99,10 @@ private:
     // Add a SynPoint derived from |event|.
     void addSyncPoint_l(const ATSParser::SyncEvent &event);
 
+    // Add the entries mSeekIndex has found since the last call to
+    // mSeekSyncPoints.
+    void mergeSeekIndex_l();
+
     DISALLOW_EVIL_CONSTRUCTORS(MPEG2TSExtractor);
 };
 
@@ -73,6 +73,13 @@ private:
         uint32_t datalen;
         uint8_t *data;
     };
+    // A sample table box that is only needed to read samples, not to report metadata.
+    struct DeferredTable {
+        uint32_t type;
+        off64_t offset;
+        size_t size;
+    };
+
     struct Track {
         Track *next;
         sp<MetaData> meta;
@@ -80,6 +87,10 @@ private:
         sp<SampleTable> sampleTable;
         bool includes_expensive_metadata;
         bool skipTrack;
+
+        // ctts and stss boxes, read into sampleTable by loadDeferredTables()
+        Vector<DeferredTable> deferredTables;
+        status_t deferredTablesStatus;
     };
 
     Vector<SidxEntry> mSidxEntries;
@@ -108,6 +119,7 @@ private:
     KeyedVector<uint32_t, AString> mMetaKeyMap;
 
     status_t readMetaData();
+    status_t loadDeferredTables(Track *track);
     status_t parseChunk(off64_t *offset, int depth);
     status_t parseITunesMetaData(off64_t offset, size_t size);
     status_t parseColorInfo(off64_t offset, size_t size);
@@ -70,6 +70,24 @@ struct NuCachedSource2 : public DataSource {
             String8 *cacheConfig,
             bool *disconnectAtHighwatermark);
 
+    struct Stats {
+        uint64_t mBytesFetched;     // read from the source into the cache
+        uint64_t mBytesConsumed;    // returned by readAt()
+        // Read ahead of the last readAt(), then dropped by a seek.
+        uint64_t mBytesDiscarded;
+        uint32_t mNumSeeks;
+        size_t mReadSize;           // the size of the next read from the source
+        bool mRandomAccess;
+    };
+
+    void getStats(Stats *stats) const;
+
+    // The size of the next read from the source, given the size of the
+    // current ones and that a read of numBytes took durationUs. At most
+    // maxReadSize.
+    static size_t ComputeReadSize(
+            size_t readSize, size_t maxReadSize, size_t numBytes, int64_t durationUs);
+
 protected:
     virtual ~NuCachedSource2();
 
@@ -89,6 +107,20 @@ private:
         // Read data after a 15 sec timeout whether we're actively
         // fetching or not.
         kDefaultKeepAliveIntervalUs     = 15000000,
+
+        // Reads from the source are a power of two times kPageSize, up to
+        // kMaxReadSize, and take about kTargetReadDurationUs at the rate the
+        // source last delivered.
+        kMaxReadSize                    = 1024 * 1024,
+        kTargetReadDurationUs           = 200000,
+
+        // After kMinShortRunsForRandomAccess seeks in a row, each less than
+        // kSequentialRunBytes past the previous one, only read
+        // kRandomAccessReadahead bytes ahead of the reader, kPageSize at a
+        // time. Reading kSequentialRunBytes without a seek ends this.
+        kMinShortRunsForRandomAccess    = 3,
+        kSequentialRunBytes             = 1024 * 1024,
+        kRandomAccessReadahead          = 512 * 1024,
     };
 
     enum {
@@ -128,6 +160,16 @@ private:
 
     bool mDisconnectAtHighwatermark;
 
+    size_t mReadSize;
+    bool mRandomAccess;
+    uint32_t mNumShortRuns;
+    size_t mBytesReadSinceSeek;
+    // The end of the last readAt(), and of the one readInternal() is waiting
+    // for data for, if any.
+    off64_t mLastReadEnd;
+    off64_t mDeferredReadEnd;
+    Stats mStats;
+
     void onMessageReceived(const sp<AMessage> &msg);
     void onFetch();
     void onRead(const sp<AMessage> &msg);
@@ -136,6 +178,11 @@ private:
     ssize_t readInternal(off64_t offset, void *data, size_t size);
     status_t seekInternal_l(off64_t offset);
 
+    void onDataRead_l(off64_t offset, size_t size);
+    // How much of the first numBytes of the cache is past the last read.
+    size_t unreadBytes_l(size_t numBytes) const;
+    void updateReadSize_l(size_t numBytes, int64_t durationUs);
+
     size_t approxDataRemaining_l(status_t *finalStatus) const;
 
     void restartPrefetcherIfNecessary_l(
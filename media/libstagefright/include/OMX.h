@@ -121,6 +121,9 @@ public:
             node_id node, OMX_U32 port_index, const sp<IMemory> &params,
             buffer_id *buffer, OMX_U32 allottedSize);
 
+    virtual status_t getBufferCopyStats(
+            node_id node, OMX_U32 port_index, uint64_t *bytesCopied);
+
     virtual status_t freeBuffer(
             node_id node, OMX_U32 port_index, buffer_id buffer);
 
@@ -109,6 +109,8 @@ struct OMXNodeInstance {
             OMX_U32 portIndex, const sp<IMemory> &params,
             OMX::buffer_id *buffer, OMX_U32 allottedSize);
 
+    status_t getBufferCopyStats(OMX_U32 portIndex, uint64_t *bytesCopied);
+
     status_t freeBuffer(OMX_U32 portIndex, OMX::buffer_id buffer);
 
     status_t fillBuffer(OMX::buffer_id buffer, int fenceFd);
@@ -156,6 +158,8 @@ private:
     bool mQueriedProhibitedExtensions;
     SortedVector<OMX_INDEXTYPE> mProhibitedExtensions;
     bool mIsSecure;
+    // in-process software component that can share backup buffers
+    bool mShareBackupBuffers;
 
     // Lock only covers mGraphicBufferSource.  We can't always use mLock
     // because of rare instances where we'd end up locking it recursively.
@@ -193,6 +197,7 @@ private:
     int DEBUG_BUMP;
     SortedVector<OMX_BUFFERHEADERTYPE *> mInputBuffersWithCodec, mOutputBuffersWithCodec;
     size_t mDebugLevelBumpPendingBuffers[2];
+    uint64_t mBytesCopied[2];
     void bumpDebugLevel_l(size_t numInputBuffers, size_t numOutputBuffers);
     void unbumpDebugLevel_l(size_t portIndex);
 
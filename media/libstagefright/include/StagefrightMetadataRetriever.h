@@ -41,6 +41,7 @@ struct StagefrightMetadataRetriever : public MediaMetadataRetrieverInterface {
     virtual status_t setDataSource(const sp<DataSource>& source);
 
     virtual VideoFrame *getFrameAtTime(int64_t timeUs, int option);
+    virtual VideoFrame *getThumbnailAtTime(int64_t timeUs, int32_t maxWidth, int32_t maxHeight);
     virtual MediaAlbumArt *extractAlbumArt();
     virtual const char *extractMetadata(int keyCode);
 
@@ -53,6 +54,9 @@ private:
     MediaAlbumArt *mAlbumArt;
 
     void parseMetaData();
+    // Full size frame if |maxWidth| or |maxHeight| is not positive.
+    VideoFrame *getFrameInternal(
+            int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight);
     // Delete album art and clear metadata.
     void clearMetadata();
 
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THUMBNAIL_DECODER_POOL_H_
+
+#define THUMBNAIL_DECODER_POOL_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ALooper;
+struct MediaCodec;
+
+// Process-wide pool of stopped decoders used for thumbnail extraction, so that
+// extracting many thumbnails in a row does not instantiate a new component for
+// every file. Decoders are keyed by component name and released after they
+// have been idle for a few seconds.
+struct ThumbnailDecoderPool : public AHandler {
+    static sp<ThumbnailDecoderPool> getInstance();
+
+    // Returns an unconfigured decoder for |componentName|, reusing an idle one
+    // if possible.
+    sp<MediaCodec> acquire(const AString &componentName, status_t *err);
+
+    // Returns |decoder| (which must have been acquired for |componentName|) to
+    // the pool. The decoder is stopped here; it is released instead if it could
+    // not be stopped or the pool is full.
+    void recycle(const AString &componentName, const sp<MediaCodec> &decoder);
+
+protected:
+    virtual ~ThumbnailDecoderPool();
+
+    virtual void onMessageReceived(const sp<AMessage> &msg);
+
+private:
+    enum {
+        kWhatEvict = 'evct',
+    };
+
+    struct IdleDecoder {
+        sp<MediaCodec> mDecoder;
+        int64_t mIdleSinceUs;
+    };
+
+    Mutex mLock;
+    sp<ALooper> mLooper;
+    KeyedVector<AString, Vector<IdleDecoder> > mIdleDecoders;
+    bool mEvictPending;
+
+    ThumbnailDecoderPool();
+
+    void scheduleEvict_l();
+
+    DISALLOW_EVIL_CONSTRUCTORS(ThumbnailDecoderPool);
+};
+
+}  // namespace android
+
+#endif  // THUMBNAIL_DECODER_POOL_H_
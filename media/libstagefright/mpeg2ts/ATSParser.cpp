@@ -54,19 +54,19 @@ struct ATSParser::Program : public RefBase {
     bool parsePSISection(
             unsigned pid, ABitReader *br, status_t *err);
 
-    // Pass to appropriate stream according to pid, and set event if it's a PES
-    // with a sync frame.
-    // Note that the method itself does not touch event.
-    bool parsePID(
-            unsigned pid, unsigned continuity_counter,
-            unsigned payload_unit_start_indicator,
-            ABitReader *br, status_t *err, SyncEvent *event);
+    // Keyed by elementary PID. The parser routes packets to them through its
+    // PID table.
+    const KeyedVector<unsigned, sp<Stream> > &streams() const {
+        return mStreams;
+    }
 
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
     void signalEOS(status_t finalResult);
 
+    void discardAccessUnits();
+
     sp<MediaSource> getSource(SourceType type);
     bool hasSource(SourceType type) const;
 
@@ -135,6 +135,8 @@ struct ATSParser::Stream : public RefBase {
 
     void signalEOS(status_t finalResult);
 
+    void discardAccessUnits();
+
     sp<MediaSource> getSource(SourceType type);
 
     bool isAudio() const;
@@ -245,23 +247,6 @@ bool ATSParser::Program::parsePSISection(
     return true;
 }
 
-bool ATSParser::Program::parsePID(
-        unsigned pid, unsigned continuity_counter,
-        unsigned payload_unit_start_indicator,
-        ABitReader *br, status_t *err, SyncEvent *event) {
-    *err = OK;
-
-    ssize_t index = mStreams.indexOfKey(pid);
-    if (index < 0) {
-        return false;
-    }
-
-    *err = mStreams.editValueAt(index)->parse(
-            continuity_counter, payload_unit_start_indicator, br, event);
-
-    return true;
-}
-
 void ATSParser::Program::signalDiscontinuity(
         DiscontinuityType type, const sp<AMessage> &extra) {
     int64_t mediaTimeUs;
@@ -283,6 +268,12 @@ void ATSParser::Program::signalEOS(status_t finalResult) {
     }
 }
 
+void ATSParser::Program::discardAccessUnits() {
+    for (size_t i = 0; i < mStreams.size(); ++i) {
+        mStreams.editValueAt(i)->discardAccessUnits();
+    }
+}
+
 bool ATSParser::Program::switchPIDs(const Vector<StreamInfo> &infos) {
     bool success = false;
 
@@ -482,6 +473,8 @@ status_t ATSParser::Program::parseProgramMap(ABitReader *br) {
             ALOGI("Stream PIDs changed and we cannot recover.");
             return ERROR_MALFORMED;
         }
+
+        mParser->mPIDTableStale = true;
     }
 
     for (size_t i = 0; i < infos.size(); ++i) {
@@ -494,6 +487,7 @@ status_t ATSParser::Program::parseProgramMap(ABitReader *br) {
                     this, info.mPID, info.mType, PCR_PID);
 
             mStreams.add(info.mPID, stream);
+            mParser->mPIDTableStale = true;
         }
     }
 
@@ -823,6 +817,12 @@ void ATSParser::Stream::signalEOS(status_t finalResult) {
     flush(NULL);
 }
 
+void ATSParser::Stream::discardAccessUnits() {
+    if (mSource != NULL) {
+        mSource->clear();
+    }
+}
+
 status_t ATSParser::Stream::parsePES(ABitReader *br, SyncEvent *event) {
     unsigned packet_startcode_prefix = br->getBits(24);
 
@@ -1165,6 +1165,7 @@ sp<MediaSource> ATSParser::Stream::getSource(SourceType type) {
 
 ATSParser::ATSParser(uint32_t flags)
     : mFlags(flags),
+      mPIDTableStale(true),
       mAbsoluteTimeAnchorUs(-1ll),
       mTimeOffsetValid(false),
       mTimeOffsetUs(0ll),
@@ -1184,8 +1185,53 @@ status_t ATSParser::feedTSPacket(const void *data, size_t size,
         return BAD_VALUE;
     }
 
-    ABitReader br((const uint8_t *)data, kTSPacketSize);
-    return parseTS(&br, event);
+    return parseTS((const uint8_t *)data, event);
+}
+
+status_t ATSParser::feedTSPackets(const void *data, size_t size,
+        SyncEvent *event, size_t *numPacketsFed) {
+    if (numPacketsFed != NULL) {
+        *numPacketsFed = 0;
+    }
+
+    if (size % kTSPacketSize != 0) {
+        ALOGE("Wrong TS packets size %zu", size);
+        return BAD_VALUE;
+    }
+
+    const uint8_t *packet = (const uint8_t *)data;
+    const size_t numPackets = size / kTSPacketSize;
+    const off64_t offset = (event != NULL) ? event->getOffset() : 0;
+
+    status_t err = OK;
+    size_t i = 0;
+    while (i < numPackets) {
+        if (event == NULL) {
+            err = parseTS(packet, NULL);
+        } else {
+            // Each packet gets an event with its own offset, like
+            // feedTSPacket() callers do
+            SyncEvent packetEvent(offset + (off64_t)(i * kTSPacketSize));
+            err = parseTS(packet, &packetEvent);
+            if (packetEvent.hasReturnedData()) {
+                *event = packetEvent;
+                ++i;
+                break;
+            }
+        }
+
+        ++i;
+        packet += kTSPacketSize;
+
+        if (err != OK) {
+            break;
+        }
+    }
+
+    if (numPacketsFed != NULL) {
+        *numPacketsFed = i;
+    }
+    return err;
 }
 
 void ATSParser::signalDiscontinuity(
@@ -1247,6 +1293,12 @@ void ATSParser::signalEOS(status_t finalResult) {
     }
 }
 
+void ATSParser::discardAccessUnits() {
+    for (size_t i = 0; i < mPrograms.size(); ++i) {
+        mPrograms.editItemAt(i)->discardAccessUnits();
+    }
+}
+
 void ATSParser::parseProgramAssociationTable(ABitReader *br) {
     unsigned table_id = br->getBits(8);
     ALOGV("  table_id = %u", table_id);
@@ -1303,6 +1355,7 @@ void ATSParser::parseProgramAssociationTable(ABitReader *br) {
 
             if (mPSISections.indexOfKey(programMapPID) < 0) {
                 mPSISections.add(programMapPID, new PSISection);
+                mPIDTableStale = true;
             }
         }
     }
@@ -1315,130 +1368,161 @@ status_t ATSParser::parsePID(
         unsigned continuity_counter,
         unsigned payload_unit_start_indicator,
         SyncEvent *event) {
-    ssize_t sectionIndex = mPSISections.indexOfKey(PID);
+    if (mPIDTableStale) {
+        rebuildPIDTable();
+    }
 
-    if (sectionIndex >= 0) {
-        sp<PSISection> section = mPSISections.valueAt(sectionIndex);
+    unsigned targetIndex = mPIDTable[PID];
+    if (targetIndex == 0) {
+        ALOGV("PID 0x%04x not handled.", PID);
+        return OK;
+    }
 
-        if (payload_unit_start_indicator) {
-            if (!section->isEmpty()) {
-                ALOGW("parsePID encounters payload_unit_start_indicator when section is not empty");
-                section->clear();
-            }
+    const PIDTarget &target = mPIDTargets.itemAt(targetIndex - 1);
+    if (target.mStream != NULL) {
+        return target.mStream->parse(
+                continuity_counter, payload_unit_start_indicator, br, event);
+    }
 
-            unsigned skip = br->getBits(8);
-            section->setSkipBytes(skip + 1);  // skip filler bytes + pointer field itself
-            br->skipBits(skip * 8);
-        }
+    // Parsing the section may rebuild the table, so hold on to the section
+    sp<PSISection> section = target.mSection;
 
-        if (br->numBitsLeft() % 8 != 0) {
-            return ERROR_MALFORMED;
+    if (payload_unit_start_indicator) {
+        if (!section->isEmpty()) {
+            ALOGW("parsePID encounters payload_unit_start_indicator when section is not empty");
+            section->clear();
         }
-        status_t err = section->append(br->data(), br->numBitsLeft() / 8);
 
-        if (err != OK) {
-            return err;
-        }
+        unsigned skip = br->getBits(8);
+        section->setSkipBytes(skip + 1);  // skip filler bytes + pointer field itself
+        br->skipBits(skip * 8);
+    }
 
-        if (!section->isComplete()) {
-            return OK;
-        }
+    if (br->numBitsLeft() % 8 != 0) {
+        return ERROR_MALFORMED;
+    }
+    status_t err = section->append(br->data(), br->numBitsLeft() / 8);
 
-        if (!section->isCRCOkay()) {
-            return BAD_VALUE;
-        }
-        ABitReader sectionBits(section->data(), section->size());
+    if (err != OK) {
+        return err;
+    }
 
-        if (PID == 0) {
-            parseProgramAssociationTable(&sectionBits);
-        } else {
-            bool handled = false;
-            for (size_t i = 0; i < mPrograms.size(); ++i) {
-                status_t err;
-                if (!mPrograms.editItemAt(i)->parsePSISection(
-                            PID, &sectionBits, &err)) {
-                    continue;
-                }
+    if (!section->isComplete()) {
+        return OK;
+    }
 
-                if (err != OK) {
-                    return err;
-                }
+    if (!section->isCRCOkay()) {
+        return BAD_VALUE;
+    }
+    ABitReader sectionBits(section->data(), section->size());
 
-                handled = true;
-                break;
+    if (PID == 0) {
+        parseProgramAssociationTable(&sectionBits);
+    } else {
+        bool handled = false;
+        for (size_t i = 0; i < mPrograms.size(); ++i) {
+            status_t err;
+            if (!mPrograms.editItemAt(i)->parsePSISection(
+                        PID, &sectionBits, &err)) {
+                continue;
             }
 
-            if (!handled) {
-                mPSISections.removeItem(PID);
-                section.clear();
+            if (err != OK) {
+                return err;
             }
+
+            handled = true;
+            break;
         }
 
-        if (section != NULL) {
-            section->clear();
+        if (!handled) {
+            mPSISections.removeItem(PID);
+            mPIDTableStale = true;
+            section.clear();
         }
+    }
 
-        return OK;
+    if (section != NULL) {
+        section->clear();
     }
 
-    bool handled = false;
-    for (size_t i = 0; i < mPrograms.size(); ++i) {
-        status_t err;
-        if (mPrograms.editItemAt(i)->parsePID(
-                    PID, continuity_counter, payload_unit_start_indicator,
-                    br, &err, event)) {
-            if (err != OK) {
-                return err;
-            }
+    return OK;
+}
 
-            handled = true;
-            break;
+void ATSParser::rebuildPIDTable() {
+    memset(mPIDTable, 0, sizeof(mPIDTable));
+    mPIDTargets.clear();
+
+    // PSI sections come first, then the streams of each program in order;
+    // the first to claim a PID gets it.
+    for (size_t i = 0; i < mPSISections.size(); ++i) {
+        unsigned PID = mPSISections.keyAt(i);
+        if (PID >= kNumPIDs) {
+            continue;
         }
+        PIDTarget target;
+        target.mSection = mPSISections.valueAt(i);
+        mPIDTargets.push(target);
+        mPIDTable[PID] = mPIDTargets.size();
     }
 
-    if (!handled) {
-        ALOGV("PID 0x%04x not handled.", PID);
+    for (size_t i = 0; i < mPrograms.size(); ++i) {
+        const KeyedVector<unsigned, sp<Stream> > &streams =
+                mPrograms.itemAt(i)->streams();
+        for (size_t j = 0; j < streams.size(); ++j) {
+            unsigned PID = streams.keyAt(j);
+            if (PID >= kNumPIDs || mPIDTable[PID] != 0) {
+                continue;
+            }
+            PIDTarget target;
+            target.mStream = streams.valueAt(j);
+            mPIDTargets.push(target);
+            mPIDTable[PID] = mPIDTargets.size();
+        }
     }
 
-    return OK;
+    mPIDTableStale = false;
 }
 
-status_t ATSParser::parseAdaptationField(ABitReader *br, unsigned PID) {
-    unsigned adaptation_field_length = br->getBits(8);
+
+status_t ATSParser::parseAdaptationField(
+        const uint8_t *data, unsigned PID, size_t *payloadOffset) {
+    unsigned adaptation_field_length = data[4];
+    *payloadOffset = 5 + adaptation_field_length;
 
     if (adaptation_field_length > 0) {
-        if (adaptation_field_length * 8 > br->numBitsLeft()) {
+        if (adaptation_field_length > kTSPacketSize - 5) {
             ALOGV("Adaptation field should be included in a single TS packet.");
             return ERROR_MALFORMED;
         }
 
-        unsigned discontinuity_indicator = br->getBits(1);
+        unsigned discontinuity_indicator = data[5] >> 7;
 
         if (discontinuity_indicator) {
             ALOGV("PID 0x%04x: discontinuity_indicator = 1 (!!!)", PID);
         }
 
-        br->skipBits(2);
-        unsigned PCR_flag = br->getBits(1);
-
-        size_t numBitsRead = 4;
+        unsigned PCR_flag = (data[5] >> 4) & 1;
 
         if (PCR_flag) {
-            if (adaptation_field_length * 8 < 52) {
+            // 33 bits of PCR_base, 6 reserved bits and 9 bits of PCR_ext
+            // follow the flags.
+            if (adaptation_field_length < 7) {
                 return ERROR_MALFORMED;
             }
-            br->skipBits(4);
-            uint64_t PCR_base = br->getBits(32);
-            PCR_base = (PCR_base << 1) | br->getBits(1);
+            uint64_t PCR_base =
+                ((uint64_t)data[6] << 25)
+                | ((uint64_t)data[7] << 17)
+                | ((uint64_t)data[8] << 9)
+                | ((uint64_t)data[9] << 1)
+                | (data[10] >> 7);
 
-            br->skipBits(6);
-            unsigned PCR_ext = br->getBits(9);
+            unsigned PCR_ext = ((data[10] & 1) << 8) | data[11];
 
             // The number of bytes from the start of the current
             // MPEG2 transport stream packet up and including
             // the final byte of this PCR_ext field.
-            size_t byteOffsetFromStartOfTSPacket =
-                (188 - br->numBitsLeft() / 8);
+            size_t byteOffsetFromStartOfTSPacket = 12;
 
             uint64_t PCR = PCR_base * 300 + PCR_ext;
 
@@ -1453,55 +1537,48 @@ status_t ATSParser::parseAdaptationField(ABitReader *br, unsigned PID) {
             for (size_t i = 0; i < mPrograms.size(); ++i) {
                 updatePCR(PID, PCR, byteOffsetFromStart);
             }
-
-            numBitsRead += 52;
         }
-
-        br->skipBits(adaptation_field_length * 8 - numBitsRead);
     }
     return OK;
 }
 
-status_t ATSParser::parseTS(ABitReader *br, SyncEvent *event) {
+status_t ATSParser::parseTS(const uint8_t *data, SyncEvent *event) {
     ALOGV("---");
 
-    unsigned sync_byte = br->getBits(8);
+    // The 4-byte header is read straight from the packet; only the payload
+    // goes through a bit reader.
+    unsigned sync_byte = data[0];
     if (sync_byte != 0x47u) {
         ALOGE("[error] parseTS: return error as sync_byte=0x%x", sync_byte);
         return BAD_VALUE;
     }
 
-    if (br->getBits(1)) {  // transport_error_indicator
+    if (data[1] & 0x80) {  // transport_error_indicator
         // silently ignore.
         return OK;
     }
 
-    unsigned payload_unit_start_indicator = br->getBits(1);
+    unsigned payload_unit_start_indicator = (data[1] >> 6) & 1;
     ALOGV("payload_unit_start_indicator = %u", payload_unit_start_indicator);
 
-    MY_LOGV("transport_priority = %u", br->getBits(1));
+    unsigned PID = ((data[1] & 0x1f) << 8) | data[2];
 
-    unsigned PID = br->getBits(13);
-    ALOGV("PID = 0x%04x", PID);
-
-    MY_LOGV("transport_scrambling_control = %u", br->getBits(2));
-
-    unsigned adaptation_field_control = br->getBits(2);
+    unsigned adaptation_field_control = (data[3] >> 4) & 3;
     ALOGV("adaptation_field_control = %u", adaptation_field_control);
 
-    unsigned continuity_counter = br->getBits(4);
+    unsigned continuity_counter = data[3] & 0x0f;
     ALOGV("PID = 0x%04x, continuity_counter = %u", PID, continuity_counter);
 
-    // ALOGI("PID = 0x%04x, continuity_counter = %u", PID, continuity_counter);
-
     status_t err = OK;
+    size_t payloadOffset = 4;
 
     if (adaptation_field_control == 2 || adaptation_field_control == 3) {
-        err = parseAdaptationField(br, PID);
+        err = parseAdaptationField(data, PID, &payloadOffset);
     }
     if (err == OK) {
         if (adaptation_field_control == 1 || adaptation_field_control == 3) {
-            err = parsePID(br, PID, continuity_counter,
+            ABitReader br(data + payloadOffset, kTSPacketSize - payloadOffset);
+            err = parsePID(&br, PID, continuity_counter,
                     payload_unit_start_indicator, event);
         }
     }
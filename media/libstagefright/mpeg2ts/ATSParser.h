@@ -102,11 +102,25 @@ struct ATSParser : public RefBase {
     status_t feedTSPacket(
             const void *data, size_t size, SyncEvent *event = NULL);
 
+    // Feed a run of TS packets into the parser; size must be a multiple of
+    // the TS packet size. If event is not NULL, its offset is taken to be the
+    // offset of the first packet, and feeding stops after the packet that
+    // initializes it. Feeding also stops after a packet that fails to parse,
+    // and that error is returned. numPacketsFed, if not NULL, is set to the
+    // number of packets fed, including the one feeding stopped after.
+    status_t feedTSPackets(
+            const void *data, size_t size, SyncEvent *event = NULL,
+            size_t *numPacketsFed = NULL);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
     void signalEOS(status_t finalResult);
 
+    // Drop the access units queued on the sources of every program, for
+    // users that only want the sync events feedTSPacket() reports.
+    void discardAccessUnits();
+
     enum SourceType {
         VIDEO = 0,
         AUDIO = 1,
@@ -146,12 +160,29 @@ private:
     struct Stream;
     struct PSISection;
 
+    // Where the payload of a PID goes: a PSI section or an elementary stream.
+    struct PIDTarget {
+        sp<PSISection> mSection;
+        sp<Stream> mStream;
+    };
+
+    enum {
+        kNumPIDs = 0x2000,
+    };
+
     uint32_t mFlags;
     Vector<sp<Program> > mPrograms;
 
     // Keyed by PID
     KeyedVector<unsigned, sp<PSISection> > mPSISections;
 
+    // PID -> 1-based index into mPIDTargets, 0 if nothing takes the PID.
+    // Rebuilt from mPSISections and the programs' streams before the next
+    // packet is routed whenever either changes.
+    uint16_t mPIDTable[kNumPIDs];
+    Vector<PIDTarget> mPIDTargets;
+    bool mPIDTableStale;
+
     int64_t mAbsoluteTimeAnchorUs;
 
     bool mTimeOffsetValid;
@@ -178,9 +209,14 @@ private:
         unsigned payload_unit_start_indicator,
         SyncEvent *event);
 
-    status_t parseAdaptationField(ABitReader *br, unsigned PID);
-    // see feedTSPacket().
-    status_t parseTS(ABitReader *br, SyncEvent *event);
+    // Parse the adaptation field of the TS packet at data, and set
+    // payloadOffset to where the payload starts.
+    status_t parseAdaptationField(
+            const uint8_t *data, unsigned PID, size_t *payloadOffset);
+    // see feedTSPacket(). data points at a whole TS packet.
+    status_t parseTS(const uint8_t *data, SyncEvent *event);
+
+    void rebuildPIDTable();
 
     void updatePCR(unsigned PID, uint64_t PCR, uint64_t byteOffsetFromStart);
 
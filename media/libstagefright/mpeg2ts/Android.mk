@@ -8,6 +8,7 @@ LOCAL_SRC_FILES:=                 \
         ESQueue.cpp               \
         MPEG2PSExtractor.cpp      \
         MPEG2TSExtractor.cpp      \
+        MPEG2TSSeekIndex.cpp      \
 
 LOCAL_C_INCLUDES:= \
 	$(TOP)/frameworks/av/media/libstagefright \
@@ -24,3 +25,64 @@ ifeq ($(TARGET_ARCH),arm)
 endif
 
 include $(BUILD_STATIC_LIBRARY)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tests/ATSParserBench.cpp
+
+LOCAL_C_INCLUDES := \
+	$(TOP)/frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/av/media/libstagefright/mpeg2ts \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_STATIC_LIBRARIES := \
+        libstagefright_mpeg2ts
+
+LOCAL_SHARED_LIBRARIES := \
+        libstagefright \
+        libstagefright_foundation \
+        libmedia \
+        libcutils \
+        libutils \
+        liblog
+
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_CLANG := true
+
+LOCAL_MODULE := mpeg2ts_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tests/ESQueueBench.cpp
+
+LOCAL_C_INCLUDES := \
+	$(TOP)/frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/av/media/libstagefright/mpeg2ts \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_STATIC_LIBRARIES := \
+        libstagefright_mpeg2ts
+
+LOCAL_SHARED_LIBRARIES := \
+        libstagefright \
+        libstagefright_foundation \
+        libmedia \
+        libutils \
+        liblog
+
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_CLANG := true
+
+LOCAL_MODULE := esqueue_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
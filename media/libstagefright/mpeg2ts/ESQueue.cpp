@@ -39,7 +39,9 @@ namespace android {
 ElementaryStreamQueue::ElementaryStreamQueue(Mode mode, uint32_t flags)
     : mMode(mode),
       mFlags(flags),
-      mEOSReached(false) {
+      mEOSReached(false),
+      mRangeInfoHead(0),
+      mNumRangeInfos(0) {
 }
 
 sp<MetaData> ElementaryStreamQueue::getFormat() {
@@ -51,7 +53,8 @@ void ElementaryStreamQueue::clear(bool clearFormat) {
         mBuffer->setRange(0, 0);
     }
 
-    mRangeInfos.clear();
+    mRangeInfoHead = 0;
+    mNumRangeInfos = 0;
 
     if (clearFormat) {
         mFormat.clear();
@@ -60,6 +63,62 @@ void ElementaryStreamQueue::clear(bool clearFormat) {
     mEOSReached = false;
 }
 
+void ElementaryStreamQueue::consumeData(size_t size) {
+    if (size >= mBuffer->size()) {
+        mBuffer->setRange(0, 0);
+    } else {
+        mBuffer->setRange(mBuffer->offset() + size, mBuffer->size() - size);
+    }
+}
+
+void ElementaryStreamQueue::pushRangeInfo(const RangeInfo &info) {
+    if (mNumRangeInfos == mRangeInfos.size()) {
+        // Full: make room, putting the entries back in order from index 0.
+        Vector<RangeInfo> rangeInfos;
+        size_t capacity = mRangeInfos.isEmpty() ? 16 : 2 * mRangeInfos.size();
+        rangeInfos.insertAt(info, 0, capacity);
+        for (size_t i = 0; i < mNumRangeInfos; ++i) {
+            rangeInfos.editItemAt(i) =
+                    mRangeInfos[(mRangeInfoHead + i) % mRangeInfos.size()];
+        }
+        mRangeInfos = rangeInfos;
+        mRangeInfoHead = 0;
+    }
+
+    mRangeInfos.editItemAt(
+            (mRangeInfoHead + mNumRangeInfos) % mRangeInfos.size()) = info;
+    ++mNumRangeInfos;
+}
+
+ElementaryStreamQueue::RangeInfo *ElementaryStreamQueue::firstRangeInfo() {
+    return mNumRangeInfos == 0 ? NULL : &mRangeInfos.editItemAt(mRangeInfoHead);
+}
+
+void ElementaryStreamQueue::popRangeInfo() {
+    mRangeInfoHead = (mRangeInfoHead + 1) % mRangeInfos.size();
+    --mNumRangeInfos;
+}
+
+// Returns the offset of the first 0x00 0x00 0x01 start code prefix in data,
+// or -1 if there is none. memchr() for the 0x01 goes through coded data a lot
+// faster than comparing at every offset.
+static ssize_t FindStartCode(const uint8_t *data, size_t size) {
+    size_t offset = 2;
+    while (offset < size) {
+        const uint8_t *one =
+            (const uint8_t *)memchr(&data[offset], 0x01, size - offset);
+        if (one == NULL) {
+            return -1;
+        }
+        offset = one - data;
+        if (data[offset - 1] == 0x00 && data[offset - 2] == 0x00) {
+            return offset - 2;
+        }
+        ++offset;
+    }
+    return -1;
+}
+
 // Parse AC3 header assuming the current ptr is start position of syncframe,
 // update metadata only applicable, and return the payload size
 static unsigned parseAC3SyncFrame(
@@ -264,13 +323,7 @@ status_t ElementaryStreamQueue::appendData(
 #else
                 uint8_t *ptr = (uint8_t *)data;
 
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i + 2 < size; ++i) {
-                    if (!memcmp("\x00\x00\x01", &ptr[i], 3)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+                ssize_t startOffset = FindStartCode(ptr, size);
 
                 if (startOffset < 0) {
                     return ERROR_MALFORMED;
@@ -297,13 +350,7 @@ status_t ElementaryStreamQueue::appendData(
 #else
                 uint8_t *ptr = (uint8_t *)data;
 
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i + 2 < size; ++i) {
-                    if (!memcmp("\x00\x00\x01", &ptr[i], 3)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+                ssize_t startOffset = FindStartCode(ptr, size);
 
                 if (startOffset < 0) {
                     return ERROR_MALFORMED;
@@ -429,29 +476,43 @@ status_t ElementaryStreamQueue::appendData(
     }
 
     size_t neededSize = (mBuffer == NULL ? 0 : mBuffer->size()) + size;
-    if (mBuffer == NULL || neededSize > mBuffer->capacity()) {
-        neededSize = (neededSize + 65535) & ~65535;
+    if (mBuffer == NULL
+            || mBuffer->offset() + neededSize > mBuffer->capacity()) {
+        if (mBuffer != NULL && neededSize <= mBuffer->capacity() / 2) {
+            // Plenty of room once the consumed data is out of the way.
+            memmove(mBuffer->base(), mBuffer->data(), mBuffer->size());
+            mBuffer->setRange(0, mBuffer->size());
+        } else {
+            size_t capacity = (mBuffer == NULL) ? 0 : 2 * mBuffer->capacity();
+            if (capacity < neededSize) {
+                capacity = (neededSize + 65535) & ~65535;
+            }
 
-        ALOGV("resizing buffer to size %zu", neededSize);
+            ALOGV("resizing buffer to size %zu", capacity);
 
-        sp<ABuffer> buffer = new ABuffer(neededSize);
-        if (mBuffer != NULL) {
-            memcpy(buffer->data(), mBuffer->data(), mBuffer->size());
-            buffer->setRange(0, mBuffer->size());
-        } else {
-            buffer->setRange(0, 0);
-        }
+            sp<ABuffer> buffer = new ABuffer(capacity);
+            if (buffer->base() == NULL) {
+                ALOGE("failed to allocate %zu bytes", capacity);
+                return NO_MEMORY;
+            }
+            if (mBuffer != NULL) {
+                memcpy(buffer->data(), mBuffer->data(), mBuffer->size());
+                buffer->setRange(0, mBuffer->size());
+            } else {
+                buffer->setRange(0, 0);
+            }
 
-        mBuffer = buffer;
+            mBuffer = buffer;
+        }
     }
 
     memcpy(mBuffer->data() + mBuffer->size(), data, size);
-    mBuffer->setRange(0, mBuffer->size() + size);
+    mBuffer->setRange(mBuffer->offset(), mBuffer->size() + size);
 
     RangeInfo info;
     info.mLength = size;
     info.mTimestampUs = timeUs;
-    mRangeInfos.push_back(info);
+    pushRangeInfo(info);
 
 #if 0
     if (mMode == AAC) {
@@ -465,22 +526,18 @@ status_t ElementaryStreamQueue::appendData(
 
 sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnit() {
     if ((mFlags & kFlag_AlignedData) && mMode == H264) {
-        if (mRangeInfos.empty()) {
+        if (mNumRangeInfos == 0) {
             return NULL;
         }
 
-        RangeInfo info = *mRangeInfos.begin();
-        mRangeInfos.erase(mRangeInfos.begin());
+        RangeInfo info = *firstRangeInfo();
+        popRangeInfo();
 
         sp<ABuffer> accessUnit = new ABuffer(info.mLength);
         memcpy(accessUnit->data(), mBuffer->data(), info.mLength);
         accessUnit->meta()->setInt64("timeUs", info.mTimestampUs);
 
-        memmove(mBuffer->data(),
-                mBuffer->data() + info.mLength,
-                mBuffer->size() - info.mLength);
-
-        mBuffer->setRange(0, mBuffer->size() - info.mLength);
+        consumeData(info.mLength);
 
         if (mFormat == NULL) {
             mFormat = MakeAVCCodecSpecificData(accessUnit);
@@ -552,12 +609,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAC3() {
     accessUnit->meta()->setInt64("timeUs", timeUs);
     accessUnit->meta()->setInt32("isSync", 1);
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + syncStartPos + payloadSize,
-            mBuffer->size() - syncStartPos - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - syncStartPos - payloadSize);
+    consumeData(syncStartPos + payloadSize);
 
     return accessUnit;
 }
@@ -620,12 +672,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
         ptr[i] = ntohs(ptr[i]);
     }
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + 4 + payloadSize,
-            mBuffer->size() - 4 - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - 4 - payloadSize);
+    consumeData(4 + payloadSize);
 
     return accessUnit;
 }
@@ -635,11 +682,11 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAAC() {
         return NULL;
     }
 
-    if (mRangeInfos.empty()) {
+    if (mNumRangeInfos == 0) {
         return NULL;
     }
 
-    const RangeInfo &info = *mRangeInfos.begin();
+    const RangeInfo &info = *firstRangeInfo();
     if (mBuffer->size() < info.mLength) {
         return NULL;
     }
@@ -741,9 +788,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAAC() {
     sp<ABuffer> accessUnit = new ABuffer(offset);
     memcpy(accessUnit->data(), mBuffer->data(), offset);
 
-    memmove(mBuffer->data(), mBuffer->data() + offset,
-            mBuffer->size() - offset);
-    mBuffer->setRange(0, mBuffer->size() - offset);
+    consumeData(offset);
 
     accessUnit->meta()->setInt64("timeUs", timeUs);
     accessUnit->meta()->setInt32("isSync", 1);
@@ -756,12 +801,11 @@ int64_t ElementaryStreamQueue::fetchTimestamp(size_t size) {
     bool first = true;
 
     while (size > 0) {
-        if (mRangeInfos.empty()) {
+        RangeInfo *info = firstRangeInfo();
+        if (info == NULL) {
             return timeUs;
         }
 
-        RangeInfo *info = &*mRangeInfos.begin();
-
         if (first) {
             timeUs = info->mTimestampUs;
             first = false;
@@ -773,7 +817,7 @@ int64_t ElementaryStreamQueue::fetchTimestamp(size_t size) {
         } else {
             size -= info->mLength;
 
-            mRangeInfos.erase(mRangeInfos.begin());
+            popRangeInfo();
             info = NULL;
         }
 
@@ -790,7 +834,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
     const uint8_t *data = mBuffer->data();
 
     size_t size = mBuffer->size();
-    Vector<NALPosition> nals;
+    size_t numNALs = 0;
 
     size_t totalSize = 0;
     size_t seiCount = 0;
@@ -836,7 +880,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
             // The access unit will contain all nal units up to, but excluding
             // the current one, separated by 0x00 0x00 0x00 0x01 startcodes.
 
-            size_t auSize = 4 * nals.size() + totalSize;
+            size_t auSize = 4 * numNALs + totalSize;
             sp<ABuffer> accessUnit = new ABuffer(auSize);
             sp<ABuffer> sei;
 
@@ -851,8 +895,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
 
             size_t dstOffset = 0;
             size_t seiIndex = 0;
-            for (size_t i = 0; i < nals.size(); ++i) {
-                const NALPosition &pos = nals.itemAt(i);
+            for (size_t i = 0; i < numNALs; ++i) {
+                const NALPosition &pos = mNALPositions.itemAt(i);
 
                 unsigned nalType = mBuffer->data()[pos.nalOffset] & 0x1f;
 
@@ -888,14 +932,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
             ALOGV("accessUnit contains nal types %s", out.c_str());
 #endif
 
-            const NALPosition &pos = nals.itemAt(nals.size() - 1);
+            const NALPosition &pos = mNALPositions.itemAt(numNALs - 1);
             size_t nextScan = pos.nalOffset + pos.nalSize;
 
-            memmove(mBuffer->data(),
-                    mBuffer->data() + nextScan,
-                    mBuffer->size() - nextScan);
-
-            mBuffer->setRange(0, mBuffer->size() - nextScan);
+            consumeData(nextScan);
 
             int64_t timeUs = fetchTimestamp(nextScan);
             if (timeUs < 0ll) {
@@ -919,7 +959,12 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
         pos.nalOffset = nalStart - mBuffer->data();
         pos.nalSize = nalSize;
 
-        nals.push(pos);
+        if (numNALs < mNALPositions.size()) {
+            mNALPositions.editItemAt(numNALs) = pos;
+        } else {
+            mNALPositions.push(pos);
+        }
+        ++numNALs;
 
         totalSize += nalSize;
     }
@@ -959,11 +1004,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGAudio() {
     sp<ABuffer> accessUnit = new ABuffer(frameSize);
     memcpy(accessUnit->data(), data, frameSize);
 
-    memmove(mBuffer->data(),
-            mBuffer->data() + frameSize,
-            mBuffer->size() - frameSize);
-
-    mBuffer->setRange(0, mBuffer->size() - frameSize);
+    consumeData(frameSize);
 
     int64_t timeUs = fetchTimestamp(frameSize);
     if (timeUs < 0ll) {
@@ -1060,21 +1101,22 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
 
     size_t offset = 0;
     while (offset + 3 < size) {
-        if (memcmp(&data[offset], "\x00\x00\x01", 3)) {
-            ++offset;
-            continue;
+        ssize_t startCode = FindStartCode(&data[offset], size - offset - 1);
+        if (startCode < 0) {
+            break;
         }
+        offset += startCode;
 
         pprevStartCode = prevStartCode;
         prevStartCode = currentStartCode;
         currentStartCode = data[offset + 3];
 
         if (currentStartCode == 0xb3 && mFormat == NULL) {
-            memmove(mBuffer->data(), mBuffer->data() + offset, size - offset);
+            consumeData(offset);
+            data = mBuffer->data();
             size -= offset;
             (void)fetchTimestamp(offset);
             offset = 0;
-            mBuffer->setRange(0, size);
         }
 
         if ((prevStartCode == 0xb3 && currentStartCode != 0xb5)
@@ -1103,11 +1145,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
                 sp<ABuffer> csd = new ABuffer(offset);
                 memcpy(csd->data(), data, offset);
 
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consumeData(offset);
+                data = mBuffer->data();
                 size -= offset;
                 (void)fetchTimestamp(offset);
                 offset = 0;
@@ -1146,11 +1185,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
                 sp<ABuffer> accessUnit = new ABuffer(offset);
                 memcpy(accessUnit->data(), data, offset);
 
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consumeData(offset);
 
                 int64_t timeUs = fetchTimestamp(offset);
                 if (timeUs < 0ll) {
@@ -1205,16 +1240,12 @@ static ssize_t getNextChunkSize(
         return -EAGAIN;
     }
 
-    size_t offset = 3;
-    while (offset + 2 < size) {
-        if (!memcmp(&data[offset], kStartCode, 3)) {
-            return offset;
-        }
-
-        ++offset;
+    ssize_t offset = FindStartCode(&data[3], size - 3);
+    if (offset < 0) {
+        return -EAGAIN;
     }
 
-    return -EAGAIN;
+    return offset + 3;
 }
 
 sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
@@ -1340,9 +1371,9 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
                     sp<ABuffer> accessUnit = new ABuffer(offset);
                     memcpy(accessUnit->data(), data, offset);
 
-                    memmove(data, &data[offset], size - offset);
+                    consumeData(offset);
+                    data = mBuffer->data();
                     size -= offset;
-                    mBuffer->setRange(0, size);
 
                     int64_t timeUs = fetchTimestamp(offset);
                     if (timeUs < 0ll) {
@@ -1378,10 +1409,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
 
         if (discard) {
             (void)fetchTimestamp(offset);
-            memmove(data, &data[offset], size - offset);
+            consumeData(offset);
+            data = mBuffer->data();
             size -= offset;
             offset = 0;
-            mBuffer->setRange(0, size);
         } else {
             offset += chunkSize;
         }
@@ -1413,7 +1444,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMetadata() {
     accessUnit->meta()->setInt64("timeUs", timeUs);
 
     memcpy(accessUnit->data(), mBuffer->data(), size);
-    mBuffer->setRange(0, 0);
+    consumeData(size);
 
     if (mFormat == NULL) {
         mFormat = new MetaData;
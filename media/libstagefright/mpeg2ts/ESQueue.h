@@ -20,8 +20,10 @@
 
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/Errors.h>
-#include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include "include/avc_utils.h"
 
 namespace android {
 
@@ -64,11 +66,32 @@ private:
     uint32_t mFlags;
     bool mEOSReached;
 
+    // The data not yet taken out in access units is mBuffer->data() up to
+    // mBuffer->size(). Consuming data moves the start of the range forward;
+    // the pending data is moved back to the front of the buffer only when
+    // appended data doesn't fit behind it.
     sp<ABuffer> mBuffer;
-    List<RangeInfo> mRangeInfos;
+
+    // The timestamps of the pending data, in the order it was appended: a
+    // FIFO of mNumRangeInfos entries starting at mRangeInfoHead, wrapping
+    // around mRangeInfos so that it only allocates when it grows.
+    Vector<RangeInfo> mRangeInfos;
+    size_t mRangeInfoHead;
+    size_t mNumRangeInfos;
+
+    // The NAL units of the H.264 access unit being assembled, kept around
+    // so that dequeueAccessUnitH264() doesn't allocate them every time.
+    Vector<NALPosition> mNALPositions;
 
     sp<MetaData> mFormat;
 
+    // Drops the first size bytes of the pending data.
+    void consumeData(size_t size);
+
+    void pushRangeInfo(const RangeInfo &info);
+    RangeInfo *firstRangeInfo();
+    void popRangeInfo();
+
     sp<ABuffer> dequeueAccessUnitH264();
     sp<ABuffer> dequeueAccessUnitAAC();
     sp<ABuffer> dequeueAccessUnitAC3();
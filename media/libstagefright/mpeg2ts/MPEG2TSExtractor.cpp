@@ -36,6 +36,7 @@
 
 #include "AnotherPacketSource.h"
 #include "ATSParser.h"
+#include "MPEG2TSSeekIndex.h"
 
 namespace android {
 
@@ -94,7 +95,11 @@ status_t MPEG2TSSource::read(
     ReadOptions::SeekMode seekMode;
     if (mDoesSeek && options && options->getSeekTo(&seekTimeUs, &seekMode)) {
         // seek is needed
+        int64_t startUs = ALooper::GetNowUs();
         status_t err = mExtractor->seek(seekTimeUs, seekMode);
+        ALOGV("seek to %" PRId64 " us took %" PRId64 " us (%s)",
+                seekTimeUs, ALooper::GetNowUs() - startUs,
+                mExtractor->mSeekIndex != NULL ? "indexed" : "not indexed");
         if (err != OK) {
             return err;
         }
@@ -113,10 +118,18 @@ MPEG2TSExtractor::MPEG2TSExtractor(const sp<DataSource> &source)
     : mDataSource(source),
       mParser(new ATSParser),
       mLastSyncEvent(0),
+      mSeekSyncPoints(NULL),
+      mNumSeekIndexEntriesMerged(0),
       mOffset(0) {
     init();
 }
 
+MPEG2TSExtractor::~MPEG2TSExtractor() {
+    if (mSeekIndex != NULL) {
+        mSeekIndex->stop();
+    }
+}
+
 size_t MPEG2TSExtractor::countTracks() {
     return mSourceImpls.size();
 }
@@ -193,8 +206,32 @@ void MPEG2TSExtractor::init() {
         }
     }
 
+    // Index the seek track in the background, or load its index if the file
+    // has been indexed before.
+    bool durationKnown = false;
+    if ((haveAudio || haveVideo) && MPEG2TSSeekIndex::IsWanted(mDataSource)) {
+        mSeekIndex = new MPEG2TSSeekIndex(
+                mDataSource, haveVideo ? ATSParser::VIDEO : ATSParser::AUDIO);
+        if (mSeekIndex->start() != OK) {
+            mSeekIndex.clear();
+        }
+
+        int64_t durationUs;
+        if (mSeekIndex != NULL && mSeekIndex->getDurationUs(&durationUs)) {
+            sp<AnotherPacketSource> impl = haveVideo
+                    ? (AnotherPacketSource *)mParser->getSource(
+                            ATSParser::VIDEO).get()
+                    : (AnotherPacketSource *)mParser->getSource(
+                            ATSParser::AUDIO).get();
+            const sp<MetaData> meta = impl->getFormat();
+            meta->setInt64(kKeyDuration, durationUs);
+            impl->setFormat(meta);
+            durationKnown = true;
+        }
+    }
+
     off64_t size;
-    if (mDataSource->getSize(&size) == OK && (haveAudio || haveVideo)) {
+    if (!durationKnown && mDataSource->getSize(&size) == OK && (haveAudio || haveVideo)) {
         sp<AnotherPacketSource> impl = haveVideo
                 ? (AnotherPacketSource *)mParser->getSource(
                         ATSParser::VIDEO).get()
@@ -308,6 +345,11 @@ uint32_t MPEG2TSExtractor::flags() const {
 
 status_t MPEG2TSExtractor::seek(int64_t seekTimeUs,
         const MediaSource::ReadOptions::SeekMode &seekMode) {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mergeSeekIndex_l();
+    }
+
     if (mSeekSyncPoints == NULL || mSeekSyncPoints->isEmpty()) {
         ALOGW("No sync point to seek to.");
         // ... and therefore we have nothing useful to do here.
@@ -390,6 +432,18 @@ status_t MPEG2TSExtractor::seek(int64_t seekTimeUs,
     return OK;
 }
 
+void MPEG2TSExtractor::mergeSeekIndex_l() {
+    if (mSeekIndex == NULL || mSeekSyncPoints == NULL) {
+        return;
+    }
+
+    Vector<MPEG2TSSeekIndex::Entry> entries;
+    mNumSeekIndexEntriesMerged = mSeekIndex->getEntries(mNumSeekIndexEntriesMerged, &entries);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        mSeekSyncPoints->add(entries[i].mTimeUs, entries[i].mOffset);
+    }
+}
+
 status_t MPEG2TSExtractor::queueDiscontinuityForSeek(int64_t actualSeekTimeUs) {
     // Signal discontinuity
     sp<AMessage> extra(new AMessage);
@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MPEG2TSSeekIndex"
+#include <utils/Log.h>
+
+#include "MPEG2TSSeekIndex.h"
+
+#include "AnotherPacketSource.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+#include <cutils/properties.h>
+#include <utils/KeyedVector.h>
+#include <utils/ThreadDefs.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace android {
+
+static const size_t kTSPacketSize = 188;
+static const size_t kPacketsPerRead = 1024;
+
+// Smaller files are quick enough to seek in by demuxing from an estimated
+// offset.
+static const off64_t kMinIndexedFileSize = 32ll * 1024 * 1024;
+
+// How much of each end of the file goes into its cache key
+static const size_t kIdentityBytes = 64 * 1024;
+
+static const char *kCacheDir = "/data/misc/media/mpeg2ts_index";
+static const uint32_t kCacheMagic = 0x58495354;  // "TSIX"
+static const uint32_t kCacheVersion = 1;
+static const char *kCacheSuffix = ".idx";
+
+const int64_t MPEG2TSSeekIndex::kMinEntryIntervalUs = 100000ll;
+
+// An hour of indexed video takes about 600 KB.
+const off64_t MPEG2TSSeekIndex::kMaxCacheSize = 4ll * 1024 * 1024;
+
+struct CacheHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    int64_t mFileSize;
+    int32_t mType;
+    uint32_t mNumEntries;
+    int64_t mDurationUs;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+MPEG2TSSeekIndex::MPEG2TSSeekIndex(
+        const sp<DataSource> &source, ATSParser::SourceType type,
+        const char *cacheDir)
+    : mDataSource(source),
+      mType(type),
+      mFileSize(0),
+      mCacheDir(cacheDir != NULL ? cacheDir : kCacheDir),
+      mComplete(false),
+      mStopping(false),
+      mDurationUs(-1ll),
+      mThreadStarted(false) {
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+MPEG2TSSeekIndex::~MPEG2TSSeekIndex() {
+    stop();
+}
+
+// static
+bool MPEG2TSSeekIndex::IsWanted(const sp<DataSource> &source) {
+    if (!property_get_bool("media.stagefright.ts-index", false)) {
+        return false;
+    }
+
+    // Reading the whole file ahead of playback only makes sense for local
+    // files.
+    if (source->flags()
+            & (DataSource::kIsCachingDataSource | DataSource::kIsHTTPBasedSource)) {
+        return false;
+    }
+
+    off64_t size;
+    return source->getSize(&size) == OK && size >= kMinIndexedFileSize;
+}
+
+status_t MPEG2TSSeekIndex::start() {
+    if (mDataSource->getSize(&mFileSize) != OK) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    if (!computeCachePath()) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    if (loadFromCache()) {
+        ALOGV("loaded %zu entries from %s", mEntries.size(), mCachePath.string());
+        return OK;
+    }
+
+    if (!isCacheWritable()) {
+        ALOGV("not indexing, can't write to %s", mCacheDir.string());
+        return ERROR_UNSUPPORTED;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    int res = pthread_create(&mThread, &attr, ThreadWrapper, this);
+    pthread_attr_destroy(&attr);
+    if (res != 0) {
+        ALOGE("Unable to start indexing thread: %s", strerror(res));
+        return -res;
+    }
+    mThreadStarted = true;
+    return OK;
+}
+
+void MPEG2TSSeekIndex::stop() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mStopping = true;
+    }
+
+    if (mThreadStarted) {
+        pthread_join(mThread, NULL);
+        mThreadStarted = false;
+    }
+}
+
+bool MPEG2TSSeekIndex::isComplete() const {
+    Mutex::Autolock autoLock(mLock);
+    return mComplete;
+}
+
+bool MPEG2TSSeekIndex::getDurationUs(int64_t *durationUs) const {
+    Mutex::Autolock autoLock(mLock);
+    if (!mComplete || mDurationUs < 0) {
+        return false;
+    }
+    *durationUs = mDurationUs;
+    return true;
+}
+
+size_t MPEG2TSSeekIndex::getEntries(size_t from, Vector<Entry> *entries) const {
+    Mutex::Autolock autoLock(mLock);
+    for (size_t i = from; i < mEntries.size(); ++i) {
+        entries->push(mEntries.itemAt(i));
+    }
+    return mEntries.size();
+}
+
+void MPEG2TSSeekIndex::getStats(Stats *stats) const {
+    Mutex::Autolock autoLock(mLock);
+    *stats = mStats;
+    stats->mNumEntries = mEntries.size();
+}
+
+// static
+void *MPEG2TSSeekIndex::ThreadWrapper(void *me) {
+    static_cast<MPEG2TSSeekIndex *>(me)->threadEntry();
+    return NULL;
+}
+
+void MPEG2TSSeekIndex::threadEntry() {
+    // Stay out of the way of playback
+    androidSetThreadPriority(0, ANDROID_PRIORITY_BACKGROUND);
+
+    int64_t startUs = ALooper::GetNowUs();
+    status_t err = build();
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    Stats stats;
+    {
+        Mutex::Autolock autoLock(mLock);
+        mStats.mBuildTimeUs = elapsedUs;
+        if (err == OK) {
+            mComplete = true;
+        }
+        stats = mStats;
+        stats.mNumEntries = mEntries.size();
+    }
+
+    if (err != OK) {
+        ALOGV("indexing stopped after %" PRId64 " bytes: %d", stats.mBytesScanned, err);
+        return;
+    }
+
+    ALOGI("indexed %" PRId64 " bytes in %" PRId64 " ms (%.1f MB/s), %zu entries",
+            stats.mBytesScanned, elapsedUs / 1000,
+            elapsedUs > 0 ? stats.mBytesScanned / (elapsedUs / 1E6) / (1024 * 1024) : 0.0,
+            stats.mNumEntries);
+
+    saveToCache();
+}
+
+status_t MPEG2TSSeekIndex::build() {
+    sp<ATSParser> parser = new ATSParser;
+
+    uint8_t *buffer = (uint8_t *)malloc(kPacketsPerRead * kTSPacketSize);
+    if (buffer == NULL) {
+        return NO_MEMORY;
+    }
+
+    status_t err = OK;
+    off64_t offset = 0;
+    int64_t lastEntryTimeUs = -1ll;
+    int64_t durationUs = -1ll;
+    size_t numBadPackets = 0;
+
+    while (offset + (off64_t)kTSPacketSize <= mFileSize) {
+        {
+            Mutex::Autolock autoLock(mLock);
+            if (mStopping) {
+                err = -EINTR;
+                break;
+            }
+            mStats.mBytesScanned = offset;
+        }
+
+        size_t size = kPacketsPerRead * kTSPacketSize;
+        if ((off64_t)size > mFileSize - offset) {
+            size = mFileSize - offset;
+        }
+        ssize_t n = mDataSource->readAt(offset, buffer, size);
+        if (n < 0) {
+            err = n;
+            break;
+        } else if (n < (ssize_t)kTSPacketSize) {
+            // The file got shorter
+            break;
+        }
+        size_t numPackets = n / kTSPacketSize;
+
+        size_t fed = 0;
+        while (fed < numPackets) {
+            ATSParser::SyncEvent event(offset + (off64_t)(fed * kTSPacketSize));
+            size_t numPacketsFed;
+            status_t feedErr = parser->feedTSPackets(
+                    buffer + fed * kTSPacketSize,
+                    (numPackets - fed) * kTSPacketSize,
+                    &event, &numPacketsFed);
+            fed += numPacketsFed;
+
+            if (event.hasReturnedData()) {
+                sp<MediaSource> source = parser->getSource(mType);
+                int64_t timeUs = event.getTimeUs();
+                if (source != NULL && event.getMediaSource() == source
+                        && (lastEntryTimeUs < 0
+                            || llabs(timeUs - lastEntryTimeUs) >= kMinEntryIntervalUs)) {
+                    Entry entry;
+                    entry.mTimeUs = timeUs;
+                    entry.mOffset = event.getOffset();
+
+                    Mutex::Autolock autoLock(mLock);
+                    mEntries.push(entry);
+                    lastEntryTimeUs = timeUs;
+                }
+            }
+
+            // Recordings can have damaged packets; skip them like a player
+            // would skip the frames they belong to
+            if (feedErr != OK) {
+                ++numBadPackets;
+            }
+        }
+        offset += numPackets * kTSPacketSize;
+
+        // Only the sync events matter here, but note where the track ends
+        sp<AnotherPacketSource> source =
+            static_cast<AnotherPacketSource *>(parser->getSource(mType).get());
+        if (source != NULL) {
+            sp<AMessage> meta = source->getLatestEnqueuedMeta();
+            int64_t timeUs;
+            if (meta != NULL && meta->findInt64("timeUs", &timeUs) && timeUs > durationUs) {
+                durationUs = timeUs;
+            }
+        }
+        parser->discardAccessUnits();
+    }
+
+    free(buffer);
+
+    if (numBadPackets > 0) {
+        ALOGW("skipped %zu bad packets", numBadPackets);
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    mStats.mBytesScanned = offset;
+    if (err == OK) {
+        mDurationUs = durationUs;
+    }
+    return err;
+}
+
+bool MPEG2TSSeekIndex::computeCachePath() {
+    if (mFileSize < (off64_t)(2 * kIdentityBytes)) {
+        return false;
+    }
+
+    uint8_t *buffer = (uint8_t *)malloc(kIdentityBytes);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = fnv1a(hash, &mFileSize, sizeof(mFileSize));
+    int32_t type = mType;
+    hash = fnv1a(hash, &type, sizeof(type));
+
+    bool success = true;
+    const off64_t offsets[] = { 0, mFileSize - (off64_t)kIdentityBytes };
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+        if (mDataSource->readAt(offsets[i], buffer, kIdentityBytes)
+                != (ssize_t)kIdentityBytes) {
+            success = false;
+            break;
+        }
+        hash = fnv1a(hash, buffer, kIdentityBytes);
+    }
+    free(buffer);
+
+    if (!success) {
+        return false;
+    }
+
+    mCachePath = String8::format(
+            "%s/%016" PRIx64 "%s", mCacheDir.string(), hash, kCacheSuffix);
+    return true;
+}
+
+bool MPEG2TSSeekIndex::isCacheWritable() {
+    if (mkdir(mCacheDir.string(), 0770) != 0 && errno != EEXIST) {
+        return false;
+    }
+    return access(mCacheDir.string(), W_OK | X_OK) == 0;
+}
+
+bool MPEG2TSSeekIndex::loadFromCache() {
+    Vector<Entry> entries;
+    int64_t durationUs;
+    if (!ReadCacheFile(mCachePath.string(), mFileSize, mType, &entries, &durationUs)) {
+        if (access(mCachePath.string(), F_OK) == 0) {
+            ALOGW("ignoring bad index %s", mCachePath.string());
+            unlink(mCachePath.string());
+        }
+        return false;
+    }
+
+    // Eviction goes by modification time; mark the index as recently used.
+    utimes(mCachePath.string(), NULL);
+
+    Mutex::Autolock autoLock(mLock);
+    mEntries = entries;
+    mDurationUs = durationUs;
+    mComplete = true;
+    mStats.mLoadedFromCache = true;
+    mStats.mBytesScanned = mFileSize;
+    return true;
+}
+
+void MPEG2TSSeekIndex::saveToCache() {
+    Vector<Entry> entries;
+    int64_t durationUs;
+    {
+        Mutex::Autolock autoLock(mLock);
+        entries = mEntries;
+        durationUs = mDurationUs;
+    }
+
+    if ((off64_t)(sizeof(CacheHeader) + entries.size() * sizeof(Entry)) > kMaxCacheSize) {
+        ALOGV("not saving %zu entries, too many for the cache", entries.size());
+        return;
+    }
+
+    if (!WriteCacheFile(mCachePath.string(), mFileSize, mType, entries, durationUs)) {
+        ALOGW("failed to save index to %s", mCachePath.string());
+        return;
+    }
+    ALOGV("saved %zu entries to %s", entries.size(), mCachePath.string());
+
+    TrimCache(mCacheDir.string(), kMaxCacheSize);
+}
+
+// static
+bool MPEG2TSSeekIndex::ReadCacheFile(
+        const char *path, off64_t fileSize, ATSParser::SourceType type,
+        Vector<Entry> *entries, int64_t *durationUs) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    CacheHeader header;
+    struct stat st;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+            && header.mMagic == kCacheMagic
+            && header.mVersion == kCacheVersion
+            && header.mFileSize == fileSize
+            && header.mType == (int32_t)type
+            && header.mNumEntries <= fileSize / kTSPacketSize
+            && fstat(fileno(file), &st) == 0
+            && st.st_size == (off_t)(sizeof(header) + header.mNumEntries * sizeof(Entry));
+    if (valid) {
+        entries->clear();
+        entries->insertAt(0, header.mNumEntries);
+        valid = header.mNumEntries == 0
+                || fread(entries->editArray(), sizeof(Entry), header.mNumEntries, file)
+                        == header.mNumEntries;
+    }
+    fclose(file);
+
+    // The file could have been rewritten in place with the same size and
+    // ends, or the cache file damaged; either way the extractor must not be
+    // sent to an offset that isn't in the file. Entries are in file order.
+    off64_t lastOffset = 0;
+    for (size_t i = 0; valid && i < entries->size(); ++i) {
+        off64_t offset = entries->itemAt(i).mOffset;
+        valid = offset >= lastOffset && offset <= fileSize - (off64_t)kTSPacketSize;
+        lastOffset = offset;
+    }
+
+    if (!valid) {
+        entries->clear();
+        return false;
+    }
+    *durationUs = header.mDurationUs;
+    return true;
+}
+
+// static
+bool MPEG2TSSeekIndex::WriteCacheFile(
+        const char *path, off64_t fileSize, ATSParser::SourceType type,
+        const Vector<Entry> &entries, int64_t durationUs) {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.mMagic = kCacheMagic;
+    header.mVersion = kCacheVersion;
+    header.mFileSize = fileSize;
+    header.mType = type;
+    header.mNumEntries = entries.size();
+    header.mDurationUs = durationUs;
+
+    // Write it under another name first so that a reader never sees half
+    // an index
+    String8 tempPath(path);
+    tempPath.append(".tmp");
+    FILE *file = fopen(tempPath.string(), "wb");
+    if (file == NULL) {
+        ALOGV("can't write %s: %s", tempPath.string(), strerror(errno));
+        return false;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1
+            && (entries.isEmpty()
+                || fwrite(entries.array(), sizeof(Entry), entries.size(), file)
+                        == entries.size());
+    success = fclose(file) == 0 && success;
+
+    if (!success || rename(tempPath.string(), path) != 0) {
+        unlink(tempPath.string());
+        return false;
+    }
+    return true;
+}
+
+// static
+void MPEG2TSSeekIndex::TrimCache(const char *dir, off64_t maxSize) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+
+    // Oldest first
+    KeyedVector<int64_t, String8> files;
+    off64_t totalSize = 0;
+    const size_t suffixLength = strlen(kCacheSuffix);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length <= suffixLength
+                || strcmp(entry->d_name + length - suffixLength, kCacheSuffix)) {
+            continue;
+        }
+
+        String8 path = String8::format("%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (stat(path.string(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        totalSize += st.st_size;
+
+        // Break ties so that no file is left out
+        int64_t key = st.st_mtim.tv_sec * 1000000ll + st.st_mtim.tv_nsec / 1000;
+        while (files.indexOfKey(key) >= 0) {
+            ++key;
+        }
+        files.add(key, path);
+    }
+    closedir(d);
+
+    for (size_t i = 0; i < files.size() && totalSize > maxSize; ++i) {
+        struct stat st;
+        const String8 &path = files.valueAt(i);
+        if (stat(path.string(), &st) == 0 && unlink(path.string()) == 0) {
+            ALOGV("evicted %s", path.string());
+            totalSize -= st.st_size;
+        }
+    }
+}
+
+}  // namespace android
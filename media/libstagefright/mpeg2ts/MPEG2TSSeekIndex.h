@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPEG2_TS_SEEK_INDEX_H_
+
+#define MPEG2_TS_SEEK_INDEX_H_
+
+#include <pthread.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "ATSParser.h"
+
+namespace android {
+
+class DataSource;
+
+// A sparse index of the sync frames of one track of a transport stream file:
+// presentation time and the offset of the TS packet their PES starts in,
+// at most one entry per kMinEntryIntervalUs. Only sync frames are indexed,
+// so every entry is a place playback can start from.
+//
+// The index is built on a background thread by demuxing the whole file with
+// a parser of its own, whose timestamps match those of a parser that started
+// at the beginning of the file. Complete indexes are saved to a cache
+// directory, keyed by the file's size and a hash of its first and last bytes,
+// and are loaded from there when the same file is opened again. The least
+// recently used indexes are evicted once the directory outgrows kMaxCacheSize.
+struct MPEG2TSSeekIndex : public RefBase {
+    struct Entry {
+        int64_t mTimeUs;
+        off64_t mOffset;
+    };
+
+    struct Stats {
+        bool mLoadedFromCache;
+        off64_t mBytesScanned;
+        int64_t mBuildTimeUs;
+        size_t mNumEntries;
+    };
+
+    // cacheDir is where indexes are saved and looked up, /data/misc/media/
+    // mpeg2ts_index unless given.
+    MPEG2TSSeekIndex(const sp<DataSource> &source, ATSParser::SourceType type,
+            const char *cacheDir = NULL);
+
+    // Whether an index is worth having for source: a local file at least a
+    // few tens of megabytes long, with indexing enabled through
+    // media.stagefright.ts-index.
+    static bool IsWanted(const sp<DataSource> &source);
+
+    // Loads the index from the cache if it's there; otherwise starts
+    // building it in the background. Fails if the index could not be saved
+    // once built, since every open of the file would then demux all of it
+    // again.
+    status_t start();
+
+    // Stops building the index. The entries found so far stay available.
+    void stop();
+
+    bool isComplete() const;
+
+    // The presentation time of the last access unit of the track, once the
+    // index is complete.
+    bool getDurationUs(int64_t *durationUs) const;
+
+    // Appends the entries from index from on to entries, and returns the
+    // number of entries in the index.
+    size_t getEntries(size_t from, Vector<Entry> *entries) const;
+
+    void getStats(Stats *stats) const;
+
+    // A cache file is a header followed by its entries. Reading fails unless
+    // the file was written for a file of fileSize bytes and a track of the
+    // given type, and all of its entries lie within that file.
+    static bool ReadCacheFile(
+            const char *path, off64_t fileSize, ATSParser::SourceType type,
+            Vector<Entry> *entries, int64_t *durationUs);
+    static bool WriteCacheFile(
+            const char *path, off64_t fileSize, ATSParser::SourceType type,
+            const Vector<Entry> &entries, int64_t durationUs);
+
+    // Deletes the least recently used indexes in dir until the rest take up
+    // at most maxSize bytes.
+    static void TrimCache(const char *dir, off64_t maxSize);
+
+protected:
+    virtual ~MPEG2TSSeekIndex();
+
+private:
+    static const int64_t kMinEntryIntervalUs;
+    static const off64_t kMaxCacheSize;
+
+    sp<DataSource> mDataSource;
+    ATSParser::SourceType mType;
+    off64_t mFileSize;
+    String8 mCacheDir;
+    String8 mCachePath;
+
+    mutable Mutex mLock;
+    Vector<Entry> mEntries;
+    bool mComplete;
+    bool mStopping;
+    int64_t mDurationUs;
+    Stats mStats;
+
+    pthread_t mThread;
+    bool mThreadStarted;
+
+    static void *ThreadWrapper(void *me);
+    void threadEntry();
+
+    // Demuxes the file and collects entries. Returns OK once it has reached
+    // the end of the file.
+    status_t build();
+
+    bool computeCachePath();
+    bool isCacheWritable();
+    bool loadFromCache();
+    void saveToCache();
+
+    DISALLOW_EVIL_CONSTRUCTORS(MPEG2TSSeekIndex);
+};
+
+}  // namespace android
+
+#endif  // MPEG2_TS_SEEK_INDEX_H_
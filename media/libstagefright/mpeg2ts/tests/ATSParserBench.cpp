@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times ATSParser demuxing a transport stream held in memory, fed one packet
+// at a time through feedTSPacket() and in runs through feedTSPackets().
+//
+// Without -f, a synthetic multi-program capture is generated: PAT and PMTs
+// repeated every 64 packets, PCRs in the adaptation field, and PES packets on
+// private data streams. ATSParser doesn't queue private data, so this measures
+// packet header parsing and PID routing alone. With -f, a real capture is
+// demuxed, including elementary stream parsing; the access units of the
+// sources getSource() returns are dequeued after every run of packets.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+
+#include "ATSParser.h"
+#include "AnotherPacketSource.h"
+
+using namespace android;
+
+static const size_t kTSPacketSize = 188;
+static const size_t kPacketsPerRun = 1024;
+static const size_t kPSIInterval = 64;
+static const size_t kPESInterval = 32;
+static const size_t kPCRInterval = 16;
+static const uint8_t kPrivateStreamType = 0x06;
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t crc32Mpeg(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+struct SyntheticCapture {
+    SyntheticCapture(size_t numPrograms, size_t streamsPerProgram)
+        : mNumPrograms(numPrograms),
+          mStreamsPerProgram(streamsPerProgram),
+          mPCR(0) {
+        mContinuityCounters.resize(0x2000, 0);
+    }
+
+    void generate(std::vector<uint8_t> *out, size_t numPackets);
+
+private:
+    size_t mNumPrograms;
+    size_t mStreamsPerProgram;
+    uint64_t mPCR;
+    std::vector<uint8_t> mContinuityCounters;
+
+    static unsigned pmtPID(size_t program) {
+        return 0x100 + program * 0x20;
+    }
+
+    static unsigned streamPID(size_t program, size_t stream) {
+        return pmtPID(program) + 1 + stream;
+    }
+
+    uint8_t *startPacket(std::vector<uint8_t> *out, unsigned PID,
+            bool payloadStart, bool adaptation);
+    void writeSection(std::vector<uint8_t> *out, unsigned PID,
+            const std::vector<uint8_t> &section);
+    void writePAT(std::vector<uint8_t> *out);
+    void writePMT(std::vector<uint8_t> *out, size_t program);
+    void writePES(std::vector<uint8_t> *out, size_t program, size_t stream,
+            size_t packetIndex);
+};
+
+uint8_t *SyntheticCapture::startPacket(
+        std::vector<uint8_t> *out, unsigned PID, bool payloadStart,
+        bool adaptation) {
+    size_t offset = out->size();
+    out->resize(offset + kTSPacketSize, 0xff);
+    uint8_t *packet = &(*out)[offset];
+    packet[0] = 0x47;
+    packet[1] = (payloadStart ? 0x40 : 0) | (PID >> 8);
+    packet[2] = PID & 0xff;
+    packet[3] = (adaptation ? 0x30 : 0x10) | mContinuityCounters[PID];
+    mContinuityCounters[PID] = (mContinuityCounters[PID] + 1) & 0x0f;
+    return packet;
+}
+
+void SyntheticCapture::writeSection(
+        std::vector<uint8_t> *out, unsigned PID,
+        const std::vector<uint8_t> &section) {
+    uint8_t *packet = startPacket(out, PID, true /* payloadStart */,
+            false /* adaptation */);
+    packet[4] = 0;  // pointer_field
+    CHECK_LE(section.size(), kTSPacketSize - 5);
+    memcpy(packet + 5, section.data(), section.size());
+}
+
+static void finishSection(std::vector<uint8_t> *section) {
+    // section_length counts everything after it, including the CRC
+    size_t sectionLength = section->size() - 3 + 4;
+    (*section)[1] |= (sectionLength >> 8) & 0x0f;
+    (*section)[2] = sectionLength & 0xff;
+    uint32_t crc = crc32Mpeg(section->data(), section->size());
+    section->push_back(crc >> 24);
+    section->push_back(crc >> 16);
+    section->push_back(crc >> 8);
+    section->push_back(crc);
+}
+
+void SyntheticCapture::writePAT(std::vector<uint8_t> *out) {
+    std::vector<uint8_t> section = {
+        0x00,           // table_id
+        0xb0, 0x00,     // section_syntax_indicator, section_length
+        0x00, 0x01,     // transport_stream_id
+        0xc1,           // version_number, current_next_indicator
+        0x00, 0x00,     // section_number, last_section_number
+    };
+    for (size_t i = 0; i < mNumPrograms; ++i) {
+        unsigned programNumber = i + 1;
+        section.push_back(programNumber >> 8);
+        section.push_back(programNumber & 0xff);
+        section.push_back(0xe0 | (pmtPID(i) >> 8));
+        section.push_back(pmtPID(i) & 0xff);
+    }
+    finishSection(&section);
+    writeSection(out, 0, section);
+}
+
+void SyntheticCapture::writePMT(std::vector<uint8_t> *out, size_t program) {
+    unsigned programNumber = program + 1;
+    unsigned PCR_PID = streamPID(program, 0);
+    std::vector<uint8_t> section = {
+        0x02,           // table_id
+        0xb0, 0x00,     // section_syntax_indicator, section_length
+        (uint8_t)(programNumber >> 8), (uint8_t)(programNumber & 0xff),
+        0xc1,           // version_number, current_next_indicator
+        0x00, 0x00,     // section_number, last_section_number
+        (uint8_t)(0xe0 | (PCR_PID >> 8)), (uint8_t)(PCR_PID & 0xff),
+        0xf0, 0x00,     // program_info_length
+    };
+    for (size_t i = 0; i < mStreamsPerProgram; ++i) {
+        unsigned PID = streamPID(program, i);
+        section.push_back(kPrivateStreamType);
+        section.push_back(0xe0 | (PID >> 8));
+        section.push_back(PID & 0xff);
+        section.push_back(0xf0);  // ES_info_length
+        section.push_back(0x00);
+    }
+    finishSection(&section);
+    writeSection(out, pmtPID(program), section);
+}
+
+void SyntheticCapture::writePES(
+        std::vector<uint8_t> *out, size_t program, size_t stream,
+        size_t packetIndex) {
+    unsigned PID = streamPID(program, stream);
+    bool payloadStart = (packetIndex % kPESInterval) == 0;
+    bool hasPCR = stream == 0 && (packetIndex % kPCRInterval) == 0;
+
+    uint8_t *packet = startPacket(out, PID, payloadStart, hasPCR);
+    size_t offset = 4;
+    if (hasPCR) {
+        mPCR += 27000000 / 100;
+        uint64_t base = mPCR / 300;
+        unsigned ext = mPCR % 300;
+        packet[4] = 7;      // adaptation_field_length
+        packet[5] = 0x10;   // PCR_flag
+        packet[6] = base >> 25;
+        packet[7] = base >> 17;
+        packet[8] = base >> 9;
+        packet[9] = base >> 1;
+        packet[10] = ((base & 1) << 7) | 0x7e | (ext >> 8);
+        packet[11] = ext & 0xff;
+        offset = 12;
+    }
+
+    if (payloadStart) {
+        uint64_t PTS = (mPCR / 300) & 0x1ffffffffull;
+        const uint8_t header[] = {
+            0x00, 0x00, 0x01, 0xbd,         // private_stream_1
+            0x00, 0x00,                     // PES_packet_length (unbounded)
+            0x80, 0x80, 0x05,               // PTS only
+            (uint8_t)(0x21 | ((PTS >> 29) & 0x0e)),
+            (uint8_t)(PTS >> 22),
+            (uint8_t)(0x01 | ((PTS >> 14) & 0xfe)),
+            (uint8_t)(PTS >> 7),
+            (uint8_t)(0x01 | ((PTS << 1) & 0xfe)),
+        };
+        memcpy(packet + offset, header, sizeof(header));
+        offset += sizeof(header);
+    }
+
+    for (size_t i = offset; i < kTSPacketSize; ++i) {
+        packet[i] = (uint8_t)(packetIndex + i);
+    }
+}
+
+void SyntheticCapture::generate(std::vector<uint8_t> *out, size_t numPackets) {
+    out->reserve(numPackets * kTSPacketSize);
+    size_t numStreams = mNumPrograms * mStreamsPerProgram;
+    size_t esPackets = 0;
+    while (out->size() / kTSPacketSize < numPackets) {
+        if ((out->size() / kTSPacketSize) % kPSIInterval == 0) {
+            writePAT(out);
+            for (size_t i = 0; i < mNumPrograms; ++i) {
+                writePMT(out, i);
+            }
+            continue;
+        }
+        size_t index = esPackets % numStreams;
+        writePES(out, index / mStreamsPerProgram, index % mStreamsPerProgram,
+                esPackets / numStreams);
+        ++esPackets;
+    }
+    out->resize(numPackets * kTSPacketSize);
+}
+
+static bool readCapture(const char *path, std::vector<uint8_t> *out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    out->resize(st.st_size - st.st_size % kTSPacketSize);
+    size_t offset = 0;
+    while (offset < out->size()) {
+        ssize_t n = read(fd, out->data() + offset, out->size() - offset);
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        offset += n;
+    }
+    close(fd);
+    return true;
+}
+
+static void drainSources(const sp<ATSParser> &parser) {
+    static const ATSParser::SourceType kTypes[] = {
+        ATSParser::VIDEO, ATSParser::AUDIO, ATSParser::META,
+    };
+    for (size_t i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); ++i) {
+        sp<AnotherPacketSource> source =
+            static_cast<AnotherPacketSource *>(parser->getSource(kTypes[i]).get());
+        if (source == NULL) {
+            continue;
+        }
+        status_t finalResult;
+        sp<ABuffer> accessUnit;
+        while (source->hasBufferAvailable(&finalResult)
+                && source->dequeueAccessUnit(&accessUnit) == OK) {
+        }
+    }
+}
+
+// Returns the time it took to demux data, or a negative value on error.
+static double demux(const std::vector<uint8_t> &data, bool batched, bool drain) {
+    sp<ATSParser> parser = new ATSParser;
+    const size_t numPackets = data.size() / kTSPacketSize;
+
+    double start = nowSeconds();
+    for (size_t first = 0; first < numPackets; first += kPacketsPerRun) {
+        size_t count = numPackets - first;
+        if (count > kPacketsPerRun) {
+            count = kPacketsPerRun;
+        }
+        const uint8_t *packets = data.data() + first * kTSPacketSize;
+
+        if (batched) {
+            size_t numPacketsFed;
+            status_t err = parser->feedTSPackets(
+                    packets, count * kTSPacketSize, NULL, &numPacketsFed);
+            if (err != OK || numPacketsFed != count) {
+                fprintf(stderr, "feedTSPackets failed at packet %zu: %d\n",
+                        first + numPacketsFed, err);
+                return -1;
+            }
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                status_t err = parser->feedTSPacket(
+                        packets + i * kTSPacketSize, kTSPacketSize);
+                if (err != OK) {
+                    fprintf(stderr, "feedTSPacket failed at packet %zu: %d\n",
+                            first + i, err);
+                    return -1;
+                }
+            }
+        }
+
+        if (drain) {
+            drainSources(parser);
+        }
+    }
+    return nowSeconds() - start;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-f capture.ts] [-m megabytes] [-p programs] "
+            "[-s streams per program] [-n iterations]\n", me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    int megabytes = 64;
+    int numPrograms = 8;
+    int streamsPerProgram = 3;
+    int iterations = 5;
+
+    int res;
+    while ((res = getopt(argc, argv, "f:m:p:s:n:")) >= 0) {
+        switch (res) {
+            case 'f':
+                path = optarg;
+                break;
+            case 'm':
+                megabytes = atoi(optarg);
+                break;
+            case 'p':
+                numPrograms = atoi(optarg);
+                break;
+            case 's':
+                streamsPerProgram = atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    // The PAT and every PMT have to fit in one packet each
+    if (megabytes <= 0 || numPrograms <= 0 || numPrograms > 40
+            || streamsPerProgram <= 0 || streamsPerProgram > 30
+            || iterations <= 0) {
+        usage(argv[0]);
+    }
+
+    std::vector<uint8_t> data;
+    if (path != NULL) {
+        if (!readCapture(path, &data)) {
+            return 1;
+        }
+        printf("%s: %zu packets\n", path, data.size() / kTSPacketSize);
+    } else {
+        SyntheticCapture capture(numPrograms, streamsPerProgram);
+        capture.generate(&data, (size_t)megabytes * 1024 * 1024 / kTSPacketSize);
+        printf("synthetic: %d programs x %d streams, %zu packets\n",
+                numPrograms, streamsPerProgram, data.size() / kTSPacketSize);
+    }
+    if (data.empty()) {
+        fprintf(stderr, "Nothing to demux\n");
+        return 1;
+    }
+
+    printf("%-24s %10s %10s\n", "mode", "best MB/s", "avg MB/s");
+    for (int batched = 0; batched <= 1; ++batched) {
+        double best = 0;
+        double total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            double elapsed = demux(data, batched, path != NULL);
+            if (elapsed < 0) {
+                return 1;
+            }
+            if (best == 0 || elapsed < best) {
+                best = elapsed;
+            }
+            total += elapsed;
+        }
+        double megabytesFed = data.size() / (1024.0 * 1024.0);
+        printf("%-24s %10.1f %10.1f\n",
+                batched ? "feedTSPackets" : "feedTSPacket",
+                megabytesFed / best, megabytesFed * iterations / total);
+    }
+    return 0;
+}
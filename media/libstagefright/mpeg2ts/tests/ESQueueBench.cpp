@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times ElementaryStreamQueue assembling access units from synthetic H.264
+// and ADTS AAC elementary streams, appended one PES payload at a time the way
+// ATSParser does, and counts the heap allocations made per access unit.
+//
+// Allocations are counted through operator new, so they include the returned
+// ABuffers and their meta messages but not the malloc() calls behind buffer
+// contents and Vector storage.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+
+#include "ESQueue.h"
+
+using namespace android;
+
+static size_t gNumAllocations = 0;
+
+void *operator new(size_t size) {
+    ++gNumAllocations;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        abort();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+static const int64_t kFrameDurationUs = 33333;
+static const size_t kIDRInterval = 30;
+static const size_t kIDRSize = 30000;
+static const size_t kSliceSize = 4000;
+
+static const size_t kAACFrameSize = 372;
+static const size_t kAACFramesPerPES = 4;
+static const int64_t kAACFrameDurationUs = 23220;
+
+// 320x240 baseline profile
+static const uint8_t kSPS[] = { 0x67, 0x42, 0xc0, 0x1e, 0xda, 0x0a, 0x0f, 0xc8 };
+static const uint8_t kPPS[] = { 0x68, 0xce, 0x38, 0x80 };
+static const uint8_t kAUD[] = { 0x09, 0xf0 };
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Coded data without zero bytes, so that it never contains a start code.
+static void appendPayload(std::vector<uint8_t> *out, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        out->push_back(1 + rand() % 255);
+    }
+}
+
+static void appendNAL(std::vector<uint8_t> *out, const uint8_t *nal, size_t size) {
+    static const uint8_t kStartCode[] = { 0x00, 0x00, 0x00, 0x01 };
+    out->insert(out->end(), kStartCode, kStartCode + sizeof(kStartCode));
+    out->insert(out->end(), nal, nal + size);
+}
+
+// One PES payload per frame: an access unit delimiter, parameter sets before
+// every IDR frame, and a single slice.
+static void generateH264(std::vector<std::vector<uint8_t> > *pes, size_t numFrames) {
+    for (size_t i = 0; i < numFrames; ++i) {
+        std::vector<uint8_t> frame;
+        appendNAL(&frame, kAUD, sizeof(kAUD));
+
+        bool idr = (i % kIDRInterval) == 0;
+        if (idr) {
+            appendNAL(&frame, kSPS, sizeof(kSPS));
+            appendNAL(&frame, kPPS, sizeof(kPPS));
+        }
+
+        // first_mb_in_slice 0, so every slice starts a new picture
+        uint8_t header[] = { (uint8_t)(idr ? 0x65 : 0x41), 0x88 };
+        appendNAL(&frame, header, sizeof(header));
+        appendPayload(&frame, idr ? kIDRSize : kSliceSize);
+
+        pes->push_back(frame);
+    }
+}
+
+// kAACFramesPerPES ADTS frames per PES payload: AAC LC, 44.1 kHz, stereo.
+static void generateAAC(std::vector<std::vector<uint8_t> > *pes, size_t numFrames) {
+    for (size_t i = 0; i < numFrames; i += kAACFramesPerPES) {
+        std::vector<uint8_t> payload;
+        for (size_t j = 0; j < kAACFramesPerPES; ++j) {
+            uint8_t header[] = {
+                0xff, 0xf1, 0x50,
+                (uint8_t)(0x80 | (kAACFrameSize >> 11)),
+                (uint8_t)((kAACFrameSize >> 3) & 0xff),
+                (uint8_t)(((kAACFrameSize & 7) << 5) | 0x1f),
+                0xfc,
+            };
+            payload.insert(payload.end(), header, header + sizeof(header));
+            appendPayload(&payload, kAACFrameSize - sizeof(header));
+        }
+        pes->push_back(payload);
+    }
+}
+
+struct Result {
+    size_t mNumAccessUnits;
+    size_t mNumBytes;
+    size_t mNumAllocations;
+    double mSeconds;
+};
+
+static bool run(ElementaryStreamQueue::Mode mode,
+        const std::vector<std::vector<uint8_t> > &pes, int64_t durationUs,
+        int passes, Result *result) {
+    memset(result, 0, sizeof(*result));
+
+    ElementaryStreamQueue queue(mode);
+    int64_t timeUs = 0;
+
+    // The first pass warms up the queue's buffers and finds the format.
+    for (int pass = 0; pass <= passes; ++pass) {
+        size_t allocationsBefore = gNumAllocations;
+        double start = nowSeconds();
+        size_t numAccessUnits = 0;
+        size_t numBytes = 0;
+
+        for (size_t i = 0; i < pes.size(); ++i) {
+            if (queue.appendData(&pes[i][0], pes[i].size(), timeUs) != OK) {
+                fprintf(stderr, "appendData failed at PES %zu\n", i);
+                return false;
+            }
+            timeUs += durationUs;
+            numBytes += pes[i].size();
+
+            sp<ABuffer> accessUnit;
+            while ((accessUnit = queue.dequeueAccessUnit()) != NULL) {
+                ++numAccessUnits;
+            }
+        }
+
+        if (pass > 0) {
+            result->mSeconds += nowSeconds() - start;
+            result->mNumAllocations += gNumAllocations - allocationsBefore;
+            result->mNumAccessUnits += numAccessUnits;
+            result->mNumBytes += numBytes;
+        }
+    }
+
+    return result->mNumAccessUnits > 0;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n passes]\n", me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int passes = 10;
+
+    int res;
+    while ((res = getopt(argc, argv, "n:")) >= 0) {
+        switch (res) {
+            case 'n':
+                passes = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (passes <= 0) {
+        usage(argv[0]);
+    }
+
+    srand(1);
+    std::vector<std::vector<uint8_t> > h264;
+    generateH264(&h264, 600);
+    std::vector<std::vector<uint8_t> > aac;
+    generateAAC(&aac, 4000);
+
+    printf("%-8s %12s %10s %12s\n", "stream", "AUs/s", "MB/s", "allocs/AU");
+
+    struct {
+        const char *mName;
+        ElementaryStreamQueue::Mode mMode;
+        const std::vector<std::vector<uint8_t> > *mPES;
+        int64_t mDurationUs;
+    } streams[] = {
+        { "H.264", ElementaryStreamQueue::H264, &h264, kFrameDurationUs },
+        { "AAC", ElementaryStreamQueue::AAC, &aac,
+                kAACFramesPerPES * kAACFrameDurationUs },
+    };
+
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); ++i) {
+        Result result;
+        if (!run(streams[i].mMode, *streams[i].mPES, streams[i].mDurationUs,
+                passes, &result)) {
+            fprintf(stderr, "%s: no access units\n", streams[i].mName);
+            return 1;
+        }
+        printf("%-8s %12.0f %10.1f %12.2f\n",
+                streams[i].mName,
+                result.mNumAccessUnits / result.mSeconds,
+                result.mNumBytes / result.mSeconds / 1E6,
+                (double)result.mNumAllocations / result.mNumAccessUnits);
+    }
+
+    return 0;
+}
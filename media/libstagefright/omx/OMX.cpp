@@ -570,6 +570,17 @@ status_t OMX::allocateBufferWithBackup(
             port_index, params, buffer, allottedSize);
 }
 
+status_t OMX::getBufferCopyStats(
+        node_id node, OMX_U32 port_index, uint64_t *bytesCopied) {
+    OMXNodeInstance *instance = findInstance(node);
+
+    if (instance == NULL) {
+        return NAME_NOT_FOUND;
+    }
+
+    return instance->getBufferCopyStats(port_index, bytesCopied);
+}
+
 status_t OMX::freeBuffer(node_id node, OMX_U32 port_index, buffer_id buffer) {
     OMXNodeInstance *instance = findInstance(node);
 
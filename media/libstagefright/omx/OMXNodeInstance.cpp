@@ -119,25 +119,28 @@ struct BufferMeta {
           mBackup(NULL) {
     }
 
-    void CopyFromOMX(const OMX_BUFFERHEADERTYPE *header) {
+    // these return the number of bytes copied
+    size_t CopyFromOMX(const OMX_BUFFERHEADERTYPE *header) {
         if (!mCopyFromOmx) {
-            return;
+            return 0;
         }
 
         // check component returns proper range
         sp<ABuffer> codec = getBuffer(header, false /* backup */, true /* limit */);
 
         memcpy((OMX_U8 *)mMem->pointer() + header->nOffset, codec->data(), codec->size());
+        return codec->size();
     }
 
-    void CopyToOMX(const OMX_BUFFERHEADERTYPE *header) {
+    size_t CopyToOMX(const OMX_BUFFERHEADERTYPE *header) {
         if (!mCopyToOmx) {
-            return;
+            return 0;
         }
 
         memcpy(header->pBuffer + header->nOffset,
                 (const OMX_U8 *)mMem->pointer() + header->nOffset,
                 header->nFilledLen);
+        return header->nFilledLen;
     }
 
     // return either the codec or the backup buffer
@@ -222,11 +225,16 @@ OMXNodeInstance::OMXNodeInstance(
     mNumPortBuffers[1] = 0;
     mDebugLevelBumpPendingBuffers[0] = 0;
     mDebugLevelBumpPendingBuffers[1] = 0;
+    mBytesCopied[0] = 0;
+    mBytesCopied[1] = 0;
     mMetadataType[0] = kMetadataBufferTypeInvalid;
     mMetadataType[1] = kMetadataBufferTypeInvalid;
     mSecureBufferType[0] = kSecureBufferTypeUnknown;
     mSecureBufferType[1] = kSecureBufferTypeUnknown;
     mIsSecure = AString(name).endsWith(".secure");
+    // software components live in this process and use the backup memory directly
+    mShareBackupBuffers = AString(name).startsWithIgnoreCase("OMX.google.")
+            && property_get_bool("debug.stagefright.omx-share-backup", true);
 }
 
 OMXNodeInstance::~OMXNodeInstance() {
@@ -351,6 +359,12 @@ status_t OMXNodeInstance::freeNode(OMXMaster *master) {
             break;
     }
 
+    {
+        Mutex::Autolock _l(mDebugLock);
+        CLOG_LIFE(freeNode, "copied %" PRIu64 " input / %" PRIu64 " output bytes",
+                mBytesCopied[kPortIndexInput], mBytesCopied[kPortIndexOutput]);
+    }
+
     ALOGV("[%x:%s] calling destroyComponentInstance", mNodeID, mName);
     OMX_ERRORTYPE err = master->destroyComponentInstance(
             static_cast<OMX_COMPONENTTYPE *>(mHandle));
@@ -1281,16 +1295,29 @@ status_t OMXNodeInstance::allocateBufferWithBackup(
     // metadata buffers are not connected cross process; only copy if not meta
     bool copy = mMetadataType[portIndex] == kMetadataBufferTypeInvalid;
 
+    // software components can work on the backup memory itself, which is
+    // mapped into this process, instead of on a copy of it. ACodec gets here
+    // for codecs listed with a requires-allocate-on-*-ports quirk; otherwise
+    // it uses useBuffer(), which never copies.
+    OMX_U8 *data = static_cast<OMX_U8 *>(params->pointer());
+    bool share = copy && mShareBackupBuffers && data != NULL;
+
     BufferMeta *buffer_meta = new BufferMeta(
             params, portIndex,
-            (portIndex == kPortIndexInput) && copy /* copyToOmx */,
-            (portIndex == kPortIndexOutput) && copy /* copyFromOmx */,
+            (portIndex == kPortIndexInput) && copy && !share /* copyToOmx */,
+            (portIndex == kPortIndexOutput) && copy && !share /* copyFromOmx */,
             NULL /* data */);
 
     OMX_BUFFERHEADERTYPE *header;
 
-    OMX_ERRORTYPE err = OMX_AllocateBuffer(
-            mHandle, &header, portIndex, buffer_meta, allottedSize);
+    OMX_ERRORTYPE err;
+    if (share) {
+        err = OMX_UseBuffer(
+                mHandle, &header, portIndex, buffer_meta, allottedSize, data);
+    } else {
+        err = OMX_AllocateBuffer(
+                mHandle, &header, portIndex, buffer_meta, allottedSize);
+    }
     if (err != OMX_ErrorNone) {
         CLOG_ERROR(allocateBufferWithBackup, err,
                 SIMPLE_BUFFER(portIndex, (size_t)allottedSize, params->pointer()));
@@ -1319,6 +1346,16 @@ status_t OMXNodeInstance::allocateBufferWithBackup(
     return OK;
 }
 
+status_t OMXNodeInstance::getBufferCopyStats(OMX_U32 portIndex, uint64_t *bytesCopied) {
+    if (portIndex >= NELEM(mBytesCopied)) {
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock _l(mDebugLock);
+    *bytesCopied = mBytesCopied[portIndex];
+    return OK;
+}
+
 status_t OMXNodeInstance::freeBuffer(
         OMX_U32 portIndex, OMX::buffer_id buffer) {
     Mutex::Autolock autoLock(mLock);
@@ -1416,7 +1453,11 @@ status_t OMXNodeInstance::emptyBuffer(
         header->nFilledLen = rangeLength;
         header->nOffset = rangeOffset;
 
-        buffer_meta->CopyToOMX(header);
+        size_t copied = buffer_meta->CopyToOMX(header);
+        if (copied > 0) {
+            Mutex::Autolock _l(mDebugLock);
+            mBytesCopied[kPortIndexInput] += copied;
+        }
     }
 
     return emptyBuffer_l(header, flags, timestamp, (intptr_t)buffer, fenceFd);
@@ -1705,9 +1746,20 @@ bool OMXNodeInstance::handleMessage(omx_message &msg) {
             return false;
         }
 
+        BufferMeta *buffer_meta =
+            static_cast<BufferMeta *>(buffer->pAppPrivate);
+
+        if (buffer->nOffset + buffer->nFilledLen < buffer->nOffset
+                || buffer->nOffset + buffer->nFilledLen > buffer->nAllocLen) {
+            CLOG_ERROR(onFillBufferDone, OMX_ErrorBadParameter,
+                    FULL_BUFFER(NULL, buffer, msg.fenceFd));
+        }
+        size_t copied = buffer_meta->CopyFromOMX(buffer);
+
         {
             Mutex::Autolock _l(mDebugLock);
             mOutputBuffersWithCodec.remove(buffer);
+            mBytesCopied[kPortIndexOutput] += copied;
 
             CLOG_BUMPED_BUFFER(
                     FBD, WITH_STATS(FULL_BUFFER(
@@ -1716,16 +1768,6 @@ bool OMXNodeInstance::handleMessage(omx_message &msg) {
             unbumpDebugLevel_l(kPortIndexOutput);
         }
 
-        BufferMeta *buffer_meta =
-            static_cast<BufferMeta *>(buffer->pAppPrivate);
-
-        if (buffer->nOffset + buffer->nFilledLen < buffer->nOffset
-                || buffer->nOffset + buffer->nFilledLen > buffer->nAllocLen) {
-            CLOG_ERROR(onFillBufferDone, OMX_ErrorBadParameter,
-                    FULL_BUFFER(NULL, buffer, msg.fenceFd));
-        }
-        buffer_meta->CopyFromOMX(buffer);
-
         if (bufferSource != NULL) {
             // fix up the buffer info (especially timestamp) if needed
             bufferSource->codecBufferFilled(buffer);
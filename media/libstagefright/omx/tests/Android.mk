@@ -42,3 +42,30 @@ LOCAL_CFLAGS += -Werror -Wall
 LOCAL_CLANG := true
 
 include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := OMXBackupBuffer_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	OMXBackupBuffer_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright_omx \
+	libstagefright_foundation \
+	libbinder \
+	libmedia \
+	libcutils \
+	libutils \
+	liblog \
+
+LOCAL_C_INCLUDES := \
+	frameworks/av/media/libstagefright \
+	frameworks/native/include/media/openmax \
+
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_CLANG := true
+
+include $(BUILD_NATIVE_TEST)
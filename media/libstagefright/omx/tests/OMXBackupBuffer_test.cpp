@@ -0,0 +1,196 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "OMXBackupBuffer_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <binder/MemoryDealer.h>
+#include <cutils/properties.h>
+#include <media/IOMX.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <utils/List.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+#include <OMX_Component.h>
+
+#include "include/OMX.h"
+
+namespace android {
+
+static const int64_t kTimeoutUs = 2000000ll;
+
+// Collects the messages the component sends.
+struct MessageQueue : public BnOMXObserver {
+    virtual void onMessages(const std::list<omx_message> &messages) {
+        Mutex::Autolock autoLock(mLock);
+        for (std::list<omx_message>::const_iterator it = messages.begin();
+                it != messages.end(); ++it) {
+            mMessages.push_back(*it);
+        }
+        mMessageAdded.signal();
+    }
+
+    status_t dequeue(omx_message *msg) {
+        Mutex::Autolock autoLock(mLock);
+        int64_t finishByUs = ALooper::GetNowUs() + kTimeoutUs;
+        while (mMessages.empty()) {
+            int64_t remainingUs = finishByUs - ALooper::GetNowUs();
+            if (remainingUs <= 0
+                    || mMessageAdded.waitRelative(mLock, remainingUs * 1000) == TIMED_OUT) {
+                return TIMED_OUT;
+            }
+        }
+        *msg = *mMessages.begin();
+        mMessages.erase(mMessages.begin());
+        if (msg->fenceFd >= 0) {
+            ::close(msg->fenceFd);
+            msg->fenceFd = -1;
+        }
+        return OK;
+    }
+
+private:
+    Mutex mLock;
+    Condition mMessageAdded;
+    List<omx_message> mMessages;
+};
+
+// Buffers allocated with allocateBufferWithBackup(), as ACodec does for
+// components with the requires-allocate-on-*-ports quirks, run through the
+// raw passthrough decoder in this process.
+class OMXBackupBufferTest : public ::testing::Test {
+protected:
+    struct Buffer {
+        IOMX::buffer_id mID;
+        sp<IMemory> mMemory;
+    };
+
+    sp<OMX> mOMX;
+    sp<MessageQueue> mMessages;
+    sp<MemoryDealer> mDealer;
+    IOMX::node_id mNode;
+    Vector<Buffer> mBuffers[2];
+
+    virtual void SetUp() {
+        mOMX = new OMX;
+        mMessages = new MessageQueue;
+        mDealer = new MemoryDealer(1024 * 1024, "OMXBackupBuffer_test");
+        mNode = 0;
+    }
+
+    virtual void TearDown() {
+        if (mNode != 0) {
+            // freeNode() takes the component back to loaded and frees the buffers
+            mOMX->freeNode(mNode);
+        }
+    }
+
+    // Skips other messages until the component reports it has reached |state|.
+    bool waitForState(OMX_STATETYPE state) {
+        omx_message msg;
+        while (mMessages->dequeue(&msg) == OK) {
+            if (msg.type == omx_message::EVENT
+                    && msg.u.event_data.event == OMX_EventCmdComplete
+                    && msg.u.event_data.data1 == OMX_CommandStateSet
+                    && msg.u.event_data.data2 == (OMX_U32)state) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void allocatePortBuffers(OMX_U32 portIndex) {
+        OMX_PARAM_PORTDEFINITIONTYPE def;
+        memset(&def, 0, sizeof(def));
+        def.nSize = sizeof(def);
+        def.nVersion.s.nVersionMajor = 1;
+        def.nPortIndex = portIndex;
+        ASSERT_EQ(OK, mOMX->getParameter(
+                mNode, OMX_IndexParamPortDefinition, &def, sizeof(def)));
+
+        for (OMX_U32 i = 0; i < def.nBufferCountActual; ++i) {
+            Buffer buffer;
+            buffer.mMemory = mDealer->allocate(def.nBufferSize);
+            ASSERT_TRUE(buffer.mMemory != NULL);
+            ASSERT_EQ(OK, mOMX->allocateBufferWithBackup(
+                    mNode, portIndex, buffer.mMemory, &buffer.mID, def.nBufferSize));
+            mBuffers[portIndex].push(buffer);
+        }
+    }
+};
+
+TEST_F(OMXBackupBufferTest, SoftwareComponentUsesBackupMemory) {
+    ASSERT_EQ(OK, mOMX->allocateNode("OMX.google.raw.decoder", mMessages, NULL, &mNode));
+
+    ASSERT_EQ(OK, mOMX->sendCommand(mNode, OMX_CommandStateSet, OMX_StateIdle));
+    allocatePortBuffers(0 /* portIndex */);
+    allocatePortBuffers(1 /* portIndex */);
+    ASSERT_FALSE(HasFatalFailure());
+    ASSERT_TRUE(waitForState(OMX_StateIdle));
+
+    ASSERT_EQ(OK, mOMX->sendCommand(mNode, OMX_CommandStateSet, OMX_StateExecuting));
+    ASSERT_TRUE(waitForState(OMX_StateExecuting));
+
+    for (size_t i = 0; i < mBuffers[1].size(); ++i) {
+        ASSERT_EQ(OK, mOMX->fillBuffer(mNode, mBuffers[1][i].mID));
+    }
+
+    const size_t kLength = 4096;
+    uint8_t *input = (uint8_t *)mBuffers[0][0].mMemory->pointer();
+    for (size_t i = 0; i < kLength; ++i) {
+        input[i] = (uint8_t)(i * 7);
+    }
+    ASSERT_EQ(OK, mOMX->emptyBuffer(
+            mNode, mBuffers[0][0].mID, 0 /* offset */, kLength,
+            OMX_BUFFERFLAG_ENDOFFRAME, 0 /* timestamp */));
+
+    omx_message msg;
+    do {
+        ASSERT_EQ(OK, mMessages->dequeue(&msg));
+    } while (msg.type != omx_message::FILL_BUFFER_DONE);
+    ASSERT_EQ(kLength, msg.u.extended_buffer_data.range_length);
+
+    sp<IMemory> output;
+    for (size_t i = 0; i < mBuffers[1].size(); ++i) {
+        if (mBuffers[1][i].mID == msg.u.extended_buffer_data.buffer) {
+            output = mBuffers[1][i].mMemory;
+        }
+    }
+    ASSERT_TRUE(output != NULL);
+    EXPECT_EQ(0, memcmp(input,
+            (const uint8_t *)output->pointer() + msg.u.extended_buffer_data.range_offset,
+            kLength));
+
+    // The component worked on the client's memory, unless sharing is turned off
+    uint64_t inputCopied, outputCopied;
+    ASSERT_EQ(OK, mOMX->getBufferCopyStats(mNode, 0 /* portIndex */, &inputCopied));
+    ASSERT_EQ(OK, mOMX->getBufferCopyStats(mNode, 1 /* portIndex */, &outputCopied));
+    if (property_get_bool("debug.stagefright.omx-share-backup", true)) {
+        EXPECT_EQ(0u, inputCopied);
+        EXPECT_EQ(0u, outputCopied);
+    } else {
+        EXPECT_EQ(kLength, inputCopied);
+        EXPECT_EQ(kLength, outputCopied);
+    }
+}
+
+}  // namespace android
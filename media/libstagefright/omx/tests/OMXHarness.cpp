@@ -412,6 +412,15 @@ status_t Harness::testStateTransitions(
            "Component did not properly transition to from idle to "
            "loaded state after freeing all input and output buffers.");
 
+    uint64_t inputBytesCopied, outputBytesCopied;
+    err = mOMX->getBufferCopyStats(node, 0, &inputBytesCopied);
+    EXPECT_SUCCESS(err, "getBufferCopyStats(input)");
+    err = mOMX->getBufferCopyStats(node, 1, &outputBytesCopied);
+    EXPECT_SUCCESS(err, "getBufferCopyStats(output)");
+
+    ALOGI("%s copied %" PRIu64 " input and %" PRIu64 " output bytes",
+            componentName, inputBytesCopied, outputBytesCopied);
+
     err = mOMX->freeNode(node);
     EXPECT_SUCCESS(err, "freeNode");
 
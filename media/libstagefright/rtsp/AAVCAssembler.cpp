@@ -37,7 +37,8 @@ AAVCAssembler::AAVCAssembler(const sp<AMessage> &notify)
       mAccessUnitRTPTime(0),
       mNextExpectedSeqNoValid(false),
       mNextExpectedSeqNo(0),
-      mAccessUnitDamaged(false) {
+      mAccessUnitDamaged(false),
+      mAccessUnitCapacity(0) {
 }
 
 AAVCAssembler::~AAVCAssembler() {
@@ -129,15 +130,46 @@ void AAVCAssembler::addSingleNALUnit(const sp<ABuffer> &buffer) {
     hexdump(buffer->data(), buffer->size());
 #endif
 
+    memcpy(appendNALUnit(buffer, buffer->size()),
+           buffer->data(), buffer->size());
+}
+
+uint8_t *AAVCAssembler::appendNALUnit(const sp<ABuffer> &packet, size_t size) {
     uint32_t rtpTime;
-    CHECK(buffer->meta()->findInt32("rtp-time", (int32_t *)&rtpTime));
+    CHECK(packet->meta()->findInt32("rtp-time", (int32_t *)&rtpTime));
 
-    if (!mNALUnits.empty() && rtpTime != mAccessUnitRTPTime) {
+    if (mAccessUnit != NULL && rtpTime != mAccessUnitRTPTime) {
         submitAccessUnit();
     }
     mAccessUnitRTPTime = rtpTime;
 
-    mNALUnits.push_back(buffer);
+    size_t offset = 0;
+    if (mAccessUnit == NULL) {
+        size_t capacity = mAccessUnitCapacity;
+        if (capacity < 4 + size) {
+            capacity = 4 + size;
+        }
+        mAccessUnit = new ABuffer(capacity);
+        CopyTimes(mAccessUnit, packet);
+    } else {
+        offset = mAccessUnit->size();
+        if (offset + 4 + size > mAccessUnit->capacity()) {
+            size_t capacity = 2 * mAccessUnit->capacity();
+            if (capacity < offset + 4 + size) {
+                capacity = offset + 4 + size;
+            }
+            sp<ABuffer> accessUnit = new ABuffer(capacity);
+            memcpy(accessUnit->data(), mAccessUnit->data(), offset);
+            CopyTimes(accessUnit, mAccessUnit);
+            mAccessUnit = accessUnit;
+        }
+    }
+
+    uint8_t *dst = mAccessUnit->data() + offset;
+    memcpy(dst, "\x00\x00\x00\x01", 4);
+    mAccessUnit->setRange(0, offset + 4 + size);
+
+    return dst + 4;
 }
 
 bool AAVCAssembler::addSingleTimeAggregationPacket(const sp<ABuffer> &buffer) {
@@ -159,12 +191,7 @@ bool AAVCAssembler::addSingleTimeAggregationPacket(const sp<ABuffer> &buffer) {
             return false;
         }
 
-        sp<ABuffer> unit = new ABuffer(nalSize);
-        memcpy(unit->data(), &data[2], nalSize);
-
-        CopyTimes(unit, buffer);
-
-        addSingleNALUnit(unit);
+        memcpy(appendNALUnit(buffer, nalSize), &data[2], nalSize);
 
         data += 2 + nalSize;
         size -= 2 + nalSize;
@@ -284,10 +311,9 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addFragmentedNALUnit(
     // header byte.
     ++totalSize;
 
-    sp<ABuffer> unit = new ABuffer(totalSize);
-    CopyTimes(unit, *queue->begin());
+    uint8_t *dst = appendNALUnit(*queue->begin(), totalSize);
 
-    unit->data()[0] = (nri << 5) | nalType;
+    dst[0] = (nri << 5) | nalType;
 
     size_t offset = 1;
     List<sp<ABuffer> >::iterator it = queue->begin();
@@ -299,45 +325,25 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addFragmentedNALUnit(
         hexdump(buffer->data(), buffer->size());
 #endif
 
-        memcpy(unit->data() + offset, buffer->data() + 2, buffer->size() - 2);
+        memcpy(dst + offset, buffer->data() + 2, buffer->size() - 2);
         offset += buffer->size() - 2;
 
         it = queue->erase(it);
     }
 
-    unit->setRange(0, totalSize);
-
-    addSingleNALUnit(unit);
-
     ALOGV("successfully assembled a NAL unit from fragments.");
 
     return OK;
 }
 
 void AAVCAssembler::submitAccessUnit() {
-    CHECK(!mNALUnits.empty());
+    CHECK(mAccessUnit != NULL);
 
-    ALOGV("Access unit complete (%zu nal units)", mNALUnits.size());
+    ALOGV("Access unit complete (%zu bytes)", mAccessUnit->size());
 
-    size_t totalSize = 0;
-    for (List<sp<ABuffer> >::iterator it = mNALUnits.begin();
-         it != mNALUnits.end(); ++it) {
-        totalSize += 4 + (*it)->size();
-    }
-
-    sp<ABuffer> accessUnit = new ABuffer(totalSize);
-    size_t offset = 0;
-    for (List<sp<ABuffer> >::iterator it = mNALUnits.begin();
-         it != mNALUnits.end(); ++it) {
-        memcpy(accessUnit->data() + offset, "\x00\x00\x00\x01", 4);
-        offset += 4;
-
-        sp<ABuffer> nal = *it;
-        memcpy(accessUnit->data() + offset, nal->data(), nal->size());
-        offset += nal->size();
-    }
-
-    CopyTimes(accessUnit, *mNALUnits.begin());
+    sp<ABuffer> accessUnit = mAccessUnit;
+    mAccessUnit.clear();
+    mAccessUnitCapacity = accessUnit->size();
 
 #if 0
     printf(mAccessUnitDamaged ? "X" : ".");
@@ -348,7 +354,6 @@ void AAVCAssembler::submitAccessUnit() {
         accessUnit->meta()->setInt32("damaged", true);
     }
 
-    mNALUnits.clear();
     mAccessUnitDamaged = false;
 
     sp<AMessage> msg = mNotifyMsg->dup();
@@ -375,6 +380,10 @@ void AAVCAssembler::packetLost() {
 }
 
 void AAVCAssembler::onByeReceived() {
+    if (mAccessUnit != NULL) {
+        submitAccessUnit();
+    }
+
     sp<AMessage> msg = mNotifyMsg->dup();
     msg->setInt32("eos", true);
     msg->post();
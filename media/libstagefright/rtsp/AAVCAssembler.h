@@ -45,10 +45,19 @@ private:
     bool mNextExpectedSeqNoValid;
     uint32_t mNextExpectedSeqNo;
     bool mAccessUnitDamaged;
-    List<sp<ABuffer> > mNALUnits;
+
+    // NAL units are written straight into the access unit, each after a
+    // start code. It's allocated at the size of the previous one and
+    // grows as needed.
+    sp<ABuffer> mAccessUnit;
+    size_t mAccessUnitCapacity;
 
     AssemblyStatus addNALUnit(const sp<ARTPSource> &source);
     void addSingleNALUnit(const sp<ABuffer> &buffer);
+
+    // Makes room for a NAL unit of size bytes from packet in the access unit
+    // and returns where it goes.
+    uint8_t *appendNALUnit(const sp<ABuffer> &packet, size_t size);
     AssemblyStatus addFragmentedNALUnit(List<sp<ABuffer> > *queue);
     bool addSingleTimeAggregationPacket(const sp<ABuffer> &buffer);
 
@@ -18,15 +18,13 @@
 
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
-#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 
 #include <stdint.h>
 
 namespace android {
 
-ARTPAssembler::ARTPAssembler()
-    : mFirstFailureTimeUs(-1) {
+ARTPAssembler::ARTPAssembler() {
 }
 
 void ARTPAssembler::onPacketReceived(const sp<ARTPSource> &source) {
@@ -35,24 +33,14 @@ void ARTPAssembler::onPacketReceived(const sp<ARTPSource> &source) {
         status = assembleMore(source);
 
         if (status == WRONG_SEQUENCE_NUMBER) {
-            if (mFirstFailureTimeUs >= 0) {
-                if (ALooper::GetNowUs() - mFirstFailureTimeUs > 10000ll) {
-                    mFirstFailureTimeUs = -1;
-
-                    // LOG(VERBOSE) << "waited too long for packet.";
-                    packetLost();
-                    continue;
-                }
-            } else {
-                mFirstFailureTimeUs = ALooper::GetNowUs();
-            }
-            break;
-        } else {
-            mFirstFailureTimeUs = -1;
+            // ARTPSource only queues packets past a missing one once it has
+            // waited long enough for it.
+            packetLost();
+            continue;
+        }
 
-            if (status == NOT_ENOUGH_DATA) {
-                break;
-            }
+        if (status == NOT_ENOUGH_DATA) {
+            break;
         }
     }
 }
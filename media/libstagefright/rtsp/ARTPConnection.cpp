@@ -37,6 +37,9 @@ namespace android {
 
 static const size_t kMaxUDPSize = 1500;
 
+// The largest datagram receive() accepts.
+static const size_t kMaxDatagramSize = 65536;
+
 static uint16_t u16at(const uint8_t *data) {
     return data[0] << 8 | data[1];
 }
@@ -287,7 +290,7 @@ void ARTPConnection::onPollStreams() {
 
             status_t err = OK;
             if (FD_ISSET(it->mRTPSocket, &rs)) {
-                err = receive(&*it, true);
+                err = receiveRTPBatch(&*it);
             }
             if (err == OK && FD_ISSET(it->mRTCPSocket, &rs)) {
                 err = receive(&*it, false);
@@ -370,12 +373,64 @@ void ARTPConnection::onPollStreams() {
     }
 }
 
+status_t ARTPConnection::receiveRTPBatch(StreamInfo *s) {
+    ALOGV("receiving RTP");
+
+    CHECK(!s->mIsInjected);
+
+    if (mReceiveBuffer == NULL) {
+        mReceiveBuffer = new ABuffer(kMaxBatchedPackets * kMaxDatagramSize);
+    }
+
+    struct iovec iov[kMaxBatchedPackets];
+    struct mmsghdr msgs[kMaxBatchedPackets];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < kMaxBatchedPackets; ++i) {
+        iov[i].iov_base = mReceiveBuffer->data() + i * kMaxDatagramSize;
+        iov[i].iov_len = kMaxDatagramSize;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Waits for the first datagram only.
+    int n;
+    do {
+        n = recvmmsg(
+                s->mRTPSocket, msgs, kMaxBatchedPackets, MSG_WAITFORONE, NULL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0 && errno == ENOSYS) {
+        return receive(s, true /* receiveRTP */);
+    }
+
+    if (n <= 0) {
+        return -ECONNRESET;
+    }
+
+    status_t err = OK;
+    for (int i = 0; i < n; ++i) {
+        size_t size = msgs[i].msg_len;
+        if (size == 0) {
+            return -ECONNRESET;
+        }
+
+        sp<ABuffer> buffer = new ABuffer(size);
+        memcpy(buffer->data(), iov[i].iov_base, size);
+
+        if (parseRTP(s, buffer) != OK) {
+            err = -1;
+        }
+    }
+
+    return err;
+}
+
 status_t ARTPConnection::receive(StreamInfo *s, bool receiveRTP) {
     ALOGV("receiving %s", receiveRTP ? "RTP" : "RTCP");
 
     CHECK(!s->mIsInjected);
 
-    sp<ABuffer> buffer = new ABuffer(65536);
+    sp<ABuffer> buffer = new ABuffer(kMaxDatagramSize);
 
     socklen_t remoteAddrLen =
         (!receiveRTP && s->mNumRTCPPacketsReceived == 0)
@@ -64,8 +64,16 @@ private:
 
     static const int64_t kSelectTimeoutUs;
 
+    enum {
+        // RTP packets are received up to kMaxBatchedPackets per call, into
+        // mReceiveBuffer, then copied into buffers of their own size.
+        kMaxBatchedPackets = 8,
+    };
+
     uint32_t mFlags;
 
+    sp<ABuffer> mReceiveBuffer;
+
     struct StreamInfo;
     List<StreamInfo> mStreams;
 
@@ -79,6 +87,7 @@ private:
     void onSendReceiverReports();
 
     status_t receive(StreamInfo *info, bool receiveRTP);
+    status_t receiveRTPBatch(StreamInfo *info);
 
     status_t parseRTP(StreamInfo *info, const sp<ABuffer> &buffer);
     status_t parseRTCP(StreamInfo *info, const sp<ABuffer> &buffer);
@@ -37,6 +37,10 @@ namespace android {
 
 static const uint32_t kSourceID = 0xdeadbeef;
 
+// static
+const int64_t ARTPSource::kMinJitterDelayUs = 10000ll;
+const int64_t ARTPSource::kMaxJitterDelayUs = 200000ll;
+
 ARTPSource::ARTPSource(
         uint32_t id,
         const sp<ASessionDescription> &sessionDesc, size_t index,
@@ -44,6 +48,13 @@ ARTPSource::ARTPSource(
     : mID(id),
       mHighestSeqNumber(0),
       mNumBuffersReceived(0),
+      mNextSeqNumber(0),
+      mGapSeqNumber(0),
+      mGapStartUs(-1),
+      mJitterDelayUs(kMinJitterDelayUs),
+      mNumPacketsLost(0),
+      mStarted(false),
+      mFirstPacketUs(-1),
       mLastNTPTime(0),
       mLastNTPTimeUpdateUs(0),
       mIssueFIRRequests(false),
@@ -105,68 +116,174 @@ void ARTPSource::timeUpdate(uint32_t rtpTime, uint64_t ntpTime) {
 bool ARTPSource::queuePacket(const sp<ABuffer> &buffer) {
     uint32_t seqNum = (uint32_t)buffer->int32Data();
 
+    int64_t nowUs = ALooper::GetNowUs();
+
     if (mNumBuffersReceived++ == 0) {
         mHighestSeqNumber = seqNum;
-        mQueue.push_back(buffer);
-        return true;
+        mNextSeqNumber = seqNum;
+        mFirstPacketUs = nowUs;
+    } else {
+        // Only the lower 16-bit of the sequence numbers are transmitted,
+        // derive the high-order bits by choosing the candidate closest
+        // to the highest sequence number (extended to 32 bits) received so far.
+
+        uint32_t seq1 = seqNum | (mHighestSeqNumber & 0xffff0000);
+
+        // non-overflowing version of:
+        // uint32_t seq2 = seqNum | ((mHighestSeqNumber & 0xffff0000) + 0x10000);
+        uint32_t seq2 = seqNum | (((mHighestSeqNumber >> 16) + 1) << 16);
+
+        // non-underflowing version of:
+        // uint32_t seq2 = seqNum | ((mHighestSeqNumber & 0xffff0000) - 0x10000);
+        uint32_t seq3 = seqNum | ((((mHighestSeqNumber >> 16) | 0x10000) - 1) << 16);
+
+        uint32_t diff1 = AbsDiff(seq1, mHighestSeqNumber);
+        uint32_t diff2 = AbsDiff(seq2, mHighestSeqNumber);
+        uint32_t diff3 = AbsDiff(seq3, mHighestSeqNumber);
+
+        if (diff1 < diff2) {
+            if (diff1 < diff3) {
+                // diff1 < diff2 ^ diff1 < diff3
+                seqNum = seq1;
+            } else {
+                // diff3 <= diff1 < diff2
+                seqNum = seq3;
+            }
+        } else if (diff2 < diff3) {
+            // diff2 <= diff1 ^ diff2 < diff3
+            seqNum = seq2;
+        } else {
+            // diff3 <= diff2 <= diff1
+            seqNum = seq3;
+        }
+
+        if (seqNum > mHighestSeqNumber) {
+            mHighestSeqNumber = seqNum;
+        }
+
+        buffer->setInt32Data(seqNum);
     }
 
-    // Only the lower 16-bit of the sequence numbers are transmitted,
-    // derive the high-order bits by choosing the candidate closest
-    // to the highest sequence number (extended to 32 bits) received so far.
+    if (seqNum < mNextSeqNumber) {
+        if (mStarted || mHighestSeqNumber - seqNum >= kJitterBufferSize) {
+            ALOGV("Discarding late buffer");
+            return false;
+        }
 
-    uint32_t seq1 = seqNum | (mHighestSeqNumber & 0xffff0000);
+        // Nothing was released yet, it can still go first.
+        mNextSeqNumber = seqNum;
+    }
+
+    if (seqNum - mNextSeqNumber >= kJitterBufferSize) {
+        // Too far ahead to keep waiting for what's before it.
+        skipTo(seqNum - kJitterBufferSize + 1);
+    }
 
-    // non-overflowing version of:
-    // uint32_t seq2 = seqNum | ((mHighestSeqNumber & 0xffff0000) + 0x10000);
-    uint32_t seq2 = seqNum | (((mHighestSeqNumber >> 16) + 1) << 16);
+    sp<ABuffer> *slot = &mJitterBuffer[seqNum % kJitterBufferSize];
+    if (*slot != NULL) {
+        ALOGW("Discarding duplicate buffer");
+        return false;
+    }
+    *slot = buffer;
+
+    if (mGapStartUs >= 0 && seqNum == mGapSeqNumber) {
+        int64_t delayUs = 2 * (nowUs - mGapStartUs);
+        if (delayUs > mJitterDelayUs) {
+            mJitterDelayUs =
+                delayUs < kMaxJitterDelayUs ? delayUs : kMaxJitterDelayUs;
+            ALOGV("jitter delay now %lld us", (long long)mJitterDelayUs);
+        }
+    }
 
-    // non-underflowing version of:
-    // uint32_t seq2 = seqNum | ((mHighestSeqNumber & 0xffff0000) - 0x10000);
-    uint32_t seq3 = seqNum | ((((mHighestSeqNumber >> 16) | 0x10000) - 1) << 16);
+    if (!mStarted) {
+        if (mNumBuffersReceived < kNumStartupPackets
+                && nowUs - mFirstPacketUs < mJitterDelayUs) {
+            return false;
+        }
+        mStarted = true;
+    }
 
-    uint32_t diff1 = AbsDiff(seq1, mHighestSeqNumber);
-    uint32_t diff2 = AbsDiff(seq2, mHighestSeqNumber);
-    uint32_t diff3 = AbsDiff(seq3, mHighestSeqNumber);
+    size_t numDequeued = dequeueReadyPackets();
 
-    if (diff1 < diff2) {
-        if (diff1 < diff3) {
-            // diff1 < diff2 ^ diff1 < diff3
-            seqNum = seq1;
+    if (mNextSeqNumber > mHighestSeqNumber) {
+        mGapStartUs = -1;
+    } else if (mGapStartUs < 0 || mGapSeqNumber != mNextSeqNumber) {
+        mGapSeqNumber = mNextSeqNumber;
+        mGapStartUs = nowUs;
+    } else if (nowUs - mGapStartUs >= mJitterDelayUs) {
+        ALOGV("giving up on packet %u", mNextSeqNumber);
+
+        // There's a packet after the gap, so this ends.
+        while (mJitterBuffer[mNextSeqNumber % kJitterBufferSize] == NULL) {
+            ++mNextSeqNumber;
+            ++mNumPacketsLost;
+        }
+        numDequeued += dequeueReadyPackets();
+
+        mJitterDelayUs -= mJitterDelayUs / 8;
+        if (mJitterDelayUs < kMinJitterDelayUs) {
+            mJitterDelayUs = kMinJitterDelayUs;
+        }
+
+        if (mNextSeqNumber > mHighestSeqNumber) {
+            mGapStartUs = -1;
         } else {
-            // diff3 <= diff1 < diff2
-            seqNum = seq3;
+            mGapSeqNumber = mNextSeqNumber;
+            mGapStartUs = nowUs;
         }
-    } else if (diff2 < diff3) {
-        // diff2 <= diff1 ^ diff2 < diff3
-        seqNum = seq2;
-    } else {
-        // diff3 <= diff2 <= diff1
-        seqNum = seq3;
     }
 
-    if (seqNum > mHighestSeqNumber) {
-        mHighestSeqNumber = seqNum;
-    }
+    return numDequeued > 0;
+}
 
-    buffer->setInt32Data(seqNum);
+size_t ARTPSource::dequeueReadyPackets() {
+    size_t n = 0;
+    for (;;) {
+        sp<ABuffer> *slot = &mJitterBuffer[mNextSeqNumber % kJitterBufferSize];
+        if (*slot == NULL) {
+            break;
+        }
 
-    List<sp<ABuffer> >::iterator it = mQueue.begin();
-    while (it != mQueue.end() && (uint32_t)(*it)->int32Data() < seqNum) {
-        ++it;
+        mQueue.push_back(*slot);
+        slot->clear();
+        ++mNextSeqNumber;
+        ++n;
     }
+    return n;
+}
 
-    if (it != mQueue.end() && (uint32_t)(*it)->int32Data() == seqNum) {
-        ALOGW("Discarding duplicate buffer");
-        return false;
+void ARTPSource::skipTo(uint32_t seqNum) {
+    // Everything in the jitter buffer is within kJitterBufferSize of
+    // mNextSeqNumber.
+    uint32_t n = seqNum - mNextSeqNumber;
+    if (n > kJitterBufferSize) {
+        n = kJitterBufferSize;
     }
 
-    mQueue.insert(it, buffer);
+    for (uint32_t i = 0; i < n; ++i) {
+        sp<ABuffer> *slot =
+            &mJitterBuffer[(mNextSeqNumber + i) % kJitterBufferSize];
+        if (*slot != NULL) {
+            mQueue.push_back(*slot);
+            slot->clear();
+        } else {
+            ++mNumPacketsLost;
+        }
+    }
 
-    return true;
+    mNextSeqNumber = seqNum;
+    mGapStartUs = -1;
+    mStarted = true;
 }
 
 void ARTPSource::byeReceived() {
+    // Nothing else is coming, don't wait for what's missing.
+    if (mNumBuffersReceived > 0 && mNextSeqNumber <= mHighestSeqNumber) {
+        skipTo(mHighestSeqNumber);
+        dequeueReadyPackets();
+        mAssembler->onPacketReceived(this);
+    }
+
     mAssembler->onByeReceived();
 }
 
@@ -244,9 +361,10 @@ void ARTPSource::addReceiverReport(const sp<ABuffer> &buffer) {
 
     data[12] = 0x00;  // fraction lost
 
-    data[13] = 0x00;  // cumulative lost
-    data[14] = 0x00;
-    data[15] = 0x00;
+    uint32_t numLost = mNumPacketsLost < 0x7fffff ? mNumPacketsLost : 0x7fffff;
+    data[13] = (numLost >> 16) & 0xff;  // cumulative lost
+    data[14] = (numLost >> 8) & 0xff;
+    data[15] = numLost & 0xff;
 
     data[16] = mHighestSeqNumber >> 24;
     data[17] = (mHighestSeqNumber >> 16) & 0xff;
@@ -47,11 +47,40 @@ struct ARTPSource : public RefBase {
     void addFIR(const sp<ABuffer> &buffer);
 
 private:
+    enum {
+        // Packets received ahead of one that's missing wait in a ring of
+        // kJitterBufferSize slots, indexed by sequence number.
+        kJitterBufferSize = 1024,
+
+        // Nothing is released until this many packets are in, or the
+        // jitter delay has passed since the first one, so that a packet
+        // that belongs before the first to arrive isn't dropped as late.
+        kNumStartupPackets = 4,
+    };
+
+    // How long to wait for a missing packet. This is twice the longest a
+    // packet that eventually arrived has been waited for, and shrinks as
+    // waits end with the packet lost.
+    static const int64_t kMinJitterDelayUs;
+    static const int64_t kMaxJitterDelayUs;
+
     uint32_t mID;
     uint32_t mHighestSeqNumber;
     int32_t mNumBuffersReceived;
 
+    // Packets in sequence number order, with gaps only where packets were
+    // given up on, for the assembler.
     List<sp<ABuffer> > mQueue;
+
+    sp<ABuffer> mJitterBuffer[kJitterBufferSize];
+    uint32_t mNextSeqNumber;
+    uint32_t mGapSeqNumber;
+    int64_t mGapStartUs;
+    int64_t mJitterDelayUs;
+    uint32_t mNumPacketsLost;
+    bool mStarted;
+    int64_t mFirstPacketUs;
+
     sp<ARTPAssembler> mAssembler;
 
     uint64_t mLastNTPTime;
@@ -65,6 +94,14 @@ private:
 
     bool queuePacket(const sp<ABuffer> &buffer);
 
+    // Moves the packets from mNextSeqNumber on to mQueue, up to the first
+    // missing one. Returns how many were moved.
+    size_t dequeueReadyPackets();
+
+    // Moves what's in the jitter buffer before seqNum to mQueue, counting
+    // what isn't as lost.
+    void skipTo(uint32_t seqNum);
+
     DISALLOW_EVIL_CONSTRUCTORS(ARTPSource);
 };
 
@@ -68,3 +68,33 @@ LOCAL_MODULE:= rtp_test
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 
 # include $(BUILD_EXECUTABLE)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	tests/RTPReceiveBench.cpp \
+	UDPPusher.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright liblog libutils libstagefright_foundation libmedia
+
+LOCAL_STATIC_LIBRARIES := \
+	libstagefright_rtsp
+
+LOCAL_C_INCLUDES := \
+	frameworks/av/media/libstagefright \
+	$(TOP)/frameworks/native/include/media/openmax
+
+LOCAL_CFLAGS += -Wno-multichar -Werror -Wall
+LOCAL_CLANG := true
+LOCAL_SANITIZE := signed-integer-overflow
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_MODULE:= rtp_receive_bench
+
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the RTP receive path. H.264 access units are packetized into FU-A
+// fragments and written to a capture in the format UDPPusher replays (and
+// rtp_test plays), with some packets swapped or left out. UDPPusher then
+// sends the capture over loopback to an ARTPConnection stream, and the time
+// from the last packet of each access unit being sent to the access unit
+// being assembled is reported.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <utils/ByteOrder.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "ARTPConnection.h"
+#include "ASessionDescription.h"
+#include "UDPPusher.h"
+
+using namespace android;
+
+// The SSRC UDPPusher sends its BYE for.
+static const uint32_t kSSRC = 0x8f49c0d0;
+
+static const size_t kMaxPayloadSize = 1400;
+
+static const char *kSDP =
+    "v=0\r\n"
+    "o=- 64 233572944 IN IP4 127.0.0.0\r\n"
+    "s=QuickTime\r\n"
+    "t=0 0\r\n"
+    "a=range:npt=now-\r\n"
+    "m=video 5434 RTP/AVP 96\r\n"
+    "c=IN IP4 127.0.0.1\r\n"
+    "b=AS:320000\r\n"
+    "a=rtpmap:96 H264/90000\r\n"
+    "a=fmtp:96 packetization-mode=1;profile-level-id=42001E;"
+      "sprop-parameter-sets=Z0IAHpZUBaHogA==,aM44gA==\r\n"
+    "a=cliprect:0,0,480,270\r\n"
+    "a=framesize:96 720-480\r\n";
+
+struct Options {
+    size_t mNumFrames;
+    int32_t mFrameRate;
+    size_t mFrameSize;
+    int mReorderPercent;
+    int mLossPercent;
+};
+
+struct Packet {
+    uint32_t mTimeMs;
+    sp<ABuffer> mData;
+};
+
+static sp<ABuffer> makePacket(
+        uint16_t seqNum, uint32_t rtpTime, bool marker, size_t payloadSize) {
+    sp<ABuffer> packet = new ABuffer(12 + payloadSize);
+    uint8_t *data = packet->data();
+    data[0] = 0x80;
+    data[1] = (marker ? 0x80 : 0) | 96;
+    data[2] = seqNum >> 8;
+    data[3] = seqNum & 0xff;
+    data[4] = rtpTime >> 24;
+    data[5] = (rtpTime >> 16) & 0xff;
+    data[6] = (rtpTime >> 8) & 0xff;
+    data[7] = rtpTime & 0xff;
+    data[8] = kSSRC >> 24;
+    data[9] = (kSSRC >> 16) & 0xff;
+    data[10] = (kSSRC >> 8) & 0xff;
+    data[11] = kSSRC & 0xff;
+    return packet;
+}
+
+// Each access unit is a single IDR NAL unit of mFrameSize bytes, sent as
+// FU-A fragments, all of them at the frame's time. Sets lastTimeMs[i] to when
+// the last packet of frame i goes out.
+static void packetize(
+        const Options &options, Vector<Packet> *packets,
+        Vector<uint32_t> *lastTimeMs) {
+    uint16_t seqNum = 0;
+    for (size_t i = 0; i < options.mNumFrames; ++i) {
+        uint32_t timeMs = i * 1000 / options.mFrameRate;
+        uint32_t rtpTime = i * 90000 / options.mFrameRate;
+
+        size_t offset = 1;
+        while (offset < options.mFrameSize) {
+            size_t size = options.mFrameSize - offset;
+            if (size > kMaxPayloadSize) {
+                size = kMaxPayloadSize;
+            }
+            bool last = offset + size == options.mFrameSize;
+
+            Packet packet;
+            packet.mTimeMs = timeMs;
+            packet.mData = makePacket(seqNum++, rtpTime, last, 2 + size);
+
+            uint8_t *payload = packet.mData->data() + 12;
+            payload[0] = (3 << 5) | 28;  // FU-A
+            payload[1] = (offset == 1 ? 0x80 : 0) | (last ? 0x40 : 0) | 5;
+            for (size_t j = 0; j < size; ++j) {
+                payload[2 + j] = (offset + j) & 0xff;
+            }
+
+            packets->push(packet);
+            offset += size;
+        }
+
+        lastTimeMs->push(timeMs);
+    }
+
+    // Packets swap places with the next one, or go missing, but the times
+    // they're sent at stay in order.
+    for (size_t i = 0; i + 1 < packets->size(); ++i) {
+        if (rand() % 100 < options.mReorderPercent) {
+            sp<ABuffer> tmp = packets->itemAt(i).mData;
+            packets->editItemAt(i).mData = packets->itemAt(i + 1).mData;
+            packets->editItemAt(i + 1).mData = tmp;
+            ++i;
+        }
+    }
+    for (size_t i = 0; i < packets->size();) {
+        if (rand() % 100 < options.mLossPercent) {
+            packets->removeAt(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+static bool writeCapture(const char *path, const Vector<Packet> &packets) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < packets.size(); ++i) {
+        uint32_t timeMs = tolel(packets[i].mTimeMs);
+        uint32_t length = tolel((uint32_t)packets[i].mData->size());
+        ok = fwrite(&timeMs, sizeof(timeMs), 1, file) == 1
+            && fwrite(&length, sizeof(length), 1, file) == 1
+            && fwrite(packets[i].mData->data(),
+                      packets[i].mData->size(), 1, file) == 1;
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+struct Receiver : public AHandler {
+    enum {
+        kWhatNotify = 'noti',
+    };
+
+    Receiver(const Options &options, const Vector<uint32_t> &lastTimeMs)
+        : mOptions(options),
+          mLastTimeMs(lastTimeMs),
+          mStartTimeUs(0),
+          mEOS(false),
+          mNumDamaged(0),
+          mNumWrongSize(0) {
+    }
+
+    void start(int64_t startTimeUs) {
+        Mutex::Autolock autoLock(mLock);
+        mStartTimeUs = startTimeUs;
+    }
+
+    // Returns false if the stream didn't end within timeoutUs.
+    bool waitForEOS(int64_t timeoutUs) {
+        Mutex::Autolock autoLock(mLock);
+        int64_t untilUs = ALooper::GetNowUs() + timeoutUs;
+        while (!mEOS) {
+            int64_t nowUs = ALooper::GetNowUs();
+            if (nowUs >= untilUs) {
+                return false;
+            }
+            mCondition.waitRelative(mLock, (untilUs - nowUs) * 1000ll);
+        }
+        return true;
+    }
+
+    void report() {
+        Mutex::Autolock autoLock(mLock);
+
+        printf("%zu of %zu access units, %zu damaged, %zu wrong size\n",
+                mLatenciesUs.size(), mOptions.mNumFrames,
+                mNumDamaged, mNumWrongSize);
+        if (mLatenciesUs.empty()) {
+            return;
+        }
+
+        mLatenciesUs.sort(compareLatencies);
+        int64_t sumUs = 0;
+        for (size_t i = 0; i < mLatenciesUs.size(); ++i) {
+            sumUs += mLatenciesUs[i];
+        }
+        printf("latency ms: mean %.2f, median %.2f, 99%% %.2f, max %.2f\n",
+                sumUs / 1E3 / mLatenciesUs.size(),
+                mLatenciesUs[mLatenciesUs.size() / 2] / 1E3,
+                mLatenciesUs[mLatenciesUs.size() * 99 / 100] / 1E3,
+                mLatenciesUs[mLatenciesUs.size() - 1] / 1E3);
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        CHECK_EQ(msg->what(), (uint32_t)kWhatNotify);
+
+        Mutex::Autolock autoLock(mLock);
+
+        int32_t eos;
+        if (msg->findInt32("eos", &eos) && eos) {
+            mEOS = true;
+            mCondition.signal();
+            return;
+        }
+
+        sp<ABuffer> accessUnit;
+        if (!msg->findBuffer("access-unit", &accessUnit)) {
+            return;
+        }
+
+        uint32_t rtpTime;
+        CHECK(accessUnit->meta()->findInt32("rtp-time", (int32_t *)&rtpTime));
+        // Rounds up, to undo the truncation in packetize().
+        size_t index =
+            ((uint64_t)rtpTime * mOptions.mFrameRate + 89999) / 90000;
+        if (index >= mLastTimeMs.size()) {
+            return;
+        }
+
+        int32_t damaged;
+        if (accessUnit->meta()->findInt32("damaged", &damaged) && damaged) {
+            ++mNumDamaged;
+        } else if (accessUnit->size() != 4 + mOptions.mFrameSize) {
+            ++mNumWrongSize;
+        }
+
+        mLatenciesUs.push(ALooper::GetNowUs()
+                - (mStartTimeUs + mLastTimeMs[index] * 1000ll));
+    }
+
+private:
+    Options mOptions;
+    Vector<uint32_t> mLastTimeMs;
+
+    Mutex mLock;
+    Condition mCondition;
+    int64_t mStartTimeUs;
+    bool mEOS;
+    size_t mNumDamaged;
+    size_t mNumWrongSize;
+    Vector<int64_t> mLatenciesUs;
+
+    static int compareLatencies(const int64_t *a, const int64_t *b) {
+        return *a < *b ? -1 : *a > *b ? 1 : 0;
+    }
+};
+
+static void usage(const char *me) {
+    fprintf(stderr,
+            "usage: %s [-n frames] [-f frame rate] [-s frame KB]"
+            " [-r reorder %%] [-l loss %%] [-o capture]\n",
+            me);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    options.mNumFrames = 300;
+    options.mFrameRate = 30;
+    options.mFrameSize = 50 * 1024;
+    options.mReorderPercent = 0;
+    options.mLossPercent = 0;
+    const char *capturePath = "/data/local/tmp/rtp_receive_bench.dat";
+
+    int res;
+    while ((res = getopt(argc, argv, "n:f:s:r:l:o:")) >= 0) {
+        switch (res) {
+            case 'n':
+                options.mNumFrames = atoi(optarg);
+                break;
+            case 'f':
+                options.mFrameRate = atoi(optarg);
+                break;
+            case 's':
+                options.mFrameSize = atoi(optarg) * 1024;
+                break;
+            case 'r':
+                options.mReorderPercent = atoi(optarg);
+                break;
+            case 'l':
+                options.mLossPercent = atoi(optarg);
+                break;
+            case 'o':
+                capturePath = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (options.mNumFrames == 0 || options.mFrameRate <= 0
+            || options.mFrameRate > 1000 || options.mFrameSize <= 1) {
+        usage(argv[0]);
+    }
+
+    srand(1);
+    Vector<Packet> packets;
+    Vector<uint32_t> lastTimeMs;
+    packetize(options, &packets, &lastTimeMs);
+
+    if (!writeCapture(capturePath, packets)) {
+        fprintf(stderr, "can't write %s\n", capturePath);
+        return 1;
+    }
+
+    sp<ASessionDescription> desc = new ASessionDescription;
+    CHECK(desc->setTo(kSDP, strlen(kSDP)));
+
+    int rtpSocket, rtcpSocket;
+    unsigned rtpPort;
+    ARTPConnection::MakePortPair(&rtpSocket, &rtcpSocket, &rtpPort);
+
+    sp<ALooper> receiveLooper = new ALooper;
+    receiveLooper->setName("rtp receive");
+    sp<ALooper> pushLooper = new ALooper;
+    pushLooper->setName("rtp push");
+
+    sp<Receiver> receiver = new Receiver(options, lastTimeMs);
+    receiveLooper->registerHandler(receiver);
+    sp<ARTPConnection> connection = new ARTPConnection;
+    receiveLooper->registerHandler(connection);
+
+    sp<UDPPusher> pusher = new UDPPusher(capturePath, rtpPort);
+    pushLooper->registerHandler(pusher);
+
+    connection->addStream(
+            rtpSocket, rtcpSocket, desc, 1 /* index */,
+            new AMessage(Receiver::kWhatNotify, receiver),
+            false /* injected */);
+
+    receiveLooper->start();
+    pushLooper->start();
+
+    int64_t startUs = ALooper::GetNowUs();
+    receiver->start(startUs);
+    pusher->start();
+
+    int64_t durationUs = lastTimeMs[lastTimeMs.size() - 1] * 1000ll;
+    bool ended = receiver->waitForEOS(durationUs + 5000000ll);
+    double seconds = (ALooper::GetNowUs() - startUs) / 1E6;
+
+    printf("%zu frames of %zu KB at %d fps, %d%% reordered, %d%% lost\n",
+            options.mNumFrames, options.mFrameSize / 1024, options.mFrameRate,
+            options.mReorderPercent, options.mLossPercent);
+    printf("%zu packets in %.2f s, %.0f packets/s\n",
+            packets.size(), seconds, packets.size() / seconds);
+    receiver->report();
+
+    connection->removeStream(rtpSocket, rtcpSocket);
+    pushLooper->stop();
+    receiveLooper->stop();
+    close(rtpSocket);
+    close(rtcpSocket);
+
+    if (!ended) {
+        fprintf(stderr, "the stream didn't end\n");
+        return 1;
+    }
+    return 0;
+}
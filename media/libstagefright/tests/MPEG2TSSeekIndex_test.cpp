@@ -0,0 +1,281 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MPEG2TSSeekIndex_test"
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/String8.h>
+
+#include "mpeg2ts/MPEG2TSSeekIndex.h"
+
+namespace android {
+
+static const char *kTestDir = "/data/local/tmp/MPEG2TSSeekIndex_test";
+static const size_t kTSPacketSize = 188;
+
+// A transport stream of null packets: valid, but with nothing to index.
+struct NullPacketSource : public DataSource {
+    NullPacketSource(size_t numPackets) {
+        uint8_t packet[kTSPacketSize];
+        memset(packet, 0xff, sizeof(packet));
+        packet[0] = 0x47;
+        packet[1] = 0x1f;   // PID 0x1fff
+        packet[2] = 0xff;
+        packet[3] = 0x10;   // payload only
+        for (size_t i = 0; i < numPackets; ++i) {
+            mData.append((const char *)packet, sizeof(packet));
+        }
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset < 0 || offset >= (off64_t)mData.size()) {
+            return 0;
+        }
+        if (size > mData.size() - offset) {
+            size = mData.size() - offset;
+        }
+        memcpy(data, mData.c_str() + offset, size);
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mData.size();
+        return OK;
+    }
+
+private:
+    AString mData;
+};
+
+class MPEG2TSSeekIndexTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        ASSERT_TRUE(mkdir(kTestDir, 0700) == 0 || errno == EEXIST);
+        clearTestDir();
+    }
+
+    virtual void TearDown() {
+        clearTestDir();
+        rmdir(kTestDir);
+    }
+
+    static String8 testPath(const char *name) {
+        return String8::format("%s/%s", kTestDir, name);
+    }
+
+    static size_t countTestFiles() {
+        size_t count = 0;
+        DIR *dir = opendir(kTestDir);
+        if (dir != NULL) {
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] != '.') {
+                    ++count;
+                }
+            }
+            closedir(dir);
+        }
+        return count;
+    }
+
+    static Vector<MPEG2TSSeekIndex::Entry> makeEntries(size_t count) {
+        Vector<MPEG2TSSeekIndex::Entry> entries;
+        for (size_t i = 0; i < count; ++i) {
+            MPEG2TSSeekIndex::Entry entry;
+            entry.mTimeUs = i * 500000ll;
+            entry.mOffset = i * 100 * kTSPacketSize;
+            entries.push(entry);
+        }
+        return entries;
+    }
+
+private:
+    static void clearTestDir() {
+        DIR *dir = opendir(kTestDir);
+        if (dir == NULL) {
+            return;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') {
+                unlink(testPath(entry->d_name).string());
+            }
+        }
+        closedir(dir);
+    }
+};
+
+TEST_F(MPEG2TSSeekIndexTest, CacheFileRoundTrip) {
+    const off64_t fileSize = 1000 * kTSPacketSize;
+    Vector<MPEG2TSSeekIndex::Entry> written = makeEntries(10);
+    String8 path = testPath("a.idx");
+    ASSERT_TRUE(MPEG2TSSeekIndex::WriteCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, written, 4500000ll));
+
+    Vector<MPEG2TSSeekIndex::Entry> read;
+    int64_t durationUs;
+    ASSERT_TRUE(MPEG2TSSeekIndex::ReadCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, &read, &durationUs));
+    EXPECT_EQ(4500000ll, durationUs);
+    ASSERT_EQ(written.size(), read.size());
+    for (size_t i = 0; i < read.size(); ++i) {
+        EXPECT_EQ(written[i].mTimeUs, read[i].mTimeUs);
+        EXPECT_EQ(written[i].mOffset, read[i].mOffset);
+    }
+
+    // Only the file itself is left; the temporary one was renamed.
+    EXPECT_EQ(1u, countTestFiles());
+}
+
+TEST_F(MPEG2TSSeekIndexTest, RejectsMismatchedCacheFile) {
+    const off64_t fileSize = 1000 * kTSPacketSize;
+    String8 path = testPath("a.idx");
+    Vector<MPEG2TSSeekIndex::Entry> read;
+    int64_t durationUs;
+
+    ASSERT_TRUE(MPEG2TSSeekIndex::WriteCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, makeEntries(10), 0));
+    EXPECT_FALSE(MPEG2TSSeekIndex::ReadCacheFile(
+            path.string(), fileSize + kTSPacketSize, ATSParser::VIDEO, &read, &durationUs));
+    EXPECT_FALSE(MPEG2TSSeekIndex::ReadCacheFile(
+            path.string(), fileSize, ATSParser::AUDIO, &read, &durationUs));
+
+    // Truncated
+    ASSERT_EQ(0, truncate(path.string(), 40));
+    EXPECT_FALSE(MPEG2TSSeekIndex::ReadCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, &read, &durationUs));
+
+    // An entry past the end of the file
+    Vector<MPEG2TSSeekIndex::Entry> entries = makeEntries(10);
+    entries.editItemAt(9).mOffset = fileSize;
+    ASSERT_TRUE(MPEG2TSSeekIndex::WriteCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, entries, 0));
+    EXPECT_FALSE(MPEG2TSSeekIndex::ReadCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, &read, &durationUs));
+
+    // Entries out of file order
+    entries = makeEntries(10);
+    entries.editItemAt(5).mOffset = 0;
+    ASSERT_TRUE(MPEG2TSSeekIndex::WriteCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, entries, 0));
+    EXPECT_FALSE(MPEG2TSSeekIndex::ReadCacheFile(
+            path.string(), fileSize, ATSParser::VIDEO, &read, &durationUs));
+    EXPECT_TRUE(read.isEmpty());
+
+    EXPECT_FALSE(MPEG2TSSeekIndex::ReadCacheFile(
+            testPath("missing.idx").string(), fileSize, ATSParser::VIDEO,
+            &read, &durationUs));
+}
+
+TEST_F(MPEG2TSSeekIndexTest, TrimEvictsLeastRecentlyUsed) {
+    const off64_t fileSize = 1000 * kTSPacketSize;
+    const char *names[] = { "old.idx", "new.idx", "newest.idx" };
+    off64_t indexSize = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        String8 path = testPath(names[i]);
+        ASSERT_TRUE(MPEG2TSSeekIndex::WriteCacheFile(
+                path.string(), fileSize, ATSParser::VIDEO, makeEntries(10), 0));
+
+        struct timeval times[2];
+        times[0].tv_sec = times[1].tv_sec = 1000000 + i * 10;
+        times[0].tv_usec = times[1].tv_usec = 0;
+        ASSERT_EQ(0, utimes(path.string(), times));
+
+        struct stat st;
+        ASSERT_EQ(0, stat(path.string(), &st));
+        indexSize = st.st_size;
+    }
+
+    // Other files are left alone, whatever their size.
+    FILE *other = fopen(testPath("other").string(), "w");
+    ASSERT_TRUE(other != NULL);
+    fclose(other);
+
+    MPEG2TSSeekIndex::TrimCache(kTestDir, 3 * indexSize);
+    EXPECT_EQ(4u, countTestFiles());
+
+    MPEG2TSSeekIndex::TrimCache(kTestDir, 2 * indexSize);
+    EXPECT_EQ(3u, countTestFiles());
+    EXPECT_NE(0, access(testPath("old.idx").string(), F_OK));
+    EXPECT_EQ(0, access(testPath("new.idx").string(), F_OK));
+    EXPECT_EQ(0, access(testPath("newest.idx").string(), F_OK));
+    EXPECT_EQ(0, access(testPath("other").string(), F_OK));
+}
+
+TEST_F(MPEG2TSSeekIndexTest, SavesAndLoadsIndex) {
+    sp<DataSource> source = new NullPacketSource(1400);
+
+    sp<MPEG2TSSeekIndex> index =
+        new MPEG2TSSeekIndex(source, ATSParser::VIDEO, kTestDir);
+    ASSERT_EQ(OK, index->start());
+    // stop() waits for the indexing thread, which is done with a file this
+    // small long before it would notice.
+    for (int i = 0; i < 500 && !index->isComplete(); ++i) {
+        usleep(10000);
+    }
+    index->stop();
+    ASSERT_TRUE(index->isComplete());
+
+    MPEG2TSSeekIndex::Stats stats;
+    index->getStats(&stats);
+    EXPECT_FALSE(stats.mLoadedFromCache);
+    EXPECT_EQ(0u, stats.mNumEntries);
+    EXPECT_EQ(1u, countTestFiles());
+
+    index = new MPEG2TSSeekIndex(source, ATSParser::VIDEO, kTestDir);
+    ASSERT_EQ(OK, index->start());
+    EXPECT_TRUE(index->isComplete());
+    index->getStats(&stats);
+    EXPECT_TRUE(stats.mLoadedFromCache);
+    index->stop();
+
+    // The audio track of the same file has an index of its own.
+    index = new MPEG2TSSeekIndex(source, ATSParser::AUDIO, kTestDir);
+    ASSERT_EQ(OK, index->start());
+    index->stop();
+    index->getStats(&stats);
+    EXPECT_FALSE(stats.mLoadedFromCache);
+}
+
+TEST_F(MPEG2TSSeekIndexTest, DoesNotIndexWithoutWritableCache) {
+    FILE *file = fopen(testPath("file").string(), "w");
+    ASSERT_TRUE(file != NULL);
+    fclose(file);
+
+    // A directory can't be created under a regular file.
+    String8 cacheDir = testPath("file/cache");
+    sp<MPEG2TSSeekIndex> index = new MPEG2TSSeekIndex(
+            new NullPacketSource(1400), ATSParser::VIDEO, cacheDir.string());
+    EXPECT_NE(OK, index->start());
+    EXPECT_FALSE(index->isComplete());
+}
+
+}  // namespace android
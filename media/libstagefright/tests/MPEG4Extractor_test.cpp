@@ -0,0 +1,285 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MPEG4Extractor_test"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/foundation/AString.h>
+
+#include "include/MPEG4Extractor.h"
+
+namespace android {
+
+static const size_t kNumFrames = 10;
+static const size_t kFrameSize = 32;     // one AMR-NB 12.2 kbps frame
+static const uint32_t kFrameDuration = 160;  // 20 ms at 8 kHz
+
+struct BufferSource : public DataSource {
+    BufferSource(const AString &data) : mData(data) {}
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset < 0 || offset >= (off64_t)mData.size()) {
+            return 0;
+        }
+        if (size > mData.size() - offset) {
+            size = mData.size() - offset;
+        }
+        memcpy(data, mData.c_str() + offset, size);
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mData.size();
+        return OK;
+    }
+
+private:
+    AString mData;
+};
+
+static void appendU16(AString *out, uint16_t x) {
+    char data[2] = { (char)(x >> 8), (char)x };
+    out->append(data, sizeof(data));
+}
+
+static void appendU32(AString *out, uint32_t x) {
+    appendU16(out, x >> 16);
+    appendU16(out, x);
+}
+
+static void appendZeros(AString *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out->append('\0');
+    }
+}
+
+static void appendBox(AString *out, const char *type, const AString &payload) {
+    appendU32(out, 8 + payload.size());
+    out->append(type, 4);
+    out->append(payload);
+}
+
+// A single-track AMR-NB file, laid out the way a recorder writes it: the
+// moov box followed by kNumFrames frames in one chunk. The second half of
+// the track starts at a sync sample.
+static AString makeFile(bool withTimeToSample) {
+    AString ftyp;
+    ftyp.append("3gp4", 4);
+    appendU32(&ftyp, 0);
+    ftyp.append("isom3gp4", 8);
+
+    AString file;
+    off64_t chunkOffset = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        AString mvhd;
+        appendU32(&mvhd, 0);        // version, flags
+        appendU32(&mvhd, 0);        // creation time
+        appendU32(&mvhd, 0);        // modification time
+        appendU32(&mvhd, 1000);     // timescale
+        appendU32(&mvhd, 200);      // duration
+        appendU32(&mvhd, 0x10000);  // rate
+        appendU16(&mvhd, 0x100);    // volume
+        appendZeros(&mvhd, 10 + 36 + 24);
+        appendU32(&mvhd, 2);        // next track ID
+
+        AString tkhd;
+        appendU32(&tkhd, 7);        // version 0, enabled | in movie | in preview
+        appendZeros(&tkhd, 8);
+        appendU32(&tkhd, 1);        // track ID
+        appendU32(&tkhd, 0);
+        appendU32(&tkhd, 200);      // duration
+        appendZeros(&tkhd, 8 + 2 + 2);
+        appendU16(&tkhd, 0x100);    // volume
+        appendU16(&tkhd, 0);
+        static const uint32_t kIdentity[9] =
+            { 0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000 };
+        for (size_t i = 0; i < 9; ++i) {
+            appendU32(&tkhd, kIdentity[i]);
+        }
+        appendZeros(&tkhd, 8);      // width, height
+
+        AString mdhd;
+        appendU32(&mdhd, 0);
+        appendZeros(&mdhd, 8);
+        appendU32(&mdhd, 8000);     // timescale
+        appendU32(&mdhd, kNumFrames * kFrameDuration);
+        appendU16(&mdhd, 0x55c4);   // "und"
+        appendU16(&mdhd, 0);
+
+        AString hdlr;
+        appendZeros(&hdlr, 8);
+        hdlr.append("soun", 4);
+        appendZeros(&hdlr, 12 + 1);
+
+        AString samr;
+        appendZeros(&samr, 6);
+        appendU16(&samr, 1);        // data reference index
+        appendZeros(&samr, 8);
+        appendU16(&samr, 1);        // channels
+        appendU16(&samr, 16);       // sample size
+        appendZeros(&samr, 4);
+        appendU32(&samr, 8000 << 16);
+
+        AString stsd;
+        appendU32(&stsd, 0);
+        appendU32(&stsd, 1);
+        appendBox(&stsd, "samr", samr);
+
+        AString stts;
+        appendU32(&stts, 0);
+        appendU32(&stts, 1);
+        appendU32(&stts, kNumFrames);
+        appendU32(&stts, kFrameDuration);
+
+        AString stsc;
+        appendU32(&stsc, 0);
+        appendU32(&stsc, 1);
+        appendU32(&stsc, 1);        // first chunk
+        appendU32(&stsc, kNumFrames);
+        appendU32(&stsc, 1);        // sample description index
+
+        AString stsz;
+        appendU32(&stsz, 0);
+        appendU32(&stsz, kFrameSize);
+        appendU32(&stsz, kNumFrames);
+
+        AString stco;
+        appendU32(&stco, 0);
+        appendU32(&stco, 1);
+        appendU32(&stco, chunkOffset);
+
+        AString stss;
+        appendU32(&stss, 0);
+        appendU32(&stss, 2);
+        appendU32(&stss, 1);
+        appendU32(&stss, kNumFrames / 2 + 1);
+
+        AString stbl;
+        appendBox(&stbl, "stsd", stsd);
+        if (withTimeToSample) {
+            appendBox(&stbl, "stts", stts);
+        }
+        appendBox(&stbl, "stsc", stsc);
+        appendBox(&stbl, "stsz", stsz);
+        appendBox(&stbl, "stco", stco);
+        appendBox(&stbl, "stss", stss);
+
+        AString minf;
+        appendBox(&minf, "stbl", stbl);
+
+        AString mdia;
+        appendBox(&mdia, "mdhd", mdhd);
+        appendBox(&mdia, "hdlr", hdlr);
+        appendBox(&mdia, "minf", minf);
+
+        AString trak;
+        appendBox(&trak, "tkhd", tkhd);
+        appendBox(&trak, "mdia", mdia);
+
+        AString moov;
+        appendBox(&moov, "mvhd", mvhd);
+        appendBox(&moov, "trak", trak);
+
+        file.clear();
+        appendBox(&file, "ftyp", ftyp);
+        appendBox(&file, "moov", moov);
+
+        // The frames start right after the mdat header.
+        chunkOffset = file.size() + 8;
+    }
+
+    AString mdat;
+    for (size_t i = 0; i < kNumFrames; ++i) {
+        char frame[kFrameSize];
+        memset(frame, i, sizeof(frame));
+        frame[0] = 0x3c;            // 12.2 kbps, good quality
+        mdat.append(frame, sizeof(frame));
+    }
+    appendBox(&file, "mdat", mdat);
+
+    return file;
+}
+
+TEST(MPEG4ExtractorTest, OpensAndReadsTrack) {
+    sp<MPEG4Extractor> extractor =
+        new MPEG4Extractor(new BufferSource(makeFile(true)));
+
+    ASSERT_EQ(1u, extractor->countTracks());
+
+    sp<MetaData> meta = extractor->getTrackMetaData(0);
+    ASSERT_TRUE(meta != NULL);
+    const char *mime;
+    ASSERT_TRUE(meta->findCString(kKeyMIMEType, &mime));
+    EXPECT_STREQ(MEDIA_MIMETYPE_AUDIO_AMR_NB, mime);
+    int64_t durationUs;
+    ASSERT_TRUE(meta->findInt64(kKeyDuration, &durationUs));
+    EXPECT_EQ(200000ll, durationUs);
+
+    sp<IMediaSource> source = extractor->getTrack(0);
+    ASSERT_TRUE(source != NULL);
+    ASSERT_EQ(OK, source->start());
+
+    for (size_t i = 0; i < kNumFrames; ++i) {
+        MediaBuffer *buffer;
+        ASSERT_EQ(OK, source->read(&buffer));
+
+        int64_t timeUs;
+        ASSERT_TRUE(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+        EXPECT_EQ((int64_t)i * 20000, timeUs);
+        ASSERT_EQ(kFrameSize, buffer->range_length());
+        const uint8_t *data =
+            (const uint8_t *)buffer->data() + buffer->range_offset();
+        EXPECT_EQ(0x3c, data[0]);
+        EXPECT_EQ(i, data[1]);
+        buffer->release();
+    }
+
+    MediaBuffer *buffer;
+    EXPECT_EQ(ERROR_END_OF_STREAM, source->read(&buffer));
+
+    // The sync sample table is read when the track is instantiated.
+    MediaSource::ReadOptions options;
+    options.setSeekTo(130000, MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC);
+    ASSERT_EQ(OK, source->read(&buffer, &options));
+    int64_t timeUs;
+    ASSERT_TRUE(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+    EXPECT_EQ(100000ll, timeUs);
+    buffer->release();
+
+    EXPECT_EQ(OK, source->stop());
+}
+
+TEST(MPEG4ExtractorTest, RejectsTrackWithoutTimeToSample) {
+    sp<MPEG4Extractor> extractor =
+        new MPEG4Extractor(new BufferSource(makeFile(false)));
+
+    EXPECT_EQ(0u, extractor->countTracks());
+}
+
+}  // namespace android
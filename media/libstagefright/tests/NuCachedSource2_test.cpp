@@ -0,0 +1,172 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "NuCachedSource2_test"
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+
+#include "include/NuCachedSource2.h"
+
+namespace android {
+
+static uint8_t byteAt(off64_t offset) {
+    return (offset % 251) ^ ((offset >> 16) & 0xff);
+}
+
+// size bytes of local data, byteAt() each.
+struct PatternSource : public DataSource {
+    PatternSource(off64_t size) : mSize(size) {}
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset >= mSize) {
+            return 0;
+        }
+        if ((off64_t)size > mSize - offset) {
+            size = mSize - offset;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            ((uint8_t *)data)[i] = byteAt(offset + i);
+        }
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mSize;
+        return OK;
+    }
+
+private:
+    off64_t mSize;
+};
+
+class NuCachedSource2Test : public ::testing::Test {
+protected:
+    sp<NuCachedSource2> createSource(off64_t size) {
+        return NuCachedSource2::Create(new PatternSource(size));
+    }
+
+    // Reads size bytes at offset and checks them.
+    bool read(const sp<NuCachedSource2> &source, off64_t offset, size_t size) {
+        uint8_t *buffer = new uint8_t[size];
+        bool ok = source->readAt(offset, buffer, size) == (ssize_t)size;
+        for (size_t i = 0; ok && i < size; ++i) {
+            ok = buffer[i] == byteAt(offset + i);
+        }
+        delete[] buffer;
+        return ok;
+    }
+};
+
+static const size_t kKB = 1024;
+static const size_t kMB = 1024 * 1024;
+
+TEST_F(NuCachedSource2Test, FastSourceGrowsReadSize) {
+    // 64 KB in 1 ms: reads double each time, up to 1 MB.
+    size_t readSize = 64 * kKB;
+    static const size_t kExpected[] = {
+        128 * kKB, 256 * kKB, 512 * kKB, 1 * kMB, 1 * kMB };
+    for (size_t i = 0; i < sizeof(kExpected) / sizeof(kExpected[0]); ++i) {
+        readSize = NuCachedSource2::ComputeReadSize(
+                readSize, 5 * kMB, readSize, readSize / (64 * kKB) * 1000);
+        EXPECT_EQ(kExpected[i], readSize);
+    }
+
+    // Never more than a quarter of a small cache.
+    EXPECT_EQ(256 * kKB, NuCachedSource2::ComputeReadSize(
+            256 * kKB, 256 * kKB, 256 * kKB, 1000));
+
+    // A read that took no measurable time.
+    EXPECT_EQ(128 * kKB, NuCachedSource2::ComputeReadSize(
+            64 * kKB, 5 * kMB, 64 * kKB, 0));
+}
+
+TEST_F(NuCachedSource2Test, SlowSourceKeepsReadsSmall) {
+    // 400 KB/s: a 64 KB read takes 160 ms, close to the 200 ms target.
+    EXPECT_EQ(64 * kKB, NuCachedSource2::ComputeReadSize(
+            64 * kKB, 5 * kMB, 64 * kKB, 160000));
+
+    // Reads shrink at once when the source slows down: 1 MB in a second
+    // leaves room for 200 KB.
+    EXPECT_EQ(128 * kKB, NuCachedSource2::ComputeReadSize(
+            1 * kMB, 5 * kMB, 1 * kMB, 1000000));
+}
+
+TEST_F(NuCachedSource2Test, SequentialReads) {
+    static const off64_t kSize = 16 * kMB;
+    sp<NuCachedSource2> source = createSource(kSize);
+
+    for (off64_t offset = 0; offset < kSize; offset += 32768) {
+        ASSERT_TRUE(read(source, offset, 32768));
+    }
+
+    NuCachedSource2::Stats stats;
+    source->getStats(&stats);
+    EXPECT_EQ((uint64_t)kSize, stats.mBytesConsumed);
+    EXPECT_EQ((uint64_t)kSize, stats.mBytesFetched);
+    EXPECT_EQ(0u, stats.mBytesDiscarded);
+    EXPECT_EQ(0u, stats.mNumSeeks);
+    EXPECT_FALSE(stats.mRandomAccess);
+}
+
+TEST_F(NuCachedSource2Test, RandomAccessLimitsReadahead) {
+    static const off64_t kSize = 1024ll * kMB;
+    static const size_t kNumReads = 12;
+    sp<NuCachedSource2> source = createSource(kSize);
+
+    // Reads further apart than the cache holds, so that each one is a
+    // seek however far the prefetcher got.
+    NuCachedSource2::Stats stats;
+    uint64_t bytesFetched = 0;
+    for (size_t i = 0; i < kNumReads; ++i) {
+        off64_t offset = (off64_t)(i + 1) * 37 * kMB + 4096;
+        ASSERT_TRUE(read(source, offset, 16384));
+
+        source->getStats(&stats);
+        EXPECT_EQ(i + 1, stats.mNumSeeks);
+        if (i == 3) {
+            ASSERT_TRUE(stats.mRandomAccess);
+            bytesFetched = stats.mBytesFetched;
+        }
+    }
+
+    // Each read past the first few fetches a page and at most the readahead
+    // after it.
+    uint64_t bytesPerRead =
+        (stats.mBytesFetched - bytesFetched) / (kNumReads - 4);
+    EXPECT_LE(bytesPerRead, 1024u * 1024u);
+    EXPECT_TRUE(stats.mRandomAccess);
+    EXPECT_GT(stats.mBytesDiscarded, 0u);
+    EXPECT_EQ(65536u, stats.mReadSize);
+
+    // A long enough sequential run ends random access.
+    off64_t offset = 512ll * kMB;
+    for (size_t i = 0; i < 40; ++i) {
+        ASSERT_TRUE(read(source, offset, 32768));
+        offset += 32768;
+    }
+    source->getStats(&stats);
+    EXPECT_FALSE(stats.mRandomAccess);
+}
+
+}  // namespace android
@@ -83,3 +83,5 @@ LOCAL_CFLAGS += -Wall -Wextra -Werror
 LOCAL_MODULE:= libcameraservice
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -24,6 +24,8 @@
 #include <utils/Timers.h>
 #include <utils/List.h>
 
+#include <vector>
+
 #include "hardware/camera2.h"
 #include "hardware/camera3.h"
 #include "camera/CameraMetadata.h"
@@ -243,6 +245,22 @@ class CameraDeviceBase : public virtual RefBase {
      */
     virtual status_t getNextResult(CaptureResult *frame) = 0;
 
+    /**
+     * Get all capture results currently in the result queue at once, in
+     * order. The contents of frames are replaced; pass the same vector on
+     * every call so that its storage is reused. Returns NOT_ENOUGH_DATA if the
+     * queue is empty. Ownership of the metadata is as for getNextResult.
+     * May be called concurrently to most methods, except for waitForNextFrame.
+     */
+    virtual status_t getNextResults(std::vector<CaptureResult> *frames) = 0;
+
+    /**
+     * Hand consumed results back to the device, so that their metadata buffers
+     * can be reused for later results. frames is left empty, with its storage
+     * intact for the next getNextResults call.
+     */
+    virtual void     recycleResults(std::vector<CaptureResult> *frames) = 0;
+
     /**
      * Trigger auto-focus. The latest ID used in a trigger autofocus or cancel
      * autofocus call will be returned by the HAL in all subsequent AF
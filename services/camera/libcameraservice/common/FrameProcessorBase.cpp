@@ -121,32 +121,48 @@ bool FrameProcessorBase::threadLoop() {
 void FrameProcessorBase::processNewFrames(const sp<CameraDeviceBase> &device) {
     status_t res;
     ATRACE_CALL();
-    CaptureResult result;
 
     ALOGV("%s: Camera %d: Process new frames", __FUNCTION__, device->getId());
 
-    while ( (res = device->getNextResult(&result)) == OK) {
+    // Take everything queued so far in one go, instead of locking the
+    // device's result queue once per frame.
+    while ( (res = device->getNextResults(&mResults)) == OK) {
+        ssize_t lastFrame = -1;
 
-        // TODO: instead of getting frame number from metadata, we should read
-        // this from result.mResultExtras when CameraDeviceBase interface is fixed.
-        camera_metadata_entry_t entry;
+        for (size_t i = 0; i < mResults.size(); i++) {
+            CaptureResult &result = mResults[i];
 
-        entry = result.mMetadata.find(ANDROID_REQUEST_FRAME_COUNT);
-        if (entry.count == 0) {
-            ALOGE("%s: Camera %d: Error reading frame number",
-                    __FUNCTION__, device->getId());
-            break;
-        }
-        ATRACE_INT("cam2_frame", entry.data.i32[0]);
+            // TODO: instead of getting frame number from metadata, we should read
+            // this from result.mResultExtras when CameraDeviceBase interface is fixed.
+            camera_metadata_entry_t entry;
+
+            entry = result.mMetadata.find(ANDROID_REQUEST_FRAME_COUNT);
+            if (entry.count == 0) {
+                ALOGE("%s: Camera %d: Error reading frame number",
+                        __FUNCTION__, device->getId());
+                continue;
+            }
+            ATRACE_INT("cam2_frame", entry.data.i32[0]);
 
-        if (!processSingleFrame(result, device)) {
-            break;
+            if (!processSingleFrame(result, device)) {
+                continue;
+            }
+
+            if (!result.mMetadata.isEmpty()) {
+                lastFrame = i;
+            }
         }
 
-        if (!result.mMetadata.isEmpty()) {
+        // Keep the newest frame for dump(), and hand the one it replaces back
+        // to the device along with the rest of the batch.
+        if (lastFrame >= 0) {
             Mutex::Autolock al(mLastFrameMutex);
-            mLastFrame.acquire(result.mMetadata);
+            CameraMetadata previous;
+            previous.acquire(mLastFrame);
+            mLastFrame.acquire(mResults[lastFrame].mMetadata);
+            mResults[lastFrame].mMetadata.acquire(previous);
         }
+        device->recycleResults(&mResults);
     }
     if (res != NOT_ENOUGH_DATA) {
         ALOGE("%s: Camera %d: Error getting next frame: %s (%d)",
@@ -25,6 +25,8 @@
 #include <camera/CameraMetadata.h>
 #include <camera/CaptureResult.h>
 
+#include <vector>
+
 namespace android {
 
 class CameraDeviceBase;
@@ -83,6 +85,10 @@ class FrameProcessorBase: public Thread {
                               const sp<CameraDeviceBase> &device);
 
     CameraMetadata mLastFrame;
+
+    // Results fetched from the device in one batch; only used by the thread.
+    // Kept as a member so that its storage is reused across batches.
+    std::vector<CaptureResult> mResults;
 };
 
 
@@ -18,6 +18,8 @@
 #define LOG_TAG "Camera3-BufferManager"
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 
+#include <inttypes.h>
+
 #include <gui/ISurfaceComposer.h>
 #include <private/gui/ComposerService.h>
 #include <utils/Log.h>
@@ -77,50 +79,41 @@ status_t Camera3BufferManager::registerStream(wp<Camera3OutputStream>& stream,
         return INVALID_OPERATION;
     }
 
-    Mutex::Autolock l(mLock);
+    RWLock::AutoWLock l(mMapLock);
     if (mAllocator == NULL) {
         ALOGE("%s: allocator is NULL, buffer manager is bad state.", __FUNCTION__);
         return INVALID_OPERATION;
     }
 
-    // Check if this stream was registered with different stream set ID, if so, error out.
-    for (size_t i = 0; i < mStreamSetMap.size(); i++) {
-        ssize_t streamIdx = mStreamSetMap[i].streamInfoMap.indexOfKey(streamId);
-        if (streamIdx != NAME_NOT_FOUND &&
-            mStreamSetMap[i].streamInfoMap[streamIdx].streamSetId != streamInfo.streamSetId) {
+    // Check if this stream was registered already; it is illegal to do so with a different stream
+    // set ID.
+    ssize_t streamIdx = mStreamMap.indexOfKey(streamId);
+    if (streamIdx != NAME_NOT_FOUND) {
+        if (mStreamMap[streamIdx]->info.streamSetId != streamSetId) {
             ALOGE("%s: It is illegal to register the same stream id with different stream set",
                     __FUNCTION__);
             return BAD_VALUE;
         }
+        ALOGW("%s: stream %d was already registered with stream set %d",
+                __FUNCTION__, streamId, streamSetId);
+        return OK;
     }
     // Check if there is an existing stream set registered; if not, create one; otherwise, add this
-    // stream info to the existing stream set entry.
+    // stream to the existing stream set entry.
     ssize_t setIdx = mStreamSetMap.indexOfKey(streamSetId);
     if (setIdx == NAME_NOT_FOUND) {
         ALOGV("%s: stream set %d is not registered to stream set map yet, create it.",
                 __FUNCTION__, streamSetId);
-        // Create stream info map, then add to mStreamsetMap.
-        StreamSet newStreamSet;
-        setIdx = mStreamSetMap.add(streamSetId, newStreamSet);
+        setIdx = mStreamSetMap.add(streamSetId, new StreamSetState());
     }
-    // Update stream set map and water mark.
-    StreamSet& currentStreamSet = mStreamSetMap.editValueAt(setIdx);
-    ssize_t streamIdx = currentStreamSet.streamInfoMap.indexOfKey(streamId);
-    if (streamIdx != NAME_NOT_FOUND) {
-        ALOGW("%s: stream %d was already registered with stream set %d",
-                __FUNCTION__, streamId, streamSetId);
-        return OK;
-    }
-    currentStreamSet.streamInfoMap.add(streamId, streamInfo);
-    currentStreamSet.handoutBufferCountMap.add(streamId, 0);
-    currentStreamSet.attachedBufferCountMap.add(streamId, 0);
-    mStreamMap.add(streamId, stream);
+    const sp<StreamSetState>& currentStreamSet = mStreamSetMap.valueAt(setIdx);
+    sp<StreamState> state = new StreamState(stream, streamInfo);
+    currentStreamSet->streams.add(state);
+    mStreamMap.add(streamId, state);
 
     // The max allowed buffer count should be the max of buffer count of each stream inside a stream
     // set.
-    if (streamInfo.totalBufferCount > currentStreamSet.maxAllowedBufferCount) {
-       currentStreamSet.maxAllowedBufferCount = streamInfo.totalBufferCount;
-    }
+    atomicMax(currentStreamSet->maxAllowedBufferCount, streamInfo.totalBufferCount);
 
     return OK;
 }
@@ -128,7 +121,7 @@ status_t Camera3BufferManager::registerStream(wp<Camera3OutputStream>& stream,
 status_t Camera3BufferManager::unregisterStream(int streamId, int streamSetId) {
     ATRACE_CALL();
 
-    Mutex::Autolock l(mLock);
+    RWLock::AutoWLock l(mMapLock);
     ALOGV("%s: unregister stream %d with stream set %d", __FUNCTION__,
             streamId, streamSetId);
     if (mAllocator == NULL) {
@@ -136,39 +129,50 @@ status_t Camera3BufferManager::unregisterStream(int streamId, int streamSetId) {
         return INVALID_OPERATION;
     }
 
-    if (!checkIfStreamRegisteredLocked(streamId, streamSetId)){
+    ssize_t setIdx = mStreamSetMap.indexOfKey(streamSetId);
+    ssize_t streamIdx = mStreamMap.indexOfKey(streamId);
+    if (setIdx == NAME_NOT_FOUND || streamIdx == NAME_NOT_FOUND ||
+            mStreamMap[streamIdx]->info.streamSetId != streamSetId) {
         ALOGE("%s: stream %d with set id %d wasn't properly registered to this buffer manager!",
                 __FUNCTION__, streamId, streamSetId);
         return BAD_VALUE;
     }
 
-    // De-list all the buffers associated with this stream first.
-    StreamSet& currentSet = mStreamSetMap.editValueFor(streamSetId);
-    BufferList& freeBufs = currentSet.freeBuffers;
-    BufferCountMap& handOutBufferCounts = currentSet.handoutBufferCountMap;
-    BufferCountMap& attachedBufferCounts = currentSet.attachedBufferCountMap;
-    InfoMap& infoMap = currentSet.streamInfoMap;
-    removeBuffersFromBufferListLocked(freeBufs, streamId);
-    handOutBufferCounts.removeItem(streamId);
-    attachedBufferCounts.removeItem(streamId);
-
-    // Remove the stream info from info map and recalculate the buffer count water mark.
-    infoMap.removeItem(streamId);
-    currentSet.maxAllowedBufferCount = 0;
-    for (size_t i = 0; i < infoMap.size(); i++) {
-        if (infoMap[i].totalBufferCount > currentSet.maxAllowedBufferCount) {
-            currentSet.maxAllowedBufferCount = infoMap[i].totalBufferCount;
+    // De-list all the buffers associated with this stream first. They are dropped once the lock
+    // is released.
+    sp<StreamSetState> currentSet = mStreamSetMap.valueAt(setIdx);
+    sp<StreamState> state = mStreamMap.valueAt(streamIdx);
+    BufferList freeBufs;
+    {
+        Mutex::Autolock sl(state->lock);
+        state->registered = false;
+        currentSet->allocatedBufferCount -= state->freeBuffers.size() + state->attachedBufferCount;
+        freeBufs.swap(state->freeBuffers);
+        state->handoutBufferCount = 0;
+        state->attachedBufferCount = 0;
+    }
+
+    // Remove the stream from the set and recalculate the buffer count water mark.
+    StreamList& streams = currentSet->streams;
+    size_t maxAllowedBufferCount = 0;
+    for (size_t i = 0; i < streams.size(); ) {
+        if (streams[i] == state) {
+            streams.removeAt(i);
+            continue;
         }
+        maxAllowedBufferCount = std::max(maxAllowedBufferCount, streams[i]->info.totalBufferCount);
+        i++;
     }
-    mStreamMap.removeItem(streamId);
+    currentSet->maxAllowedBufferCount = maxAllowedBufferCount;
+    mStreamMap.removeItemsAt(streamIdx);
 
     // Lazy solution: when a stream is unregistered, the streams will be reconfigured, reset
     // the water mark and let it grow again.
-    currentSet.allocatedBufferWaterMark = 0;
+    currentSet->allocatedBufferWaterMark = 0;
 
     // Remove this stream set if all its streams have been removed.
-    if (freeBufs.size() == 0 && handOutBufferCounts.size() == 0 && infoMap.size() == 0) {
-        mStreamSetMap.removeItem(streamSetId);
+    if (streams.isEmpty()) {
+        mStreamSetMap.removeItemsAt(setIdx);
     }
 
     return OK;
@@ -178,7 +182,7 @@ status_t Camera3BufferManager::getBufferForStream(int streamId, int streamSetId,
         sp<GraphicBuffer>* gb, int* fenceFd) {
     ATRACE_CALL();
 
-    Mutex::Autolock l(mLock);
+    nsecs_t startTime = systemTime();
     ALOGV("%s: get buffer for stream %d with stream set %d", __FUNCTION__,
             streamId, streamSetId);
     if (mAllocator == NULL) {
@@ -186,147 +190,105 @@ status_t Camera3BufferManager::getBufferForStream(int streamId, int streamSetId,
         return INVALID_OPERATION;
     }
 
-    if (!checkIfStreamRegisteredLocked(streamId, streamSetId)) {
+    sp<StreamState> state;
+    sp<StreamSetState> streamSet;
+    StreamList streams;
+    if (lookUpStream(streamId, streamSetId, &state, &streamSet, &streams) != OK) {
         ALOGE("%s: stream %d is not registered with stream set %d yet!!!",
                 __FUNCTION__, streamId, streamSetId);
         return BAD_VALUE;
     }
 
-    StreamSet &streamSet = mStreamSetMap.editValueFor(streamSetId);
-    BufferCountMap& handOutBufferCounts = streamSet.handoutBufferCountMap;
-    size_t& bufferCount = handOutBufferCounts.editValueFor(streamId);
-    if (bufferCount >= streamSet.maxAllowedBufferCount) {
-        ALOGE("%s: bufferCount (%zu) exceeds the max allowed buffer count (%zu) of this stream set",
-                __FUNCTION__, bufferCount, streamSet.maxAllowedBufferCount);
-        return INVALID_OPERATION;
-    }
-
-    BufferCountMap& attachedBufferCounts = streamSet.attachedBufferCountMap;
-    size_t& attachedBufferCount = attachedBufferCounts.editValueFor(streamId);
-    if (attachedBufferCount > bufferCount) {
-        // We've already attached more buffers to this stream than we currently have
-        // outstanding, so have the stream just use an already-attached buffer
-        bufferCount++;
-        return ALREADY_EXISTS;
+    if (mGrallocVersion >= HARDWARE_DEVICE_API_VERSION(1,0)) {
+        // TODO: implement this.
+        return BAD_VALUE;
     }
-    ALOGV("Stream %d set %d: Get buffer for stream: Allocate new", streamId, streamSetId);
 
-    GraphicBufferEntry buffer =
-            getFirstBufferFromBufferListLocked(streamSet.freeBuffers, streamId);
-
-    if (mGrallocVersion < HARDWARE_DEVICE_API_VERSION(1,0)) {
-        // Allocate one if there is no free buffer available.
-        if (buffer.graphicBuffer == nullptr) {
-            const StreamInfo& info = streamSet.streamInfoMap.valueFor(streamId);
-            status_t res = OK;
-            buffer.fenceFd = -1;
-            buffer.graphicBuffer = mAllocator->createGraphicBuffer(
-                    info.width, info.height, info.format, info.combinedUsage, &res);
-            ALOGV("%s: allocating a new graphic buffer (%dx%d, format 0x%x) %p with handle %p",
-                    __FUNCTION__, info.width, info.height, info.format,
-                    buffer.graphicBuffer.get(), buffer.graphicBuffer->handle);
-            if (res != OK) {
-                ALOGE("%s: graphic buffer allocation failed: (error %d %s) ",
-                        __FUNCTION__, res, strerror(-res));
-                return res;
-            }
-            ALOGV("%s: allocation done", __FUNCTION__);
+    // Take the hand-out and attached counts up front, so that the allocation below doesn't
+    // hold the stream's lock.
+    GraphicBufferEntry buffer;
+    size_t bufferCount;
+    {
+        Mutex::Autolock l(state->lock);
+        if (!state->registered) {
+            ALOGE("%s: stream %d was unregistered from stream set %d",
+                    __FUNCTION__, streamId, streamSetId);
+            return BAD_VALUE;
         }
-
-        // Increase the hand-out and attached buffer counts for tracking purposes.
-        bufferCount++;
-        attachedBufferCount++;
-        // Update the water mark to be the max hand-out buffer count + 1. An additional buffer is
-        // added to reduce the chance of buffer allocation during stream steady state, especially
-        // for cases where one stream is active, the other stream may request some buffers randomly.
-        if (bufferCount + 1 > streamSet.allocatedBufferWaterMark) {
-            streamSet.allocatedBufferWaterMark = bufferCount + 1;
+        size_t maxAllowedBufferCount = streamSet->maxAllowedBufferCount;
+        if (state->handoutBufferCount >= maxAllowedBufferCount) {
+            ALOGE("%s: bufferCount (%zu) exceeds the max allowed buffer count (%zu) of this "
+                    "stream set", __FUNCTION__, state->handoutBufferCount,
+                    maxAllowedBufferCount);
+            return INVALID_OPERATION;
         }
-        *gb = buffer.graphicBuffer;
-        *fenceFd = buffer.fenceFd;
-        ALOGV("%s: get buffer (%p) with handle (%p).",
-                __FUNCTION__, buffer.graphicBuffer.get(), buffer.graphicBuffer->handle);
-
-        // Proactively free buffers for other streams if the current number of allocated buffers
-        // exceeds the water mark. This only for Gralloc V1, for V2, this logic can also be handled
-        // in returnBufferForStream() if we want to free buffer more quickly.
-        // TODO: probably should find out all the inactive stream IDs, and free the firstly found
-        // buffers for them.
-        StreamId firstOtherStreamId = CAMERA3_STREAM_ID_INVALID;
-        if (streamSet.streamInfoMap.size() > 1) {
-            bool freeBufferIsAttached = false;
-            for (size_t i = 0; i < streamSet.streamInfoMap.size(); i++) {
-                firstOtherStreamId = streamSet.streamInfoMap[i].streamId;
-                if (firstOtherStreamId != streamId) {
-
-                    size_t otherBufferCount  =
-                            streamSet.handoutBufferCountMap.valueFor(firstOtherStreamId);
-                    size_t otherAttachedBufferCount =
-                            streamSet.attachedBufferCountMap.valueFor(firstOtherStreamId);
-                    if (otherAttachedBufferCount > otherBufferCount) {
-                        freeBufferIsAttached = true;
-                        break;
-                    }
-                    if (hasBufferForStreamLocked(streamSet.freeBuffers, firstOtherStreamId)) {
-                        freeBufferIsAttached = false;
-                        break;
-                    }
-                }
-                firstOtherStreamId = CAMERA3_STREAM_ID_INVALID;
-            }
-            if (firstOtherStreamId == CAMERA3_STREAM_ID_INVALID) {
-                return OK;
-            }
+        state->lastRequestTime = startTime;
+
+        if (state->attachedBufferCount > state->handoutBufferCount) {
+            // We've already attached more buffers to this stream than we currently have
+            // outstanding, so have the stream just use an already-attached buffer
+            state->handoutBufferCount++;
+            recordRequest(streamSet, startTime);
+            return ALREADY_EXISTS;
+        }
+        ALOGV("Stream %d set %d: Get buffer for stream: Allocate new", streamId, streamSetId);
 
-            // This will drop the reference to one free buffer, which will effectively free one
-            // buffer (from the free buffer list) for the inactive streams.
-            size_t totalAllocatedBufferCount = streamSet.freeBuffers.size();
-            for (size_t i = 0; i < streamSet.attachedBufferCountMap.size(); i++) {
-                totalAllocatedBufferCount += streamSet.attachedBufferCountMap[i];
-            }
-            if (totalAllocatedBufferCount > streamSet.allocatedBufferWaterMark) {
-                ALOGV("%s: free a buffer from stream %d", __FUNCTION__, firstOtherStreamId);
-                if (freeBufferIsAttached) {
-                    ALOGV("Stream %d: Freeing buffer: detach", firstOtherStreamId);
-                    sp<Camera3OutputStream> stream =
-                            mStreamMap.valueFor(firstOtherStreamId).promote();
-                    if (stream == nullptr) {
-                        ALOGE("%s: unable to promote stream %d to detach buffer", __FUNCTION__,
-                                firstOtherStreamId);
-                        return INVALID_OPERATION;
-                    }
-
-                    // Detach and then drop the buffer.
-                    //
-                    // Need to unlock because the stream may also be calling
-                    // into the buffer manager in parallel to signal buffer
-                    // release, or acquire a new buffer.
-                    {
-                        mLock.unlock();
-                        sp<GraphicBuffer> buffer;
-                        stream->detachBuffer(&buffer, /*fenceFd*/ nullptr);
-                        mLock.lock();
-                    }
-                    size_t& otherAttachedBufferCount =
-                            streamSet.attachedBufferCountMap.editValueFor(firstOtherStreamId);
-                    otherAttachedBufferCount--;
-                } else {
-                    // Droppable buffer is in the free buffer list, grab and drop
-                    getFirstBufferFromBufferListLocked(streamSet.freeBuffers, firstOtherStreamId);
-                }
+        if (!state->freeBuffers.empty()) {
+            buffer = state->freeBuffers.front();
+            state->freeBuffers.pop_front();
+        }
+        state->handoutBufferCount++;
+        state->attachedBufferCount++;
+        bufferCount = state->handoutBufferCount;
+    }
+
+    // Allocate one if there is no free buffer available.
+    if (buffer.graphicBuffer == nullptr) {
+        const StreamInfo& info = state->info;
+        status_t res = OK;
+        buffer.fenceFd = -1;
+        buffer.graphicBuffer = mAllocator->createGraphicBuffer(
+                info.width, info.height, info.format, info.combinedUsage, &res);
+        if (res != OK || buffer.graphicBuffer == nullptr) {
+            ALOGE("%s: graphic buffer allocation failed: (error %d %s) ",
+                    __FUNCTION__, res, strerror(-res));
+            Mutex::Autolock l(state->lock);
+            if (state->registered) {
+                state->handoutBufferCount--;
+                state->attachedBufferCount--;
             }
+            return (res != OK) ? res : NO_MEMORY;
         }
-    } else {
-        // TODO: implement this.
-        return BAD_VALUE;
+        ALOGV("%s: allocated a new graphic buffer (%dx%d, format 0x%x) %p with handle %p",
+                __FUNCTION__, info.width, info.height, info.format,
+                buffer.graphicBuffer.get(), buffer.graphicBuffer->handle);
+        streamSet->allocatedBufferCount++;
+        streamSet->allocationCount++;
     }
 
+    // Update the water mark to be the max hand-out buffer count + 1. An additional buffer is
+    // added to reduce the chance of buffer allocation during stream steady state, especially
+    // for cases where one stream is active, the other stream may request some buffers randomly.
+    atomicMax(streamSet->allocatedBufferWaterMark, bufferCount + 1);
+
+    *gb = buffer.graphicBuffer;
+    *fenceFd = buffer.fenceFd;
+    ALOGV("%s: get buffer (%p) with handle (%p).",
+            __FUNCTION__, buffer.graphicBuffer.get(), buffer.graphicBuffer->handle);
+
+    // Proactively free buffers for other streams if the current number of allocated buffers
+    // exceeds the water mark, and drop the free buffers of streams that went idle.
+    if (streams.size() > 1) {
+        freeBufferOfOtherStream(streamId, streamSet, streams);
+        trimIdleStreams(streamSet, streams, startTime);
+    }
+
+    recordRequest(streamSet, startTime);
     return OK;
 }
 
 status_t Camera3BufferManager::onBufferReleased(int streamId, int streamSetId) {
     ATRACE_CALL();
-    Mutex::Autolock l(mLock);
 
     ALOGV("Stream %d set %d: Buffer released", streamId, streamSetId);
     if (mAllocator == NULL) {
@@ -334,19 +296,22 @@ status_t Camera3BufferManager::onBufferReleased(int streamId, int streamSetId) {
         return INVALID_OPERATION;
     }
 
-    if (!checkIfStreamRegisteredLocked(streamId, streamSetId)){
+    sp<StreamState> state;
+    sp<StreamSetState> streamSet;
+    if (lookUpStream(streamId, streamSetId, &state, &streamSet) != OK) {
         ALOGV("%s: signaling buffer release for an already unregistered stream "
                 "(stream %d with set id %d)", __FUNCTION__, streamId, streamSetId);
         return OK;
     }
 
     if (mGrallocVersion < HARDWARE_DEVICE_API_VERSION(1,0)) {
-        StreamSet& streamSet = mStreamSetMap.editValueFor(streamSetId);
-        BufferCountMap& handOutBufferCounts = streamSet.handoutBufferCountMap;
-        size_t& bufferCount = handOutBufferCounts.editValueFor(streamId);
-        bufferCount--;
+        Mutex::Autolock l(state->lock);
+        if (!state->registered) {
+            return OK;
+        }
+        state->handoutBufferCount--;
         ALOGV("%s: Stream %d set %d: Buffer count now %zu", __FUNCTION__, streamId, streamSetId,
-                bufferCount);
+                state->handoutBufferCount);
     } else {
         // TODO: implement gralloc V1 support
         return BAD_VALUE;
@@ -358,7 +323,6 @@ status_t Camera3BufferManager::onBufferReleased(int streamId, int streamSetId) {
 status_t Camera3BufferManager::returnBufferForStream(int streamId,
         int streamSetId, const sp<GraphicBuffer>& buffer, int fenceFd) {
     ATRACE_CALL();
-    Mutex::Autolock l(mLock);
     ALOGV_IF(buffer != 0, "%s: return buffer (%p) with handle (%p) for stream %d and stream set %d",
             __FUNCTION__, buffer.get(), buffer->handle, streamId, streamSetId);
     if (mAllocator == NULL) {
@@ -366,31 +330,29 @@ status_t Camera3BufferManager::returnBufferForStream(int streamId,
         return INVALID_OPERATION;
     }
 
-    if (!checkIfStreamRegisteredLocked(streamId, streamSetId)){
+    sp<StreamState> state;
+    sp<StreamSetState> streamSet;
+    if (lookUpStream(streamId, streamSetId, &state, &streamSet) != OK) {
         ALOGV("%s: returning buffer for an already unregistered stream (stream %d with set id %d),"
                 "buffer will be dropped right away!", __FUNCTION__, streamId, streamSetId);
         return OK;
     }
 
     if (mGrallocVersion < HARDWARE_DEVICE_API_VERSION(1,0)) {
-        // Add to the freeBuffer list.
-        StreamSet& streamSet = mStreamSetMap.editValueFor(streamSetId);
+        Mutex::Autolock l(state->lock);
+        if (!state->registered) {
+            return OK;
+        }
+        // Add to the free buffer list; a buffer that didn't come back is no longer allocated.
         if (buffer != 0) {
-            BufferEntry entry;
-            entry.add(streamId, GraphicBufferEntry(buffer, fenceFd));
-            status_t res = addBufferToBufferListLocked(streamSet.freeBuffers, entry);
-            if (res != OK) {
-                ALOGE("%s: add buffer to free buffer list failed", __FUNCTION__);
-                return res;
-            }
+            state->freeBuffers.push_back(GraphicBufferEntry(buffer, fenceFd));
+        } else {
+            streamSet->allocatedBufferCount--;
         }
 
         // Update the handed out and attached buffer count for this buffer.
-        BufferCountMap& handOutBufferCounts = streamSet.handoutBufferCountMap;
-        size_t& bufferCount = handOutBufferCounts.editValueFor(streamId);
-        bufferCount--;
-        size_t& attachedBufferCount = streamSet.attachedBufferCountMap.editValueFor(streamId);
-        attachedBufferCount--;
+        state->handoutBufferCount--;
+        state->attachedBufferCount--;
     } else {
         // TODO: implement this.
         return BAD_VALUE;
@@ -399,135 +361,212 @@ status_t Camera3BufferManager::returnBufferForStream(int streamId,
     return OK;
 }
 
+status_t Camera3BufferManager::getStreamSetStats(int streamSetId, StreamSetStats* stats) const {
+    if (stats == NULL) {
+        return BAD_VALUE;
+    }
+
+    RWLock::AutoRLock l(mMapLock);
+    ssize_t setIdx = mStreamSetMap.indexOfKey(streamSetId);
+    if (setIdx == NAME_NOT_FOUND) {
+        return BAD_VALUE;
+    }
+    const sp<StreamSetState>& streamSet = mStreamSetMap.valueAt(setIdx);
+    stats->allocatedBufferCount = streamSet->allocatedBufferCount;
+    stats->allocationCount = streamSet->allocationCount;
+    stats->stealCount = streamSet->stealCount;
+    stats->trimCount = streamSet->trimCount;
+    stats->requestCount = streamSet->requestCount;
+    stats->totalWaitTime = streamSet->totalWaitTime;
+    stats->maxWaitTime = streamSet->maxWaitTime;
+    return OK;
+}
+
 void Camera3BufferManager::dump(int fd, const Vector<String16>& args) const {
-    Mutex::Autolock l(mLock);
+    RWLock::AutoRLock l(mMapLock);
 
     (void) args;
     String8 lines;
     lines.appendFormat("      Total stream sets: %zu\n", mStreamSetMap.size());
     for (size_t i = 0; i < mStreamSetMap.size(); i++) {
+        const sp<StreamSetState>& streamSet = mStreamSetMap[i];
         lines.appendFormat("        Stream set %d has below streams:\n", mStreamSetMap.keyAt(i));
-        for (size_t j = 0; j < mStreamSetMap[i].streamInfoMap.size(); j++) {
-            lines.appendFormat("          Stream %d\n", mStreamSetMap[i].streamInfoMap[j].streamId);
+        for (size_t j = 0; j < streamSet->streams.size(); j++) {
+            lines.appendFormat("          Stream %d\n", streamSet->streams[j]->info.streamId);
         }
         lines.appendFormat("          Stream set max allowed buffer count: %zu\n",
-                mStreamSetMap[i].maxAllowedBufferCount);
+                streamSet->maxAllowedBufferCount.load());
         lines.appendFormat("          Stream set buffer count water mark: %zu\n",
-                mStreamSetMap[i].allocatedBufferWaterMark);
-        lines.appendFormat("          Handout buffer counts:\n");
-        for (size_t m = 0; m < mStreamSetMap[i].handoutBufferCountMap.size(); m++) {
-            int streamId = mStreamSetMap[i].handoutBufferCountMap.keyAt(m);
-            size_t bufferCount = mStreamSetMap[i].handoutBufferCountMap.valueAt(m);
-            lines.appendFormat("            stream id: %d, buffer count: %zu.\n",
-                    streamId, bufferCount);
-        }
-        lines.appendFormat("          Attached buffer counts:\n");
-        for (size_t m = 0; m < mStreamSetMap[i].attachedBufferCountMap.size(); m++) {
-            int streamId = mStreamSetMap[i].attachedBufferCountMap.keyAt(m);
-            size_t bufferCount = mStreamSetMap[i].attachedBufferCountMap.valueAt(m);
-            lines.appendFormat("            stream id: %d, attached buffer count: %zu.\n",
-                    streamId, bufferCount);
-        }
-
-        lines.appendFormat("          Free buffer count: %zu\n",
-                mStreamSetMap[i].freeBuffers.size());
-        for (auto& bufEntry : mStreamSetMap[i].freeBuffers) {
-            for (size_t m = 0; m < bufEntry.size(); m++) {
-                const sp<GraphicBuffer>& buffer = bufEntry.valueAt(m).graphicBuffer;
-                int streamId = bufEntry.keyAt(m);
-                lines.appendFormat("            stream id: %d, buffer: %p, handle: %p.\n",
-                        streamId, buffer.get(), buffer->handle);
+                streamSet->allocatedBufferWaterMark.load());
+        lines.appendFormat("          Stream set allocated buffer count: %zu\n",
+                streamSet->allocatedBufferCount.load());
+        size_t requestCount = streamSet->requestCount;
+        lines.appendFormat("          Buffers allocated: %zu, stolen: %zu, trimmed: %zu\n",
+                streamSet->allocationCount.load(), streamSet->stealCount.load(),
+                streamSet->trimCount.load());
+        lines.appendFormat("          Buffer requests: %zu, average wait %" PRId64 " us, "
+                "max wait %" PRId64 " us\n", requestCount,
+                requestCount > 0 ? streamSet->totalWaitTime / requestCount / 1000 : 0,
+                streamSet->maxWaitTime / 1000);
+        for (size_t j = 0; j < streamSet->streams.size(); j++) {
+            const sp<StreamState>& state = streamSet->streams[j];
+            Mutex::Autolock sl(state->lock);
+            lines.appendFormat("          Stream id: %d, handout buffer count: %zu, "
+                    "attached buffer count: %zu, free buffer count: %zu\n",
+                    state->info.streamId, state->handoutBufferCount,
+                    state->attachedBufferCount, state->freeBuffers.size());
+            for (auto& bufEntry : state->freeBuffers) {
+                const sp<GraphicBuffer>& buffer = bufEntry.graphicBuffer;
+                lines.appendFormat("            buffer: %p, handle: %p.\n",
+                        buffer.get(), buffer->handle);
             }
         }
     }
     write(fd, lines.string(), lines.size());
 }
 
-bool Camera3BufferManager::checkIfStreamRegisteredLocked(int streamId, int streamSetId) const {
+status_t Camera3BufferManager::lookUpStream(int streamId, int streamSetId,
+        sp<StreamState>* state, sp<StreamSetState>* streamSet, StreamList* streams) const {
+    RWLock::AutoRLock l(mMapLock);
     ssize_t setIdx = mStreamSetMap.indexOfKey(streamSetId);
     if (setIdx == NAME_NOT_FOUND) {
         ALOGV("%s: stream set %d is not registered to stream set map yet!",
                 __FUNCTION__, streamSetId);
-        return false;
+        return BAD_VALUE;
     }
 
-    ssize_t streamIdx = mStreamSetMap.valueAt(setIdx).streamInfoMap.indexOfKey(streamId);
-    if (streamIdx == NAME_NOT_FOUND) {
-        ALOGV("%s: stream %d is not registered to stream info map yet!", __FUNCTION__, streamId);
-        return false;
+    ssize_t streamIdx = mStreamMap.indexOfKey(streamId);
+    if (streamIdx == NAME_NOT_FOUND || mStreamMap[streamIdx]->info.streamSetId != streamSetId) {
+        ALOGV("%s: stream %d is not registered to stream set %d yet!", __FUNCTION__, streamId,
+                streamSetId);
+        return BAD_VALUE;
     }
 
-    size_t bufferWaterMark = mStreamSetMap[setIdx].maxAllowedBufferCount;
+    const sp<StreamSetState>& currentSet = mStreamSetMap.valueAt(setIdx);
+    size_t bufferWaterMark = currentSet->maxAllowedBufferCount;
     if (bufferWaterMark == 0 || bufferWaterMark > kMaxBufferCount) {
         ALOGW("%s: stream %d with stream set %d is not registered correctly to stream set map,"
                 " as the water mark (%zu) is wrong!",
                 __FUNCTION__, streamId, streamSetId, bufferWaterMark);
-        return false;
+        return BAD_VALUE;
     }
 
-    return true;
+    *state = mStreamMap.valueAt(streamIdx);
+    *streamSet = currentSet;
+    if (streams != NULL) {
+        *streams = currentSet->streams;
+    }
+    return OK;
 }
 
-status_t Camera3BufferManager::addBufferToBufferListLocked(BufferList& bufList,
-        const BufferEntry& buffer) {
-    // TODO: need add some sanity check here.
-    bufList.push_back(buffer);
+void Camera3BufferManager::freeBufferOfOtherStream(int streamId,
+        const sp<StreamSetState>& streamSet, const StreamList& streams) {
+    if (streamSet->allocatedBufferCount <= streamSet->allocatedBufferWaterMark) {
+        return;
+    }
 
-    return OK;
-}
+    // TODO: probably should find out all the inactive stream IDs, and free the firstly found
+    // buffers for them.
+    sp<StreamState> detachFrom;
+    for (size_t i = 0; i < streams.size(); i++) {
+        const sp<StreamState>& other = streams[i];
+        if (other->info.streamId == streamId) {
+            continue;
+        }
 
-status_t Camera3BufferManager::removeBuffersFromBufferListLocked(BufferList& bufferList,
-        int streamId) {
-    BufferList::iterator i = bufferList.begin();
-    while (i != bufferList.end()) {
-        ssize_t idx = i->indexOfKey(streamId);
-        if (idx != NAME_NOT_FOUND) {
-            ALOGV("%s: Remove a buffer for stream %d, free buffer total count: %zu",
-                    __FUNCTION__, streamId, bufferList.size());
-            i->removeItem(streamId);
-            if (i->isEmpty()) {
-                i = bufferList.erase(i);
+        GraphicBufferEntry dropped;
+        {
+            Mutex::Autolock l(other->lock);
+            if (!other->registered) {
+                continue;
             }
-        } else {
-            i++;
+            if (other->attachedBufferCount > other->handoutBufferCount) {
+                // Count the buffer as gone right away so that the stream doesn't hand it out
+                // again while it's being detached.
+                other->attachedBufferCount--;
+                streamSet->allocatedBufferCount--;
+                detachFrom = other;
+                break;
+            }
+            if (other->freeBuffers.empty()) {
+                continue;
+            }
+            // Droppable buffer is in the free buffer list, grab it and drop it below, outside
+            // the lock.
+            dropped = other->freeBuffers.front();
+            other->freeBuffers.pop_front();
+            streamSet->allocatedBufferCount--;
+        }
+        ALOGV("%s: free a buffer from stream %d", __FUNCTION__, other->info.streamId);
+        streamSet->stealCount++;
+        return;
+    }
+    if (detachFrom == nullptr) {
+        return;
+    }
+
+    ALOGV("Stream %d: Freeing buffer: detach", detachFrom->info.streamId);
+    sp<Camera3OutputStream> stream = detachFrom->stream.promote();
+    if (stream == nullptr) {
+        ALOGE("%s: unable to promote stream %d to detach buffer", __FUNCTION__,
+                detachFrom->info.streamId);
+        Mutex::Autolock l(detachFrom->lock);
+        if (detachFrom->registered) {
+            detachFrom->attachedBufferCount++;
+            streamSet->allocatedBufferCount++;
         }
+        return;
     }
 
-    return OK;
+    // Detach and then drop the buffer. No lock is held here, because the stream may also be
+    // calling into the buffer manager in parallel to signal buffer release, or acquire a new
+    // buffer.
+    sp<GraphicBuffer> buffer;
+    stream->detachBuffer(&buffer, /*fenceFd*/ nullptr);
+    streamSet->stealCount++;
 }
 
-bool Camera3BufferManager::hasBufferForStreamLocked(BufferList& buffers, int streamId) {
-    BufferList::iterator i = buffers.begin();
-    while (i != buffers.end()) {
-        ssize_t idx = i->indexOfKey(streamId);
-        if (idx != NAME_NOT_FOUND) {
-            return true;
+void Camera3BufferManager::trimIdleStreams(const sp<StreamSetState>& streamSet,
+        const StreamList& streams, nsecs_t now) {
+    // Look at most twice per timeout, so that busy streams don't pay for this on every buffer
+    nsecs_t lastTrimTime = streamSet->lastTrimTime;
+    if (now - lastTrimTime < kIdleBufferTimeout / 2 ||
+            !streamSet->lastTrimTime.compare_exchange_strong(lastTrimTime, now)) {
+        return;
+    }
+
+    for (size_t i = 0; i < streams.size(); i++) {
+        const sp<StreamState>& other = streams[i];
+        BufferList dropped;
+        {
+            Mutex::Autolock l(other->lock);
+            if (!other->registered || other->freeBuffers.empty() ||
+                    other->handoutBufferCount > 0 ||
+                    now - other->lastRequestTime < kIdleBufferTimeout) {
+                continue;
+            }
+            dropped.swap(other->freeBuffers);
+            streamSet->allocatedBufferCount -= dropped.size();
         }
-        i++;
+        ALOGV("%s: stream %d is idle, dropping its %zu free buffers", __FUNCTION__,
+                other->info.streamId, dropped.size());
+        streamSet->trimCount += dropped.size();
     }
+}
 
-    return false;
+void Camera3BufferManager::recordRequest(const sp<StreamSetState>& streamSet,
+        nsecs_t startTime) {
+    nsecs_t waitTime = systemTime() - startTime;
+    streamSet->requestCount++;
+    streamSet->totalWaitTime += waitTime;
+    atomicMax(streamSet->maxWaitTime, waitTime);
 }
 
-Camera3BufferManager::GraphicBufferEntry Camera3BufferManager::getFirstBufferFromBufferListLocked(
-        BufferList& buffers, int streamId) {
-    // Try to get the first buffer from the free buffer list if there is one.
-    GraphicBufferEntry entry;
-    BufferList::iterator i = buffers.begin();
-    while (i != buffers.end()) {
-        ssize_t idx = i->indexOfKey(streamId);
-        if (idx != NAME_NOT_FOUND) {
-            entry = GraphicBufferEntry(i->valueAt(idx));
-            i = buffers.erase(i);
-            break;
-        } else {
-            i++;
-        }
+template <typename T>
+void Camera3BufferManager::atomicMax(std::atomic<T>& value, T newValue) {
+    T current = value.load();
+    while (newValue > current && !value.compare_exchange_weak(current, newValue)) {
     }
-
-    ALOGV_IF(entry.graphicBuffer == 0, "%s: Unable to find free buffer for stream %d",
-            __FUNCTION__, streamId);
-    return entry;
 }
 
 } // namespace camera3
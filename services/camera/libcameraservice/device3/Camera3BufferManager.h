@@ -17,11 +17,14 @@
 #ifndef ANDROID_SERVERS_CAMERA3_BUFFER_MANAGER_H
 #define ANDROID_SERVERS_CAMERA3_BUFFER_MANAGER_H
 
+#include <atomic>
 #include <list>
 #include <algorithm>
 #include <ui/GraphicBuffer.h>
 #include <utils/RefBase.h>
 #include <utils/KeyedVector.h>
+#include <utils/RWLock.h>
+#include <utils/Timers.h>
 #include "Camera3OutputStream.h"
 
 namespace android {
@@ -41,6 +44,12 @@ class Camera3OutputStream;
  * In doing so, it reduces the memory footprint unless it is already minimal without impacting
  * performance.
  *
+ * Each stream keeps its own buffer counts and free buffer list under its own lock, so the
+ * per-frame calls (getBufferForStream(), onBufferReleased() and returnBufferForStream()) of
+ * different streams don't contend. The stream and stream set maps are only locked for writing
+ * by registration; the per-frame calls hold the read lock just long enough to look the stream
+ * up. The allocated buffer count of a stream set, its water mark and its statistics are atomic.
+ *
  */
 class Camera3BufferManager: public virtual RefBase {
 public:
@@ -173,18 +182,47 @@ public:
     status_t returnBufferForStream(int streamId, int streamSetId, const sp<GraphicBuffer>& buffer,
             int fenceFd);
 
+    /**
+     * Buffer statistics of one stream set.
+     */
+    struct StreamSetStats {
+        // Buffers currently allocated for the stream set, attached to a stream or free
+        size_t allocatedBufferCount;
+        // Buffers allocated since the stream set was created
+        size_t allocationCount;
+        // Buffers freed from one stream to stay within the water mark when another needed one
+        size_t stealCount;
+        // Free buffers dropped because their stream stopped asking for buffers
+        size_t trimCount;
+        // getBufferForStream() calls, and the time spent in them
+        size_t requestCount;
+        nsecs_t totalWaitTime;
+        nsecs_t maxWaitTime;
+    };
+
+    /**
+     * Get the statistics of a stream set.
+     *
+     * Return values:
+     *
+     *  OK:        The statistics were copied to stats.
+     *  BAD_VALUE: No stream is registered with this stream set ID, or stats is NULL.
+     */
+    status_t getStreamSetStats(int streamSetId, StreamSetStats* stats) const;
+
     /**
      * Dump the buffer manager statistics.
      */
     void     dump(int fd, const Vector<String16> &args) const;
 
 private:
+    static const size_t kMaxBufferCount = BufferQueueDefs::NUM_BUFFER_SLOTS;
+
     /**
-     * Lock to synchronize the access to the methods of this class.
+     * Free buffers of a stream that hasn't asked for a buffer for this long, and has none handed
+     * out, are dropped.
      */
-    mutable Mutex mLock;
-
-    static const size_t kMaxBufferCount = BufferQueueDefs::NUM_BUFFER_SLOTS;
+    static const nsecs_t kIdleBufferTimeout = 1000000000LL; // 1 s
 
     /**
      * mAllocator is the connection to SurfaceFlinger that is used to allocate new GraphicBuffer
@@ -200,35 +238,70 @@ private:
             fenceFd(fd) {}
     };
 
-    /**
-     * A buffer entry (indexed by stream ID) represents a single physically allocated buffer. For
-     * Gralloc V0, since each physical buffer is associated with one stream, this is
-     * a single entry map. For Gralloc V1, one physical buffer can be shared between different
-     * streams in one stream set, so this entry may include multiple entries, where the different
-     * graphic buffers have the same common Gralloc backing store.
-     */
     typedef int StreamId;
-    typedef KeyedVector<StreamId, GraphicBufferEntry> BufferEntry;
+    typedef int StreamSetId;
 
-    typedef std::list<BufferEntry> BufferList;
+    typedef std::list<GraphicBufferEntry> BufferList;
 
     /**
-     * Stream info map (indexed by stream ID) tracks all the streams registered to a particular
-     * stream set.
+     * StreamState keeps track of the stream info, free buffer list and buffer counts of one
+     * stream. For Gralloc V0 every buffer belongs to a single stream, so free buffers are kept on
+     * the list of the stream they were allocated for.
      */
-    typedef KeyedVector<StreamId, StreamInfo> InfoMap;
+    struct StreamState : public LightRefBase<StreamState> {
+        StreamInfo info;
+        wp<Camera3OutputStream> stream;
 
-    /**
-     * Stream set buffer count map (indexed by stream ID) tracks all buffer counts of the streams
-     * registered to a particular stream set.
-     */
-    typedef KeyedVector<StreamId, size_t> BufferCountMap;
+        /**
+         * Guards the fields below, which change together.
+         */
+        Mutex lock;
+        /**
+         * Cleared when the stream is unregistered; a stream that was looked up before that must
+         * not hand out or take back buffers anymore.
+         */
+        bool registered;
+        /**
+         * The count of the buffers that were handed out to this stream.
+         */
+        size_t handoutBufferCount;
+        /**
+         * The count of the buffers that are attached to this stream. An attached buffer may be
+         * free or handed out.
+         */
+        size_t attachedBufferCount;
+        /**
+         * The free buffers of this stream. They are returned by the returnBufferForStream() call,
+         * and available for reuse.
+         */
+        BufferList freeBuffers;
+        /**
+         * When this stream last asked for a buffer.
+         */
+        nsecs_t lastRequestTime;
+
+        StreamState(wp<Camera3OutputStream>& s, const StreamInfo& streamInfo) :
+                info(streamInfo),
+                stream(s),
+                registered(true),
+                handoutBufferCount(0),
+                attachedBufferCount(0),
+                lastRequestTime(systemTime()) {}
+    };
+
+    typedef Vector<sp<StreamState>> StreamList;
 
     /**
-     * StreamSet keeps track of the stream info, free buffer list and hand-out buffer counts for
-     * each stream set.
+     * StreamSetState keeps track of the streams, the buffer budget and the statistics of a stream
+     * set.
      */
-    struct StreamSet {
+    struct StreamSetState : public LightRefBase<StreamSetState> {
+        /**
+         * The streams in this set. Only changed with mMapLock held for writing; readers take a
+         * copy, which is cheap since Vector storage is shared until written.
+         */
+        StreamList streams;
+
         /**
          * Stream set buffer count water mark representing the max number of allocated buffers
          * (hand-out buffers + free buffers) count for each stream set. For a given stream set, when
@@ -249,88 +322,95 @@ private:
          * This water mark can be dynamically changed, and will grow when the hand-out buffer count
          * of each stream increases, until it reaches the maxAllowedBufferCount.
          */
-        size_t allocatedBufferWaterMark;
+        std::atomic<size_t> allocatedBufferWaterMark;
 
         /**
          * The max allowed buffer count for this stream set. It is the max of total number of
          * buffers for each stream. This is the upper bound of the allocatedBufferWaterMark.
          */
-        size_t maxAllowedBufferCount;
+        std::atomic<size_t> maxAllowedBufferCount;
 
         /**
-         * The stream info for all streams in this set
+         * The number of buffers allocated for this stream set: the attached buffers plus the free
+         * buffers of all its streams. This is what is held against the water mark.
          */
-        InfoMap streamInfoMap;
-        /**
-         * The free buffer list for all the buffers belong to this set. The free buffers are
-         * returned by the returnBufferForStream() call, and available for reuse.
-         */
-        BufferList freeBuffers;
+        std::atomic<size_t> allocatedBufferCount;
+
         /**
-         * The count of the buffers that were handed out to the streams of this set.
+         * When idle streams were last looked for.
          */
-        BufferCountMap handoutBufferCountMap;
+        std::atomic<nsecs_t> lastTrimTime;
+
         /**
-         * The count of the buffers that are attached to the streams of this set.
-         * An attached buffer may be free or handed out
+         * Statistics, see StreamSetStats.
          */
-        BufferCountMap attachedBufferCountMap;
-
-        StreamSet() {
-            allocatedBufferWaterMark = 0;
-            maxAllowedBufferCount = 0;
-        }
+        std::atomic<size_t> allocationCount;
+        std::atomic<size_t> stealCount;
+        std::atomic<size_t> trimCount;
+        std::atomic<size_t> requestCount;
+        std::atomic<nsecs_t> totalWaitTime;
+        std::atomic<nsecs_t> maxWaitTime;
+
+        StreamSetState() :
+                allocatedBufferWaterMark(0),
+                maxAllowedBufferCount(0),
+                allocatedBufferCount(0),
+                lastTrimTime(0),
+                allocationCount(0),
+                stealCount(0),
+                trimCount(0),
+                requestCount(0),
+                totalWaitTime(0),
+                maxWaitTime(0) {}
     };
 
+    /**
+     * Lock for mStreamSetMap and mStreamMap, and for the stream lists of the stream sets.
+     */
+    mutable RWLock mMapLock;
+
     /**
      * Stream set map managed by this buffer manager.
      */
-    typedef int StreamSetId;
-    KeyedVector<StreamSetId, StreamSet> mStreamSetMap;
-    KeyedVector<StreamId, wp<Camera3OutputStream>> mStreamMap;
+    KeyedVector<StreamSetId, sp<StreamSetState>> mStreamSetMap;
+    KeyedVector<StreamId, sp<StreamState>> mStreamMap;
 
     // TODO: There is no easy way to query the Gralloc version in this code yet, we have different
     // code paths for different Gralloc versions, hardcode something here for now.
     const uint32_t mGrallocVersion = GRALLOC_DEVICE_API_VERSION_0_1;
 
     /**
-     * Check if this stream was successfully registered already. This method needs to be called with
-     * mLock held.
+     * Look up a registered stream and its stream set. Takes mMapLock for reading. Returns
+     * BAD_VALUE if the stream wasn't successfully registered with this stream set.
      */
-    bool checkIfStreamRegisteredLocked(int streamId, int streamSetId) const;
+    status_t lookUpStream(int streamId, int streamSetId, sp<StreamState>* state,
+            sp<StreamSetState>* streamSet, StreamList* streams = NULL) const;
 
     /**
-     * Add a buffer entry to the BufferList. This method needs to be called with mLock held.
+     * Free one buffer of another stream in the set if the set has more buffers allocated than
+     * its water mark: either a free buffer on that stream's list, or a buffer that is attached to
+     * the stream but not handed out, which the stream then detaches.
      */
-    status_t addBufferToBufferListLocked(BufferList &bufList, const BufferEntry &buffer);
+    void freeBufferOfOtherStream(int streamId, const sp<StreamSetState>& streamSet,
+            const StreamList& streams);
 
     /**
-     * Remove all buffers from the BufferList.
-     *
-     * Note that this doesn't mean that the buffers are freed after this call. A buffer is freed
-     * only if all other references to it are dropped.
-     *
-     * This method needs to be called with mLock held.
+     * Drop the free buffers of streams that have no buffers handed out and haven't asked for one
+     * in kIdleBufferTimeout.
      */
-    status_t removeBuffersFromBufferListLocked(BufferList &bufList, int streamId);
+    void trimIdleStreams(const sp<StreamSetState>& streamSet, const StreamList& streams,
+            nsecs_t now);
 
     /**
-     * Get the first available buffer from the buffer list for this stream. The graphicBuffer inside
-     * this entry will be NULL if there is no any GraphicBufferEntry found. After this call, the
-     * GraphicBufferEntry will be removed from the BufferList if a GraphicBufferEntry is found.
-     *
-     * This method needs to be called with mLock held.
-     *
+     * Account a getBufferForStream() call that started at startTime.
      */
-    GraphicBufferEntry getFirstBufferFromBufferListLocked(BufferList& buffers, int streamId);
+    static void recordRequest(const sp<StreamSetState>& streamSet, nsecs_t startTime);
 
     /**
-     * Check if there is any buffer associated with this stream in the given buffer list.
-     *
-     * This method needs to be called with mLock held.
-     *
+     * Raise an atomic value to at least the given value.
      */
-    bool inline hasBufferForStreamLocked(BufferList& buffers, int streamId);
+    template <typename T>
+    static void atomicMax(std::atomic<T>& value, T newValue);
 };
 
 } // namespace camera3
@@ -72,7 +72,10 @@ Camera3Device::Camera3Device(int id):
         mNextReprocessResultFrameNumber(0),
         mNextShutterFrameNumber(0),
         mNextReprocessShutterFrameNumber(0),
-        mListener(NULL)
+        mResultQueueHead(0),
+        mListener(NULL),
+        mResultMetadataEntries(0),
+        mResultMetadataData(0)
 {
     ATRACE_CALL();
     camera3_callback_ops::notify = &sNotify;
@@ -85,6 +88,10 @@ Camera3Device::~Camera3Device()
     ATRACE_CALL();
     ALOGV("%s: Tearing down for camera id %d", __FUNCTION__, mId);
     disconnect();
+
+    for (size_t i = 0; i < mResultMetadataPool.size(); i++) {
+        free_camera_metadata(mResultMetadataPool[i]);
+    }
 }
 
 int Camera3Device::getId() const {
@@ -595,8 +602,8 @@ status_t Camera3Device::dump(int fd, const Vector<String16> &args) {
     if (mInFlightMap.size() == 0) {
         lines.append("      None\n");
     } else {
-        for (size_t i = 0; i < mInFlightMap.size(); i++) {
-            InFlightRequest r = mInFlightMap.valueAt(i);
+        for (ssize_t i = mInFlightMap.firstIndex(); i >= 0; i = mInFlightMap.nextIndex(i)) {
+            const InFlightRequest &r = mInFlightMap.valueAt(i);
             lines.appendFormat("      Frame %d |  Timestamp: %" PRId64 ", metadata"
                     " arrived: %s, buffers left: %d\n", mInFlightMap.keyAt(i),
                     r.shutterTimestamp, r.haveResultMetadata ? "true" : "false",
@@ -605,6 +612,22 @@ status_t Camera3Device::dump(int fd, const Vector<String16> &args) {
     }
     write(fd, lines.string(), lines.size());
 
+    lines = String8("    Result delivery latency (HAL callback to client):\n");
+    if (mResultLatency.count == 0) {
+        lines.append("      No results delivered\n");
+    } else {
+        lines.appendFormat("      %zu results, average %" PRId64 " us, max %" PRId64 " us\n",
+                mResultLatency.count, mResultLatency.total / mResultLatency.count / 1000,
+                mResultLatency.max / 1000);
+    }
+    write(fd, lines.string(), lines.size());
+
+    if (mRequestThread != NULL) {
+        lines = String8("    Request submission (HAL return to next process_capture_request):\n");
+        mRequestThread->dumpSubmissionStats(&lines);
+        write(fd, lines.string(), lines.size());
+    }
+
     {
         lines = String8("    Last request sent:\n");
         write(fd, lines.string(), lines.size());
@@ -1505,7 +1528,7 @@ status_t Camera3Device::waitForNextFrame(nsecs_t timeout) {
     status_t res;
     Mutex::Autolock l(mOutputLock);
 
-    while (mResultQueue.empty()) {
+    while (mResultQueueHead == mResultQueue.size()) {
         res = mResultSignal.waitRelative(mOutputLock, timeout);
         if (res == TIMED_OUT) {
             return res;
@@ -1522,7 +1545,7 @@ status_t Camera3Device::getNextResult(CaptureResult *frame) {
     ATRACE_CALL();
     Mutex::Autolock l(mOutputLock);
 
-    if (mResultQueue.empty()) {
+    if (mResultQueueHead == mResultQueue.size()) {
         return NOT_ENOUGH_DATA;
     }
 
@@ -1531,14 +1554,114 @@ status_t Camera3Device::getNextResult(CaptureResult *frame) {
         return BAD_VALUE;
     }
 
-    CaptureResult &result = *(mResultQueue.begin());
+    recordResultLatencyLocked(mResultQueueHead, mResultQueueHead + 1);
+
+    CaptureResult &result = mResultQueue[mResultQueueHead++];
     frame->mResultExtras = result.mResultExtras;
     frame->mMetadata.acquire(result.mMetadata);
-    mResultQueue.erase(mResultQueue.begin());
+
+    if (mResultQueueHead == mResultQueue.size()) {
+        mResultQueue.clear();
+        mResultQueueTimes.clear();
+        mResultQueueHead = 0;
+    }
+
+    return OK;
+}
+
+status_t Camera3Device::getNextResults(std::vector<CaptureResult> *frames) {
+    ATRACE_CALL();
+
+    if (frames == NULL) {
+        ALOGE("%s: argument cannot be NULL", __FUNCTION__);
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock l(mOutputLock);
+
+    size_t count = mResultQueue.size() - mResultQueueHead;
+    if (count == 0) {
+        return NOT_ENOUGH_DATA;
+    }
+
+    recordResultLatencyLocked(mResultQueueHead, mResultQueue.size());
+    ATRACE_INT("cam3_result_batch", count);
+
+    frames->clear();
+    if (mResultQueueHead == 0) {
+        // Hand over the whole queue; the caller's (empty) storage takes its place
+        frames->swap(mResultQueue);
+    } else {
+        frames->resize(count);
+        for (size_t i = 0; i < count; i++) {
+            CaptureResult &result = mResultQueue[mResultQueueHead + i];
+            (*frames)[i].mResultExtras = result.mResultExtras;
+            (*frames)[i].mMetadata.acquire(result.mMetadata);
+        }
+        mResultQueue.clear();
+    }
+    mResultQueueTimes.clear();
+    mResultQueueHead = 0;
 
     return OK;
 }
 
+void Camera3Device::recycleResults(std::vector<CaptureResult> *frames) {
+    if (frames == NULL) return;
+
+    {
+        Mutex::Autolock l(mOutputLock);
+        for (size_t i = 0; i < frames->size(); i++) {
+            camera_metadata_t *buffer = (*frames)[i].mMetadata.release();
+            if (buffer == NULL) continue;
+
+            // Buffers smaller than the largest result so far would rarely fit
+            if (mResultMetadataPool.size() < kResultMetadataPoolSize &&
+                    get_camera_metadata_entry_capacity(buffer) >= mResultMetadataEntries &&
+                    get_camera_metadata_data_capacity(buffer) >= mResultMetadataData) {
+                mResultMetadataPool.push_back(buffer);
+            } else {
+                free_camera_metadata(buffer);
+            }
+        }
+    }
+    frames->clear();
+}
+
+camera_metadata_t* Camera3Device::obtainResultMetadataLocked(size_t entryCapacity,
+        size_t dataCapacity) {
+    if (entryCapacity > mResultMetadataEntries) mResultMetadataEntries = entryCapacity;
+    if (dataCapacity > mResultMetadataData) mResultMetadataData = dataCapacity;
+
+    for (size_t i = mResultMetadataPool.size(); i > 0; i--) {
+        camera_metadata_t *buffer = mResultMetadataPool[i - 1];
+        size_t bufferEntries = get_camera_metadata_entry_capacity(buffer);
+        size_t bufferData = get_camera_metadata_data_capacity(buffer);
+        if (bufferEntries >= entryCapacity && bufferData >= dataCapacity) {
+            mResultMetadataPool.removeAt(i - 1);
+            // Empty the buffer in place, keeping its capacity
+            return place_camera_metadata(buffer, get_camera_metadata_size(buffer),
+                    bufferEntries, bufferData);
+        }
+    }
+
+    return allocate_camera_metadata(mResultMetadataEntries, mResultMetadataData);
+}
+
+void Camera3Device::recordResultLatencyLocked(size_t begin, size_t end) {
+    nsecs_t now = systemTime();
+    for (size_t i = begin; i < end && i < mResultQueueTimes.size(); i++) {
+        nsecs_t latency = now - mResultQueueTimes[i];
+        mResultLatency.count++;
+        mResultLatency.total += latency;
+        if (latency > mResultLatency.max) {
+            mResultLatency.max = latency;
+        }
+        ALOGVV("%s: result for frame %" PRId64 " delivered after %" PRId64 " us",
+                __FUNCTION__, mResultQueue[i].mResultExtras.frameNumber, latency / 1000);
+    }
+}
+
 status_t Camera3Device::triggerAutofocus(uint32_t id) {
     ATRACE_CALL();
     Mutex::Autolock il(mInterfaceLock);
@@ -2223,7 +2346,7 @@ void Camera3Device::returnOutputBuffers(
 }
 
 void Camera3Device::removeInFlightMapEntryLocked(int idx) {
-    mInFlightMap.removeItemsAt(idx, 1);
+    mInFlightMap.removeItemAt(idx);
 
     // Indicate idle inFlightMap to the status tracker
     if (mInFlightMap.size() == 0) {
@@ -2281,7 +2404,8 @@ void Camera3Device::removeInFlightRequestIfReadyLocked(int idx) {
 }
 
 void Camera3Device::insertResultLocked(CaptureResult *result, uint32_t frameNumber,
-            const AeTriggerCancelOverride_t &aeTriggerCancelOverride) {
+            const AeTriggerCancelOverride_t &aeTriggerCancelOverride,
+            nsecs_t halCallbackTime) {
     if (result == nullptr) return;
 
     if (result->mMetadata.update(ANDROID_REQUEST_FRAME_COUNT,
@@ -2297,39 +2421,51 @@ void Camera3Device::insertResultLocked(CaptureResult *result, uint32_t frameNumb
 
     overrideResultForPrecaptureCancel(&result->mMetadata, aeTriggerCancelOverride);
 
-    // Valid result, insert into queue
-    List<CaptureResult>::iterator queuedResult =
-            mResultQueue.insert(mResultQueue.end(), CaptureResult(*result));
+    // Valid result, move into queue
+    bool wasEmpty = (mResultQueueHead == mResultQueue.size());
+    mResultQueue.emplace_back();
+    CaptureResult &queuedResult = mResultQueue.back();
+    queuedResult.mResultExtras = result->mResultExtras;
+    queuedResult.mMetadata.acquire(result->mMetadata);
+    mResultQueueTimes.push_back(halCallbackTime);
     ALOGVV("%s: result requestId = %" PRId32 ", frameNumber = %" PRId64
            ", burstId = %" PRId32, __FUNCTION__,
-           queuedResult->mResultExtras.requestId,
-           queuedResult->mResultExtras.frameNumber,
-           queuedResult->mResultExtras.burstId);
+           queuedResult.mResultExtras.requestId,
+           queuedResult.mResultExtras.frameNumber,
+           queuedResult.mResultExtras.burstId);
 
-    mResultSignal.signal();
+    // The consumer drains the whole queue once woken up
+    if (wasEmpty) {
+        mResultSignal.signal();
+    }
 }
 
 
 void Camera3Device::sendPartialCaptureResult(const camera_metadata_t * partialResult,
         const CaptureResultExtras &resultExtras, uint32_t frameNumber,
-        const AeTriggerCancelOverride_t &aeTriggerCancelOverride) {
+        const AeTriggerCancelOverride_t &aeTriggerCancelOverride,
+        nsecs_t halCallbackTime) {
     Mutex::Autolock l(mOutputLock);
 
     CaptureResult captureResult;
     captureResult.mResultExtras = resultExtras;
-    captureResult.mMetadata = partialResult;
+    captureResult.mMetadata.acquire(obtainResultMetadataLocked(
+            get_camera_metadata_entry_count(partialResult) + kResultMetadataExtraEntries,
+            get_camera_metadata_data_count(partialResult) + kResultMetadataExtraData));
+    captureResult.mMetadata.append(partialResult);
 
-    insertResultLocked(&captureResult, frameNumber, aeTriggerCancelOverride);
+    insertResultLocked(&captureResult, frameNumber, aeTriggerCancelOverride, halCallbackTime);
 }
 
 
-void Camera3Device::sendCaptureResult(CameraMetadata &pendingMetadata,
+void Camera3Device::sendCaptureResult(const camera_metadata_t *pendingMetadata,
         CaptureResultExtras &resultExtras,
         CameraMetadata &collectedPartialResult,
         uint32_t frameNumber,
         bool reprocess,
-        const AeTriggerCancelOverride_t &aeTriggerCancelOverride) {
-    if (pendingMetadata.isEmpty())
+        const AeTriggerCancelOverride_t &aeTriggerCancelOverride,
+        nsecs_t halCallbackTime) {
+    if (pendingMetadata == NULL || get_camera_metadata_entry_count(pendingMetadata) == 0)
         return;
 
     Mutex::Autolock l(mOutputLock);
@@ -2353,13 +2489,30 @@ void Camera3Device::sendCaptureResult(CameraMetadata &pendingMetadata,
         mNextResultFrameNumber = frameNumber + 1;
     }
 
+    // Assemble the result in a pooled buffer large enough for the metadata,
+    // the partials and the entries added below, so it doesn't get resized.
+    const camera_metadata_t *partials = NULL;
+    if (mUsePartialResult && !collectedPartialResult.isEmpty()) {
+        partials = collectedPartialResult.getAndLock();
+    }
+    size_t entryCapacity = get_camera_metadata_entry_count(pendingMetadata) +
+            kResultMetadataExtraEntries;
+    size_t dataCapacity = get_camera_metadata_data_count(pendingMetadata) +
+            kResultMetadataExtraData;
+    if (partials != NULL) {
+        entryCapacity += get_camera_metadata_entry_count(partials);
+        dataCapacity += get_camera_metadata_data_count(partials);
+    }
+
     CaptureResult captureResult;
     captureResult.mResultExtras = resultExtras;
-    captureResult.mMetadata = pendingMetadata;
+    captureResult.mMetadata.acquire(obtainResultMetadataLocked(entryCapacity, dataCapacity));
+    captureResult.mMetadata.append(pendingMetadata);
 
     // Append any previous partials to form a complete result
-    if (mUsePartialResult && !collectedPartialResult.isEmpty()) {
-        captureResult.mMetadata.append(collectedPartialResult);
+    if (partials != NULL) {
+        captureResult.mMetadata.append(partials);
+        collectedPartialResult.unlock(partials);
     }
 
     // Derive some new keys for backward compaibility
@@ -2384,7 +2537,7 @@ void Camera3Device::sendCaptureResult(CameraMetadata &pendingMetadata,
     mTagMonitor.monitorMetadata(TagMonitor::RESULT,
             frameNumber, timestamp.data.i64[0], captureResult.mMetadata);
 
-    insertResultLocked(&captureResult, frameNumber, aeTriggerCancelOverride);
+    insertResultLocked(&captureResult, frameNumber, aeTriggerCancelOverride, halCallbackTime);
 }
 
 /**
@@ -2395,6 +2548,7 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
     ATRACE_CALL();
 
     status_t res;
+    nsecs_t halCallbackTime = systemTime();
 
     uint32_t frameNumber = result->frame_number;
     if (result->result == NULL && result->num_output_buffers == 0 &&
@@ -2484,7 +2638,7 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
             if (isPartialResult) {
                 // Send partial capture result
                 sendPartialCaptureResult(result->result, request.resultExtras, frameNumber,
-                        request.aeTriggerCancelOverride);
+                        request.aeTriggerCancelOverride, halCallbackTime);
             }
         }
 
@@ -2546,11 +2700,9 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
                 request.pendingMetadata = result->result;
                 request.collectedPartialResult = collectedPartialResult;
             } else {
-                CameraMetadata metadata;
-                metadata = result->result;
-                sendCaptureResult(metadata, request.resultExtras,
+                sendCaptureResult(result->result, request.resultExtras,
                     collectedPartialResult, frameNumber, hasInputBufferInRequest,
-                    request.aeTriggerCancelOverride);
+                    request.aeTriggerCancelOverride, halCallbackTime);
             }
         }
 
@@ -2679,6 +2831,7 @@ void Camera3Device::notifyError(const camera3_error_msg_t &msg,
 void Camera3Device::notifyShutter(const camera3_shutter_msg_t &msg,
         sp<NotificationListener> listener) {
     ssize_t idx;
+    nsecs_t halCallbackTime = systemTime();
 
     // Set timestamp for the request in the in-flight tracking
     // and get the request ID to send upstream
@@ -2722,9 +2875,11 @@ void Camera3Device::notifyShutter(const camera3_shutter_msg_t &msg,
             r.shutterTimestamp = msg.timestamp;
 
             // send pending result and buffers
-            sendCaptureResult(r.pendingMetadata, r.resultExtras,
+            const camera_metadata_t *pendingMetadata = r.pendingMetadata.getAndLock();
+            sendCaptureResult(pendingMetadata, r.resultExtras,
                 r.collectedPartialResult, msg.frame_number,
-                r.hasInputBuffer, r.aeTriggerCancelOverride);
+                r.hasInputBuffer, r.aeTriggerCancelOverride, halCallbackTime);
+            r.pendingMetadata.unlock(pendingMetadata);
             returnOutputBuffers(r.pendingOutputBuffers.array(),
                 r.pendingOutputBuffers.size(), r.shutterTimestamp);
             r.pendingOutputBuffers.clear();
@@ -2757,6 +2912,136 @@ void Camera3Device::monitorMetadata(TagMonitor::eventSource source,
     mTagMonitor.monitorMetadata(source, frameNumber, timestamp, metadata);
 }
 
+/**
+ * OutputBufferAcquirer inner class methods
+ */
+
+Camera3Device::OutputBufferAcquirer::OutputBufferAcquirer(size_t threadCount) :
+        mNextJob(0),
+        mJobsRunning(0),
+        mStarted(false),
+        mExiting(false),
+        mResult(OK) {
+    for (size_t i = 0; i < threadCount; i++) {
+        sp<WorkerThread> thread = new WorkerThread(this);
+        status_t res = thread->run(String8::format("C3Dev-BufAcq-%zu", i).string());
+        if (res != OK) {
+            ALOGE("%s: Unable to start buffer acquirer thread: %s (%d)",
+                    __FUNCTION__, strerror(-res), res);
+            break;
+        }
+        mThreads.add(thread);
+    }
+}
+
+Camera3Device::OutputBufferAcquirer::~OutputBufferAcquirer() {
+    {
+        Mutex::Autolock l(mLock);
+        mExiting = true;
+        mJobSignal.broadcast();
+    }
+    for (size_t i = 0; i < mThreads.size(); i++) {
+        mThreads[i]->requestExitAndWait();
+    }
+}
+
+void Camera3Device::OutputBufferAcquirer::add(
+        const sp<camera3::Camera3OutputStreamInterface>& stream,
+        camera3_stream_buffer_t *buffer) {
+    Mutex::Autolock l(mLock);
+    ALOG_ASSERT(!mStarted, "Adding a buffer while acquisition is running");
+
+    // One job per stream, since a stream hands out its buffers in order
+    for (size_t i = 0; i < mJobs.size(); i++) {
+        if (mJobs[i].stream == stream) {
+            mJobs.editItemAt(i).buffers.add(buffer);
+            return;
+        }
+    }
+    Job job;
+    job.stream = stream;
+    job.buffers.add(buffer);
+    mJobs.add(job);
+}
+
+void Camera3Device::OutputBufferAcquirer::start() {
+    Mutex::Autolock l(mLock);
+    mStarted = true;
+    mResult = OK;
+    mJobSignal.broadcast();
+}
+
+status_t Camera3Device::OutputBufferAcquirer::wait() {
+    ATRACE_CALL();
+    Mutex::Autolock l(mLock);
+    while (hasJobLocked()) {
+        runNextJobLocked();
+    }
+    while (mJobsRunning > 0) {
+        mDoneSignal.wait(mLock);
+    }
+
+    status_t res = mResult;
+    mJobs.clear();
+    mNextJob = 0;
+    mStarted = false;
+    mResult = OK;
+    return res;
+}
+
+bool Camera3Device::OutputBufferAcquirer::hasJobLocked() const {
+    return mStarted && mNextJob < mJobs.size();
+}
+
+void Camera3Device::OutputBufferAcquirer::runNextJobLocked() {
+    // mJobs isn't resized while started, so the job stays in place while unlocked
+    Job &job = mJobs.editItemAt(mNextJob++);
+    mJobsRunning++;
+    // Don't bother if a buffer of another stream already failed
+    bool skip = (mResult != OK);
+    status_t res = OK;
+
+    mLock.unlock();
+    for (size_t i = 0; i < job.buffers.size() && !skip; i++) {
+        res = job.stream->getBuffer(job.buffers[i]);
+        if (res != OK) {
+            // Can't get output buffer from gralloc queue - this could be due to
+            // abandoned queue or other consumer misbehavior, so not a fatal
+            // error
+            ALOGE("RequestThread: Can't get output buffer, skipping request:"
+                    " %s (%d)", strerror(-res), res);
+            *job.buffers[i] = camera3_stream_buffer_t();
+            break;
+        }
+    }
+    mLock.lock();
+
+    if (res != OK && mResult == OK) {
+        mResult = res;
+    }
+    mJobsRunning--;
+    if (mJobsRunning == 0 && !hasJobLocked()) {
+        mDoneSignal.signal();
+    }
+}
+
+Camera3Device::OutputBufferAcquirer::WorkerThread::WorkerThread(OutputBufferAcquirer *parent) :
+        Thread(/*canCallJava*/false),
+        mParent(parent) {
+}
+
+bool Camera3Device::OutputBufferAcquirer::WorkerThread::threadLoop() {
+    Mutex::Autolock l(mParent->mLock);
+    while (!mParent->mExiting && !mParent->hasJobLocked()) {
+        mParent->mJobSignal.wait(mParent->mLock);
+    }
+    if (mParent->mExiting) {
+        return false;
+    }
+    mParent->runNextJobLocked();
+    return true;
+}
+
 /**
  * RequestThread inner class methods
  */
@@ -2771,11 +3056,16 @@ Camera3Device::RequestThread::RequestThread(wp<Camera3Device> parent,
         mHal3Device(hal3Device),
         mListener(nullptr),
         mId(getId(parent)),
+        mPrebuiltRequestsCancelled(false),
         mReconfigured(false),
         mDoPause(false),
         mPaused(true),
         mFrameNumber(0),
         mLatestRequestId(NAME_NOT_FOUND),
+        mLastSubmissionReturn(0),
+        mSubmissionCount(0),
+        mSubmissionGapTotal(0),
+        mSubmissionGapMax(0),
         mCurrentAfTriggerId(0),
         mCurrentPreCaptureTriggerId(0),
         mRepeatingLastFrameNumber(
@@ -2783,6 +3073,13 @@ Camera3Device::RequestThread::RequestThread(wp<Camera3Device> parent,
         mAeLockAvailable(aeLockAvailable),
         mPrepareVideoStream(false) {
     mStatusId = statusTracker->addComponent();
+    mBufferAcquirer = new OutputBufferAcquirer(kOutputBufferAcquireThreads);
+}
+
+Camera3Device::RequestThread::~RequestThread() {
+    // The thread may have been told to exit between taking a batch early and
+    // submitting it
+    cleanUpPrebuiltRequests(/*sendRequestError*/ false);
 }
 
 void Camera3Device::RequestThread::setNotificationListener(
@@ -2927,6 +3224,26 @@ status_t Camera3Device::RequestThread::clear(
 
     mRepeatingRequests.clear();
 
+    // A batch taken off the queue early is dropped by the request thread, which
+    // sends its errors once its output buffers are back. Its input buffer may
+    // be the one the queued reprocess requests below have to wait for, so hand
+    // that back here, ahead of theirs.
+    if (!mPrebuiltRequests.empty()) {
+        mPrebuiltRequestsCancelled = true;
+        for (auto& prebuilt : mPrebuiltRequests) {
+            sp<CaptureRequest> &request = prebuilt.captureRequest;
+            if (request->mInputStream != NULL && !prebuilt.inputBufferReturned) {
+                request->mInputBuffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+                status_t res = request->mInputStream->returnInputBuffer(request->mInputBuffer);
+                if (res != OK) {
+                    ALOGE("%s: %d: couldn't return input buffer while clearing the request "
+                            "list: %s (%d)", __FUNCTION__, __LINE__, strerror(-res), res);
+                }
+                prebuilt.inputBufferReturned = true;
+            }
+        }
+    }
+
     // Send errors for all requests pending in the request queue, including
     // pending repeating requests
     sp<NotificationListener> listener = mListener.promote();
@@ -3098,17 +3415,37 @@ bool Camera3Device::RequestThread::threadLoop() {
     ATRACE_CALL();
     status_t res;
 
-    // Handle paused state.
-    if (waitIfPaused()) {
-        return true;
+    if (mPrebuiltRequests.empty()) {
+        // Handle paused state.
+        if (waitIfPaused()) {
+            return true;
+        }
+
+        // Wait for the next batch of requests.
+        waitForNextRequestBatch();
+        if (mNextRequests.size() == 0) {
+            return true;
+        }
+
+        startGettingOutputBuffers(&mNextRequests);
+        res = mBufferAcquirer->wait();
+    } else {
+        // Taken off the queue while the previous batch was submitted, so
+        // submit it before honoring a pause.
+        res = takePrebuiltRequests();
     }
 
-    // Wait for the next batch of requests.
-    waitForNextRequestBatch();
-    if (mNextRequests.size() == 0) {
+    if (res != OK) {
+        // Not a fatal error if getting output buffers time out.
+        cleanUpFailedRequests(/*sendRequestError*/ true);
+        // Check if any stream is abandoned.
+        checkAndStopRepeatingRequest();
         return true;
     }
 
+    // Get the following batch ready while this one is submitted
+    prebuildNextRequestBatch();
+
     // Get the latest request ID, if any
     int latestRequestId;
     camera_metadata_entry_t requestIdEntry = mNextRequests[mNextRequests.size() - 1].
@@ -3120,16 +3457,11 @@ bool Camera3Device::RequestThread::threadLoop() {
         latestRequestId = NAME_NOT_FOUND;
     }
 
-    // Prepare a batch of HAL requests and output buffers.
+    // Prepare a batch of HAL requests.
     res = prepareHalRequests();
-    if (res == TIMED_OUT) {
-        // Not a fatal error if getting output buffers time out.
-        cleanUpFailedRequests(/*sendRequestError*/ true);
-        // Check if any stream is abandoned.
-        checkAndStopRepeatingRequest();
-        return true;
-    } else if (res != OK) {
+    if (res != OK) {
         cleanUpFailedRequests(/*sendRequestError*/ false);
+        cleanUpPrebuiltRequests(/*sendRequestError*/ false);
         return false;
     }
 
@@ -3160,7 +3492,9 @@ bool Camera3Device::RequestThread::threadLoop() {
         // Submit request and block until ready for next one
         ATRACE_ASYNC_BEGIN("frame capture", nextRequest.halRequest.frame_number);
         ATRACE_BEGIN("camera3->process_capture_request");
+        nsecs_t submitTime = systemTime();
         res = mHal3Device->ops->process_capture_request(mHal3Device, &nextRequest.halRequest);
+        recordSubmission(submitTime, systemTime());
         ATRACE_END();
 
         if (res != OK) {
@@ -3171,6 +3505,7 @@ bool Camera3Device::RequestThread::threadLoop() {
                     " device: %s (%d)", nextRequest.halRequest.frame_number, strerror(-res),
                     res);
             cleanUpFailedRequests(/*sendRequestError*/ false);
+            cleanUpPrebuiltRequests(/*sendRequestError*/ false);
             if (useFlushLock) {
                 mFlushLock.unlock();
             }
@@ -3184,8 +3519,7 @@ bool Camera3Device::RequestThread::threadLoop() {
         if (nextRequest.halRequest.settings != NULL) { // Don't update if they were unchanged
             Mutex::Autolock al(mLatestRequestMutex);
 
-            camera_metadata_t* cloned = clone_camera_metadata(nextRequest.halRequest.settings);
-            mLatestRequest.acquire(cloned);
+            updateLatestRequestLocked(nextRequest.halRequest.settings);
 
             sp<Camera3Device> parent = mParent.promote();
             if (parent != NULL) {
@@ -3205,6 +3539,7 @@ bool Camera3Device::RequestThread::threadLoop() {
                   "(capture request %d, HAL device: %s (%d)",
                   nextRequest.halRequest.frame_number, strerror(-res), res);
             cleanUpFailedRequests(/*sendRequestError*/ false);
+            cleanUpPrebuiltRequests(/*sendRequestError*/ false);
             if (useFlushLock) {
                 mFlushLock.unlock();
             }
@@ -3222,9 +3557,144 @@ bool Camera3Device::RequestThread::threadLoop() {
         mNextRequests.clear();
     }
 
+    // No more loops once exit is requested, so don't hold on to the next batch
+    if (exitPending()) {
+        cleanUpPrebuiltRequests(/*sendRequestError*/ false);
+    }
+
+    return true;
+}
+
+void Camera3Device::RequestThread::startGettingOutputBuffers(Vector<NextRequest> *requests) {
+    ATRACE_CALL();
+
+    for (auto& nextRequest : *requests) {
+        sp<CaptureRequest> captureRequest = nextRequest.captureRequest;
+        Vector<camera3_stream_buffer_t>* outputBuffers = &nextRequest.outputBuffers;
+
+        outputBuffers->insertAt(camera3_stream_buffer_t(), 0,
+                captureRequest->mOutputStreams.size());
+        for (size_t i = 0; i < captureRequest->mOutputStreams.size(); i++) {
+            sp<Camera3OutputStreamInterface> outputStream = captureRequest->mOutputStreams.editItemAt(i);
+
+            // Prepare video buffers for high speed recording on the first video request.
+            if (mPrepareVideoStream && outputStream->isVideoStream()) {
+                // Only try to prepare video stream on the first video request.
+                mPrepareVideoStream = false;
+
+                status_t res = outputStream->startPrepare(
+                        Camera3StreamInterface::ALLOCATE_PIPELINE_MAX);
+                while (res == NOT_ENOUGH_DATA) {
+                    res = outputStream->prepareNextBuffer();
+                }
+                if (res != OK) {
+                    ALOGW("%s: Preparing video buffers for high speed failed: %s (%d)",
+                        __FUNCTION__, strerror(-res), res);
+                    outputStream->cancelPrepare();
+                }
+            }
+
+            mBufferAcquirer->add(outputStream, &outputBuffers->editItemAt(i));
+        }
+    }
+
+    mBufferAcquirer->start();
+}
+
+bool Camera3Device::RequestThread::isNextRequestBatchReadyLocked() const {
+    // Requests come from the queue first, and the repeating list refills an
+    // empty queue without waiting
+    const RequestList &source = mRequestQueue.empty() ? mRepeatingRequests : mRequestQueue;
+    if (source.empty()) {
+        return false;
+    }
+    size_t batchSize = (*source.begin())->mBatchSize;
+    if (&source == &mRequestQueue && mRequestQueue.size() < batchSize &&
+            mRepeatingRequests.empty()) {
+        return false;
+    }
+
+    // Input buffers are taken along with the request. A reprocess request on
+    // its own can come early, as long as its input buffer is there; a batch
+    // can't be put back on the queue half taken, so leave those for their turn
+    size_t checked = 0;
+    for (const auto& request : source) {
+        if (checked++ == batchSize) break;
+        if (request->mInputStream != NULL &&
+                (batchSize > 1 || &source != &mRequestQueue)) {
+            return false;
+        }
+    }
+    if (checked < batchSize) {
+        for (const auto& request : mRepeatingRequests) {
+            if (request->mInputStream != NULL) return false;
+        }
+    }
     return true;
 }
 
+void Camera3Device::RequestThread::prebuildNextRequestBatch() {
+    if (exitPending()) {
+        return;
+    }
+    {
+        Mutex::Autolock pl(mPauseLock);
+        if (mDoPause) {
+            return;
+        }
+    }
+
+    {
+        Mutex::Autolock l(mRequestLock);
+        if (!isNextRequestBatchReadyLocked()) {
+            return;
+        }
+
+        if (!takeNextRequestLocked(&mPrebuiltRequests, /*lookahead*/true)) {
+            return;
+        }
+        const size_t batchSize = mPrebuiltRequests[0].captureRequest->mBatchSize;
+        for (size_t i = 1; i < batchSize; i++) {
+            if (!takeNextRequestLocked(&mPrebuiltRequests, /*lookahead*/true)) {
+                break;
+            }
+        }
+    }
+
+    ALOGVV("%s: prebuilding %zu requests", __FUNCTION__, mPrebuiltRequests.size());
+    startGettingOutputBuffers(&mPrebuiltRequests);
+}
+
+status_t Camera3Device::RequestThread::takePrebuiltRequests() {
+    assert(mNextRequests.empty());
+
+    // The buffer structs are written in place until wait() returns
+    status_t res = mBufferAcquirer->wait();
+
+    Mutex::Autolock l(mRequestLock);
+    mNextRequests = mPrebuiltRequests;
+    mPrebuiltRequests.clear();
+    if (mPrebuiltRequestsCancelled) {
+        mPrebuiltRequestsCancelled = false;
+        return TIMED_OUT;
+    }
+    if (res == OK && mNextRequests.size() <
+            static_cast<size_t>(mNextRequests[0].captureRequest->mBatchSize)) {
+        ALOGE("RequestThread: only get %zu out of %d requests. Skipping requests.",
+                mNextRequests.size(), mNextRequests[0].captureRequest->mBatchSize);
+        return TIMED_OUT;
+    }
+    return res;
+}
+
+void Camera3Device::RequestThread::cleanUpPrebuiltRequests(bool sendRequestError) {
+    if (mPrebuiltRequests.empty()) {
+        return;
+    }
+    takePrebuiltRequests();
+    cleanUpFailedRequests(sendRequestError);
+}
+
 status_t Camera3Device::RequestThread::prepareHalRequests() {
     ATRACE_CALL();
 
@@ -3234,7 +3704,7 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
         Vector<camera3_stream_buffer_t>* outputBuffers = &nextRequest.outputBuffers;
 
         // Prepare a request to HAL
-        halRequest->frame_number = captureRequest->mResultExtras.frameNumber;
+        halRequest->frame_number = nextRequest.resultExtras.frameNumber;
 
         // Insert any queued triggers (before metadata is locked)
         status_t res = insertTriggers(captureRequest);
@@ -3249,6 +3719,10 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
         bool triggersMixedIn = (triggerCount > 0 || mPrevTriggers > 0);
         mPrevTriggers = triggerCount;
 
+        // Trigger IDs in effect for this frame, including any just mixed in
+        nextRequest.resultExtras.afTriggerId = mCurrentAfTriggerId;
+        nextRequest.resultExtras.precaptureTriggerId = mCurrentPreCaptureTriggerId;
+
         // If the request is the same as last, or we had triggers last time
         if (mPrevRequest != captureRequest || triggersMixedIn) {
             /**
@@ -3302,40 +3776,9 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
             halRequest->input_buffer = NULL;
         }
 
-        outputBuffers->insertAt(camera3_stream_buffer_t(), 0,
-                captureRequest->mOutputStreams.size());
+        // Output buffers were gotten by startGettingOutputBuffers()
         halRequest->output_buffers = outputBuffers->array();
-        for (size_t i = 0; i < captureRequest->mOutputStreams.size(); i++) {
-            sp<Camera3OutputStreamInterface> outputStream = captureRequest->mOutputStreams.editItemAt(i);
-
-            // Prepare video buffers for high speed recording on the first video request.
-            if (mPrepareVideoStream && outputStream->isVideoStream()) {
-                // Only try to prepare video stream on the first video request.
-                mPrepareVideoStream = false;
-
-                res = outputStream->startPrepare(Camera3StreamInterface::ALLOCATE_PIPELINE_MAX);
-                while (res == NOT_ENOUGH_DATA) {
-                    res = outputStream->prepareNextBuffer();
-                }
-                if (res != OK) {
-                    ALOGW("%s: Preparing video buffers for high speed failed: %s (%d)",
-                        __FUNCTION__, strerror(-res), res);
-                    outputStream->cancelPrepare();
-                }
-            }
-
-            res = outputStream->getBuffer(&outputBuffers->editItemAt(i));
-            if (res != OK) {
-                // Can't get output buffer from gralloc queue - this could be due to
-                // abandoned queue or other consumer misbehavior, so not a fatal
-                // error
-                ALOGE("RequestThread: Can't get output buffer, skipping request:"
-                        " %s (%d)", strerror(-res), res);
-
-                return TIMED_OUT;
-            }
-            halRequest->num_output_buffers++;
-        }
+        halRequest->num_output_buffers = outputBuffers->size();
         totalNumBuffers += halRequest->num_output_buffers;
 
         // Log request in the in-flight queue
@@ -3346,14 +3789,14 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
             return INVALID_OPERATION;
         }
         res = parent->registerInFlight(halRequest->frame_number,
-                totalNumBuffers, captureRequest->mResultExtras,
+                totalNumBuffers, nextRequest.resultExtras,
                 /*hasInput*/halRequest->input_buffer != NULL,
-                captureRequest->mAeTriggerCancelOverride);
+                nextRequest.aeTriggerCancelOverride);
         ALOGVV("%s: registered in flight requestId = %" PRId32 ", frameNumber = %" PRId64
                ", burstId = %" PRId32 ".",
                 __FUNCTION__,
-                captureRequest->mResultExtras.requestId, captureRequest->mResultExtras.frameNumber,
-                captureRequest->mResultExtras.burstId);
+                nextRequest.resultExtras.requestId, nextRequest.resultExtras.frameNumber,
+                nextRequest.resultExtras.burstId);
         if (res != OK) {
             SET_ERR("RequestThread: Unable to register new in-flight request:"
                     " %s (%d)", strerror(-res), res);
@@ -3364,6 +3807,38 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
     return OK;
 }
 
+void Camera3Device::RequestThread::updateLatestRequestLocked(const camera_metadata_t *settings) {
+    // Consecutive requests mostly differ in a few per-frame tags, so only
+    // rewrite those
+    if (mLatestRequest.patch(settings) != OK) {
+        mLatestRequest = settings;
+    }
+}
+
+void Camera3Device::RequestThread::recordSubmission(nsecs_t submitTime, nsecs_t returnTime) {
+    if (mLastSubmissionReturn != 0) {
+        nsecs_t gap = submitTime - mLastSubmissionReturn;
+        Mutex::Autolock l(mSubmissionStatsLock);
+        mSubmissionCount++;
+        mSubmissionGapTotal += gap;
+        if (gap > mSubmissionGapMax) {
+            mSubmissionGapMax = gap;
+        }
+    }
+    mLastSubmissionReturn = returnTime;
+}
+
+void Camera3Device::RequestThread::dumpSubmissionStats(String8 *lines) const {
+    Mutex::Autolock l(mSubmissionStatsLock);
+    if (mSubmissionCount == 0) {
+        lines->append("      No back-to-back submissions\n");
+    } else {
+        lines->appendFormat("      %zu submissions, average gap %" PRId64 " us, max %" PRId64
+                " us\n", mSubmissionCount, mSubmissionGapTotal / mSubmissionCount / 1000,
+                mSubmissionGapMax / 1000);
+    }
+}
+
 CameraMetadata Camera3Device::RequestThread::getLatestRequest() const {
     Mutex::Autolock al(mLatestRequestMutex);
 
@@ -3385,6 +3860,13 @@ bool Camera3Device::RequestThread::isStreamPending(
         }
     }
 
+    for (const auto& nextRequest : mPrebuiltRequests) {
+        for (const auto& s : nextRequest.captureRequest->mOutputStreams) {
+            if (stream == s) return true;
+        }
+        if (stream == nextRequest.captureRequest->mInputStream) return true;
+    }
+
     for (const auto& request : mRequestQueue) {
         for (const auto& s : request->mOutputStreams) {
             if (stream == s) return true;
@@ -3421,12 +3903,16 @@ void Camera3Device::RequestThread::cleanUpFailedRequests(bool sendRequestError)
             captureRequest->mSettings.unlock(halRequest->settings);
         }
 
-        if (captureRequest->mInputStream != NULL) {
+        if (captureRequest->mInputStream != NULL && !nextRequest.inputBufferReturned) {
             captureRequest->mInputBuffer.status = CAMERA3_BUFFER_STATUS_ERROR;
             captureRequest->mInputStream->returnInputBuffer(captureRequest->mInputBuffer);
         }
 
-        for (size_t i = 0; i < halRequest->num_output_buffers; i++) {
+        // Buffers are gotten in parallel, so any of them may be missing
+        for (size_t i = 0; i < outputBuffers->size(); i++) {
+            if ((*outputBuffers)[i].buffer == NULL) {
+                continue;
+            }
             outputBuffers->editItemAt(i).status = CAMERA3_BUFFER_STATUS_ERROR;
             captureRequest->mOutputStreams.editItemAt(i)->returnBuffer((*outputBuffers)[i], 0);
         }
@@ -3437,7 +3923,7 @@ void Camera3Device::RequestThread::cleanUpFailedRequests(bool sendRequestError)
             if (listener != NULL) {
                 listener->notifyError(
                         hardware::camera2::ICameraDeviceCallbacks::ERROR_CAMERA_REQUEST,
-                        captureRequest->mResultExtras);
+                        nextRequest.resultExtras);
             }
         }
 
@@ -3446,10 +3932,10 @@ void Camera3Device::RequestThread::cleanUpFailedRequests(bool sendRequestError)
           sp<Camera3Device> parent = mParent.promote();
           if (parent != NULL) {
               Mutex::Autolock l(parent->mInFlightLock);
-              ssize_t idx = parent->mInFlightMap.indexOfKey(captureRequest->mResultExtras.frameNumber);
+              ssize_t idx = parent->mInFlightMap.indexOfKey(nextRequest.resultExtras.frameNumber);
               if (idx >= 0) {
                   ALOGV("%s: Remove inflight request from queue: frameNumber %" PRId64,
-                        __FUNCTION__, captureRequest->mResultExtras.frameNumber);
+                        __FUNCTION__, nextRequest.resultExtras.frameNumber);
                   parent->removeInFlightMapEntryLocked(idx);
               }
           }
@@ -3467,29 +3953,17 @@ void Camera3Device::RequestThread::waitForNextRequestBatch() {
 
     assert(mNextRequests.empty());
 
-    NextRequest nextRequest;
-    nextRequest.captureRequest = waitForNextRequestLocked();
-    if (nextRequest.captureRequest == nullptr) {
+    if (!takeNextRequestLocked(&mNextRequests)) {
         return;
     }
 
-    nextRequest.halRequest = camera3_capture_request_t();
-    nextRequest.submitted = false;
-    mNextRequests.add(nextRequest);
-
     // Wait for additional requests
-    const size_t batchSize = nextRequest.captureRequest->mBatchSize;
+    const size_t batchSize = mNextRequests[0].captureRequest->mBatchSize;
 
     for (size_t i = 1; i < batchSize; i++) {
-        NextRequest additionalRequest;
-        additionalRequest.captureRequest = waitForNextRequestLocked();
-        if (additionalRequest.captureRequest == nullptr) {
+        if (!takeNextRequestLocked(&mNextRequests)) {
             break;
         }
-
-        additionalRequest.halRequest = camera3_capture_request_t();
-        additionalRequest.submitted = false;
-        mNextRequests.add(additionalRequest);
     }
 
     if (mNextRequests.size() < batchSize) {
@@ -3501,10 +3975,29 @@ void Camera3Device::RequestThread::waitForNextRequestBatch() {
     return;
 }
 
+bool Camera3Device::RequestThread::takeNextRequestLocked(Vector<NextRequest> *requests,
+        bool lookahead) {
+    NextRequest nextRequest;
+    nextRequest.captureRequest = waitForNextRequestLocked(lookahead);
+    if (nextRequest.captureRequest == nullptr) {
+        return false;
+    }
+
+    nextRequest.halRequest = camera3_capture_request_t();
+    nextRequest.submitted = false;
+    nextRequest.inputBufferReturned = false;
+    nextRequest.resultExtras = nextRequest.captureRequest->mResultExtras;
+    nextRequest.aeTriggerCancelOverride = nextRequest.captureRequest->mAeTriggerCancelOverride;
+    requests->add(nextRequest);
+    return true;
+}
+
 sp<Camera3Device::CaptureRequest>
-        Camera3Device::RequestThread::waitForNextRequestLocked() {
+        Camera3Device::RequestThread::waitForNextRequestLocked(bool lookahead) {
     status_t res;
     sp<CaptureRequest> nextRequest;
+    bool triedInputBuffer = false;
+    status_t inputBufferRes = OK;
 
     while (mRequestQueue.empty()) {
         if (!mRepeatingRequests.empty()) {
@@ -3525,6 +4018,8 @@ sp<Camera3Device::CaptureRequest>
             break;
         }
 
+        // Out of requests, so the next submission doesn't follow on from the last one
+        mLastSubmissionReturn = 0;
         res = mRequestSignal.waitRelative(mRequestLock, kRequestTimeout);
 
         if ((mRequestQueue.empty() && mRepeatingRequests.empty()) ||
@@ -3551,6 +4046,18 @@ sp<Camera3Device::CaptureRequest>
                 mRequestQueue.begin();
         nextRequest = *firstRequest;
         mRequestQueue.erase(firstRequest);
+
+        // Don't wait for the HAL to hand back an input buffer while looking
+        // ahead; the request gets its turn once the current batch is submitted
+        if (lookahead && nextRequest->mInputStream != NULL) {
+            inputBufferRes = nextRequest->mInputStream->tryGetInputBuffer(
+                    &nextRequest->mInputBuffer);
+            if (inputBufferRes == WOULD_BLOCK) {
+                mRequestQueue.push_front(nextRequest);
+                return NULL;
+            }
+            triedInputBuffer = true;
+        }
     }
 
     // In case we've been unpaused by setPaused clearing mDoPause, need to
@@ -3581,7 +4088,8 @@ sp<Camera3Device::CaptureRequest>
         // Since RequestThread::clear() removes buffers from the input stream,
         // get the right buffer here before unlocking mRequestLock
         if (nextRequest->mInputStream != NULL) {
-            res = nextRequest->mInputStream->getInputBuffer(&nextRequest->mInputBuffer);
+            res = triedInputBuffer ? inputBufferRes :
+                    nextRequest->mInputStream->getInputBuffer(&nextRequest->mInputBuffer);
             if (res != OK) {
                 // Can't get input buffer from gralloc queue - this could be due to
                 // disconnected queue or other producer misbehavior, so not a fatal
@@ -3609,6 +4117,7 @@ bool Camera3Device::RequestThread::waitIfPaused() {
     status_t res;
     Mutex::Autolock l(mPauseLock);
     while (mDoPause) {
+        mLastSubmissionReturn = 0;
         if (mPaused == false) {
             mPaused = true;
             ALOGV("%s: RequestThread: Paused", __FUNCTION__);
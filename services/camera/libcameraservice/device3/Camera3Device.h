@@ -27,10 +27,13 @@
 #include <hardware/camera3.h>
 #include <camera/CaptureResult.h>
 
+#include <vector>
+
 #include "common/CameraDeviceBase.h"
 #include "device3/StatusTracker.h"
 #include "device3/Camera3BufferManager.h"
 #include "utils/TagMonitor.h"
+#include "utils/FrameNumberRing.h"
 
 /**
  * Function pointer types with C calling convention to
@@ -136,6 +139,8 @@ class Camera3Device :
     virtual bool     willNotify3A();
     virtual status_t waitForNextFrame(nsecs_t timeout);
     virtual status_t getNextResult(CaptureResult *frame);
+    virtual status_t getNextResults(std::vector<CaptureResult> *frames);
+    virtual void     recycleResults(std::vector<CaptureResult> *frames);
 
     virtual status_t triggerAutofocus(uint32_t id);
     virtual status_t triggerCancelAutofocus(uint32_t id);
@@ -177,6 +182,11 @@ class Camera3Device :
     static const nsecs_t       kActiveTimeout     = 500000000;  // 500 ms
     static const size_t        kInFlightWarnLimit = 20;
     static const size_t        kInFlightWarnLimitHighSpeed = 256; // batch size 32 * pipe depth 8
+    // Number of result metadata buffers kept around for reuse
+    static const size_t        kResultMetadataPoolSize = 16;
+    // Room left in a pooled result buffer for the entries the framework adds
+    static const size_t        kResultMetadataExtraEntries = 8;
+    static const size_t        kResultMetadataExtraData = 64;
     // SCHED_FIFO priority for request submission thread in HFR mode
     static const int           kRequestThreadPriority = 1;
 
@@ -448,6 +458,69 @@ class Camera3Device :
         }
     };
 
+    /**
+     * Gets the output buffers for a batch of capture requests. Buffers of
+     * different streams are dequeued in parallel on a few helper threads;
+     * buffers of one stream are dequeued in the order they were added.
+     */
+    class OutputBufferAcquirer : public virtual RefBase {
+      public:
+        explicit OutputBufferAcquirer(size_t threadCount);
+        ~OutputBufferAcquirer();
+
+        /**
+         * Queue up a buffer to get from the stream into *buffer. The buffer
+         * struct must stay in place until wait() returns.
+         */
+        void     add(const sp<camera3::Camera3OutputStreamInterface>& stream,
+                camera3_stream_buffer_t *buffer);
+
+        /**
+         * Start getting all queued buffers.
+         */
+        void     start();
+
+        /**
+         * Wait until all queued buffers have been handled, helping out on the
+         * calling thread meanwhile. Returns the first error from getBuffer;
+         * buffers that could not be gotten are left zeroed (buffer == NULL).
+         */
+        status_t wait();
+
+      private:
+        class WorkerThread : public Thread {
+          public:
+            explicit WorkerThread(OutputBufferAcquirer *parent);
+          private:
+            virtual bool threadLoop();
+            OutputBufferAcquirer *mParent;
+        };
+
+        struct Job {
+            sp<camera3::Camera3OutputStreamInterface> stream;
+            Vector<camera3_stream_buffer_t*> buffers;
+        };
+
+        // Run the next job, unlocking mLock meanwhile. Must be called with
+        // mLock held and a job available.
+        void runNextJobLocked();
+        bool hasJobLocked() const;
+
+        Mutex mLock;
+        Condition mJobSignal;
+        Condition mDoneSignal;
+
+        // Guarded by mLock
+        Vector<Job> mJobs;
+        size_t mNextJob;
+        size_t mJobsRunning;
+        bool mStarted;
+        bool mExiting;
+        status_t mResult;
+
+        Vector<sp<WorkerThread> > mThreads;
+    };
+
     /**
      * Thread for managing capture request submission to HAL device.
      */
@@ -459,6 +532,7 @@ class Camera3Device :
                 sp<camera3::StatusTracker> statusTracker,
                 camera3_device_t *hal3Device,
                 bool aeLockAvailable);
+        ~RequestThread();
 
         void     setNotificationListener(wp<NotificationListener> listener);
 
@@ -533,6 +607,12 @@ class Camera3Device :
          */
         bool isStreamPending(sp<camera3::Camera3StreamInterface>& stream);
 
+        /**
+         * Append statistics on the gaps between consecutive
+         * process_capture_request calls while streaming.
+         */
+        void     dumpSubmissionStats(String8 *lines) const;
+
       protected:
 
         virtual bool threadLoop();
@@ -553,12 +633,23 @@ class Camera3Device :
 
         static const nsecs_t kRequestTimeout = 50e6; // 50 ms
 
+        // Helper threads for getting output buffers, in addition to the request thread
+        static const size_t kOutputBufferAcquireThreads = 2;
+
         // Used to prepare a batch of requests.
         struct NextRequest {
             sp<CaptureRequest>              captureRequest;
             camera3_capture_request_t       halRequest;
             Vector<camera3_stream_buffer_t> outputBuffers;
             bool                            submitted;
+            // Copied from captureRequest when it is taken off the queue. A
+            // repeating request can be taken again before this one is submitted,
+            // so the per-frame values can't be read back from captureRequest.
+            CaptureResultExtras             resultExtras;
+            AeTriggerCancelOverride_t       aeTriggerCancelOverride;
+            // Set by clear() when it hands back the input buffer of a prebuilt reprocess
+            // request ahead of the request thread.
+            bool                            inputBufferReturned;
         };
 
         // Wait for the next batch of requests and put them in mNextRequests. mNextRequests will
@@ -566,11 +657,38 @@ class Camera3Device :
         void waitForNextRequestBatch();
 
         // Waits for a request, or returns NULL if times out. Must be called with mRequestLock hold.
-        sp<CaptureRequest> waitForNextRequestLocked();
-
-        // Prepare HAL requests and output buffers in mNextRequests. Return TIMED_OUT if getting any
-        // output buffer timed out. If an error is returned, the caller should clean up the pending
-        // request batch.
+        // With lookahead set, a reprocess request whose input buffer isn't available right away
+        // is left at the head of the queue and NULL is returned.
+        sp<CaptureRequest> waitForNextRequestLocked(bool lookahead = false);
+
+        // Waits for a request and appends it to requests. Returns false if it times out. Must be
+        // called with mRequestLock held.
+        bool takeNextRequestLocked(Vector<NextRequest> *requests, bool lookahead = false);
+
+        // If a whole batch of requests can be taken off the queue without waiting, take it into
+        // mPrebuiltRequests along with any input buffer, and start getting its output buffers, so
+        // that they are ready by the time the current batch has been submitted.
+        void prebuildNextRequestBatch();
+
+        // If the next batch of requests is available without waiting. Must be called with
+        // mRequestLock held.
+        bool isNextRequestBatchReadyLocked() const;
+
+        // Queue up the output buffers of a batch of requests on mBufferAcquirer and start
+        // getting them.
+        void startGettingOutputBuffers(Vector<NextRequest> *requests);
+
+        // Move mPrebuiltRequests into mNextRequests once their output buffers have been
+        // handled. Returns the result of getting the buffers, or TIMED_OUT if the batch was
+        // cancelled by clear().
+        status_t takePrebuiltRequests();
+
+        // Return buffers, etc, for requests in mPrebuiltRequests and send request errors if
+        // sendRequestError is true. mNextRequests must be empty.
+        void cleanUpPrebuiltRequests(bool sendRequestError);
+
+        // Prepare HAL requests in mNextRequests, whose output buffers must already be in place.
+        // If an error is returned, the caller should clean up the pending request batch.
         status_t prepareHalRequests();
 
         // Return buffers, etc, for requests in mNextRequests that couldn't be fully constructed and
@@ -578,6 +696,13 @@ class Camera3Device :
         // ERROR state to mark them as not having valid data. mNextRequests will be cleared.
         void cleanUpFailedRequests(bool sendRequestError);
 
+        // Update mLatestRequest with the settings sent to the HAL, rewriting only the
+        // entries that changed. Must be called with mLatestRequestMutex held.
+        void updateLatestRequestLocked(const camera_metadata_t *settings);
+
+        // Record the gap since the previous process_capture_request call returned.
+        void recordSubmission(nsecs_t submitTime, nsecs_t returnTime);
+
         // Stop the repeating request if any of its output streams is abandoned.
         void checkAndStopRepeatingRequest();
 
@@ -615,6 +740,14 @@ class Camera3Device :
         // on the request queue. Read-only even with mRequestLock held, outside
         // of threadLoop
         Vector<NextRequest> mNextRequests;
+        // The batch after mNextRequests, taken off the request queue early so that its output
+        // buffers are gotten while mNextRequests is submitted. Same access rules as
+        // mNextRequests.
+        Vector<NextRequest> mPrebuiltRequests;
+        // Set by clear() to drop mPrebuiltRequests instead of submitting them
+        bool               mPrebuiltRequestsCancelled;
+
+        sp<OutputBufferAcquirer> mBufferAcquirer;
 
         // To protect flush() and sending a request batch to HAL.
         Mutex              mFlushLock;
@@ -639,6 +772,13 @@ class Camera3Device :
         int32_t            mLatestRequestId;
         CameraMetadata     mLatestRequest;
 
+        // Gaps between process_capture_request calls; reset when the thread idles
+        mutable Mutex      mSubmissionStatsLock;
+        nsecs_t            mLastSubmissionReturn;
+        size_t             mSubmissionCount;
+        nsecs_t            mSubmissionGapTotal;
+        nsecs_t            mSubmissionGapMax;
+
         typedef KeyedVector<uint32_t/*tag*/, RequestTrigger> TriggerMap;
         Mutex              mTriggerMutex;
         TriggerMap         mTriggerMap;
@@ -696,7 +836,7 @@ class Camera3Device :
         // CONTROL_AE_PRECAPTURE_TRIGGER_CANCEL
         AeTriggerCancelOverride_t aeTriggerCancelOverride;
 
-        // Default constructor needed by KeyedVector
+        // Default constructor needed by FrameNumberRing
         InFlightRequest() :
                 shutterTimestamp(0),
                 sensorTimestamp(0),
@@ -720,8 +860,10 @@ class Camera3Device :
         }
     };
 
-    // Map from frame number to the in-flight request state
-    typedef KeyedVector<uint32_t, InFlightRequest> InFlightMap;
+    // Map from frame number to the in-flight request state. A ring indexed by
+    // frame number, so registering and retiring requests doesn't shift or
+    // reallocate the other entries.
+    typedef FrameNumberRing<InFlightRequest> InFlightMap;
 
     Mutex                  mInFlightLock; // Protects mInFlightMap
     InFlightMap            mInFlightMap;
@@ -806,10 +948,31 @@ class Camera3Device :
     uint32_t               mNextShutterFrameNumber;
     // the minimal frame number of the next reprocess shutter
     uint32_t               mNextReprocessShutterFrameNumber;
-    List<CaptureResult>   mResultQueue;
+    // Results waiting to be picked up; entries before mResultQueueHead have
+    // already been handed out. Swapped wholesale with the caller's vector in
+    // getNextResults, so both sides keep their capacity across frames.
+    std::vector<CaptureResult> mResultQueue;
+    size_t                 mResultQueueHead;
+    // System time of the HAL callback that completed each queued result
+    std::vector<nsecs_t>   mResultQueueTimes;
     Condition              mResultSignal;
     wp<NotificationListener>  mListener;
 
+    // Empty result metadata buffers for reuse by later results
+    Vector<camera_metadata_t*> mResultMetadataPool;
+    // Largest result seen so far, used to size new pooled buffers
+    size_t                 mResultMetadataEntries;
+    size_t                 mResultMetadataData;
+
+    // Latency from HAL callback to the result being picked up by the client
+    struct ResultLatencyStats {
+        ResultLatencyStats() : count(0), total(0), max(0) {}
+        size_t count;
+        nsecs_t total;
+        nsecs_t max;
+    };
+    ResultLatencyStats     mResultLatency;
+
     /**** End scope for mOutputLock ****/
 
     /**
@@ -829,23 +992,36 @@ class Camera3Device :
     void returnOutputBuffers(const camera3_stream_buffer_t *outputBuffers,
             size_t numBuffers, nsecs_t timestamp);
 
-    // Send a partial capture result.
+    // Send a partial capture result. halCallbackTime is when the HAL
+    // callback that carried the result started.
     void sendPartialCaptureResult(const camera_metadata_t * partialResult,
             const CaptureResultExtras &resultExtras, uint32_t frameNumber,
-            const AeTriggerCancelOverride_t &aeTriggerCancelOverride);
+            const AeTriggerCancelOverride_t &aeTriggerCancelOverride,
+            nsecs_t halCallbackTime);
 
     // Send a total capture result given the pending metadata and result extras,
     // partial results, and the frame number to the result queue.
-    void sendCaptureResult(CameraMetadata &pendingMetadata,
+    void sendCaptureResult(const camera_metadata_t *pendingMetadata,
             CaptureResultExtras &resultExtras,
             CameraMetadata &collectedPartialResult, uint32_t frameNumber,
-            bool reprocess, const AeTriggerCancelOverride_t &aeTriggerCancelOverride);
+            bool reprocess, const AeTriggerCancelOverride_t &aeTriggerCancelOverride,
+            nsecs_t halCallbackTime);
 
     // Insert the result to the result queue after updating frame number and overriding AE
-    // trigger cancel.
+    // trigger cancel. Takes over the result's metadata.
     // mOutputLock must be held when calling this function.
     void insertResultLocked(CaptureResult *result, uint32_t frameNumber,
-            const AeTriggerCancelOverride_t &aeTriggerCancelOverride);
+            const AeTriggerCancelOverride_t &aeTriggerCancelOverride,
+            nsecs_t halCallbackTime);
+
+    // Get an empty metadata buffer with at least the given capacity, from the
+    // pool if possible. mOutputLock must be held when calling this function.
+    camera_metadata_t* obtainResultMetadataLocked(size_t entryCapacity,
+            size_t dataCapacity);
+
+    // Account for the delivery latency of the results in
+    // mResultQueue[begin, end). mOutputLock must be held.
+    void recordResultLatencyLocked(size_t begin, size_t end);
 
     /**** Scope for mInFlightLock ****/
 
@@ -67,7 +67,11 @@ status_t Camera3InputStream::getInputBufferLocked(
     BufferItem bufferItem;
 
     res = mConsumer->acquireBuffer(&bufferItem, /*waitForFence*/false);
-    if (res != OK) {
+    if (res == BufferQueue::NO_BUFFER_AVAILABLE) {
+        // Not an error for callers that only try
+        ALOGV("%s: Stream %d: No input buffer queued yet", __FUNCTION__, mId);
+        return res;
+    } else if (res != OK) {
         ALOGE("%s: Stream %d: Can't acquire next output buffer: %s (%d)",
                 __FUNCTION__, mId, strerror(-res), res);
         return res;
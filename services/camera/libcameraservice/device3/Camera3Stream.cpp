@@ -18,6 +18,7 @@
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 //#define LOG_NDEBUG 0
 
+#include <gui/BufferQueue.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 #include "device3/Camera3Stream.h"
@@ -549,6 +550,15 @@ status_t Camera3Stream::returnBuffer(const camera3_stream_buffer &buffer,
 
 status_t Camera3Stream::getInputBuffer(camera3_stream_buffer *buffer) {
     ATRACE_CALL();
+    return getInputBufferImpl(buffer, /*wait*/true);
+}
+
+status_t Camera3Stream::tryGetInputBuffer(camera3_stream_buffer *buffer) {
+    ATRACE_CALL();
+    return getInputBufferImpl(buffer, /*wait*/false);
+}
+
+status_t Camera3Stream::getInputBufferImpl(camera3_stream_buffer *buffer, bool wait) {
     Mutex::Autolock l(mLock);
     status_t res = OK;
 
@@ -561,6 +571,9 @@ status_t Camera3Stream::getInputBuffer(camera3_stream_buffer *buffer) {
 
     // Wait for new buffer returned back if we are running into the limit.
     if (getHandoutInputBufferCountLocked() == camera3_stream::max_buffers) {
+        if (!wait) {
+            return WOULD_BLOCK;
+        }
         ALOGV("%s: Already dequeued max input buffers (%d), wait for next returned one.",
                 __FUNCTION__, camera3_stream::max_buffers);
         res = mInputBufferReturnedSignal.waitRelative(mLock, kWaitForBufferDuration);
@@ -574,6 +587,9 @@ status_t Camera3Stream::getInputBuffer(camera3_stream_buffer *buffer) {
     }
 
     res = getInputBufferLocked(buffer);
+    if (!wait && res == BufferQueue::NO_BUFFER_AVAILABLE) {
+        return WOULD_BLOCK;
+    }
     if (res == OK) {
         fireBufferListenersLocked(*buffer, /*acquired*/true, /*output*/false);
         if (buffer->buffer) {
@@ -301,6 +301,13 @@ class Camera3Stream :
      */
     status_t         getInputBuffer(camera3_stream_buffer *buffer);
 
+    /**
+     * Like getInputBuffer(), but return WOULD_BLOCK right away instead of
+     * waiting when the HAL already holds the maximum number of input buffers,
+     * or when the producer hasn't queued an input buffer yet.
+     */
+    status_t         tryGetInputBuffer(camera3_stream_buffer *buffer);
+
     /**
      * Return a buffer to the stream after use by the HAL.
      *
@@ -460,6 +467,9 @@ class Camera3Stream :
     // Gets all buffers from endpoint and registers them with the HAL.
     status_t registerBuffersLocked(camera3_device *hal3Device);
 
+    // Shared by getInputBuffer() and tryGetInputBuffer().
+    status_t getInputBufferImpl(camera3_stream_buffer *buffer, bool wait);
+
     void fireBufferListenersLocked(const camera3_stream_buffer& buffer,
                                   bool acquired, bool output);
     List<wp<Camera3StreamBufferListener> > mBufferListenerList;
@@ -222,6 +222,13 @@ class Camera3StreamInterface : public virtual RefBase {
      */
     virtual status_t getInputBuffer(camera3_stream_buffer *buffer) = 0;
 
+    /**
+     * Like getInputBuffer(), but return WOULD_BLOCK right away instead of
+     * waiting when the HAL already holds the maximum number of input buffers,
+     * or when the producer hasn't queued an input buffer yet.
+     */
+    virtual status_t tryGetInputBuffer(camera3_stream_buffer *buffer) = 0;
+
     /**
      * Return a buffer to the stream after use by the HAL.
      *
@@ -19,6 +19,7 @@
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
 #include <inttypes.h>
+#include <sched.h>
 
 #include <utils/Log.h>
 
@@ -42,12 +43,22 @@ RingBufferConsumer::RingBufferConsumer(const sp<IGraphicBufferConsumer>& consume
         int bufferCount) :
     ConsumerBase(consumer),
     mBufferCount(bufferCount),
+    mEntries(new RingEntry[bufferCount > 0 ? bufferCount : 0]),
+    mOrder(new std::atomic<int32_t>[bufferCount > 0 ? bufferCount : 0]),
+    mOrderSize(0),
+    mOrderVersion(0),
     mLatestTimestamp(0)
 {
     mConsumer->setConsumerUsageBits(consumerUsage);
     mConsumer->setMaxAcquiredBufferCount(bufferCount);
 
     assert(bufferCount > 0);
+
+    // Hand out the entries in ascending order
+    for (int i = bufferCount - 1; i >= 0; --i) {
+        mFreeEntries.push_back(i);
+        mOrder[i].store(-1, std::memory_order_relaxed);
+    }
 }
 
 RingBufferConsumer::~RingBufferConsumer() {
@@ -63,27 +74,27 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
         const RingBufferComparator& filter,
         bool waitForFence) {
 
-    sp<PinnedBufferItem> pinnedBuffer;
+    int selected = -1;
 
     {
-        List<RingBufferItem>::iterator it, end, accIt;
         BufferInfo acc, cur;
         BufferInfo* accPtr = NULL;
 
         Mutex::Autolock _l(mMutex);
 
-        for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-             it != end;
-             ++it) {
-
-            const RingBufferItem& item = *it;
+        // Entries in the index can't be evicted or refilled while mMutex is
+        // held, so their items are stable here.
+        int32_t size = mOrderSize.load(std::memory_order_relaxed);
+        for (int32_t i = 0; i < size; ++i) {
+            int entry = mOrder[i].load(std::memory_order_relaxed);
+            const BufferItem& item = mEntries[entry].mItem;
 
             cur.mCrop = item.mCrop;
             cur.mTransform = item.mTransform;
             cur.mScalingMode = item.mScalingMode;
             cur.mTimestamp = item.mTimestamp;
             cur.mFrameNumber = item.mFrameNumber;
-            cur.mPinned = item.mPinCount > 0;
+            cur.mPinned = mEntries[entry].mPinState.load(std::memory_order_relaxed) > 0;
 
             int ret = filter.compare(accPtr, &cur);
 
@@ -92,7 +103,7 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
             } else if (ret > 0) {
                 acc = cur;
                 accPtr = &acc;
-                accIt = it;
+                selected = entry;
             } // else acc = acc
         }
 
@@ -100,11 +111,45 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
             return NULL;
         }
 
-        pinnedBuffer = new PinnedBufferItem(this, *accIt);
-        pinBufferLocked(pinnedBuffer->getBufferItem());
+        mEntries[selected].mPinState.fetch_add(1, std::memory_order_acquire);
 
     } // end scope of mMutex autolock
 
+    return makePinnedBuffer(selected, waitForFence);
+}
+
+sp<PinnedBufferItem> RingBufferConsumer::pinBufferByTimestamp(nsecs_t timestamp,
+        bool waitForFence) {
+    int entry;
+    uint64_t frameNumber;
+
+    // Retries only when the index or the selected entry changed underneath
+    // us, i.e. when onFrameAvailable made progress in the meantime.
+    while (true) {
+        if (!findByTimestamp(timestamp, &entry, &frameNumber)) {
+            sched_yield();
+            continue;
+        }
+        if (entry < 0) {
+            return NULL;
+        }
+        if (tryPinEntry(entry, frameNumber)) {
+            break;
+        }
+        sched_yield();
+    }
+
+    return makePinnedBuffer(entry, waitForFence);
+}
+
+sp<PinnedBufferItem> RingBufferConsumer::makePinnedBuffer(int entry, bool waitForFence) {
+    sp<PinnedBufferItem> pinnedBuffer =
+            new PinnedBufferItem(this, mEntries[entry].mItem, entry);
+
+    BI_LOGV("Pinned buffer (frame %" PRIu64 ", timestamp %" PRId64 ")",
+            pinnedBuffer->getBufferItem().mFrameNumber,
+            pinnedBuffer->getBufferItem().mTimestamp);
+
     if (waitForFence) {
         status_t err = pinnedBuffer->getBufferItem().mFence->waitForever(
                 "RingBufferConsumer::pinSelectedBuffer");
@@ -117,6 +162,123 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
     return pinnedBuffer;
 }
 
+bool RingBufferConsumer::findByTimestamp(nsecs_t timestamp, int* entry,
+        uint64_t* frameNumber) const {
+    uint32_t version = mOrderVersion.load(std::memory_order_acquire);
+    if (version & 1) {
+        return false;
+    }
+
+    *entry = -1;
+    *frameNumber = 0;
+
+    int32_t size = mOrderSize.load(std::memory_order_relaxed);
+    if (size > 0 && size <= mBufferCount) {
+        // First buffer not older than the timestamp
+        int32_t low = 0, high = size;
+        while (low < high) {
+            int32_t mid = low + (high - low) / 2;
+            int e = mOrder[mid].load(std::memory_order_relaxed);
+            if (e < 0 || e >= mBufferCount) {
+                return false;
+            }
+            if (mEntries[e].mTimestamp.load(std::memory_order_relaxed) < timestamp) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        int32_t position = low;
+        if (position > 0 && position < size) {
+            // The order may change under us; check what we read before use
+            int e = mOrder[position].load(std::memory_order_relaxed);
+            if (e < 0 || e >= mBufferCount) {
+                return false;
+            }
+            if (mEntries[e].mTimestamp.load(std::memory_order_relaxed) != timestamp) {
+                // No exact match; prefer the closest older buffer
+                --position;
+            }
+        } else if (position == size) {
+            --position;
+        }
+
+        *entry = mOrder[position].load(std::memory_order_relaxed);
+        if (*entry < 0 || *entry >= mBufferCount) {
+            return false;
+        }
+        *frameNumber = mEntries[*entry].mFrameNumber.load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return mOrderVersion.load(std::memory_order_relaxed) == version;
+}
+
+bool RingBufferConsumer::tryPinEntry(int entry, uint64_t frameNumber) {
+    RingEntry& e = mEntries[entry];
+
+    int32_t state = e.mPinState.load(std::memory_order_relaxed);
+    do {
+        if (state == ENTRY_UNAVAILABLE) {
+            // Being evicted or refilled
+            return false;
+        }
+    } while (!e.mPinState.compare_exchange_weak(state, state + 1,
+            std::memory_order_acquire, std::memory_order_relaxed));
+
+    // The entry may have been evicted and refilled with a newer frame after
+    // it was looked up.
+    if (e.mFrameNumber.load(std::memory_order_relaxed) != frameNumber) {
+        e.mPinState.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+void RingBufferConsumer::insertOrderLocked(int entry) {
+    int32_t size = mOrderSize.load(std::memory_order_relaxed);
+    int64_t timestamp = mEntries[entry].mTimestamp.load(std::memory_order_relaxed);
+
+    // Frames normally arrive in timestamp order, so this is the last slot
+    int32_t position = size;
+    while (position > 0 && mEntries[mOrder[position - 1].load(
+            std::memory_order_relaxed)].mTimestamp.load(
+            std::memory_order_relaxed) > timestamp) {
+        --position;
+    }
+
+    uint32_t version = mOrderVersion.load(std::memory_order_relaxed);
+    mOrderVersion.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int32_t i = size; i > position; --i) {
+        mOrder[i].store(mOrder[i - 1].load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+    }
+    mOrder[position].store(entry, std::memory_order_relaxed);
+    mOrderSize.store(size + 1, std::memory_order_relaxed);
+
+    mOrderVersion.store(version + 2, std::memory_order_release);
+}
+
+void RingBufferConsumer::removeOrderLocked(size_t position) {
+    int32_t size = mOrderSize.load(std::memory_order_relaxed);
+
+    uint32_t version = mOrderVersion.load(std::memory_order_relaxed);
+    mOrderVersion.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int32_t i = position; i < size - 1; ++i) {
+        mOrder[i].store(mOrder[i + 1].load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+    }
+    mOrder[size - 1].store(-1, std::memory_order_relaxed);
+    mOrderSize.store(size - 1, std::memory_order_relaxed);
+
+    mOrderVersion.store(version + 2, std::memory_order_release);
+}
+
 status_t RingBufferConsumer::clear() {
 
     status_t err;
@@ -125,7 +287,7 @@ status_t RingBufferConsumer::clear() {
     BI_LOGV("%s", __FUNCTION__);
 
     // Avoid annoying log warnings by returning early
-    if (mBufferItemList.size() == 0) {
+    if (mOrderSize.load(std::memory_order_relaxed) == 0) {
         return OK;
     }
 
@@ -134,7 +296,7 @@ status_t RingBufferConsumer::clear() {
         err = releaseOldestBufferLocked(&pinnedFrames);
 
         if (err == NO_BUFFER_AVAILABLE) {
-            assert(pinnedFrames == mBufferItemList.size());
+            assert(pinnedFrames == (size_t)mOrderSize.load(std::memory_order_relaxed));
             break;
         }
 
@@ -154,46 +316,16 @@ status_t RingBufferConsumer::clear() {
 }
 
 nsecs_t RingBufferConsumer::getLatestTimestamp() {
-    Mutex::Autolock _l(mMutex);
-    if (mBufferItemList.size() == 0) {
+    if (mOrderSize.load(std::memory_order_acquire) == 0) {
         return 0;
     }
-    return mLatestTimestamp;
-}
-
-void RingBufferConsumer::pinBufferLocked(const BufferItem& item) {
-    List<RingBufferItem>::iterator it, end;
-
-    for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-         it != end;
-         ++it) {
-
-        RingBufferItem& find = *it;
-        if (item.mGraphicBuffer == find.mGraphicBuffer) {
-            find.mPinCount++;
-            break;
-        }
-    }
-
-    if (it == end) {
-        BI_LOGE("Failed to pin buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
-                 item.mTimestamp, item.mFrameNumber);
-    } else {
-        BI_LOGV("Pinned buffer (frame %" PRIu64 ", timestamp %" PRId64 ")",
-                item.mFrameNumber, item.mTimestamp);
-    }
+    return mLatestTimestamp.load(std::memory_order_relaxed);
 }
 
 status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
-    status_t err = OK;
-
-    List<RingBufferItem>::iterator it, end, accIt;
+    int32_t size = mOrderSize.load(std::memory_order_relaxed);
 
-    it = mBufferItemList.begin();
-    end = mBufferItemList.end();
-    accIt = end;
-
-    if (it == end) {
+    if (size == 0) {
         /**
          * This is fine. We really care about being able to acquire a buffer
          * successfully after this function completes, not about it releasing
@@ -204,10 +336,14 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
         return NOT_ENOUGH_DATA;
     }
 
-    for (; it != end; ++it) {
-        RingBufferItem& find = *it;
-
-        if (find.mPinCount > 0) {
+    // The index is ordered by timestamp, so the first entry that can be
+    // claimed is the oldest unpinned one. Claiming it (0 -> unavailable)
+    // fails if a pin races with us, in which case the entry is pinned.
+    for (int32_t i = 0; i < size; ++i) {
+        int entry = mOrder[i].load(std::memory_order_relaxed);
+        int32_t unpinned = 0;
+        if (!mEntries[entry].mPinState.compare_exchange_strong(unpinned, ENTRY_UNAVAILABLE,
+                std::memory_order_acquire, std::memory_order_relaxed)) {
             if (pinnedFrames != NULL) {
                 ++(*pinnedFrames);
             }
@@ -215,53 +351,75 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
             continue;
         }
 
-        if (find.mTimestamp < accIt->mTimestamp || accIt == end) {
-            accIt = it;
+        removeOrderLocked(i);
+
+        status_t err = releaseEntryLocked(entry);
+        if (err != OK) {
+            // Keep the buffer in the ring; it is still acquired
+            mEntries[entry].mPinState.store(0, std::memory_order_release);
+            insertOrderLocked(entry);
+            return err;
         }
-    }
 
-    if (accIt != end) {
-        RingBufferItem& item = *accIt;
+        mFreeEntries.push_back(entry);
+        return OK;
+    }
 
-        // In case the object was never pinned, pass the acquire fence
-        // back to the release fence. If the fence was already waited on,
-        // it'll just be a no-op to wait on it again.
+    BI_LOGW("All buffers pinned, could not find any to release");
+    return NO_BUFFER_AVAILABLE;
+}
 
-        // item.mGraphicBuffer was populated with the proper graphic-buffer
-        // at acquire even if it was previously acquired
-        err = addReleaseFenceLocked(item.mSlot,
-                item.mGraphicBuffer, item.mFence);
+status_t RingBufferConsumer::releaseEntryLocked(int entry) {
+    status_t err = OK;
+    BufferItem& item = mEntries[entry].mItem;
 
-        if (err != OK) {
-            BI_LOGE("Failed to add release fence to buffer "
-                    "(timestamp %" PRId64 ", framenumber %" PRIu64,
-                    item.mTimestamp, item.mFrameNumber);
-            return err;
-        }
+    // In case the object was never pinned, pass the acquire fence
+    // back to the release fence. If the fence was already waited on,
+    // it'll just be a no-op to wait on it again.
 
-        BI_LOGV("Attempting to release buffer timestamp %" PRId64 ", frame %" PRIu64,
-                item.mTimestamp, item.mFrameNumber);
+    // item.mGraphicBuffer was populated with the proper graphic-buffer
+    // at acquire even if it was previously acquired
+    err = addReleaseFenceLocked(item.mSlot,
+            item.mGraphicBuffer, item.mFence);
 
-        // item.mGraphicBuffer was populated with the proper graphic-buffer
-        // at acquire even if it was previously acquired
-        err = releaseBufferLocked(item.mSlot, item.mGraphicBuffer,
-                                  EGL_NO_DISPLAY,
-                                  EGL_NO_SYNC_KHR);
-        if (err != OK) {
-            BI_LOGE("Failed to release buffer: %s (%d)",
-                    strerror(-err), err);
-            return err;
-        }
+    sp<Fence> releaseFence;
+    {
+        Mutex::Autolock _l(mFenceLock);
+        releaseFence = mEntries[entry].mReleaseFence;
+    }
+    if (err == OK && releaseFence != NULL) {
+        err = addReleaseFenceLocked(item.mSlot, item.mGraphicBuffer, releaseFence);
+    }
 
-        BI_LOGV("Buffer timestamp %" PRId64 ", frame %" PRIu64 " evicted",
+    if (err != OK) {
+        BI_LOGE("Failed to add release fence to buffer "
+                "(timestamp %" PRId64 ", framenumber %" PRIu64,
                 item.mTimestamp, item.mFrameNumber);
+        return err;
+    }
 
-        mBufferItemList.erase(accIt);
-    } else {
-        BI_LOGW("All buffers pinned, could not find any to release");
-        return NO_BUFFER_AVAILABLE;
+    BI_LOGV("Attempting to release buffer timestamp %" PRId64 ", frame %" PRIu64,
+            item.mTimestamp, item.mFrameNumber);
+
+    // item.mGraphicBuffer was populated with the proper graphic-buffer
+    // at acquire even if it was previously acquired
+    err = releaseBufferLocked(item.mSlot, item.mGraphicBuffer,
+                              EGL_NO_DISPLAY,
+                              EGL_NO_SYNC_KHR);
+    if (err != OK) {
+        BI_LOGE("Failed to release buffer: %s (%d)",
+                strerror(-err), err);
+        return err;
+    }
 
+    BI_LOGV("Buffer timestamp %" PRId64 ", frame %" PRIu64 " evicted",
+            item.mTimestamp, item.mFrameNumber);
+
+    {
+        Mutex::Autolock _l(mFenceLock);
+        mEntries[entry].mReleaseFence.clear();
     }
+    item = BufferItem();
 
     return OK;
 }
@@ -275,7 +433,7 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
         /**
          * Release oldest frame
          */
-        if (mBufferItemList.size() >= (size_t)mBufferCount) {
+        if (mOrderSize.load(std::memory_order_relaxed) >= mBufferCount) {
             err = releaseOldestBufferLocked(/*pinnedFrames*/NULL);
             assert(err != NOT_ENOUGH_DATA);
 
@@ -288,8 +446,10 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
             // we could've locked but didn't because there was no space
         }
 
-        RingBufferItem& item = *mBufferItemList.insert(mBufferItemList.end(),
-                                                       RingBufferItem());
+        assert(!mFreeEntries.isEmpty());
+        int entry = mFreeEntries.top();
+        RingEntry& ringEntry = mEntries[entry];
+        BufferItem& item = ringEntry.mItem;
 
         /**
          * Acquire new frame
@@ -300,56 +460,64 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
                 BI_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
             }
 
-            mBufferItemList.erase(--mBufferItemList.end());
+            item = BufferItem();
             return;
         }
+        mFreeEntries.pop();
+
+        item.mGraphicBuffer = mSlots[item.mSlot].mGraphicBuffer;
+
+        // Publish the entry: the item is complete before the pin state
+        // makes it pinnable, and the index makes it findable.
+        ringEntry.mTimestamp.store(item.mTimestamp, std::memory_order_relaxed);
+        ringEntry.mFrameNumber.store(item.mFrameNumber, std::memory_order_relaxed);
+        ringEntry.mPinState.store(0, std::memory_order_release);
+        insertOrderLocked(entry);
 
         BI_LOGV("New buffer acquired (timestamp %" PRId64 "), "
-                "buffer items %zu out of %d",
+                "buffer items %d out of %d",
                 item.mTimestamp,
-                mBufferItemList.size(), mBufferCount);
+                mOrderSize.load(std::memory_order_relaxed), mBufferCount);
 
-        if (item.mTimestamp < mLatestTimestamp) {
+        int64_t latestTimestamp = mLatestTimestamp.load(std::memory_order_relaxed);
+        if (item.mTimestamp < latestTimestamp) {
             BI_LOGE("Timestamp  decreases from %" PRId64 " to %" PRId64,
-                    mLatestTimestamp, item.mTimestamp);
+                    latestTimestamp, item.mTimestamp);
         }
 
-        mLatestTimestamp = item.mTimestamp;
-
-        item.mGraphicBuffer = mSlots[item.mSlot].mGraphicBuffer;
+        mLatestTimestamp.store(item.mTimestamp, std::memory_order_relaxed);
     } // end of mMutex lock
 
     ConsumerBase::onFrameAvailable(item);
 }
 
-void RingBufferConsumer::unpinBuffer(const BufferItem& item) {
-    Mutex::Autolock _l(mMutex);
-
-    List<RingBufferItem>::iterator it, end, accIt;
-
-    for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-         it != end;
-         ++it) {
-
-        RingBufferItem& find = *it;
-        if (item.mGraphicBuffer == find.mGraphicBuffer) {
-            status_t res = addReleaseFenceLocked(item.mSlot,
-                    item.mGraphicBuffer, item.mFence);
-
-            if (res != OK) {
-                BI_LOGE("Failed to add release fence to buffer "
-                        "(timestamp %" PRId64 ", framenumber %" PRIu64,
-                        item.mTimestamp, item.mFrameNumber);
-                return;
-            }
-
-            find.mPinCount--;
-            break;
+void RingBufferConsumer::unpinBuffer(int entry, const BufferItem& item) {
+    if (entry < 0 || entry >= mBufferCount) {
+        // This should never happen. If it happens, we have a bug.
+        BI_LOGE("Failed to unpin buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
+                 item.mTimestamp, item.mFrameNumber);
+        return;
+    }
+    RingEntry& ringEntry = mEntries[entry];
+
+    // The entry can't be evicted until the pin is dropped below, so its item
+    // is still the one that was pinned. Skip the acquire fence, which is
+    // passed back on eviction anyway.
+    if (item.mFence != NULL && item.mFence->isValid() &&
+            item.mFence != ringEntry.mItem.mFence) {
+        Mutex::Autolock _l(mFenceLock);
+        if (ringEntry.mReleaseFence == NULL) {
+            ringEntry.mReleaseFence = item.mFence;
+        } else {
+            ringEntry.mReleaseFence = Fence::merge(String8("RingBufferConsumer"),
+                    ringEntry.mReleaseFence, item.mFence);
         }
     }
 
-    if (it == end) {
+    int32_t previous = ringEntry.mPinState.fetch_sub(1, std::memory_order_release);
+    if (previous <= 0) {
         // This should never happen. If it happens, we have a bug.
+        ringEntry.mPinState.fetch_add(1, std::memory_order_relaxed);
         BI_LOGE("Failed to unpin buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
                  item.mTimestamp, item.mFrameNumber);
     } else {
@@ -25,7 +25,9 @@
 #include <utils/String8.h>
 #include <utils/Vector.h>
 #include <utils/threads.h>
-#include <utils/List.h>
+
+#include <atomic>
+#include <memory>
 
 #define ANDROID_GRAPHICS_RINGBUFFERCONSUMER_JNI_ID "mRingBufferConsumer"
 
@@ -44,6 +46,12 @@ namespace android {
  *
  * Note that the 'oldest' buffer is the one with the smallest timestamp.
  *
+ * The buffers are kept in a fixed array of ring entries, together with an
+ * index of the entries ordered by timestamp. Only onFrameAvailable and clear
+ * modify the index (under mMutex); pinBufferByTimestamp and unpinning do not
+ * take mMutex at all, so ZSL picks never wait on a frame being acquired or
+ * released, and a new frame never waits on a pick.
+ *
  * Edge cases:
  *  - If ringbuffer is not full, no drops occur when a buffer is produced.
  *  - If all the buffers get filled or pinned then there will be no empty
@@ -120,15 +128,17 @@ class RingBufferConsumer : public ConsumerBase,
 
     struct PinnedBufferItem : public LightRefBase<PinnedBufferItem> {
         PinnedBufferItem(wp<RingBufferConsumer> consumer,
-                         const BufferItem& item) :
+                         const BufferItem& item,
+                         int entry) :
                 mConsumer(consumer),
-                mBufferItem(item) {
+                mBufferItem(item),
+                mEntry(entry) {
         }
 
         ~PinnedBufferItem() {
             sp<RingBufferConsumer> consumer = mConsumer.promote();
             if (consumer != NULL) {
-                consumer->unpinBuffer(mBufferItem);
+                consumer->unpinBuffer(mEntry, mBufferItem);
             }
         }
 
@@ -142,6 +152,7 @@ class RingBufferConsumer : public ConsumerBase,
       private:
         wp<RingBufferConsumer> mConsumer;
         BufferItem             mBufferItem;
+        int                    mEntry;
     };
 
     // Find a buffer using the filter, then pin it before returning it.
@@ -155,6 +166,15 @@ class RingBufferConsumer : public ConsumerBase,
     sp<PinnedBufferItem> pinSelectedBuffer(const RingBufferComparator& filter,
                                            bool waitForFence = true);
 
+    // Pin the buffer whose timestamp matches the given one exactly; if there
+    // is none, the closest older buffer, and failing that the oldest buffer.
+    // Returns NULL if the ring buffer is empty.
+    //
+    // This is a binary search over the timestamp index and does not take
+    // mMutex, so it can run concurrently with onFrameAvailable.
+    sp<PinnedBufferItem> pinBufferByTimestamp(nsecs_t timestamp,
+                                              bool waitForFence = true);
+
     // Release all the non-pinned buffers in the ring buffer
     status_t clear();
 
@@ -166,25 +186,80 @@ class RingBufferConsumer : public ConsumerBase,
     // Override ConsumerBase::onFrameAvailable
     virtual void onFrameAvailable(const BufferItem& item);
 
-    void pinBufferLocked(const BufferItem& item);
-    void unpinBuffer(const BufferItem& item);
+    // Drop one pin from the given ring entry. The item's fence is merged into
+    // the release fence of the entry, which is handed back to the BufferQueue
+    // when the entry is evicted. Does not take mMutex.
+    void unpinBuffer(int entry, const BufferItem& item);
 
     // Releases oldest buffer. Returns NO_BUFFER_AVAILABLE
     // if all the buffers were pinned.
     // Returns NOT_ENOUGH_DATA if list was empty.
     status_t releaseOldestBufferLocked(size_t* pinnedFrames);
 
-    struct RingBufferItem : public BufferItem {
-        RingBufferItem() : BufferItem(), mPinCount(0) {}
-        int mPinCount;
+    // Release the buffer of an entry that has been claimed for eviction
+    // back to the BufferQueue.
+    status_t releaseEntryLocked(int entry);
+
+    // Find the entry selected by pinBufferByTimestamp in the timestamp
+    // index, without locking. Returns false if the index was modified while
+    // it was being read; otherwise *entry is the selected entry (or -1 if the
+    // ring is empty) and *frameNumber its frame number.
+    bool findByTimestamp(nsecs_t timestamp, int* entry, uint64_t* frameNumber) const;
+
+    // Add one pin to an entry, if it still holds frameNumber.
+    bool tryPinEntry(int entry, uint64_t frameNumber);
+
+    // Insert/remove an entry in the timestamp index; mMutex must be held.
+    void insertOrderLocked(int entry);
+    void removeOrderLocked(size_t position);
+
+    // Take a copy of the item of an entry pinned by the caller, and
+    // optionally wait for its acquire fence.
+    sp<PinnedBufferItem> makePinnedBuffer(int entry, bool waitForFence);
+
+    enum {
+        // Pin state of an entry that holds no published buffer: it is free,
+        // being filled by onFrameAvailable, or being evicted.
+        ENTRY_UNAVAILABLE = -1,
+    };
+
+    struct RingEntry {
+        RingEntry() : mPinState(ENTRY_UNAVAILABLE), mTimestamp(0), mFrameNumber(0) {}
+
+        // Only written while mPinState is ENTRY_UNAVAILABLE, and only read
+        // under mMutex or while holding a pin.
+        BufferItem mItem;
+
+        // Merged release fences of unpinned users; guarded by mFenceLock.
+        sp<Fence> mReleaseFence;
+
+        // Number of pins (>= 0) of a published buffer, or ENTRY_UNAVAILABLE.
+        std::atomic<int32_t> mPinState;
+
+        // Copies of mItem's timestamp and frame number for lock-free readers.
+        std::atomic<int64_t> mTimestamp;
+        std::atomic<uint64_t> mFrameNumber;
     };
 
-    // List of acquired buffers in our ring buffer
-    List<RingBufferItem>       mBufferItemList;
     const int                  mBufferCount;
 
+    // Ring entries holding the acquired buffers
+    std::unique_ptr<RingEntry[]> mEntries;
+
+    // Indices of entries that hold no buffer; guarded by mMutex
+    Vector<int>                mFreeEntries;
+
+    // Indices of the published entries ordered by timestamp, oldest first.
+    // Written under mMutex; mOrderVersion is odd while a write is in
+    // progress so that lock-free readers can detect a torn read and retry.
+    std::unique_ptr<std::atomic<int32_t>[]> mOrder;
+    std::atomic<int32_t>       mOrderSize;
+    std::atomic<uint32_t>      mOrderVersion;
+
+    Mutex                      mFenceLock;
+
     // Timestamp of latest buffer
-    nsecs_t mLatestTimestamp;
+    std::atomic<int64_t>       mLatestTimestamp;
 };
 
 } // namespace android
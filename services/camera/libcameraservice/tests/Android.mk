@@ -0,0 +1,80 @@
+# Build the unit tests for libcameraservice.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := RingBufferConsumer_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	RingBufferConsumer_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libutils \
+	libui \
+	libgui \
+	libcameraservice \
+
+LOCAL_C_INCLUDES := \
+	frameworks/av/services/camera/libcameraservice \
+
+LOCAL_CFLAGS += -Werror -Wall -Wextra
+LOCAL_CLANG := true
+
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := Camera3DeviceSubmission_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	Camera3DeviceSubmission_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libutils \
+	libui \
+	libgui \
+	libcamera_client \
+	libcamera_metadata \
+	libhardware \
+	libcameraservice \
+
+LOCAL_C_INCLUDES := \
+	frameworks/av/services/camera/libcameraservice \
+	system/media/camera/include \
+
+LOCAL_CFLAGS += -Werror -Wall -Wextra
+LOCAL_CLANG := true
+
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := Camera3BufferManager_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	Camera3BufferManager_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libutils \
+	libui \
+	libgui \
+	libcamera_client \
+	libhardware \
+	libcameraservice \
+
+LOCAL_C_INCLUDES := \
+	frameworks/av/services/camera/libcameraservice \
+	system/media/camera/include \
+
+LOCAL_CFLAGS += -Werror -Wall -Wextra
+LOCAL_CLANG := true
+
+include $(BUILD_NATIVE_TEST)
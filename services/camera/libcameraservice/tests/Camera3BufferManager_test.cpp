@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "Camera3BufferManager_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gui/GraphicBufferAlloc.h>
+#include <hardware/gralloc.h>
+#include <utils/Timers.h>
+
+#include "device3/Camera3BufferManager.h"
+
+namespace android {
+
+using camera3::Camera3BufferManager;
+using camera3::Camera3OutputStream;
+using camera3::StreamInfo;
+
+static const int kStreamSetId = 1;
+static const uint32_t kWidth = 64;
+static const uint32_t kHeight = 64;
+
+class Camera3BufferManagerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mManager = new Camera3BufferManager(new GraphicBufferAlloc());
+    }
+
+    virtual void TearDown() {
+        for (size_t i = 0; i < mStreamIds.size(); ++i) {
+            EXPECT_EQ(OK, mManager->unregisterStream(mStreamIds[i], kStreamSetId));
+        }
+        mManager.clear();
+    }
+
+    void registerStream(int streamId, size_t bufferCount) {
+        StreamInfo info(streamId, kStreamSetId, kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+                HAL_DATASPACE_UNKNOWN, GRALLOC_USAGE_SW_READ_OFTEN, bufferCount,
+                /*configured*/ true);
+        // No stream object: the tests return every buffer to the manager, so it never has to
+        // ask a stream to detach one.
+        wp<Camera3OutputStream> stream;
+        ASSERT_EQ(OK, mManager->registerStream(stream, info));
+        mStreamIds.push_back(streamId);
+    }
+
+    Camera3BufferManager::StreamSetStats getStats() {
+        Camera3BufferManager::StreamSetStats stats;
+        memset(&stats, 0, sizeof(stats));
+        EXPECT_EQ(OK, mManager->getStreamSetStats(kStreamSetId, &stats));
+        return stats;
+    }
+
+    // Get count buffers for a stream, then give them all back.
+    void cycleBuffers(int streamId, size_t count) {
+        std::vector<sp<GraphicBuffer>> buffers;
+        for (size_t i = 0; i < count; ++i) {
+            sp<GraphicBuffer> buffer;
+            int fenceFd = -1;
+            ASSERT_EQ(OK, mManager->getBufferForStream(streamId, kStreamSetId, &buffer,
+                    &fenceFd));
+            ASSERT_TRUE(buffer != NULL);
+            buffers.push_back(buffer);
+        }
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            ASSERT_EQ(OK, mManager->returnBufferForStream(streamId, kStreamSetId, buffers[i],
+                    -1));
+        }
+    }
+
+    sp<Camera3BufferManager> mManager;
+    std::vector<int> mStreamIds;
+};
+
+TEST_F(Camera3BufferManagerTest, ReuseAndSteal) {
+    registerStream(0, 4);
+    registerStream(1, 4);
+    ASSERT_FALSE(HasFatalFailure());
+
+    // Buffers returned by a stream are handed out to it again
+    for (int i = 0; i < 10; ++i) {
+        cycleBuffers(0, 4);
+        ASSERT_FALSE(HasFatalFailure());
+    }
+    Camera3BufferManager::StreamSetStats stats = getStats();
+    EXPECT_EQ(4u, stats.allocationCount);
+    EXPECT_EQ(4u, stats.allocatedBufferCount);
+    EXPECT_EQ(40u, stats.requestCount);
+    EXPECT_EQ(0u, stats.stealCount);
+
+    // When the other stream takes over, stream 0's free buffers make room for its buffers, so
+    // the set stays close to its water mark (max hand-out count + 1)
+    for (int i = 0; i < 10; ++i) {
+        cycleBuffers(1, 4);
+        ASSERT_FALSE(HasFatalFailure());
+    }
+    stats = getStats();
+    EXPECT_EQ(8u, stats.allocationCount);
+    EXPECT_GT(stats.stealCount, 0u);
+    EXPECT_LE(stats.allocatedBufferCount, 5u);
+
+    // Streams can't get more buffers than the set allows
+    std::vector<sp<GraphicBuffer>> buffers(4);
+    int fenceFd = -1;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        ASSERT_EQ(OK, mManager->getBufferForStream(1, kStreamSetId, &buffers[i], &fenceFd));
+    }
+    sp<GraphicBuffer> extra;
+    EXPECT_EQ(INVALID_OPERATION, mManager->getBufferForStream(1, kStreamSetId, &extra, &fenceFd));
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        ASSERT_EQ(OK, mManager->returnBufferForStream(1, kStreamSetId, buffers[i], -1));
+    }
+
+    // Unregistered streams are rejected
+    EXPECT_EQ(BAD_VALUE, mManager->getBufferForStream(2, kStreamSetId, &extra, &fenceFd));
+    EXPECT_EQ(BAD_VALUE, mManager->getBufferForStream(0, kStreamSetId + 1, &extra, &fenceFd));
+}
+
+TEST_F(Camera3BufferManagerTest, IdleStreamsAreTrimmed) {
+    registerStream(0, 4);
+    registerStream(1, 2);
+    ASSERT_FALSE(HasFatalFailure());
+
+    cycleBuffers(0, 4);
+    cycleBuffers(1, 1);
+    ASSERT_FALSE(HasFatalFailure());
+    size_t allocated = getStats().allocatedBufferCount;
+
+    // Stream 0 goes quiet while stream 1 keeps asking for a buffer at a time
+    nsecs_t start = systemTime();
+    while (systemTime() - start < 2500000000LL) {
+        cycleBuffers(1, 1);
+        ASSERT_FALSE(HasFatalFailure());
+        usleep(10000);
+    }
+
+    Camera3BufferManager::StreamSetStats stats = getStats();
+    EXPECT_GT(stats.trimCount + stats.stealCount, 0u);
+    EXPECT_LT(stats.allocatedBufferCount, allocated);
+    EXPECT_LE(stats.allocatedBufferCount, 2u);
+
+    // A trimmed stream gets new buffers when it comes back
+    cycleBuffers(0, 4);
+    ASSERT_FALSE(HasFatalFailure());
+    EXPECT_GT(getStats().allocationCount, stats.allocationCount);
+}
+
+// Several streams of one set, each asking for buffers at its own rate and holding them for a
+// few frames the way a consumer would. Every buffer must be handed to one stream at a time. The
+// streams run together, which the water mark doesn't plan for, so they keep stealing from each
+// other; still, a stream only allocates when it has no free buffer, so the set never holds more
+// buffers than the streams have in use at their peaks.
+TEST_F(Camera3BufferManagerTest, StreamsAtDifferentRates) {
+    struct StreamConfig {
+        int streamId;
+        size_t bufferCount;
+        nsecs_t framePeriod;
+        size_t heldFrames;
+    };
+    const StreamConfig kStreams[] = {
+        { 0, 6, 16666667, 3 },  // 60 fps preview
+        { 1, 4, 33333333, 2 },  // 30 fps video
+        { 2, 3, 100000000, 1 }, // 10 fps analysis
+        { 3, 2, 250000000, 1 }, // occasional stills
+    };
+    const size_t kStreamCount = sizeof(kStreams) / sizeof(kStreams[0]);
+    const nsecs_t kDuration = 2000000000LL;
+
+    size_t peakBuffers = 0;
+    for (size_t i = 0; i < kStreamCount; ++i) {
+        registerStream(kStreams[i].streamId, kStreams[i].bufferCount);
+        peakBuffers += kStreams[i].heldFrames + 1;
+    }
+    ASSERT_FALSE(HasFatalFailure());
+
+    std::mutex inUseLock;
+    std::set<GraphicBuffer*> inUse;
+    std::atomic<int> errors(0);
+    std::atomic<int> duplicates(0);
+    std::atomic<size_t> frames(0);
+
+    nsecs_t start = systemTime();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kStreamCount; ++i) {
+        threads.push_back(std::thread([&, i]() {
+            const StreamConfig& config = kStreams[i];
+            std::deque<sp<GraphicBuffer>> held;
+            for (nsecs_t frameTime = start; frameTime < start + kDuration;
+                    frameTime += config.framePeriod) {
+                nsecs_t now = systemTime();
+                if (frameTime > now) {
+                    usleep((frameTime - now) / 1000);
+                }
+
+                sp<GraphicBuffer> buffer;
+                int fenceFd = -1;
+                if (mManager->getBufferForStream(config.streamId, kStreamSetId, &buffer,
+                        &fenceFd) != OK || buffer == NULL) {
+                    errors++;
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> l(inUseLock);
+                    if (!inUse.insert(buffer.get()).second) {
+                        duplicates++;
+                    }
+                }
+                held.push_back(buffer);
+                frames++;
+
+                if (held.size() > config.heldFrames) {
+                    sp<GraphicBuffer> done = held.front();
+                    held.pop_front();
+                    {
+                        std::lock_guard<std::mutex> l(inUseLock);
+                        inUse.erase(done.get());
+                    }
+                    if (mManager->returnBufferForStream(config.streamId, kStreamSetId, done,
+                            -1) != OK) {
+                        errors++;
+                    }
+                }
+            }
+            while (!held.empty()) {
+                {
+                    std::lock_guard<std::mutex> l(inUseLock);
+                    inUse.erase(held.front().get());
+                }
+                if (mManager->returnBufferForStream(config.streamId, kStreamSetId, held.front(),
+                        -1) != OK) {
+                    errors++;
+                }
+                held.pop_front();
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    Camera3BufferManager::StreamSetStats stats = getStats();
+    ALOGI("%zu frames, %zu allocations, %zu steals, %zu trims, average wait %" PRId64
+            " us, max wait %" PRId64 " us", frames.load(), stats.allocationCount,
+            stats.stealCount, stats.trimCount,
+            stats.requestCount > 0 ? stats.totalWaitTime / (nsecs_t) stats.requestCount / 1000 : 0,
+            stats.maxWaitTime / 1000);
+
+    EXPECT_EQ(0, errors.load());
+    EXPECT_EQ(0, duplicates.load());
+    EXPECT_EQ(frames.load(), stats.requestCount);
+    EXPECT_LE(stats.allocationCount, stats.requestCount);
+    EXPECT_LE(stats.allocatedBufferCount, peakBuffers);
+}
+
+} // namespace android
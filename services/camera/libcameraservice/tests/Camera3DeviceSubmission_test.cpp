@@ -0,0 +1,540 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "Camera3DeviceSubmission_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <camera/CameraMetadata.h>
+#include <gui/BufferItemConsumer.h>
+#include <gui/BufferQueue.h>
+#include <gui/Surface.h>
+#include <hardware/camera3.h>
+#include <utils/Timers.h>
+
+#include "common/CameraModule.h"
+#include "device3/Camera3Device.h"
+
+namespace android {
+
+static const nsecs_t kFramePeriod = 8333333; // 120 fps sensor
+static const size_t kPipelineDepth = 4;
+static const uint32_t kFrames = 240;
+static const int kStreamCount = 3;
+static const uint32_t kWidth = 320;
+static const uint32_t kHeight = 240;
+
+/**
+ * A camera HAL without a camera: process_capture_request queues the request
+ * and only blocks while kPipelineDepth requests are outstanding, and a
+ * "sensor" thread completes one request per kFramePeriod. It records the
+ * time between a process_capture_request call returning and the next call,
+ * which is the framework's per-request overhead while streaming.
+ */
+class FakeCamera3Hal {
+  public:
+    static FakeCamera3Hal* sInstance;
+
+    FakeCamera3Hal() :
+            mCallbacks(NULL),
+            mExiting(false),
+            mLastReturn(0),
+            mSubmissions(0),
+            mGapTotal(0),
+            mGapMax(0),
+            mCompleted(0) {
+        memset(&mDevice, 0, sizeof(mDevice));
+        mDevice.common.tag = HARDWARE_DEVICE_TAG;
+        mDevice.common.version = CAMERA_DEVICE_API_VERSION_3_2;
+        mDevice.common.close = close;
+        mDevice.ops = &mOps;
+        mDevice.priv = this;
+
+        memset(&mOps, 0, sizeof(mOps));
+        mOps.initialize = initialize;
+        mOps.configure_streams = configureStreams;
+        mOps.construct_default_request_settings = constructDefaultRequestSettings;
+        mOps.process_capture_request = processCaptureRequest;
+        mOps.get_metadata_vendor_tag_ops = getMetadataVendorTagOps;
+        mOps.dump = dump;
+        mOps.flush = flush;
+
+        mDefaultSettings = allocate_camera_metadata(/*entries*/4, /*data*/16);
+        uint8_t controlMode = ANDROID_CONTROL_MODE_AUTO;
+        add_camera_metadata_entry(mDefaultSettings, ANDROID_CONTROL_MODE, &controlMode, 1);
+
+        mStaticInfo = allocate_camera_metadata(/*entries*/4, /*data*/16);
+        uint8_t sceneMode = ANDROID_CONTROL_SCENE_MODE_DISABLED;
+        add_camera_metadata_entry(mStaticInfo, ANDROID_CONTROL_AVAILABLE_SCENE_MODES,
+                &sceneMode, 1);
+        int32_t partialResultCount = 1;
+        add_camera_metadata_entry(mStaticInfo, ANDROID_REQUEST_PARTIAL_RESULT_COUNT,
+                &partialResultCount, 1);
+    }
+
+    ~FakeCamera3Hal() {
+        stopSensor();
+        free_camera_metadata(mDefaultSettings);
+        free_camera_metadata(mStaticInfo);
+    }
+
+    camera3_device_t* device() { return &mDevice; }
+    const camera_metadata_t* staticInfo() const { return mStaticInfo; }
+
+    uint32_t completed() const { return mCompleted.load(); }
+
+    void getSubmissionStats(size_t *count, nsecs_t *average, nsecs_t *max) {
+        std::lock_guard<std::mutex> l(mLock);
+        *count = mSubmissions;
+        *average = mSubmissions > 0 ? mGapTotal / mSubmissions : 0;
+        *max = mGapMax;
+    }
+
+  private:
+    struct Capture {
+        uint32_t frameNumber;
+        std::vector<camera3_stream_buffer_t> buffers;
+        bool hasInput;
+        camera3_stream_buffer_t inputBuffer;
+    };
+
+    static FakeCamera3Hal* get(const camera3_device_t *device) {
+        return static_cast<FakeCamera3Hal*>(device->priv);
+    }
+
+    static int close(hw_device_t *device) {
+        get(reinterpret_cast<camera3_device_t*>(device))->stopSensor();
+        return 0;
+    }
+
+    static int initialize(const camera3_device_t *device,
+            const camera3_callback_ops_t *callbacks) {
+        FakeCamera3Hal *hal = get(device);
+        hal->mCallbacks = callbacks;
+        hal->mSensor = std::thread(&FakeCamera3Hal::sensorLoop, hal);
+        return 0;
+    }
+
+    static int configureStreams(const camera3_device_t *,
+            camera3_stream_configuration_t *config) {
+        for (uint32_t i = 0; i < config->num_streams; i++) {
+            camera3_stream_t *stream = config->streams[i];
+            stream->usage |= stream->stream_type == CAMERA3_STREAM_INPUT ?
+                    GRALLOC_USAGE_HW_CAMERA_READ : GRALLOC_USAGE_HW_CAMERA_WRITE;
+            stream->max_buffers = kPipelineDepth + 1;
+        }
+        return 0;
+    }
+
+    static const camera_metadata_t* constructDefaultRequestSettings(
+            const camera3_device_t *device, int) {
+        return get(device)->mDefaultSettings;
+    }
+
+    static int processCaptureRequest(const camera3_device_t *device,
+            camera3_capture_request_t *request) {
+        FakeCamera3Hal *hal = get(device);
+        nsecs_t now = systemTime();
+
+        Capture capture;
+        capture.frameNumber = request->frame_number;
+        capture.hasInput = request->input_buffer != NULL;
+        if (capture.hasInput) {
+            capture.inputBuffer = *request->input_buffer;
+            if (capture.inputBuffer.acquire_fence >= 0) {
+                ::close(capture.inputBuffer.acquire_fence);
+            }
+            capture.inputBuffer.acquire_fence = -1;
+            capture.inputBuffer.release_fence = -1;
+            capture.inputBuffer.status = CAMERA3_BUFFER_STATUS_OK;
+        }
+        for (uint32_t i = 0; i < request->num_output_buffers; i++) {
+            camera3_stream_buffer_t buffer = request->output_buffers[i];
+            if (buffer.acquire_fence >= 0) {
+                ::close(buffer.acquire_fence);
+            }
+            buffer.acquire_fence = -1;
+            buffer.release_fence = -1;
+            buffer.status = CAMERA3_BUFFER_STATUS_OK;
+            capture.buffers.push_back(buffer);
+        }
+
+        std::unique_lock<std::mutex> l(hal->mLock);
+        if (hal->mLastReturn != 0) {
+            nsecs_t gap = now - hal->mLastReturn;
+            hal->mSubmissions++;
+            hal->mGapTotal += gap;
+            if (gap > hal->mGapMax) hal->mGapMax = gap;
+        }
+        hal->mPending.push_back(capture);
+        hal->mSignal.notify_all();
+
+        // A full pipeline holds the caller back until the sensor catches up
+        while (hal->mPending.size() >= kPipelineDepth && !hal->mExiting) {
+            hal->mSignal.wait(l);
+        }
+        hal->mLastReturn = systemTime();
+        return 0;
+    }
+
+    static void getMetadataVendorTagOps(const camera3_device_t *, vendor_tag_query_ops_t *) {
+    }
+
+    static void dump(const camera3_device_t *, int) {
+    }
+
+    static int flush(const camera3_device_t *device) {
+        FakeCamera3Hal *hal = get(device);
+        std::unique_lock<std::mutex> l(hal->mLock);
+        while (!hal->mPending.empty() && !hal->mExiting) {
+            hal->mSignal.wait(l);
+        }
+        return 0;
+    }
+
+    void sensorLoop() {
+        nsecs_t nextFrame = systemTime();
+        std::unique_lock<std::mutex> l(mLock);
+        while (!mExiting) {
+            if (mPending.empty()) {
+                mSignal.wait(l);
+                nextFrame = systemTime();
+                continue;
+            }
+            nsecs_t now = systemTime();
+            if (now < nextFrame) {
+                l.unlock();
+                usleep((nextFrame - now) / 1000);
+                l.lock();
+                continue;
+            }
+            nextFrame += kFramePeriod;
+
+            Capture capture = mPending.front();
+            mPending.pop_front();
+            l.unlock();
+            completeCapture(capture, now);
+            l.lock();
+            mSignal.notify_all();
+        }
+    }
+
+    void completeCapture(Capture &capture, nsecs_t timestamp) {
+        camera3_notify_msg_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = CAMERA3_MSG_SHUTTER;
+        msg.message.shutter.frame_number = capture.frameNumber;
+        msg.message.shutter.timestamp = timestamp;
+        mCallbacks->notify(mCallbacks, &msg);
+
+        camera_metadata_t *metadata = allocate_camera_metadata(/*entries*/1, /*data*/8);
+        int64_t sensorTimestamp = timestamp;
+        add_camera_metadata_entry(metadata, ANDROID_SENSOR_TIMESTAMP, &sensorTimestamp, 1);
+
+        camera3_capture_result_t result;
+        memset(&result, 0, sizeof(result));
+        result.frame_number = capture.frameNumber;
+        result.result = metadata;
+        result.num_output_buffers = capture.buffers.size();
+        result.output_buffers = capture.buffers.data();
+        result.input_buffer = capture.hasInput ? &capture.inputBuffer : NULL;
+        result.partial_result = 1;
+        mCallbacks->process_capture_result(mCallbacks, &result);
+
+        free_camera_metadata(metadata);
+        mCompleted++;
+    }
+
+    void stopSensor() {
+        {
+            std::lock_guard<std::mutex> l(mLock);
+            mExiting = true;
+            mSignal.notify_all();
+        }
+        if (mSensor.joinable()) {
+            mSensor.join();
+        }
+    }
+
+    camera3_device_t mDevice;
+    camera3_device_ops_t mOps;
+    const camera3_callback_ops_t *mCallbacks;
+    camera_metadata_t *mDefaultSettings;
+    camera_metadata_t *mStaticInfo;
+    std::thread mSensor;
+
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    std::deque<Capture> mPending;
+    bool mExiting;
+    nsecs_t mLastReturn;
+    size_t mSubmissions;
+    nsecs_t mGapTotal;
+    nsecs_t mGapMax;
+
+    std::atomic<uint32_t> mCompleted;
+};
+
+FakeCamera3Hal* FakeCamera3Hal::sInstance = NULL;
+
+static int fakeGetNumberOfCameras() {
+    return 1;
+}
+
+static int fakeGetCameraInfo(int, struct camera_info *info) {
+    memset(info, 0, sizeof(*info));
+    info->facing = CAMERA_FACING_BACK;
+    info->device_version = CAMERA_DEVICE_API_VERSION_3_2;
+    info->static_camera_characteristics = FakeCamera3Hal::sInstance->staticInfo();
+    return 0;
+}
+
+static int fakeOpen(const hw_module_t *, const char *, hw_device_t **device) {
+    *device = &FakeCamera3Hal::sInstance->device()->common;
+    return 0;
+}
+
+static void initFakeModule(camera_module_t *module, hw_module_methods_t *methods) {
+    memset(methods, 0, sizeof(*methods));
+    methods->open = fakeOpen;
+
+    memset(module, 0, sizeof(*module));
+    module->common.tag = HARDWARE_MODULE_TAG;
+    module->common.module_api_version = CAMERA_MODULE_API_VERSION_2_3;
+    module->common.hal_api_version = HARDWARE_HAL_API_VERSION;
+    module->common.id = CAMERA_HARDWARE_MODULE_ID;
+    module->common.name = "Fake camera HAL";
+    module->common.author = "The Android Open Source Project";
+    module->common.methods = methods;
+    module->get_number_of_cameras = fakeGetNumberOfCameras;
+    module->get_camera_info = fakeGetCameraInfo;
+}
+
+// Counts request errors, which the device sends for requests it drops
+class ErrorCounter : public CameraDeviceBase::NotificationListener {
+  public:
+    ErrorCounter() : mErrors(0) {}
+    virtual void notifyError(int32_t, const CaptureResultExtras &) { mErrors++; }
+    virtual void notifyIdle() {}
+    virtual void notifyShutter(const CaptureResultExtras &, nsecs_t) {}
+    virtual void notifyPrepared(int) {}
+    virtual void notifyAutoFocus(uint8_t, int) {}
+    virtual void notifyAutoExposure(uint8_t, int) {}
+    virtual void notifyAutoWhitebalance(uint8_t, int) {}
+    virtual void notifyRepeatingRequestError(long) {}
+
+    std::atomic<int> mErrors;
+};
+
+// Releases every frame as soon as it arrives
+class FrameDrainer : public BufferItemConsumer::FrameAvailableListener {
+  public:
+    explicit FrameDrainer(const sp<BufferItemConsumer> &consumer) : mConsumer(consumer) {}
+
+    virtual void onFrameAvailable(const BufferItem &) {
+        BufferItem item;
+        if (mConsumer->acquireBuffer(&item, 0) == OK) {
+            mConsumer->releaseBuffer(item);
+        }
+    }
+
+  private:
+    sp<BufferItemConsumer> mConsumer;
+};
+
+// Streams a repeating request to several outputs. The submission gaps are
+// logged for comparison, not checked, since they depend on the load of the
+// machine running the test.
+TEST(Camera3DeviceSubmissionTest, StreamingSubmissionGaps) {
+    FakeCamera3Hal hal;
+    FakeCamera3Hal::sInstance = &hal;
+
+    hw_module_methods_t methods;
+    camera_module_t rawModule;
+    initFakeModule(&rawModule, &methods);
+    CameraModule module(&rawModule);
+    ASSERT_EQ(OK, module.init());
+
+    sp<Camera3Device> device = new Camera3Device(0);
+    ASSERT_EQ(OK, device->initialize(&module));
+    sp<ErrorCounter> errors = new ErrorCounter();
+    ASSERT_EQ(OK, device->setNotifyCallback(errors));
+
+    std::vector<sp<BufferItemConsumer> > consumers;
+    std::vector<sp<FrameDrainer> > drainers;
+    int32_t streamIds[kStreamCount];
+    for (int i = 0; i < kStreamCount; i++) {
+        sp<IGraphicBufferProducer> producer;
+        sp<IGraphicBufferConsumer> consumer;
+        BufferQueue::createBufferQueue(&producer, &consumer);
+        sp<BufferItemConsumer> itemConsumer = new BufferItemConsumer(consumer,
+                GRALLOC_USAGE_HW_TEXTURE, /*bufferCount*/2);
+        sp<FrameDrainer> drainer = new FrameDrainer(itemConsumer);
+        itemConsumer->setFrameAvailableListener(drainer);
+        consumers.push_back(itemConsumer);
+        drainers.push_back(drainer);
+
+        int id;
+        ASSERT_EQ(OK, device->createStream(new Surface(producer), kWidth, kHeight,
+                HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED, HAL_DATASPACE_UNKNOWN,
+                CAMERA3_STREAM_ROTATION_0, &id));
+        streamIds[i] = id;
+    }
+    ASSERT_EQ(OK, device->configureStreams());
+
+    CameraMetadata request;
+    ASSERT_EQ(OK, device->createDefaultRequest(CAMERA3_TEMPLATE_PREVIEW, &request));
+    int32_t requestId = 1;
+    request.update(ANDROID_REQUEST_ID, &requestId, 1);
+    request.update(ANDROID_REQUEST_OUTPUT_STREAMS, streamIds, kStreamCount);
+    ASSERT_EQ(OK, device->setStreamingRequest(request));
+
+    std::vector<CaptureResult> results;
+    nsecs_t deadline = systemTime() + kFrames * kFramePeriod * 4;
+    while (hal.completed() < kFrames && systemTime() < deadline) {
+        if (device->waitForNextFrame(kFramePeriod * 4) == OK &&
+                device->getNextResults(&results) == OK) {
+            device->recycleResults(&results);
+        }
+    }
+
+    size_t submissions;
+    nsecs_t averageGap, maxGap;
+    hal.getSubmissionStats(&submissions, &averageGap, &maxGap);
+
+    EXPECT_EQ(OK, device->clearStreamingRequest());
+    EXPECT_EQ(OK, device->waitUntilDrained());
+    EXPECT_EQ(OK, device->disconnect());
+    FakeCamera3Hal::sInstance = NULL;
+
+    ALOGI("%zu submissions with %d streams: average gap %" PRId64 " us, max %" PRId64 " us",
+            submissions, kStreamCount, averageGap / 1000, maxGap / 1000);
+
+    EXPECT_GE(hal.completed(), kFrames);
+    EXPECT_GT(submissions, 0u);
+    EXPECT_EQ(0, errors->mErrors.load());
+}
+
+// Reprocessing back to back: every request brings its own input buffer, which
+// the application queues just before submitting it. Every request must
+// complete; the throughput is logged, with the next request's input and
+// output buffers gotten while the current one is submitted it should be close
+// to the sensor rate.
+TEST(Camera3DeviceSubmissionTest, ReprocessThroughput) {
+    FakeCamera3Hal hal;
+    FakeCamera3Hal::sInstance = &hal;
+
+    hw_module_methods_t methods;
+    camera_module_t rawModule;
+    initFakeModule(&rawModule, &methods);
+    CameraModule module(&rawModule);
+    ASSERT_EQ(OK, module.init());
+
+    sp<Camera3Device> device = new Camera3Device(0);
+    ASSERT_EQ(OK, device->initialize(&module));
+    sp<ErrorCounter> errors = new ErrorCounter();
+    ASSERT_EQ(OK, device->setNotifyCallback(errors));
+
+    int inputId;
+    ASSERT_EQ(OK, device->createInputStream(kWidth, kHeight, HAL_PIXEL_FORMAT_YCbCr_420_888,
+            &inputId));
+
+    sp<IGraphicBufferProducer> outputProducer;
+    sp<IGraphicBufferConsumer> outputConsumer;
+    BufferQueue::createBufferQueue(&outputProducer, &outputConsumer);
+    sp<BufferItemConsumer> itemConsumer = new BufferItemConsumer(outputConsumer,
+            GRALLOC_USAGE_HW_TEXTURE, /*bufferCount*/2);
+    sp<FrameDrainer> drainer = new FrameDrainer(itemConsumer);
+    itemConsumer->setFrameAvailableListener(drainer);
+    int outputId;
+    ASSERT_EQ(OK, device->createStream(new Surface(outputProducer), kWidth, kHeight,
+            HAL_PIXEL_FORMAT_YCbCr_420_888, HAL_DATASPACE_UNKNOWN,
+            CAMERA3_STREAM_ROTATION_0, &outputId));
+    ASSERT_EQ(OK, device->configureStreams());
+
+    sp<IGraphicBufferProducer> inputProducer;
+    ASSERT_EQ(OK, device->getInputBufferProducer(&inputProducer));
+    sp<Surface> inputSurface = new Surface(inputProducer);
+    ANativeWindow *inputWindow = inputSurface.get();
+    ASSERT_EQ(OK, native_window_api_connect(inputWindow, NATIVE_WINDOW_API_CPU));
+
+    CameraMetadata request;
+    ASSERT_EQ(OK, device->createDefaultRequest(CAMERA3_TEMPLATE_STILL_CAPTURE, &request));
+    int32_t requestId = 1;
+    request.update(ANDROID_REQUEST_ID, &requestId, 1);
+    request.update(ANDROID_REQUEST_INPUT_STREAMS, &inputId, 1);
+    request.update(ANDROID_REQUEST_OUTPUT_STREAMS, &outputId, 1);
+
+    // Submit from another thread, the way an application keeps reprocessing
+    // frames it had saved; queueing input buffers blocks once the device and
+    // HAL hold all of them
+    std::atomic<int> submitErrors(0);
+    nsecs_t start = systemTime();
+    std::thread submitter([&]() {
+        for (uint32_t i = 0; i < kFrames; i++) {
+            ANativeWindowBuffer *buffer;
+            if (native_window_dequeue_buffer_and_wait(inputWindow, &buffer) != OK ||
+                    inputWindow->queueBuffer(inputWindow, buffer, -1) != OK ||
+                    device->capture(request) != OK) {
+                submitErrors++;
+                return;
+            }
+        }
+    });
+
+    std::vector<CaptureResult> results;
+    nsecs_t deadline = start + kFrames * kFramePeriod * 4;
+    while (hal.completed() < kFrames && systemTime() < deadline) {
+        if (device->waitForNextFrame(kFramePeriod * 4) == OK &&
+                device->getNextResults(&results) == OK) {
+            device->recycleResults(&results);
+        }
+    }
+    nsecs_t elapsed = systemTime() - start;
+    submitter.join();
+
+    size_t submissions;
+    nsecs_t averageGap, maxGap;
+    hal.getSubmissionStats(&submissions, &averageGap, &maxGap);
+
+    EXPECT_EQ(OK, device->waitUntilDrained());
+    native_window_api_disconnect(inputWindow, NATIVE_WINDOW_API_CPU);
+    EXPECT_EQ(OK, device->disconnect());
+    FakeCamera3Hal::sInstance = NULL;
+
+    double fps = hal.completed() * 1e9 / elapsed;
+    ALOGI("%u reprocess requests at %.1f fps: average gap %" PRId64 " us, max %" PRId64 " us",
+            hal.completed(), fps, averageGap / 1000, maxGap / 1000);
+
+    EXPECT_EQ(0, submitErrors.load());
+    EXPECT_GE(hal.completed(), kFrames);
+    EXPECT_EQ(0, errors->mErrors.load());
+}
+
+} // namespace android
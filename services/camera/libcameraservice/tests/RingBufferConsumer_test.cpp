@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "RingBufferConsumer_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gui/BufferQueue.h>
+#include <gui/RingBufferConsumer.h>
+#include <gui/Surface.h>
+#include <hardware/gralloc.h>
+#include <system/window.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static const int kBufferCount = 8;
+static const uint32_t kWidth = 64;
+static const uint32_t kHeight = 64;
+static const nsecs_t kFramePeriod = 16666667; // 60 fps
+
+// Frame n carries timestamp n * kFramePeriod and has n written to its first
+// pixels, so a pinned buffer can be checked against its timestamp.
+static nsecs_t frameTimestamp(uint64_t frame) {
+    return frame * kFramePeriod;
+}
+
+class RingBufferConsumerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        sp<IGraphicBufferProducer> producer;
+        sp<IGraphicBufferConsumer> consumer;
+        BufferQueue::createBufferQueue(&producer, &consumer);
+
+        mRing = new RingBufferConsumer(consumer,
+                GRALLOC_USAGE_SW_READ_OFTEN, kBufferCount);
+        mRing->setName(String8("RingBufferConsumer_test"));
+        ASSERT_EQ(OK, mRing->setDefaultBufferSize(kWidth, kHeight));
+        ASSERT_EQ(OK, mRing->setDefaultBufferFormat(HAL_PIXEL_FORMAT_RGBA_8888));
+
+        mSurface = new Surface(producer);
+        ANativeWindow* window = mSurface.get();
+        ASSERT_EQ(OK, native_window_set_usage(window,
+                GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN));
+    }
+
+    virtual void TearDown() {
+        mSurface.clear();
+        mRing.clear();
+    }
+
+    // Queue one frame; blocks in dequeue if all buffers are taken.
+    void queueFrame(uint64_t frame) {
+        ANativeWindow* window = mSurface.get();
+        ASSERT_EQ(OK, native_window_set_buffers_timestamp(window, frameTimestamp(frame)));
+
+        ANativeWindow_Buffer buffer;
+        ASSERT_EQ(OK, mSurface->lock(&buffer, NULL));
+        memcpy(buffer.bits, &frame, sizeof(frame));
+        ASSERT_EQ(OK, mSurface->unlockAndPost());
+    }
+
+    // Returns the frame number written into a pinned buffer.
+    static uint64_t readFrame(const sp<RingBufferConsumer::PinnedBufferItem>& pinned) {
+        const sp<GraphicBuffer>& buffer = pinned->getBufferItem().mGraphicBuffer;
+        void* bits = NULL;
+        uint64_t frame = 0;
+        if (buffer->lock(GRALLOC_USAGE_SW_READ_OFTEN, &bits) == OK) {
+            memcpy(&frame, bits, sizeof(frame));
+            buffer->unlock();
+        }
+        return frame;
+    }
+
+    sp<RingBufferConsumer> mRing;
+    sp<Surface> mSurface;
+};
+
+TEST_F(RingBufferConsumerTest, PinByTimestamp) {
+    EXPECT_EQ(0, mRing->getLatestTimestamp());
+    EXPECT_TRUE(mRing->pinBufferByTimestamp(frameTimestamp(1)) == NULL);
+
+    // Fill the ring with frames 1..kBufferCount + 2; frames 1 and 2 get evicted.
+    const uint64_t lastFrame = kBufferCount + 2;
+    for (uint64_t frame = 1; frame <= lastFrame; ++frame) {
+        queueFrame(frame);
+    }
+    // onFrameAvailable runs on the producer's thread in-process
+    EXPECT_EQ(frameTimestamp(lastFrame), mRing->getLatestTimestamp());
+
+    // Exact match
+    sp<RingBufferConsumer::PinnedBufferItem> pinned =
+            mRing->pinBufferByTimestamp(frameTimestamp(5));
+    ASSERT_TRUE(pinned != NULL);
+    EXPECT_EQ(frameTimestamp(5), pinned->getBufferItem().mTimestamp);
+    EXPECT_EQ(5u, readFrame(pinned));
+
+    // Between two frames: the older one
+    pinned = mRing->pinBufferByTimestamp(frameTimestamp(6) + kFramePeriod / 2);
+    ASSERT_TRUE(pinned != NULL);
+    EXPECT_EQ(frameTimestamp(6), pinned->getBufferItem().mTimestamp);
+
+    // Older than everything in the ring: the oldest frame
+    pinned = mRing->pinBufferByTimestamp(frameTimestamp(1));
+    ASSERT_TRUE(pinned != NULL);
+    EXPECT_EQ(frameTimestamp(3), pinned->getBufferItem().mTimestamp);
+
+    // A pinned frame survives eviction, so the oldest frame stays frame 3
+    for (uint64_t frame = lastFrame + 1; frame <= lastFrame + kBufferCount; ++frame) {
+        queueFrame(frame);
+    }
+    EXPECT_EQ(3u, readFrame(pinned));
+    sp<RingBufferConsumer::PinnedBufferItem> oldest =
+            mRing->pinBufferByTimestamp(frameTimestamp(1));
+    ASSERT_TRUE(oldest != NULL);
+    EXPECT_EQ(frameTimestamp(3), oldest->getBufferItem().mTimestamp);
+    oldest.clear();
+    pinned.clear();
+
+    // clear() drops everything that is not pinned
+    EXPECT_EQ(OK, mRing->clear());
+    EXPECT_EQ(0, mRing->getLatestTimestamp());
+    EXPECT_TRUE(mRing->pinBufferByTimestamp(frameTimestamp(1)) == NULL);
+}
+
+// Feed frames at 60 fps while several threads keep picking recent frames the
+// way ZSL reprocessing does, and check that a pinned buffer is never
+// recycled underneath its user and that every frame is taken into the ring
+// as it is queued, whatever the pickers hold.
+TEST_F(RingBufferConsumerTest, ConcurrentPinsAt60Fps) {
+    const uint64_t kFrames = 300;
+    // Fewer pickers than buffers, so that there is always a frame to evict
+    const int kPickers = 3;
+
+    std::atomic<uint64_t> latestFrame(0);
+    std::atomic<bool> done(false);
+    std::atomic<int> mismatches(0);
+    std::atomic<int> picks(0);
+    std::atomic<nsecs_t> maxPinLatency(0);
+
+    std::vector<std::thread> pickers;
+    for (int i = 0; i < kPickers; ++i) {
+        pickers.push_back(std::thread([&, i]() {
+            unsigned int seed = i;
+            while (!done.load()) {
+                uint64_t latest = latestFrame.load();
+                if (latest == 0) {
+                    usleep(1000);
+                    continue;
+                }
+                uint64_t back = rand_r(&seed) % kBufferCount;
+                uint64_t wanted = latest > back ? latest - back : 1;
+
+                nsecs_t start = systemTime();
+                sp<RingBufferConsumer::PinnedBufferItem> pinned =
+                        mRing->pinBufferByTimestamp(frameTimestamp(wanted));
+                nsecs_t latency = systemTime() - start;
+                nsecs_t previous = maxPinLatency.load();
+                while (latency > previous &&
+                        !maxPinLatency.compare_exchange_weak(previous, latency)) {
+                }
+                if (pinned == NULL) {
+                    continue;
+                }
+
+                uint64_t frame = pinned->getBufferItem().mTimestamp / kFramePeriod;
+                if (readFrame(pinned) != frame) {
+                    mismatches++;
+                }
+                // Hold the buffer across a few new frames, as a reprocess would
+                usleep(rand_r(&seed) % (3 * kFramePeriod / 1000));
+                if (readFrame(pinned) != frame) {
+                    mismatches++;
+                }
+                picks++;
+            }
+        }));
+    }
+
+    nsecs_t start = systemTime();
+    int lateFrames = 0;
+    for (uint64_t frame = 1; frame <= kFrames; ++frame) {
+        nsecs_t deadline = start + frame * kFramePeriod;
+        nsecs_t now = systemTime();
+        if (deadline > now) {
+            usleep((deadline - now) / 1000);
+        }
+        queueFrame(frame);
+        if (mRing->getLatestTimestamp() != frameTimestamp(frame)) {
+            lateFrames++;
+        }
+        latestFrame.store(frame);
+    }
+
+    done.store(true);
+    for (size_t i = 0; i < pickers.size(); ++i) {
+        pickers[i].join();
+    }
+
+    ALOGI("%d picks, max pin latency %" PRId64 " us",
+            picks.load(), maxPinLatency.load() / 1000);
+
+    EXPECT_EQ(0, mismatches.load());
+    EXPECT_GT(picks.load(), 0);
+    EXPECT_EQ(frameTimestamp(kFrames), mRing->getLatestTimestamp());
+    // Pinned buffers never keep a new frame out of the ring
+    EXPECT_EQ(0, lateFrames);
+}
+
+} // namespace android
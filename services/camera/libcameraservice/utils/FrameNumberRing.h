@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_FRAMENUMBERRING_H
+#define ANDROID_SERVERS_CAMERA_FRAMENUMBERRING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include <utils/Errors.h>
+#include <utils/Log.h>
+
+namespace android {
+
+/**
+ * A map from frame number to VALUE, for frame numbers that are handed out in
+ * increasing order and retired roughly in the same order, such as in-flight
+ * capture requests.
+ *
+ * Entries live in a power-of-two array indexed by the low bits of the frame
+ * number, so lookup, insertion and removal are O(1) and reuse the same storage
+ * frame after frame. The array only grows when a new frame number lands on a
+ * slot that still holds a live frame, and never past maxCapacity slots: a
+ * frame that is still there maxCapacity frames later is dropped, with an
+ * error logged, to make room for the new one.
+ *
+ * Indices returned by add() and indexOfKey() are array slots; they stay valid
+ * until the entry is removed or another entry is added. Iterate with
+ * firstIndex()/nextIndex().
+ */
+template <typename VALUE>
+class FrameNumberRing {
+  public:
+    explicit FrameNumberRing(size_t initialCapacity = kDefaultCapacity,
+            size_t maxCapacity = kDefaultMaxCapacity) : mSize(0) {
+        size_t capacity = 1;
+        while (capacity < initialCapacity) capacity <<= 1;
+        mSlots.resize(capacity);
+        mMaxCapacity = capacity;
+        while (mMaxCapacity < maxCapacity) mMaxCapacity <<= 1;
+    }
+
+    size_t size() const { return mSize; }
+    bool isEmpty() const { return mSize == 0; }
+
+    // Returns the index of the frame, or NAME_NOT_FOUND.
+    ssize_t indexOfKey(uint32_t frameNumber) const {
+        size_t index = frameNumber & (mSlots.size() - 1);
+        const Slot &slot = mSlots[index];
+        if (!slot.used || slot.frameNumber != frameNumber) {
+            return NAME_NOT_FOUND;
+        }
+        return index;
+    }
+
+    // Returns the index of the new entry, or ALREADY_EXISTS.
+    ssize_t add(uint32_t frameNumber, const VALUE &value) {
+        size_t index = frameNumber & (mSlots.size() - 1);
+        while (mSlots[index].used) {
+            if (mSlots[index].frameNumber == frameNumber) {
+                return ALREADY_EXISTS;
+            }
+            if (!grow()) {
+                ALOGE("%s: Frame %u still present at frame %u, dropping it", __FUNCTION__,
+                        mSlots[index].frameNumber, frameNumber);
+                removeItemAt(index);
+                break;
+            }
+            index = frameNumber & (mSlots.size() - 1);
+        }
+        Slot &slot = mSlots[index];
+        slot.used = true;
+        slot.frameNumber = frameNumber;
+        slot.value = value;
+        mSize++;
+        return index;
+    }
+
+    uint32_t keyAt(size_t index) const { return mSlots[index].frameNumber; }
+    const VALUE& valueAt(size_t index) const { return mSlots[index].value; }
+    VALUE& editValueAt(size_t index) { return mSlots[index].value; }
+
+    void removeItemAt(size_t index) {
+        Slot &slot = mSlots[index];
+        if (!slot.used) return;
+        slot.used = false;
+        // Drop whatever the value holds on to
+        slot.value = VALUE();
+        mSize--;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < mSlots.size(); i++) {
+            removeItemAt(i);
+        }
+    }
+
+    ssize_t firstIndex() const { return nextIndex(-1); }
+
+    // Returns the next used index after the given one, or NAME_NOT_FOUND.
+    ssize_t nextIndex(ssize_t index) const {
+        for (size_t i = index + 1; i < mSlots.size(); i++) {
+            if (mSlots[i].used) return i;
+        }
+        return NAME_NOT_FOUND;
+    }
+
+  private:
+    static const size_t kDefaultCapacity = 32;
+    static const size_t kDefaultMaxCapacity = 4096;
+
+    struct Slot {
+        Slot() : used(false), frameNumber(0) {}
+        bool used;
+        uint32_t frameNumber;
+        VALUE value;
+    };
+
+    // Double the capacity until all live frames map to distinct slots.
+    // Returns false, leaving the array as it was, if that takes more than
+    // mMaxCapacity slots.
+    bool grow() {
+        size_t capacity = mSlots.size();
+        bool collision;
+        std::vector<Slot> slots;
+        do {
+            if (capacity >= mMaxCapacity) return false;
+            capacity <<= 1;
+            slots.clear();
+            slots.resize(capacity);
+            collision = false;
+            for (size_t i = 0; i < mSlots.size() && !collision; i++) {
+                if (!mSlots[i].used) continue;
+                Slot &slot = slots[mSlots[i].frameNumber & (capacity - 1)];
+                if (slot.used) {
+                    collision = true;
+                } else {
+                    slot = mSlots[i];
+                }
+            }
+        } while (collision);
+        mSlots.swap(slots);
+        return true;
+    }
+
+    std::vector<Slot> mSlots;
+    size_t mSize;
+    size_t mMaxCapacity;
+};
+
+} // namespace android
+
+#endif